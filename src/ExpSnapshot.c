@@ -0,0 +1,606 @@
+/* ExpSnapshot.c - Compiled experiment snapshot of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "SeqUtil.h"
+#include "SeqNode.h"
+#include "SeqDepends.h"
+#include "XmlUtils.h"
+#include "ExpSnapshot.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Inner workings.
+ * The image is a header, the table of files, the table of nodes sorted by
+ * path, the file indices of each node (refs) and a blob holding the strings
+ * and the packed nodes.  A packed node is the list of the fields nodeinfo()
+ * sets, in the order of snap_strings() and snap_ints() followed by the lists;
+ * a string is its length (~0 for NULL) and its bytes, a number is 32 bits.
+ * Fields set by the caller of nodeinfo() (datestamp, experiment home, loop
+ * arguments, extension, ...) are not packed.
+ *
+ * While writing, the hook of SeqUtil_noteFile() enters every file read in the
+ * table of files (hashed on its name) and in the refs of the node being built.
+********************************************************************************/
+
+#define SNAP_ORDER     0x01020304
+#define SNAP_NULL      0xffffffff
+#define SNAP_BUCKETS   4096
+
+typedef struct {
+   char *buf;
+   size_t len, size;
+} SnapBuffer;
+
+typedef struct {
+   ExpSnapFile file;
+   int validity;        /* the file has VALIDITY tags */
+   int next;            /* hash chain */
+} SnapWFile;
+
+/* snapshot being written */
+static struct {
+   int recording;
+   char *expHome;
+   SnapBuffer blob, refs, nodes;
+   SnapWFile *files;
+   int nfiles, maxfiles;
+   int bucket[SNAP_BUCKETS];
+   int first;           /* first ref of the node being built */
+} SnapW;
+
+/* snapshot mapped for reading */
+static struct {
+   char *expHome;
+   char *map;
+   size_t size;
+   const ExpSnapHeader *hdr;
+} SnapR;
+
+static void snap_grow( SnapBuffer *b, size_t len ) {
+   if ( b->len + len <= b->size ) return;
+   while ( b->len + len > b->size ) b->size = b->size ? b->size * 2 : 65536;
+   if ( (b->buf = realloc(b->buf, b->size)) == NULL )
+      raiseError("OutOfMemory exception in ExpSnapshot\n");
+}
+
+static void snap_put( SnapBuffer *b, const void *data, size_t len ) {
+   snap_grow(b, len);
+   memcpy(b->buf + b->len, data, len);
+   b->len += len;
+}
+
+static void snap_putInt( SnapBuffer *b, uint32_t value ) {
+   snap_put(b, &value, sizeof(value));
+}
+
+static void snap_putStr( SnapBuffer *b, const char *s ) {
+   if ( s == NULL ) {
+      snap_putInt(b, SNAP_NULL);
+   } else {
+      snap_putInt(b, strlen(s));
+      snap_put(b, s, strlen(s));
+   }
+}
+
+/* adds a NUL terminated string to the blob, returns its offset */
+static uint32_t snap_string( const char *s ) {
+   uint32_t offset = SnapW.blob.len;
+   snap_put(&SnapW.blob, s, strlen(s) + 1);
+   return offset;
+}
+
+static unsigned int snap_hash( const char *s ) {
+   unsigned int h = 2166136261u;
+   while ( *s ) h = (h ^ (unsigned char) *s++) * 16777619u;
+   return h;
+}
+
+/* the packed string fields of a node */
+static void snap_strings( SeqNodeDataPtr n, char **fields[] ) {
+   int i = 0;
+   fields[i++] = &n->nodeName;      fields[i++] = &n->suiteName;
+   fields[i++] = &n->container;     fields[i++] = &n->intramodule_container;
+   fields[i++] = &n->module;        fields[i++] = &n->pathToModule;
+   fields[i++] = &n->queue;         fields[i++] = &n->machine;
+   fields[i++] = &n->memory;        fields[i++] = &n->cpu;
+   fields[i++] = &n->cpu_multiplier;fields[i++] = &n->npex;
+   fields[i++] = &n->npey;          fields[i++] = &n->omp;
+   fields[i++] = &n->soumetArgs;    fields[i++] = &n->workq;
+   fields[i++] = &n->workerPath;    fields[i++] = &n->alias;
+   fields[i++] = &n->args;          fields[i++] = &n->submitOrigin;
+   fields[i++] = &n->shell;         fields[i++] = &n->taskPath;
+   fields[i++] = &n->errormsg;
+   fields[i] = NULL;
+}
+
+/* the packed number fields of a node, the type apart */
+static void snap_ints( SeqNodeDataPtr n, int *fields[] ) {
+   int i = 0;
+   fields[i++] = &n->silent;        fields[i++] = &n->catchup;
+   fields[i++] = &n->mpi;           fields[i++] = &n->wallclock;
+   fields[i++] = &n->isLastArg;     fields[i++] = &n->immediateMode;
+   fields[i++] = &n->error;
+   fields[i] = NULL;
+}
+
+/* the packed string fields of a dependency */
+static void snap_depStrings( SeqDepDataPtr d, char **fields[] ) {
+   int i = 0;
+   fields[i++] = &d->node_name;     fields[i++] = &d->node_path;
+   fields[i++] = &d->exp;           fields[i++] = &d->status;
+   fields[i++] = &d->index;         fields[i++] = &d->ext;
+   fields[i++] = &d->local_index;   fields[i++] = &d->local_ext;
+   fields[i++] = &d->hour;          fields[i++] = &d->time_delta;
+   fields[i++] = &d->datestamp;     fields[i++] = &d->valid_hour;
+   fields[i++] = &d->valid_dow;     fields[i++] = &d->protocol;
+   fields[i] = NULL;
+}
+
+static void snap_putList( SnapBuffer *b, LISTNODEPTR list ) {
+   LISTNODEPTR itr;
+   uint32_t count = 0;
+   for ( itr = list; itr != NULL; itr = itr->nextPtr ) count++;
+   snap_putInt(b, count);
+   for ( itr = list; itr != NULL; itr = itr->nextPtr ) snap_putStr(b, itr->data);
+}
+
+static void snap_putNameValues( SnapBuffer *b, SeqNameValuesPtr list ) {
+   SeqNameValuesPtr itr;
+   uint32_t count = 0;
+   for ( itr = list; itr != NULL; itr = itr->nextPtr ) count++;
+   snap_putInt(b, count);
+   for ( itr = list; itr != NULL; itr = itr->nextPtr ) {
+      snap_putStr(b, itr->name);
+      snap_putStr(b, itr->value);
+   }
+}
+
+static void snap_pack( SnapBuffer *b, SeqNodeDataPtr n ) {
+   char **strings[32], ***s;
+   int *ints[16], **i;
+   SeqDepNodePtr dep;
+   SeqLoopsPtr loop;
+   uint32_t count;
+
+   snap_putInt(b, n->type);
+   snap_ints(n, ints);
+   for ( i = ints; *i != NULL; i++ ) snap_putInt(b, **i);
+   snap_strings(n, strings);
+   for ( s = strings; *s != NULL; s++ ) snap_putStr(b, **s);
+
+   snap_putInt(b, n->forEachTarget != NULL);
+   if ( n->forEachTarget != NULL ) {
+      snap_putStr(b, n->forEachTarget->node);
+      snap_putStr(b, n->forEachTarget->index);
+      snap_putStr(b, n->forEachTarget->exp);
+      snap_putStr(b, n->forEachTarget->hour);
+   }
+
+   snap_putList(b, n->submits);
+   snap_putList(b, n->abort_actions);
+   snap_putList(b, n->siblings);
+   snap_putNameValues(b, n->data);
+
+   for ( count = 0, loop = n->loops; loop != NULL; loop = loop->nextPtr ) count++;
+   snap_putInt(b, count);
+   for ( loop = n->loops; loop != NULL; loop = loop->nextPtr ) {
+      snap_putInt(b, loop->type);
+      snap_putStr(b, loop->loop_name);
+      snap_putNameValues(b, loop->values);
+   }
+
+   for ( count = 0, dep = n->dependencies; dep != NULL; dep = (SeqDepNodePtr) dep->nextPtr ) count++;
+   snap_putInt(b, count);
+   for ( dep = n->dependencies; dep != NULL; dep = (SeqDepNodePtr) dep->nextPtr ) {
+      SeqDepDataPtr d = dep->depData;
+      snap_putInt(b, d->type);
+      snap_putInt(b, d->exp_scope);
+      snap_putInt(b, d->isInScope);
+      snap_depStrings(d, strings);
+      for ( s = strings; *s != NULL; s++ ) snap_putStr(b, **s);
+   }
+}
+
+/********************************************************************************
+ * Reading a packed node.  The image was renamed in place once complete, an
+ * overrun means it was damaged afterwards.
+********************************************************************************/
+typedef struct {
+   const char *p, *end;
+} SnapReader;
+
+static uint32_t snap_getInt( SnapReader *r ) {
+   uint32_t value;
+   if ( r->end - r->p < sizeof(value) ) raiseError("ExpSnapshot: %s/%s is damaged, remove it\n", SnapR.expHome, EXPSNAP_FILE);
+   memcpy(&value, r->p, sizeof(value));
+   r->p += sizeof(value);
+   return value;
+}
+
+static char *snap_getStr( SnapReader *r ) {
+   uint32_t len = snap_getInt(r);
+   char *s;
+   if ( len == SNAP_NULL ) return NULL;
+   if ( r->end - r->p < len ) raiseError("ExpSnapshot: %s/%s is damaged, remove it\n", SnapR.expHome, EXPSNAP_FILE);
+   if ( (s = malloc(len + 1)) == NULL ) raiseError("OutOfMemory exception in ExpSnapshot\n");
+   memcpy(s, r->p, len);
+   s[len] = '\0';
+   r->p += len;
+   return s;
+}
+
+static void snap_getList( SnapReader *r, LISTNODEPTR *list ) {
+   uint32_t count = snap_getInt(r);
+   char *data;
+   SeqListNode_deleteWholeList(list);
+   while ( count-- > 0 ) {
+      data = snap_getStr(r);
+      SeqListNode_insertItem(list, data ? data : "");
+      free(data);
+   }
+}
+
+static void snap_getNameValues( SnapReader *r, SeqNameValuesPtr *list ) {
+   uint32_t count = snap_getInt(r);
+   char *name, *value;
+   SeqNameValues_deleteWholeList(list);
+   while ( count-- > 0 ) {
+      name = snap_getStr(r);
+      value = snap_getStr(r);
+      SeqNameValues_insertItem(list, name ? name : "", value ? value : "");
+      free(name);
+      free(value);
+   }
+}
+
+static void snap_unpack( SnapReader *r, SeqNodeDataPtr n ) {
+   char **strings[32], ***s;
+   int *ints[16], **i;
+   SeqLoopsPtr loop;
+   SeqDepDataPtr d;
+   uint32_t count;
+
+   n->type = (SeqNodeType) snap_getInt(r);
+   snap_ints(n, ints);
+   for ( i = ints; *i != NULL; i++ ) **i = (int) snap_getInt(r);
+   snap_strings(n, strings);
+   for ( s = strings; *s != NULL; s++ ) {
+      free(**s);
+      **s = snap_getStr(r);
+   }
+
+   if ( snap_getInt(r) ) {
+      char *node = snap_getStr(r), *index = snap_getStr(r), *exp = snap_getStr(r), *hour = snap_getStr(r);
+      SeqNode_setForEachTarget(n, node, index, exp, hour);
+      free(node); free(index); free(exp); free(hour);
+   }
+
+   snap_getList(r, &n->submits);
+   snap_getList(r, &n->abort_actions);
+   snap_getList(r, &n->siblings);
+   snap_getNameValues(r, &n->data);
+
+   count = snap_getInt(r);
+   while ( count-- > 0 ) {
+      loop = SeqNode_allocateLoopsEntry(n);
+      loop->type = (SeqLoopType) snap_getInt(r);
+      loop->loop_name = snap_getStr(r);
+      snap_getNameValues(r, &loop->values);
+   }
+
+   count = snap_getInt(r);
+   while ( count-- > 0 ) {
+      d = SeqDep_newDep();
+      d->type = (SeqDependsType) snap_getInt(r);
+      d->exp_scope = (SeqDependsScope) snap_getInt(r);
+      d->isInScope = (int) snap_getInt(r);
+      snap_depStrings(d, strings);
+      for ( s = strings; *s != NULL; s++ ) {
+         free(**s);
+         **s = snap_getStr(r);
+      }
+      SeqNode_addNodeDependency(n, d);
+   }
+}
+
+/********************************************************************************
+ * Writing
+********************************************************************************/
+
+/* hook of SeqUtil_noteFile(): enters the file in the table and in the refs of
+   the node being built */
+static void snap_noteFile( const char *filename ) {
+   unsigned int h = snap_hash(filename) % SNAP_BUCKETS;
+   uint32_t *refs;
+   struct stat st;
+   SnapWFile *f;
+   char *content;
+   int i, fd;
+
+   for ( i = SnapW.bucket[h]; i >= 0; i = SnapW.files[i].next ) {
+      if ( strcmp(SnapW.blob.buf + SnapW.files[i].file.path, filename) == 0 ) break;
+   }
+
+   if ( i < 0 ) {
+      if ( SnapW.nfiles == SnapW.maxfiles ) {
+         SnapW.maxfiles = SnapW.maxfiles ? SnapW.maxfiles * 2 : 1024;
+         if ( (SnapW.files = realloc(SnapW.files, SnapW.maxfiles * sizeof(SnapWFile))) == NULL )
+            raiseError("OutOfMemory exception in ExpSnapshot\n");
+      }
+      i = SnapW.nfiles++;
+      f = &SnapW.files[i];
+      memset(f, 0, sizeof(*f));
+      f->file.path = snap_string(filename);
+      if ( stat(filename, &st) != 0 ) {
+         f->file.missing = 1;
+      } else {
+         f->file.mtime = st.st_mtim.tv_sec;
+         f->file.mtime_nsec = st.st_mtim.tv_nsec;
+         f->file.size = st.st_size;
+         /* VALIDITY tags make the resources depend on the datestamp */
+         if ( (fd = open(filename, O_RDONLY)) >= 0 ) {
+            if ( (content = malloc(st.st_size + 1)) != NULL ) {
+               ssize_t got = read(fd, content, st.st_size);
+               content[got > 0 ? got : 0] = '\0';
+               f->validity = strstr(content, "<VALIDITY") != NULL;
+               free(content);
+            }
+            close(fd);
+         }
+      }
+      f->next = SnapW.bucket[h];
+      SnapW.bucket[h] = i;
+   }
+
+   refs = (uint32_t *) SnapW.refs.buf;
+   for ( h = SnapW.first; h < SnapW.refs.len / sizeof(uint32_t); h++ ) {
+      if ( refs[h] == i ) return;
+   }
+   snap_putInt(&SnapW.refs, i);
+}
+
+void ExpSnapshot_begin( const char *_exp_home ) {
+   int i;
+   ExpSnapshot_close();
+   memset(&SnapW, 0, sizeof(SnapW));
+   for ( i = 0; i < SNAP_BUCKETS; i++ ) SnapW.bucket[i] = -1;
+   SnapW.recording = 1;
+   SnapW.expHome = strdup(_exp_home);
+   snap_string(_exp_home);
+   SeqUtil_setFileHook(snap_noteFile);
+   /* a cached resource file would not show the definition files it was resolved with */
+   XmlUtils_setDocCache(0);
+}
+
+void ExpSnapshot_skipNode( void ) {
+   SnapW.refs.len = SnapW.first * sizeof(uint32_t);
+}
+
+int ExpSnapshot_addNode( SeqNodeDataPtr _nodeDataPtr ) {
+   uint32_t *refs = (uint32_t *) SnapW.refs.buf;
+   size_t nrefs = SnapW.refs.len / sizeof(uint32_t), r;
+   SeqDepNodePtr dep;
+   ExpSnapNode node;
+
+   if ( _nodeDataPtr->switchAnswers != NULL ) goto skip;
+   for ( r = SnapW.first; r < nrefs; r++ ) {
+      if ( SnapW.files[refs[r]].validity ) goto skip;
+   }
+
+   memset(&node, 0, sizeof(node));
+   node.path = snap_string(_nodeDataPtr->name);
+   node.ref = SnapW.first;
+   node.nref = nrefs - SnapW.first;
+   for ( dep = _nodeDataPtr->dependencies; dep != NULL; dep = (SeqDepNodePtr) dep->nextPtr ) {
+      SeqDepDataPtr d = dep->depData;
+      if ( _nodeDataPtr->loops != NULL ||
+           (d->index && (strstr(d->index, "CURRENT_INDEX") || strstr(d->index, "$(("))) ||
+           (d->local_index && (strstr(d->local_index, "CURRENT_INDEX") || strstr(d->local_index, "$((")))) {
+         node.flags |= EXPSNAP_LOOPDEP;
+      }
+   }
+   node.data = SnapW.blob.len;
+   snap_pack(&SnapW.blob, _nodeDataPtr);
+   node.len = SnapW.blob.len - node.data;
+   snap_put(&SnapW.nodes, &node, sizeof(node));
+   SnapW.first = nrefs;
+   return 0;
+
+skip:
+   ExpSnapshot_skipNode();
+   return 1;
+}
+
+static const char *SnapSortBlob;
+
+static int snap_compareNodes( const void *a, const void *b ) {
+   return strcmp(SnapSortBlob + ((const ExpSnapNode *) a)->path, SnapSortBlob + ((const ExpSnapNode *) b)->path);
+}
+
+int ExpSnapshot_write( const char *filename ) {
+   ExpSnapHeader hdr;
+   char tmp[SEQ_MAXFIELD];
+   FILE *fp = NULL;
+   int i, fd, retval = -1, nnodes = SnapW.nodes.len / sizeof(ExpSnapNode);
+
+   SeqUtil_setFileHook(NULL);
+   XmlUtils_setDocCache(1);
+
+   SnapSortBlob = SnapW.blob.buf;
+   qsort(SnapW.nodes.buf, nnodes, sizeof(ExpSnapNode), snap_compareNodes);
+
+   memset(&hdr, 0, sizeof(hdr));
+   memcpy(hdr.magic, EXPSNAP_MAGIC, strlen(EXPSNAP_MAGIC));
+   hdr.version = EXPSNAP_VERSION;
+   hdr.order = SNAP_ORDER;
+   hdr.nfiles = SnapW.nfiles;
+   hdr.nnodes = nnodes;
+   hdr.nrefs = SnapW.refs.len / sizeof(uint32_t);
+   hdr.expHome = 0;
+   hdr.files = sizeof(hdr);
+   hdr.nodes = hdr.files + hdr.nfiles * sizeof(ExpSnapFile);
+   hdr.refs = hdr.nodes + SnapW.nodes.len;
+   hdr.blob = hdr.refs + SnapW.refs.len;
+   hdr.size = hdr.blob + SnapW.blob.len;
+
+   /* written aside and renamed: a reader never maps a partial image */
+   snprintf(tmp, sizeof(tmp), "%s.XXXXXX", filename);
+   if ( (fd = mkstemp(tmp)) < 0 || (fp = fdopen(fd, "w")) == NULL ) {
+      SeqUtil_TRACE(TL_ERROR, "ExpSnapshot: cannot create %s errno=%d\n", tmp, errno);
+      goto out;
+   }
+   fchmod(fd, 0644);
+   fwrite(&hdr, sizeof(hdr), 1, fp);
+   for ( i = 0; i < SnapW.nfiles; i++ ) fwrite(&SnapW.files[i].file, sizeof(ExpSnapFile), 1, fp);
+   if ( SnapW.nodes.len ) fwrite(SnapW.nodes.buf, SnapW.nodes.len, 1, fp);
+   if ( SnapW.refs.len ) fwrite(SnapW.refs.buf, SnapW.refs.len, 1, fp);
+   fwrite(SnapW.blob.buf, SnapW.blob.len, 1, fp);
+   if ( fflush(fp) != 0 || ferror(fp) || fsync(fd) != 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "ExpSnapshot: cannot write %s errno=%d\n", tmp, errno);
+      fclose(fp);
+      unlink(tmp);
+      goto out;
+   }
+   fclose(fp);
+   if ( rename(tmp, filename) != 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "ExpSnapshot: cannot rename %s to %s errno=%d\n", tmp, filename, errno);
+      unlink(tmp);
+      goto out;
+   }
+   SeqUtil_TRACE(TL_MEDIUM, "ExpSnapshot: %s written, %d nodes, %d files\n", filename, nnodes, SnapW.nfiles);
+   retval = 0;
+
+out:
+   free(SnapW.blob.buf);
+   free(SnapW.refs.buf);
+   free(SnapW.nodes.buf);
+   free(SnapW.files);
+   free(SnapW.expHome);
+   memset(&SnapW, 0, sizeof(SnapW));
+   return retval;
+}
+
+/********************************************************************************
+ * Reading
+********************************************************************************/
+
+/* maps the snapshot of _exp_home, returns 0 if there is a usable one */
+static int snap_open( const char *_exp_home ) {
+   const ExpSnapHeader *hdr;
+   char path[SEQ_MAXFIELD];
+   struct stat st;
+   int fd;
+
+   if ( SnapR.expHome != NULL && strcmp(SnapR.expHome, _exp_home) == 0 )
+      return SnapR.hdr != NULL ? 0 : 1;
+
+   ExpSnapshot_close();
+   SnapR.expHome = strdup(_exp_home);
+
+   snprintf(path, sizeof(path), "%s/%s", _exp_home, EXPSNAP_FILE);
+   if ( (fd = open(path, O_RDONLY)) < 0 ) return 1;
+   if ( fstat(fd, &st) != 0 || st.st_size < sizeof(ExpSnapHeader) ||
+        (SnapR.map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED ) {
+      SnapR.map = NULL;
+      close(fd);
+      return 1;
+   }
+   close(fd);
+   SnapR.size = st.st_size;
+
+   hdr = (const ExpSnapHeader *) SnapR.map;
+   if ( strncmp(hdr->magic, EXPSNAP_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != EXPSNAP_VERSION ||
+        hdr->order != SNAP_ORDER || hdr->size != SnapR.size ||
+        hdr->nodes != hdr->files + (uint64_t) hdr->nfiles * sizeof(ExpSnapFile) ||
+        hdr->refs != hdr->nodes + (uint64_t) hdr->nnodes * sizeof(ExpSnapNode) ||
+        hdr->blob != hdr->refs + (uint64_t) hdr->nrefs * sizeof(uint32_t) || hdr->blob >= hdr->size ||
+        strcmp(SnapR.map + hdr->blob + hdr->expHome, _exp_home) != 0 ) {
+      SeqUtil_TRACE(TL_MEDIUM, "ExpSnapshot: %s is not a snapshot of this experiment or of this version, ignored\n", path);
+      return 1;
+   }
+   SnapR.hdr = hdr;
+   return 0;
+}
+
+/* the files of a node still are as recorded */
+static int snap_current( const ExpSnapNode *node ) {
+   const ExpSnapHeader *hdr = SnapR.hdr;
+   const uint32_t *refs = (const uint32_t *) (SnapR.map + hdr->refs);
+   const ExpSnapFile *files = (const ExpSnapFile *) (SnapR.map + hdr->files), *f;
+   struct stat st;
+   uint32_t r;
+
+   if ( (uint64_t) node->ref + node->nref > hdr->nrefs ) return 0;
+   for ( r = node->ref; r < node->ref + node->nref; r++ ) {
+      if ( refs[r] >= hdr->nfiles ) return 0;
+      f = &files[refs[r]];
+      if ( stat(SnapR.map + hdr->blob + f->path, &st) != 0 ) {
+         if ( ! f->missing ) return 0;
+      } else if ( f->missing || st.st_mtim.tv_sec != f->mtime || st.st_mtim.tv_nsec != f->mtime_nsec || st.st_size != f->size ) {
+         SeqUtil_TRACE(TL_FULL_TRACE, "ExpSnapshot: %s changed\n", SnapR.map + hdr->blob + f->path);
+         return 0;
+      }
+   }
+   return 1;
+}
+
+int ExpSnapshot_getNode( SeqNodeDataPtr _nodeDataPtr, const char *_exp_home,
+                         SeqNameValuesPtr _loops, const char *extraArgs, const char *switch_args ) {
+   const ExpSnapNode *nodes, *node;
+   SnapReader reader;
+   int low, high, mid, cmp;
+
+   if ( SnapW.recording ) return 1;
+   if ( (switch_args && *switch_args) || (extraArgs && *extraArgs) ) return 1;
+   if ( snap_open(_exp_home) != 0 ) return 1;
+
+   nodes = (const ExpSnapNode *) (SnapR.map + SnapR.hdr->nodes);
+   for ( node = NULL, low = 0, high = SnapR.hdr->nnodes - 1; low <= high; ) {
+      mid = (low + high) / 2;
+      if ( (cmp = strcmp(_nodeDataPtr->name, SnapR.map + SnapR.hdr->blob + nodes[mid].path)) == 0 ) {
+         node = &nodes[mid];
+         break;
+      }
+      if ( cmp < 0 ) high = mid - 1; else low = mid + 1;
+   }
+
+   if ( node == NULL || ( (node->flags & EXPSNAP_LOOPDEP) && _loops != NULL ) ) return 1;
+   if ( node->data + node->len > SnapR.hdr->size - SnapR.hdr->blob || ! snap_current(node) ) return 1;
+
+   reader.p = SnapR.map + SnapR.hdr->blob + node->data;
+   reader.end = reader.p + node->len;
+   snap_unpack(&reader, _nodeDataPtr);
+   SeqUtil_TRACE(TL_FULL_TRACE, "ExpSnapshot: %s read from the snapshot\n", _nodeDataPtr->name);
+   return 0;
+}
+
+void ExpSnapshot_close( void ) {
+   if ( SnapR.map != NULL ) munmap(SnapR.map, SnapR.size);
+   free(SnapR.expHome);
+   memset(&SnapR, 0, sizeof(SnapR));
+}
@@ -0,0 +1,112 @@
+/* ExpSnapshot.h - Compiled experiment snapshot of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _EXP_SNAPSHOT_H_
+#define _EXP_SNAPSHOT_H_
+
+#include <stdint.h>
+#include "SeqNode.h"
+#include "SeqNameValues.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Interface.
+ * The snapshot of an experiment, $SEQ_EXP_HOME/sequencing/experiment.snapshot,
+ * is written by expcompile.  It holds, for every node, what nodeinfo() gets
+ * from the flow.xml files, the resource files and the definition files: type,
+ * paths, loop definitions, submits, siblings, dependencies, batch resources,
+ * abort actions, ... together with the name, mtime and size of each file that
+ * was read (or found missing) to build the node.
+ *
+ * nodeinfo() maps the snapshot and takes a node from it instead of walking
+ * the xml files as long as the files of that node still have the recorded
+ * mtimes and sizes.  A node is left out of the snapshot when its data depends
+ * on the datestamp (a switch on its path, VALIDITY tags in its resources); a
+ * node whose dependencies depend on loop indices is only taken from the
+ * snapshot when no loop arguments are given.  Anything not in the snapshot,
+ * or out of date, goes through the xml files as before.
+ *
+ * The image is native endian and versioned, a snapshot of another version
+ * or byte order is ignored.
+********************************************************************************/
+
+#define EXPSNAP_FILE     "sequencing/experiment.snapshot"
+#define EXPSNAP_MAGIC    "XPSNAP"
+#define EXPSNAP_VERSION  1
+
+/* node flags */
+#define EXPSNAP_LOOPDEP  0x1   /* dependencies change with the loop arguments */
+
+typedef struct _ExpSnapHeader {
+   char     magic[8];
+   uint32_t version;
+   uint32_t order;           /* 0x01020304 written natively */
+   uint32_t nfiles;
+   uint32_t nnodes;
+   uint32_t nrefs;
+   uint32_t expHome;         /* string offset */
+   uint64_t files;           /* section offsets from the start of the image */
+   uint64_t nodes;
+   uint64_t refs;
+   uint64_t blob;
+   uint64_t size;
+} ExpSnapHeader;
+
+typedef struct _ExpSnapFile {
+   uint32_t path;            /* string offset */
+   uint32_t missing;         /* the file did not exist */
+   int64_t  mtime;
+   int64_t  mtime_nsec;
+   int64_t  size;
+} ExpSnapFile;
+
+/* sorted by path */
+typedef struct _ExpSnapNode {
+   uint32_t path;            /* string offset */
+   uint32_t flags;
+   uint32_t ref;             /* first file index in the refs section */
+   uint32_t nref;
+   uint64_t data;            /* packed node, offset in the blob */
+   uint64_t len;
+} ExpSnapNode;
+
+/********************************************************************************
+ * Fills the flow and resource data of _nodeDataPtr, whose name, experiment
+ * home, datestamp and loop arguments are set, from the snapshot of _exp_home.
+ * Returns 0 if it did, 1 if the node must be read from the xml files.
+********************************************************************************/
+int  ExpSnapshot_getNode ( SeqNodeDataPtr _nodeDataPtr, const char *_exp_home,
+                           SeqNameValuesPtr _loops, const char *extraArgs, const char *switch_args );
+
+/********************************************************************************
+ * Writing a snapshot: ExpSnapshot_begin() starts recording the files read by
+ * nodeinfo(), which then never uses a snapshot; ExpSnapshot_addNode() adds a
+ * node built by nodeinfo() since the last call with the files it read, and
+ * ExpSnapshot_write() writes the image to filename and ends the recording.
+ * ExpSnapshot_addNode() returns 1 if the node cannot be kept in a snapshot.
+********************************************************************************/
+void ExpSnapshot_begin ( const char *_exp_home );
+int  ExpSnapshot_addNode ( SeqNodeDataPtr _nodeDataPtr );
+void ExpSnapshot_skipNode ( void );
+int  ExpSnapshot_write ( const char *filename );
+
+/* release the snapshot mapped by this process */
+void ExpSnapshot_close ( void );
+
+#endif
@@ -53,7 +53,8 @@ FlowVisitorPtr Flow_newVisitor(const char *nodePath, const char *seq_exp_home,
       char * postfix = "/EntryModule/flow.xml";
       char * xmlFilename = (char *) malloc ( strlen(seq_exp_home) + strlen(postfix) + 1 );
       sprintf(xmlFilename, "%s%s", seq_exp_home,postfix);
-      xmlDocPtr doc = XmlUtils_getdoc(xmlFilename);
+      int parsed;
+      xmlDocPtr doc = XmlUtils_borrowdoc(xmlFilename, NULL, &parsed);
       new_flow_visitor->context = xmlXPathNewContext(doc);
       free(xmlFilename);
    }
@@ -85,10 +86,9 @@ static void _freeStack(FlowVisitorPtr fv)
 {
    xmlXPathContextPtr context;
    while ( (context = _popContext(fv)) != NULL){
-      xmlFreeDoc(context->doc);
+      XmlUtils_releasedoc(context->doc);
       xmlXPathFreeContext(context);
    }
-   xmlCleanupParser();
 }
 
 /********************************************************************************
@@ -98,7 +98,7 @@ int Flow_deleteVisitor(FlowVisitorPtr _flow_visitor)
 {
    SeqUtil_TRACE(TL_FULL_TRACE, "Flow_deleteVisitor() begin\n");
    if( _flow_visitor->context->doc != NULL )
-      xmlFreeDoc(_flow_visitor->context->doc);
+      XmlUtils_releasedoc(_flow_visitor->context->doc);
    if( _flow_visitor->context != NULL )
       xmlXPathFreeContext(_flow_visitor->context);
 
@@ -337,7 +337,7 @@ xmlXPathContextPtr _popContext(FlowVisitorPtr fv)
 int Flow_restoreContext(FlowVisitorPtr fv)
 {
    if (fv->context != NULL) {
-      xmlFreeDoc(fv->context->doc);
+      XmlUtils_releasedoc(fv->context->doc);
       xmlXPathFreeContext(fv->context);
    }
    if( (fv->context = _popContext(fv)) == NULL ){
@@ -366,10 +366,11 @@ int Flow_changeXmlFile(FlowVisitorPtr _flow_visitor, const char * xmlFilename)
 {
    SeqUtil_TRACE(TL_FULL_TRACE, "Flow_changeXmlFile(): begin : xmlFilename=%s\n", xmlFilename);
    xmlDocPtr doc = NULL;
+   int parsed;
 
    Flow_saveContext(_flow_visitor);
 
-   if( (doc = XmlUtils_getdoc(xmlFilename)) == NULL ){
+   if( (doc = XmlUtils_borrowdoc(xmlFilename, NULL, &parsed)) == NULL ){
       return FLOW_FAILURE;
    }
    _flow_visitor->context = xmlXPathNewContext(doc);
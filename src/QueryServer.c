@@ -36,18 +36,8 @@
  * 
  */
 
-int Query_L2D2_Server ( int sock , ServerActions action , const char *buf , const char *buf2 , const char * _seq_exp_home)
+static int compose_Request ( ServerActions action , const char *buf , const char *buf2 , char *buffer )
 {
-    int bytes_read, bytes_sent;
-    int ret_nfs;
-    char buffer[MAXBUF];
-    char Rbuffer[MAXBUF];
-
-    /* reset buffer */
-    memset(buffer,'\0',sizeof(buffer));
-    memset(Rbuffer,'\0',sizeof(Rbuffer));
-
-
     /* ok compose the message to be sent to server */
     switch (action) {
 
@@ -87,11 +77,43 @@ int Query_L2D2_Server ( int sock , ServerActions action , const char *buf , cons
            case SVR_WRITE_USERDFILE: /* K  */
                             sprintf(buffer,"%s",buf);
 	                    break;
+           case SVR_SET_STATE:
+                            sprintf(buffer,"U %s",buf);
+	                    break;
+           case SVR_RATE_TAKE:
+                            sprintf(buffer,"B %s",buf);
+	                    break;
            default  :
 	                    fprintf (stderr,"@@@@@@@@@@@ ERROR Unrecognized action for the Server:%d @@@@@@@@@@@ \n",action);
 			    return(-1);
                             break;
     }
+    return(0);
+}
+
+int Query_L2D2_Server ( int sock , ServerActions action , const char *buf , const char *buf2 , const char * _seq_exp_home)
+{
+    int bytes_read, bytes_sent;
+    int ret_nfs;
+    char buffer[MAXBUF];
+    char Rbuffer[MAXBUF];
+    L2D2Query query;
+
+    /* framed connection : a batch of one */
+    if ( is_framed(sock) ) {
+           query.action = action;
+           query.buf = buf;
+           query.buf2 = buf2;
+           query.answer = NULL;
+           Query_L2D2_Batch(sock, &query, 1, _seq_exp_home);
+           return(query.status);
+    }
+
+    /* reset buffer */
+    memset(buffer,'\0',sizeof(buffer));
+    memset(Rbuffer,'\0',sizeof(Rbuffer));
+
+    if ( compose_Request(action, buf, buf2, buffer) != 0 ) return(-1);
 
     if ( (bytes_sent=send_socket(sock , buffer , sizeof(buffer) , SOCK_TIMEOUT_CLIENT)) <= 0 ) {
            fprintf(stderr,"%%%%%%%%%%%% Query_L2D2_Server: socket closed at send  %%%%%%%%%%%%%%\n");
@@ -133,6 +155,122 @@ int Query_L2D2_Server ( int sock , ServerActions action , const char *buf , cons
 
 }
 
+/**
+ *
+ * Name   : Query_L2D2_Batch
+ * Descri : Send a burst of requests to the Server in one flight of packets
+ *          and collect the answers in queries[i].status, and the data of
+ *          framed replies in queries[i].answer if set. On a framed
+ *          connection (see do_Login) the replies are matched by request id,
+ *          otherwise the requests go one at a time through Query_L2D2_Server.
+ *          Requests left unanswered by a broken connection revert to nfs.
+ * Return : 0 success, -1 connection failure
+ *
+ */
+int Query_L2D2_Batch ( int sock , L2D2Query *queries , int count , const char * _seq_exp_home)
+{
+    char buffer[MAXBUF];
+    char *frames, *waiting, *payload;
+    size_t flen = 0, tlen;
+    unsigned int id, len;
+    int i, op, status, expected = 0, failed = 0;
+
+    if ( ! is_framed(sock) ) {
+           for ( i = 0; i < count; i++ ) {
+                  queries[i].status = Query_L2D2_Server(sock, queries[i].action, queries[i].buf, queries[i].buf2, _seq_exp_home);
+           }
+           return(0);
+    }
+
+    if ( (frames = (char *) malloc(count * (L2D2_FRAME_HEADER + MAXBUF))) == NULL || (waiting = (char *) calloc(count, 1)) == NULL ) {
+           raiseError("OutOfMemory exception in Query_L2D2_Batch()\n");
+    }
+
+    /* frame "X payload" requests: opcode X, id is the rank in the batch + 1 */
+    for ( i = 0; i < count; i++ ) {
+           memset(buffer,'\0',sizeof(buffer));
+           queries[i].status = -1;
+           if ( queries[i].answer != NULL ) queries[i].answer[0] = '\0';
+           if ( compose_Request(queries[i].action, queries[i].buf, queries[i].buf2, buffer) != 0 ) continue;
+           tlen = strlen(buffer);
+           tlen = tlen > 2 ? tlen - 2 : 0;
+           pack_frame(frames + flen, tlen, i + 1, buffer[0], 0);
+           memcpy(frames + flen + L2D2_FRAME_HEADER, buffer + 2, tlen);
+           flen += L2D2_FRAME_HEADER + tlen;
+           waiting[i] = 1;
+           expected++;
+    }
+
+    if ( send_full(sock, frames, flen) != 0 ) {
+           fprintf(stderr,"%%%%%%%%%%%% Query_L2D2_Batch: socket closed at send  %%%%%%%%%%%%%%\n");
+           failed = 1;
+    }
+
+    while ( ! failed && expected > 0 ) {
+           if ( recv_frame(sock, &id, &op, &status, &payload, &len) != 0 ) {
+                  fprintf(stderr,"%%%%%%%%%%%% Query_L2D2_Batch: socket closed at recv   %%%%%%%%%%%%%%\n");
+                  failed = 1;
+                  break;
+           }
+           if ( id >= 1 && id <= count && waiting[id - 1] ) {
+                  if ( queries[id - 1].answer != NULL ) snprintf(queries[id - 1].answer, MAXBUF, "%s", payload);
+                  queries[id - 1].status = status;
+                  waiting[id - 1] = 0;
+                  expected--;
+           }
+           free(payload);
+    }
+
+    if ( failed ) {
+           fprintf(stderr, "====== Reverting to Nfs Routines ====== \n");
+           for ( i = 0; i < count; i++ ) {
+                  if ( waiting[i] ) queries[i].status = revert_nfs(queries[i].buf, queries[i].action, queries[i].buf2, _seq_exp_home);
+           }
+    }
+
+    free(frames);
+    free(waiting);
+    return( failed ? -1 : 0 );
+}
+
+/**
+ *
+ * Name   : Send_L2D2_Request
+ * Descri : Send an already composed request "X payload" to the Server,
+ *          framed or not depending on the connection.
+ * Return : status of the server, -1 if the connection failed
+ *
+ */
+int Send_L2D2_Request ( int sock , const char *request )
+{
+    char buffer[MAXBUF];
+    char hdr[L2D2_FRAME_HEADER];
+    char *payload;
+    unsigned int id, len;
+    int op, status, tlen;
+
+    if ( ! is_framed(sock) ) {
+           memset(buffer,'\0',sizeof(buffer));
+           snprintf(buffer,sizeof(buffer),"%s",request);
+           if ( send_socket(sock , buffer , sizeof(buffer) , SOCK_TIMEOUT_CLIENT) <= 0 ) return(-1);
+           memset(buffer,'\0',sizeof(buffer));
+           if ( recv_socket(sock , buffer , sizeof(buffer) , SOCK_TIMEOUT_CLIENT) <= 0 ) return(-1);
+           return( buffer[0] == '0' ? 0 : 1 );
+    }
+
+    /* the request as it is, not bound to the size of the 1024 byte protocol */
+    tlen = strlen(request);
+    tlen = tlen > 2 ? tlen - 2 : 0;
+    if ( tlen > L2D2_FRAME_MAX ) return(-1);
+    pack_frame(hdr, tlen, 1, request[0], 0);
+    if ( send_full(sock, hdr, sizeof(hdr)) != 0 || send_full(sock, request + 2, tlen) != 0 ) return(-1);
+    do {
+           if ( recv_frame(sock, &id, &op, &status, &payload, &len) != 0 ) return(-1);
+           free(payload);
+    } while ( id != 1 );
+    return( status );
+}
+
 /** 
  * If we detect that socket is down revert to  
  * NFS routines to keep the flow going 
@@ -181,9 +319,17 @@ int revert_nfs (  const char * buf , ServerActions action , const char *buf2 , c
 		                fprintf(stderr,"Nfs Routine: SVR_UNLOCK cmd=%s\n",buf); 
 		                ret=unlock_nfs ( buf, buf2, _seq_exp_home ) ;
 	                        break;
+                      case SVR_SET_STATE:
+		                fprintf(stderr,"Nfs Routine: SVR_SET_STATE cmd=%s\n",buf); 
+		                ret=setNodeState_nfs ( buf, NULL, 0, _seq_exp_home ) ;
+	                        break;
                       case SVR_LOG_NODE:
 		                fprintf(stderr,"===NO NFS FOR LOGGING===\n");
 				break;
+                      case SVR_RATE_TAKE: /* the caller takes the token from the bucket file */
+		                fprintf(stderr,"Nfs Routine: SVR_RATE_TAKE cmd=%s\n",buf); 
+		                ret=1;
+	                        break;
                       case SVR_WRITE_WNF:
 		                fprintf(stderr,"Nfs Routine: SVR_WRITE_WNF cmd=%s\n",buf); 
 		                memset(sfile,'\0',sizeof(sfile));
@@ -232,6 +378,7 @@ int OpenConnectionToMLLServer (const char * node ,const char *signal , const cha
     int sock;
     int ret;
     int port;
+    int framed = 0;
 
     struct passwd *passwdEnt = getpwuid(getuid());
 
@@ -269,7 +416,7 @@ int OpenConnectionToMLLServer (const char * node ,const char *signal , const cha
     
     gethostname(thisHost, sizeof(thisHost));
 
-    ret=do_Login(sock,pid,node,_seq_exp_home,signal,passwdEnt->pw_name,&m5sum); 
+    ret=do_Login(sock,pid,node,_seq_exp_home,signal,passwdEnt->pw_name,&m5sum,&framed); 
     free(m5sum);
 
     if ( ret != 0 ) close(sock);
@@ -285,8 +432,16 @@ void CloseConnectionWithMLLServer ( int con )
 {
       /* int ret; */
       int bytes_sent;
+      char hdr[L2D2_FRAME_HEADER];
       
-      if ( (bytes_sent=send_socket(con , "S \0" , 3 , SOCK_TIMEOUT_CLIENT)) <= 0 ) {
+      if ( is_framed(con) ) {
+           set_framed(con, 0);
+           pack_frame(hdr, 0, 1, 'S', 0);
+           bytes_sent = send_full(con, hdr, sizeof(hdr)) == 0 ? sizeof(hdr) : -1;
+      } else {
+           bytes_sent = send_socket(con , "S \0" , 3 , SOCK_TIMEOUT_CLIENT);
+      }
+      if ( bytes_sent <= 0 ) {
            fprintf(stderr,"%%%%%%%%%%%% CloseConnectionWithMLLServer: socket closed at send %%%%%%%%%%%%%%\n");
       } else close(con);
 
@@ -59,12 +59,25 @@ typedef enum _ServerActions {
    SVR_WRITE_USERDFILE,
    SVR_REGISTER_DEPENDENCY_POLLING,
    SVR_REGISTER_DEPENDENCY_NOTIFY,
-   SVR_REGISTER_DEPENDENCY_SSH
+   SVR_REGISTER_DEPENDENCY_SSH,
+   SVR_SET_STATE,
+   SVR_RATE_TAKE
 } ServerActions;
 
+/* one request of a batch, see Query_L2D2_Batch */
+typedef struct _L2D2Query {
+   ServerActions action;
+   const char *buf;
+   const char *buf2;
+   int status;       /* answer of the server, or of the nfs routine */
+   char *answer;     /* MAXBUF bytes for the data of a framed reply, or NULL */
+} L2D2Query;
+
 extern int MLLServerConnectionFid;
 
 int  Query_L2D2_Server ( int , ServerActions action , const char * , const char *, const char * _seq_exp_home);
+int  Query_L2D2_Batch ( int , L2D2Query * , int , const char * _seq_exp_home);
+int  Send_L2D2_Request ( int , const char * );
 int  OpenConnectionToMLLServer (const char * ,const char *, const char* _seq_exp_home);
 void CloseConnectionWithMLLServer ( int  );
 int  revert_nfs ( const char * , ServerActions action , const char * , const char * _seq_exp_home);
@@ -23,6 +23,7 @@
 #include <libxml/tree.h>
 #include <libxml/xpathInternals.h>
 #include <string.h>
+#include <pthread.h>
 #include "ResourceVisitor.h"
 #include "SeqUtilServer.h"
 #include "XmlUtils.h"
@@ -207,7 +208,7 @@ void deleteResourceVisitor(ResourceVisitorPtr rv)
    free((char *)rv->xmlFile);
    free((char *)rv->defFile);
    if( rv->context != NULL ){
-      xmlFreeDoc(rv->context->doc);
+      XmlUtils_releasedoc(rv->context->doc);
       xmlXPathFreeContext(rv->context);
    }
    free(rv);
@@ -302,8 +303,9 @@ xmlXPathContextPtr Resource_createContext(SeqNodeDataPtr _nodeDataPtr, const cha
    xmlXPathContextPtr context = NULL;
    xmlDocPtr doc = NULL;
    xmlNodePtr currentNodePtr = NULL, nodeToDelete=NULL;
-   int found=0; 
+   int found=0, parsed=0; 
 
+   SeqUtil_noteFile(xmlFile);
    if ( access(xmlFile, R_OK ) != 0 ){
       if ( nodeType == Loop || nodeType == ForEach ){
          raiseError("createResourceContext(): Cannot access mandatory resource file %s\n", xmlFile);
@@ -313,10 +315,13 @@ xmlXPathContextPtr Resource_createContext(SeqNodeDataPtr _nodeDataPtr, const cha
       }
    }
 
-   doc = XmlUtils_getdoc(xmlFile);
+   /* the document is shared with the other nodes using the file, it is only
+    * trimmed and resolved right after it was parsed */
+   doc = XmlUtils_borrowdoc(xmlFile, defFile, &parsed);
 
    if (doc == NULL) {
-      doc = xml_fallbackDoc( xmlFile, nodeType);
+      xmlFreeDoc( xml_fallbackDoc( xmlFile, nodeType) );
+      doc = XmlUtils_borrowdoc(xmlFile, defFile, &parsed);
    }
 
    context = xmlXPathNewContext(doc);
@@ -339,7 +344,7 @@ xmlXPathContextPtr Resource_createContext(SeqNodeDataPtr _nodeDataPtr, const cha
       }
    } 
    
-   if ( defFile != NULL )
+   if ( defFile != NULL && parsed )
       XmlUtils_resolve(xmlFile,context,defFile,_nodeDataPtr->expHome);
 
 out:
@@ -351,14 +356,19 @@ out:
  * Fallback in case the document cannot be parsed:  If it is empty, we create a
  * dummy one, even for loops.
  * If it wasn't empty and could not be parsed, there is nothing we can do about
- * it except exit with error.
+ * it except exit with error.  The threads of tsvinfo write the tags once, the
+ * other ones find the file written.
 ********************************************************************************/
+static pthread_mutex_t fallbackMutex = PTHREAD_MUTEX_INITIALIZER;
+
 xmlDocPtr xml_fallbackDoc(const char * xmlFile, SeqNodeType nodeType)
 {
    SeqUtil_TRACE(TL_FULL_TRACE, "xml_fallbackDoc() begin\n");
    FILE * pxml = NULL;
    int xmlSize = 0;
+   xmlDocPtr doc = NULL;
 
+   pthread_mutex_lock(&fallbackMutex);
    pxml = fopen (xmlFile, "a+");
    if(!pxml) raiseError("Permission to write in %s\n",xmlFile);
    fseek (pxml , 0 , SEEK_END);
@@ -381,13 +391,15 @@ xmlDocPtr xml_fallbackDoc(const char * xmlFile, SeqNodeType nodeType)
          goto write_err;
       }
 
-   } else {
-      goto syntax_err;
    }
    fclose (pxml);
 
+   if ( (doc = XmlUtils_getdoc(xmlFile)) == NULL ) {
+      goto syntax_err;
+   }
+   pthread_mutex_unlock(&fallbackMutex);
    SeqUtil_TRACE(TL_FULL_TRACE, "xml_fallbackDoc() end\n");
-   return XmlUtils_getdoc(xmlFile);
+   return doc;
 
 write_err:
    raiseError("xml_fallbackDoc(): Unable to write in file %s\n",xmlFile);
@@ -0,0 +1,836 @@
+/* SeqLogIndex.c - Binary index of the nodelog of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "SeqUtil.h"
+#include "SeqLogIndex.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Inner workings.
+ * The numbers of the file are little endian whatever the host, the index of
+ * a nodelog on a shared file system is read by hosts of every kind.
+ *
+ * The file starts with a header (IDX_HEADER bytes): "MIDX", the version, the
+ * offset in the nodelog up to which its lines are indexed, the offset of the
+ * last index entry (0 if none) and the end of the valid entries.  Entries
+ * follow, each an u32 length (of the whole entry), a type and 3 bytes of
+ * padding:
+ *    'S'  a string interned: its bytes.  Strings are numbered in the order of
+ *         the file from 0.
+ *    'R'  a record: u32 time, u32 state, u64 offset, u32 length of the line,
+ *         u32 node and u32 extension (ids of strings).
+ *    'I'  the index ending a segment: u64 offset of the previous 'I' (0 if
+ *         none), u32 number and u32 size of the node lists, u32 number of
+ *         strings, u32 number of keys (node, extension); the lists of the
+ *         keys having records in the segment, each u32 node, u32 extension,
+ *         u32 count and the records; every string so far, each u32 length and
+ *         its bytes; the latest record of every key so far.
+ * Records are u32 time, u32 state, u64 offset, u32 length (IDX_RECORD) in
+ * the index entries.
+ *
+ * The latest state of the nodes is the last 'I' followed by the entries after
+ * it (the open segment), the history of a node the lists of every 'I',
+ * walking back from the last, and the records of the open segment.  A segment
+ * is closed once it has as many records as there are keys (IDX_SEGMENT_MIN
+ * at least), so the copies of the latest records and strings in the 'I' are
+ * never bigger than the records of the segment.
+ *
+ * An update appends the new entries past the end of the header, then writes
+ * the header: entries of an update cut short are beyond the end and written
+ * over by the next one.  The header is read again under the lock at every
+ * update, another process may have updated the index since; an index whose
+ * header is unusable, or that covers more than the nodelog has (the nodelog
+ * was replaced), is rebuilt from the start of the nodelog.
+********************************************************************************/
+
+#define IDX_MAGIC        "MIDX"
+#define IDX_HEADER       32
+#define IDX_ENTRY        8
+#define IDX_RECORD       20
+#define IDX_INDEX        24
+#define IDX_SEGMENT_MIN  1024
+#define IDX_CHUNK        (1 << 20)
+#define IDX_FLUSH        (1 << 20)
+
+typedef struct {
+   uint32_t time, state;
+   uint64_t offset;
+   uint32_t len;
+} IdxRecord;
+
+typedef struct {
+   uint32_t   node, ext;
+   IdxRecord  latest;
+   IdxRecord *recs;         /* of the open segment */
+   int        nrecs, maxrecs;
+} IdxKey;
+
+struct _SeqLogIndex {
+   char      *logpath;
+   int        fd;            /* of the index, -1 for a reader without one */
+   int        writer;
+   uint64_t   covered, last, end;
+   uint64_t   segStart;      /* first entry of the open segment */
+   int        segRecs;
+   char     **strings;
+   uint32_t  *stringLens;
+   int        nstrings, maxstrings;
+   IdxKey    *keys;
+   int        nkeys, maxkeys;
+   int       *stringHash, *keyHash;   /* id + 1, 0 is free */
+   int        hashSize;
+   unsigned char *out;       /* entries not written yet, from end */
+   size_t     outLen, outMax;
+};
+
+/* a line of the nodelog, pointers in the line */
+typedef struct {
+   const char *node, *ext;
+   size_t      nodeLen, extLen;
+   IdxRecord   rec;
+} IdxLine;
+
+static const struct { const char *prefix; int state; } IdxStates[] = {
+   { "abort",   SEQ_LOG_ABORT },
+   { "submit",  SEQ_LOG_SUBMIT },
+   { "begin",   SEQ_LOG_BEGIN },
+   { "end",     SEQ_LOG_END },
+   { "init",    SEQ_LOG_INIT },
+   { "wait",    SEQ_LOG_WAIT },
+   { "discret", SEQ_LOG_DISCRET },
+   { "catchup", SEQ_LOG_CATCHUP },
+   { "info",    SEQ_LOG_INFO },
+   { "event",   SEQ_LOG_EVENT },
+   { NULL,      SEQ_LOG_OTHER }
+};
+
+static void put32( unsigned char *p, uint32_t v ) {
+   p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void put64( unsigned char *p, uint64_t v ) {
+   put32(p, (uint32_t) v);
+   put32(p + 4, (uint32_t) (v >> 32));
+}
+
+static uint32_t get32( const unsigned char *p ) {
+   return( (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24) );
+}
+
+static uint64_t get64( const unsigned char *p ) {
+   return( (uint64_t) get32(p) | ((uint64_t) get32(p + 4) << 32) );
+}
+
+static void putRecord( unsigned char *p, const IdxRecord *rec ) {
+   put32(p, rec->time);
+   put32(p + 4, rec->state);
+   put64(p + 8, rec->offset);
+   put32(p + 16, rec->len);
+}
+
+static void getRecord( const unsigned char *p, IdxRecord *rec ) {
+   rec->time   = get32(p);
+   rec->state  = get32(p + 4);
+   rec->offset = get64(p + 8);
+   rec->len    = get32(p + 16);
+}
+
+static void *idx_grow( void *ptr, int *max, size_t size ) {
+   int n = *max > 0 ? 2 * *max : 64;
+
+   if ( (ptr = realloc(ptr, n * size)) == NULL ) raiseError("SeqLogIndex realloc: Out of memory!\n");
+   *max = n;
+   return(ptr);
+}
+
+static unsigned int idx_hash( const char *s, size_t len, unsigned int h ) {
+   while ( len-- > 0 ) h = h * 31 + (unsigned char) *s++;
+   return(h);
+}
+
+static unsigned int idx_keyHash( uint32_t node, uint32_t ext ) {
+   return( node * 2654435761u ^ (ext + 0x9e3779b9u) * 40503u );
+}
+
+/* the hash tables hold at most half of their size */
+static void idx_rehash( SeqLogIndex *idx ) {
+   int i, size = idx->hashSize > 0 ? 2 * idx->hashSize : 1024;
+   unsigned int h;
+
+   free(idx->stringHash);
+   free(idx->keyHash);
+   if ( (idx->stringHash = calloc(size, sizeof(int))) == NULL || (idx->keyHash = calloc(size, sizeof(int))) == NULL ) {
+      raiseError("SeqLogIndex calloc: Out of memory!\n");
+   }
+   idx->hashSize = size;
+   for ( i = 0; i < idx->nstrings; i++ ) {
+      for ( h = idx_hash(idx->strings[i], idx->stringLens[i], 0) & (size - 1); idx->stringHash[h] != 0; h = (h + 1) & (size - 1) );
+      idx->stringHash[h] = i + 1;
+   }
+   for ( i = 0; i < idx->nkeys; i++ ) {
+      for ( h = idx_keyHash(idx->keys[i].node, idx->keys[i].ext) & (size - 1); idx->keyHash[h] != 0; h = (h + 1) & (size - 1) );
+      idx->keyHash[h] = i + 1;
+   }
+}
+
+/* room for len more bytes of entries */
+static unsigned char *idx_out( SeqLogIndex *idx, size_t len ) {
+   unsigned char *p;
+
+   if ( idx->outLen + len > idx->outMax ) {
+      idx->outMax = idx->outLen + len > 2 * idx->outMax ? idx->outLen + len : 2 * idx->outMax;
+      if ( (idx->out = realloc(idx->out, idx->outMax)) == NULL ) raiseError("SeqLogIndex realloc: Out of memory!\n");
+   }
+   p = idx->out + idx->outLen;
+   idx->outLen += len;
+   return(p);
+}
+
+static unsigned char *idx_entry( SeqLogIndex *idx, char type, size_t len ) {
+   unsigned char *p = idx_out(idx, IDX_ENTRY + len);
+
+   put32(p, IDX_ENTRY + len);
+   p[4] = type;
+   p[5] = p[6] = p[7] = 0;
+   return(p + IDX_ENTRY);
+}
+
+/* id of the string, added (and appended to the index by a writer) when new */
+static uint32_t idx_intern( SeqLogIndex *idx, const char *s, size_t len, int append ) {
+   unsigned int h;
+   int id;
+
+   if ( 2 * (idx->nstrings + 1) > idx->hashSize ) idx_rehash(idx);
+   for ( h = idx_hash(s, len, 0) & (idx->hashSize - 1); (id = idx->stringHash[h]) != 0; h = (h + 1) & (idx->hashSize - 1) ) {
+      if ( idx->stringLens[id - 1] == len && memcmp(idx->strings[id - 1], s, len) == 0 ) return(id - 1);
+   }
+   if ( idx->nstrings == idx->maxstrings ) {
+      idx->strings = idx_grow(idx->strings, &idx->maxstrings, sizeof(char *));
+      if ( (idx->stringLens = realloc(idx->stringLens, idx->maxstrings * sizeof(uint32_t))) == NULL ) {
+         raiseError("SeqLogIndex realloc: Out of memory!\n");
+      }
+   }
+   if ( (idx->strings[idx->nstrings] = malloc(len + 1)) == NULL ) raiseError("SeqLogIndex malloc: Out of memory!\n");
+   memcpy(idx->strings[idx->nstrings], s, len);
+   idx->strings[idx->nstrings][len] = '\0';
+   idx->stringLens[idx->nstrings] = len;
+   idx->stringHash[h] = ++idx->nstrings;
+   if ( append ) memcpy(idx_entry(idx, 'S', len), s, len);
+   return(idx->nstrings - 1);
+}
+
+/* the key of node and ext, -1 if it has none */
+static int idx_findKey( SeqLogIndex *idx, uint32_t node, uint32_t ext, unsigned int *slot ) {
+   unsigned int h;
+   int k;
+
+   if ( 2 * (idx->nkeys + 1) > idx->hashSize ) idx_rehash(idx);
+   for ( h = idx_keyHash(node, ext) & (idx->hashSize - 1); (k = idx->keyHash[h]) != 0; h = (h + 1) & (idx->hashSize - 1) ) {
+      if ( idx->keys[k - 1].node == node && idx->keys[k - 1].ext == ext ) return(k - 1);
+   }
+   if ( slot != NULL ) *slot = h;
+   return(-1);
+}
+
+static IdxKey *idx_key( SeqLogIndex *idx, uint32_t node, uint32_t ext ) {
+   unsigned int slot;
+   IdxKey *key;
+   int k;
+
+   if ( (k = idx_findKey(idx, node, ext, &slot)) >= 0 ) return(&idx->keys[k]);
+   if ( idx->nkeys == idx->maxkeys ) idx->keys = idx_grow(idx->keys, &idx->maxkeys, sizeof(IdxKey));
+   key = &idx->keys[idx->nkeys];
+   memset(key, '\0', sizeof(IdxKey));
+   key->node = node;
+   key->ext = ext;
+   idx->keyHash[slot] = ++idx->nkeys;
+   return(key);
+}
+
+static void idx_addRecord( SeqLogIndex *idx, IdxKey *key, const IdxRecord *rec ) {
+   if ( key->nrecs == key->maxrecs ) key->recs = idx_grow(key->recs, &key->maxrecs, sizeof(IdxRecord));
+   key->recs[key->nrecs++] = *rec;
+   key->latest = *rec;
+   idx->segRecs++;
+}
+
+/* append the 'I' of the open segment and start another */
+static void idx_closeSegment( SeqLogIndex *idx ) {
+   unsigned char *p;
+   size_t listLen = 0, len;
+   int i, j, nlists = 0;
+
+   for ( i = 0; i < idx->nkeys; i++ ) {
+      if ( idx->keys[i].nrecs == 0 ) continue;
+      nlists++;
+      listLen += 12 + idx->keys[i].nrecs * IDX_RECORD;
+   }
+   len = IDX_INDEX + listLen + idx->nkeys * (8 + IDX_RECORD);
+   for ( i = 0; i < idx->nstrings; i++ ) len += 4 + idx->stringLens[i];
+
+   p = idx_entry(idx, 'I', len);
+   put64(p, idx->last);
+   put32(p + 8, nlists);
+   put32(p + 12, listLen);
+   put32(p + 16, idx->nstrings);
+   put32(p + 20, idx->nkeys);
+   p += IDX_INDEX;
+   for ( i = 0; i < idx->nkeys; i++ ) {
+      if ( idx->keys[i].nrecs == 0 ) continue;
+      put32(p, idx->keys[i].node);
+      put32(p + 4, idx->keys[i].ext);
+      put32(p + 8, idx->keys[i].nrecs);
+      p += 12;
+      for ( j = 0; j < idx->keys[i].nrecs; j++, p += IDX_RECORD ) putRecord(p, &idx->keys[i].recs[j]);
+      idx->keys[i].nrecs = 0;
+   }
+   for ( i = 0; i < idx->nstrings; i++ ) {
+      put32(p, idx->stringLens[i]);
+      memcpy(p + 4, idx->strings[i], idx->stringLens[i]);
+      p += 4 + idx->stringLens[i];
+   }
+   for ( i = 0; i < idx->nkeys; i++, p += 8 + IDX_RECORD ) {
+      put32(p, idx->keys[i].node);
+      put32(p + 4, idx->keys[i].ext);
+      putRecord(p + 8, &idx->keys[i].latest);
+   }
+
+   idx->last = idx->end + idx->outLen - (IDX_ENTRY + len);
+   idx->segStart = idx->end + idx->outLen;
+   idx->segRecs = 0;
+}
+
+/* seconds since the epoch of the UTC time, without timegm() */
+static uint32_t idx_utc( int year, int month, int day, int hour, int min, int sec ) {
+   long days;
+
+   year -= month <= 2;
+   days = 365L * year + year / 4 - year / 100 + year / 400 + (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1 - 719468L;
+   return( (uint32_t) (days * 86400 + hour * 3600 + min * 60 + sec) );
+}
+
+static int idx_digits( const char *s, int n ) {
+   int v = 0;
+
+   while ( n-- > 0 ) {
+      if ( *s < '0' || *s > '9' ) return(-1);
+      v = v * 10 + *s++ - '0';
+   }
+   return(v);
+}
+
+/* the field name= at c, its value up to the next ':' before end; NULL if c is not name= */
+static const char *idx_field( const char *c, const char *end, const char *name, size_t *len ) {
+   size_t n = strlen(name);
+   const char *v;
+
+   if ( (size_t) (end - c) < n || memcmp(c, name, n) != 0 ) return(NULL);
+   for ( v = c + n; v < end && *v != ':'; v++ );
+   *len = v - (c + n);
+   return(c + n);
+}
+
+/********************************************************************************
+ * TIMESTAMP=YYYYMMDD.HH:MM:SS:SEQNODE=node:MSGTYPE=type[:SEQLOOP=ext]:SEQMSG=...
+ * as written by the nodelogger, 0 if the line is not one of those.
+********************************************************************************/
+static int idx_parseLine( const char *line, size_t len, IdxLine *l ) {
+   const char *c, *end = line + len, *type;
+   size_t typeLen;
+   int i, y, mo, d, h, mi, s;
+
+   if ( len < 28 || memcmp(line, "TIMESTAMP=", 10) != 0 || line[27] != ':' ) return(0);
+   c = line + 10;
+   if ( (y = idx_digits(c, 4)) < 0 || (mo = idx_digits(c + 4, 2)) < 0 || (d = idx_digits(c + 6, 2)) < 0 || c[8] != '.' ||
+        (h = idx_digits(c + 9, 2)) < 0 || c[11] != ':' || (mi = idx_digits(c + 12, 2)) < 0 || c[14] != ':' ||
+        (s = idx_digits(c + 15, 2)) < 0 ) return(0);
+   l->rec.time = idx_utc(y, mo, d, h, mi, s);
+
+   if ( (l->node = idx_field(line + 28, end, "SEQNODE=", &l->nodeLen)) == NULL || l->nodeLen == 0 ) return(0);
+   c = l->node + l->nodeLen + 1;
+   if ( c >= end || (type = idx_field(c, end, "MSGTYPE=", &typeLen)) == NULL ) return(0);
+   c = type + typeLen + 1;
+   l->ext = "";
+   l->extLen = 0;
+   if ( c < end && (l->ext = idx_field(c, end, "SEQLOOP=", &l->extLen)) == NULL ) l->ext = "";
+
+   l->rec.state = SEQ_LOG_OTHER;
+   for ( i = 0; IdxStates[i].prefix != NULL; i++ ) {
+      if ( typeLen >= strlen(IdxStates[i].prefix) && strncmp(type, IdxStates[i].prefix, strlen(IdxStates[i].prefix)) == 0 ) {
+         l->rec.state = IdxStates[i].state;
+         break;
+      }
+   }
+   return(1);
+}
+
+/********************************************************************************
+ * Index the complete lines of the nodelog from idx->covered up to size.  A
+ * writer appends the entries and closes the segments, a reader only keeps
+ * the records.  Returns 0, -1 if the nodelog could not be read.
+********************************************************************************/
+static int idx_readText( SeqLogIndex *idx, int fd, uint64_t size ) {
+   char *buf, *line, *nl, *end;
+   ssize_t num;
+   size_t have = 0;
+   uint64_t want;
+   IdxLine l;
+   IdxKey *key;
+   uint32_t node, ext;
+
+   if ( (buf = malloc(IDX_CHUNK)) == NULL ) raiseError("SeqLogIndex malloc: Out of memory!\n");
+   while ( idx->covered + have < size ) {
+      want = size - idx->covered - have;
+      if ( want > IDX_CHUNK - have ) want = IDX_CHUNK - have;
+      num = pread(fd, buf + have, want, idx->covered + have);
+      if ( num < 0 && errno == EINTR ) continue;
+      if ( num <= 0 ) {
+         free(buf);
+         return(num < 0 ? -1 : 0);
+      }
+      have += num;
+      end = buf + have;
+      for ( line = buf; line < end && (nl = memchr(line, '\n', end - line)) != NULL; line = nl + 1 ) {
+         if ( idx_parseLine(line, nl - line, &l) ) {
+            node = idx_intern(idx, l.node, l.nodeLen, idx->writer);
+            ext = idx_intern(idx, l.ext, l.extLen, idx->writer);
+            l.rec.offset = idx->covered + (line - buf);
+            l.rec.len = nl - line + 1;
+            key = idx_key(idx, node, ext);
+            idx_addRecord(idx, key, &l.rec);
+            if ( idx->writer ) {
+               unsigned char *p = idx_entry(idx, 'R', IDX_RECORD + 8);
+               putRecord(p, &l.rec);
+               put32(p + IDX_RECORD, node);
+               put32(p + IDX_RECORD + 4, ext);
+               if ( idx->segRecs >= IDX_SEGMENT_MIN && idx->segRecs >= idx->nkeys ) idx_closeSegment(idx);
+            }
+         }
+      }
+      if ( line == buf && have == IDX_CHUNK ) {
+         /* not a line of the nodelog, step over it */
+         line = end;
+      }
+      idx->covered += line - buf;
+      have = end - line;
+      memmove(buf, line, have);
+      if ( idx->writer && idx->outLen >= IDX_FLUSH ) {
+         /* written beyond the end in the header, they count once it is */
+         if ( pwrite(idx->fd, idx->out, idx->outLen, idx->end) != (ssize_t) idx->outLen ) {
+            free(buf);
+            return(-1);
+         }
+         idx->end += idx->outLen;
+         idx->outLen = 0;
+      }
+   }
+   free(buf);
+   return(0);
+}
+
+static void idx_clear( SeqLogIndex *idx ) {
+   int i;
+
+   for ( i = 0; i < idx->nstrings; i++ ) free(idx->strings[i]);
+   for ( i = 0; i < idx->nkeys; i++ ) free(idx->keys[i].recs);
+   idx->nstrings = idx->nkeys = 0;
+   if ( idx->hashSize > 0 ) {
+      memset(idx->stringHash, '\0', idx->hashSize * sizeof(int));
+      memset(idx->keyHash, '\0', idx->hashSize * sizeof(int));
+   }
+   idx->covered = idx->last = 0;
+   idx->end = idx->segStart = IDX_HEADER;
+   idx->segRecs = 0;
+   idx->outLen = 0;
+}
+
+static int pread_full( int fd, void *buf, size_t len, uint64_t offset ) {
+   ssize_t num;
+
+   while ( len > 0 ) {
+      if ( (num = pread(fd, buf, len, offset)) < 0 && errno == EINTR ) continue;
+      if ( num <= 0 ) return(-1);
+      buf = (char *) buf + num;
+      len -= num;
+      offset += num;
+   }
+   return(0);
+}
+
+/* the entry at offset in a buffer to free, its type in type; NULL if it is not within the end */
+static unsigned char *idx_readEntry( SeqLogIndex *idx, uint64_t offset, char *type, uint32_t *len ) {
+   unsigned char head[IDX_ENTRY], *p;
+
+   if ( offset + IDX_ENTRY > idx->end || pread_full(idx->fd, head, IDX_ENTRY, offset) != 0 ) return(NULL);
+   *len = get32(head);
+   *type = head[4];
+   if ( *len < IDX_ENTRY || offset + *len > idx->end ) return(NULL);
+   if ( (p = malloc(*len)) == NULL ) raiseError("SeqLogIndex malloc: Out of memory!\n");
+   if ( pread_full(idx->fd, p, *len, offset) != 0 ) {
+      free(p);
+      return(NULL);
+   }
+   return(p);
+}
+
+/********************************************************************************
+ * Read the header, the last 'I' and the open segment.  Returns 0, -1 when the
+ * index is unusable (the state is then empty).
+********************************************************************************/
+static int idx_load( SeqLogIndex *idx ) {
+   unsigned char head[IDX_HEADER], *e, *p, *q;
+   uint64_t offset;
+   uint32_t len, n, i, node, ext;
+   IdxRecord rec;
+   IdxKey *key;
+   char type;
+
+   idx_clear(idx);
+   if ( pread_full(idx->fd, head, IDX_HEADER, 0) != 0 || memcmp(head, IDX_MAGIC, 4) != 0 ||
+        get32(head + 4) != SEQ_LOG_INDEX_VERSION ) return(-1);
+   idx->covered = get64(head + 8);
+   idx->last = get64(head + 16);
+   idx->end = get64(head + 24);
+   if ( idx->end < IDX_HEADER || (idx->last != 0 && (idx->last < IDX_HEADER || idx->last >= idx->end)) ) goto unusable;
+
+   idx->segStart = IDX_HEADER;
+   if ( idx->last != 0 ) {
+      if ( (e = idx_readEntry(idx, idx->last, &type, &len)) == NULL ) goto unusable;
+      p = e + IDX_ENTRY;
+      q = e + len;
+      if ( type != 'I' || len < IDX_ENTRY + IDX_INDEX || get32(p + 12) > len ) {
+         free(e);
+         goto unusable;
+      }
+      n = get32(p + 16);
+      p += IDX_INDEX + get32(p + 12);
+      for ( i = 0; i < n && p + 4 <= q && get32(p) <= (uint32_t) (q - p - 4); i++ ) {
+         idx_intern(idx, (char *) p + 4, get32(p), 0);
+         p += 4 + get32(p);
+      }
+      if ( i < n ) {
+         free(e);
+         goto unusable;
+      }
+      n = get32(e + IDX_ENTRY + 20);
+      for ( i = 0; i < n && p + 8 + IDX_RECORD <= q; i++, p += 8 + IDX_RECORD ) {
+         node = get32(p);
+         ext = get32(p + 4);
+         if ( node >= (uint32_t) idx->nstrings || ext >= (uint32_t) idx->nstrings ) break;
+         key = idx_key(idx, node, ext);
+         getRecord(p + 8, &key->latest);
+      }
+      free(e);
+      if ( i < n ) goto unusable;
+      idx->segStart = idx->last + len;
+   }
+
+   for ( offset = idx->segStart; offset < idx->end; offset += len ) {
+      if ( (e = idx_readEntry(idx, offset, &type, &len)) == NULL ) goto unusable;
+      p = e + IDX_ENTRY;
+      if ( type == 'S' ) {
+         idx_intern(idx, (char *) p, len - IDX_ENTRY, 0);
+      } else if ( type == 'R' && len == IDX_ENTRY + IDX_RECORD + 8 ) {
+         getRecord(p, &rec);
+         node = get32(p + IDX_RECORD);
+         ext = get32(p + IDX_RECORD + 4);
+         if ( node >= (uint32_t) idx->nstrings || ext >= (uint32_t) idx->nstrings ) {
+            free(e);
+            goto unusable;
+         }
+         idx_addRecord(idx, idx_key(idx, node, ext), &rec);
+      } else {
+         free(e);
+         goto unusable;
+      }
+      free(e);
+   }
+   return(0);
+
+unusable:
+   idx_clear(idx);
+   return(-1);
+}
+
+/* write the header, 0 or -1 */
+static int idx_writeHeader( SeqLogIndex *idx ) {
+   unsigned char head[IDX_HEADER];
+
+   memcpy(head, IDX_MAGIC, 4);
+   put32(head + 4, SEQ_LOG_INDEX_VERSION);
+   put64(head + 8, idx->covered);
+   put64(head + 16, idx->last);
+   put64(head + 24, idx->end);
+   return( pwrite(idx->fd, head, IDX_HEADER, 0) == IDX_HEADER ? 0 : -1 );
+}
+
+static int idx_lock( int fd, short type ) {
+   struct flock fl;
+
+   memset(&fl, '\0', sizeof(fl));
+   fl.l_type = type;
+   fl.l_whence = SEEK_SET;
+   while ( fcntl(fd, F_SETLKW, &fl) != 0 ) {
+      if ( errno != EINTR ) return(-1);
+   }
+   return(0);
+}
+
+static SeqLogIndex *idx_new( const char *logpath ) {
+   SeqLogIndex *idx;
+
+   if ( (idx = calloc(1, sizeof(SeqLogIndex))) == NULL || (idx->logpath = strdup(logpath)) == NULL ) {
+      raiseError("SeqLogIndex calloc: Out of memory!\n");
+   }
+   idx->fd = -1;
+   idx_clear(idx);
+   return(idx);
+}
+
+SeqLogIndex *SeqLogIndex_open( const char *logpath ) {
+   SeqLogIndex *idx;
+   char path[1024];
+
+   if ( snprintf(path, sizeof(path), "%s%s", logpath, SEQ_LOG_INDEX_EXT) >= (int) sizeof(path) ) return(NULL);
+   idx = idx_new(logpath);
+   idx->writer = 1;
+   if ( (idx->fd = open(path, O_RDWR|O_CREAT, 00666)) < 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqLogIndex: cannot open %s: %s\n", path, strerror(errno));
+      SeqLogIndex_close(idx);
+      return(NULL);
+   }
+   /* loaded by the first update */
+   idx->end = 0;
+   return(idx);
+}
+
+int SeqLogIndex_update( SeqLogIndex *idx ) {
+   unsigned char head[IDX_HEADER];
+   struct stat st;
+   int fd, ret = -1;
+
+   if ( idx_lock(idx->fd, F_WRLCK) != 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqLogIndex: cannot lock the index of %s: %s\n", idx->logpath, strerror(errno));
+      return(-1);
+   }
+   if ( (fd = open(idx->logpath, O_RDONLY)) < 0 || fstat(fd, &st) != 0 ) goto done;
+
+   /* another process may have gone on with the index, or rebuilt it */
+   if ( pread_full(idx->fd, head, IDX_HEADER, 0) != 0 || get64(head + 24) != idx->end || get64(head + 8) != idx->covered ) {
+      if ( idx_load(idx) != 0 ) SeqUtil_TRACE(TL_FULL_TRACE, "SeqLogIndex: building the index of %s\n", idx->logpath);
+   }
+   if ( (uint64_t) st.st_size < idx->covered ) {
+      SeqUtil_TRACE(TL_FULL_TRACE, "SeqLogIndex: %s was replaced, building its index again\n", idx->logpath);
+      idx_clear(idx);
+   }
+   if ( idx->covered == 0 && idx->end == IDX_HEADER && ftruncate(idx->fd, IDX_HEADER) != 0 ) goto done;
+
+   if ( idx_readText(idx, fd, st.st_size) == 0 &&
+        (idx->outLen == 0 || pwrite(idx->fd, idx->out, idx->outLen, idx->end) == (ssize_t) idx->outLen) ) {
+      idx->end += idx->outLen;
+      idx->outLen = 0;
+      ret = idx_writeHeader(idx);
+   }
+
+done:
+   if ( ret != 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqLogIndex: cannot update the index of %s: %s\n", idx->logpath, strerror(errno));
+      /* loaded again from the file by the next update */
+      idx->end = 0;
+   }
+   if ( fd >= 0 ) close(fd);
+   idx_lock(idx->fd, F_UNLCK);
+   return(ret);
+}
+
+void SeqLogIndex_close( SeqLogIndex *idx ) {
+   if ( idx == NULL ) return;
+   idx_clear(idx);
+   if ( idx->fd >= 0 ) close(idx->fd);
+   free(idx->strings);
+   free(idx->stringLens);
+   free(idx->keys);
+   free(idx->stringHash);
+   free(idx->keyHash);
+   free(idx->out);
+   free(idx->logpath);
+   free(idx);
+}
+
+/********************************************************************************
+ * The state of a reader: what the index has (none if it is unusable), then
+ * the lines of the nodelog beyond.  The lock on the index is kept until
+ * reader_end(), the walk of the segments of a history reads it again.
+********************************************************************************/
+static SeqLogIndex *reader_begin( const char *logpath, int *textfd ) {
+   SeqLogIndex *idx;
+   char path[1024];
+   struct stat st;
+
+   if ( (*textfd = open(logpath, O_RDONLY)) < 0 || fstat(*textfd, &st) != 0 ) {
+      if ( *textfd >= 0 ) close(*textfd);
+      return(NULL);
+   }
+   idx = idx_new(logpath);
+   if ( snprintf(path, sizeof(path), "%s%s", logpath, SEQ_LOG_INDEX_EXT) < (int) sizeof(path) &&
+        (idx->fd = open(path, O_RDONLY)) >= 0 ) {
+      idx_lock(idx->fd, F_RDLCK);
+      if ( idx_load(idx) != 0 || (uint64_t) st.st_size < idx->covered ) {
+         SeqUtil_TRACE(TL_FULL_TRACE, "SeqLogIndex: no usable index for %s, reading it all\n", logpath);
+         idx_clear(idx);
+         idx->end = 0;
+      }
+   }
+   if ( idx_readText(idx, *textfd, st.st_size) != 0 ) {
+      SeqLogIndex_close(idx);
+      close(*textfd);
+      return(NULL);
+   }
+   return(idx);
+}
+
+static void reader_end( SeqLogIndex *idx, int textfd ) {
+   if ( idx->fd >= 0 ) idx_lock(idx->fd, F_UNLCK);
+   SeqLogIndex_close(idx);
+   close(textfd);
+}
+
+static int reader_call( SeqLogIndex *idx, uint32_t node, uint32_t ext, const IdxRecord *rec, SeqLogIndex_callback fn, void *arg ) {
+   SeqLogRecord r;
+
+   r.node = idx->strings[node];
+   r.ext = idx->strings[ext];
+   r.time = (time_t) rec->time;
+   r.state = rec->state;
+   r.offset = (off_t) rec->offset;
+   r.len = rec->len;
+   return( fn(&r, arg) );
+}
+
+static int cmp_latest( const void *a, const void *b ) {
+   const IdxKey *ka = a, *kb = b;
+
+   return( ka->latest.offset < kb->latest.offset ? -1 : ka->latest.offset > kb->latest.offset );
+}
+
+int SeqLogIndex_latest( const char *logpath, SeqLogIndex_callback fn, void *arg ) {
+   SeqLogIndex *idx;
+   int i, textfd, n = 0;
+
+   if ( (idx = reader_begin(logpath, &textfd)) == NULL ) return(-1);
+   /* in the order of the nodelog; the hash table is not used past this */
+   qsort(idx->keys, idx->nkeys, sizeof(IdxKey), cmp_latest);
+   for ( i = 0; i < idx->nkeys; i++ ) {
+      n++;
+      if ( reader_call(idx, idx->keys[i].node, idx->keys[i].ext, &idx->keys[i].latest, fn, arg) != 0 ) break;
+   }
+   reader_end(idx, textfd);
+   return(n);
+}
+
+typedef struct {
+   uint32_t  ext;
+   IdxRecord rec;
+} HistoryRecord;
+
+static int cmp_history( const void *a, const void *b ) {
+   const HistoryRecord *ha = a, *hb = b;
+
+   return( ha->rec.offset < hb->rec.offset ? -1 : ha->rec.offset > hb->rec.offset );
+}
+
+int SeqLogIndex_history( const char *logpath, const char *node, SeqLogIndex_callback fn, void *arg ) {
+   SeqLogIndex *idx;
+   HistoryRecord *hist = NULL;
+   unsigned char *e, *p, *q;
+   uint64_t offset, prev;
+   uint32_t len, nlists, count, nodeId, i, j;
+   unsigned int h;
+   int k, textfd, nhist = 0, maxhist = 0, n = 0;
+   char type;
+
+   if ( (idx = reader_begin(logpath, &textfd)) == NULL ) return(-1);
+   k = 0;
+   if ( idx->hashSize > 0 ) {
+      for ( h = idx_hash(node, strlen(node), 0) & (idx->hashSize - 1); (k = idx->stringHash[h]) != 0; h = (h + 1) & (idx->hashSize - 1) ) {
+         if ( strcmp(idx->strings[k - 1], node) == 0 ) break;
+      }
+   }
+   if ( k == 0 ) {
+      reader_end(idx, textfd);
+      return(0);
+   }
+   nodeId = k - 1;
+
+   /* the closed segments, walking back from the last */
+   for ( offset = idx->last; offset != 0; offset = prev ) {
+      if ( (e = idx_readEntry(idx, offset, &type, &len)) == NULL || type != 'I' || len < IDX_ENTRY + IDX_INDEX ) {
+         SeqUtil_TRACE(TL_ERROR, "SeqLogIndex: the index of %s is damaged at %llu\n", logpath, (unsigned long long) offset);
+         free(e);
+         break;
+      }
+      prev = get64(e + IDX_ENTRY);
+      nlists = get32(e + IDX_ENTRY + 8);
+      p = e + IDX_ENTRY + IDX_INDEX;
+      q = get32(e + IDX_ENTRY + 12) <= len - IDX_ENTRY - IDX_INDEX ? p + get32(e + IDX_ENTRY + 12) : p;
+      for ( i = 0; i < nlists && p + 12 <= q; i++ ) {
+         count = get32(p + 8);
+         if ( count > (uint32_t) (q - p - 12) / IDX_RECORD ) break;
+         if ( get32(p) == nodeId && get32(p + 4) < (uint32_t) idx->nstrings ) {
+            for ( j = 0; j < count; j++ ) {
+               if ( nhist == maxhist ) hist = idx_grow(hist, &maxhist, sizeof(HistoryRecord));
+               hist[nhist].ext = get32(p + 4);
+               getRecord(p + 12 + j * IDX_RECORD, &hist[nhist++].rec);
+            }
+         }
+         p += 12 + count * IDX_RECORD;
+      }
+      free(e);
+      /* segments go forward in the file */
+      if ( prev >= offset ) break;
+   }
+
+   /* the open segment and the lines beyond the index */
+   for ( k = 0; k < idx->nkeys; k++ ) {
+      if ( idx->keys[k].node != nodeId ) continue;
+      for ( j = 0; j < (uint32_t) idx->keys[k].nrecs; j++ ) {
+         if ( nhist == maxhist ) hist = idx_grow(hist, &maxhist, sizeof(HistoryRecord));
+         hist[nhist].ext = idx->keys[k].ext;
+         hist[nhist++].rec = idx->keys[k].recs[j];
+      }
+   }
+
+   qsort(hist, nhist, sizeof(HistoryRecord), cmp_history);
+   for ( k = 0; k < nhist; k++ ) {
+      n++;
+      if ( reader_call(idx, nodeId, hist[k].ext, &hist[k].rec, fn, arg) != 0 ) break;
+   }
+   free(hist);
+   reader_end(idx, textfd);
+   return(n);
+}
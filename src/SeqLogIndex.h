@@ -0,0 +1,97 @@
+/* SeqLogIndex.h - Binary index of the nodelog of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SEQ_LOG_INDEX_H_
+#define _SEQ_LOG_INDEX_H_
+
+#include <sys/types.h>
+#include <time.h>
+
+/********************************************************************************
+ * DOCUMENTATION: Interface.
+ * The index of a nodelog is a binary file next to it (SEQ_LOG_INDEX_EXT added
+ * to its path) kept by mserver when nodelogIndex="1" is set in the pparams of
+ * its configuration.  It holds a record for every line of the nodelog: the
+ * time of the line, the node and its loop extension (ids of strings interned
+ * in the index), the state code of its MSGTYPE and the offset and length of
+ * the line in the nodelog.  The records are grouped in segments, each ending
+ * with an index of the nodes: the records of each node in the segment and the
+ * latest record of every node seen since the start of the nodelog.
+ *
+ * The index follows the text: mserver indexes the lines it finds in the
+ * nodelog after those already indexed, whoever wrote them (lines merged from
+ * the spool, another mserver process).  The readers below use the index up to
+ * where it got and read the rest of the nodelog as text, so their answer is
+ * always that of the whole nodelog: without a usable index (none, of another
+ * version, of a nodelog since replaced) the whole nodelog is read as text.
+********************************************************************************/
+
+#define SEQ_LOG_INDEX_EXT      ".idx"
+#define SEQ_LOG_INDEX_VERSION  1
+
+/* state codes of the records, from the MSGTYPE of the line */
+#define SEQ_LOG_OTHER    0
+#define SEQ_LOG_ABORT    1
+#define SEQ_LOG_SUBMIT   2
+#define SEQ_LOG_BEGIN    3
+#define SEQ_LOG_END      4
+#define SEQ_LOG_INIT     5
+#define SEQ_LOG_WAIT     6
+#define SEQ_LOG_DISCRET  7
+#define SEQ_LOG_CATCHUP  8
+#define SEQ_LOG_INFO     9
+#define SEQ_LOG_EVENT    10
+
+/* a line of the nodelog as given to the callbacks of the readers */
+typedef struct {
+   const char *node;       /* as logged, /main/task */
+   const char *ext;        /* loop extension, "" if none */
+   time_t      time;       /* of the TIMESTAMP, UTC */
+   int         state;      /* SEQ_LOG_ code */
+   off_t       offset;     /* of the line in the nodelog */
+   size_t      len;        /* of the line, with its newline */
+} SeqLogRecord;
+
+/* return non zero to stop the reading */
+typedef int (*SeqLogIndex_callback)( const SeqLogRecord *rec, void *arg );
+
+typedef struct _SeqLogIndex SeqLogIndex;
+
+/********************************************************************************
+ * Writer.  SeqLogIndex_open() opens (creating it if needed) the index of the
+ * nodelog at logpath, SeqLogIndex_update() indexes the complete lines the
+ * nodelog got since the last update, rebuilding the index when it is not
+ * that of the nodelog anymore.  Processes updating the same index are
+ * serialized by an fcntl() lock on it.  Return 0 on success, -1 on failure.
+********************************************************************************/
+SeqLogIndex *SeqLogIndex_open( const char *logpath );
+int  SeqLogIndex_update( SeqLogIndex *idx );
+void SeqLogIndex_close( SeqLogIndex *idx );
+
+/********************************************************************************
+ * Readers.  SeqLogIndex_latest() calls fn with the latest line of every node
+ * and loop extension of the nodelog at logpath, SeqLogIndex_history() with
+ * every line of node (any loop extension) in the order of the nodelog.
+ * Return the number of calls of fn, -1 when the nodelog cannot be read.
+********************************************************************************/
+int SeqLogIndex_latest( const char *logpath, SeqLogIndex_callback fn, void *arg );
+int SeqLogIndex_history( const char *logpath, const char *node, SeqLogIndex_callback fn, void *arg );
+
+#endif
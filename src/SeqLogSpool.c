@@ -0,0 +1,337 @@
+/* SeqLogSpool.c - Per host spool of the nodelog of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include "SeqUtil.h"
+#include "SeqLogSpool.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Inner workings.
+ * A segment is a file of the spool named after its host, its lines are those
+ * of the log preceded by "seconds.microseconds " of the time of the append.
+ * The writers open, write and close the segment for each line: the write of
+ * the kernel holding the file for an O_APPEND write, a line is never cut by
+ * another of the same host.
+ *
+ * Segments are never truncated or renamed, since a writer may have one open:
+ * the file .merged of the spool has, for each segment, the offset up to which
+ * its lines are in the log.  A merge, under the lock of the file .lock, reads
+ * every segment from its offset up to its last newline, sorts the lines by
+ * time (then by host and order in the segment), appends them to the log,
+ * syncs it and only then writes .merged again (a file renamed in place).  A
+ * merge interrupted between the two leaves lines to be appended again; one
+ * failing before leaves the log as it was.  The segments go away with the
+ * log, they belong to its datestamp.
+********************************************************************************/
+
+#define SPOOL_STATE ".merged"
+#define SPOOL_LOCK  ".lock"
+
+typedef struct {
+   char   *name;
+   off_t   offset;     /* merged up to */
+   off_t   end;        /* merged up to once this merge is done */
+   char   *data;       /* bytes from offset to end */
+} SpoolSegment;
+
+typedef struct {
+   long        sec, usec;
+   int         segment;
+   const char *text;   /* the line of the log, stamp removed */
+   size_t      len;
+} SpoolLine;
+
+/* write() the whole buffer, 0 or the errno of the failure */
+static int write_full( int fd, const char *buf, size_t len ) {
+   ssize_t num;
+
+   while ( len > 0 ) {
+      if ( (num = write(fd, buf, len)) < 0 ) {
+         if ( errno == EINTR ) continue;
+         return(errno);
+      }
+      buf += num;
+      len -= num;
+   }
+   return(0);
+}
+
+int SeqLogSpool_append( const char *logpath, const char *host, const char *line ) {
+   char path[1024], *buf, *c;
+   struct timeval tv;
+   size_t len;
+   int fd, n, err;
+
+   n = snprintf(path, sizeof(path), "%s%s", logpath, SEQ_LOG_SPOOL_EXT);
+   if ( n < 0 || n >= (int) sizeof(path) ) return(-1);
+   if ( mkdir(path, 0777) != 0 && errno != EEXIST ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: cannot create %s: %s\n", path, strerror(errno));
+      return(-1);
+   }
+   if ( snprintf(path + n, sizeof(path) - n, "/%s", host) >= (int) sizeof(path) - n ) return(-1);
+   /* a host is a file name, not a path nor one of the files of the merge */
+   for ( c = path + n + 1; *c != '\0'; c++ ) {
+      if ( *c == '/' || ( *c == '.' && c == path + n + 1 ) ) *c = '_';
+   }
+
+   len = strlen(line);
+   if ( (buf = malloc(len + 32)) == NULL ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqLogSpool malloc: Out of memory!\n");
+      return(-1);
+   }
+   gettimeofday(&tv, NULL);
+   n = sprintf(buf, "%ld.%06ld ", (long) tv.tv_sec, (long) tv.tv_usec);
+   memcpy(buf + n, line, len);
+   len += n;
+   if ( buf[len - 1] != '\n' ) buf[len++] = '\n';
+
+   if ( (fd = open(path, O_WRONLY|O_APPEND|O_CREAT, 00666)) < 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: cannot open %s: %s\n", path, strerror(errno));
+      free(buf);
+      return(-1);
+   }
+   if ( (err = write_full(fd, buf, len)) == 0 && fsync(fd) != 0 ) err = errno;
+   close(fd);
+   free(buf);
+   if ( err != 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: cannot write %s: %s\n", path, strerror(err));
+      return(-1);
+   }
+   return(0);
+}
+
+/* the time and the text of the line at c, -1 if it has no time */
+static int parse_stamp( char *c, SpoolLine *line ) {
+   char *end;
+
+   line->sec = line->usec = 0;
+   line->text = c;
+   if ( ! isdigit((unsigned char) *c) ) return(-1);
+   line->sec = strtol(c, &end, 10);
+   if ( *end != '.' || ! isdigit((unsigned char) end[1]) ) return(-1);
+   line->usec = strtol(end + 1, &end, 10);
+   if ( *end != ' ' ) return(-1);
+   line->text = end + 1;
+   return(0);
+}
+
+static int compare_lines( const void *a, const void *b ) {
+   const SpoolLine *la = (const SpoolLine *) a, *lb = (const SpoolLine *) b;
+
+   if ( la->sec != lb->sec ) return(la->sec < lb->sec ? -1 : 1);
+   if ( la->usec != lb->usec ) return(la->usec < lb->usec ? -1 : 1);
+   if ( la->segment != lb->segment ) return(la->segment < lb->segment ? -1 : 1);
+   return(la->text < lb->text ? -1 : la->text > lb->text);
+}
+
+/* reads the offsets of .merged into the segments of the same name */
+static void read_state( const char *path, SpoolSegment *segments, int nsegments ) {
+   char line[1024], name[1024];
+   long long offset;
+   FILE *fp;
+   int i;
+
+   if ( (fp = fopen(path, "r")) == NULL ) return;
+   while ( fgets(line, sizeof(line), fp) != NULL ) {
+      if ( sscanf(line, "%lld %1023s", &offset, name) != 2 ) continue;
+      for ( i = 0; i < nsegments; i++ ) {
+         if ( strcmp(segments[i].name, name) == 0 ) segments[i].offset = (off_t) offset;
+      }
+   }
+   fclose(fp);
+}
+
+static int write_state( const char *path, SpoolSegment *segments, int nsegments ) {
+   char tmp[1100];
+   FILE *fp;
+   int i, ret;
+
+   snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+   if ( (fp = fopen(tmp, "w")) == NULL ) return(-1);
+   for ( i = 0; i < nsegments; i++ ) fprintf(fp, "%lld %s\n", (long long) segments[i].end, segments[i].name);
+   ret = fflush(fp) != 0 || fsync(fileno(fp)) != 0;
+   if ( fclose(fp) != 0 || ret != 0 || rename(tmp, path) != 0 ) {
+      unlink(tmp);
+      return(-1);
+   }
+   return(0);
+}
+
+/* reads the complete lines added to the segment, 0 or -1 */
+static int read_segment( const char *dir, SpoolSegment *segment ) {
+   char path[1024];
+   struct stat st;
+   ssize_t num;
+   off_t done = 0;
+   int fd;
+
+   segment->end = segment->offset;
+   snprintf(path, sizeof(path), "%s/%s", dir, segment->name);
+   if ( (fd = open(path, O_RDONLY)) < 0 ) return(-1);
+   if ( fstat(fd, &st) != 0 ) {
+      close(fd);
+      return(-1);
+   }
+   if ( st.st_size < segment->offset ) {
+      /* not the segment merged before, taken again whole */
+      SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: %s is shorter than merged, merging it again\n", path);
+      segment->offset = segment->end = 0;
+   }
+   if ( st.st_size > segment->offset ) {
+      if ( (segment->data = malloc(st.st_size - segment->offset)) == NULL ) {
+         close(fd);
+         return(-1);
+      }
+      while ( done < st.st_size - segment->offset ) {
+         num = pread(fd, segment->data + done, st.st_size - segment->offset - done, segment->offset + done);
+         if ( num < 0 && errno == EINTR ) continue;
+         if ( num <= 0 ) break;
+         done += num;
+      }
+      /* a line being written is left to the next merge */
+      while ( done > 0 && segment->data[done - 1] != '\n' ) done--;
+      segment->end = segment->offset + done;
+   }
+   close(fd);
+   return(0);
+}
+
+int SeqLogSpool_merge( const char *logpath ) {
+   SpoolSegment *segments = NULL, *more;
+   SpoolLine *lines = NULL, *moreLines;
+   struct dirent *d;
+   struct flock fl;
+   struct stat st;
+   char dir[1024], path[1100], *c, *end, *out = NULL;
+   int nsegments = 0, maxsegments = 0, nlines = 0, maxlines = 0;
+   int i, fd, lockfd, err = 0, ret = -1;
+   size_t outLen = 0;
+   DIR *dp;
+
+   snprintf(dir, sizeof(dir), "%s%s", logpath, SEQ_LOG_SPOOL_EXT);
+   if ( stat(dir, &st) != 0 ) return(errno == ENOENT ? 0 : -1);
+
+   snprintf(path, sizeof(path), "%s/%s", dir, SPOOL_LOCK);
+   if ( (lockfd = open(path, O_RDWR|O_CREAT, 00666)) < 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: cannot open %s: %s\n", path, strerror(errno));
+      return(-1);
+   }
+   memset(&fl, '\0', sizeof fl);
+   fl.l_type = F_WRLCK;
+   fl.l_whence = SEEK_SET;
+   while ( fcntl(lockfd, F_SETLKW, &fl) != 0 ) {
+      if ( errno != EINTR ) {
+         SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: cannot lock %s\n", path);
+         close(lockfd);
+         return(-1);
+      }
+   }
+
+   if ( (dp = opendir(dir)) == NULL ) goto done;
+   while ( (d = readdir(dp)) != NULL ) {
+      if ( d->d_name[0] == '.' ) continue;
+      if ( nsegments == maxsegments ) {
+         maxsegments = maxsegments == 0 ? 16 : 2 * maxsegments;
+         if ( (more = realloc(segments, maxsegments * sizeof(SpoolSegment))) == NULL ) {
+            closedir(dp);
+            goto done;
+         }
+         segments = more;
+      }
+      memset(&segments[nsegments], '\0', sizeof(SpoolSegment));
+      if ( (segments[nsegments].name = strdup(d->d_name)) == NULL ) {
+         closedir(dp);
+         goto done;
+      }
+      nsegments++;
+   }
+   closedir(dp);
+
+   snprintf(path, sizeof(path), "%s/%s", dir, SPOOL_STATE);
+   read_state(path, segments, nsegments);
+
+   for ( i = 0; i < nsegments; i++ ) {
+      if ( read_segment(dir, &segments[i]) != 0 ) {
+         SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: cannot read segment %s of %s\n", segments[i].name, dir);
+         goto done;
+      }
+      end = segments[i].data + (segments[i].end - segments[i].offset);
+      for ( c = segments[i].data; c != NULL && c < end; c = (char *) memchr(c, '\n', end - c) + 1 ) {
+         if ( nlines == maxlines ) {
+            maxlines = maxlines == 0 ? 256 : 2 * maxlines;
+            if ( (moreLines = realloc(lines, maxlines * sizeof(SpoolLine))) == NULL ) goto done;
+            lines = moreLines;
+         }
+         lines[nlines].segment = i;
+         if ( parse_stamp(c, &lines[nlines]) != 0 ) {
+            SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: line without time in segment %s of %s\n", segments[i].name, dir);
+         }
+         lines[nlines].len = (char *) memchr(lines[nlines].text, '\n', end - lines[nlines].text) + 1 - lines[nlines].text;
+         outLen += lines[nlines].len;
+         nlines++;
+      }
+   }
+
+   if ( nlines > 0 ) {
+      qsort(lines, nlines, sizeof(SpoolLine), compare_lines);
+      if ( (out = malloc(outLen)) == NULL ) goto done;
+      for ( i = 0, outLen = 0; i < nlines; i++ ) {
+         memcpy(out + outLen, lines[i].text, lines[i].len);
+         outLen += lines[i].len;
+      }
+      if ( (fd = open(logpath, O_WRONLY|O_APPEND|O_CREAT, 00666)) < 0 ) {
+         SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: cannot open %s: %s\n", logpath, strerror(errno));
+         goto done;
+      }
+      if ( (err = write_full(fd, out, outLen)) == 0 && fsync(fd) != 0 ) err = errno;
+      close(fd);
+      if ( err != 0 ) {
+         SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: cannot write %s: %s\n", logpath, strerror(err));
+         goto done;
+      }
+      if ( write_state(path, segments, nsegments) != 0 ) {
+         SeqUtil_TRACE(TL_ERROR, "SeqLogSpool: cannot write %s, its lines will be merged again\n", path);
+         goto done;
+      }
+   }
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqLogSpool_merge() %s segments:%d lines:%d\n", dir, nsegments, nlines);
+   ret = nlines;
+
+done:
+   for ( i = 0; i < nsegments; i++ ) {
+      free(segments[i].name);
+      free(segments[i].data);
+   }
+   free(segments);
+   free(lines);
+   free(out);
+   close(lockfd);
+   return(ret);
+}
@@ -0,0 +1,57 @@
+/* SeqLogSpool.h - Per host spool of the nodelog of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SEQ_LOG_SPOOL_H_
+#define _SEQ_LOG_SPOOL_H_
+
+/********************************************************************************
+ * DOCUMENTATION: Interface.
+ * When mserver cannot be reached, the nodelogger does not append to the
+ * nodelog (or toplog) itself: it appends the line to the segment of its host
+ * in the spool of the log, the directory SEQ_LOG_SPOOL_EXT added to the path
+ * of the log.  A segment is only appended to, by the processes of one host,
+ * each line with a single O_APPEND write(), so that the writers need no lock
+ * and no other host: the lines of a host never interleave.
+ *
+ * The lines of the segments reach the log when they are merged, by logreader
+ * before it reads the log and by mserver before it appends to it.  A merge
+ * takes the complete lines added to the segments since the previous merge,
+ * puts them in the order of their time, and appends them to the log with one
+ * write().  Mergers are serialized by an fcntl() lock in the spool, which the
+ * writers never take.
+********************************************************************************/
+
+#define SEQ_LOG_SPOOL_EXT  ".spool"
+
+/********************************************************************************
+ * Appends line (a nodelog line with its newline) to the segment of host in
+ * the spool of the log at logpath, creating both when needed.  Returns 0 on
+ * success, -1 on failure.
+********************************************************************************/
+int SeqLogSpool_append( const char *logpath, const char *host, const char *line );
+
+/********************************************************************************
+ * Merges the spool of the log at logpath into it.  Returns the number of
+ * lines appended to the log, 0 when there is no spool, -1 on failure (the
+ * lines stay in the spool for the next merge).
+********************************************************************************/
+int SeqLogSpool_merge( const char *logpath );
+
+#endif
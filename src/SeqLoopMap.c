@@ -0,0 +1,318 @@
+/* SeqLoopMap.c - Completion maps of the loops of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "SeqUtil.h"
+#include "SeqLoopsUtil.h"
+#include "SeqLoopMap.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Inner workings.
+ * A map is a header followed by the words of the done bits then the words of
+ * the aborted bits, the bit of rank r being bit r%64 of word r/64.  The header
+ * has a signature of the loop space (base, levels and their definitions) and
+ * the number of iterations; a map whose header does not match the space is
+ * stale and built again.  A build truncates the file, writes the words then the
+ * header, so that a build cut short leaves a map without a header.
+ *
+ * Every access locks the whole file for writing.  A process that got the lock
+ * on a map removed meanwhile (SeqLoopMap_remove) opens the path again, so that
+ * no change goes to a file nobody reads any more.
+********************************************************************************/
+
+#define LOOPMAP_MAGIC   "LOOPMAP1"
+#define LOOPMAP_VERSION 1
+#define LOOPMAP_ORDER   0x01020304
+
+typedef struct {
+   char               magic[8];
+   unsigned int       version;
+   unsigned int       order;      /* LOOPMAP_ORDER as written, for the byte order */
+   unsigned long long signature;  /* of the loop space */
+   unsigned long long nbits;      /* iterations of the loop space */
+   unsigned long long done;       /* bits set of each bitmap */
+   unsigned long long aborted;
+} LoopMapHeader;
+
+#define LOOPMAP_WORDS(nbits) ( ((nbits) + 63) / 64 )
+
+/* FNV-1a */
+static unsigned long long loopmap_hash( unsigned long long hash, const void *data, size_t size ) {
+   const unsigned char *p = data;
+
+   while ( size-- > 0 ) {
+      hash ^= *p++;
+      hash *= 1099511628211ULL;
+   }
+   return(hash);
+}
+
+static unsigned long long loopmap_signature( const SeqLoopSpace *space ) {
+   unsigned long long hash = 14695981039346656037ULL;
+   const SeqLoopLevel *level;
+   int i, d;
+
+   hash = loopmap_hash(hash, space->base, strlen(space->base) + 1);
+   for ( i = 0; i < space->nlevels; i++ ) {
+      level = &space->levels[i];
+      if ( level->value != NULL ) hash = loopmap_hash(hash, level->value, strlen(level->value) + 1);
+      for ( d = 0; d < level->ndefs; d++ ) {
+         hash = loopmap_hash(hash, &level->defs[d].start, sizeof(level->defs[d].start));
+         hash = loopmap_hash(hash, &level->defs[d].step, sizeof(level->defs[d].step));
+         hash = loopmap_hash(hash, &level->defs[d].count, sizeof(level->defs[d].count));
+      }
+      hash = loopmap_hash(hash, &level->count, sizeof(level->count));
+   }
+   return(hash);
+}
+
+static int loopmap_lock( int fd, short type ) {
+   struct flock fl;
+
+   memset(&fl, '\0', sizeof fl);
+   fl.l_type = type;
+   fl.l_whence = SEEK_SET;
+   while ( fcntl(fd, F_SETLKW, &fl) != 0 ) {
+      if ( errno != EINTR ) return(1);
+   }
+   return(0);
+}
+
+/* the map at path opened and locked, -1 with errno set if it is missing (and not create),
+   cannot be opened or cannot be locked */
+static int loopmap_open( const char *path, int create ) {
+   struct stat sfd, spath;
+   int fd, err;
+
+   for (;;) {
+      if ( (fd = open(path, create ? O_RDWR|O_CREAT : O_RDWR, 0644)) < 0 ) {
+         if ( (err = errno) != ENOENT ) SeqUtil_TRACE(TL_ERROR, "SeqLoopMap: cannot open %s\n", path);
+         errno = err;
+         return(-1);
+      }
+      if ( loopmap_lock(fd, F_WRLCK) != 0 ) {
+         err = errno;
+         SeqUtil_TRACE(TL_ERROR, "SeqLoopMap: cannot lock %s\n", path);
+         close(fd);
+         errno = err;
+         return(-1);
+      }
+      if ( fstat(fd, &sfd) == 0 && stat(path, &spath) == 0 &&
+           sfd.st_dev == spath.st_dev && sfd.st_ino == spath.st_ino ) {
+         return(fd);
+      }
+      /* removed while waiting for the lock */
+      close(fd);
+   }
+}
+
+static void loopmap_close( int fd ) {
+   loopmap_lock(fd, F_UNLCK);
+   close(fd);
+}
+
+/* reads the header of the map, returns 0 if it matches the space */
+static int loopmap_header( int fd, const SeqLoopSpace *space, LoopMapHeader *hdr ) {
+   struct stat sb;
+
+   if ( fstat(fd, &sb) != 0 || pread(fd, hdr, sizeof(LoopMapHeader), 0) != sizeof(LoopMapHeader) ) return(1);
+   if ( memcmp(hdr->magic, LOOPMAP_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != LOOPMAP_VERSION || hdr->order != LOOPMAP_ORDER ||
+        hdr->signature != loopmap_signature(space) || hdr->nbits != space->count ||
+        hdr->done > hdr->nbits || hdr->aborted > hdr->nbits ||
+        sb.st_size != sizeof(LoopMapHeader) + 2 * LOOPMAP_WORDS(hdr->nbits) * sizeof(uint64_t) ) {
+      return(1);
+   }
+   return(0);
+}
+
+/* the bits of the whole map, from scan, written to fd */
+static int loopmap_build( int fd, const SeqLoopSpace *space, SeqLoopMapScan scan, void *arg, LoopMapHeader *hdr ) {
+   size_t nwords = LOOPMAP_WORDS(space->count);
+   uint64_t *words = NULL;
+   char extension[SEQ_MAXFIELD];
+   SeqLoopIterator iterator;
+   unsigned long rank = 0;
+   int flags, ret = 0;
+
+   if ( nwords > 0 && (words = calloc(2 * nwords, sizeof(uint64_t))) == NULL ) return(1);
+
+   memset(hdr, '\0', sizeof(LoopMapHeader));
+   memcpy(hdr->magic, LOOPMAP_MAGIC, sizeof(hdr->magic));
+   hdr->version = LOOPMAP_VERSION;
+   hdr->order = LOOPMAP_ORDER;
+   hdr->signature = loopmap_signature(space);
+   hdr->nbits = space->count;
+
+   SeqLoops_iteratorInit(&iterator, space, 0);
+   while ( SeqLoops_iteratorNext(&iterator, extension, sizeof extension) ) {
+      flags = scan(extension, arg);
+      if ( flags & SEQ_LOOPMAP_DONE ) {
+         words[rank / 64] |= (uint64_t) 1 << (rank % 64);
+         hdr->done++;
+      }
+      if ( flags & SEQ_LOOPMAP_ABORTED ) {
+         words[nwords + rank / 64] |= (uint64_t) 1 << (rank % 64);
+         hdr->aborted++;
+      }
+      rank++;
+   }
+
+   if ( ftruncate(fd, 0) != 0 ||
+        ( nwords > 0 && pwrite(fd, words, 2 * nwords * sizeof(uint64_t), sizeof(LoopMapHeader)) != (ssize_t) (2 * nwords * sizeof(uint64_t)) ) ||
+        pwrite(fd, hdr, sizeof(LoopMapHeader), 0) != sizeof(LoopMapHeader) ) {
+      ret = 1;
+   }
+   free(words);
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqLoopMap: built map of %lu iterations, done=%llu aborted=%llu\n", space->count, hdr->done, hdr->aborted);
+   return(ret);
+}
+
+int SeqLoopMap_stateFlags( const char *state ) {
+   if ( strcmp(state, "end") == 0 || strcmp(state, "abort.cont") == 0 ) return(SEQ_LOOPMAP_DONE);
+   if ( strcmp(state, "abort.stop") == 0 ) return(SEQ_LOOPMAP_ABORTED);
+   return(0);
+}
+
+int SeqLoopMap_counts( const char *path, const SeqLoopSpace *space, SeqLoopMapScan scan, void *arg,
+                       unsigned long *done, unsigned long *aborted ) {
+   LoopMapHeader hdr;
+   int fd;
+
+   if ( (fd = loopmap_open(path, 1)) < 0 ) return(-1);
+   if ( loopmap_header(fd, space, &hdr) != 0 && loopmap_build(fd, space, scan, arg, &hdr) != 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqLoopMap: cannot build %s\n", path);
+      loopmap_close(fd);
+      return(-1);
+   }
+   loopmap_close(fd);
+   *done = hdr.done;
+   *aborted = hdr.aborted;
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqLoopMap_counts() %s iterations=%lu done=%lu aborted=%lu\n", path, space->count, *done, *aborted);
+   return(0);
+}
+
+int SeqLoopMap_set( const char *path, const SeqLoopSpace *space, const char *extension, int flags ) {
+   LoopMapHeader hdr;
+   uint64_t word, bit;
+   off_t offset;
+   long rank;
+   int fd, i, ret = 0;
+
+   if ( (fd = loopmap_open(path, 0)) < 0 ) {
+      if ( errno == ENOENT ) return(0);
+      /* a map left behind without this iteration would be wrong, it is built again */
+      SeqUtil_TRACE(TL_ERROR, "SeqLoopMap: cannot update %s, removed\n", path);
+      return(unlink(path) == 0 || errno == ENOENT ? 0 : 1);
+   }
+   if ( loopmap_header(fd, space, &hdr) != 0 || (rank = SeqLoops_spaceRank(space, extension)) < 0 ) {
+      /* stale, built again when needed */
+      ret = ftruncate(fd, 0);
+      loopmap_close(fd);
+      return(ret);
+   }
+
+   bit = (uint64_t) 1 << (rank % 64);
+   for ( i = 0; i < 2 && ret == 0; i++ ) {
+      offset = sizeof(LoopMapHeader) + ((i * LOOPMAP_WORDS(hdr.nbits)) + rank / 64) * sizeof(uint64_t);
+      if ( pread(fd, &word, sizeof word, offset) != sizeof word ) {
+         ret = 1;
+         break;
+      }
+      if ( ((flags & (i == 0 ? SEQ_LOOPMAP_DONE : SEQ_LOOPMAP_ABORTED)) != 0) == ((word & bit) != 0) ) continue;
+      word ^= bit;
+      if ( i == 0 ) hdr.done += (word & bit) ? 1 : -1; else hdr.aborted += (word & bit) ? 1 : -1;
+      if ( pwrite(fd, &word, sizeof word, offset) != sizeof word ) ret = 1;
+   }
+   if ( ret == 0 && pwrite(fd, &hdr, sizeof hdr, 0) != sizeof hdr ) ret = 1;
+   if ( ret != 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqLoopMap: cannot update %s, emptied\n", path);
+      ret = ftruncate(fd, 0);
+   }
+   loopmap_close(fd);
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqLoopMap_set() %s extension=%s flags=%d\n", path, extension, flags);
+   return(ret);
+}
+
+int SeqLoopMap_verify( const char *path, const SeqLoopSpace *space, SeqLoopMapScan scan, void *arg, FILE *fp ) {
+   size_t nwords = LOOPMAP_WORDS(space->count);
+   uint64_t *words = NULL;
+   unsigned long long done = 0, aborted = 0;
+   char extension[SEQ_MAXFIELD];
+   SeqLoopIterator iterator;
+   LoopMapHeader hdr;
+   unsigned long rank = 0;
+   int fd, flags, mapFlags, differ = 0;
+
+   if ( (fd = loopmap_open(path, 1)) < 0 ) return(-1);
+   if ( loopmap_header(fd, space, &hdr) != 0 ) {
+      /* nothing to compare with, the map is built */
+      differ = loopmap_build(fd, space, scan, arg, &hdr) == 0 ? 0 : -1;
+      loopmap_close(fd);
+      return(differ);
+   }
+   if ( nwords > 0 && ( (words = malloc(2 * nwords * sizeof(uint64_t))) == NULL ||
+        pread(fd, words, 2 * nwords * sizeof(uint64_t), sizeof(LoopMapHeader)) != (ssize_t) (2 * nwords * sizeof(uint64_t)) ) ) {
+      free(words);
+      loopmap_close(fd);
+      return(-1);
+   }
+
+   SeqLoops_iteratorInit(&iterator, space, 0);
+   while ( SeqLoops_iteratorNext(&iterator, extension, sizeof extension) ) {
+      mapFlags = ( (words[rank / 64] >> (rank % 64)) & 1 ? SEQ_LOOPMAP_DONE : 0 ) |
+                 ( (words[nwords + rank / 64] >> (rank % 64)) & 1 ? SEQ_LOOPMAP_ABORTED : 0 );
+      done += (mapFlags & SEQ_LOOPMAP_DONE) != 0;
+      aborted += (mapFlags & SEQ_LOOPMAP_ABORTED) != 0;
+      if ( (flags = scan(extension, arg)) != mapFlags ) {
+         if ( fp != NULL ) fprintf(fp, "%s %s: map done=%d aborted=%d, status files done=%d aborted=%d\n", path, extension,
+                                   (mapFlags & SEQ_LOOPMAP_DONE) != 0, (mapFlags & SEQ_LOOPMAP_ABORTED) != 0,
+                                   (flags & SEQ_LOOPMAP_DONE) != 0, (flags & SEQ_LOOPMAP_ABORTED) != 0);
+         differ++;
+      }
+      rank++;
+   }
+   if ( fp != NULL && (done != hdr.done || aborted != hdr.aborted) ) {
+      fprintf(fp, "%s: counts done=%llu aborted=%llu, bits done=%llu aborted=%llu\n", path, hdr.done, hdr.aborted, done, aborted);
+   }
+   if ( (differ > 0 || done != hdr.done || aborted != hdr.aborted) && loopmap_build(fd, space, scan, arg, &hdr) != 0 ) {
+      differ = -1;
+   }
+   free(words);
+   loopmap_close(fd);
+   return(differ);
+}
+
+int SeqLoopMap_remove( const char *path ) {
+   int fd, ret;
+
+   if ( (fd = loopmap_open(path, 0)) < 0 ) return(access(path, F_OK) == 0 ? 1 : 0);
+   ret = unlink(path);
+   loopmap_close(fd);
+   return(ret);
+}
@@ -0,0 +1,87 @@
+/* SeqLoopMap.h - Completion maps of the loops of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SEQ_LOOP_MAP_H_
+#define _SEQ_LOOP_MAP_H_
+
+#include <stdio.h>
+#include "SeqLoopsUtil.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Interface.
+ * The loop map of a loop instance (a loop node in one iteration of its
+ * containers) has a bit per iteration for the iterations that are done (end or
+ * abort.cont state), another for the ones that are aborted (abort.stop), and
+ * the count of each: whether the loop is complete or has an aborted iteration
+ * is known without the status file of every iteration.  The map is the file
+ * $node.$ext.loopmap next to the status files of the loop node, ext being the
+ * extension of the instance, and the bits are ranked by the loop space of the
+ * loop (SeqLoops_childSpace).
+ *
+ * The status files stay the reference.  A map is built from them, through the
+ * scan function of the caller, the first time it is needed and whenever it no
+ * longer matches the loop space; maestro sets the bits of an iteration after
+ * its status file, both under an fcntl() lock of the map.  Removing a map is
+ * always safe, it is built again.
+ *
+ * The image is native endian and versioned, a map of another version or byte
+ * order is built again.
+********************************************************************************/
+
+#define SEQ_LOOPMAP_SUFFIX  "loopmap"
+
+/* flags of an iteration */
+#define SEQ_LOOPMAP_DONE    1
+#define SEQ_LOOPMAP_ABORTED 2
+
+/* the flags of the iteration of a loop with this extension, from its status files */
+typedef int (*SeqLoopMapScan)( const char *extension, void *arg );
+
+/* the flags of an iteration in state (begin, end, abort.stop, ..., init) */
+int SeqLoopMap_stateFlags( const char *state );
+
+/********************************************************************************
+ * The number of iterations of the map at path that are done and aborted.  The
+ * map is built with scan first if it is missing or does not match the space.
+ * Returns 0 if succeeds, -1 if the map cannot be used.
+********************************************************************************/
+int SeqLoopMap_counts( const char *path, const SeqLoopSpace *space, SeqLoopMapScan scan, void *arg,
+                       unsigned long *done, unsigned long *aborted );
+
+/********************************************************************************
+ * Sets the flags of the iteration with extension in the map at path.  A
+ * missing map is left to be built from the status files, a map that does not
+ * match the space is emptied and one that cannot be opened or locked is
+ * removed, both to be built again.  Returns 0 if succeeds.
+********************************************************************************/
+int SeqLoopMap_set( const char *path, const SeqLoopSpace *space, const char *extension, int flags );
+
+/********************************************************************************
+ * Cross-checks the map at path against the status files: every iteration
+ * whose bits differ from what scan returns is printed to fp (if not NULL), and
+ * a map with differences is built again from scan.  Returns the number of
+ * iterations that differ, -1 if the map cannot be used.
+********************************************************************************/
+int SeqLoopMap_verify( const char *path, const SeqLoopSpace *space, SeqLoopMapScan scan, void *arg, FILE *fp );
+
+/* removes the map at path, returns 0 if it is gone */
+int SeqLoopMap_remove( const char *path );
+
+#endif
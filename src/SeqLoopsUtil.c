@@ -37,13 +37,7 @@
 static char* EXT_TOKEN = "+";
 
 static int hasWildCard(SeqNameValuesPtr depArg);
-static LISTNODEPTR loopArg_to_reverse_extension_list( SeqNodeDataPtr _nodeDataPtr, SeqNameValuesPtr arg);
-static LISTNODEPTR loop_to_reverse_extension_list(SeqLoopsPtr loopPtr);
-static LISTNODEPTR switch_to_extension_list(SeqLoopsPtr loopPtr);
-static LISTNODEPTR SeqNodeData_to_reverse_extension_list( SeqNodeDataPtr _nodeDataPtr);
-static LISTNODEPTR numerical_to_reverse_extension_list(SeqNameValuesPtr loopData);
-static LISTNODEPTR expression_to_reverse_extension_list( char * expression );
-static LISTNODEPTR def_to_reverse_extension_list( int start, int end, int step);
+static LISTNODEPTR space_to_list( SeqLoopSpacePtr space, int reverse );
 
 LISTNODEPTR SeqLoops_childExtensions( SeqNodeDataPtr _nodeDataPtr );
 LISTNODEPTR SeqLoops_getLoopContainerExtensions( SeqNodeDataPtr _nodeDataPtr, const char * depIndex );
@@ -120,7 +114,7 @@ char * SeqLoops_indexToExt(const char * index)
    cmd_args must be in the form "loop_name=value,loop_namex=valuex"
 */
 int SeqLoops_parseArgs( SeqNameValuesPtr* nameValuesPtr, const char* cmd_args ) {
-   char *tmpstrtok = NULL, *tmp_args = NULL;
+   char *tmpstrtok = NULL, *tmp_args = NULL, *saveptr = NULL;
    char loopName[100], loopValue[50];
    int isError = 0, n=0;
    
@@ -129,7 +123,7 @@ int SeqLoops_parseArgs( SeqNameValuesPtr* nameValuesPtr, const char* cmd_args )
    */
    
    tmp_args = strdup( cmd_args );
-   tmpstrtok = (char*) strtok( tmp_args, "," );
+   tmpstrtok = (char*) strtok_r( tmp_args, ",", &saveptr );
    while ( tmpstrtok != NULL ) {
       /* any alphanumeric characters and special chars
          _:/-$()* are supported */
@@ -146,7 +140,7 @@ int SeqLoops_parseArgs( SeqNameValuesPtr* nameValuesPtr, const char* cmd_args )
          SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_parseArgs inserted %s = %s\n", loopName, loopValue ); 
          SeqNameValues_insertItem( nameValuesPtr, loopName, loopValue );
       }
-      tmpstrtok = (char*) strtok(NULL,",");
+      tmpstrtok = (char*) strtok_r(NULL,",",&saveptr);
    }
    SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_parseArgsdone exit status: %d\n", isError ); 
    free( tmp_args );
@@ -328,47 +322,10 @@ char* SeqLoops_NodeExtension( const char* node_name, SeqNameValuesPtr loop_args_
  * To be used to check if a loop parent node is done,
  * assuming that extension is set in  _nodeDataPtr->extension 
  * List is given end first for optimization purposes. 
+ * Prefer iterating SeqLoops_childSpace(), the list holds every iteration.
 */
 LISTNODEPTR SeqLoops_childExtensionsInReverse( SeqNodeDataPtr _nodeDataPtr ) {
-   SeqNameValuesPtr nodeSpecPtr = NULL;
-   char tmp[20], *baseExtension;
-   int loopStart = 0, loopStep = 1, loopEnd = 1, loopCount = 0;
-   char *tmpExpression = NULL, *tmpAttributeValue=NULL;
-   LISTNODEPTR loopExtensions = NULL, tmpLoopExtensions = NULL;
-   memset( tmp, '\0', sizeof tmp );
-   baseExtension = SeqLoops_getExtensionBase( _nodeDataPtr );
-   nodeSpecPtr = _nodeDataPtr->data;
-   
-   tmpExpression = SeqLoops_getLoopAttribute( nodeSpecPtr, "EXPRESSION" );
-   if (tmpExpression != NULL && strcmp(tmpExpression, "") != 0) {
-      SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_childExtensionsInReverse expression: %s\n", tmpExpression);
-      tmpLoopExtensions = (LISTNODEPTR) SeqLoops_childExtensions(_nodeDataPtr);
-      SeqListNode_reverseList ( &tmpLoopExtensions );
-      loopExtensions = tmpLoopExtensions;
-   } else {
-
-      if (( tmpAttributeValue = SeqLoops_getLoopAttribute( nodeSpecPtr, "START" )) != NULL ) { 
-         loopStart = atoi(tmpAttributeValue);
-      } 
-      if(( tmpAttributeValue = SeqLoops_getLoopAttribute( nodeSpecPtr, "STEP" )) != NULL ) { 
-	      loopStep = atoi(tmpAttributeValue);
-      }
-      if(( tmpAttributeValue =  SeqLoops_getLoopAttribute( nodeSpecPtr, "END" )) != NULL ) {
-         loopEnd = atoi(tmpAttributeValue);
-         /* real end will be loopStart + loopStep * somevalue */ 
-         int multiplier = ( loopEnd - loopStart ) / loopStep; 
-         loopEnd = loopStart + loopStep * multiplier; 
-      }
-      SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_childExtensionsInReverse extension:%s baseExtension:%s START:%d END:%d\n",_nodeDataPtr->extension, baseExtension, loopEnd, loopStart );
-      loopCount = loopEnd;
-      while( loopCount >= loopStart ) {
-	      sprintf( tmp, "%s%s%d", baseExtension, EXT_TOKEN, loopCount );
-	      SeqListNode_insertItem( &loopExtensions, tmp );
-	      loopCount = loopCount - loopStep;
-      }
-   }
-
-   return loopExtensions;
+   return space_to_list( SeqLoops_childSpace( _nodeDataPtr ), 1 );
 }
 
 
@@ -376,91 +333,10 @@ LISTNODEPTR SeqLoops_childExtensionsInReverse( SeqNodeDataPtr _nodeDataPtr ) {
 /* return the loop container extension values that the current node is in. (ex: +3+1 -> +3+2 -> +3+3) 
  * Current node must be a loop node.
    To be used to check if a loop parent node is done,
-   assuming that extension is set in  _nodeDataPtr->extension */
+   assuming that extension is set in  _nodeDataPtr->extension
+   Prefer iterating SeqLoops_childSpace(), the list holds every iteration. */
 LISTNODEPTR SeqLoops_childExtensions( SeqNodeDataPtr _nodeDataPtr ) {
-   SeqNameValuesPtr nodeSpecPtr = NULL;
-   char tmp[20], *baseExtension;
-   int expressionArray[256], i, startIndex=0, endIndex=1, stepIndex=2, detectedEnd=0;
-   char *tmpExpression = NULL, *tmpArrayValue = NULL, *tmpAttributeValue = NULL;
-   int loopStart = 0, loopStep = 1, loopEnd = 0, loopCount = 0, breakFlag, firstFlag=1;
-   LISTNODEPTR loopExtensions = NULL;
-   memset( tmp, '\0', sizeof tmp );
-   baseExtension = SeqLoops_getExtensionBase( _nodeDataPtr );
-   nodeSpecPtr = _nodeDataPtr->data;
-
-   tmpExpression = SeqLoops_getLoopAttribute( nodeSpecPtr, "EXPRESSION" );
-   
-   if ((tmpExpression != NULL && strcmp(tmpExpression, "") != 0) && ((SeqLoops_getLoopAttribute( nodeSpecPtr, "START" ) != NULL) ||
-      (SeqLoops_getLoopAttribute( nodeSpecPtr, "END" ) != NULL) ||
-      (SeqLoops_getLoopAttribute( nodeSpecPtr, "SET" ) != NULL) ||
-      (SeqLoops_getLoopAttribute( nodeSpecPtr, "STEP" ) != NULL))) {
-      raiseError("SeqLoops_childExtensions Error: loop syntax must be defined with start, end, step, step attributes OR with an expression attribute\n");
-   }
-   
-   if (tmpExpression != NULL && strcmp(tmpExpression, "") != 0) {
-      SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_childExtensions expression: %s\n", tmpExpression);
-      
-      i=0;
-      tmpArrayValue = strtok (tmpExpression,":,");
-      while (tmpArrayValue != NULL) {
-	 expressionArray[i] = atoi(tmpArrayValue);
-	 /*End is the biggest number of the expression*/
-	 if (expressionArray[i]>detectedEnd)
-	    detectedEnd=expressionArray[i];
-	 i++;
-	 tmpArrayValue = strtok (NULL,":,");
-      }
-      
-      while( loopCount <= detectedEnd ) {
-	 loopCount = expressionArray[startIndex];
-	 breakFlag = 0;
-	 if ((startIndex-4) >= 0 && loopCount != expressionArray[endIndex-4]) {
-	    firstFlag = 1;
-	 }
-	 while( loopCount <= expressionArray[endIndex] && breakFlag == 0){
-	    if (firstFlag == 0) {
-	       if ((loopCount+expressionArray[stepIndex]) <= expressionArray[endIndex]) {
-		  loopCount = loopCount + expressionArray[stepIndex];
-	       } else {
-		  breakFlag = 1;
-	       }
-	    } else {
-	       firstFlag = 0;
-	    }
-	    if (breakFlag == 0) {
-	       sprintf( tmp, "%s%s%d", baseExtension, EXT_TOKEN, loopCount );
-	       SeqListNode_insertItem( &loopExtensions, tmp );
-	    }
-	 }
-	 if ((stepIndex+4) < i) {
-	    endIndex=endIndex+4;
-	    stepIndex=stepIndex+4;
-	    startIndex=startIndex+4;
-	 } else {
-	    break;
-	 }
-      }
-   } else {
-      SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_childExtensions extension:%s baseExtension:%s\n",_nodeDataPtr->extension, baseExtension);
-      if ( (tmpAttributeValue = SeqLoops_getLoopAttribute( nodeSpecPtr, "START" )) != NULL ) { 
-         loopStart = atoi(tmpAttributeValue);
-      } 
-      if( (tmpAttributeValue = SeqLoops_getLoopAttribute( nodeSpecPtr, "STEP" )) != NULL ) { 
-	      loopStep = atoi(tmpAttributeValue);
-      }
-      if( (tmpAttributeValue =  SeqLoops_getLoopAttribute( nodeSpecPtr, "END" )) != NULL ) {
-         loopEnd = atoi(tmpAttributeValue);
-      }
-
-      loopCount = loopStart;
-      while( loopCount <= loopEnd ) {
-	      sprintf( tmp, "%s%s%d", baseExtension, EXT_TOKEN, loopCount );
-	      SeqListNode_insertItem( &loopExtensions, tmp );
-	      loopCount = loopCount + loopStep;
-      }
-   }
-
-   return loopExtensions;
+   return space_to_list( SeqLoops_childSpace( _nodeDataPtr ), 0 );
 }
 
 /* returns 1 if the parent of a node is a loop container */
@@ -483,39 +359,15 @@ int SeqLoops_isParentLoopContainer ( const SeqNodeDataPtr _nodeDataPtr ) {
  * This function determines the list of possible extensions specified by
  * depIndex.  There may be many of them if there are wildcards in depIndex.  For
  * example, if we have index="n1=*,n2=x,n3=*", and n1 can be A or B, and n3 can
- * be C,D,E:.  In the first iteration, loopExtensions will be {+B, +A}, then
- * { +B, +A} x { +X} = {+B+X, +A+X}, and then the final list
- * { +B+X, +A+X } x { +E, +D, +C} = { +B+X+E, +B+X+D, +B+X+C, +A+X+E, +A+X+D, +A+X+C }.
+ * be C,D,E:.  The list is the reverse of { +A, +B } x { +X } x { +C, +D, +E }
+ * = { +B+X+E, +B+X+D, +B+X+C, +A+X+E, +A+X+D, +A+X+C }.
+ * Prefer iterating SeqLoops_containerSpace(), the list holds every iteration.
 ********************************************************************************/
 LISTNODEPTR SeqLoops_getLoopContainerExtensionsInReverse( SeqNodeDataPtr _nodeDataPtr, const char * depIndex ) {
-   LISTNODEPTR loopExtensions=NULL, prod=NULL, rhs=NULL;
-   SeqNameValuesPtr depArgs=NULL, arg=NULL;
+   LISTNODEPTR loopExtensions = NULL;
 
    SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensionsInReverse(): Begin call\n");
-
-   if( depIndex == NULL || strlen(depIndex) == 0){
-      SeqListNode_pushFront(&loopExtensions, "");
-      SeqUtil_TRACE(TL_FULL_TRACE, "No extension, returning 1 elem list containing empty string");
-      goto out;
-   }
-
-   SeqNode_showLoops(_nodeDataPtr->loops,TL_FULL_TRACE);
-   SeqLoops_parseArgs(&depArgs,depIndex);
-
-   for( arg = depArgs; arg != NULL; arg = arg->nextPtr){
-      rhs = loopArg_to_reverse_extension_list(_nodeDataPtr,arg);
-      if ( loopExtensions == NULL ){
-         loopExtensions = rhs;
-      } else {
-         /* loopExtensions = loopExtensions (X) rhs */
-         prod = SeqListNode_multiply_lists(loopExtensions, rhs);
-         SeqListNode_deleteWholeList(&loopExtensions);
-         SeqListNode_deleteWholeList(&rhs);
-         rhs = NULL;
-         loopExtensions = prod;
-      }
-   }
-out:
+   loopExtensions = space_to_list( SeqLoops_containerSpace( _nodeDataPtr, depIndex ), 1 );
    SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensionsInReverse(): returning list:   \n");
    SeqListNode_printList(loopExtensions); SeqUtil_TRACE(TL_FULL_TRACE,"\n");
    return loopExtensions;
@@ -529,32 +381,6 @@ static int hasWildCard(SeqNameValuesPtr loop_arg)
    return ( strstr(loop_arg->value, "*") != NULL );
 }
 
-/********************************************************************************
- * Returns the reverse list of possible extensions for a loop (numerical loop or
- * switch).  The function looks for a loop matching arg->name in
- * _nodeDataPtr->loops, then looks in nodeDataPtr->data if nodeDataPtr is the
- * loop we are looking for.
-********************************************************************************/
-static LISTNODEPTR loopArg_to_reverse_extension_list( SeqNodeDataPtr _nodeDataPtr, SeqNameValuesPtr arg)
-{
-   LISTNODEPTR extensionList = NULL;
-
-   if( ! hasWildCard(arg)){
-      char buffer[100] = {'\0'};
-      sprintf(buffer,"%s%s",EXT_TOKEN,arg->value);
-      SeqListNode_insertItem(&extensionList,buffer);
-   } else {
-      SeqLoopsPtr loopPtr = NULL;
-      loopPtr = SeqLoops_findLoopByName(_nodeDataPtr->loops, arg->name);
-      if(loopPtr != NULL)
-         extensionList = loop_to_reverse_extension_list(loopPtr);
-      else if( strcmp(arg->name, _nodeDataPtr->nodeName) == 0 )
-         extensionList = SeqNodeData_to_reverse_extension_list(_nodeDataPtr);
-      else
-         raiseError("loopArg_to_reverse_extension_list() unable to find loop matching arg->name=%s\n", arg->name);
-   }
-   return extensionList;
-}
 
 /********************************************************************************
  * Looks through a SeqLoopsPtr linked list to find a loopPtr whose loop_name field
@@ -575,327 +401,370 @@ SeqLoopsPtr SeqLoops_findLoopByName( SeqLoopsPtr loopsPtr, char * name)
 }
 
 /********************************************************************************
- * Creates the reverse list of possible extensions for a loop whose information
- * is given in a loopPtr structure.
+ * DOCUMENTATION: Inner workings.
+ * A level is built from the attributes of a loop (the values of a SeqLoops
+ * entry or the data of a loop node): the definitions of EXPRESSION, or START,
+ * END and STEP.  A definition starting on the last iteration of the one before
+ * it starts one step further, so that iteration is given once.  Once all the
+ * levels are there, the stride of a level is the number of iterations of the
+ * levels after it, and the rank of an iteration is the sum of the index in
+ * each level times its stride.
+ *
+ * The definitions of a level are in the order of their ranks, the definition
+ * of an index in the level is found by bisection and the index of a value by
+ * dividing by the step in the definition holding it.
 ********************************************************************************/
-static LISTNODEPTR loop_to_reverse_extension_list( SeqLoopsPtr loopPtr){
-   if( loopPtr->type == SwitchType)
-      return switch_to_extension_list(loopPtr);
-   else if ( loopPtr->type == Numerical)
-      return numerical_to_reverse_extension_list(loopPtr->values);
-   else
-      return NULL;
-}
 
 /********************************************************************************
- * Creates the reverse list of possible extensions for a loop when the loop is
- * the current node.  It looks in _nodeDataPtr->data for the information and
- * interprets it based on whether the loop is a numerical loop or a switch.
+ * Returns 1 if the attributes have one named attr_name, without copying it.
 ********************************************************************************/
-static LISTNODEPTR SeqNodeData_to_reverse_extension_list( SeqNodeDataPtr _nodeDataPtr)
+static int hasLoopAttribute( SeqNameValuesPtr loop_attr_ptr, char * attr_name )
 {
-   LISTNODEPTR newList = NULL;
-   if ( _nodeDataPtr->type == Switch ){
-      char extension[10];
-      char * switchValue = SeqNameValues_getValue(_nodeDataPtr->data, "VALUE");
-      sprintf(extension, "%s%s", EXT_TOKEN, switchValue);
-      SeqListNode_insertItem(&newList, extension );
-      free(switchValue);
-      return newList;
-   } else if (_nodeDataPtr->type == Loop) {
-      return numerical_to_reverse_extension_list(_nodeDataPtr->data);
-   } else {
-      return NULL;
-   }
+   for( ; loop_attr_ptr != NULL; loop_attr_ptr = loop_attr_ptr->nextPtr )
+      if( strcmp( loop_attr_ptr->name, attr_name ) == 0 )
+         return 1;
+   return 0;
 }
 
+static SeqLoopSpacePtr space_create( const char * base )
+{
+   SeqLoopSpacePtr space = calloc( 1, sizeof(SeqLoopSpace) );
 
-/********************************************************************************
- * Creates the extension list of a switch by simply returning a list whose only
- * element is the current value of the switch.
-********************************************************************************/
-static LISTNODEPTR switch_to_extension_list(SeqLoopsPtr loopPtr){
-   LISTNODEPTR newList=NULL;
-   char * switch_value=NULL;
-   char buffer[128] = {'\0'};
-   SeqUtil_TRACE(TL_FULL_TRACE,"switch_to_extension_list() begin call\n");
+   if( space == NULL || (space->base = strdup(base)) == NULL )
+      raiseError("space_create malloc: Out of memory!\n");
+   return space;
+}
+
+static SeqLoopLevel * space_addLevel( SeqLoopSpacePtr space )
+{
+   SeqLoopLevel * levels = realloc( space->levels, (space->nlevels + 1) * sizeof(SeqLoopLevel) );
 
-   switch_value = (char*)SeqLoops_getLoopAttribute( loopPtr->values, "VALUE" );
+   if( levels == NULL )
+      raiseError("space_addLevel realloc: Out of memory!\n");
+   space->levels = levels;
+   memset( &levels[space->nlevels], 0, sizeof(SeqLoopLevel) );
+   return &levels[space->nlevels++];
+}
 
-   sprintf(buffer,"%s%s", EXT_TOKEN,switch_value);
-   SeqListNode_insertItem(&newList, buffer);
+/* sets the strides and the number of iterations once all the levels are there */
+static void space_close( SeqLoopSpacePtr space )
+{
+   int i;
 
-   SeqUtil_TRACE(TL_FULL_TRACE,"switch_to_extension_list() end call\n");
-   return newList;
+   space->count = 1;
+   for( i = space->nlevels - 1; i >= 0; i-- ){
+      space->levels[i].stride = space->count;
+      space->count *= space->levels[i].count;
+   }
 }
 
-/********************************************************************************
- * Creates the list of all possible extensions for a loop by either calling
- * def_to_reverse_extension_list or by calling
- * expression_to_reverse_extension_list based on the way the loop is defined.
-********************************************************************************/
-static LISTNODEPTR numerical_to_reverse_extension_list(SeqNameValuesPtr loopData){
-   char * attrib = NULL;
-   int start=0,end=0,step=0;
-   LISTNODEPTR retval = NULL;
-   SeqUtil_TRACE(TL_FULL_TRACE,"numerical_to_reverse_extension_list(): begin call\n");
-
-   if ( (attrib = (char*)SeqLoops_getLoopAttribute( loopData, "EXPRESSION" )) != NULL && strcmp(attrib,"") != 0 ){
-      retval = expression_to_reverse_extension_list( attrib );
+static void level_setValue( SeqLoopLevel * level, const char * value )
+{
+   if( (level->value = strdup( value != NULL ? value : "" )) == NULL )
+      raiseError("level_setValue malloc: Out of memory!\n");
+   level->count = 1;
+}
+
+static void level_addDef( SeqLoopLevel * level, int start, int end, int step )
+{
+   SeqLoopDef *defs = NULL, *previous = NULL;
+   int count = 0;
+
+   if( step == 0 )
+      raiseError("level_addDef loop step cannot be 0\n");
+   if( (step > 0 && start <= end) || (step < 0 && start >= end) )
+      count = (end - start) / step + 1;
+   if( count > 0 && level->ndefs > 0 ){
+      previous = &level->defs[level->ndefs - 1];
+      if( start == previous->start + previous->step * (previous->count - 1) ){
+         start += step;
+         count--;
+      }
+   }
+   if( count <= 0 )
+      return;
+
+   if( (defs = realloc( level->defs, (level->ndefs + 1) * sizeof(SeqLoopDef) )) == NULL )
+      raiseError("level_addDef realloc: Out of memory!\n");
+   level->defs = defs;
+   defs[level->ndefs].start = start;
+   defs[level->ndefs].step = step;
+   defs[level->ndefs].count = count;
+   defs[level->ndefs].first = level->count;
+   level->ndefs++;
+   level->count += count;
+}
+
+/* the definitions of a numerical loop, from its attributes */
+static void level_setDefs( SeqLoopLevel * level, SeqNameValuesPtr loopData )
+{
+   char *expression = NULL, *attrib = NULL, *token = NULL;
+   int start = DEFAULT_LOOP_START, end = DEFAULT_LOOP_END, step = DEFAULT_LOOP_STEP;
+
+   if( (expression = SeqLoops_getLoopAttribute( loopData, "EXPRESSION" )) != NULL && strcmp(expression,"") != 0 ){
+      /* start:end:step:set,start:end:step:set,... */
+      for( token = expression; token != NULL; token = strchr(token, ',') != NULL ? strchr(token, ',') + 1 : NULL ){
+         if( sscanf( token, "%d:%d:%d", &start, &end, &step ) != 3 )
+            raiseError("level_setDefs format error in loop expression %s\n", expression);
+         level_addDef( level, start, end, step );
+      }
    } else {
-      if ( (attrib = (char*)SeqLoops_getLoopAttribute( loopData, "START" )) != NULL ){
+      if( (attrib = SeqLoops_getLoopAttribute( loopData, "START" )) != NULL ){
          start = atoi(attrib);
          free(attrib);
       }
-      if ( (attrib = (char*)SeqLoops_getLoopAttribute( loopData, "END" )) != NULL ){
+      if( (attrib = SeqLoops_getLoopAttribute( loopData, "END" )) != NULL ){
          end = atoi(attrib);
          free(attrib);
       }
-      if ( (attrib = (char*)SeqLoops_getLoopAttribute( loopData, "STEP" )) != NULL ){
+      if( (attrib = SeqLoops_getLoopAttribute( loopData, "STEP" )) != NULL ){
          step = atoi(attrib);
          free(attrib);
       }
-      retval = def_to_reverse_extension_list(start,end,step);
+      level_addDef( level, start, end, step );
    }
-   SeqUtil_TRACE(TL_FULL_TRACE,"numerical_to_reverse_extension_list(): returning list: ");
-   SeqListNode_printList(retval);SeqUtil_TRACE(TL_FULL_TRACE,"\n");
-   return retval;
+   free(expression);
+}
+
+/* the definition holding the index of a numerical level */
+static const SeqLoopDef * level_findDef( const SeqLoopLevel * level, unsigned long index )
+{
+   int low = 0, high = level->ndefs - 1, middle = 0;
+
+   while( low < high ){
+      middle = (low + high + 1) / 2;
+      if( level->defs[middle].first <= index )
+         low = middle;
+      else
+         high = middle - 1;
+   }
+   return &level->defs[low];
 }
 
 /********************************************************************************
- * Creates the reverse list of possible extensions for a loop defined by an
- * expression.  Makes a call to def_to_reverse_extension_list() for each
- * definition of the expression and adds the lists together.
+ * Returns the loop space of the iterations of a loop node, the extension base
+ * of the node followed by the level of the loop.
 ********************************************************************************/
-static LISTNODEPTR expression_to_reverse_extension_list( char * expression ){
-   LISTNODEPTR newList = NULL, rhs = NULL;
-   char * token = NULL;
-   int * currentDef = NULL;
-   int i=0,expressionArray[SEQ_MAXFIELD] = {'\0'},number_of_definitions=0;
+SeqLoopSpacePtr SeqLoops_childSpace( SeqNodeDataPtr _nodeDataPtr )
+{
+   SeqNameValuesPtr nodeSpecPtr = _nodeDataPtr->data;
+   SeqLoopSpacePtr space = NULL;
+   char *baseExtension = NULL, *tmpExpression = NULL;
+
+   tmpExpression = SeqLoops_getLoopAttribute( nodeSpecPtr, "EXPRESSION" );
+   if( tmpExpression != NULL && strcmp(tmpExpression, "") != 0 &&
+       ( hasLoopAttribute( nodeSpecPtr, "START" ) || hasLoopAttribute( nodeSpecPtr, "END" ) ||
+         hasLoopAttribute( nodeSpecPtr, "SET" ) || hasLoopAttribute( nodeSpecPtr, "STEP" ) ) ){
+      raiseError("SeqLoops_childSpace Error: loop syntax must be defined with start, end, step, step attributes OR with an expression attribute\n");
+   }
+   free(tmpExpression);
+
+   baseExtension = SeqLoops_getExtensionBase( _nodeDataPtr );
+   space = space_create( baseExtension );
+   level_setDefs( space_addLevel(space), nodeSpecPtr );
+   space_close( space );
+   SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_childSpace extension:%s baseExtension:%s iterations:%lu\n",_nodeDataPtr->extension, baseExtension, space->count);
+   free(baseExtension);
+   return space;
+}
+
+/********************************************************************************
+ * Returns the loop space of the iterations specified by depIndex, a level per
+ * argument.  An argument without a wildcard is a fixed value, a wildcard takes
+ * the loop or switch of _nodeDataPtr->loops whose leaf is the argument name, or
+ * _nodeDataPtr itself if it is the loop or switch of that name.  An empty
+ * depIndex gives a space whose only iteration is the empty extension.
+********************************************************************************/
+SeqLoopSpacePtr SeqLoops_containerSpace( SeqNodeDataPtr _nodeDataPtr, const char * depIndex )
+{
+   SeqLoopSpacePtr space = space_create("");
+   SeqNameValuesPtr depArgs = NULL, arg = NULL;
+   SeqLoopsPtr loopPtr = NULL;
+   SeqLoopLevel *level = NULL;
+   char *switchValue = NULL;
+
+   SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_containerSpace depIndex: %s\n", depIndex != NULL ? depIndex : "");
+   if( depIndex != NULL && strlen(depIndex) > 0 ){
+      SeqNode_showLoops(_nodeDataPtr->loops,TL_FULL_TRACE);
+      SeqLoops_parseArgs(&depArgs,depIndex);
+   }
 
-   for ( i = 0, token = strtok(expression,":,") ; token != NULL ; i++, token = strtok(NULL,":,") )
-      expressionArray[i] = atoi(token);
-   number_of_definitions = (i / 4);
+   for( arg = depArgs; arg != NULL; arg = arg->nextPtr ){
+      level = space_addLevel(space);
+      if( ! hasWildCard(arg) ){
+         level_setValue( level, arg->value );
+      } else if( (loopPtr = SeqLoops_findLoopByName(_nodeDataPtr->loops, arg->name)) != NULL ){
+         if( loopPtr->type == SwitchType ){
+            switchValue = SeqLoops_getLoopAttribute( loopPtr->values, "VALUE" );
+            level_setValue( level, switchValue );
+            free(switchValue);
+         } else if( loopPtr->type == Numerical ){
+            level_setDefs( level, loopPtr->values );
+         }
+      } else if( strcmp(arg->name, _nodeDataPtr->nodeName) == 0 ){
+         if( _nodeDataPtr->type == Switch ){
+            switchValue = SeqNameValues_getValue( _nodeDataPtr->data, "VALUE" );
+            level_setValue( level, switchValue );
+            free(switchValue);
+         } else if( _nodeDataPtr->type == Loop ){
+            level_setDefs( level, _nodeDataPtr->data );
+         }
+      } else {
+         raiseError("SeqLoops_containerSpace() unable to find loop matching arg->name=%s\n", arg->name);
+      }
+   }
+   SeqNameValues_deleteWholeList(&depArgs);
 
-   /* Make an currentDef point to the start of the last definition */
-   currentDef = &expressionArray[i - 4];
+   space_close( space );
+   SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_containerSpace levels:%d iterations:%lu\n", space->nlevels, space->count);
+   return space;
+}
 
-   /* Iterate over the definitions, constructing the desired list */
-   for ( i = number_of_definitions; i > 0; i--,currentDef -= 4 ){
-      rhs = def_to_reverse_extension_list(currentDef[DEF_START], currentDef[DEF_END], currentDef[DEF_STEP]);
-      SeqListNode_addLists(&newList, rhs);
+void SeqLoops_freeSpace( SeqLoopSpacePtr space )
+{
+   int i;
+
+   if( space == NULL )
+      return;
+   for( i = 0; i < space->nlevels; i++ ){
+      free(space->levels[i].value);
+      free(space->levels[i].defs);
    }
-   return newList;
+   free(space->levels);
+   free(space->base);
+   free(space);
 }
 
 /********************************************************************************
- * Creates a reverse list of the possible extensions for a loop whose iterations
- * are defined by start, end, step.  Note the use of push front to make this
- * process O(n).  Going from end to start and using SeqListNode_insertItem would
- * be O(n^2) because insertItem() goes through the whole list every time.
- * Otherwise, we could keep a pointer to the last element of the list, but this
- * is more elegant.
+ * Writes the extension of an iteration of the space, given its rank, into
+ * buffer.  Returns the length of the extension, that was truncated if it is
+ * size or more, as snprintf() does, or -1 if rank is not in the space.
 ********************************************************************************/
-static LISTNODEPTR def_to_reverse_extension_list( int start, int end, int step){
-   LISTNODEPTR newList=NULL;
-   char buffer[128];
-   int loopCount;
-
-   for(loopCount = start; loopCount <= end; loopCount += step){
-      sprintf(buffer,"%s%d",EXT_TOKEN,loopCount);
-      SeqListNode_pushFront(&newList, buffer);
+int SeqLoops_spaceExtension( const SeqLoopSpace * space, unsigned long rank, char * buffer, size_t size )
+{
+   const SeqLoopLevel *level = NULL;
+   const SeqLoopDef *def = NULL;
+   unsigned long index = 0;
+   char *at = NULL;
+   int i, length = 0;
+
+   if( rank >= space->count )
+      return -1;
+
+   length = snprintf( buffer, size, "%s", space->base );
+   for( i = 0; i < space->nlevels; i++ ){
+      level = &space->levels[i];
+      index = rank / level->stride % level->count;
+      at = (size_t) length < size ? buffer + length : NULL;
+      if( level->value != NULL ){
+         length += snprintf( at, at != NULL ? size - length : 0, "%s%s", EXT_TOKEN, level->value );
+      } else {
+         def = level_findDef( level, index );
+         length += snprintf( at, at != NULL ? size - length : 0, "%s%d", EXT_TOKEN,
+                             def->start + def->step * (int)(index - def->first) );
+      }
    }
+   return length;
+}
 
-   return newList;
+/********************************************************************************
+ * Returns the rank of an extension in the space, or -1 if the extension is not
+ * one of the iterations of the space.
+********************************************************************************/
+long SeqLoops_spaceRank( const SeqLoopSpace * space, const char * extension )
+{
+   const SeqLoopLevel *level = NULL;
+   const SeqLoopDef *def = NULL;
+   const char *token = NULL, *tokenEnd = NULL;
+   char *numberEnd = NULL;
+   size_t baseLength = strlen(space->base);
+   unsigned long rank = 0;
+   long value = 0;
+   int i, d;
+
+   if( extension == NULL || strncmp( extension, space->base, baseLength ) != 0 )
+      return -1;
+
+   token = extension + baseLength;
+   for( i = 0; i < space->nlevels; i++ ){
+      level = &space->levels[i];
+      if( *token++ != EXT_TOKEN[0] )
+         return -1;
+      if( (tokenEnd = strchr( token, EXT_TOKEN[0] )) == NULL )
+         tokenEnd = token + strlen(token);
+
+      if( level->value != NULL ){
+         if( strlen(level->value) != (size_t)(tokenEnd - token) || strncmp( token, level->value, tokenEnd - token ) != 0 )
+            return -1;
+      } else {
+         value = strtol( token, &numberEnd, 10 );
+         if( numberEnd == token || numberEnd != tokenEnd )
+            return -1;
+         for( d = 0; d < level->ndefs; d++ ){
+            def = &level->defs[d];
+            if( (value - def->start) % def->step == 0 &&
+                (value - def->start) / def->step >= 0 && (value - def->start) / def->step < def->count )
+               break;
+         }
+         if( d == level->ndefs )
+            return -1;
+         rank += (def->first + (value - def->start) / def->step) * level->stride;
+      }
+      token = tokenEnd;
+   }
+   return *token == '\0' ? (long) rank : -1;
 }
 
+void SeqLoops_iteratorInit( SeqLoopIterator * iterator, const SeqLoopSpace * space, int reverse )
+{
+   iterator->space = space;
+   iterator->next = 0;
+   iterator->reverse = reverse;
+}
 
+/********************************************************************************
+ * Writes the next extension of the iteration into buffer and returns 1, or
+ * returns 0 when all the extensions of the space were given.
+********************************************************************************/
+int SeqLoops_iteratorNext( SeqLoopIterator * iterator, char * buffer, size_t size )
+{
+   const SeqLoopSpace *space = iterator->space;
+   unsigned long rank = 0;
+
+   if( space == NULL || iterator->next >= space->count )
+      return 0;
+   rank = iterator->reverse ? space->count - 1 - iterator->next : iterator->next;
+   iterator->next++;
+   if( SeqLoops_spaceExtension( space, rank, buffer, size ) >= (int) size )
+      raiseError("SeqLoops_iteratorNext extension of iteration %lu longer than %lu characters\n", rank, (unsigned long) size - 1);
+   return 1;
+}
+
+/********************************************************************************
+ * Returns the list of the extensions of a space, the last one first if reverse,
+ * and frees the space.  The list is built from its end with pushFront().
+********************************************************************************/
+static LISTNODEPTR space_to_list( SeqLoopSpacePtr space, int reverse )
+{
+   LISTNODEPTR newList = NULL;
+   SeqLoopIterator iterator;
+   char extension[SEQ_MAXFIELD];
+
+   SeqLoops_iteratorInit( &iterator, space, ! reverse );
+   while( SeqLoops_iteratorNext( &iterator, extension, sizeof extension ) )
+      SeqListNode_pushFront( &newList, extension );
+   SeqLoops_freeSpace( space );
+   return newList;
+}
 /*
  * returns a list containing ALL the loop extensions for a node that is
  * a child of a loop container or loop containers, defined in the dep_index list of loops iterations. For instance, this 
  * function is used to support dependency wildcard when a node is dependant on all
  * the iterations of a node that is a child of a loop container
+ * Prefer iterating SeqLoops_containerSpace(), the list holds every iteration.
  */
 LISTNODEPTR SeqLoops_getLoopContainerExtensions( SeqNodeDataPtr _nodeDataPtr, const char * depIndex ) {
-   char tmp[100];
-   int expressionArray[256], i, j, startIndex=0, endIndex=1, stepIndex=2, detectedEnd=0, breakFlag=0, firstFlag=1, detectedStart;
-   char *tmpExpression = NULL, *tmpArrayValue = NULL;
-   int foundIt = 0, loopStart = 0, loopStep = 1, loopEnd = 0, loopCount = 0;
-   LISTNODEPTR loopExtensions = NULL, tmpLoopExts = NULL;
-   SeqNameValuesPtr loopsDataPtr = NULL;
-   SeqLoopsPtr loopsPtr = NULL; 
-   SeqNameValuesPtr depArgs = NULL;
-
-   SeqLoops_parseArgs( &depArgs, depIndex);
-
-   memset( tmp, '\0', sizeof tmp );
-   SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensions depIndex: %s\n", depIndex);  
-
-   /* looping over each depedency index argument */
-   while (depArgs != NULL){
-        SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensions dealing with argument %s=%s\n", depArgs->name, depArgs->value);  
-	if( strstr( depArgs->value, "*" ) != NULL ) {
-	/* wildcard found */
-            SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensions getting loop information from node %s\n", _nodeDataPtr -> name );  
-            loopsPtr = _nodeDataPtr->loops; 
-  	    while (loopsPtr != NULL && !foundIt ) {
-                 loopsDataPtr =  loopsPtr->values;
-                 if (loopsDataPtr != NULL ) {
-		     /* find the right loop arg to match*/
-                     if (strcmp(SeqUtil_getPathLeaf(loopsPtr->loop_name),depArgs->name)==0) {
-		         loopsDataPtr = loopsDataPtr->nextPtr;
-			 
-			 tmpExpression = SeqLoops_getLoopAttribute( loopsDataPtr, "EXPRESSION" );
-			 if (tmpExpression != NULL && strcmp(tmpExpression, "") != 0) {
-			   SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensions expression: %s\n", tmpExpression);
-			 } else {
-			   loopStart = atoi( SeqLoops_getLoopAttribute( loopsDataPtr, "START" ) );
-			   if( SeqLoops_getLoopAttribute( loopsDataPtr, "STEP" ) != NULL ) { 
-			      loopStep = atoi( SeqLoops_getLoopAttribute( loopsDataPtr, "STEP" ) );
-			   }
-			   loopEnd = atoi( SeqLoops_getLoopAttribute( loopsDataPtr, "END" ) );
-			   loopCount = loopStart;
-			   SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensions loopStart:%d loopStep:%d loopEnd=%d \n", loopStart, loopStep, loopEnd );
-			 }
-			 foundIt=1;
-		     } else {
-		         loopsPtr = loopsPtr->nextPtr; 
-		     }
-                  }
-            }
-
-            /* if targetting a loop node as a dependency, _nodeDataPtr->data will have the loop attributes */
-            loopsDataPtr=_nodeDataPtr->data; 
-	    if ((strcmp(_nodeDataPtr->nodeName,depArgs->name)==0) && (loopsDataPtr != NULL)) {
-               SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensions targetting a loop node\n");
-	       tmpExpression = SeqLoops_getLoopAttribute( loopsDataPtr, "EXPRESSION" );
-	       if (tmpExpression != NULL && strcmp(tmpExpression, "") != 0) {
-		  SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensions expression: %s\n", tmpExpression);
-	       } else {
-		  loopStart = atoi( SeqLoops_getLoopAttribute( loopsDataPtr, "START" ) );
-		  if( SeqLoops_getLoopAttribute( loopsDataPtr, "STEP" ) != NULL ) { 
-		     loopStep = atoi( SeqLoops_getLoopAttribute( loopsDataPtr, "STEP" ) );
-		  }
-		  loopEnd = atoi( SeqLoops_getLoopAttribute( loopsDataPtr, "END" ) );
-		  loopCount = loopStart;
-		  SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensions loopStart:%d loopStep:%d loopEnd=%d \n", loopStart, loopStep, loopEnd );
-	       }
-	    }
-	    
-	    /* parse the loop expression to expressionArray */
-	    if (strcmp(tmpExpression, "") != 0) {
-	       i=0;
-	       tmpArrayValue = strtok (tmpExpression,":,");
-	       while (tmpArrayValue != NULL) {
-		  expressionArray[i] = atoi(tmpArrayValue);
-		  /*End is the biggest number of the expression*/
-		  if (expressionArray[i]>detectedEnd)
-		     detectedEnd=expressionArray[i];
-		  i++;
-		  tmpArrayValue = strtok (NULL,":,");
-	       }
-	       detectedStart=detectedEnd;
-	       for (j=0; j<i; j=j+4) {
-		  if(expressionArray[j]<detectedStart){
-		     detectedStart=expressionArray[j];
-		     startIndex=j;
-		  }
-	       }
-	       loopCount=detectedStart;
-	       loopEnd=detectedEnd;
-	    }
-
-	    /*reset for next loop to find*/
-	    foundIt=0;
-
-	} else {
-	/* only one value*/
-               loopCount = atoi(depArgs->value);
-	       loopEnd=loopCount;
-               SeqUtil_TRACE(TL_FULL_TRACE,"SeqLoops_getLoopContainerExtensions Found single value for loop: loop name = %s ; loop value = %d \n", depArgs->name, loopCount );
-	}
-
-        /* add values to the list of extensions */ 
-	do {
-	   if (tmpExpression != NULL && strcmp(tmpExpression, "") != 0 && loopEnd != loopCount) {
-	       while( loopCount <= detectedEnd ) {
-		  loopCount = expressionArray[startIndex];
-		  breakFlag = 0;
-		  if ((startIndex-4) >= 0 && loopCount != expressionArray[endIndex-4]) {
-		     firstFlag = 1;
-		  }
-		  while( loopCount <= expressionArray[endIndex] && breakFlag == 0){
-		     if (firstFlag == 0) {
-			if ((loopCount+expressionArray[stepIndex]) <= expressionArray[endIndex]) {
-			   loopCount = loopCount + expressionArray[stepIndex];
-			} else {
-			   breakFlag = 1;
-			}
-		     } else {
-			firstFlag = 0;
-		     }
-		     if (breakFlag == 0) {
-			if( loopExtensions != NULL ) {
-			   sprintf( tmp, "%s%s%d", loopExtensions->data, EXT_TOKEN, loopCount );
-			} else {
-			   sprintf( tmp, "%s%d", EXT_TOKEN, loopCount );
-			}
-			/*SeqUtil_TRACE(TL_FULL_TRACE, "SeqLoops_getLoopContainerExtensions new extension added based on expression:%s\n", tmp );*/
-			SeqListNode_insertItem( &tmpLoopExts, tmp );
-		     }
-		  }
-		  if ((stepIndex+4) < i) {
-		     endIndex=endIndex+4;
-		     stepIndex=stepIndex+4;
-		     startIndex=startIndex+4;
-		  } else {
-		     break;
-		  }
-	       }
-	    } else {
-	       while( loopCount <= loopEnd ) {
-		  if( loopExtensions != NULL ) {
-		     sprintf( tmp, "%s%s%d", loopExtensions->data, EXT_TOKEN, loopCount );
-		  } else {
-		     sprintf( tmp, "%s%d", EXT_TOKEN, loopCount );
-		  }
-		  /* build the tmp list of extensions */
-		  SeqUtil_TRACE(TL_FULL_TRACE, "SeqLoops_getLoopContainerExtensions new extension added:%s\n", tmp );
-		  SeqListNode_insertItem( &tmpLoopExts, tmp );
-		  loopCount = loopCount + loopStep;
-	       }
-	    }
-
-	        /* if not done, do next */
-            if( loopExtensions != NULL ) {
-	       loopExtensions = loopExtensions->nextPtr;
-	       if (strcmp(tmpExpression, "") != 0)
-		  loopCount = detectedStart;
-	       else
-		  loopCount = loopStart;
-            }
-		 
-        } while( loopExtensions != NULL );
-
-
-	/* delete the previous list of extensions */
-	SeqListNode_deleteWholeList( &loopExtensions );
-
-        /* store the new list of extensions */
-	loopExtensions = tmpLoopExts; 
-
-	tmpLoopExts = NULL;
-
-        /* re-init loop values */
-        loopCount = 0; loopStep = 1; loopStart = 0; loopEnd = 0; breakFlag = 0; firstFlag = 1;
-	detectedEnd = 0; startIndex=0; endIndex=1; stepIndex=2; 
-	tmpExpression = NULL; tmpArrayValue = NULL;
-        /* get next loop argument */
-        depArgs = depArgs->nextPtr;
-   } 
-
-   return loopExtensions;
-
+   return space_to_list( SeqLoops_containerSpace( _nodeDataPtr, depIndex ), 0 );
 }
 
 
@@ -68,6 +68,69 @@ char * SeqLoops_indexToExt( const char * index);
 char* SeqLoops_getLoopArgs( SeqNameValuesPtr _loop_args );
 SeqLoopsPtr SeqLoops_findLoopByName( SeqLoopsPtr loopsPtr, char * name);
 
+/********************************************************************************
+ * DOCUMENTATION: Interface.
+ * A loop space describes the iterations of a loop node or the iterations
+ * targeted by a dependency index ("outer=*,sw=*,inner=3") without listing
+ * them: a base extension followed by levels, one per loop, switch or index
+ * value.  A numerical level keeps the definitions of the loop (start, step and
+ * number of iterations of every start:end:step of the expression), a switch or
+ * an index value without a wildcard is a fixed value.
+ *
+ * The iterations are ordered as the extensions of the levels, the first level
+ * varying the slowest, and the extension of a rank as well as the rank of an
+ * extension are found by arithmetic on the levels, whatever the number of
+ * iterations.  An iterator yields the extensions of a space, in that order or
+ * in reverse, into a buffer of the caller; it keeps no other state than its own
+ * structure, so a space can be iterated by many at once.
+********************************************************************************/
+
+typedef struct _SeqLoopDef {
+   int start;
+   int step;
+   int count;              /* iterations of the definition */
+   unsigned long first;    /* rank of its first iteration in the level */
+} SeqLoopDef;
+
+typedef struct _SeqLoopLevel {
+   char *value;            /* fixed value, NULL for a numerical loop */
+   int ndefs;
+   SeqLoopDef *defs;
+   unsigned long count;    /* iterations of the level */
+   unsigned long stride;   /* iterations of the levels after this one */
+} SeqLoopLevel;
+
+typedef struct _SeqLoopSpace {
+   char *base;             /* extension in front of the levels */
+   int nlevels;
+   SeqLoopLevel *levels;
+   unsigned long count;    /* iterations of the space */
+} SeqLoopSpace;
+
+typedef SeqLoopSpace *SeqLoopSpacePtr;
+
+typedef struct _SeqLoopIterator {
+   const SeqLoopSpace *space;
+   unsigned long next;
+   int reverse;
+} SeqLoopIterator;
+
+/* The iterations of the loop node _nodeDataPtr, as SeqLoops_childExtensions() */
+SeqLoopSpacePtr SeqLoops_childSpace( SeqNodeDataPtr _nodeDataPtr );
+/* The iterations targeted by depIndex, as SeqLoops_getLoopContainerExtensions() */
+SeqLoopSpacePtr SeqLoops_containerSpace( SeqNodeDataPtr _nodeDataPtr, const char * depIndex );
+void SeqLoops_freeSpace( SeqLoopSpacePtr space );
+
+/* Writes the extension of rank into buffer as snprintf() does, returns -1 if
+ * the space has no such rank */
+int SeqLoops_spaceExtension( const SeqLoopSpace *space, unsigned long rank, char *buffer, size_t size );
+/* Rank of extension in the space, -1 if it is not one of its iterations */
+long SeqLoops_spaceRank( const SeqLoopSpace *space, const char *extension );
+
+void SeqLoops_iteratorInit( SeqLoopIterator *iterator, const SeqLoopSpace *space, int reverse );
+/* Writes the next extension into buffer, returns 0 once they were all given */
+int SeqLoops_iteratorNext( SeqLoopIterator *iterator, char *buffer, size_t size );
+
 
 
 #endif
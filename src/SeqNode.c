@@ -140,7 +140,7 @@ void SeqNode_setContainer ( SeqNodeDataPtr node_ptr, const char* container ) {
 }
 
 void SeqNode_setCpu ( SeqNodeDataPtr node_ptr, const char* cpu ) {
-   char *tmpstrtok=NULL;
+   char *tmpstrtok=NULL, *saveptr=NULL;
    char *tmpCpu=NULL;
    if ( cpu != NULL ) {
       free( node_ptr->cpu );
@@ -152,7 +152,7 @@ void SeqNode_setCpu ( SeqNodeDataPtr node_ptr, const char* cpu ) {
       }
   
       /* parse NPEX */
-      tmpstrtok = (char*) strtok( tmpCpu, "x" );
+      tmpstrtok = (char*) strtok_r( tmpCpu, "x", &saveptr );
       if ( tmpstrtok != NULL ) {
           free( node_ptr->npex );
 	  if (node_ptr->npex=malloc( strlen(tmpstrtok) +1)){ 
@@ -162,7 +162,7 @@ void SeqNode_setCpu ( SeqNodeDataPtr node_ptr, const char* cpu ) {
           }
       }
       /* NPEY */
-      tmpstrtok = (char*) strtok( NULL, "x" );
+      tmpstrtok = (char*) strtok_r( NULL, "x", &saveptr );
       if ( tmpstrtok != NULL ) {
           free( node_ptr->npey );
 	  if (node_ptr->npey=malloc( strlen(tmpstrtok) +1)){ 
@@ -172,7 +172,7 @@ void SeqNode_setCpu ( SeqNodeDataPtr node_ptr, const char* cpu ) {
           }
       }
       /* OMP */
-      tmpstrtok = (char*) strtok( NULL, "x" );
+      tmpstrtok = (char*) strtok_r( NULL, "x", &saveptr );
       if ( tmpstrtok != NULL ) {
           free( node_ptr->omp );
 	  if (node_ptr->omp=malloc( strlen(tmpstrtok) +1)){ 
@@ -245,14 +245,14 @@ void SeqNode_setCpu_new ( SeqNodeDataPtr node_ptr, const char* cpu ) {
 
 void SeqNode_setCpuMultiplier ( SeqNodeDataPtr node_ptr, const char* cpu_multiplier ) {
   char *tmpMult=NULL;
-  char *tmpMultTok=NULL;
+  char *tmpMultTok=NULL, *saveptr=NULL;
   int mult=1;
   tmpMult = strdup(cpu_multiplier);
   if ( cpu_multiplier != NULL ) {
-    tmpMultTok = (char*) strtok( tmpMult, "x" );
+    tmpMultTok = (char*) strtok_r( tmpMult, "x", &saveptr );
     while ( tmpMultTok != NULL ) {
       mult = mult * atoi(tmpMultTok);
-      tmpMultTok = (char*) strtok( NULL, "x" );
+      tmpMultTok = (char*) strtok_r( NULL, "x", &saveptr );
     }
     sprintf(tmpMult,"%d",mult);
     free( node_ptr->cpu_multiplier );
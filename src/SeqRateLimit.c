@@ -0,0 +1,97 @@
+/* SeqRateLimit.c - Submission rate limit of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "SeqUtil.h"
+#include "SeqRateLimit.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Inner workings.
+ * The file is a line "tokens last", read and written again whole under a lock
+ * of the file.  A file that cannot be read as such (new, cut short) is a full
+ * bucket.  A clock going back does not add tokens.
+********************************************************************************/
+
+double SeqRateLimit_now( void ) {
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return(tv.tv_sec + tv.tv_usec / 1.0e6);
+}
+
+double SeqRateLimit_reserve( SeqRateBucket *bucket, double rate, double burst, double now ) {
+   if ( rate <= 0.0 ) return(0.0);
+   if ( burst < 1.0 ) burst = 1.0;
+
+   if ( now > bucket->last ) {
+      bucket->tokens += (now - bucket->last) * rate;
+      bucket->last = now;
+   }
+   if ( bucket->tokens > burst ) bucket->tokens = burst;
+   bucket->tokens -= 1.0;
+   return(bucket->tokens >= 0.0 ? 0.0 : -bucket->tokens / rate);
+}
+
+double SeqRateLimit_take( const char *path, double rate, double burst, double now ) {
+   SeqRateBucket bucket;
+   struct flock fl;
+   char line[128];
+   ssize_t len;
+   double wait;
+   int fd;
+
+   if ( rate <= 0.0 ) return(0.0);
+   if ( (fd = open(path, O_RDWR|O_CREAT, 0644)) < 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqRateLimit: cannot open %s, no submission limit\n", path);
+      return(0.0);
+   }
+   memset(&fl, '\0', sizeof fl);
+   fl.l_type = F_WRLCK;
+   fl.l_whence = SEEK_SET;
+   while ( fcntl(fd, F_SETLKW, &fl) != 0 ) {
+      if ( errno != EINTR ) {
+         SeqUtil_TRACE(TL_ERROR, "SeqRateLimit: cannot lock %s, no submission limit\n", path);
+         close(fd);
+         return(0.0);
+      }
+   }
+
+   len = pread(fd, line, sizeof(line) - 1, 0);
+   line[len > 0 ? len : 0] = '\0';
+   if ( sscanf(line, "%lf %lf", &bucket.tokens, &bucket.last) != 2 ) {
+      bucket.tokens = burst;
+      bucket.last = now;
+   }
+   wait = SeqRateLimit_reserve(&bucket, rate, burst, now);
+
+   snprintf(line, sizeof(line), "%.6f %.6f\n", bucket.tokens, bucket.last);
+   if ( pwrite(fd, line, strlen(line), 0) != (ssize_t) strlen(line) || ftruncate(fd, strlen(line)) != 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqRateLimit: cannot write %s\n", path);
+   }
+   close(fd);
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqRateLimit_take() %s tokens:%.3f wait:%.3f\n", path, bucket.tokens, wait);
+   return(wait);
+}
@@ -0,0 +1,66 @@
+/* SeqRateLimit.h - Submission rate limit of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SEQ_RATE_LIMIT_H_
+#define _SEQ_RATE_LIMIT_H_
+
+/********************************************************************************
+ * DOCUMENTATION: Interface.
+ * The submissions of the containers of an experiment go through a token
+ * bucket: it holds up to burst tokens, gains rate tokens per second, and each
+ * submission takes one.  A submission that finds the bucket empty reserves the
+ * next token anyway and is told how long to wait for it, so that the processes
+ * sharing the bucket go in the order they came, at rate submissions per second
+ * once the burst is spent, and without waiting while the bucket has tokens.
+ *
+ * The bucket of all the maestro processes of an experiment is the file
+ * SEQ_RATE_BUCKET under its status directory, changed under an fcntl() lock;
+ * with mserver the server changes it for its clients.  rate and burst come
+ * from SEQ_SUBMIT_RATE and SEQ_SUBMIT_BURST of resources.def.
+********************************************************************************/
+
+#define SEQ_RATE_BUCKET "submit_rate.bucket"
+
+/* default rate and burst: the flood control of containers, 10 submissions then 15 seconds */
+#define SEQ_RATE_DEFAULT  ( 10.0 / 15.0 )
+#define SEQ_BURST_DEFAULT 10.0
+
+typedef struct {
+   double tokens;    /* below 0 when tokens are reserved */
+   double last;      /* time of tokens, seconds */
+} SeqRateBucket;
+
+/* seconds since the epoch */
+double SeqRateLimit_now( void );
+
+/********************************************************************************
+ * Takes a token of bucket at time now (an empty bucket is full).  Returns the
+ * seconds to wait before the token is there, 0 if it is.
+********************************************************************************/
+double SeqRateLimit_reserve( SeqRateBucket *bucket, double rate, double burst, double now );
+
+/********************************************************************************
+ * Takes a token of the bucket in the file at path at time now, under an
+ * fcntl() lock; the file is created full.  Returns the seconds to wait, 0 if
+ * the file cannot be used (no limit rather than no submission).
+********************************************************************************/
+double SeqRateLimit_take( const char *path, double rate, double burst, double now );
+
+#endif
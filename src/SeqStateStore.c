@@ -0,0 +1,813 @@
+/* SeqStateStore.c - Status store of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "SeqUtil.h"
+#include "SeqListNode.h"
+#include "SeqStateStore.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Inner workings.
+ * The table is a header followed by a power of 2 number of records, found by
+ * linear probing from the hash of their key.  A record is never freed: a node
+ * without any state keeps its slot, so a probe stops at the first free slot.
+ *
+ * A change is a set of full record images (slot, record) appended to the
+ * journal with a sequence number and a checksum, then copied in the table
+ * (the journal is synced first with SeqStateStore_sync).  The header keeps
+ * the sequence number of the last entry applied, an open replays the entries
+ * after it; an entry with a bad checksum is the torn tail of a crash and
+ * ends the replay.  Once the journal has SEQ_STORE_CHECKPOINT entries the
+ * table is msync()ed and the journal truncated.  A full table is rewritten
+ * twice as big under another name and renamed over the old one, whose header
+ * is marked moved so that the other processes map the new one.
+********************************************************************************/
+
+#define STORE_MAGIC "SEQSTOR1"
+
+/* paths of the table and journal: a datestamp directory and a file name in it */
+#define STORE_PATH_MAX ( SEQ_MAXFIELD + 32 )
+
+/* the status files, in the order of their bit in a record */
+static const char *StoreStates[] = { "begin", "end", "submit", "waiting", "abort.stop", "abort.cont", "abort.rerun" };
+#define STORE_NSTATES ( sizeof(StoreStates) / sizeof(StoreStates[0]) )
+
+typedef struct {
+   char               magic[8];
+   unsigned int       capacity;   /* number of records, a power of 2 */
+   unsigned int       count;      /* records used */
+   unsigned long long seq;        /* last journal entry applied */
+   unsigned int       moved;      /* replaced by a bigger table, map it again */
+   char               pad[228];   /* as big as a record: no record spans two pages */
+} StoreHeader;
+
+typedef struct {
+   unsigned int   hash;           /* 0 for a free slot */
+   unsigned short states;         /* a bit per entry of StoreStates */
+   unsigned short len;
+   unsigned int   mtime;          /* last change */
+   char           key[SEQ_STORE_KEYMAX];
+} StoreRecord;
+
+typedef struct {
+   unsigned long long seq;
+   unsigned int       slot;
+   unsigned int       sum;
+   StoreRecord        rec;
+} StoreEntry;
+
+typedef struct _SeqStore {
+   char         dir[SEQ_MAXFIELD];
+   int          fd;               /* table */
+   int          jfd;              /* journal, also the lock */
+   int          rdonly;           /* store of another user, states are only read */
+   size_t       size;
+   StoreHeader *hdr;
+   StoreRecord *rec;
+   struct _SeqStore *next;
+} SeqStore;
+
+/* one change of a record */
+typedef struct {
+   const char    *key;
+   unsigned short set;
+   unsigned short clear;
+   unsigned short was;            /* states before the change */
+} StoreChange;
+
+/* stores opened by this process */
+static SeqStore *Stores = NULL;
+
+/* sync the journal at each change, see SeqStateStore_sync */
+static int StoreSync = 0;
+
+/* FNV-1a */
+static unsigned int store_hash( const char *key ) {
+   unsigned int h = 2166136261u;
+
+   while ( *key != '\0' ) {
+      h ^= (unsigned char) *key++;
+      h *= 16777619u;
+   }
+   return( h != 0 ? h : 1 );
+}
+
+static unsigned int store_sum( const StoreEntry *e ) {
+   const unsigned char *p = (const unsigned char *) &e->rec;
+   unsigned int h = 2166136261u ^ (unsigned int) e->seq ^ e->slot;
+   size_t i;
+
+   for ( i = 0; i < sizeof(e->rec); i++ ) {
+      h ^= p[i];
+      h *= 16777619u;
+   }
+   return( h );
+}
+
+/*
+ * Split a status file (or a pattern of status files) name in the datestamp
+ * directory ".../sequencing/status/<datestamp>", the key, which is the node
+ * path and extension relative to it, and the state.  keyoff is set to the
+ * offset of the key in the name.  Returns 0 for a status file, 1 otherwise.
+ */
+static int store_parse( const char *path, char *dir, char *key, int *state, size_t *keyoff ) {
+   const char *p, *rest, *end;
+   size_t n, len, slen, off;
+   int i;
+
+   if ( (p = strstr(path, "/sequencing/status/")) == NULL ) return(1);
+   p += strlen("/sequencing/status/");
+   for ( n = 0; isdigit((unsigned char) p[n]); n++ );
+   if ( n < 8 || p[n] != '/' ) return(1);
+   if ( (size_t) (p + n - path) >= SEQ_MAXFIELD ) return(1);
+   memcpy(dir, path, p + n - path);
+   dir[p + n - path] = '\0';
+
+   for ( rest = p + n; *rest == '/'; rest++ );
+   off = rest - path;
+   len = strlen(rest);
+   for ( i = 0; i < STORE_NSTATES; i++ ) {
+      slen = strlen(StoreStates[i]);
+      if ( len > slen + 1 && rest[len - slen - 1] == '.' && strcmp(rest + len - slen, StoreStates[i]) == 0 ) break;
+   }
+   if ( i == STORE_NSTATES ) return(1);
+
+   /* the key, without doubled slashes */
+   end = rest + len - strlen(StoreStates[i]) - 1;
+   for ( n = 0; rest < end; rest++ ) {
+      if ( *rest == '/' && n > 0 && key[n - 1] == '/' ) continue;
+      if ( n >= SEQ_STORE_KEYMAX - 1 ) return(1);
+      key[n++] = *rest;
+   }
+   key[n] = '\0';
+   *state = i;
+   if ( keyoff != NULL ) *keyoff = off;
+   return(0);
+}
+
+static int store_lock( SeqStore *st, short type ) {
+   struct flock fl;
+
+   memset(&fl, '\0', sizeof fl);
+   fl.l_type = type;
+   fl.l_whence = SEEK_SET;
+   while ( fcntl(st->jfd, F_SETLKW, &fl) != 0 ) {
+      if ( errno != EINTR ) return(1);
+   }
+   return(0);
+}
+
+static void store_unlock( SeqStore *st ) {
+   store_lock(st, F_UNLCK);
+}
+
+/* map the table of the store, returns 0 if succeeds */
+static int store_map( SeqStore *st ) {
+   char path[STORE_PATH_MAX];
+   struct stat sb;
+   void *map;
+
+   snprintf(path, sizeof path, "%s/%s", st->dir, SEQ_STORE_TABLE);
+   if ( (st->fd = open(path, st->rdonly ? O_RDONLY : O_RDWR)) < 0 ) return(1);
+   if ( fstat(st->fd, &sb) != 0 || sb.st_size < sizeof(StoreHeader) ||
+        (map = mmap(NULL, sb.st_size, st->rdonly ? PROT_READ : PROT_READ|PROT_WRITE, MAP_SHARED, st->fd, 0)) == MAP_FAILED ) {
+      close(st->fd);
+      st->fd = -1;
+      return(1);
+   }
+   st->size = sb.st_size;
+   st->hdr = (StoreHeader *) map;
+   st->rec = (StoreRecord *) ((char *) map + sizeof(StoreHeader));
+   if ( memcmp(st->hdr->magic, STORE_MAGIC, sizeof(st->hdr->magic)) != 0 ||
+        st->size != sizeof(StoreHeader) + (size_t) st->hdr->capacity * sizeof(StoreRecord) ) {
+      SeqUtil_TRACE(TL_ERROR, "SeqStateStore: %s is not a status store\n", path);
+      munmap(map, st->size);
+      close(st->fd);
+      st->fd = -1;
+      return(1);
+   }
+   return(0);
+}
+
+static void store_unmap( SeqStore *st ) {
+   if ( st->fd < 0 ) return;
+   munmap(st->hdr, st->size);
+   close(st->fd);
+   st->fd = -1;
+}
+
+/* the slot of key, or of the free slot where it goes, -1 if the table is full */
+static int store_find( StoreHeader *hdr, StoreRecord *rec, const char *key, unsigned int hash ) {
+   unsigned int mask = hdr->capacity - 1, slot, n;
+   size_t len = strlen(key);
+
+   for ( n = 0, slot = hash & mask; n < hdr->capacity; n++, slot = (slot + 1) & mask ) {
+      if ( rec[slot].hash == 0 ) return(slot);
+      if ( rec[slot].hash == hash && rec[slot].len == len && memcmp(rec[slot].key, key, len) == 0 ) return(slot);
+   }
+   return(-1);
+}
+
+static void store_apply( SeqStore *st, const StoreEntry *e ) {
+   if ( st->rec[e->slot].hash == 0 && e->rec.hash != 0 ) st->hdr->count++;
+   memcpy(&st->rec[e->slot], &e->rec, sizeof(StoreRecord));
+   st->hdr->seq = e->seq;
+}
+
+/* sync the table and empty the journal, called with the write lock */
+static int store_checkpoint( SeqStore *st ) {
+   if ( msync(st->hdr, st->size, MS_SYNC) != 0 ) return(1);
+   if ( ftruncate(st->jfd, 0) != 0 ) return(1);
+   return(0);
+}
+
+/* apply the entries of the journal not in the table yet, called with the write lock */
+static void store_replay( SeqStore *st ) {
+   StoreEntry e;
+   int replayed = 0;
+
+   if ( lseek(st->jfd, 0, SEEK_SET) != 0 ) return;
+   while ( read(st->jfd, &e, sizeof e) == sizeof e ) {
+      if ( e.sum != store_sum(&e) || e.slot >= st->hdr->capacity ) break;
+      if ( e.seq > st->hdr->seq ) {
+         store_apply(st, &e);
+         replayed++;
+      }
+   }
+   if ( replayed > 0 ) SeqUtil_TRACE(TL_MEDIUM, "SeqStateStore: replayed %d journal entries in %s\n", replayed, st->dir);
+   store_checkpoint(st);
+}
+
+/*
+ * Write a new table of capacity records holding the n records of rec, those
+ * without state are dropped and those of a same key merged.
+ * Returns 0 if succeeds
+ */
+static int store_write_table( const char *path, unsigned int capacity, const StoreRecord *recs, unsigned int n, unsigned long long seq ) {
+   StoreHeader *hdr;
+   StoreRecord *rec;
+   size_t size = sizeof(StoreHeader) + (size_t) capacity * sizeof(StoreRecord);
+   unsigned int i;
+   void *map;
+   int fd, slot, ret = 0;
+
+   if ( (fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 00666)) < 0 ) return(1);
+   if ( ftruncate(fd, size) != 0 || (map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED ) {
+      close(fd);
+      unlink(path);
+      return(1);
+   }
+   hdr = (StoreHeader *) map;
+   rec = (StoreRecord *) ((char *) map + sizeof(StoreHeader));
+   memcpy(hdr->magic, STORE_MAGIC, sizeof(hdr->magic));
+   hdr->capacity = capacity;
+   hdr->seq = seq;
+
+   for ( i = 0; i < n; i++ ) {
+      if ( recs[i].hash == 0 || recs[i].states == 0 ) continue;
+      if ( (slot = store_find(hdr, rec, recs[i].key, recs[i].hash)) < 0 ) {
+         ret = 1;
+         break;
+      }
+      if ( rec[slot].hash == 0 ) {
+         memcpy(&rec[slot], &recs[i], sizeof(StoreRecord));
+         hdr->count++;
+      } else {
+         rec[slot].states |= recs[i].states;
+      }
+   }
+
+   if ( ret == 0 && msync(map, size, MS_SYNC) != 0 ) ret = 1;
+   munmap(map, size);
+   if ( ret == 0 && fsync(fd) != 0 ) ret = 1;
+   close(fd);
+   if ( ret != 0 ) unlink(path);
+   return(ret);
+}
+
+/* double the table, called with the write lock */
+static int store_grow( SeqStore *st ) {
+   char path[STORE_PATH_MAX], tmp[STORE_PATH_MAX];
+
+   snprintf(path, sizeof path, "%s/%s", st->dir, SEQ_STORE_TABLE);
+   snprintf(tmp, sizeof tmp, "%s/%s.%d", st->dir, SEQ_STORE_TABLE, getpid());
+   if ( store_checkpoint(st) != 0 ) return(1);
+   if ( store_write_table(tmp, 2 * st->hdr->capacity, st->rec, st->hdr->capacity, st->hdr->seq) != 0 ) return(1);
+   if ( rename(tmp, path) != 0 ) {
+      unlink(tmp);
+      return(1);
+   }
+   st->hdr->moved = 1;
+   msync(st->hdr, sizeof(StoreHeader), MS_SYNC);
+   store_unmap(st);
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqStateStore: %s grown\n", st->dir);
+   return(store_map(st));
+}
+
+/* after taking a lock: map the table again if another process replaced it */
+static int store_current( SeqStore *st ) {
+   if ( st->fd >= 0 && ! st->hdr->moved ) return(0);
+   store_unmap(st);
+   return(store_map(st));
+}
+
+/*
+ * Commit changes of records: journal them, sync the journal then apply them.
+ * change[i].was is set to the states before the change. Returns 0 if succeeds.
+ */
+static int store_change( SeqStore *st, StoreChange *change, int n ) {
+   StoreEntry entries[SEQ_STATE_FILES + 1];
+   StoreRecord *rec;
+   unsigned int hash, mask, slot, probe;
+   unsigned short states;
+   int i, k, used = 0, ret = 0;
+   size_t len;
+   off_t jsize;
+
+   if ( st->rdonly || n > SEQ_STATE_FILES + 1 ) return(1);
+   if ( store_lock(st, F_WRLCK) != 0 ) return(1);
+   if ( store_current(st) != 0 ) {
+      store_unlock(st);
+      return(1);
+   }
+   if ( (st->hdr->count + n) * 4 >= st->hdr->capacity * 3 && store_grow(st) != 0 ) {
+      store_unlock(st);
+      return(1);
+   }
+
+   mask = st->hdr->capacity - 1;
+   for ( i = 0; i < n && ret == 0; i++ ) {
+      hash = store_hash(change[i].key);
+      len = strlen(change[i].key);
+
+      /* probe the table as the entries already built leave it */
+      for ( probe = 0, slot = hash & mask, rec = NULL; probe < st->hdr->capacity; probe++, slot = (slot + 1) & mask ) {
+         for ( k = used - 1; k >= 0 && entries[k].slot != slot; k-- );
+         rec = k >= 0 ? &entries[k].rec : &st->rec[slot];
+         if ( rec->hash == 0 || (rec->hash == hash && rec->len == len && memcmp(rec->key, change[i].key, len) == 0) ) break;
+      }
+      if ( probe == st->hdr->capacity ) {
+         ret = 1;
+         break;
+      }
+
+      change[i].was = rec->hash != 0 ? rec->states : 0;
+      states = (change[i].was & ~change[i].clear) | change[i].set;
+      if ( states == change[i].was ) continue;
+      if ( k >= 0 ) {
+         rec->states = states;
+         continue;
+      }
+      memset(&entries[used], '\0', sizeof(StoreEntry));
+      entries[used].slot = slot;
+      entries[used].rec.hash = hash;
+      entries[used].rec.states = states;
+      entries[used].rec.len = len;
+      entries[used].rec.mtime = (unsigned int) time(NULL);
+      memcpy(entries[used].rec.key, change[i].key, len);
+      used++;
+   }
+
+   if ( ret == 0 && used > 0 ) {
+      for ( i = 0; i < used; i++ ) {
+         entries[i].seq = st->hdr->seq + i + 1;
+         entries[i].sum = store_sum(&entries[i]);
+      }
+      if ( (jsize = lseek(st->jfd, 0, SEEK_END)) < 0 ||
+           write(st->jfd, entries, used * sizeof(StoreEntry)) != (ssize_t) (used * sizeof(StoreEntry)) ||
+           (StoreSync && fdatasync(st->jfd) != 0) ) {
+         SeqUtil_TRACE(TL_ERROR, "SeqStateStore: cannot write the journal of %s errno=%d\n", st->dir, errno);
+         if ( jsize >= 0 && ftruncate(st->jfd, jsize) != 0 ) SeqUtil_TRACE(TL_ERROR, "SeqStateStore: journal of %s left torn\n", st->dir);
+         ret = 1;
+      } else {
+         for ( i = 0; i < used; i++ ) store_apply(st, &entries[i]);
+         if ( jsize / sizeof(StoreEntry) + used >= SEQ_STORE_CHECKPOINT ) store_checkpoint(st);
+      }
+   }
+   store_unlock(st);
+   return(ret);
+}
+
+/* read the states of key, returns 0 if succeeds */
+static int store_states( SeqStore *st, const char *key, unsigned short *states ) {
+   int slot;
+
+   *states = 0;
+   if ( store_lock(st, F_RDLCK) != 0 ) return(1);
+   if ( store_current(st) != 0 ) {
+      store_unlock(st);
+      return(1);
+   }
+   if ( (slot = store_find(st->hdr, st->rec, key, store_hash(key))) >= 0 && st->rec[slot].hash != 0 ) *states = st->rec[slot].states;
+   store_unlock(st);
+   return(0);
+}
+
+/* add the status files found under sub of dir to recs */
+static void store_import( const char *dir, const char *sub, StoreRecord **recs, unsigned int *n, unsigned int *size ) {
+   char path[SEQ_MAXFIELD], ddir[SEQ_MAXFIELD], key[SEQ_STORE_KEYMAX];
+   struct dirent *de;
+   struct stat sb;
+   DIR *dp;
+   int state;
+
+   snprintf(path, sizeof path, "%s%s", dir, sub);
+   if ( (dp = opendir(path)) == NULL ) return;
+   while ( (de = readdir(dp)) != NULL ) {
+      if ( de->d_name[0] == '.' ) continue;
+      snprintf(path, sizeof path, "%s%s/%s", dir, sub, de->d_name);
+      if ( stat(path, &sb) != 0 ) continue;
+      if ( S_ISDIR(sb.st_mode) ) {
+         snprintf(path, sizeof path, "%s/%s", sub, de->d_name);
+         store_import(dir, path, recs, n, size);
+      } else if ( store_parse(path, ddir, key, &state, NULL) == 0 ) {
+         if ( *n == *size ) {
+            *size = *size > 0 ? 2 * *size : SEQ_STORE_RECORDS;
+            if ( (*recs = (StoreRecord *) realloc(*recs, *size * sizeof(StoreRecord))) == NULL ) {
+               raiseError("OutOfMemory exception in SeqStateStore.store_import()\n");
+            }
+         }
+         memset(&(*recs)[*n], '\0', sizeof(StoreRecord));
+         (*recs)[*n].hash = store_hash(key);
+         (*recs)[*n].states = 1 << state;
+         (*recs)[*n].len = strlen(key);
+         (*recs)[*n].mtime = (unsigned int) sb.st_mtime;
+         memcpy((*recs)[*n].key, key, strlen(key));
+         (*n)++;
+      }
+   }
+   closedir(dp);
+}
+
+/*
+ * Create the table of a datestamp directory with the status files already
+ * there: a datestamp started with status files goes on from them.
+ * Called with the write lock.
+ */
+static int store_create( const char *dir ) {
+   char path[STORE_PATH_MAX], tmp[STORE_PATH_MAX];
+   StoreRecord *recs = NULL;
+   unsigned int n = 0, size = 0, capacity = SEQ_STORE_RECORDS;
+   int ret;
+
+   store_import(dir, "", &recs, &n, &size);
+   while ( n * 4 >= capacity * 3 ) capacity *= 2;
+   snprintf(path, sizeof path, "%s/%s", dir, SEQ_STORE_TABLE);
+   snprintf(tmp, sizeof tmp, "%s/%s.%d", dir, SEQ_STORE_TABLE, getpid());
+   if ( (ret = store_write_table(tmp, capacity, recs, n, 0)) == 0 && (ret = rename(tmp, path)) != 0 ) unlink(tmp);
+   free(recs);
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqStateStore: created %s with %u status files\n", dir, n);
+   return(ret);
+}
+
+/*
+ * The store of a datestamp directory, NULL if it has none and create is 0
+ * or if it cannot be created.
+ */
+static SeqStore *store_open( const char *dir, int create ) {
+   char path[STORE_PATH_MAX];
+   SeqStore *st;
+   struct stat sb;
+
+   for ( st = Stores; st != NULL; st = st->next ) {
+      if ( strcmp(st->dir, dir) == 0 ) return(st);
+   }
+
+   snprintf(path, sizeof path, "%s/%s", dir, SEQ_STORE_TABLE);
+   if ( ! create && stat(path, &sb) != 0 ) return(NULL);
+
+   if ( (st = (SeqStore *) malloc(sizeof(SeqStore))) == NULL ) raiseError("OutOfMemory exception in SeqStateStore.store_open()\n");
+   memset(st, '\0', sizeof(SeqStore));
+   snprintf(st->dir, sizeof st->dir, "%s", dir);
+   st->fd = -1;
+   snprintf(path, sizeof path, "%s/%s", dir, SEQ_STORE_JOURNAL);
+   if ( (st->jfd = open(path, create ? O_RDWR|O_CREAT : O_RDWR, 00666)) < 0 && errno == EACCES && ! create ) {
+      st->jfd = open(path, O_RDONLY);
+      st->rdonly = 1;
+   }
+   if ( st->jfd < 0 || store_lock(st, st->rdonly ? F_RDLCK : F_WRLCK) != 0 ) {
+      if ( st->jfd >= 0 ) close(st->jfd);
+      free(st);
+      return(NULL);
+   }
+
+   snprintf(path, sizeof path, "%s/%s", dir, SEQ_STORE_TABLE);
+   if ( store_map(st) != 0 && (st->rdonly || stat(path, &sb) == 0 || store_create(dir) != 0 || store_map(st) != 0) ) {
+      store_unlock(st);
+      close(st->jfd);
+      free(st);
+      return(NULL);
+   }
+   if ( ! st->rdonly ) store_replay(st);
+   store_unlock(st);
+
+   st->next = Stores;
+   Stores = st;
+   return(st);
+}
+
+/*
+ * The store and key of a status file, NULL if the file is not a status file
+ * or if its datestamp has no store (and create is 0).
+ */
+static SeqStore *store_lookup( const char *filename, int create, char *key, int *state ) {
+   char dir[SEQ_MAXFIELD];
+
+   if ( store_parse(filename, dir, key, state, NULL) != 0 ) return(NULL);
+   return(store_open(dir, create));
+}
+
+/**
+ * touch_store: sets the state of a status file, any other file is touched
+ */
+int touch_store( const char *filename, const char * _seq_exp_home ) {
+   char key[SEQ_STORE_KEYMAX];
+   StoreChange change;
+   SeqStore *st;
+   int state;
+
+   if ( (st = store_lookup(filename, 1, key, &state)) == NULL ) return(touch_nfs(filename, _seq_exp_home));
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqStateStore.touch_store() %s %s\n", key, StoreStates[state]);
+   change.key = key;
+   change.set = 1 << state;
+   change.clear = 0;
+   return(store_change(st, &change, 1));
+}
+
+/**
+ * access_store: returns zero if the state of a status file is set, or if
+ * any other file can be accessed, and a nonzero value if not
+ */
+int access_store( const char *filename, int mode, const char * _seq_exp_home ) {
+   char key[SEQ_STORE_KEYMAX];
+   unsigned short states;
+   SeqStore *st;
+   int state;
+
+   if ( (st = store_lookup(filename, 0, key, &state)) == NULL ) return(access_nfs(filename, mode, _seq_exp_home));
+   if ( store_states(st, key, &states) != 0 ) return(-1);
+   return( (states & (1 << state)) ? 0 : -1 );
+}
+
+/**
+ * isFileExists_store: returns 1 if the state of a status file is set, or if
+ * any other file exists, 0 if not
+ */
+int isFileExists_store( const char* lockfile, const char *caller, const char * _seq_exp_home ) {
+   char key[SEQ_STORE_KEYMAX];
+   SeqStore *st;
+   int state;
+
+   if ( (st = store_lookup(lockfile, 0, key, &state)) == NULL ) return(isFileExists_nfs(lockfile, caller, _seq_exp_home));
+   if ( access_store(lockfile, R_OK, _seq_exp_home) == 0 ) {
+      SeqUtil_TRACE(TL_FULL_TRACE, "SeqStateStore.isFileExists_store() caller:%s found state %s %s\n", caller, key, StoreStates[state]);
+      return(1);
+   }
+   SeqUtil_TRACE(TL_MEDIUM, "SeqStateStore.isFileExists_store() caller:%s missing state %s %s\n", caller, key, StoreStates[state]);
+   return(0);
+}
+
+/**
+ * removeFile_store: clears the state of a status file, any other file is
+ * removed. Returns zero if the state was set (or the file removed)
+ */
+int removeFile_store( const char *filename, const char * _seq_exp_home ) {
+   char key[SEQ_STORE_KEYMAX];
+   StoreChange change;
+   SeqStore *st;
+   int state;
+
+   if ( (st = store_lookup(filename, 0, key, &state)) == NULL ) return(removeFile_nfs(filename, _seq_exp_home));
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqStateStore.removeFile_store() %s %s\n", key, StoreStates[state]);
+   change.key = key;
+   change.set = 0;
+   change.clear = 1 << state;
+   if ( store_change(st, &change, 1) != 0 ) return(-1);
+   return( (change.was & (1 << state)) ? 0 : -1 );
+}
+
+/**
+ * removeFiles_store: removeFile_store of each file, status[i] is zero if
+ * filenames[i] was removed
+ */
+int removeFiles_store( const char **filenames, int count, int *status, const char * _seq_exp_home ) {
+   int i;
+
+   for ( i = 0; i < count; i++ ) status[i] = removeFile_store(filenames[i], _seq_exp_home);
+   return(0);
+}
+
+/**
+ * setNodeState_store: puts a node in a new state with a single change of the
+ * store, see SeqUtil_stateFiles. The names of the status files removed are
+ * returned in removed. It returns zero if succeeds
+ */
+int setNodeState_store( const char *request, char *removed, size_t size, const char * _seq_exp_home ) {
+   char stale[SEQ_STATE_FILES][SEQ_MAXFIELD], newfile[SEQ_MAXFIELD];
+   char keys[SEQ_STATE_FILES + 1][SEQ_STORE_KEYMAX], dir[SEQ_MAXFIELD], other[SEQ_MAXFIELD];
+   StoreChange change[SEQ_STATE_FILES + 1];
+   int state[SEQ_STATE_FILES + 1];
+   SeqStore *st;
+   int i, count, n;
+
+   if ( SeqUtil_stateFiles(request, stale, &count, newfile) != 0 ) return(setNodeState_nfs(request, removed, size, _seq_exp_home));
+
+   /* every file of the change must be in the same store */
+   for ( i = 0; i < count; i++ ) {
+      if ( store_parse(stale[i], i == 0 ? dir : other, keys[i], &state[i], NULL) != 0 ||
+           (i > 0 && strcmp(dir, other) != 0) ) return(setNodeState_nfs(request, removed, size, _seq_exp_home));
+      change[i].key = keys[i];
+      change[i].set = 0;
+      change[i].clear = 1 << state[i];
+   }
+   n = count;
+   if ( newfile[0] != '\0' ) {
+      if ( store_parse(newfile, other, keys[n], &state[n], NULL) != 0 || strcmp(dir, other) != 0 ) {
+         return(setNodeState_nfs(request, removed, size, _seq_exp_home));
+      }
+      change[n].key = keys[n];
+      change[n].set = 1 << state[n];
+      change[n].clear = 0;
+      n++;
+   }
+   if ( (st = store_open(dir, 1)) == NULL ) return(setNodeState_nfs(request, removed, size, _seq_exp_home));
+
+   if ( removed != NULL && size > 0 ) removed[0] = '\0';
+   if ( store_change(st, change, n) != 0 ) return(1);
+   for ( i = 0; i < count; i++ ) {
+      if ( change[i].was & (1 << state[i]) ) SeqUtil_stateRemoved(removed, size, stale[i]);
+   }
+   return(0);
+}
+
+/*
+ * Call fn for each status file of a store matching pattern, returns the
+ * number of matches or -1 if the pattern is not for a store.
+ */
+static int store_glob( const char *pattern, void (*fn)( const char *match, void *arg ), void *arg ) {
+   char dir[SEQ_MAXFIELD], keypat[SEQ_STORE_KEYMAX], name[SEQ_STORE_KEYMAX + 16], match[SEQ_MAXFIELD];
+   SeqStore *st;
+   size_t keyoff;
+   unsigned int i;
+   int state, count = 0;
+
+   if ( store_parse(pattern, dir, keypat, &state, &keyoff) != 0 || strpbrk(dir, "*?[") != NULL ) return(-1);
+   if ( (st = store_open(dir, 0)) == NULL ) return(-1);
+   if ( store_lock(st, F_RDLCK) != 0 ) return(0);
+   if ( store_current(st) != 0 ) {
+      store_unlock(st);
+      return(0);
+   }
+   for ( i = 0; i < st->hdr->capacity; i++ ) {
+      if ( st->rec[i].hash == 0 || ! (st->rec[i].states & (1 << state)) ) continue;
+      if ( fnmatch(keypat, st->rec[i].key, FNM_PATHNAME) != 0 ) continue;
+      count++;
+      if ( fn != NULL ) {
+         snprintf(name, sizeof name, "%s.%s", st->rec[i].key, StoreStates[state]);
+         snprintf(match, sizeof match, "%.*s%s", (int) keyoff, pattern, name);
+         fn(match, arg);
+      }
+   }
+   store_unlock(st);
+   return(count);
+}
+
+/**
+ * globPath_store: number of status files of a store matching pattern,
+ * like globPath_nfs
+ */
+int globPath_store( const char *pattern, int flags, int (*errfunc) (const char *epath, int eerrno), const char * _seq_exp_home ) {
+   int ret;
+
+   if ( (ret = store_glob(pattern, NULL, NULL)) < 0 ) return(globPath_nfs(pattern, flags, errfunc, _seq_exp_home));
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqStateStore.globPath_store() %s matches:%d\n", pattern, ret);
+   return(ret);
+}
+
+typedef struct {
+   const char  *pattern;
+   size_t       wildcard;
+   LISTNODEPTR  list;
+} StoreExtList;
+
+static void store_ext( const char *match, void *arg ) {
+   StoreExtList *ext = (StoreExtList *) arg;
+   char *tmpString;
+
+   /* same as globExtList_nfs: what the wildcard of the pattern stands for */
+   tmpString = strndup(match + ext->wildcard, strlen(match) - strlen(ext->pattern) + 1);
+   SeqListNode_insertItem(&ext->list, tmpString);
+   free(tmpString);
+}
+
+/**
+ * globExtList_store: extensions of the status files of a store matching
+ * pattern, like globExtList_nfs
+ */
+LISTNODEPTR globExtList_store( const char *pattern, int flags, int (*errfunc) (const char *epath, int eerrno) ) {
+   StoreExtList ext;
+   char *wildcardPtr;
+
+   if ( (wildcardPtr = strchr(pattern, '*')) == NULL ) return(NULL);
+   ext.pattern = pattern;
+   ext.wildcard = wildcardPtr - pattern;
+   ext.list = NULL;
+   if ( store_glob(pattern, store_ext, &ext) < 0 ) return(globExtList_nfs(pattern, flags, errfunc));
+   return(ext.list);
+}
+
+int SeqStateStore_export( const char *dir ) {
+   char path[SEQ_MAXFIELD], parent[SEQ_MAXFIELD], *slash;
+   SeqStore *st;
+   unsigned int i, s;
+   int exists, changed = 0;
+
+   if ( (st = store_open(dir, 0)) == NULL || store_lock(st, F_RDLCK) != 0 ) return(-1);
+   if ( store_current(st) != 0 ) {
+      store_unlock(st);
+      return(-1);
+   }
+   for ( i = 0; i < st->hdr->capacity; i++ ) {
+      if ( st->rec[i].hash == 0 ) continue;
+      for ( s = 0; s < STORE_NSTATES; s++ ) {
+         snprintf(path, sizeof path, "%s/%s.%s", dir, st->rec[i].key, StoreStates[s]);
+         exists = access(path, F_OK) == 0;
+         if ( (st->rec[i].states & (1 << s)) && ! exists ) {
+            snprintf(parent, sizeof parent, "%s", path);
+            if ( (slash = strrchr(parent, '/')) != NULL ) *slash = '\0';
+            if ( access(parent, F_OK) != 0 ) SeqUtil_mkdir_nfs(parent, 1, NULL);
+            if ( touch_nfs(path, NULL) == 0 ) changed++;
+         } else if ( ! (st->rec[i].states & (1 << s)) && exists ) {
+            if ( removeFile_nfs(path, NULL) == 0 ) changed++;
+         }
+      }
+   }
+   store_unlock(st);
+   return(changed);
+}
+
+int SeqStateStore_list( const char *dir, FILE *fp ) {
+   SeqStore *st;
+   unsigned int i, s;
+   int lines = 0;
+
+   if ( (st = store_open(dir, 0)) == NULL || store_lock(st, F_RDLCK) != 0 ) return(-1);
+   if ( store_current(st) != 0 ) {
+      store_unlock(st);
+      return(-1);
+   }
+   for ( i = 0; i < st->hdr->capacity; i++ ) {
+      if ( st->rec[i].hash == 0 ) continue;
+      for ( s = 0; s < STORE_NSTATES; s++ ) {
+         if ( ! (st->rec[i].states & (1 << s)) ) continue;
+         fprintf(fp, "%s %s\n", st->rec[i].key, StoreStates[s]);
+         lines++;
+      }
+   }
+   store_unlock(st);
+   return(lines);
+}
+
+void SeqStateStore_sync( int on ) {
+   StoreSync = on;
+}
+
+void SeqStateStore_close( void ) {
+   SeqStore *st;
+
+   while ( (st = Stores) != NULL ) {
+      Stores = st->next;
+      store_unmap(st);
+      close(st->jfd);
+      free(st);
+   }
+}
@@ -0,0 +1,87 @@
+/* SeqStateStore.h - Status store of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SEQ_STATE_STORE_H_
+#define _SEQ_STATE_STORE_H_
+
+#include <stdio.h>
+#include "SeqListNode.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Interface.
+ * The status store keeps the states of the nodes of one datestamp in a single
+ * table, sequencing/status/$datestamp/.states, instead of one empty file per
+ * state (node.ext.begin, node.ext.end, ...).  The table is mmapped, its fixed
+ * size records are found by a hash of the node path and extension.  Changes
+ * are first appended to sequencing/status/$datestamp/.states.journal, then
+ * applied to the table; the journal is replayed at the next open after a
+ * crash and truncated once the table is synced.  Processes serialize on
+ * fcntl() locks of the journal.
+ *
+ * The *_store functions take the same arguments as the nfs functions of
+ * SeqUtil and replace them behind the _touch, _access, _isFileExists,
+ * _removeFile ... pointers (see SEQ_STATE_BACKEND in maestro.c).  A path that
+ * is not a status file, or a datestamp without a store, goes to the nfs
+ * function.  The store of a datestamp is created, with the status files
+ * already there, on its first change.
+ *
+ * Tools that read the status files need SeqStateStore_export() (see the
+ * statestore command) to materialise them from the store.
+********************************************************************************/
+
+#define SEQ_STORE_TABLE      ".states"
+#define SEQ_STORE_JOURNAL    ".states.journal"
+#define SEQ_STORE_KEYMAX     244    /* node path and extension, with its '\0' */
+#define SEQ_STORE_RECORDS    1024   /* records of a new table, doubled when 3/4 full */
+#define SEQ_STORE_CHECKPOINT 256    /* journal entries before the table is synced */
+
+int  touch_store ( const char *filename, const char * _seq_exp_home );
+int  access_store ( const char *filename, int mode, const char * _seq_exp_home );
+int  isFileExists_store ( const char* lockfile, const char *caller, const char * _seq_exp_home );
+int  removeFile_store ( const char *filename, const char * _seq_exp_home );
+int  removeFiles_store ( const char **filenames, int count, int *status, const char * _seq_exp_home );
+int  setNodeState_store ( const char *request, char *removed, size_t size, const char * _seq_exp_home );
+int  globPath_store ( const char *pattern, int flags, int (*errfunc) (const char *epath, int eerrno), const char * _seq_exp_home );
+LISTNODEPTR globExtList_store ( const char *pattern, int flags, int (*errfunc) (const char *epath, int eerrno) );
+
+/********************************************************************************
+ * Write the status files of a datestamp directory from its store: missing
+ * files are created, files of states no longer set are removed.
+ * Returns the number of files changed, -1 if the directory has no store.
+********************************************************************************/
+int  SeqStateStore_export ( const char *dir );
+
+/********************************************************************************
+ * Print the states of a datestamp directory, one "node.ext state" per line.
+ * Returns the number of lines, -1 if the directory has no store.
+********************************************************************************/
+int  SeqStateStore_list ( const char *dir, FILE *fp );
+
+/********************************************************************************
+ * With on set, the journal is synced before a change is applied so that it
+ * survives a crash of the host, not only of the process (SEQ_STATE_SYNC=yes
+ * in ~/.maestrorc).  Off by default: the status files never were synced.
+********************************************************************************/
+void SeqStateStore_sync ( int on );
+
+/* release the stores opened by this process */
+void SeqStateStore_close ( void );
+
+#endif
@@ -0,0 +1,447 @@
+/* SeqStatsStore.c - Columnar store of the daily statistics of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "SeqUtil.h"
+#include "SeqDatesUtil.h"
+#include "SeqStatsStore.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Inner workings.
+ * The store is a header followed by blocks, one per stats file added.  A
+ * block has the datestamp, mtime and size of its stats file, the nodes and
+ * members first seen in it ("node\0member\0", given the next indexes), then
+ * the columns: the node indexes of the lines and the seconds of each time,
+ * uint32/int32 arrays of nrows.  Every part is padded to 8 bytes and the
+ * block ends with its length: a block cut by a crash does not end with its
+ * length, it is ignored and overwritten by the next block added.
+ *
+ * A window scans the block headers and the names, which are few, and maps
+ * the columns of the blocks of its days only.
+********************************************************************************/
+
+#define STATS_MAGIC        "SEQSTAT1"
+#define STATS_BLOCK_MAGIC  0x53424c4bu
+#define STATS_ALIGN(n)     ( ((n) + 7) & ~(size_t) 7 )
+#define STATS_LINE         1024     /* as read by logreader before */
+
+typedef struct {
+   char     magic[8];
+   uint32_t order;           /* 0x01020304 written natively */
+   uint32_t pad;
+} StatsHeader;
+
+typedef struct {
+   uint32_t magic;
+   uint32_t nrows;
+   uint32_t nnames;          /* names added by the block */
+   uint32_t namesSize;       /* padded */
+   char     datestamp[16];
+   int64_t  mtime;           /* of the stats file when added */
+   int64_t  mtime_nsec;
+   int64_t  size;
+   uint64_t length;          /* of the block, repeated at its end */
+} StatsBlock;
+
+typedef struct {
+   int          fd;
+   int          writable;
+   char        *map;
+   size_t       mapSize;
+   off_t        end;           /* end of the valid blocks */
+   const char **node;          /* by index */
+   const char **member;
+   unsigned int count, size;
+   unsigned int *buckets;      /* index + 1, 0 when free */
+   unsigned int nbuckets;
+   char       **owned;         /* names and blocks read from the files */
+   unsigned int nowned, sowned;
+} StatsStore;
+
+static unsigned int stats_hash( const char *node, const char *member ) {
+   unsigned int h = 2166136261u;
+   for ( ; *node != '\0'; node++ ) h = (h ^ (unsigned char) *node) * 16777619u;
+   h = (h ^ (unsigned char) ':') * 16777619u;
+   for ( ; *member != '\0'; member++ ) h = (h ^ (unsigned char) *member) * 16777619u;
+   return h;
+}
+
+static int stats_own( StatsStore *st, char *ptr ) {
+   char **owned;
+   if ( st->nowned == st->sowned ) {
+      if ( (owned = realloc(st->owned, (st->sowned ? 2 * st->sowned : 64) * sizeof(char *))) == NULL ) return(1);
+      st->owned = owned;
+      st->sowned = st->sowned ? 2 * st->sowned : 64;
+   }
+   st->owned[st->nowned++] = ptr;
+   return(0);
+}
+
+/* the index of a name, -1 if not there */
+static int stats_findName( StatsStore *st, const char *node, const char *member ) {
+   unsigned int i, idx;
+   if ( st->nbuckets == 0 ) return(-1);
+   for ( i = stats_hash(node, member) & (st->nbuckets - 1); (idx = st->buckets[i]) != 0; i = (i + 1) & (st->nbuckets - 1) ) {
+      if ( strcmp(st->node[idx - 1], node) == 0 && strcmp(st->member[idx - 1], member) == 0 ) return(idx - 1);
+   }
+   return(-1);
+}
+
+/* gives the next index to a name, whose strings must outlive the store */
+static int stats_addName( StatsStore *st, const char *node, const char *member ) {
+   unsigned int i, n, size, *buckets;
+   const char **names;
+
+   if ( st->count == st->size ) {
+      size = st->size ? 2 * st->size : 1024;
+      if ( (names = realloc(st->node, size * sizeof(char *))) == NULL ) return(-1);
+      st->node = names;
+      if ( (names = realloc(st->member, size * sizeof(char *))) == NULL ) return(-1);
+      st->member = names;
+      st->size = size;
+   }
+   if ( 2 * (st->count + 1) > st->nbuckets ) {
+      size = st->nbuckets ? 2 * st->nbuckets : 2048;
+      if ( (buckets = calloc(size, sizeof(unsigned int))) == NULL ) return(-1);
+      for ( n = 0; n < st->count; n++ ) {
+         for ( i = stats_hash(st->node[n], st->member[n]) & (size - 1); buckets[i] != 0; i = (i + 1) & (size - 1) );
+         buckets[i] = n + 1;
+      }
+      free(st->buckets);
+      st->buckets = buckets;
+      st->nbuckets = size;
+   }
+   st->node[st->count] = node;
+   st->member[st->count] = member;
+   for ( i = stats_hash(node, member) & (st->nbuckets - 1); st->buckets[i] != 0; i = (i + 1) & (st->nbuckets - 1) );
+   st->buckets[i] = st->count + 1;
+   return(st->count++);
+}
+
+static int stats_lock( int fd, short type ) {
+   struct flock fl;
+
+   memset(&fl, '\0', sizeof fl);
+   fl.l_type = type;
+   fl.l_whence = SEEK_SET;
+   while ( fcntl(fd, F_SETLKW, &fl) != 0 ) {
+      if ( errno != EINTR ) return(1);
+   }
+   return(0);
+}
+
+/* the block at off if it is complete, NULL otherwise */
+static const StatsBlock *stats_block( StatsStore *st, off_t off ) {
+   const StatsBlock *blk;
+   uint64_t trailer;
+
+   if ( off + sizeof(StatsBlock) + sizeof(uint64_t) > st->mapSize ) return(NULL);
+   blk = (const StatsBlock *) (st->map + off);
+   if ( blk->magic != STATS_BLOCK_MAGIC || blk->length > st->mapSize - off ||
+        blk->length != sizeof(StatsBlock) + blk->namesSize + STATS_ALIGN((size_t) blk->nrows * sizeof(uint32_t) * (1 + SEQ_STATS_NTIMES)) + sizeof(uint64_t) ) return(NULL);
+   memcpy(&trailer, st->map + off + blk->length - sizeof(uint64_t), sizeof(trailer));
+   if ( trailer != blk->length || blk->datestamp[sizeof(blk->datestamp) - 1] != '\0' ) return(NULL);
+   return(blk);
+}
+
+/* the names added by a block, 1 if they are not all there */
+static int stats_blockNames( StatsStore *st, const StatsBlock *blk ) {
+   const char *ptr = (const char *) (blk + 1), *end = ptr + blk->namesSize, *node, *member;
+   uint32_t i;
+
+   for ( i = 0; i < blk->nnames; i++ ) {
+      node = ptr;
+      if ( (ptr = memchr(ptr, '\0', end - ptr)) == NULL ) return(1);
+      member = ++ptr;
+      if ( ptr >= end || (ptr = memchr(ptr, '\0', end - ptr)) == NULL ) return(1);
+      ptr++;
+      if ( stats_addName(st, node, member) < 0 ) return(1);
+   }
+   return(0);
+}
+
+static void stats_dayOfBlock( SeqStatsDay *day, const StatsBlock *blk ) {
+   const char *cols = (const char *) (blk + 1) + blk->namesSize;
+   int t;
+
+   day->nrows = blk->nrows;
+   day->node = (const uint32_t *) cols;
+   for ( t = 0; t < SEQ_STATS_NTIMES; t++ ) day->times[t] = (const int32_t *) (cols + (size_t) blk->nrows * sizeof(uint32_t) * (1 + t));
+}
+
+/* seconds of HH:MM:SS or of the time of day of YYYYMMDD.HH:MM:SS, as charToSeconds() */
+static int32_t stats_seconds( const char *value ) {
+   char t[9], hour[3], minute[3], second[3];
+   const char *dot;
+
+   if ( (dot = strchr(value, '.')) != NULL ) value = dot + 1;
+   memset(t, '\0', sizeof t);
+   strncpy(t, value, 8);
+   hour[0] = t[0]; hour[1] = t[1]; hour[2] = '\0';
+   minute[0] = t[3]; minute[1] = t[4]; minute[2] = '\0';
+   second[0] = t[6]; second[1] = t[7]; second[2] = '\0';
+   return(atoi(second) + atoi(minute) * 60 + atoi(hour) * 60 * 60);
+}
+
+/* splits a stats line in node, member and times, 1 if it is not one */
+static int stats_parseLine( char *line, char **fields ) {
+   static const char *keys[] = { ":MEMBER=", ":SUBMIT=", ":BEGIN=", ":END=", ":EXECTIME=", ":SUBMITDELAY=", ":DELTAFROMSTART=" };
+   char *ptr, *next;
+   size_t len;
+   int k;
+
+   if ( (ptr = strstr(line, "SEQNODE=")) == NULL ) return(1);
+   ptr += strlen("SEQNODE=");
+   for ( k = 0; k < sizeof(keys) / sizeof(keys[0]); k++ ) {
+      if ( (next = strstr(ptr, keys[k])) == NULL ) return(1);
+      *next = '\0';
+      fields[k] = ptr;
+      ptr = next + strlen(keys[k]);
+   }
+   len = strlen(ptr);
+   if ( len > 0 && ptr[len - 1] == '\n' ) ptr[--len] = '\0';
+   fields[k] = ptr;
+   return(0);
+}
+
+/* reads the stats file of a day into a new block, appended to the store if it can */
+static const StatsBlock *stats_import( StatsStore *st, const char *path, const char *datestamp, const struct stat *sb ) {
+   char line[STATS_LINE], *fields[2 + SEQ_STATS_NTIMES], *name, *block, *ptr;
+   uint32_t *rows = NULL, *grown;
+   unsigned int nrows = 0, srows = 0, firstNew = st->count, i;
+   size_t namesSize = 0, length;
+   StatsBlock blk;
+   int idx, t;
+   FILE *fp;
+
+   if ( (fp = fopen(path, "r")) == NULL ) return(NULL);
+   /* rows of 1 + SEQ_STATS_NTIMES values, turned into columns below */
+   while ( fgets(line, sizeof(line), fp) != NULL && strstr(line, "SEQNODE") != NULL ) {
+      if ( stats_parseLine(line, fields) != 0 ) {
+         SeqUtil_TRACE(TL_ERROR,"SeqStatsStore parsing error at the following stats line of %s:\n%s \n", path, line);
+         continue;
+      }
+      if ( (idx = stats_findName(st, fields[0], fields[1])) < 0 ) {
+         length = strlen(fields[0]) + strlen(fields[1]) + 2;
+         if ( (name = malloc(length)) == NULL || stats_own(st, name) != 0 ) goto nomem;
+         strcpy(name, fields[0]);
+         strcpy(name + strlen(fields[0]) + 1, fields[1]);
+         if ( (idx = stats_addName(st, name, name + strlen(fields[0]) + 1)) < 0 ) goto nomem;
+         namesSize += length;
+      }
+      if ( nrows == srows ) {
+         srows = srows ? 2 * srows : 1024;
+         if ( (grown = realloc(rows, srows * (1 + SEQ_STATS_NTIMES) * sizeof(uint32_t))) == NULL ) goto nomem;
+         rows = grown;
+      }
+      rows[nrows * (1 + SEQ_STATS_NTIMES)] = idx;
+      for ( t = 0; t < SEQ_STATS_NTIMES; t++ ) rows[nrows * (1 + SEQ_STATS_NTIMES) + 1 + t] = stats_seconds(fields[2 + t]);
+      nrows++;
+   }
+   fclose(fp);
+   fp = NULL;
+
+   memset(&blk, '\0', sizeof blk);
+   blk.magic = STATS_BLOCK_MAGIC;
+   blk.nrows = nrows;
+   blk.nnames = st->count - firstNew;
+   blk.namesSize = STATS_ALIGN(namesSize);
+   snprintf(blk.datestamp, sizeof blk.datestamp, "%s", datestamp);
+   blk.mtime = sb->st_mtim.tv_sec;
+   blk.mtime_nsec = sb->st_mtim.tv_nsec;
+   blk.size = sb->st_size;
+   blk.length = sizeof(StatsBlock) + blk.namesSize + STATS_ALIGN((size_t) nrows * sizeof(uint32_t) * (1 + SEQ_STATS_NTIMES)) + sizeof(uint64_t);
+   if ( (block = calloc(1, blk.length)) == NULL || stats_own(st, block) != 0 ) goto nomem;
+   memcpy(block, &blk, sizeof blk);
+   for ( ptr = block + sizeof blk, i = firstNew; i < st->count; i++ ) {
+      strcpy(ptr, st->node[i]);
+      ptr += strlen(ptr) + 1;
+      strcpy(ptr, st->member[i]);
+      ptr += strlen(ptr) + 1;
+   }
+   ptr = block + sizeof blk + blk.namesSize;
+   for ( t = 0; t < 1 + SEQ_STATS_NTIMES; t++ ) {
+      for ( i = 0; i < nrows; i++ ) ((uint32_t *) ptr)[i] = rows[i * (1 + SEQ_STATS_NTIMES) + t];
+      ptr += nrows * sizeof(uint32_t);
+   }
+   memcpy(block + blk.length - sizeof(uint64_t), &blk.length, sizeof(uint64_t));
+   free(rows);
+
+   if ( st->writable ) {
+      /* over the tail of a block cut by a crash */
+      if ( ftruncate(st->fd, st->end) != 0 || pwrite(st->fd, block, blk.length, st->end) != blk.length ) {
+         SeqUtil_TRACE(TL_MEDIUM,"SeqStatsStore cannot add %s to the store: %s\n", path, strerror(errno));
+         if ( ftruncate(st->fd, st->end) != 0 ) SeqUtil_TRACE(TL_MEDIUM,"SeqStatsStore cannot truncate the store\n");
+         st->writable = 0;
+      } else {
+         st->end += blk.length;
+         SeqUtil_TRACE(TL_FULL_TRACE,"SeqStatsStore added %s: %u lines, %u new nodes\n", path, nrows, blk.nnames);
+      }
+   }
+   return((const StatsBlock *) block);
+
+nomem:
+   if ( fp != NULL ) fclose(fp);
+   free(rows);
+   return(NULL);
+}
+
+/* opens and maps the store of exp, without it the blocks are only in memory */
+static void stats_open( StatsStore *st, const char *exp ) {
+   char path[SEQ_MAXFIELD];
+   StatsHeader hdr;
+   struct stat sb;
+
+   st->fd = -1;
+   snprintf(path, sizeof path, "%s/%s", exp, SEQ_STATS_STORE);
+   if ( (st->fd = open(path, O_RDWR | O_CREAT, 0644)) >= 0 ) {
+      st->writable = 1;
+   } else if ( (st->fd = open(path, O_RDONLY)) < 0 ) {
+      SeqUtil_TRACE(TL_FULL_TRACE,"SeqStatsStore no store %s: %s\n", path, strerror(errno));
+      return;
+   }
+   if ( stats_lock(st->fd, st->writable ? F_WRLCK : F_RDLCK) != 0 || fstat(st->fd, &sb) != 0 ) goto unusable;
+
+   memset(&hdr, '\0', sizeof hdr);
+   memcpy(hdr.magic, STATS_MAGIC, sizeof hdr.magic);
+   hdr.order = 0x01020304;
+   if ( sb.st_size < sizeof hdr ) {
+      if ( ! st->writable || ftruncate(st->fd, 0) != 0 || pwrite(st->fd, &hdr, sizeof hdr, 0) != sizeof hdr ) goto unusable;
+      st->end = sizeof hdr;
+      return;
+   }
+   if ( (st->map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, st->fd, 0)) == MAP_FAILED ) {
+      st->map = NULL;
+      goto unusable;
+   }
+   st->mapSize = sb.st_size;
+   if ( memcmp(st->map, &hdr, sizeof hdr) != 0 ) {
+      SeqUtil_TRACE(TL_MEDIUM,"SeqStatsStore store %s of another version not used\n", path);
+      goto unusable;
+   }
+   st->end = sizeof hdr;
+   return;
+
+unusable:
+   if ( st->map != NULL ) munmap(st->map, st->mapSize);
+   st->map = NULL;
+   st->mapSize = 0;
+   close(st->fd);
+   st->fd = -1;
+   st->writable = 0;
+}
+
+SeqStatsWindow *SeqStatsStore_window ( const char *exp, const char *datestamp, int days ) {
+   SeqStatsWindow *window;
+   StatsStore *st;
+   const StatsBlock *blk, **latest = NULL;
+   char (*datestamps)[15] = NULL, prev[15], path[SEQ_MAXFIELD];
+   struct stat sb;
+   const uint32_t *nodes;
+   off_t off;
+   int i, d;
+   unsigned int r;
+
+   if ( days < 0 ) days = 0;
+   if ( (window = calloc(1, sizeof(SeqStatsWindow))) == NULL ) return(NULL);
+   if ( (st = calloc(1, sizeof(StatsStore))) == NULL ) {
+      free(window);
+      return(NULL);
+   }
+   window->priv = st;
+   if ( (window->days = calloc(days + 1, sizeof(SeqStatsDay))) == NULL ||
+        (datestamps = calloc(days + 1, sizeof(*datestamps))) == NULL ||
+        (latest = calloc(days + 1, sizeof(*latest))) == NULL ) goto nomem;
+
+   /* the days of the window, as logreader went back from datestamp */
+   snprintf(datestamps[0], sizeof datestamps[0], "%s", datestamp);
+   for ( d = 1; d < days; d++ ) {
+      strcpy(prev, datestamps[d - 1]);
+      snprintf(datestamps[d], sizeof datestamps[d], "%s", SeqDatesUtil_getPrintableDate(prev,-1,0,0,0));
+   }
+
+   stats_open(st, exp);
+   for ( off = st->end; st->map != NULL && (blk = stats_block(st, off)) != NULL; off += blk->length ) {
+      if ( stats_blockNames(st, blk) != 0 ) break;
+      for ( d = 0; d < days; d++ ) {
+         if ( strcmp(blk->datestamp, datestamps[d]) == 0 ) latest[d] = blk;
+      }
+      st->end = off + blk->length;
+   }
+
+   for ( d = 0; d < days; d++ ) {
+      snprintf(path, sizeof path, "%s/stats/%s", exp, datestamps[d]);
+      if ( stat(path, &sb) != 0 ) continue;
+      if ( (blk = latest[d]) != NULL ) {
+         /* names of another index than the ones of the store before it: added again */
+         nodes = (const uint32_t *) ((const char *) (blk + 1) + blk->namesSize);
+         for ( r = 0; r < blk->nrows && nodes[r] < st->count; r++ );
+         if ( blk->mtime != sb.st_mtim.tv_sec || blk->mtime_nsec != sb.st_mtim.tv_nsec || blk->size != sb.st_size || r < blk->nrows ) blk = NULL;
+      }
+      if ( blk == NULL && (blk = stats_import(st, path, datestamps[d], &sb)) == NULL ) {
+         if ( errno == ENOMEM ) goto nomem;
+         continue;
+      }
+      i = window->ndays++;
+      strcpy(window->days[i].datestamp, datestamps[d]);
+      stats_dayOfBlock(&window->days[i], blk);
+   }
+   if ( st->fd >= 0 ) stats_lock(st->fd, F_UNLCK);
+
+   window->nnodes = st->count;
+   window->node = st->node;
+   window->member = st->member;
+   free(datestamps);
+   free(latest);
+   return(window);
+
+nomem:
+   free(datestamps);
+   free(latest);
+   SeqStatsStore_free(window);
+   return(NULL);
+}
+
+void SeqStatsStore_free ( SeqStatsWindow *window ) {
+   StatsStore *st;
+   unsigned int i;
+
+   if ( window == NULL ) return;
+   if ( (st = window->priv) != NULL ) {
+      if ( st->map != NULL ) munmap(st->map, st->mapSize);
+      if ( st->fd >= 0 ) close(st->fd);
+      for ( i = 0; i < st->nowned; i++ ) free(st->owned[i]);
+      free(st->owned);
+      free(st->node);
+      free(st->member);
+      free(st->buckets);
+      free(st);
+   }
+   free(window->days);
+   free(window);
+}
@@ -0,0 +1,75 @@
+/* SeqStatsStore.h - Columnar store of the daily statistics of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SEQ_STATS_STORE_H_
+#define _SEQ_STATS_STORE_H_
+
+#include <stdint.h>
+
+/********************************************************************************
+ * DOCUMENTATION: Interface.
+ * The stats store of an experiment, $SEQ_EXP_HOME/stats/.statstore, keeps the
+ * daily stats files ($SEQ_EXP_HOME/stats/$datestamp, written by logreader -t
+ * stats) as columns: for each datestamp, the index of the node and member of
+ * every line and, per time, an array of seconds.  The nodes and members are
+ * kept once, by index, for the whole store.
+ *
+ * The store is append-only: a stats file is added the first time a window
+ * covers it, and added again when it changed since (mtime, size), the last
+ * one of a datestamp is used.  A stats file that was removed is left out of
+ * the window as before, whatever the store has.  Processes serialize on
+ * fcntl() locks of the store; without write access to the stats directory
+ * the files not in the store yet are read each time.
+ *
+ * The image is native endian and versioned, a store of another version or
+ * byte order is not used.
+********************************************************************************/
+
+#define SEQ_STATS_STORE     "stats/.statstore"
+
+/* the times of a stats line, in the order of the line */
+enum { SEQ_STATS_SUBMIT, SEQ_STATS_BEGIN, SEQ_STATS_END, SEQ_STATS_EXECTIME,
+       SEQ_STATS_SUBMITDELAY, SEQ_STATS_DELTAFROMSTART, SEQ_STATS_NTIMES };
+
+typedef struct _SeqStatsDay {
+   char            datestamp[15];
+   unsigned int    nrows;
+   const uint32_t *node;                        /* node index of each line */
+   const int32_t  *times[SEQ_STATS_NTIMES];     /* seconds, time of day for timestamps */
+} SeqStatsDay;
+
+typedef struct _SeqStatsWindow {
+   int             ndays;        /* days with a stats file, the most recent first */
+   SeqStatsDay    *days;
+   unsigned int    nnodes;
+   const char    **node;         /* node path ("/suite/...") and member of an index */
+   const char    **member;
+   void           *priv;
+} SeqStatsWindow;
+
+/********************************************************************************
+ * The stats of the days datestamp, datestamp - 1 day, ... (days of them)
+ * that have a stats file, from the store or from the files.
+ * Returns NULL if out of memory.  Free it with SeqStatsStore_free().
+********************************************************************************/
+SeqStatsWindow *SeqStatsStore_window ( const char *exp, const char *datestamp, int days );
+void SeqStatsStore_free ( SeqStatsWindow *window );
+
+#endif
@@ -0,0 +1,223 @@
+/* SeqStatusSnapshot.c - Snapshot of the status directories of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include "SeqUtil.h"
+#include "SeqStatusSnapshot.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Inner workings.
+ * A snapshot is an array of (node.ext, states) sorted by name, an entry per
+ * node.ext whatever the number of its status files, the names being kept
+ * end to end in a single buffer: an exact name is found by
+ * bisection, the names with a prefix are the run that starts at the lower
+ * bound of the prefix.  The snapshots of a process are a list by directory;
+ * a directory that does not exist has an empty snapshot, as the globs found
+ * nothing there.
+********************************************************************************/
+
+/* the states, in the order of their bit */
+static const char *SnapshotStates[] = { "begin", "end", "submit", "waiting", "abort.stop", "abort.cont", "abort.rerun" };
+#define SNAPSHOT_NSTATES ( sizeof(SnapshotStates) / sizeof(SnapshotStates[0]) )
+
+typedef struct {
+   char *name;       /* node.ext */
+   int   states;
+} SnapshotEntry;
+
+typedef struct _Snapshot {
+   char              *dir;
+   int                count;
+   SnapshotEntry     *entries;
+   char              *names;
+   struct _Snapshot  *next;
+} Snapshot;
+
+static Snapshot *Snapshots = NULL;
+
+int SeqStatusSnapshot_state( const char *state ) {
+   unsigned int i;
+
+   for ( i = 0; i < SNAPSHOT_NSTATES; i++ ) {
+      if ( strcmp(state, SnapshotStates[i]) == 0 ) return(1 << i);
+   }
+   return(0);
+}
+
+/* the state of a status file name, its node.ext being the first *len characters; 0 if not a state */
+static int snapshot_parse( const char *file, size_t *len ) {
+   size_t flen = strlen(file), slen;
+   unsigned int i;
+
+   for ( i = 0; i < SNAPSHOT_NSTATES; i++ ) {
+      slen = strlen(SnapshotStates[i]);
+      if ( flen > slen + 1 && file[flen - slen - 1] == '.' && strcmp(file + flen - slen, SnapshotStates[i]) == 0 ) {
+         *len = flen - slen - 1;
+         return(1 << i);
+      }
+   }
+   return(0);
+}
+
+static int snapshot_compare( const void *a, const void *b ) {
+   return(strcmp(((const SnapshotEntry *) a)->name, ((const SnapshotEntry *) b)->name));
+}
+
+static void snapshot_free( Snapshot *snapshot ) {
+   free(snapshot->entries);
+   free(snapshot->names);
+   free(snapshot->dir);
+   free(snapshot);
+}
+
+/* reads dir, NULL if it cannot be read */
+static Snapshot *snapshot_read( const char *dir, size_t dirlen ) {
+   Snapshot *snapshot = NULL;
+   SnapshotEntry *entries = NULL;
+   struct dirent *dp;
+   DIR *dirp;
+   char *names = NULL;
+   size_t len, size = 0, used = 0;
+   int capacity = 0, count = 0, i, states;
+
+   if ( (snapshot = calloc(1, sizeof(Snapshot))) == NULL || (snapshot->dir = strndup(dir, dirlen)) == NULL ) {
+      raiseError("SeqStatusSnapshot malloc: Out of memory!\n");
+   }
+   if ( (dirp = opendir(snapshot->dir)) == NULL ) {
+      if ( errno == ENOENT ) return(snapshot);
+      SeqUtil_TRACE(TL_ERROR, "SeqStatusSnapshot: cannot read %s\n", snapshot->dir);
+      snapshot_free(snapshot);
+      return(NULL);
+   }
+   while ( (dp = readdir(dirp)) != NULL ) {
+      if ( (states = snapshot_parse(dp->d_name, &len)) == 0 ) continue;
+      if ( count == capacity ) {
+         capacity = capacity ? 2 * capacity : 256;
+         if ( (entries = realloc(entries, capacity * sizeof(SnapshotEntry))) == NULL ) {
+            raiseError("SeqStatusSnapshot malloc: Out of memory!\n");
+         }
+      }
+      if ( used + len + 1 > size ) {
+         size = size ? 2 * size : 16384;
+         if ( size < used + len + 1 ) size = used + len + 1;
+         if ( (names = realloc(names, size)) == NULL ) raiseError("SeqStatusSnapshot malloc: Out of memory!\n");
+      }
+      memcpy(names + used, dp->d_name, len);
+      names[used + len] = '\0';
+      /* an offset until the buffer stops moving */
+      entries[count].name = (char *) used;
+      entries[count++].states = states;
+      used += len + 1;
+   }
+   closedir(dirp);
+   for ( i = 0; i < count; i++ ) entries[i].name = names + (size_t) entries[i].name;
+
+   /* an entry per node.ext */
+   if ( count > 0 ) {
+      qsort(entries, count, sizeof(SnapshotEntry), snapshot_compare);
+      for ( i = 1, snapshot->count = 1; i < count; i++ ) {
+         if ( strcmp(entries[i].name, entries[snapshot->count - 1].name) == 0 ) {
+            entries[snapshot->count - 1].states |= entries[i].states;
+         } else {
+            entries[snapshot->count++] = entries[i];
+         }
+      }
+   }
+   snapshot->entries = entries;
+   snapshot->names = names;
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqStatusSnapshot: %s status files:%d nodes:%d\n", snapshot->dir, count, snapshot->count);
+   return(snapshot);
+}
+
+/* the snapshot of the directory of path, *name set to the name of path in it; NULL if it cannot be read */
+static Snapshot *snapshot_get( const char *path, const char **name ) {
+   const char *slash = strrchr(path, '/');
+   Snapshot *snapshot;
+   size_t dirlen;
+
+   if ( slash == NULL ) return(NULL);
+   dirlen = slash - path;
+   *name = slash + 1;
+   for ( snapshot = Snapshots; snapshot != NULL; snapshot = snapshot->next ) {
+      if ( strlen(snapshot->dir) == dirlen && strncmp(snapshot->dir, path, dirlen) == 0 ) return(snapshot);
+   }
+   if ( (snapshot = snapshot_read(path, dirlen)) != NULL ) {
+      snapshot->next = Snapshots;
+      Snapshots = snapshot;
+   }
+   return(snapshot);
+}
+
+/* the first entry whose name is not before name (count if none) */
+static int snapshot_lowerBound( const Snapshot *snapshot, const char *name, size_t len ) {
+   int low = 0, high = snapshot->count, mid;
+
+   while ( low < high ) {
+      mid = (low + high) / 2;
+      if ( strncmp(snapshot->entries[mid].name, name, len) < 0 ) low = mid + 1; else high = mid;
+   }
+   return(low);
+}
+
+int SeqStatusSnapshot_exists( const char *path ) {
+   const char *file = NULL;
+   Snapshot *snapshot;
+   size_t len = 0;
+   int state, i;
+
+   if ( (file = strrchr(path, '/')) == NULL || (state = snapshot_parse(file + 1, &len)) == 0 ) return(-1);
+   if ( (snapshot = snapshot_get(path, &file)) == NULL ) return(-1);
+
+   i = snapshot_lowerBound(snapshot, file, len);
+   if ( i < snapshot->count && strlen(snapshot->entries[i].name) == len && strncmp(snapshot->entries[i].name, file, len) == 0 ) {
+      return((snapshot->entries[i].states & state) != 0);
+   }
+   return(0);
+}
+
+int SeqStatusSnapshot_count( const char *prefix, int states ) {
+   const char *name = NULL;
+   Snapshot *snapshot;
+   size_t len;
+   int i, count = 0;
+
+   if ( (snapshot = snapshot_get(prefix, &name)) == NULL ) return(-1);
+   len = strlen(name);
+   for ( i = snapshot_lowerBound(snapshot, name, len);
+         i < snapshot->count && strncmp(snapshot->entries[i].name, name, len) == 0; i++ ) {
+      if ( snapshot->entries[i].states & states ) count++;
+   }
+   SeqUtil_TRACE(TL_FULL_TRACE, "SeqStatusSnapshot_count() %s states:%d count:%d\n", prefix, states, count);
+   return(count);
+}
+
+void SeqStatusSnapshot_invalidate( void ) {
+   Snapshot *next;
+
+   while ( Snapshots != NULL ) {
+      next = Snapshots->next;
+      snapshot_free(Snapshots);
+      Snapshots = next;
+   }
+}
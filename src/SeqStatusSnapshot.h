@@ -0,0 +1,69 @@
+/* SeqStatusSnapshot.h - Snapshot of the status directories of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SEQ_STATUS_SNAPSHOT_H_
+#define _SEQ_STATUS_SNAPSHOT_H_
+
+/********************************************************************************
+ * DOCUMENTATION: Interface.
+ * A status snapshot is the list of the status files of a directory
+ * (sequencing/status/$datestamp/$container), read with a single readdir() the
+ * first time the directory is queried and kept by the process: every entry
+ * node.ext.state is classified by node.ext and state, and the questions of the
+ * completeness checks (does this status file exist, how many iterations of
+ * this node are in one of these states) are answered from it.
+ *
+ * A snapshot is as old as its readdir(): the process drops all of them with
+ * SeqStatusSnapshot_invalidate() whenever it changes a state.  Only the states
+ * below are in a snapshot, the other files go to the file system.
+********************************************************************************/
+
+/* the states of a snapshot, a bit each */
+#define SEQ_SNAP_BEGIN      0x01
+#define SEQ_SNAP_END        0x02
+#define SEQ_SNAP_SUBMIT     0x04
+#define SEQ_SNAP_WAITING    0x08
+#define SEQ_SNAP_ABORTSTOP  0x10
+#define SEQ_SNAP_ABORTCONT  0x20
+#define SEQ_SNAP_ABORTRERUN 0x40
+
+/* the bit of a state (begin, end, abort.stop, ...), 0 if not in a snapshot */
+int SeqStatusSnapshot_state( const char *state );
+
+/********************************************************************************
+ * Whether the status file at path exists, from the snapshot of its directory.
+ * Returns 1 or 0, -1 if path is not the file of a state of a snapshot or the
+ * directory cannot be read: ask the file system.
+********************************************************************************/
+int SeqStatusSnapshot_exists( const char *path );
+
+/********************************************************************************
+ * The number of node.ext of the directory of prefix (a path, the name of the
+ * status files after the last '/') whose name starts like prefix and that are
+ * in one of states (SEQ_SNAP_* bits).  prefix "dir/task.+1+" counts the
+ * iterations of the npass task in the loop iteration +1.
+ * Returns -1 if the directory cannot be read.
+********************************************************************************/
+int SeqStatusSnapshot_count( const char *prefix, int states );
+
+/* drops the snapshots, the next queries read the directories again */
+void SeqStatusSnapshot_invalidate( void );
+
+#endif
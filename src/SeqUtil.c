@@ -34,6 +34,7 @@
 #include <glob.h>
 #include <utime.h> 
 #include <errno.h>        /* errno */
+#include <ctype.h>
 #include "SeqUtil.h"
 #include <time.h>  /*nsleep*/
 #include "SeqNameValues.h"
@@ -49,13 +50,26 @@ int SEQ_TRACE = 0;
 
 void raiseError(const char* fmt, ... );
 
-#define SEQ_MAXFILES 100
+/* buckets of the table of mapped files, chained, any number of files */
+#define SEQ_FILEBUCKETS 64
 
+/* one key = value line of a mapped definition file, pointing into the mapping */
+struct defEntry{
+  const char* key;
+  const char* value;
+  int keylen;
+  int valuelen;
+  struct defEntry* next;   /* next entry of the same bucket */
+};
 
 struct mappedFile{
   char* filename;  
   char* filestart; /* First char of file */
   char* fileend;   /* One byte past the end of file (so that end - start = size)*/
+  struct defEntry* entries;   /* definitions of the file, see SeqUtil_indexdefs() */
+  struct defEntry** buckets;
+  unsigned int nbuckets;
+  struct mappedFile* next;    /* next file of the same bucket */
 };
 
 struct TraceFlags{
@@ -65,9 +79,12 @@ struct TraceFlags{
 };
 static struct TraceFlags traceFlags = { TL_CRITICAL, TF_OFF, TF_OFF};
 
-/* Maybe have def files and cfg files to speedup the lookup process */
-static struct mappedFile mappedFiles[SEQ_MAXFILES];
-static int nbMappedFiles = 0;
+/* mapped definition files, found by a hash of their path; each thread maps its own */
+static __thread struct mappedFile* mappedFiles[SEQ_FILEBUCKETS];
+
+/* see SeqUtil_setFileHook() and SeqUtil_setDefHook(), hooks per thread */
+static __thread void (*fileHook)( const char *filename ) = NULL;
+static __thread void (*defHook)( const char *filename, const char *key ) = NULL;
 
 /********************************************************************************
  * Copies src into dst with padding char up to the specified length.  Caller
@@ -309,6 +326,131 @@ int removeFile_nfs(const char *filename, const char * _seq_exp_home) {
    return(status);
 }
 
+/********************************************************************************
+*removeFiles_nfs: Removes the named files; status[i] is zero if filenames[i] was
+* removed and a nonzero value if it was not
+********************************************************************************/
+int removeFiles_nfs(const char **filenames, int count, int *status, const char * _seq_exp_home) {
+   int i;
+
+   for ( i = 0; i < count; i++ ) status[i] = removeFile_nfs(filenames[i], _seq_exp_home);
+   return(0);
+}
+
+
+/* value of key=value in a space separated request, returns 0 if the key is there */
+static int SeqUtil_requestField( const char *request, const char *key, char *value, size_t size ) {
+   const char *p = request;
+   size_t klen = strlen(key), vlen;
+
+   while ( (p = strstr(p, key)) != NULL ) {
+      if ( (p == request || p[-1] == ' ') && p[klen] == '=' ) {
+         p += klen + 1;
+         if ( (vlen = strcspn(p, " ")) >= size ) return(1);
+         memcpy(value, p, vlen);
+         value[vlen] = '\0';
+         return(0);
+      }
+      p += klen;
+   }
+   return(1);
+}
+
+/********************************************************************************
+*SeqUtil_stateFiles: status files of a node changing state, from a set state
+* request "exp=%s datestamp=%s node=%s ext=%s state=%s [npass=%s]" (see
+* SVR_SET_STATE). state is begin, end, submit, waiting, abort.<action> or init;
+* npass is the extension of the npass task end file cleared by its iterations.
+* stale[] receives the files to remove, newfile the one to create ('\0' for init).
+* Returns zero if succeeds and a nonzero value for a malformed request or a
+* status file path longer than SEQ_MAXFIELD
+********************************************************************************/
+int SeqUtil_stateFiles( const char *request, char stale[][SEQ_MAXFIELD], int *count, char *newfile ) {
+   static const char *states[] = { "begin", "end", "abort.stop", "submit", "waiting" };
+   char exp[SEQ_MAXFIELD], datestamp[64], node[SEQ_MAXFIELD], ext[SEQ_MAXFIELD], state[64], npass[SEQ_MAXFIELD];
+   char base[SEQ_MAXFIELD];
+   int i, n = 0;
+
+   *count = 0;
+   newfile[0] = '\0';
+   if ( SeqUtil_requestField(request, "exp", exp, sizeof exp) != 0 ||
+        SeqUtil_requestField(request, "datestamp", datestamp, sizeof datestamp) != 0 ||
+        SeqUtil_requestField(request, "node", node, sizeof node) != 0 ||
+        SeqUtil_requestField(request, "ext", ext, sizeof ext) != 0 ||
+        SeqUtil_requestField(request, "state", state, sizeof state) != 0 ) return(1);
+   if ( strchr(state, '/') != NULL ) return(1);
+   if ( strcmp(state, "init") != 0 && strncmp(state, "abort.", 6) != 0 ) {
+      for ( i = 0; i < sizeof(states) / sizeof(states[0]) && strcmp(state, states[i]) != 0; i++ );
+      if ( i == sizeof(states) / sizeof(states[0]) ) return(1);
+   }
+
+   if ( ext[0] != '\0' ) {
+      if ( snprintf(base, sizeof base, "%s/sequencing/status/%s/%s.%s", exp, datestamp, node, ext) >= sizeof base ) return(1);
+   } else {
+      if ( snprintf(base, sizeof base, "%s/sequencing/status/%s/%s", exp, datestamp, node) >= sizeof base ) return(1);
+   }
+
+   /* all the state files but the current one */
+   for ( i = 0; i < sizeof(states) / sizeof(states[0]); i++ ) {
+      if ( strcmp(state, states[i]) != 0 &&
+           snprintf(stale[n++], SEQ_MAXFIELD, "%s.%s", base, states[i]) >= SEQ_MAXFIELD ) return(1);
+   }
+
+   /* NPASS(i) will delete NPASS.end in all states */
+   if ( strcmp(state, "end") != 0 && SeqUtil_requestField(request, "npass", npass, sizeof npass) == 0 ) {
+      if ( snprintf(stale[n++], SEQ_MAXFIELD, "%s/sequencing/status/%s/%s%s.end", exp, datestamp, node, npass) >= SEQ_MAXFIELD ) return(1);
+   }
+
+   /* delete abort intermediate states only in abort or end, an init keeps them */
+   if ( strcmp(state, "end") == 0 || strcmp(state, "abort.stop") == 0 ) {
+      if ( snprintf(stale[n++], SEQ_MAXFIELD, "%s.abort.rerun", base) >= SEQ_MAXFIELD ||
+           snprintf(stale[n++], SEQ_MAXFIELD, "%s.abort.cont", base) >= SEQ_MAXFIELD ) return(1);
+   }
+
+   if ( strcmp(state, "init") != 0 &&
+        snprintf(newfile, SEQ_MAXFIELD, "%s.%s", base, state) >= SEQ_MAXFIELD ) {
+      newfile[0] = '\0';
+      return(1);
+   }
+   *count = n;
+   return(0);
+}
+
+/********************************************************************************
+*SeqUtil_stateRemoved: add the name of a removed status file to the space
+* separated list answered by a set state request
+********************************************************************************/
+void SeqUtil_stateRemoved( char *removed, size_t size, const char *filename ) {
+   const char *leaf = strrchr(filename, '/');
+   size_t len;
+
+   if ( removed == NULL || size == 0 ) return;
+   leaf = leaf != NULL ? leaf + 1 : filename;
+   len = strlen(removed);
+   snprintf(removed + len, size - len, "%s%s", len > 0 ? " " : "", leaf);
+}
+
+/********************************************************************************
+*setNodeState_nfs: puts a node in a new state, see SeqUtil_stateFiles. The names
+* of the status files removed are returned in removed. It returns zero if
+* succeeds and a nonzero value if it does not
+********************************************************************************/
+int setNodeState_nfs( const char *request, char *removed, size_t size, const char * _seq_exp_home ) {
+   char stale[SEQ_STATE_FILES][SEQ_MAXFIELD], newfile[SEQ_MAXFIELD];
+   int i, count;
+
+   if ( removed != NULL && size > 0 ) removed[0] = '\0';
+   if ( SeqUtil_stateFiles(request, stale, &count, newfile) != 0 ) {
+      fprintf(stderr,"Error: maestro malformed set state request:%s\n",request);
+      return(1);
+   }
+   for ( i = 0; i < count; i++ ) {
+      if ( removeFile_nfs(stale[i], _seq_exp_home) == 0 ) SeqUtil_stateRemoved(removed, size, stale[i]);
+   }
+   /* create the state file only if not exists */
+   if ( newfile[0] != '\0' && access_nfs(newfile, R_OK, _seq_exp_home) != 0 ) return(touch_nfs(newfile, _seq_exp_home));
+   return(0);
+}
 
 /********************************************************************************
 *access_nfs: access the named file 'filename'; it returns zero if succeeds 
@@ -478,16 +620,16 @@ LISTNODEPTR globExtList_nfs (const char *pattern, int flags, int (*errfunc) (con
 
 
 char *SeqUtil_getPathLeaf (const char *full_path) {
-  char *split,*work_string,*chreturn =NULL; 
+  char *split,*work_string,*chreturn =NULL,*saveptr =NULL; 
   work_string = strdup(full_path);
-  split = strtok (work_string,"/");
+  split = strtok_r (work_string,"/",&saveptr);
   while (split != NULL) {
     if ( chreturn != NULL ) {
       /* free previous allocated memory */
       free( chreturn );
     }
     chreturn = strdup (split);
-    split = strtok (NULL,"/");
+    split = strtok_r (NULL,"/",&saveptr);
   }
   free( work_string );
   return chreturn;
@@ -512,12 +654,12 @@ char *SeqUtil_getPathBase (const char *full_path) {
   */
 int SeqUtil_mkdir_nfs( const char* dir_name, int is_recursive, const char * _seq_exp_home ) {
    char tmp[1000];
-   char *split = NULL, *work_string = NULL; 
+   char *split = NULL, *work_string = NULL, *saveptr = NULL; 
    SeqUtil_TRACE(TL_FULL_TRACE, "SeqUtil_mkdir: dir_name %s recursive? %d \n", dir_name, is_recursive );
    if ( is_recursive == 1) {
       work_string = strdup( dir_name );
       strcpy( tmp, "/" );
-      split  = strtok( work_string, "/" );
+      split  = strtok_r( work_string, "/", &saveptr );
       if( split != NULL ) {
          strcat( tmp, split );
       }
@@ -531,7 +673,7 @@ int SeqUtil_mkdir_nfs( const char* dir_name, int is_recursive, const char * _seq
             }
          }
 
-         split = strtok (NULL,"/");
+         split = strtok_r (NULL,"/",&saveptr);
          if( split != NULL ) {
             strcat( tmp, split );
          }
@@ -651,15 +793,15 @@ char *SeqUtil_resub (const char *regex_text, const char *repl_text, const char *
 int SeqUtil_tokenCount( const char* source, const char* tokenSeparator )
 {
    int count = 0;
-   char *tmpSource = NULL, *tmpstrtok = NULL; 
+   char *tmpSource = NULL, *tmpstrtok = NULL, *saveptr = NULL; 
 
    tmpSource = (char*) malloc( strlen( source ) + 1 );
    strcpy( tmpSource, source );
-   tmpstrtok = (char*) strtok( tmpSource, tokenSeparator );
+   tmpstrtok = (char*) strtok_r( tmpSource, tokenSeparator, &saveptr );
 
    while ( tmpstrtok != NULL ) {
         count++;
-        tmpstrtok = (char*) strtok(NULL, tokenSeparator);
+        tmpstrtok = (char*) strtok_r(NULL, tokenSeparator, &saveptr);
    }
 
    free(tmpSource);
@@ -710,75 +852,155 @@ void SeqUtil_waitForFile (char* filename, int secondsLimit, int timeInterval) {
    }
 } 
 
+/* path of overrides.def and default_resources.def of the owner of the last
+   experiment seen by SeqUtil_getdef(), saves a stat and a getpwuid per lookup */
+static __thread char *defExpHome = NULL, *defOvPath = NULL, *defDefPath = NULL;
+
 char* SeqUtil_getdef( const char* filename, const char* key , const char* _seq_exp_home) {
-  char *retval=NULL,*home=NULL,*ovpath=NULL,*ovext="/.suites/overrides.def", *defpath=NULL, *defext="/.suites/default_resources.def";
-  struct passwd *passwdEnt;
+  char *retval=NULL,*home=NULL,*ovext="/.suites/overrides.def", *defext="/.suites/default_resources.def";
+  char pwbuf[4096];
+  struct passwd pwent, *passwdEnt = NULL;
   struct stat fileStat;
 
-  /* Use ownership of the suite to determine path to overrides.def */
-  if (stat(_seq_exp_home,&fileStat) < 0){
-     raiseError("SeqUtil_getdef unable to stat SEQ_EXP_HOME\n");
-  }
+  if ( defHook != NULL && filename != NULL && key != NULL ) defHook( filename, key );
+  if ( defExpHome == NULL || _seq_exp_home == NULL || strcmp( defExpHome, _seq_exp_home ) != 0 ) {
+     /* Use ownership of the suite to determine path to overrides.def */
+     if (_seq_exp_home == NULL || stat(_seq_exp_home,&fileStat) < 0){
+        raiseError("SeqUtil_getdef unable to stat SEQ_EXP_HOME\n");
+     }
 
-  passwdEnt = getpwuid(fileStat.st_uid);
-  home = passwdEnt->pw_dir;
-  ovpath = (char *) malloc( strlen(home) + strlen(ovext) + 1 );
-  defpath = (char *) malloc( strlen(home) + strlen(defext) + 1 );
-  sprintf( ovpath, "%s%s", home, ovext );
-  sprintf( defpath, "%s%s", home, defext );
-  SeqUtil_TRACE(TL_FULL_TRACE,"SeqUtil_getdef(): looking for definition of %s in %s\n",key,ovpath);
-  if ( (retval = SeqUtil_parsedef(ovpath,key)) == NULL ){
+     if ( getpwuid_r(fileStat.st_uid, &pwent, pwbuf, sizeof(pwbuf), &passwdEnt) != 0 || passwdEnt == NULL ){
+        raiseError("SeqUtil_getdef unable to find the owner of SEQ_EXP_HOME\n");
+     }
+     home = passwdEnt->pw_dir;
+     free(defExpHome);
+     free(defOvPath);
+     free(defDefPath);
+     defExpHome = strdup( _seq_exp_home );
+     defOvPath = (char *) malloc( strlen(home) + strlen(ovext) + 1 );
+     defDefPath = (char *) malloc( strlen(home) + strlen(defext) + 1 );
+     sprintf( defOvPath, "%s%s", home, ovext );
+     sprintf( defDefPath, "%s%s", home, defext );
+  }
+  SeqUtil_TRACE(TL_FULL_TRACE,"SeqUtil_getdef(): looking for definition of %s in %s\n",key,defOvPath);
+  if ( (retval = SeqUtil_parsedef(defOvPath,key)) == NULL ){
     SeqUtil_TRACE(TL_FULL_TRACE,"SeqUtil_getdef(): looking for definition of %s in %s\n",key,filename);
     if ( (retval = SeqUtil_parsedef(filename,key)) == NULL ){
-       SeqUtil_TRACE(TL_FULL_TRACE,"SeqUtil_getdef(): looking for definition of %s in %s\n",key,defpath);
-       retval = SeqUtil_parsedef(defpath,key);
+       SeqUtil_TRACE(TL_FULL_TRACE,"SeqUtil_getdef(): looking for definition of %s in %s\n",key,defDefPath);
+       retval = SeqUtil_parsedef(defDefPath,key);
     }
   } 
-  free(defpath);
-  free(ovpath);
   return retval;
 }
 
+/* FNV-1a hash of the len first chars of str */
+static unsigned int SeqUtil_hash( const char *str, int len ) {
+  unsigned int h = 2166136261u;
+  int i;
+  for ( i = 0; i < len; i++ ) {
+    h ^= (unsigned char) str[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/* definition of key in a mapped file, NULL if it has none */
+static struct defEntry* SeqUtil_finddef( const struct mappedFile *mf, const char *key, int keylen ) {
+  struct defEntry *def;
+  if ( mf->nbuckets == 0 ) return NULL;
+  for ( def = mf->buckets[SeqUtil_hash(key,keylen) & (mf->nbuckets - 1)]; def != NULL; def = def->next ) {
+    if ( def->keylen == keylen && memcmp( def->key, key, keylen ) == 0 ) return def;
+  }
+  return NULL;
+}
+
+/********************************************************************************
+ * Builds the hash index of the definitions of a mapped file, once when it is
+ * mapped.  The lines are read as SeqUtil_parsedef() always did: a line with a
+ * '#' is a comment, otherwise " key = value" where the key ends at '=', a
+ * blank or a tab and the value at a blank or a tab.  The first definition of
+ * a key in the file is the one kept.
+********************************************************************************/
+static void SeqUtil_indexdefs( struct mappedFile *mf ) {
+  const char *line, *end, *p, *key, *value;
+  int keylen, valuelen, nlines = 1, nentries = 0;
+  unsigned int bucket;
+  struct defEntry *def;
+
+  for ( p = mf->filestart; p < mf->fileend; p++ ) {
+    if ( *p == '\n' || *p == '\0' ) nlines++;
+  }
+  for ( mf->nbuckets = 16; mf->nbuckets < 2 * nlines; mf->nbuckets *= 2 );
+  if ( ! (mf->entries = malloc( nlines * sizeof(struct defEntry) )) ||
+       ! (mf->buckets = calloc( mf->nbuckets, sizeof(struct defEntry *) )) ) {
+    raiseError("SeqUtil_indexdefs malloc: Out of memory!\n");
+  }
+
+  for ( line = mf->filestart; line < mf->fileend; line = end + 1 ) {
+    for ( end = line; end < mf->fileend && *end != '\n' && *end != '\0'; end++ );
+    if ( end - line >= SEQ_MAXFIELD ) {
+      raiseError("readline(): Buffer is too small to receive line from source\n");
+    }
+    /* If the string is a comment skip to next */
+    if ( memchr( line, '#', end - line ) != NULL ) continue;
+
+    for ( p = line; p < end && isspace((unsigned char)*p); p++ );
+    for ( key = p; p < end && *p != '=' && *p != ' ' && *p != '\t'; p++ );
+    keylen = p - key;
+    for ( ; p < end && isspace((unsigned char)*p); p++ );
+    if ( keylen == 0 || p == end || *p != '=' ) continue;
+    for ( p++; p < end && isspace((unsigned char)*p); p++ );
+    for ( value = p; p < end && *p != ' ' && *p != '\t'; p++ );
+    valuelen = p - value;
+    if ( valuelen == 0 || SeqUtil_finddef( mf, key, keylen ) != NULL ) continue;
+
+    def = &mf->entries[nentries++];
+    def->key = key;
+    def->keylen = keylen;
+    def->value = value;
+    def->valuelen = valuelen;
+    bucket = SeqUtil_hash(key,keylen) & (mf->nbuckets - 1);
+    def->next = mf->buckets[bucket];
+    mf->buckets[bucket] = def;
+  }
+  SeqUtil_TRACE( TL_FULL_TRACE, "SeqUtil_indexdefs(): %d definitions in %s\n", nentries, mf->filename);
+}
+
 /********************************************************************************
  * Function that manages memory mapped files.  We verify if the file is already 
- * in memory.  
- * If it is not, the file is opened and mapped into memory.
- * In either case, a pointer is returned to where the file resides in memory.
- * NOTE: The variable may need to be changed from static to global 
- * to allow another function to do cleanup.  That or have an extra parameter so
- * that will tell the function to do unmap on all the files.
+ * in memory, the mapped files are found by a hash of their name.
+ * If it is not, the file is opened, mapped into memory and its definitions
+ * are indexed.  The index is kept until SeqUtil_unmapfiles(), a change to the
+ * file after it was mapped is not seen by the process.
+ * Returns NULL if the file cannot be mapped.
 ********************************************************************************/
-int SeqUtil_getmappedfile(const char *filename, char ** filestart , char** fileend){
-  extern struct mappedFile mappedFiles[SEQ_MAXFILES];
-  extern int nbMappedFiles;
+static struct mappedFile* SeqUtil_findmappedfile( const char *filename ) {
+  unsigned int bucket = SeqUtil_hash(filename,strlen(filename)) & (SEQ_FILEBUCKETS - 1);
+  struct mappedFile *mf;
 
   /* Find the file if it is mapped */
-  int i;
-  for(i = 0; i < nbMappedFiles; ++i) {
-    /* If the file is found, return pointer to where it is mapped and filesize */
-    if(strcmp(mappedFiles[i].filename, filename) == 0) {
+  for ( mf = mappedFiles[bucket]; mf != NULL; mf = mf->next ) {
+    if(strcmp(mf->filename, filename) == 0) {
       SeqUtil_TRACE( TL_FULL_TRACE, "getmappedfile(): File %s was found in mmapped files\n",filename);
-      *filestart = mappedFiles[i].filestart;
-      *fileend = mappedFiles[i].fileend;
-      return 0;
+      return mf;
     }
   }
 
-  /* if it is not found, open it, map it, close it,add it to the list and return
-   * the pointers. */
+  /* if it is not found, open it, map it, close it, index it and add it to the table */
 
   /* Open the file  */
   int fd = open(filename,O_RDONLY|O_NONBLOCK);
   if(fd == -1){
     SeqUtil_TRACE( TL_FULL_TRACE, "SeqUtil_getmappedfile(): Could not open file %s for definition lookup \n", filename);
-    return 1;
+    return NULL;
   }
 
   /* Get the size of the file */
   struct stat fileStat;
   if(fstat(fd,&fileStat) == -1){
     SeqUtil_TRACE(TL_ERROR,"SeqUtil_getmappedfile(): Error getting stats for file %s \n", filename);
-    return 1;
+    close(fd);
+    return NULL;
   }
 
   /* Map the file and close it */
@@ -786,37 +1008,53 @@ int SeqUtil_getmappedfile(const char *filename, char ** filestart , char** filee
   close(fd);
   if(addr == MAP_FAILED){
     SeqUtil_TRACE(TL_ERROR,"SeqUtil_getmappedfile(): Error mapping file %s into memory \n", filename);
-    return 1;
+    return NULL;
   }
   SeqUtil_TRACE( TL_FULL_TRACE,"getmappedfile(): Mapped file %s into memory using file descriptor %d \n", filename, fd);
 
-  /* Add it to the list */
-  /* Filename */
-  mappedFiles[nbMappedFiles].filename = (char*)malloc(strlen(filename) + 1);
-  strcpy(mappedFiles[nbMappedFiles].filename, filename);
-  /* Address */
-  *filestart = mappedFiles[nbMappedFiles].filestart = addr; 
-  /* Filesize */
-  *fileend = mappedFiles[nbMappedFiles].fileend = addr + fileStat.st_size;
-  ++nbMappedFiles;
+  /* Add it to the table */
+  if ( ! (mf = calloc( 1, sizeof(struct mappedFile) )) || ! (mf->filename = strdup(filename)) ) {
+    raiseError("SeqUtil_getmappedfile malloc: Out of memory!\n");
+  }
+  mf->filestart = addr; 
+  mf->fileend = addr + fileStat.st_size;
+  SeqUtil_indexdefs( mf );
+  mf->next = mappedFiles[bucket];
+  mappedFiles[bucket] = mf;
+
+  return mf;
+}
 
+/********************************************************************************
+ * Returns in filestart and fileend where the file resides in memory, mapping
+ * it if needed.  Returns 1 if the file cannot be mapped.
+********************************************************************************/
+int SeqUtil_getmappedfile(const char *filename, char ** filestart , char** fileend){
+  struct mappedFile *mf = SeqUtil_findmappedfile( filename );
+  if ( mf == NULL ) return 1;
+  *filestart = mf->filestart;
+  *fileend = mf->fileend;
   return 0 ;
 }
 
 /********************************************************************************
  * Function for cleanup on program end: Unmaps all the files that were mapped
- * into memory. 
+ * into memory by the calling thread (at the end of a worker thread too).
 ********************************************************************************/
-void SeqUtil_unmapfiles()
+void SeqUtil_unmapfiles( void )
 {
-  extern struct mappedFile mappedFiles[SEQ_MAXFILES];
-  extern int nbMappedFiles;
-  int filesize;
-
-  while(nbMappedFiles-- > 0)
-  {
-    filesize = mappedFiles[nbMappedFiles].fileend - mappedFiles[nbMappedFiles].filestart;
-    munmap(mappedFiles[nbMappedFiles].filestart, filesize);
+  struct mappedFile *mf;
+  int i;
+
+  for ( i = 0; i < SEQ_FILEBUCKETS; i++ ) {
+    while ( (mf = mappedFiles[i]) != NULL ) {
+      mappedFiles[i] = mf->next;
+      munmap(mf->filestart, mf->fileend - mf->filestart);
+      free(mf->entries);
+      free(mf->buckets);
+      free(mf->filename);
+      free(mf);
+    }
   }
 }
 
@@ -839,55 +1077,57 @@ int readline(char *line, int size, char* source)
   return i;
 }
 
+/********************************************************************************
+ * While a hook is set, it is called with the name of every definition file and
+ * xml file read to build a node, whether the file exists or not (see
+ * ExpSnapshot.c).  A NULL hook turns it off.  The hook is the calling thread's.
+********************************************************************************/
+void SeqUtil_setFileHook( void (*hook)( const char *filename ) ) {
+  fileHook = hook;
+}
+
+void SeqUtil_noteFile( const char *filename ) {
+  if ( fileHook != NULL && filename != NULL ) fileHook( filename );
+}
+
+/********************************************************************************
+ * While a hook is set, it is called with the file and the key of every lookup
+ * of SeqUtil_getdef(), defined or not (see TsvManifest.c).  A NULL hook turns
+ * it off.  The hook is the calling thread's.
+********************************************************************************/
+void SeqUtil_setDefHook( void (*hook)( const char *filename, const char *key ) ) {
+  defHook = hook;
+}
+
 /********************************************************************************
  * parser for .def simple text definition files (free return pointer in caller)
+ * The definitions are looked up in the index built when the file was mapped.
  * Returns NULL if definition was not found 
 ********************************************************************************/
 char* SeqUtil_parsedef( const char* filename, const char* key ) {
   char *retval=NULL;
-  char line[SEQ_MAXFIELD],defkey[SEQ_MAXFIELD],defval[SEQ_MAXFIELD];
-  char *filestart;
-  char *fileend;
+  struct mappedFile *mf;
+  struct defEntry *def;
   
-  int status = SeqUtil_getmappedfile(filename, &filestart, &fileend);
-  if(status == 1){
+  SeqUtil_noteFile(filename);
+  if ( (mf = SeqUtil_findmappedfile(filename)) == NULL ){
     SeqUtil_TRACE( TL_FULL_TRACE, "SeqUtil_parsdef failed to open/map file %s \n", filename);
     return NULL;
   }
 
-  char *current = filestart;
-  /* long int to help the compiler because we will be adding it to a 64 bit pointer */
-  long int readsize = 0;
-
-  do{
-    /* Read a line in memory starting at current */
-    readsize = readline(line, SEQ_MAXFIELD, current);
-    if(readsize < 0)
-      return NULL; /* ( RaiseError will have been called in readline() ) */
-    current += readsize + 1;
-    /* If the string is a comment skip to next */
-    if ( strstr( line, "#" ) != NULL ) {
-      continue;
-    }
-
-    /* Parse the string: put left of "=" into defkey and right into defval */
-    if ( sscanf( line, " %[^= \t] = %[^\n \t]", defkey, defval ) == 2 ){
-      if ( strcmp( key, defkey ) == 0 ) {
-        /* Copy the string into retval for the caller and return it. */
-        if ( ! (retval = (char *) malloc( strlen(defval)+1 )) ) {
-          raiseError("SeqUtil_parsedef malloc: Out of memory!\n");
-        }
-        strcpy(retval,defval);
-        SeqUtil_TRACE( TL_FULL_TRACE, "SeqUtil_parsedef(): found definition %s=%s in %s\n",defkey,retval,filename);
-        return retval;
-      }
-    }
-    defkey[0] = '\0';
-    defval[0] = '\0';
-  }while(current < fileend);
+  if ( (def = SeqUtil_finddef( mf, key, strlen(key) )) == NULL ) {
+    /* Return NULL if nothing was found as an error code for the caller */
+    return NULL;
+  }
 
-  /* Return NULL if nothing was found as an error code for the caller */
-  return NULL;
+  /* Copy the string into retval for the caller and return it. */
+  if ( ! (retval = (char *) malloc( def->valuelen + 1 )) ) {
+    raiseError("SeqUtil_parsedef malloc: Out of memory!\n");
+  }
+  memcpy(retval, def->value, def->valuelen);
+  retval[def->valuelen] = '\0';
+  SeqUtil_TRACE( TL_FULL_TRACE, "SeqUtil_parsedef(): found definition %s=%s in %s\n",key,retval,filename);
+  return retval;
 }
 
 /* Substitutes a ${.} formatted keyword in a string. To use a definition file (format defined by
@@ -897,7 +1137,7 @@ char* SeqUtil_parsedef( const char* filename, const char* key ) {
 char* SeqUtil_keysub( const char* _str, const char* _deffile, const char* _srcfile ,const char* _seq_exp_home) {
   char *strtmp=NULL,*substr=NULL,*var_name=NULL,*var_value=NULL,*post=NULL,*source=NULL;
   char *saveptr1,*saveptr2;
-  static char newstr[SEQ_MAXFIELD];
+  static __thread char newstr[SEQ_MAXFIELD];
   int start,isvar;
   int getFromEnv;
 
@@ -1000,7 +1240,7 @@ void SeqUtil_stripSubstring( char ** string, char * substring) {
 
 char* SeqUtil_relativePathEvaluation( char* path, SeqNodeDataPtr _nodeDataPtr) { 
 
-   char *returnString = NULL, *tmpString=NULL, *tmpstrtok=NULL, *prevPtr=NULL; 
+   char *returnString = NULL, *tmpString=NULL, *tmpstrtok=NULL, *prevPtr=NULL, *saveptr=NULL; 
 
    if (path == NULL) return NULL; 
    if (strstr(path, "..") != NULL || strstr(path, "./") != NULL) {
@@ -1021,11 +1261,11 @@ char* SeqUtil_relativePathEvaluation( char* path, SeqNodeDataPtr _nodeDataPtr) {
 	        returnString=strdup(_nodeDataPtr->container);
             tmpString = (char*) malloc( strlen( path ) + 1 );
             strcpy( tmpString, path );
-            tmpstrtok = (char*) strtok( tmpString, ".." );
+            tmpstrtok = (char*) strtok_r( tmpString, "..", &saveptr );
 	         while (tmpstrtok != NULL ) {
  		          returnString=SeqUtil_getPathBase(returnString);
                 prevPtr=tmpstrtok; 
-                tmpstrtok = (char*) strtok( NULL, ".." );
+                tmpstrtok = (char*) strtok_r( NULL, "..", &saveptr );
 	         }
             SeqUtil_stringAppend(&returnString,prevPtr);
             SeqUtil_TRACE(TL_FULL_TRACE,"SeqUtil_relativePathEvaluation(): parent keyword replacement: replacing %s with %s\n",path,returnString);
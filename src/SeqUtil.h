@@ -29,6 +29,7 @@
 #include <stdio.h>
 
 #define SEQ_MAXFIELD 2048
+#define SEQ_STATE_FILES 8   /* status files cleared by a change of state, see SeqUtil_stateFiles */
 
 /* Multiples of 10 to be able to add levels in between in the future */
 #define TRACE_LEVEL		1
@@ -74,7 +75,11 @@ void  actions(char *signal, char* flow, char *node) ;
 void  actionsEnd(char *signal, char* flow, char* node) ;
 int   genFileList(LISTNODEPTR *fileList,const char *directory,LISTNODEPTR *filterList) ;
 int   removeFile_nfs(const char *filename, const char * _seq_exp_home) ;
+int   removeFiles_nfs(const char **filenames, int count, int *status, const char * _seq_exp_home) ;
 int   touch_nfs(const char *filename, const char * _seq_exp_home) ;
+int   SeqUtil_stateFiles( const char *request, char stale[][SEQ_MAXFIELD], int *count, char *newfile );
+void  SeqUtil_stateRemoved( char *removed, size_t size, const char *filename );
+int   setNodeState_nfs( const char *request, char *removed, size_t size, const char * _seq_exp_home );
 int   access_nfs (const char *filename , int mode, const char * _seq_exp_home ) ;
 int   isFileExists_nfs( const char* lockfile, const char *caller, const char * _seq_exp_home );
 int   globPath_nfs (const char *pattern, int flags, int (*errfunc) (const char *epath, int eerrno), const char * _seq_exp_home);
@@ -98,6 +103,11 @@ char* SeqUtil_fixPath ( const char* source );
 void  SeqUtil_waitForFile( char* filename, int secondsLimit, int intervalTime); 
 char* SeqUtil_getdef( const char* filename, const char* key  , const char* _seq_exp_home) ;
 char* SeqUtil_parsedef( const char* filename, const char* key ) ;
+int   SeqUtil_getmappedfile( const char *filename, char ** filestart, char** fileend );
+void  SeqUtil_unmapfiles( void );
+void  SeqUtil_setFileHook( void (*hook)( const char *filename ) );
+void  SeqUtil_noteFile( const char *filename );
+void  SeqUtil_setDefHook( void (*hook)( const char *filename, const char *key ) );
 char* SeqUtil_keysub( const char* _str, const char* _deffile, const char* _srcfile, const char* _seq_exp_home ) ;
 char* SeqUtil_striplast( const char* str ) ;
 void  SeqUtil_stripSubstring(char ** string, char * substring);
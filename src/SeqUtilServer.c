@@ -50,6 +50,87 @@ int removeFile_svr (const char *filename, const char * _seq_exp_home) {
    return (status);
 }
 
+/**
+ * removeFiles_svr: Removes the named files through mserver, the requests are
+ * sent in one flight on a framed connection. status[i] is zero if filenames[i]
+ * was removed and a nonzero value if it was not
+ */
+int removeFiles_svr (const char **filenames, int count, int *status, const char * _seq_exp_home) {
+
+   L2D2Query *queries;
+   int i, ret;
+
+   if ( count <= 0 ) return (0);
+   if ( (queries = (L2D2Query *) malloc(count * sizeof(L2D2Query))) == NULL ) {
+      raiseError("OutOfMemory exception in SeqUtilServer.removeFiles_svr()\n");
+   }
+   for ( i = 0; i < count; i++ ) {
+      queries[i].action = SVR_REMOVE;
+      queries[i].buf = filenames[i];
+      queries[i].buf2 = "";
+      queries[i].answer = NULL;
+   }
+   ret = Query_L2D2_Batch(MLLServerConnectionFid, queries, count, _seq_exp_home);
+
+   for ( i = 0; i < count; i++ ) {
+      status[i] = queries[i].status;
+      SeqUtil_TRACE(TL_FULL_TRACE,"maestro.removeFiles_svr() removing %s return:%d\n", filenames[i], status[i] );
+   }
+   free(queries);
+   return (ret);
+}
+
+/**
+ * setNodeState_svr: puts a node in a new state through mserver in one request,
+ * see SeqUtil_stateFiles. On a framed connection the server answers the names
+ * of the status files it removed, returned in removed. It returns zero if
+ * succeeds and a nonzero value if it does not
+ */
+int setNodeState_svr (const char *request, char *removed, size_t size, const char * _seq_exp_home) {
+
+   L2D2Query query;
+   char answer[MAXBUF];
+
+   /* a request too long for the 1024 byte protocol */
+   if ( strlen(request) + 3 > MAXBUF ) return (setNodeState_nfs(request, removed, size, _seq_exp_home));
+
+   query.action = SVR_SET_STATE;
+   query.buf = request;
+   query.buf2 = "";
+   query.answer = answer;
+   answer[0] = '\0';
+   Query_L2D2_Batch(MLLServerConnectionFid, &query, 1, _seq_exp_home);
+   if ( removed != NULL && size > 0 ) snprintf(removed, size, "%s", answer);
+
+   SeqUtil_TRACE(TL_FULL_TRACE,"maestro.setNodeState_svr() %s removed:%s return:%d\n", request, answer, query.status );
+   return (query.status);
+}
+
+/**
+ * takeSubmitToken_svr: takes a token of the submission bucket in the file
+ * bucket through mserver, see SeqRateLimit.h. On a framed connection the
+ * server answers the seconds to wait, returned in wait. It returns zero if
+ * succeeds and a nonzero value if the caller has to take the token itself
+ */
+int takeSubmitToken_svr (const char *bucket, double rate, double burst, double *wait, const char * _seq_exp_home) {
+
+   L2D2Query query;
+   char request[MAXBUF], answer[MAXBUF];
+
+   if ( snprintf(request, sizeof(request), "%s %f %f", bucket, rate, burst) + 3 > MAXBUF ) return (1);
+
+   query.action = SVR_RATE_TAKE;
+   query.buf = request;
+   query.buf2 = "";
+   query.answer = answer;
+   answer[0] = '\0';
+   Query_L2D2_Batch(MLLServerConnectionFid, &query, 1, _seq_exp_home);
+   if ( query.status == 0 && sscanf(answer, "%lf", wait) != 1 ) query.status = 1;
+
+   SeqUtil_TRACE(TL_FULL_TRACE,"maestro.takeSubmitToken_svr() %s wait:%s return:%d\n", request, answer, query.status );
+   return (query.status);
+}
+
 /**
  * touch_svr : simulate a "touch" on a given file 'filename' through mserver
  */
@@ -221,6 +302,8 @@ FILE * fopen_svr ( const char * filename , int sock )
   char csize[11];
   int  size;
   int  bytes_sent,bytes_read;
+  unsigned int id, len;
+  int  op, status;
 
   unsigned int pid=getpid();
 
@@ -232,62 +315,84 @@ FILE * fopen_svr ( const char * filename , int sock )
 
   SeqUtil_TRACE(TL_FULL_TRACE,"fopen_svr(): wait file:%s===== \n",filename);
 
-  /* build command */
-  snprintf(tmp,sizeof(tmp),"Z %s",filename);
-  if ( (bytes_sent=send_socket(sock , tmp , sizeof(tmp) , SOCK_TIMEOUT_CLIENT)) <= 0 ) {
+  if ( is_framed(sock) ) {
+     /* framed connection: the file is the payload of the reply */
+     pack_frame(tmp, strlen(filename), 1, 'Z', 0);
+     if ( send_full(sock, tmp, L2D2_FRAME_HEADER) != 0 || send_full(sock, filename, strlen(filename)) != 0 ) {
+	    SeqUtil_TRACE(TL_MEDIUM,"fopen_svr(): socket closed at send\n");
+            SeqUtil_TRACE(TL_MEDIUM,"fopen_svr(): Reverting to nfs Routines\n");
+	    return (fopen_nfs(filename , sock));
+     }
+     do {
+        if ( recv_frame(sock, &id, &op, &status, &buffer, &len) != 0 ) {
+            SeqUtil_TRACE(TL_MEDIUM, "fopen_svr(): Could not download waited file:%s to host tmpdir ... Reverting to nfs Routines\n",filename);
+	    return (fopen_nfs(filename , sock));
+        }
+        if ( id != 1 ) free(buffer);
+     } while ( id != 1 );
+     if ( status != 0 || len == 0 ) {
+            free(buffer);
+            SeqUtil_TRACE(TL_MEDIUM,"fopen_svr(): received 0 size of waited file ... Reverting to nfs Routines\n");
+            return (fopen_nfs(filename , sock));
+     }
+     size = len;
+  } else {
+     /* build command */
+     snprintf(tmp,sizeof(tmp),"Z %s",filename);
+     if ( (bytes_sent=send_socket(sock , tmp , sizeof(tmp) , SOCK_TIMEOUT_CLIENT)) <= 0 ) {
 	    SeqUtil_TRACE(TL_MEDIUM,"fopen_svr(): socket closed at send\n");
             SeqUtil_TRACE(TL_MEDIUM,"fopen_svr(): Reverting to nfs Routines\n");
 	    fp=fopen_nfs(filename , sock);
             return (fp);
-  }
+     }
 
-  /* read (get) size of file */
-  if ( (bytes_read=recv_socket(sock, csize, sizeof(csize), SOCK_TIMEOUT_CLIENT)) <= 0 ) {
+     /* read (get) size of file */
+     if ( (bytes_read=recv_socket(sock, csize, sizeof(csize), SOCK_TIMEOUT_CLIENT)) <= 0 ) {
              /* should revert to nfs routine */
              SeqUtil_TRACE(TL_MEDIUM,"fopen_svr(): Could not receive size of waited file ... Reverting to nfs Routines\n");
              fp=fopen_nfs(filename , sock);
              return (fp);
-  } else {
+     } else {
              size=atoi(csize);
              SeqUtil_TRACE(TL_FULL_TRACE,"Received size of waited file=%d\n",size);
-  }
+     }
 
-  /* if size is 0 , server did not find the wait file, try nfs */
-  if ( size == 0 ) {
+     /* if size is 0 , server did not find the wait file, try nfs */
+     if ( size == 0 ) {
              SeqUtil_TRACE(TL_MEDIUM,"fopen_svr(): received 0 size of waited file ... Reverting to nfs Routines\n");
              fp=fopen_nfs(filename , sock);
              return (fp);
-  }
+     }
 
-  /* allocate an extra 1 byte for null char */
-  if ( (buffer=(char *) malloc( (1+size) * sizeof(char))) == NULL ) {
+     /* allocate an extra 1 byte for null char */
+     if ( (buffer=(char *) malloc( (1+size) * sizeof(char))) == NULL ) {
 	     raiseError("ERROR: OutOfMemory in fopen_svr()\n");
              return(NULL); /* not reached */
-  }
-  
+     }
 
-  /* ok , now receive the buffer */
-  memset(buffer,'\0',1+size);
-  if (  recv_full(sock,buffer,size) == 0 ) {
-       if (  (fp=fopen(wfilename,"w+")) == NULL) {
-	     free(buffer);
-             SeqUtil_TRACE(TL_MEDIUM,"fopen_svr(): Could not open local (on host) waited_end file ... Reverting to nfs Routines\n");
-	     fp=fopen_nfs(filename , sock);
-             return (fp);
-       }
-       buffer[size]='\0';
-       fwrite(buffer, sizeof(char) , size , fp);
-       fflush(fp);
-       fsync(fileno(fp));  /* fsync work with file descriptor */
-       SeqUtil_TRACE(TL_FULL_TRACE, "\nReceived Buffer length=%d:%s\n",strlen(buffer),buffer);
-       free(buffer); 
-       fclose(fp); /* rewind at beg. of file */
-  } else {
+     /* ok , now receive the buffer */
+     memset(buffer,'\0',1+size);
+     if (  recv_full(sock,buffer,size) != 0 ) {
          SeqUtil_TRACE(TL_MEDIUM, "fopen_svr(): Could not download waited file:%s to host tmpdir ... Reverting to nfs Routines\n",filename);
 	 free(buffer);
 	 fp=fopen_nfs(filename , sock);
          return (fp);
+     }
+  }
+
+  if (  (fp=fopen(wfilename,"w+")) == NULL) {
+       free(buffer);
+       SeqUtil_TRACE(TL_MEDIUM,"fopen_svr(): Could not open local (on host) waited_end file ... Reverting to nfs Routines\n");
+       fp=fopen_nfs(filename , sock);
+       return (fp);
   }
+  buffer[size]='\0';
+  fwrite(buffer, sizeof(char) , size , fp);
+  fflush(fp);
+  fsync(fileno(fp));  /* fsync work with file descriptor */
+  SeqUtil_TRACE(TL_FULL_TRACE, "\nReceived Buffer length=%d:%s\n",strlen(buffer),buffer);
+  free(buffer); 
+  fclose(fp); /* rewind at beg. of file */
 
   /* now the waited_end file is local (TMPDIR) , open it a give the handle to routine ... */
   if ( (fp=fopen(wfilename,"r")) == NULL) { 
@@ -28,6 +28,14 @@
 int  removeFile_svr(const char *filename, const char * _seq_exp_home ) ;
 int  (*_removeFile)(const char *filename, const char * _seq_exp_home ) ;
 
+int  removeFiles_svr(const char **filenames, int count, int *status, const char * _seq_exp_home ) ;
+int  (*_removeFiles)(const char **filenames, int count, int *status, const char * _seq_exp_home ) ;
+
+int  setNodeState_svr(const char *request, char *removed, size_t size, const char * _seq_exp_home ) ;
+int  (*_setNodeState)(const char *request, char *removed, size_t size, const char * _seq_exp_home ) ;
+
+int  takeSubmitToken_svr(const char *bucket, double rate, double burst, double *wait, const char * _seq_exp_home ) ;
+
 /* this library fnc is allready declared in unistd.h : int  access (char *filename, int mode); */
 int  access_svr(const char *filename, int mode, const char * _seq_exp_home ) ;
 int  (*_access)(const char *filename, int mode, const char * _seq_exp_home ) ;
@@ -0,0 +1,570 @@
+/* TsvManifest.c - Manifest of the inputs of tsvinfo of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "SeqUtil.h"
+#include "l2d2_commun.h"
+#include "TsvManifest.h"
+
+/********************************************************************************
+ * DOCUMENTATION: Inner workings.
+ * The manifest is text, the records excepted:
+ *    tsvinfo manifest <version>
+ *    exp <experiment home>
+ *    datestamp <datestamp>
+ *    file <index> <missing> <mtime> <mtime nsec> <size> <md5|-> <path>
+ *    key <index> <md5|-> <KEY> <deffile>
+ *    node <type> <tsv length> <hr length> <files> <keys> <path>
+ *    <indices of the files of the node>
+ *    <indices of the keys of the node>
+ *    <tsv record><hr record>
+ * a file or a key being written before the first node using it.  The files
+ * and keys of the loaded manifest and of the one being written are the same
+ * tables, hashed on their name: an entry has what the loaded manifest says
+ * (known), what is there now (checked once, the md5 sum is only computed
+ * again when the mtime or size differ) and its index in the new manifest.
+ * The records of the loaded manifest stay in its buffer until they are
+ * copied for a node.
+********************************************************************************/
+
+#define MANIFEST_BUCKETS  4096
+#define MANIFEST_MD5LEN   32
+
+typedef struct _TsvFile {
+   char *path;
+   int known, missing;                /* in the loaded manifest */
+   long long mtime, mtimeNsec, size;
+   char md5[MANIFEST_MD5LEN + 1];
+   int checked, changed;              /* now */
+   int curMissing;
+   long long curMtime, curMtimeNsec, curSize;
+   char curMd5[MANIFEST_MD5LEN + 1];
+   int scanned;                       /* ${KEY} of the file, as "KEY deffile" */
+   char **keys;
+   int nkeys, maxkeys;
+   int out;                           /* index in the new manifest, -1 */
+   struct _TsvFile *next;
+} TsvFile;
+
+typedef struct _TsvKey {
+   char *name;                        /* "KEY deffile" */
+   int known;
+   char md5[MANIFEST_MD5LEN + 1];
+   int checked, changed;
+   char curMd5[MANIFEST_MD5LEN + 1];
+   int out;
+   struct _TsvKey *next;
+} TsvKey;
+
+typedef struct _TsvNode {
+   char *path;
+   int type;
+   const char *tsv, *hr;              /* in the buffer of the manifest */
+   size_t tsvLen, hrLen;
+   TsvFile **files;
+   int nfiles;
+   TsvKey **keys;
+   int nkeys;
+   struct _TsvNode *next;
+} TsvNode;
+
+struct _TsvManifest {
+   char *path, *expHome, *datestamp, *defFile;
+   char *buf;
+   size_t size;
+   TsvFile *files[MANIFEST_BUCKETS];
+   TsvKey *keys[MANIFEST_BUCKETS];
+   TsvNode *nodes[MANIFEST_BUCKETS];
+   int outFiles, outKeys;
+   char *tmpPath;
+   FILE *out;
+};
+
+/* inputs of the calling thread, see TsvManifest_record() */
+static __thread TsvInputs *recording = NULL;
+
+static unsigned int manifest_hash( const char *s ) {
+   unsigned int h = 2166136261u;
+   while ( *s ) h = (h ^ (unsigned char) *s++) * 16777619u;
+   return(h & (MANIFEST_BUCKETS - 1));
+}
+
+static char *manifest_strdup( const char *s ) {
+   char *copy;
+   if ( (copy = strdup(s)) == NULL ) raiseError("TsvManifest malloc: Out of memory!\n");
+   return(copy);
+}
+
+/* adds s to the list unless it is there */
+static void manifest_addString( char ***list, int *count, int *max, const char *s ) {
+   int i;
+
+   for ( i = 0; i < *count; i++ ) {
+      if ( strcmp((*list)[i], s) == 0 ) return;
+   }
+   if ( *count == *max ) {
+      *max = *max ? 2 * *max : 8;
+      if ( (*list = realloc(*list, *max * sizeof(char *))) == NULL ) raiseError("TsvManifest malloc: Out of memory!\n");
+   }
+   (*list)[(*count)++] = manifest_strdup(s);
+}
+
+static void manifest_freeStrings( char **list, int count ) {
+   int i;
+   for ( i = 0; i < count; i++ ) free(list[i]);
+   free(list);
+}
+
+void TsvInputs_free( TsvInputs *inputs ) {
+   manifest_freeStrings(inputs->files, inputs->nfiles);
+   manifest_freeStrings(inputs->keys, inputs->nkeys);
+   memset(inputs, '\0', sizeof(TsvInputs));
+}
+
+/* hook of SeqUtil_noteFile(), the definition files are followed by their keys */
+static void manifest_noteFile( const char *filename ) {
+   size_t len = strlen(filename);
+
+   if ( recording == NULL || (len > 4 && strcmp(filename + len - 4, ".def") == 0) ) return;
+   manifest_addString(&recording->files, &recording->nfiles, &recording->maxfiles, filename);
+}
+
+/* hook of SeqUtil_getdef() */
+static void manifest_noteDef( const char *filename, const char *key ) {
+   char name[SEQ_MAXFIELD];
+
+   if ( recording == NULL ) return;
+   snprintf(name, sizeof(name), "%s %s", key, filename);
+   manifest_addString(&recording->keys, &recording->nkeys, &recording->maxkeys, name);
+}
+
+void TsvManifest_record( TsvInputs *inputs ) {
+   recording = inputs;
+   SeqUtil_setFileHook(inputs != NULL ? manifest_noteFile : NULL);
+   SeqUtil_setDefHook(inputs != NULL ? manifest_noteDef : NULL);
+}
+
+static TsvFile *manifest_file( TsvManifest *manifest, const char *path ) {
+   unsigned int bucket = manifest_hash(path);
+   TsvFile *file;
+
+   for ( file = manifest->files[bucket]; file != NULL; file = file->next ) {
+      if ( strcmp(file->path, path) == 0 ) return(file);
+   }
+   if ( (file = calloc(1, sizeof(TsvFile))) == NULL ) raiseError("TsvManifest malloc: Out of memory!\n");
+   file->path = manifest_strdup(path);
+   file->out = -1;
+   file->next = manifest->files[bucket];
+   manifest->files[bucket] = file;
+   return(file);
+}
+
+static TsvKey *manifest_key( TsvManifest *manifest, const char *name ) {
+   unsigned int bucket = manifest_hash(name);
+   TsvKey *key;
+
+   for ( key = manifest->keys[bucket]; key != NULL; key = key->next ) {
+      if ( strcmp(key->name, name) == 0 ) return(key);
+   }
+   if ( (key = calloc(1, sizeof(TsvKey))) == NULL ) raiseError("TsvManifest malloc: Out of memory!\n");
+   key->name = manifest_strdup(name);
+   key->out = -1;
+   key->next = manifest->keys[bucket];
+   manifest->keys[bucket] = key;
+   return(key);
+}
+
+static TsvNode *manifest_node( TsvManifest *manifest, const char *path ) {
+   TsvNode *node;
+
+   for ( node = manifest->nodes[manifest_hash(path)]; node != NULL; node = node->next ) {
+      if ( strcmp(node->path, path) == 0 ) return(node);
+   }
+   return(NULL);
+}
+
+/* the content of path, NULL if it cannot be read */
+static char *manifest_readFile( const char *path, size_t *size ) {
+   struct stat st;
+   char *content = NULL;
+   ssize_t got;
+   size_t done = 0;
+   int fd;
+
+   if ( (fd = open(path, O_RDONLY)) < 0 ) return(NULL);
+   if ( fstat(fd, &st) == 0 && (content = malloc(st.st_size + 1)) != NULL ) {
+      while ( done < (size_t) st.st_size && (got = read(fd, content + done, st.st_size - done)) > 0 ) done += got;
+      content[done] = '\0';
+      *size = done;
+   }
+   close(fd);
+   return(content);
+}
+
+static void manifest_md5( const char *data, size_t len, char *md5 ) {
+   char *sum = str2md5(data, (int) len);
+   strcpy(md5, sum);
+   free(sum);
+}
+
+/* what file is now, and whether it changed since the loaded manifest */
+static void manifest_checkFile( TsvFile *file ) {
+   struct stat st;
+   char *content;
+   size_t size = 0;
+
+   if ( file->checked ) return;
+   file->checked = 1;
+   if ( stat(file->path, &st) != 0 ) {
+      file->curMissing = 1;
+      file->curMtime = file->curMtimeNsec = file->curSize = 0;
+      strcpy(file->curMd5, "-");
+   } else {
+      file->curMissing = 0;
+      file->curMtime = st.st_mtim.tv_sec;
+      file->curMtimeNsec = st.st_mtim.tv_nsec;
+      file->curSize = st.st_size;
+      if ( file->known && ! file->missing && file->mtime == file->curMtime &&
+           file->mtimeNsec == file->curMtimeNsec && file->size == file->curSize ) {
+         strcpy(file->curMd5, file->md5);
+      } else if ( (content = manifest_readFile(file->path, &size)) != NULL ) {
+         manifest_md5(content, size, file->curMd5);
+         free(content);
+      } else {
+         strcpy(file->curMd5, "?");
+      }
+   }
+   file->changed = ! file->known || file->missing != file->curMissing || strcmp(file->md5, file->curMd5) != 0;
+   if ( file->changed ) SeqUtil_TRACE(TL_FULL_TRACE, "TsvManifest: %s changed\n", file->path);
+}
+
+/* the value of key now, and whether it changed since the loaded manifest */
+static void manifest_checkKey( TsvManifest *manifest, TsvKey *key ) {
+   char name[SEQ_MAXFIELD], *deffile, *value;
+
+   if ( key->checked ) return;
+   key->checked = 1;
+   snprintf(name, sizeof(name), "%s", key->name);
+   if ( (deffile = strchr(name, ' ')) == NULL ) {
+      strcpy(key->curMd5, "?");
+   } else {
+      *deffile++ = '\0';
+      if ( (value = SeqUtil_getdef(deffile, name, manifest->expHome)) != NULL ) {
+         manifest_md5(value, strlen(value), key->curMd5);
+         free(value);
+      } else {
+         strcpy(key->curMd5, "-");
+      }
+   }
+   key->changed = ! key->known || strcmp(key->md5, key->curMd5) != 0;
+   if ( key->changed ) SeqUtil_TRACE(TL_FULL_TRACE, "TsvManifest: %s changed\n", key->name);
+}
+
+/* the ${KEY} of an xml file, resolved with the resources.def of the experiment */
+static void manifest_scanFile( TsvManifest *manifest, TsvFile *file ) {
+   char *content, *start, *end, name[SEQ_MAXFIELD];
+   size_t size = 0;
+
+   if ( file->scanned ) return;
+   file->scanned = 1;
+   if ( (content = manifest_readFile(file->path, &size)) == NULL ) return;
+   for ( start = strstr(content, "${"); start != NULL; start = strstr(end, "${") ) {
+      start += 2;
+      if ( (end = strchr(start, '}')) == NULL ) break;
+      if ( end > start && end - start < (int) sizeof(name) / 2 ) {
+         snprintf(name, sizeof(name), "%.*s %s", (int) (end - start), start, manifest->defFile);
+         manifest_addString(&file->keys, &file->nkeys, &file->maxkeys, name);
+      }
+   }
+   free(content);
+}
+
+/* forgets the loaded manifest */
+static void manifest_forget( TsvManifest *manifest ) {
+   TsvFile *file;
+   TsvKey *key;
+   TsvNode *node;
+   int i;
+
+   for ( i = 0; i < MANIFEST_BUCKETS; i++ ) {
+      while ( (file = manifest->files[i]) != NULL ) {
+         manifest->files[i] = file->next;
+         manifest_freeStrings(file->keys, file->nkeys);
+         free(file->path);
+         free(file);
+      }
+      while ( (key = manifest->keys[i]) != NULL ) {
+         manifest->keys[i] = key->next;
+         free(key->name);
+         free(key);
+      }
+      while ( (node = manifest->nodes[i]) != NULL ) {
+         manifest->nodes[i] = node->next;
+         free(node->files);
+         free(node->keys);
+         free(node->path);
+         free(node);
+      }
+   }
+   free(manifest->buf);
+   manifest->buf = NULL;
+   manifest->size = 0;
+}
+
+/* the next line of the buffer at *pos, NUL terminated in place; NULL at the end */
+static char *manifest_line( TsvManifest *manifest, size_t *pos ) {
+   char *line = manifest->buf + *pos, *nl;
+
+   if ( *pos >= manifest->size || (nl = memchr(line, '\n', manifest->size - *pos)) == NULL ) return(NULL);
+   *nl = '\0';
+   *pos = nl - manifest->buf + 1;
+   return(line);
+}
+
+/* reads count indices of line into the entries of table */
+static int manifest_indices( char *line, void **table, int tableSize, void **entries, int count ) {
+   char *end;
+   long index;
+   int i;
+
+   for ( i = 0; i < count; i++ ) {
+      index = strtol(line, &end, 10);
+      if ( end == line || index < 0 || index >= tableSize ) return(-1);
+      entries[i] = table[index];
+      line = end;
+   }
+   return(0);
+}
+
+/* parses the buffer of the manifest, returns 0 if it is one of this experiment and datestamp */
+static int manifest_parse( TsvManifest *manifest ) {
+   TsvFile **files = NULL, *file;
+   TsvKey **keys = NULL, *key;
+   TsvNode *node;
+   char *line, md5[MANIFEST_MD5LEN + 1];
+   size_t pos = 0, tsvLen, hrLen;
+   int version = 0, nfiles = 0, nkeys = 0, index, missing, n, type, fileCount, keyCount, status = -1;
+   long long mtime, mtimeNsec, size;
+
+   if ( (line = manifest_line(manifest, &pos)) == NULL || sscanf(line, "tsvinfo manifest %d", &version) != 1 ||
+        version != TSV_MANIFEST_VERSION ) {
+      SeqUtil_TRACE(TL_MEDIUM, "TsvManifest: %s is not a manifest of version %d\n", manifest->path, TSV_MANIFEST_VERSION);
+      return(-1);
+   }
+   if ( (line = manifest_line(manifest, &pos)) == NULL || strncmp(line, "exp ", 4) != 0 || strcmp(line + 4, manifest->expHome) != 0 ||
+        (line = manifest_line(manifest, &pos)) == NULL || strncmp(line, "datestamp ", 10) != 0 || strcmp(line + 10, manifest->datestamp) != 0 ) {
+      SeqUtil_TRACE(TL_MEDIUM, "TsvManifest: %s is the manifest of another experiment or datestamp\n", manifest->path);
+      return(-1);
+   }
+
+   while ( (line = manifest_line(manifest, &pos)) != NULL ) {
+      n = 0;
+      if ( sscanf(line, "file %d %d %lld %lld %lld %32s %n", &index, &missing, &mtime, &mtimeNsec, &size, md5, &n) == 6 && n > 0 ) {
+         if ( index != nfiles ) goto out;
+         file = manifest_file(manifest, line + n);
+         file->known = 1;
+         file->missing = missing;
+         file->mtime = mtime;
+         file->mtimeNsec = mtimeNsec;
+         file->size = size;
+         strcpy(file->md5, md5);
+         if ( (files = realloc(files, (nfiles + 1) * sizeof(TsvFile *))) == NULL ) raiseError("TsvManifest malloc: Out of memory!\n");
+         files[nfiles++] = file;
+      } else if ( sscanf(line, "key %d %32s %n", &index, md5, &n) == 2 && n > 0 ) {
+         if ( index != nkeys ) goto out;
+         key = manifest_key(manifest, line + n);
+         key->known = 1;
+         strcpy(key->md5, md5);
+         if ( (keys = realloc(keys, (nkeys + 1) * sizeof(TsvKey *))) == NULL ) raiseError("TsvManifest malloc: Out of memory!\n");
+         keys[nkeys++] = key;
+      } else if ( sscanf(line, "node %d %zu %zu %d %d %n", &type, &tsvLen, &hrLen, &fileCount, &keyCount, &n) == 5 && n > 0 ) {
+         if ( fileCount < 0 || keyCount < 0 || manifest_node(manifest, line + n) != NULL ) goto out;
+         if ( (node = calloc(1, sizeof(TsvNode))) == NULL ||
+              (node->files = malloc((fileCount + 1) * sizeof(TsvFile *))) == NULL ||
+              (node->keys = malloc((keyCount + 1) * sizeof(TsvKey *))) == NULL ) {
+            raiseError("TsvManifest malloc: Out of memory!\n");
+         }
+         node->path = manifest_strdup(line + n);
+         node->type = type;
+         node->nfiles = fileCount;
+         node->nkeys = keyCount;
+         node->next = manifest->nodes[manifest_hash(node->path)];
+         manifest->nodes[manifest_hash(node->path)] = node;
+         if ( (line = manifest_line(manifest, &pos)) == NULL ||
+              manifest_indices(line, (void **) files, nfiles, (void **) node->files, fileCount) != 0 ||
+              (line = manifest_line(manifest, &pos)) == NULL ||
+              manifest_indices(line, (void **) keys, nkeys, (void **) node->keys, keyCount) != 0 ||
+              pos + tsvLen + hrLen >= manifest->size || manifest->buf[pos + tsvLen + hrLen] != '\n' ) {
+            goto out;
+         }
+         node->tsv = manifest->buf + pos;
+         node->tsvLen = tsvLen;
+         node->hr = manifest->buf + pos + tsvLen;
+         node->hrLen = hrLen;
+         pos += tsvLen + hrLen + 1;
+      } else {
+         goto out;
+      }
+   }
+   status = ( pos == manifest->size ? 0 : -1 );
+
+out:
+   if ( status != 0 ) SeqUtil_TRACE(TL_ERROR, "TsvManifest: %s cannot be read, all the nodes are resolved\n", manifest->path);
+   free(files);
+   free(keys);
+   return(status);
+}
+
+TsvManifest *TsvManifest_load( const char *path, const char *seq_exp_home, const char *datestamp ) {
+   TsvManifest *manifest;
+
+   if ( (manifest = calloc(1, sizeof(TsvManifest))) == NULL ) raiseError("TsvManifest malloc: Out of memory!\n");
+   manifest->path = manifest_strdup(path);
+   manifest->expHome = manifest_strdup(seq_exp_home);
+   manifest->datestamp = manifest_strdup(datestamp);
+   manifest->defFile = (char *) SeqUtil_resourceDefFilename(seq_exp_home);
+
+   if ( (manifest->buf = manifest_readFile(path, &manifest->size)) == NULL ) {
+      SeqUtil_TRACE(TL_MEDIUM, "TsvManifest: no manifest %s, all the nodes are resolved\n", path);
+   } else if ( manifest_parse(manifest) != 0 ) {
+      manifest_forget(manifest);
+   }
+   return(manifest);
+}
+
+int TsvManifest_reuse( TsvManifest *manifest, const char *path, int type,
+                       char **tsv, size_t *tsvLen, char **hr, size_t *hrLen, TsvInputs *inputs ) {
+   TsvNode *node;
+   int i;
+
+   if ( (node = manifest_node(manifest, path)) == NULL || node->type != type ) return(0);
+   for ( i = 0; i < node->nfiles; i++ ) {
+      manifest_checkFile(node->files[i]);
+      if ( node->files[i]->changed ) return(0);
+   }
+   for ( i = 0; i < node->nkeys; i++ ) {
+      manifest_checkKey(manifest, node->keys[i]);
+      if ( node->keys[i]->changed ) return(0);
+   }
+
+   if ( (*tsv = malloc(node->tsvLen + 1)) == NULL || (*hr = malloc(node->hrLen + 1)) == NULL )
+      raiseError("TsvManifest malloc: Out of memory!\n");
+   memcpy(*tsv, node->tsv, node->tsvLen);
+   (*tsv)[node->tsvLen] = '\0';
+   *tsvLen = node->tsvLen;
+   memcpy(*hr, node->hr, node->hrLen);
+   (*hr)[node->hrLen] = '\0';
+   *hrLen = node->hrLen;
+   for ( i = 0; i < node->nfiles; i++ )
+      manifest_addString(&inputs->files, &inputs->nfiles, &inputs->maxfiles, node->files[i]->path);
+   for ( i = 0; i < node->nkeys; i++ )
+      manifest_addString(&inputs->keys, &inputs->nkeys, &inputs->maxkeys, node->keys[i]->name);
+   return(1);
+}
+
+int TsvManifest_begin( TsvManifest *manifest ) {
+   if ( (manifest->tmpPath = malloc(strlen(manifest->path) + 5)) == NULL ) raiseError("TsvManifest malloc: Out of memory!\n");
+   sprintf(manifest->tmpPath, "%s.tmp", manifest->path);
+   if ( (manifest->out = fopen(manifest->tmpPath, "w")) == NULL ) {
+      SeqUtil_TRACE(TL_ERROR, "TsvManifest: cannot write %s\n", manifest->tmpPath);
+      return(-1);
+   }
+   fprintf(manifest->out, "tsvinfo manifest %d\nexp %s\ndatestamp %s\n", TSV_MANIFEST_VERSION, manifest->expHome, manifest->datestamp);
+   return(0);
+}
+
+int TsvManifest_addNode( TsvManifest *manifest, const char *path, int type,
+                         const char *tsv, size_t tsvLen, const char *hr, size_t hrLen,
+                         TsvInputs *inputs, int resolved ) {
+   TsvFile *file;
+   TsvKey *key;
+   int i, j, nfiles = inputs->nfiles;
+
+   if ( manifest->out == NULL ) return(-1);
+   for ( i = 0; i < nfiles; i++ ) {
+      file = manifest_file(manifest, inputs->files[i]);
+      if ( resolved ) {
+         manifest_scanFile(manifest, file);
+         for ( j = 0; j < file->nkeys; j++ )
+            manifest_addString(&inputs->keys, &inputs->nkeys, &inputs->maxkeys, file->keys[j]);
+      }
+      manifest_checkFile(file);
+      if ( file->out < 0 ) {
+         file->out = manifest->outFiles++;
+         fprintf(manifest->out, "file %d %d %lld %lld %lld %s %s\n", file->out, file->curMissing,
+                 file->curMtime, file->curMtimeNsec, file->curSize, file->curMd5, file->path);
+      }
+   }
+   for ( i = 0; i < inputs->nkeys; i++ ) {
+      key = manifest_key(manifest, inputs->keys[i]);
+      manifest_checkKey(manifest, key);
+      if ( key->out < 0 ) {
+         key->out = manifest->outKeys++;
+         fprintf(manifest->out, "key %d %s %s\n", key->out, key->curMd5, key->name);
+      }
+   }
+
+   fprintf(manifest->out, "node %d %zu %zu %d %d %s\n", type, tsvLen, hrLen, inputs->nfiles, inputs->nkeys, path);
+   for ( i = 0; i < inputs->nfiles; i++ )
+      fprintf(manifest->out, i == 0 ? "%d" : " %d", manifest_file(manifest, inputs->files[i])->out);
+   fprintf(manifest->out, "\n");
+   for ( i = 0; i < inputs->nkeys; i++ )
+      fprintf(manifest->out, i == 0 ? "%d" : " %d", manifest_key(manifest, inputs->keys[i])->out);
+   fprintf(manifest->out, "\n");
+   fwrite(tsv, 1, tsvLen, manifest->out);
+   fwrite(hr, 1, hrLen, manifest->out);
+   fprintf(manifest->out, "\n");
+   return(0);
+}
+
+int TsvManifest_end( TsvManifest *manifest ) {
+   int failed;
+
+   if ( manifest->out == NULL ) return(-1);
+   failed = ferror(manifest->out);
+   failed = ( fclose(manifest->out) != 0 ) || failed;
+   manifest->out = NULL;
+   if ( failed || rename(manifest->tmpPath, manifest->path) != 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "TsvManifest: cannot write %s\n", manifest->path);
+      unlink(manifest->tmpPath);
+      return(-1);
+   }
+   return(0);
+}
+
+void TsvManifest_free( TsvManifest *manifest ) {
+   if ( manifest == NULL ) return;
+   if ( manifest->out != NULL ) {
+      fclose(manifest->out);
+      unlink(manifest->tmpPath);
+   }
+   manifest_forget(manifest);
+   free(manifest->tmpPath);
+   free(manifest->path);
+   free(manifest->expHome);
+   free(manifest->datestamp);
+   free(manifest->defFile);
+   free(manifest);
+}
@@ -0,0 +1,92 @@
+/* TsvManifest.h - Manifest of the inputs of tsvinfo of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _TSV_MANIFEST_H_
+#define _TSV_MANIFEST_H_
+
+#include <stddef.h>
+
+/********************************************************************************
+ * DOCUMENTATION: Interface.
+ * The manifest of tsvinfo is kept next to its output (TSV_MANIFEST_EXT added
+ * to the name of the tsv file).  It holds, for every node, its tsv and human
+ * readable records with the inputs they came from:
+ *    - the xml files read (or found missing) to resolve the node, with their
+ *      mtime, size and md5 sum;
+ *    - the keys of the definition files the node used, ${KEY} of its xml
+ *      files and the keys looked up by SeqUtil_getdef(), with the md5 sum of
+ *      their value.
+ * The definition files themselves are not inputs: a change of resources.def
+ * only rebuilds the nodes using a key whose value changed.
+ *
+ * A rebuild loads the manifest, and a node of the census keeps its records
+ * when it has the same type and none of its inputs changed: a file changed
+ * when it appeared, went away, or has another md5 sum (computed again only
+ * when its mtime or size differ); a key changed when SeqUtil_getdef() gives
+ * it another value.  The other nodes are resolved again while their inputs
+ * are recorded, and the new manifest is written with the output.  A manifest
+ * of another experiment, datestamp or version is ignored.
+********************************************************************************/
+
+#define TSV_MANIFEST_EXT      ".manifest"
+#define TSV_MANIFEST_VERSION  1
+
+/* inputs of a node, keys as "KEY deffile" */
+typedef struct {
+   char **files;
+   int nfiles, maxfiles;
+   char **keys;
+   int nkeys, maxkeys;
+} TsvInputs;
+
+typedef struct _TsvManifest TsvManifest;
+
+/* the manifest at path for the experiment and datestamp, empty if there is none usable */
+TsvManifest *TsvManifest_load( const char *path, const char *seq_exp_home, const char *datestamp );
+
+/********************************************************************************
+ * Returns 1 and copies the records and the inputs of node if it can keep
+ * them, 0 if it must be resolved again.
+********************************************************************************/
+int TsvManifest_reuse( TsvManifest *manifest, const char *node, int type,
+                       char **tsv, size_t *tsvLen, char **hr, size_t *hrLen, TsvInputs *inputs );
+
+/********************************************************************************
+ * While inputs is not NULL, the files and the definitions read by the calling
+ * thread are entered in inputs.
+********************************************************************************/
+void TsvManifest_record( TsvInputs *inputs );
+void TsvInputs_free( TsvInputs *inputs );
+
+/********************************************************************************
+ * Writing the manifest, by the thread that loaded it: TsvManifest_begin()
+ * starts a new manifest at the path of the loaded one, TsvManifest_addNode()
+ * adds the nodes in the order of the output (resolved: the inputs are those
+ * recorded, the keys of the xml files are added) and TsvManifest_end() puts
+ * the new manifest in place.  Return 0 on success.
+********************************************************************************/
+int  TsvManifest_begin( TsvManifest *manifest );
+int  TsvManifest_addNode( TsvManifest *manifest, const char *node, int type,
+                          const char *tsv, size_t tsvLen, const char *hr, size_t hrLen,
+                          TsvInputs *inputs, int resolved );
+int  TsvManifest_end( TsvManifest *manifest );
+void TsvManifest_free( TsvManifest *manifest );
+
+#endif
@@ -21,10 +21,43 @@
 
 #include "XmlUtils.h"
 #include "SeqUtil.h"
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* buckets of the document cache */
+#define XML_DOC_BUCKETS 64
+/* documents kept without a borrower, the least recently used go first */
+#define XML_DOC_IDLE_MAX 64
+
+/* a document of the cache, found from the document by its _private field */
+typedef struct _XmlCachedDoc {
+   char *path;          /* absolute */
+   char *deffile;       /* resolved with, NULL if used as parsed */
+   xmlDocPtr doc;
+   dev_t dev;
+   ino_t ino;
+   off_t size;
+   struct timespec mtime;
+   int refs;            /* borrowers */
+   int stale;           /* out of the cache, freed by its last borrower */
+   unsigned int bucket;
+   struct _XmlCachedDoc *next;
+   struct _XmlCachedDoc *idlePrev, *idleNext;   /* idle list, while refs is 0 */
+} XmlCachedDoc;
+
+/* each thread has its own cache: the documents are trimmed and resolved by
+ * their first borrower, and libxml2 documents are not for concurrent use */
+static __thread XmlCachedDoc *docCache[XML_DOC_BUCKETS];
+static __thread XmlCachedDoc *idleFirst = NULL, *idleLast = NULL;
+static __thread int idleCount = 0;
+static __thread int docHits = 0, docMisses = 0, docStale = 0;
+static int docCacheOn = 1, docCacheTraced = 0;
 
 xmlDocPtr XmlUtils_getdoc (const char *_docname) {
    xmlDocPtr doc;
+   SeqUtil_noteFile(_docname);
    doc = xmlParseFile(_docname);
    
    if (doc == NULL ) {
@@ -35,6 +68,156 @@ xmlDocPtr XmlUtils_getdoc (const char *_docname) {
    return doc;
 }
 
+static void XmlUtils_traceDocCache (void) {
+   SeqUtil_TRACE(TL_MEDIUM, "XmlUtils document cache: %d hits, %d misses, %d stale\n", docHits, docMisses, docStale);
+}
+
+static void XmlUtils_freeCachedDoc (XmlCachedDoc *entry) {
+   xmlFreeDoc(entry->doc);
+   free(entry->path);
+   free(entry->deffile);
+   free(entry);
+}
+
+static void XmlUtils_unlinkIdle (XmlCachedDoc *entry) {
+   if ( entry->idlePrev != NULL ) entry->idlePrev->idleNext = entry->idleNext; else idleFirst = entry->idleNext;
+   if ( entry->idleNext != NULL ) entry->idleNext->idlePrev = entry->idlePrev; else idleLast = entry->idlePrev;
+   entry->idlePrev = entry->idleNext = NULL;
+   idleCount--;
+}
+
+/* removes an entry from its bucket */
+static void XmlUtils_uncacheDoc (XmlCachedDoc *entry) {
+   XmlCachedDoc **link;
+   for ( link = &docCache[entry->bucket]; *link != NULL; link = &(*link)->next ) {
+      if ( *link == entry ) {
+         *link = entry->next;
+         break;
+      }
+   }
+}
+
+xmlDocPtr XmlUtils_borrowdoc (const char *_docname, const char *_deffile, int *_parsed) {
+   XmlCachedDoc *entry = NULL, **link = NULL;
+   char *path = NULL, cwd[SEQ_MAXFIELD];
+   unsigned int bucket = 0;
+   const char *c;
+   struct stat st;
+   xmlDocPtr doc = NULL;
+
+   *_parsed = 1;
+   if ( ! docCacheOn || stat(_docname, &st) != 0 ) {
+      /* missing files get the messages of XmlUtils_getdoc() */
+      return XmlUtils_getdoc(_docname);
+   }
+   SeqUtil_noteFile(_docname);
+   if ( ! docCacheTraced ) {
+      atexit(XmlUtils_traceDocCache);
+      docCacheTraced = 1;
+   }
+
+   if ( _docname[0] == '/' || getcwd(cwd, sizeof(cwd)) == NULL ) {
+      path = strdup(_docname);
+   } else {
+      path = malloc( strlen(cwd) + strlen(_docname) + 2 );
+      sprintf( path, "%s/%s", cwd, _docname );
+   }
+   for ( c = path; *c != '\0'; c++ ) bucket = bucket * 31 + (unsigned char) *c;
+   bucket %= XML_DOC_BUCKETS;
+
+   for ( link = &docCache[bucket]; (entry = *link) != NULL; link = &entry->next ) {
+      if ( strcmp(entry->path, path) != 0 ) continue;
+      if ( (entry->deffile == NULL) != (_deffile == NULL) ) continue;
+      if ( _deffile != NULL && strcmp(entry->deffile, _deffile) != 0 ) continue;
+
+      if ( entry->dev == st.st_dev && entry->ino == st.st_ino && entry->size == st.st_size &&
+           entry->mtime.tv_sec == st.st_mtim.tv_sec && entry->mtime.tv_nsec == st.st_mtim.tv_nsec ) {
+         if ( entry->refs++ == 0 ) XmlUtils_unlinkIdle(entry);
+         docHits++;
+         SeqUtil_TRACE(TL_FULL_TRACE, "XmlUtils_borrowdoc(): hit %s (%d hits, %d misses)\n", path, docHits, docMisses);
+         free(path);
+         *_parsed = 0;
+         return entry->doc;
+      }
+      /* the file changed, the borrowers of the old document keep it */
+      SeqUtil_TRACE(TL_FULL_TRACE, "XmlUtils_borrowdoc(): %s changed since it was parsed\n", path);
+      *link = entry->next;
+      docStale++;
+      if ( entry->refs == 0 ) {
+         XmlUtils_unlinkIdle(entry);
+         XmlUtils_freeCachedDoc(entry);
+      } else {
+         entry->stale = 1;
+      }
+      break;
+   }
+
+   docMisses++;
+   SeqUtil_TRACE(TL_FULL_TRACE, "XmlUtils_borrowdoc(): miss %s (%d hits, %d misses)\n", path, docHits, docMisses);
+   if ( (doc = xmlParseFile(_docname)) == NULL ) {
+      fprintf(stderr,"Document not parsed successfully. \n");
+      free(path);
+      return NULL;
+   }
+   if ( (entry = calloc(1, sizeof(XmlCachedDoc))) == NULL ) {
+      raiseError("XmlUtils_borrowdoc malloc: Out of memory!\n");
+   }
+   entry->path = path;
+   entry->deffile = ( _deffile != NULL ? strdup(_deffile) : NULL );
+   entry->doc = doc;
+   entry->dev = st.st_dev;
+   entry->ino = st.st_ino;
+   entry->size = st.st_size;
+   entry->mtime = st.st_mtim;
+   entry->refs = 1;
+   entry->bucket = bucket;
+   entry->next = docCache[bucket];
+   docCache[bucket] = entry;
+   doc->_private = entry;
+   return doc;
+}
+
+void XmlUtils_releasedoc (xmlDocPtr _doc) {
+   XmlCachedDoc *entry;
+
+   if ( _doc == NULL ) return;
+   if ( (entry = (XmlCachedDoc *) _doc->_private) == NULL ) {
+      /* not from the cache */
+      xmlFreeDoc(_doc);
+      return;
+   }
+   if ( --entry->refs > 0 ) return;
+   if ( entry->stale ) {
+      XmlUtils_freeCachedDoc(entry);
+      return;
+   }
+
+   entry->idleNext = idleFirst;
+   if ( idleFirst != NULL ) idleFirst->idlePrev = entry; else idleLast = entry;
+   idleFirst = entry;
+   if ( ++idleCount > XML_DOC_IDLE_MAX ) {
+      entry = idleLast;
+      XmlUtils_unlinkIdle(entry);
+      XmlUtils_uncacheDoc(entry);
+      XmlUtils_freeCachedDoc(entry);
+   }
+}
+
+void XmlUtils_setDocCache (int on) {
+   docCacheOn = on;
+}
+
+void XmlUtils_flushDocCache (void) {
+   XmlCachedDoc *entry;
+
+   XmlUtils_traceDocCache();
+   while ( (entry = idleLast) != NULL ) {
+      XmlUtils_unlinkIdle(entry);
+      XmlUtils_uncacheDoc(entry);
+      XmlUtils_freeCachedDoc(entry);
+   }
+}
+
 xmlXPathObjectPtr
 XmlUtils_getnodeset (const xmlChar *_xpathQuery, xmlXPathContextPtr _context) {
    
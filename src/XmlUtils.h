@@ -48,6 +48,23 @@
 
 xmlDocPtr XmlUtils_getdoc (const char *_docname);
 
+/* Document cache: a thread keeps the documents it parsed, by absolute path,
+ * and parses a file again only when its mtime, inode or size changed.
+ * XmlUtils_borrowdoc() returns a cached document that the caller must not
+ * free nor modify, except just after it was parsed (*_parsed set to 1) to
+ * prepare it once for every borrower: the resource files are resolved with
+ * _deffile (see XmlUtils_resolve()), which is part of the key, NULL for a
+ * document used as parsed.  Give it back with XmlUtils_releasedoc().
+ * The hits and misses are traced, their totals at exit (TL_MEDIUM). */
+xmlDocPtr XmlUtils_borrowdoc (const char *_docname, const char *_deffile, int *_parsed);
+void XmlUtils_releasedoc (xmlDocPtr _doc);
+
+/* with on at 0, every borrow parses its own document (see ExpSnapshot_begin()) */
+void XmlUtils_setDocCache (int on);
+
+/* frees the documents of the calling thread that have no borrower, at the end of a worker thread */
+void XmlUtils_flushDocCache (void);
+
 xmlXPathObjectPtr
 XmlUtils_getnodeset (const xmlChar *_xpathQuery, xmlXPathContextPtr _context);
 
@@ -0,0 +1,143 @@
+/* expcompile_main.c - Compiles the snapshot of an experiment for the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "getopt.h"
+#include "SeqUtil.h"
+#include "SeqNode.h"
+#include "SeqNodeCensus.h"
+#include "nodeinfo.h"
+#include "ExpSnapshot.h"
+
+int MLLServerConnectionFid=0;
+
+/* the nodes kept in a snapshot do not depend on the datestamp */
+#define COMPILE_DATESTAMP "20000101000000"
+
+static void printUsage()
+{
+   char * usage = "DESCRIPTION: expcompile: Compiles the flow.xml files, the resource files and\n\
+    the definition files of an experiment into the snapshot nodeinfo maps instead\n\
+    of parsing them, $SEQ_EXP_HOME/" EXPSNAP_FILE ".\n\
+    A node whose files changed since is read from its files again, run expcompile\n\
+    again after editing the experiment.  Nodes under a switch or with VALIDITY\n\
+    tags in their resources depend on the datestamp and are left out.\n\
+\n\
+USAGE:\n\
+\n\
+    expcompile [-e experiment_home] [-o output] [-v]\n\
+\n\
+OPTIONS:\n\
+\n\
+    -e, --exp \n\
+        Experiment path.  If it is not supplied, the environment variable \n\
+        SEQ_EXP_HOME will be used.  nodeinfo uses the snapshot when given\n\
+        the experiment home written the same way.\n\
+\n\
+    -o, --output \n\
+        Snapshot file (default $SEQ_EXP_HOME/" EXPSNAP_FILE ")\n\
+\n\
+    -v, --verbose\n\
+        Turn on full tracing\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+EXAMPLES:\n\
+\n\
+    expcompile -e /home/ops/afsi/phc/.suites/sample\n";
+   puts(usage);
+}
+
+int main ( int argc, char * argv[] )
+{
+   const char*  short_opts = "e:o:vh";
+   extern char* optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+      {"exp"         , required_argument,   0,     'e'},
+      {"output"      , required_argument,   0,     'o'},
+      {"verbose"     , no_argument      ,   0,     'v'},
+      {"help"        , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+   char *seq_exp_home = NULL, *output = NULL, path[SEQ_MAXFIELD];
+   int kept = 0, left = 0;
+   PathArgNodePtr nodeList = NULL;
+   SeqNodeDataPtr ndp = NULL;
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index)) != -1) {
+     switch(c) {
+        case 'e':
+           seq_exp_home = strdup( optarg );
+           break;
+        case 'o':
+           output = strdup( optarg );
+           break;
+        case 'v':
+           SeqUtil_setTraceFlag( TRACE_LEVEL , TL_FULL_TRACE );
+           break;
+        case 'h':
+           printUsage();
+           exit(0);
+        case '?':
+           printUsage();
+           exit(1);
+     }
+   }
+
+   if ( seq_exp_home == NULL && (seq_exp_home = getenv("SEQ_EXP_HOME")) == NULL ) {
+      fprintf(stderr, "expcompile: SEQ_EXP_HOME not set and no -e experiment_home given\n");
+      exit(1);
+   }
+   if ( output == NULL ) {
+      snprintf(path, sizeof path, "%s/%s", seq_exp_home, EXPSNAP_FILE);
+      output = path;
+   }
+
+   nodeList = getNodeList(seq_exp_home, COMPILE_DATESTAMP);
+
+   ExpSnapshot_begin(seq_exp_home);
+   for_pap_list(itr,nodeList){
+      /* the branch of a switch is chosen by the datestamp */
+      if ( itr->switch_args != NULL && strlen(itr->switch_args) > 0 ) {
+         left++;
+         continue;
+      }
+      ndp = nodeinfo( itr->path, NI_SHOW_ALL, NULL, seq_exp_home, NULL, COMPILE_DATESTAMP, NULL );
+      if ( ExpSnapshot_addNode(ndp) == 0 )
+         kept++;
+      else
+         left++;
+      SeqNode_freeNode(ndp);
+   }
+
+   if ( ExpSnapshot_write(output) != 0 ) {
+      fprintf(stderr, "expcompile: cannot write %s\n", output);
+      exit(1);
+   }
+   fprintf(stdout, "expcompile: %d nodes compiled in %s, %d left to the xml files\n", kept, output, left);
+
+   PathArgNode_deleteList(&nodeList);
+   return 0;
+}
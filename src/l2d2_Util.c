@@ -58,16 +58,16 @@ static void pdir (const char * dir_name);
 *
 */
 char *getPathLeaf (const char *full_path) {
-   char *split,*work_string,*chreturn =NULL;
+   char *split,*work_string,*chreturn =NULL,*saveptr;
    work_string = strdup(full_path);
-   split = strtok (work_string,"/");
+   split = strtok_r (work_string,"/",&saveptr);
    while (split != NULL) {
      if ( chreturn != NULL ) {
        /* free previous allocated memory */
        free( chreturn );
      }
      chreturn = strdup (split);
-     split = strtok (NULL,"/");
+     split = strtok_r (NULL,"/",&saveptr);
    }
    free( work_string );
    return chreturn;
@@ -129,6 +129,25 @@ int touch (char *filename) {
    return(0); 
 }
 
+/**
+ * Name        : setNodeState
+ * Description : put a node in a new state: remove the stale status
+ *               files and create the new one (see SeqUtil_stateFiles).
+ *               removed gets the names of the files removed.
+ */
+int setNodeState (const char *request, char *removed, size_t size) {
+   char stale[SEQ_STATE_FILES][SEQ_MAXFIELD], newfile[SEQ_MAXFIELD];
+   int i, count;
+
+   removed[0] = '\0';
+   if ( SeqUtil_stateFiles(request, stale, &count, newfile) != 0 ) return(1);
+   for ( i = 0; i < count; i++ ) {
+       if ( removeFile(stale[i]) == 0 ) SeqUtil_stateRemoved(removed, size, stale[i]);
+   }
+   if ( newfile[0] != '\0' ) return(CreateLock(newfile));
+   return(0);
+}
+
 /*
  * Name        : isFileExists
  * Author      : copied form SeqUtil.c
@@ -178,14 +197,14 @@ int isDirExists ( const char* path_name ) {
  */
 int r_mkdir ( const char* dir_name, int is_recursive , FILE *mlog) {
    char tmp[1024];
-   char *split = NULL, *work_string = NULL;
+   char *split = NULL, *work_string = NULL, *saveptr;
  
    memset(tmp,'\0',sizeof(tmp));
 
    if ( is_recursive == 1) {
       work_string = strdup( dir_name );
       strcpy( tmp, "/" );
-      split  = strtok( work_string, "/" );
+      split  = strtok_r( work_string, "/", &saveptr );
       if( split != NULL ) {
          strcat( tmp, split );
       }
@@ -198,7 +217,7 @@ int r_mkdir ( const char* dir_name, int is_recursive , FILE *mlog) {
             }
          }
 
-         split = strtok (NULL,"/");
+         split = strtok_r (NULL,"/",&saveptr);
          if( split != NULL ) {
             strcat( tmp, split );
          }
@@ -607,12 +626,11 @@ int ParseXmlConfigFile(char *filename ,  _l2d2server *pl2d2 )
 	       sprintf(pl2d2->web_dep,"%s/dependencies.html",pl2d2->web);
 	       sprintf(pl2d2->emailTO,"%s@ec.gc.ca",pl2d2->user);
 	       sprintf(pl2d2->emailCC,"");
-	       pl2d2->maxNumOfProcess=4;
-	       pl2d2->maxClientPerProcess=50;
+	       pl2d2->workerThreads=8;
 	       pl2d2->pollfreq=30;       /* sec */
 	       pl2d2->dependencyTimeOut=24; /* hours */
                pl2d2->dzone=0;
-               fprintf(stderr,"Setting Defaults for maxNumOfProcess:%d maxClientPerProcess:%d\n",pl2d2->maxNumOfProcess,pl2d2->maxClientPerProcess);
+               fprintf(stderr,"Setting Defaults for workerThreads:%d\n",pl2d2->workerThreads);
                fprintf(stderr,"Setting Defaults for pollfreq:%d dependencyTimeOut:%d\n",pl2d2->pollfreq,pl2d2->dependencyTimeOut);
 	       return(0);
       }
@@ -678,41 +696,45 @@ int ParseXmlConfigFile(char *filename ,  _l2d2server *pl2d2 )
              
 	     node_t *pparam_n = roxml_get_chld(item,"pparams",0);
              if ( pparam_n != NULL ) {
-                      node_t *prc_n = roxml_get_attr(pparam_n,"maxNumOfProcess",0);
-                      if ( prc_n != NULL && (c=roxml_get_content(prc_n,bf,sizeof(bf),&size)) != NULL && size > 0 ) {
-	                    if ( (pl2d2->maxNumOfProcess=atoi(bf)) <= 0 ) {
-			              pl2d2->maxNumOfProcess=4;
-			              fprintf(stderr,"Forcing maxNumOfProcess=%d\n",pl2d2->maxNumOfProcess);
-                            } else if ( (pl2d2->maxNumOfProcess=atoi(bf)) > 8 ) {
-			              pl2d2->maxNumOfProcess=8;
-			              fprintf(stderr,"Forcing maxNumOfProcess=%d\n",pl2d2->maxNumOfProcess);
+                      /* maxNumOfProcess and maxClientPerProcess of older configurations are
+                         ignored: one worker process serves every client with a pool of threads */
+                      node_t *pwt_n = roxml_get_attr(pparam_n,"workerThreads",0);
+                      if ( pwt_n != NULL && (c=roxml_get_content(pwt_n,bf,sizeof(bf),&size)) != NULL && size > 0 ) {
+	                    if ( (pl2d2->workerThreads=atoi(bf)) <= 0 ) {
+			              pl2d2->workerThreads=8;
+			              fprintf(stderr,"Forcing workerThreads=%d\n",pl2d2->workerThreads);
+                            } else if ( (pl2d2->workerThreads=atoi(bf)) > 64 ) {
+			              pl2d2->workerThreads=64;
+			              fprintf(stderr,"Forcing workerThreads=%d\n",pl2d2->workerThreads);
                             } else {
-			              fprintf(stderr,"In xml Config File found maxNumOfProcess=%d\n",pl2d2->maxNumOfProcess);
+			              fprintf(stderr,"In xml Config File found workerThreads=%d\n",pl2d2->workerThreads);
                             }
                       } else {
-		            pl2d2->maxNumOfProcess=4;
-                            fprintf(stderr,"Setting Defaults for maxNumOfProcess:%d\n",pl2d2->maxNumOfProcess);
+		            pl2d2->workerThreads=8;
+                            fprintf(stderr,"Setting Defaults for workerThreads:%d\n",pl2d2->workerThreads);
                       }
 
-                      node_t *pmc_n = roxml_get_attr(pparam_n,"maxClientPerProcess",0);
-                      if ( pmc_n != NULL && (c=roxml_get_content(pmc_n,bf,sizeof(bf),&size)) != NULL && size > 0 ) {
-	                    if ( (pl2d2->maxClientPerProcess=atoi(bf)) <= 10 ) {
-			              pl2d2->maxClientPerProcess=50; 
-			              fprintf(stderr,"Forcing maxClientPerProcess=%d\n",pl2d2->maxClientPerProcess);
-                            } else if ( (pl2d2->maxClientPerProcess=atoi(bf)) > 512 ) {
-			              pl2d2->maxClientPerProcess=512;
-			              fprintf(stderr,"Forcing maxClientPerProcess=%d\n",pl2d2->maxClientPerProcess);
+                      node_t *pev_n = roxml_get_attr(pparam_n,"eventLoop",0);
+                      if ( pev_n != NULL && (c=roxml_get_content(pev_n,bf,sizeof(bf),&size)) != NULL && size > 0 ) {
+	                    if ( strcmp(bf,"select") == 0 ) {
+			              pl2d2->eventLoop=L2D2_LOOP_SELECT;
+                            } else if ( strcmp(bf,"epoll") == 0 ) {
+			              pl2d2->eventLoop=L2D2_LOOP_EPOLL;
                             } else {
-			              fprintf(stderr,"In xml Config File found maxClientPerProcess=%d\n",pl2d2->maxClientPerProcess);
+			              pl2d2->eventLoop=L2D2_LOOP_EPOLL;
+			              fprintf(stderr,"Unknown eventLoop=%s, forcing eventLoop=epoll\n",bf);
                             }
-                      } else {
-		            pl2d2->maxClientPerProcess=50;
-                            fprintf(stderr,"Setting Defaults for maxClientPerProcess:%d\n",pl2d2->maxClientPerProcess);
+			    fprintf(stderr,"In xml Config File found eventLoop=%s\n",pl2d2->eventLoop == L2D2_LOOP_SELECT ? "select" : "epoll");
+                      }
+
+                      node_t *pix_n = roxml_get_attr(pparam_n,"nodelogIndex",0);
+                      if ( pix_n != NULL && (c=roxml_get_content(pix_n,bf,sizeof(bf),&size)) != NULL && size > 0 ) {
+	                    pl2d2->nodelogIndex = atoi(bf) != 0 ? 1 : 0;
+			    fprintf(stderr,"In xml Config File found nodelogIndex=%d\n",pl2d2->nodelogIndex);
                       }
              } else {
-		       pl2d2->maxNumOfProcess=4;
-		       pl2d2->maxClientPerProcess=50;
-                       fprintf(stderr,"Setting Defaults for maxNumOfProcess:%d maxClientPerProcess:%d\n",pl2d2->maxNumOfProcess,pl2d2->maxClientPerProcess);
+		       pl2d2->workerThreads=8;
+                       fprintf(stderr,"Setting Defaults for workerThreads:%d\n",pl2d2->workerThreads);
 	     }
 
              
@@ -834,8 +856,7 @@ int ParseXmlConfigFile(char *filename ,  _l2d2server *pl2d2 )
                }
       } else {
              fprintf(stderr,"Incorrect root node name in xml config file:%s ... Setting Defaults \n",filename);
-	     pl2d2->maxNumOfProcess=4;
-	     pl2d2->maxClientPerProcess=20;
+	     pl2d2->workerThreads=8;
 	     pl2d2->pollfreq=30;
 	     pl2d2->dependencyTimeOut=24;
              pl2d2->dzone=0;
@@ -860,7 +881,7 @@ int ParseXmlConfigFile(char *filename ,  _l2d2server *pl2d2 )
 	     sprintf(pl2d2->emailCC,"");
              fprintf(stderr,"Setting Defaults for log directory:%s\n",pl2d2->logdir);
              fprintf(stderr,"Setting Defaults for web directory:%s\n",pl2d2->web);
-	     fprintf(stderr,"Setting Defaults for maxNumOfProcess:%d maxClientPerProcess:%d\n",pl2d2->maxNumOfProcess,pl2d2->maxClientPerProcess);
+	     fprintf(stderr,"Setting Defaults for workerThreads:%d\n",pl2d2->workerThreads);
 	     fprintf(stderr,"Setting Defaults for pollfreq:%d dependencyTimeOut:%d\n",pl2d2->pollfreq,pl2d2->dependencyTimeOut);
       }
 
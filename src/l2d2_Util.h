@@ -43,6 +43,7 @@
 /* function declaration */
 int  removeFile (char *x);
 int  CreateLock (char *x);
+int  setNodeState (const char *, char *, size_t);
 int  touch (char *x);
 int  isFileExists ( const char *x );
 int  Access ( const char *x );
@@ -338,7 +338,7 @@ int main (int argc, char* argv[])
   /* inter user dep. directory */
   snprintf(depdir,sizeof(depdir),"%s/maestrod/dependencies/polling/v%s",buffer,mversion);
 
-  answer = do_Login(sock, pid, node, exp_home, signal, passwdEnt->pw_name, &m5sum);
+  answer = do_Login(sock, pid, node, exp_home, signal, passwdEnt->pw_name, &m5sum, NULL);
   
 
   if ( answer != 0  ) {
@@ -37,13 +37,13 @@
 void get_time (char *btime , int mode )
 {
    struct timeval tv;
-   struct tm* ptm;
+   struct tm tmbuf, *ptm;
    char time_string[40];
    long milliseconds;
 	     
    /* Obtain the time of day, and convert it to a tm struct.  */
    gettimeofday (&tv, NULL);
-   ptm = gmtime (&tv.tv_sec);
+   ptm = gmtime_r (&tv.tv_sec, &tmbuf);
    /* Format the date and time, down to a single second.  */
    strftime (time_string, sizeof (time_string), "%Y%m%d%H%M%S", ptm);
    /* Compute milliseconds from microseconds.  */
@@ -0,0 +1,288 @@
+/* l2d2_depwatch.c - Index of the polling dependencies of the maestro server.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include "l2d2_depwatch.h"
+#include "l2d2_commun.h"
+
+#define DEPWATCH_POLL_EVENTS  (IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+#define DEPWATCH_LOCK_EVENTS  (IN_CREATE | IN_MOVED_TO | IN_ATTRIB)
+
+/* FNV-1a */
+static unsigned int DepWatch_hash ( const char *s )
+{
+     unsigned int h = 2166136261u;
+
+     while ( *s != '\0' ) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+     }
+     return( h % DEPWATCH_BUCKETS );
+}
+
+/* copy path without its doubled slashes */
+static void DepWatch_path ( char *dst, size_t size, const char *path )
+{
+     size_t n = 0;
+
+     for ( ; *path != '\0' && n < size - 1; path++ ) {
+        if ( *path == '/' && n > 0 && dst[n-1] == '/' ) continue;
+        dst[n++] = *path;
+     }
+     dst[n] = '\0';
+}
+
+/**
+ * Name        : DepWatch_init
+ * Description : start an empty index and watch the polling directory.
+ * Return value: 0 with inotify, 1 if the directories can only be polled
+ */
+int DepWatch_init ( l2d2depwatch *w, const char *pollDir, FILE *log )
+{
+     memset(w,'\0',sizeof(l2d2depwatch));
+     w->pollwd = -1;
+     if ( (w->fd=inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ) {
+          fprintf(log,"DepWatch_init(): inotify_init1 failed errno=%d\n",errno);
+          return(1);
+     }
+     if ( (w->pollwd=inotify_add_watch(w->fd, pollDir, DEPWATCH_POLL_EVENTS)) < 0 ) {
+          fprintf(log,"DepWatch_init(): cannot watch %s errno=%d\n",pollDir,errno);
+          close(w->fd);
+          w->fd = -1;
+          return(1);
+     }
+     return(0);
+}
+
+/* the dependency registered by the name entry of the polling directory */
+l2d2dep *DepWatch_find ( l2d2depwatch *w, const char *name )
+{
+     l2d2dep *dep;
+
+     for ( dep = w->all; dep != NULL; dep = dep->next ) {
+         if ( strcmp(dep->name, name) == 0 ) return(dep);
+     }
+     return(NULL);
+}
+
+/**
+ * Name        : DepWatch_add
+ * Description : index a dependency by its lock file and watch the directory
+ *               of the lock file. dp now belongs to the index.
+ */
+l2d2dep *DepWatch_add ( l2d2depwatch *w, const char *name, const char *link, struct _depParameters *dp, FILE *log )
+{
+     l2d2dep *dep;
+     unsigned int h;
+
+     dep = (l2d2dep *) xmalloc(sizeof(l2d2dep));
+     memset(dep,'\0',sizeof(l2d2dep));
+     snprintf(dep->name,sizeof(dep->name),"%s",name);
+     snprintf(dep->link,sizeof(dep->link),"%s",link);
+     DepWatch_path(dep->lock,sizeof(dep->lock),dp->xpd_lock);
+     dep->dp = dp;
+     dep->wd = -1;
+     time(&dep->added);
+
+     h = DepWatch_hash(dep->lock);
+     dep->lnext = w->bucket[h];
+     w->bucket[h] = dep;
+     dep->next = w->all;
+     w->all = dep;
+
+     DepWatch_watch(w, dep, log);
+     return(dep);
+}
+
+/* remove a dependency from the index, the directory of its lock file is no longer watched by the last one */
+void DepWatch_remove ( l2d2depwatch *w, l2d2dep *dep )
+{
+     l2d2dep **pp;
+     int i;
+
+     for ( pp = &w->bucket[DepWatch_hash(dep->lock)]; *pp != NULL; pp = &(*pp)->lnext ) {
+         if ( *pp == dep ) {
+             *pp = dep->lnext;
+             break;
+         }
+     }
+     for ( pp = &w->all; *pp != NULL; pp = &(*pp)->next ) {
+         if ( *pp == dep ) {
+             *pp = dep->next;
+             break;
+         }
+     }
+     if ( dep->wd >= 0 ) {
+         for ( i = 0; i < w->ndirs; i++ ) {
+             if ( w->dirs[i].wd == dep->wd && --w->dirs[i].refs == 0 ) {
+                 inotify_rm_watch(w->fd, w->dirs[i].wd);
+                 w->dirs[i] = w->dirs[--w->ndirs];
+                 break;
+             }
+         }
+     }
+     free(dep->dp);
+     free(dep);
+}
+
+/**
+ * Name        : DepWatch_watch
+ * Description : watch the directory of the lock file of dep if not done yet.
+ *               A directory that does not exist yet (datestamp not started)
+ *               is tried again at the next rescan.
+ */
+void DepWatch_watch ( l2d2depwatch *w, l2d2dep *dep, FILE *log )
+{
+     char dir[1024], *slash;
+     int i, wd;
+
+     if ( w->fd < 0 || dep->wd >= 0 ) return;
+     snprintf(dir,sizeof(dir),"%s",dep->lock);
+     if ( (slash=strrchr(dir,'/')) == NULL || slash == dir ) return;
+     *slash = '\0';
+
+     if ( (wd=inotify_add_watch(w->fd, dir, DEPWATCH_LOCK_EVENTS)) < 0 ) {
+         if ( errno != ENOENT ) fprintf(log,"DepWatch_watch(): cannot watch %s errno=%d\n",dir,errno);
+         return;
+     }
+     dep->wd = wd;
+     for ( i = 0; i < w->ndirs; i++ ) {
+         if ( w->dirs[i].wd == wd ) {
+             w->dirs[i].refs++;
+             return;
+         }
+     }
+     if ( w->ndirs == w->maxdirs ) {
+         w->maxdirs = w->maxdirs > 0 ? 2 * w->maxdirs : 16;
+         if ( (w->dirs=(l2d2depdir *) realloc(w->dirs, w->maxdirs * sizeof(l2d2depdir))) == NULL ) {
+             fprintf(log,"DepWatch_watch(): out of memory\n");
+             exit(1);
+         }
+     }
+     w->dirs[w->ndirs].wd = wd;
+     w->dirs[w->ndirs].refs = 1;
+     snprintf(w->dirs[w->ndirs].dir,sizeof(w->dirs[w->ndirs].dir),"%s",dir);
+     w->ndirs++;
+}
+
+/**
+ * Name        : DepWatch_wait
+ * Description : wait up to timeout seconds for events, only sleeps without inotify.
+ * Return value: 1 if there are events to read, 0 otherwise
+ */
+int DepWatch_wait ( l2d2depwatch *w, int timeout )
+{
+     struct pollfd pfd;
+
+     if ( timeout < 0 ) timeout = 0;
+     if ( w->fd < 0 ) {
+         sleep(timeout);
+         return(0);
+     }
+     pfd.fd = w->fd;
+     pfd.events = POLLIN;
+     return( poll(&pfd, 1, timeout * 1000) > 0 );
+}
+
+/**
+ * Name        : DepWatch_read
+ * Description : read the pending events: new entries of the polling directory
+ *               go to w->created, removed ones are marked gone and the
+ *               dependencies of the lock files touched are marked ready.
+ *               A lost event sets w->rescan.
+ * Return value: number of dependencies or entries to look at
+ */
+int DepWatch_read ( l2d2depwatch *w, FILE *log )
+{
+     char buf[16384] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+     char path[1024];
+     const struct inotify_event *ev;
+     l2d2depname *dn;
+     l2d2dep *dep;
+     ssize_t len;
+     char *p;
+     int i, count = 0;
+
+     if ( w->fd < 0 ) return(0);
+     while ( (len=read(w->fd, buf, sizeof(buf))) > 0 ) {
+        for ( p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len ) {
+           ev = (const struct inotify_event *) p;
+           if ( ev->mask & IN_Q_OVERFLOW ) {
+               fprintf(log,"DepWatch_read(): inotify queue overflow\n");
+               w->rescan = 1;
+               continue;
+           }
+           if ( ev->mask & IN_IGNORED ) {
+               /* directory removed: its dependencies are watched again at the next rescan */
+               for ( i = 0; i < w->ndirs; i++ ) {
+                   if ( w->dirs[i].wd == ev->wd ) {
+                       w->dirs[i] = w->dirs[--w->ndirs];
+                       break;
+                   }
+               }
+               for ( dep = w->all; dep != NULL; dep = dep->next ) {
+                   if ( dep->wd == ev->wd ) dep->wd = -1;
+               }
+               continue;
+           }
+           if ( ev->len == 0 ) continue;
+
+           if ( ev->wd == w->pollwd ) {
+               if ( ev->name[0] == '.' ) continue;
+               if ( ev->mask & (IN_DELETE | IN_MOVED_FROM) ) {
+                   if ( (dep=DepWatch_find(w, ev->name)) != NULL ) {
+                       dep->gone = 1;
+                       count++;
+                   }
+               } else if ( DepWatch_find(w, ev->name) == NULL ) {
+                   for ( dn = w->created; dn != NULL && strcmp(dn->name, ev->name) != 0; dn = dn->next );
+                   if ( dn == NULL ) {
+                       dn = (l2d2depname *) xmalloc(sizeof(l2d2depname));
+                       snprintf(dn->name,sizeof(dn->name),"%s",ev->name);
+                       dn->next = w->created;
+                       w->created = dn;
+                       count++;
+                   }
+               }
+               continue;
+           }
+
+           for ( i = 0; i < w->ndirs && w->dirs[i].wd != ev->wd; i++ );
+           if ( i == w->ndirs ) continue;
+           if ( snprintf(path,sizeof(path),"%s/%s",w->dirs[i].dir,ev->name) >= (int) sizeof(path) ) {
+               fprintf(log,"DepWatch_read(): skipped event, path too long %s/%s\n",w->dirs[i].dir,ev->name);
+               continue;
+           }
+           for ( dep = w->bucket[DepWatch_hash(path)]; dep != NULL; dep = dep->lnext ) {
+               if ( strcmp(dep->lock, path) == 0 && ! dep->ready ) {
+                   dep->ready = 1;
+                   count++;
+               }
+           }
+        }
+     }
+     return(count);
+}
@@ -0,0 +1,84 @@
+/* l2d2_depwatch.h - Index of the polling dependencies of the maestro server.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <time.h>
+#include "l2d2_server.h"
+#ifndef L2D2_DEPWATCH_H
+#define L2D2_DEPWATCH_H
+
+#define DEPWATCH_BUCKETS  1024   /* hash buckets of the lock files */
+
+/* a dependency registered in the polling directory */
+typedef struct _l2d2dep
+{
+	char    name[256];          /* entry of the polling directory */
+	char    link[1024];         /* dependency file it points to */
+	char    lock[1024];         /* dp->xpd_lock without doubled slashes */
+	struct _depParameters *dp;  /* parsed dependency file */
+	int     wd;                 /* watch of the directory of dp->xpd_lock, -1 if none */
+	int     ready;              /* lock file touched since last evaluation */
+	int     retry;              /* evaluate again in a second */
+	time_t  added;
+	int     gone;               /* entry removed from the polling directory */
+	int     seen;               /* found by the current rescan */
+	struct _l2d2dep *lnext;     /* next one of the same bucket */
+	struct _l2d2dep *next;
+} l2d2dep;
+
+/* entries created in the polling directory, not indexed yet */
+typedef struct _l2d2depname
+{
+	char    name[256];
+	struct _l2d2depname *next;
+} l2d2depname;
+
+/* a watched directory of lock files */
+typedef struct
+{
+	int     wd;
+	int     refs;               /* dependencies waiting in it */
+	char    dir[1024];
+} l2d2depdir;
+
+typedef struct
+{
+	int          fd;            /* inotify, -1 when the directories are only polled */
+	int          pollwd;        /* watch of the polling directory */
+	l2d2dep     *all;
+	l2d2dep     *bucket[DEPWATCH_BUCKETS];
+	l2d2depname *created;       /* from the events, see DepWatch_read */
+	l2d2depdir  *dirs;
+	int          ndirs;
+	int          maxdirs;
+	int          rescan;        /* events were lost, the directories must be read */
+} l2d2depwatch;
+
+/* forward function declarations */
+int      DepWatch_init ( l2d2depwatch *w, const char *pollDir, FILE *log );
+l2d2dep *DepWatch_find ( l2d2depwatch *w, const char *name );
+l2d2dep *DepWatch_add ( l2d2depwatch *w, const char *name, const char *link, struct _depParameters *dp, FILE *log );
+void     DepWatch_remove ( l2d2depwatch *w, l2d2dep *dep );
+void     DepWatch_watch ( l2d2depwatch *w, l2d2dep *dep, FILE *log );
+int      DepWatch_wait ( l2d2depwatch *w, int timeout );
+int      DepWatch_read ( l2d2depwatch *w, FILE *log );
+
+#endif
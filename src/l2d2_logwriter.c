@@ -0,0 +1,389 @@
+/* l2d2_logwriter.c - Group commit writer of nodelog files for the maestro server.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "l2d2_logwriter.h"
+#include "l2d2_commun.h"
+#include "l2d2_socket.h"
+#include "SeqLogSpool.h"
+#include "SeqLogIndex.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/* lines waiting for the writer thread */
+static l2d2logline *QueueHead = NULL, *QueueTail = NULL;
+static pthread_mutex_t QueueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  QueueCond  = PTHREAD_COND_INITIALIZER;
+
+/* nodelog files kept open by the writer thread, least recently used is closed first */
+typedef struct {
+	char   path[1024];
+	int    fd;
+	dev_t  dev;
+	ino_t  ino;
+	unsigned long used;  /* batch number of last use */
+	int    err;          /* errno of a failure in the current batch */
+	l2d2logline *head;   /* lines of the current batch */
+	l2d2logline *tail;
+	int    indexed;      /* a nodelog whose index is kept */
+	SeqLogIndex *index;  /* opened by the first update */
+} logfile;
+
+static logfile FdCache[LOGWRITER_FD_CACHE];
+static unsigned long BatchNumber = 0;
+static int IndexLogs = 0;
+
+/*
+ * A line of text for the file path followed by suffix.
+ */
+static l2d2logline *logline_new ( const char *path, size_t plen, const char *suffix, const char *text, size_t tlen )
+{
+     l2d2logline *ln;
+     size_t slen = strlen(suffix);
+
+     ln = (l2d2logline *) xmalloc(sizeof(l2d2logline) + plen + slen + tlen + 3);
+     memset(ln,'\0',sizeof(l2d2logline));
+     ln->path = (char *) (ln + 1);
+     memcpy(ln->path, path, plen);
+     memcpy(ln->path + plen, suffix, slen);
+     ln->path[plen+slen] = '\0';
+     ln->text = ln->path + plen + slen + 1;
+     memcpy(ln->text, text, tlen);
+     ln->text[tlen] = '\n';
+     ln->text[tlen+1] = '\0';
+     ln->len = tlen + 1;
+     return(ln);
+}
+
+/*
+ * Split "user:path:line" into path and line, 0 if malformed.
+ */
+static int logline_parse ( const char *request, const char **path, size_t *plen, const char **text, size_t *tlen )
+{
+     const char *eol;
+
+     if ( request == NULL || (*path=strchr(request,':')) == NULL || *path == request ) return(0);
+     (*path)++;
+     if ( (*text=strchr(*path,':')) == NULL || *text == *path ) return(0);
+     *plen = *text - *path;
+     (*text)++;
+     if ( (eol=strchr(*text,'\n')) == NULL ) eol = *text + strlen(*text);
+     *tlen = eol - *text;
+     return(*tlen > 0);
+}
+
+/**
+ * Name        : LogWriter_newLine
+ * Description : build a line from a nodelogger request "user:path:line",
+ *               same format as parsed by NodeLogr.
+ * Return value: the line to submit, NULL if the request is malformed
+ */
+l2d2logline *LogWriter_newLine ( const char *request )
+{
+     const char *path, *text;
+     size_t plen, tlen;
+
+     if ( ! logline_parse(request, &path, &plen, &text, &tlen) || plen >= sizeof(FdCache[0].path) ) return(NULL);
+     return(logline_new(path, plen, "", text, tlen));
+}
+
+/**
+ * Name        : LogWriter_newLines
+ * Description : build the lines of a request "targets user:prefix:line"
+ *               logging line once to each log of targets, prefix_nodelog
+ *               for L2D2_LOG_NODELOG and prefix_toplog for L2D2_LOG_TOPLOG.
+ * Return value: the number of lines put in lines, 0 if the request is malformed
+ */
+int LogWriter_newLines ( const char *request, l2d2logline *lines[2] )
+{
+     const char *path, *text;
+     char *end;
+     size_t plen, tlen;
+     long targets;
+     int n = 0;
+
+     if ( request == NULL ) return(0);
+     targets = strtol(request, &end, 10);
+     if ( end == request || *end != ' ' || (targets & ~(L2D2_LOG_NODELOG|L2D2_LOG_TOPLOG)) != 0 ) return(0);
+     if ( ! logline_parse(end + 1, &path, &plen, &text, &tlen) || plen + sizeof("_nodelog") > sizeof(FdCache[0].path) ) return(0);
+
+     if ( targets & L2D2_LOG_NODELOG ) {
+          lines[n] = logline_new(path, plen, "_nodelog", text, tlen);
+          lines[n++]->target = L2D2_LOG_NODELOG;
+     }
+     if ( targets & L2D2_LOG_TOPLOG ) {
+          lines[n] = logline_new(path, plen, "_toplog", text, tlen);
+          lines[n++]->target = L2D2_LOG_TOPLOG;
+     }
+     return(n);
+}
+
+/**
+ * Name        : LogWriter_submit
+ * Description : queue a line for the writer thread, ln->done is called
+ *               once the line is durable.
+ */
+void LogWriter_submit ( l2d2logline *ln )
+{
+     ln->next = NULL;
+     pthread_mutex_lock(&QueueMutex);
+     if ( QueueTail == NULL )
+          QueueHead = ln;
+     else
+          QueueTail->next = ln;
+     QueueTail = ln;
+     /* the writer only sleeps on an empty queue */
+     if ( QueueHead == ln ) pthread_cond_signal(&QueueCond);
+     pthread_mutex_unlock(&QueueMutex);
+}
+
+/*
+ * Return the cache slot of a nodelog file opened for appending, -1 if
+ * every slot already has lines in this batch.
+ */
+static int logfile_get ( const char *path )
+{
+     struct stat st;
+     int i, slot = -1;
+
+     for ( i = 0; i < LOGWRITER_FD_CACHE; i++ ) {
+          if ( (FdCache[i].fd >= 0 || FdCache[i].used == BatchNumber) && strcmp(FdCache[i].path, path) == 0 ) {
+               slot = i;
+               break;
+          }
+     }
+
+     if ( slot < 0 ) {
+          /* take a free slot or the least recently used file not part of this batch */
+          for ( i = 0; i < LOGWRITER_FD_CACHE; i++ ) {
+               if ( FdCache[i].used == BatchNumber ) continue;
+               if ( FdCache[i].fd < 0 ) {
+                    slot = i;
+                    break;
+               }
+               if ( slot < 0 || FdCache[i].used < FdCache[slot].used ) slot = i;
+          }
+          if ( slot < 0 ) return(-1);
+          if ( FdCache[slot].fd >= 0 ) close(FdCache[slot].fd);
+          FdCache[slot].fd = -1;
+          SeqLogIndex_close(FdCache[slot].index);
+          FdCache[slot].index = NULL;
+          snprintf(FdCache[slot].path, sizeof(FdCache[slot].path), "%s", path);
+          i = strlen(path);
+          FdCache[slot].indexed = IndexLogs && i >= 8 && strcmp(path + i - 8, "_nodelog") == 0;
+     } else if ( FdCache[slot].used != BatchNumber ) {
+          /* once per batch, make sure the file was not removed or replaced since opened */
+          if ( stat(path,&st) != 0 || st.st_ino != FdCache[slot].ino || st.st_dev != FdCache[slot].dev ) {
+               close(FdCache[slot].fd);
+               FdCache[slot].fd = -1;
+          }
+     }
+
+     if ( FdCache[slot].used != BatchNumber ) {
+          /* lines spooled while the server was unreachable go before the batch */
+          SeqLogSpool_merge(path);
+          FdCache[slot].used = BatchNumber;
+          FdCache[slot].err = 0;
+          FdCache[slot].head = FdCache[slot].tail = NULL;
+          if ( FdCache[slot].fd < 0 ) {
+               if ( (FdCache[slot].fd = open(path, O_WRONLY|O_APPEND|O_CREAT, 00666)) < 0 ) {
+                    FdCache[slot].err = errno;
+               } else if ( fstat(FdCache[slot].fd,&st) == 0 ) {
+                    FdCache[slot].dev = st.st_dev;
+                    FdCache[slot].ino = st.st_ino;
+               }
+          }
+     }
+     return(slot);
+}
+
+/*
+ * writev() the whole iovec, resuming after short writes.
+ * Returns 0 or the errno of the failure.
+ */
+static int writev_full ( int fd, struct iovec *iov, int n )
+{
+     ssize_t num;
+
+     while ( n > 0 ) {
+          if ( (num = writev(fd, iov, n)) < 0 ) {
+               if ( errno == EINTR ) continue;
+               return(errno);
+          }
+          while ( n > 0 && (size_t) num >= iov->iov_len ) {
+               num -= iov->iov_len;
+               iov++;
+               n--;
+          }
+          if ( n > 0 ) {
+               iov->iov_base = (char *) iov->iov_base + num;
+               iov->iov_len -= num;
+          }
+     }
+     return(0);
+}
+
+/*
+ * Append the lines of one file of the batch with as few writev() as
+ * possible, then fsync once.
+ */
+static void logfile_write ( logfile *lf )
+{
+     struct iovec iov[IOV_MAX];
+     l2d2logline *ln = lf->head;
+     int n;
+
+     while ( ln != NULL && lf->err == 0 ) {
+          for ( n = 0; ln != NULL && n < IOV_MAX; ln = ln->fnext, n++ ) {
+               iov[n].iov_base = ln->text;
+               iov[n].iov_len  = ln->len;
+          }
+          lf->err = writev_full(lf->fd, iov, n);
+     }
+
+     if ( lf->err == 0 && fsync(lf->fd) != 0 ) lf->err = errno;
+
+     /* a descriptor in error is reopened next time */
+     if ( lf->err != 0 ) {
+          close(lf->fd);
+          lf->fd = -1;
+     }
+}
+
+/*
+ * Bring the index of a nodelog of the batch up to its text.
+ */
+static void logfile_index ( logfile *lf )
+{
+     if ( lf->index == NULL && (lf->index = SeqLogIndex_open(lf->path)) == NULL ) return;
+     SeqLogIndex_update(lf->index);
+}
+
+/*
+ * Write a line whose file could not get a cache slot.
+ */
+static int logline_write_uncached ( l2d2logline *ln )
+{
+     struct iovec iov;
+     int fd, err;
+
+     SeqLogSpool_merge(ln->path);
+     if ( (fd = open(ln->path, O_WRONLY|O_APPEND|O_CREAT, 00666)) < 0 ) return(errno);
+     iov.iov_base = ln->text;
+     iov.iov_len  = ln->len;
+     if ( (err = writev_full(fd, &iov, 1)) == 0 && fsync(fd) != 0 ) err = errno;
+     close(fd);
+     return(err);
+}
+
+/*
+ * Writer thread: take every queued line, group them per file, write and
+ * fsync each file once, then call back the submitters in queue order.
+ */
+static void *logwriter_thread ( void *arg )
+{
+     l2d2logline *batch, *ln, *next;
+     logfile *lf;
+     int i;
+
+     for (;;) {
+          /* the lines queued while the previous batch was written and synced
+             make this batch: the window is the fsync itself, no timer */
+          pthread_mutex_lock(&QueueMutex);
+          while ( QueueHead == NULL ) pthread_cond_wait(&QueueCond, &QueueMutex);
+          batch = QueueHead;
+          QueueHead = QueueTail = NULL;
+          pthread_mutex_unlock(&QueueMutex);
+
+          BatchNumber++;
+
+          /* group the lines per file, keeping their order */
+          for ( ln = batch; ln != NULL; ln = ln->next ) {
+               ln->fnext = NULL;
+               ln->err = 0;
+               if ( (ln->slot = logfile_get(ln->path)) < 0 ) {
+                    ln->err = logline_write_uncached(ln);
+                    continue;
+               }
+               lf = &FdCache[ln->slot];
+               if ( lf->tail == NULL )
+                    lf->head = ln;
+               else
+                    lf->tail->fnext = ln;
+               lf->tail = ln;
+          }
+
+          for ( i = 0; i < LOGWRITER_FD_CACHE; i++ ) {
+               lf = &FdCache[i];
+               if ( lf->used == BatchNumber && lf->err == 0 && lf->head != NULL ) logfile_write(lf);
+          }
+
+          /* the batch is durable, answer */
+          for ( ln = batch; ln != NULL; ln = next ) {
+               next = ln->next;
+               if ( ln->slot >= 0 ) ln->err = FdCache[ln->slot].err;
+               ln->status = ln->err == 0 ? 0 : 1;
+               if ( ln->done != NULL ) ln->done(ln, ln->arg);
+               free(ln);
+          }
+
+          /* the submitters do not wait for the indexes */
+          for ( i = 0; i < LOGWRITER_FD_CACHE; i++ ) {
+               lf = &FdCache[i];
+               if ( lf->used == BatchNumber && lf->err == 0 && lf->indexed ) logfile_index(lf);
+          }
+     }
+     return(NULL);
+}
+
+/**
+ * Name        : LogWriter_start
+ * Description : start the writer thread, once per process; with index
+ *               set, the binary index of the nodelog files written
+ *               (SeqLogIndex.h) is kept after each batch.
+ * Return value: 0 success, 1 failure
+ */
+int LogWriter_start ( int index )
+{
+     pthread_t tid;
+     pthread_attr_t attr;
+     int i, ret;
+
+     for ( i = 0; i < LOGWRITER_FD_CACHE; i++ ) FdCache[i].fd = -1;
+     IndexLogs = index;
+
+     pthread_attr_init(&attr);
+     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+     ret = pthread_create(&tid, &attr, logwriter_thread, NULL);
+     pthread_attr_destroy(&attr);
+     return( ret == 0 ? 0 : 1 );
+}
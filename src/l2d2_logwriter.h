@@ -0,0 +1,55 @@
+/* l2d2_logwriter.h - Group commit writer of nodelog files for the maestro server.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdio.h>
+#ifndef L2D2_LOGWRITER_H
+#define L2D2_LOGWRITER_H
+
+#define LOGWRITER_FD_CACHE   64     /* nodelog files kept open */
+
+/* one line to append to a nodelog file */
+typedef struct _l2d2logline
+{
+	char   *path;      /* nodelog file */
+	char   *text;      /* line with its newline */
+	size_t  len;
+	int     status;    /* 0 once the line is on disk, 1 if it could not be written */
+	int     err;       /* errno of the failure */
+	/* called by the writer thread once the batch holding the line is
+	   durable, the line is freed on return */
+	void  (*done) ( struct _l2d2logline *ln, void *arg );
+	void   *arg;
+	unsigned int tag;  /* free for the submitter */
+	int     target;    /* L2D2_LOG_NODELOG or L2D2_LOG_TOPLOG for lines of LogWriter_newLines */
+	int     failed;    /* free for the submitter: targets failed among the lines of a request */
+	struct _l2d2logline *next;
+	/* private to the writer */
+	int     slot;
+	struct _l2d2logline *fnext;
+} l2d2logline;
+
+/* forward function declarations */
+l2d2logline *LogWriter_newLine ( const char *request );
+int  LogWriter_newLines ( const char *request, l2d2logline *lines[2] );
+int  LogWriter_start ( int index );
+void LogWriter_submit ( l2d2logline *ln );
+
+#endif
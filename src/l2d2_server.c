@@ -42,15 +42,20 @@
 #include <sys/select.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#define L2D2_HAVE_EPOLL
+#endif
 #include "l2d2_Util.h"
 #include "l2d2_server.h"
 #include "l2d2_socket.h"
+#include "l2d2_commun.h"
+#include "l2d2_logwriter.h"
+#include "l2d2_depwatch.h"
+#include "SeqRateLimit.h"
 
-#define MAX_PROCESS 8                     /* max number of Transient workers */
 #define ETERNAL_WORKER_STIMEOUT   1*60    /* 1 minute */
-#define TRANSIENT_WORKER_STIMEOUT 5*60
-
-#define SPAWNING_DELAY_TIME  5 /* seconds */
 
 #define NOTIF_TIME_INTVAL_EW 2*60         /* heartbeat for EW */ 
 #define NOTIF_TIME_INTVAL_DM 3*60
@@ -58,27 +63,33 @@
 #define TRUE 1
 #define FALSE 0
 
-#define MAX_LOCK_TRY 11
+#define L2D2_REQUEST_SIZE      1024        /* size of the fixed requests sent by the clients */
+#define L2D2_CLIENT_RBUF_MAX   16*1024     /* max pending bytes of one client request */
+#define L2D2_CLIENT_TABLE_INIT 1024        /* initial size of the connection table */
+#define L2D2_EPOLL_EVENTS      256         /* events handled per epoll_wait() */
 
 /* forward functions & vars declarations */
+static void maestro_l2d2_main_process_server (int fserver);
+static void l2d2server_shutdown (pid_t pid , FILE *fp);
+static void l2d2server_remove (FILE *fp);
+static void l2d2Servlet( int sock );
+static void l2d2SelectServlet( int sock , _l2d2worker *wrk );
+static void l2d2EpollServlet( int sock , _l2d2worker *wrk );
 extern void logZone(int , int , FILE *fp , char * , ...);
 extern char *page_start_dep , *page_end_dep;
 
 /* globals vars */
 unsigned int pidTken = 0;
-unsigned int ChildPids[MAX_PROCESS]={0};
 unsigned long int epoch_diff;
 double diff_t;
 
 /* global default data for l2d2server */
 _clean_times L2D2_cleantimes = {1,48,48,25,25};
-_l2d2server L2D2 = {0,0,0,0,30,24,1,4,20,'\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0',0,0};
+_l2d2server L2D2 = {0,0,0,0,30,24,1,'\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0','\0',0,0};
 
 /* variable for Signal handlers */
-volatile sig_atomic_t ProcessCount = 0; /* number of workers */
 volatile sig_atomic_t sig_depend = 0;
 volatile sig_atomic_t sig_admin_Terminate = 0;
-volatile sig_atomic_t sig_admin_AddWorker = 0;
 volatile sig_atomic_t sig_recv = 0;
 volatile sig_atomic_t sig_child = 0;
 
@@ -102,14 +113,254 @@ static void sig_admin(int signo, siginfo_t *siginfo, void *context) {
         case SIGUSR1: 
 	             sig_admin_Terminate = 1; 
 		     break;
-        case SIGUSR2:
-		     sig_admin_AddWorker = 1;
+        case SIGUSR2: /* used to add a transient worker, now served by the thread pool */
 		     break;
         default:
 		     break;
     }
 }
 
+/**
+   Evaluate one dependency: drop it if its dependency file is gone, if the
+   dependant node is no longer waiting or if it timed out, submit the
+   dependant node if the lock file is there.
+   Returns 1 when the dependency is done with and leaves the index.
+*/
+static int DM_evaluate ( _l2d2server *l2d2, l2d2dep *dep, time_t current_epoch, FILE *dmlg )
+{
+     struct _depParameters *depXp=dep->dp;
+     char buf[1024];
+     char cmd[2048];
+     char listings[1024];
+     char largs[128];
+     char ffilename[512];
+     char Time[40];
+     char *pleaf=NULL;
+     int ret=0;
+
+     snprintf(ffilename,sizeof(ffilename),"%s/%s",l2d2->dependencyPollDir,dep->name);
+     memset(buf,'\0',sizeof(buf)); memset(cmd,'\0',sizeof(cmd));
+
+     if ( access(dep->link,R_OK) != 0 ) {
+          get_time(Time,1);
+          fprintf(dmlg,"DependencyManager():%s inter-dependency file not there, removing link at:%s ... \n",dep->link,Time);
+          unlink(ffilename);
+          return(1);
+     }
+
+     /* Is dependant node still in waiting state? If not, do not submit. A node
+        registers its dependency just before it goes waiting: give it a while. */
+     if (l2d2_Util_isNodeXState (depXp->xpd_snode, depXp->xpd_slargs, depXp->xpd_sxpdate, depXp->xpd_sname, "waiting") == 0) {
+          if ( difftime(current_epoch,dep->added) < l2d2->pollfreq ) {
+               dep->retry = access(depXp->xpd_lock,R_OK) == 0;
+               return(0);
+          }
+          get_time(Time,2);
+          fprintf(dmlg,"%s Removing dependency (waiting state of dependant gone) ffilename=%s ; linkname=%s\n",Time, ffilename,dep->link);
+          unlink(dep->link);
+          unlink(ffilename);
+          return(1);
+     }
+
+     if ( strcmp(depXp->xpd_slargs,"") != 0 )
+          snprintf(largs,sizeof(largs),"-l \"%s\"",depXp->xpd_slargs);
+     else
+          strcpy(largs,"");
+
+     /* before trying to access lock file, see if dependency is still active */
+     epoch_diff=(int)(current_epoch - atoi(depXp->xpd_regtimepoch))/3600;
+     if ( epoch_diff >= l2d2->dependencyTimeOut ) {
+          ret=unlink(dep->link);
+          ret=unlink(ffilename);
+          fprintf(dmlg,"============= Dependency Timed Out ============\n");
+          fprintf(dmlg,"DependencyManager(): Dependency:%s Timed Out\n",dep->name);
+          fprintf(dmlg,"source     exp  name:%s\n",depXp->xpd_sname);
+          fprintf(dmlg,"dependency node name:%s\n",depXp->xpd_name);
+          fprintf(dmlg,"current_epoch=%d registred_epoch=%d epoch_diff(hours)=%lu\n",current_epoch,atoi(depXp->xpd_regtimepoch), epoch_diff);
+          fprintf(dmlg,"\n");
+
+          /* log into exp. nodelog file */
+          get_time(Time,1);
+          snprintf(buf,sizeof(buf),"Dependency on exp:%s node:%s from exp:%s and node:%s Timed out. Removed by mserver at:%s",depXp->xpd_name, depXp->xpd_node, depXp->xpd_sname, depXp->xpd_snode, Time);
+          snprintf(cmd,sizeof(cmd),"exec >/dev/null 2>&1;%s; export SEQ_EXP_HOME=%s; export SEQ_DATE=%s; nodelogger -n %s %s -s info -m \"%s\" ",l2d2->mshortcut, depXp->xpd_sname, depXp->xpd_sxpdate, depXp->xpd_snode, largs, buf);
+          ret=system(cmd);
+
+          /* do an initnode */
+          memset(cmd,'\0',sizeof(cmd));
+          snprintf(cmd,sizeof(cmd),"%s; export SEQ_EXP_HOME=%s; export SEQ_DATE=%s; maestro -s initnode -n %s %s",l2d2->mshortcut, depXp->xpd_sname, depXp->xpd_sxpdate, depXp->xpd_snode, largs);
+          ret=system(cmd);
+          return(1);
+     }
+
+     if ( access(depXp->xpd_lock,R_OK) != 0 ) return(0);
+
+     get_time(Time,4);
+     pleaf=(char *) getPathLeaf(depXp->xpd_snode);
+     /* where to put listing: xp/listings/server_host/datestamp/node_container/node_name_and_loop */
+     memset(listings,'\0',sizeof(listings));
+     snprintf(listings,sizeof(listings),"%s/listings/%s%s",depXp->xpd_sname, l2d2->host, depXp->xpd_container);
+     if ( access(listings,R_OK) != 0 )  ret=r_mkdir(listings,1,dmlg);
+     if ( ret != 0 ) fprintf(dmlg,"DM:Could not create directory:%s\n",listings);
+     memset(listings,'\0',sizeof(listings));
+     if ( strcmp(depXp->xpd_slargs,"") != 0 ) {
+          snprintf(listings,sizeof(listings),"%s/listings/%s/%s/%s_%s.submit.mserver.%s.%s",depXp->xpd_sname,l2d2->host, depXp->xpd_container,pleaf,depXp->xpd_slargs,depXp->xpd_sxpdate,Time);
+     } else {
+          snprintf(listings,sizeof(listings),"%s/listings/%s/%s/%s.submit.mserver.%s.%s",depXp->xpd_sname,l2d2->host, depXp->xpd_container,pleaf,depXp->xpd_sxpdate,Time);
+     }
+     /* build command */
+     snprintf(cmd,sizeof(cmd),"%s >/dev/null 2>&1; export SEQ_EXP_HOME=%s; export SEQ_DATE=%s; maestro -s submit -n %s %s -f %s >%s 2>&1",
+              l2d2->mshortcut, depXp->xpd_sname, depXp->xpd_sxpdate, depXp->xpd_snode, largs, depXp->xpd_flow, listings);
+     fprintf(dmlg,"dependency submit cmd=%s\n",cmd);
+     /* take account of concurrency here ie multiple dependency managers! */
+     snprintf(buf,sizeof(buf),"%s/.%s",l2d2->dependencyPollDir,dep->name);
+     if ( rename(ffilename,buf) == 0 ) {
+          ret=unlink(buf);
+          ret=unlink(dep->link);
+          ret=system(cmd);
+     }
+     return(1);
+}
+
+/**
+   Index the dependency registered by the name entry of the polling
+   directory, it is evaluated with the next events. Dangling links are
+   removed. Returns the dependency, NULL if the entry is not one.
+*/
+static l2d2dep *DM_register ( _l2d2server *l2d2, l2d2depwatch *watch, const char *name, FILE *dmlg )
+{
+     struct _depParameters *depXp=NULL;
+     struct stat st;
+     l2d2dep *dep;
+     char ffilename[512], linkname[1024], underline[2], extension[256];
+     char Time[40];
+     int r, datestamp;
+
+     /* skip hidden files */
+     if ( name[0] == '.' ) return(NULL);
+     snprintf(ffilename,sizeof(ffilename),"%s/%s",l2d2->dependencyPollDir,name);
+
+     /* stat will stat the file pointed to ... lstat will stat the link itself */
+     if ( stat(ffilename,&st) != 0 ) {
+          get_time(Time,1);
+          if ( (r=readlink(ffilename,linkname,sizeof(linkname)-1)) < 0 ) return(NULL);
+          linkname[r] = '\0';
+          fprintf(dmlg,"DependencyManager():%s inter-dependency file not there, removing link at:%s ... \n",linkname,Time);
+          unlink(ffilename);
+          return(NULL);
+     }
+     if ( typeofFile(st.st_mode) != 'r' ) return(NULL);
+
+     /* test format */
+     if ( strlen(name) >= sizeof(extension) || sscanf(name,"%14d%1[_]%s",&datestamp,underline,extension) != 3 ) return(NULL);
+
+     if ( (r=readlink(ffilename,linkname,sizeof(linkname)-1)) < 0 ) return(NULL);
+     linkname[r] = '\0';
+     if ( (depXp=ParseXmlDepFile( linkname, dmlg )) == NULL ) {
+          get_time(Time,1);
+          fprintf(dmlg,"DependencyManager(): %s Problem parsing xml file:%s\n",Time,linkname);
+          return(NULL);
+     }
+     dep = DepWatch_add(watch, name, linkname, depXp, dmlg);
+     dep->ready = 1;
+     return(dep);
+}
+
+/**
+   Act on what the events of the index point at: new registrations,
+   registrations removed and lock files touched.
+   Returns the number of dependencies to evaluate again in a second.
+*/
+static int DM_events ( _l2d2server *l2d2, l2d2depwatch *watch, time_t current_epoch, FILE *dmlg )
+{
+     l2d2depname *dn;
+     l2d2dep *dep, *next;
+     int retries = 0;
+
+     while ( (dn=watch->created) != NULL ) {
+          watch->created = dn->next;
+          DM_register(l2d2, watch, dn->name, dmlg);
+          free(dn);
+     }
+     for ( dep = watch->all; dep != NULL; dep = next ) {
+          next = dep->next;
+          if ( dep->gone ) {
+               DepWatch_remove(watch, dep);
+               continue;
+          }
+          if ( ! dep->ready && ! dep->retry ) continue;
+          dep->ready = dep->retry = 0;
+          if ( DM_evaluate(l2d2, dep, current_epoch, dmlg) != 0 )
+               DepWatch_remove(watch, dep);
+          else if ( dep->retry )
+               retries++;
+     }
+     return(retries);
+}
+
+/**
+   Read the whole polling directory and evaluate every dependency, for what
+   inotify cannot see: status files written by other hosts on NFS, lost events.
+   Writes the web page of the dependencies. Returns 0 if succeeds.
+*/
+static int DM_rescan ( _l2d2server *l2d2, l2d2depwatch *watch, time_t current_epoch, FILE *dmlg )
+{
+     struct _depParameters *depXp;
+     struct dirent *pd;
+     l2d2dep *dep, *next;
+     l2d2depname *dn;
+     DIR *dp;
+     FILE *fp;
+     char buf[1024];
+
+     if ( (dp=opendir(l2d2->dependencyPollDir)) == NULL ) {
+          fprintf(dmlg,"Error Could not open polling directory:%s\n",l2d2->dependencyPollDir);
+          return(1);
+     }
+     while ( (dn=watch->created) != NULL ) {
+          watch->created = dn->next;
+          free(dn);
+     }
+     for ( dep = watch->all; dep != NULL; dep = dep->next ) dep->seen = 0;
+     while ( (pd=readdir(dp)) != NULL ) {
+          if ( (dep=DepWatch_find(watch, pd->d_name)) == NULL ) dep=DM_register(l2d2, watch, pd->d_name, dmlg);
+          if ( dep != NULL ) dep->seen = 1;
+     }
+     closedir(dp);
+
+     for ( dep = watch->all; dep != NULL; dep = next ) {
+          next = dep->next;
+          if ( ! dep->seen ) {
+               DepWatch_remove(watch, dep);
+               continue;
+          }
+          DepWatch_watch(watch, dep, dmlg);
+          dep->ready = dep->retry = 0;
+          if ( DM_evaluate(l2d2, dep, current_epoch, dmlg) != 0 ) DepWatch_remove(watch, dep);
+     }
+
+     /* write dependencies to be accessed through web page */
+     if ( (fp=fopen(l2d2->web_dep , "w")) == NULL ) return(0);
+     fwrite(page_start_dep, 1, strlen(page_start_dep) , fp);
+     for ( dep = watch->all; dep != NULL; dep = dep->next ) {
+          depXp = dep->dp;
+          snprintf(buf,sizeof(buf),"<tr><td>%s</td>\n",depXp->xpd_regtimedate);
+          fwrite(buf, 1 ,strlen(buf), fp );
+          snprintf(buf,sizeof(buf),"<td><table><tr><td><font color=\"red\">SRC_EXP</font></td><td>%s</td>\n",depXp->xpd_sname);
+          fwrite(buf, 1 ,strlen(buf), fp );
+          snprintf(buf,sizeof(buf),"<tr><td><font color=\"red\">SRC_NODE</font></td><td>%s</td>\n",depXp->xpd_snode);
+          fwrite(buf, 1 ,strlen(buf), fp );
+          snprintf(buf,sizeof(buf),"<tr><td><font color=\"red\">DEP_ON_EXP</font></td><td>%s</td>\n",depXp->xpd_name);
+          fwrite(buf, 1 ,strlen(buf), fp );
+          snprintf(buf,sizeof(buf),"<tr><td><font color=\"red\">Key</font></td><td>%s_%s</td>\n",depXp->xpd_xpdate,depXp->xpd_key);
+          fwrite(buf, 1 ,strlen(buf), fp );
+          snprintf(buf,sizeof(buf),"<tr><td><font color=\"red\">LOCK</font></td><td>%s</td></table></td>\n",depXp->xpd_lock);
+          fwrite(buf, 1 ,strlen(buf), fp );
+     }
+     fwrite(page_end_dep, 1, strlen(page_end_dep) , fp);
+     fclose(fp);
+     return(0);
+}
+
 /**
    Routine which runs as a process for verifying and
    submitting dependencies. This routine is concurrency
@@ -119,32 +370,23 @@ static void sig_admin(int signo, siginfo_t *siginfo, void *context) {
 void DependencyManager (_l2d2server l2d2 ) {
      
      FILE *fp,*ft,*dmlg;
-     static DIR *dp=NULL;
-     struct dirent *pd;
      struct stat st;
      sigset_t  newmask, oldmask,zeromask;
      struct sigaction sa;
-     struct _depParameters *depXp=NULL;
-     time_t current_epoch, start_epoch, start_epoch_cln;
+     l2d2depwatch watch;
+     time_t current_epoch, start_epoch, start_epoch_cln, next_scan=0;
      glob_t g_LogFiles;
      size_t cnt;
      int  g_lres;
-     int datestamp,nb,LoopNumber;
-     char underline[2];
+     int LoopNumber;
      char buf[1024];
-     char cmd[2048];
-     char listings[1024];
-     char largs[128];
-     char extension[256]; /* probably a malloc here */
-     char ffilename[512], filename[256], linkname[1024],LoopName[64];
      char ControllerAlive[128];
      char DependencyMAlive[128];
      char rm_key[256];
      char rm_keyFile[1024];
      char Time[40],tlog[16];
-     char *pleaf=NULL;
      char **p;
-     int r, ret, running=0, _ZONE_ = 2, KILL_SERVER = FALSE;
+     int ret, running=0, retries=0, _ZONE_ = 2, KILL_SERVER = FALSE;
      int fd,epid; 
          
      l2d2.depProcPid=getpid();
@@ -218,146 +460,31 @@ void DependencyManager (_l2d2server l2d2 ) {
              fclose(ft);
      }
 
+     /* dependencies are indexed by the lock file they wait on and evaluated
+        when inotify reports a change of it; the polling directory is still
+        read every pollfreq seconds for what inotify cannot see (NFS) */
+     if ( DepWatch_init(&watch, l2d2.dependencyPollDir, dmlg) != 0 ) {
+          fprintf(dmlg,"Dependency Manager: no inotify, polling every %d seconds\n",l2d2.pollfreq);
+     }
+
      while (running == 0 ) {
-         sleep(l2d2.pollfreq);
-	 /* get current epoch */
 	 time(&current_epoch);
-	 if ( (dp=opendir(l2d2.dependencyPollDir)) == NULL ) { 
-	          fprintf(dmlg,"Error Could not open polling directory:%s\n",l2d2.dependencyPollDir);
-		  sleep(5);
-		  /* possible infinite loop here */
-	          continue ; 
-	 }  
-	 fp = fopen(l2d2.web_dep , "w");
-	 fwrite(page_start_dep, 1, strlen(page_start_dep) , fp);
-         
-	 while ( pd=readdir(dp))
-	 {
-	    memset(listings,'\0',sizeof(listings));
-	    memset(linkname,'\0',sizeof(linkname));
-	    memset(LoopName,'\0',sizeof(LoopName));
-
-	    snprintf(ffilename,sizeof(ffilename),"%s/%s",l2d2.dependencyPollDir,pd->d_name);
-	    snprintf(filename,sizeof(filename),"%s",pd->d_name);
-
-            /* stat will stat the file pointed to ... lstat will stat the link itself */
-	    if ( stat(ffilename,&st) != 0 ) {
-	                 get_time(Time,1);
-			 r=readlink(ffilename,linkname,1023);
-			 linkname[r] = '\0';
-	                 fprintf(dmlg,"DependencyManager():%s inter-dependency file not there, removing link at:%s ... \n",linkname,Time);
-			 ret=unlink(ffilename); 
-	                 continue;
-	    }
-	    switch ( typeofFile(st.st_mode) ) {
-                case 'r'    :
-		             /* skip hidden files */
-		             if ( filename[0] == '.' ) break; /* should examine if a left over file ... */
-                             /* test format */
-			     nb = sscanf(filename,"%14d%1[_]%s",&datestamp,underline,extension);
-                             if ( nb == 3 ) {
-			        /* ok get the file & parse */
-				r=readlink(ffilename,linkname,1023);
-                                memset(buf,'\0',sizeof(buf)); memset(cmd,'\0',sizeof(cmd));
-				linkname[r] = '\0';
-				if ( (depXp=ParseXmlDepFile( linkname, dmlg )) == NULL ) {
-	                                get_time(Time,1);
-	                                fprintf(dmlg,"DependencyManager(): %s Problem parsing xml file:%s\n",Time,linkname);
-				} else {
-				        /* Is dependant node still in waiting state? If not, do not submit. */
-					if (l2d2_Util_isNodeXState (depXp->xpd_snode, depXp->xpd_slargs, depXp->xpd_sxpdate, depXp->xpd_sname, "waiting") == 0) {
-						 get_time(Time,2);
-					     fprintf(dmlg,"%s Removing dependency (waiting state of dependant gone) ffilename=%s ; linkname=%s\n",Time, ffilename,linkname);
-					     unlink(linkname);
-					     unlink(ffilename);
-					     break;
-					}
-
-                   if ( strcmp(depXp->xpd_slargs,"") != 0 )  
-					   snprintf(largs,sizeof(largs),"-l \"%s\"",depXp->xpd_slargs);
-                   else 
-					   strcpy(largs,"");
-                  /* before trying to access lock file, see if dependency is still active */
-					epoch_diff=(int)(current_epoch - atoi(depXp->xpd_regtimepoch))/3600; 
-					if ( epoch_diff >= l2d2.dependencyTimeOut ) {
-					            ret=unlink(linkname);
-					            ret=unlink(ffilename);
-	                                            fprintf(dmlg,"============= Dependency Timed Out ============\n");
-	                                            fprintf(dmlg,"DependencyManager(): Dependency:%s Timed Out\n",filename);
-	                                            fprintf(dmlg,"source     exp  name:%s\n",depXp->xpd_sname);
-	                                            fprintf(dmlg,"dependency node name:%s\n",depXp->xpd_name);
-	                                            fprintf(dmlg,"current_epoch=%d registred_epoch=%d epoch_diff(hours)=%lu\n",current_epoch,atoi(depXp->xpd_regtimepoch), epoch_diff);
-						    fprintf(dmlg,"\n");
-						    
-						    /* log into exp. nodelog file */
-						    get_time(Time,1);
-						    snprintf(buf,sizeof(buf),"Dependency on exp:%s node:%s from exp:%s and node:%s Timed out. Removed by mserver at:%s",depXp->xpd_name, depXp->xpd_node, depXp->xpd_sname, depXp->xpd_snode, Time);
-					            snprintf(cmd,sizeof(cmd),"exec >/dev/null 2>&1;%s; export SEQ_EXP_HOME=%s; export SEQ_DATE=%s; nodelogger -n %s %s -s info -m \"%s\" ",l2d2.mshortcut, depXp->xpd_sname, depXp->xpd_sxpdate, depXp->xpd_snode, largs, buf);
-					            ret=system(cmd);
-						    
-						    /* do an initnode */
-                                                    memset(cmd,'\0',sizeof(cmd));
-					            /* snprintf(cmd,sizeof(cmd),"exec >/users/dor/afsi/rol/tmp/l2d2server/log/v1.4.0/cmd_listing_init 2>&1; %s; export SEQ_EXP_HOME=%s; export SEQ_DATE=%s; maestro -s initnode -n %s %s",l2d2.mshortcut, depXp->xpd_sname, depXp->xpd_sxpdate, depXp->xpd_snode, largs);*/
-					            /* snprintf(cmd,sizeof(cmd),"exec >/dev/null 2>&1;%s; export SEQ_EXP_HOME=%s; export SEQ_DATE=%s; maestro -s initnode -n %s %s",l2d2.mshortcut, depXp->xpd_sname, depXp->xpd_sxpdate, depXp->xpd_snode, largs); */
-					            snprintf(cmd,sizeof(cmd),"%s; export SEQ_EXP_HOME=%s; export SEQ_DATE=%s; maestro -s initnode -n %s %s",l2d2.mshortcut, depXp->xpd_sname, depXp->xpd_sxpdate, depXp->xpd_snode, largs);
-					            ret=system(cmd);
-
-					            /* Notify user by email : See if we need to add it 	    
-                                                    memset(buf,'\0',sizeof(buf));
-                                                    snprintf(buf,sizeof(buf),"Dependency on Experiment:%s and Node:%s",depXp->xpd_sname,depXp->xpd_name);
-			                            ret=sendmail(l2d2.emailTO,l2d2.emailTO,l2d2.emailCC,"Dependency Removed",&buf[0],dmlg);
-						    */
-						    continue;
-					} else if ( access(depXp->xpd_lock,R_OK) == 0 ) {
-                                              get_time(Time,4); 
-					      pleaf=(char *) getPathLeaf(depXp->xpd_snode);
-					      /* where to put listing: xp/listings/server_host/datestamp/node_container/node_name_and_loop */
-                                              memset(listings,'\0',sizeof(listings));
-					      snprintf(listings,sizeof(listings),"%s/listings/%s%s",depXp->xpd_sname, l2d2.host, depXp->xpd_container);
-					      if ( access(listings,R_OK) != 0 )  ret=r_mkdir(listings,1,dmlg);
-					      if ( ret != 0 ) fprintf(dmlg,"DM:Could not create directory:%s\n",listings);
-                                              memset(listings,'\0',sizeof(listings));
-					      if ( strcmp(depXp->xpd_slargs,"") != 0 ) {
-					              snprintf(listings,sizeof(listings),"%s/listings/%s/%s/%s_%s.submit.mserver.%s.%s",depXp->xpd_sname,l2d2.host, depXp->xpd_container,pleaf,depXp->xpd_slargs,depXp->xpd_sxpdate,Time);
-                                              } else {
-					              snprintf(listings,sizeof(listings),"%s/listings/%s/%s/%s.submit.mserver.%s.%s",depXp->xpd_sname,l2d2.host, depXp->xpd_container,pleaf,depXp->xpd_sxpdate,Time);
-					      }
-					      /* build command */
-					      snprintf(cmd,sizeof(cmd),"%s >/dev/null 2>&1; export SEQ_EXP_HOME=%s; export SEQ_DATE=%s; maestro -s submit -n %s %s -f %s >%s 2>&1",
-						   l2d2.mshortcut, depXp->xpd_sname, depXp->xpd_sxpdate, depXp->xpd_snode, largs, depXp->xpd_flow, listings);
-					      fprintf(dmlg,"dependency submit cmd=%s\n",cmd); 
-					      /* take account of concurrency here ie multiple dependency managers! */
-					      snprintf(buf,sizeof(buf),"%s/.%s",l2d2.dependencyPollDir,filename);
-					      ret=rename(ffilename,buf);
-					      if ( ret == 0 ) {
-					        ret=unlink(buf); 
-					        ret=unlink(linkname);
-					        ret=system(cmd); 
-                     }
-					}
-					
-					/* write dependency to be accessed through web page */
-					snprintf(buf,sizeof(buf),"<tr><td>%s</td>\n",depXp->xpd_regtimedate);
-					fwrite(buf, 1 ,strlen(buf), fp );
-					snprintf(buf,sizeof(buf),"<td><table><tr><td><font color=\"red\">SRC_EXP</font></td><td>%s</td>\n",depXp->xpd_sname);
-					fwrite(buf, 1 ,strlen(buf), fp );
-					snprintf(buf,sizeof(buf),"<tr><td><font color=\"red\">SRC_NODE</font></td><td>%s</td>\n",depXp->xpd_snode);
-					fwrite(buf, 1 ,strlen(buf), fp );
-					snprintf(buf,sizeof(buf),"<tr><td><font color=\"red\">DEP_ON_EXP</font></td><td>%s</td>\n",depXp->xpd_name);
-					fwrite(buf, 1 ,strlen(buf), fp );
-					snprintf(buf,sizeof(buf),"<tr><td><font color=\"red\">Key</font></td><td>%s_%s</td>\n",depXp->xpd_xpdate,depXp->xpd_key);
-					fwrite(buf, 1 ,strlen(buf), fp );
-					snprintf(buf,sizeof(buf),"<tr><td><font color=\"red\">LOCK</font></td><td>%s</td></table></td>\n",depXp->xpd_lock);
-					fwrite(buf, 1 ,strlen(buf), fp );
-					free(depXp);depXp=NULL;
-				}
-			     } 
-		             break;
-                default:
-		    	     break;
-            } /* end switch */
-	 } /* end while readdir */
-	
+	 if ( current_epoch < next_scan && ! watch.rescan ) {
+	       if ( DepWatch_wait(&watch, retries > 0 ? 1 : (int) (next_scan - current_epoch)) ) DepWatch_read(&watch, dmlg);
+	       time(&current_epoch);
+	       retries = DM_events(&l2d2, &watch, current_epoch, dmlg);
+	       continue;
+	 }
+
+	 watch.rescan = 0;
+	 if ( DM_rescan(&l2d2, &watch, current_epoch, dmlg) != 0 ) {
+	       /* possible infinite loop here */
+	       next_scan = current_epoch + 5;
+	       continue;
+	 }
+	 next_scan = current_epoch + l2d2.pollfreq;
+	 retries = 0;
+	 
 	 /* check controller */
 	 if ( stat(ControllerAlive,&st) == 0 ) {
 	        if ( (diff_t=abs(difftime(current_epoch,st.st_mtime))) > 20 ) {
@@ -458,541 +585,1144 @@ void DependencyManager (_l2d2server l2d2 ) {
 		   }
          }
 
-	 fwrite(page_end_dep, 1, strlen(page_end_dep) , fp);
-	 fclose(fp);
-	 closedir(dp);
      }
 }
 
+/* connections held by this worker */
+static _l2d2clientTable ClientTable = { NULL, 0, 0 };
+
+/* work queue feeding the pool threads, holds the clients having requests to serve */
+static _l2d2client *WorkHead = NULL, *WorkTail = NULL;
+static pthread_mutex_t WorkMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  WorkCond  = PTHREAD_COND_INITIALIZER;
+
+/* pool threads write here the descriptor of the clients they are done with */
+static int DonePipe[2] = { -1, -1 };
+
+/* the event loop cascades the log stream while pool threads are using it */
+static pthread_rwlock_t LogLock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* the worker, for the log writer callbacks */
+static _l2d2worker *Servlet = NULL;
+
+/* writeNodeWaitedFile looks for duplicates before appending */
+static pthread_mutex_t WaitFileMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* a change of state of a node is seen whole by the other ones */
+static pthread_mutex_t StateMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* the submission buckets are changed by one thread at a time, fcntl() locks being the process' */
+static pthread_mutex_t RateMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /*
- *  Worker Process : for locking & logging, can be Eternal or Transient.
- *  This process will handle a client Session with Multiplexing.
+ * Return a fresh client slot for descriptor fd. The table is indexed by
+ * socket descriptor and grows on demand, so a worker is only bounded by
+ * the descriptor limit of the process.
  */
-static void l2d2SelectServlet( int listen_sd , TypeOfWorker tworker)
+static _l2d2client *l2d2_clientOpen( int fd )
 {
- 
-  FILE *fp, *mlog;
-  fd_set master_set, working_set;
-  int buflen,num,ret;
-  int i,j,k,count,try;
+   _l2d2client *cl;
+   int newsize;
+
+   if ( fd >= ClientTable.size ) {
+        newsize = ClientTable.size > 0 ? ClientTable.size : L2D2_CLIENT_TABLE_INIT;
+        while ( newsize <= fd ) newsize *= 2;
+        ClientTable.conn = (_l2d2client **) xrealloc(ClientTable.conn, newsize * sizeof(_l2d2client *));
+        memset(ClientTable.conn + ClientTable.size, 0, (newsize - ClientTable.size) * sizeof(_l2d2client *));
+        ClientTable.size = newsize;
+   }
+
+   cl = (_l2d2client *) xmalloc(sizeof(_l2d2client));
+   memset(cl,'\0',sizeof(_l2d2client));
+   cl->fd = fd;
+   pthread_mutex_init(&cl->lock, NULL);
+   ClientTable.conn[fd] = cl;
+   ClientTable.count++;
+   return(cl);
+}
+
+/*
+ * Close the connection of a client and release its slot.
+ * Must not be called while a pool thread holds the client.
+ */
+static void l2d2_clientClose( _l2d2client *cl, _l2d2worker *wrk )
+{
+   char Stime[25];
+   int _ZONE_ = 1;
+
+   get_time(Stime,3);
+   if ( wrk->mlog != NULL ) logZone(_ZONE_,L2D2.dzone,wrk->mlog,"%s Closed:%s TrNum=%u\n",cl->Open_str,Stime,cl->trans);
+
+   ClientTable.conn[cl->fd] = NULL;
+   ClientTable.count--;
+   close(cl->fd);
+   pthread_mutex_destroy(&cl->lock);
+   free(cl->rbuf);
+   free(cl->qbuf);
+   free(cl->jbuf);
+   free(cl->obuf);
+   free(cl->wbuf);
+   free(cl);
+}
+
+/*
+ * Close a client whose connection is finished. If a pool thread is still
+ * serving it, the close is left to the event loop once the job is done.
+ * Returns TRUE when the client was closed.
+ */
+static int l2d2_clientDrop( _l2d2client *cl, _l2d2worker *wrk )
+{
+   int busy;
+
+   pthread_mutex_lock(&cl->lock);
+   cl->closing = 1;
+   busy = cl->busy || cl->pending;
+   pthread_mutex_unlock(&cl->lock);
+
+   if ( busy ) return(FALSE);
+   l2d2_clientClose(cl, wrk);
+   return(TRUE);
+}
+
+/*
+ * Append len bytes to the replies of the request being served.
+ */
+static void l2d2_clientQueue( _l2d2client *cl, const char *data, size_t len )
+{
+   if ( cl->olen + len > cl->osize ) {
+        cl->osize = cl->olen + len > 2 * cl->osize ? cl->olen + len : 2 * cl->osize;
+        cl->obuf = (char *) xrealloc(cl->obuf, cl->osize);
+   }
+   memcpy(cl->obuf + cl->olen, data, len);
+   cl->olen += len;
+}
+
+/*
+ * Queue a status reply, same wire format as send_reply(), or a frame with
+ * the same 0/1 status for framed requests.
+ */
+static void l2d2_reply( _l2d2client *cl, int status )
+{
+   char hdr[L2D2_FRAME_HEADER];
+
+   if ( cl->rid != 0 ) {
+        pack_frame(hdr, 0, cl->rid, cl->rop, status == 0 ? 0 : 1);
+        l2d2_clientQueue(cl, hdr, sizeof(hdr));
+   } else {
+        l2d2_clientQueue(cl, status == 0 ? "00" : "11", 3);
+   }
+}
+
+/*
+ * Queue a reply carrying data, raw for the 1024 byte protocol.
+ */
+static void l2d2_replyData( _l2d2client *cl, int status, const char *data, size_t len )
+{
+   char hdr[L2D2_FRAME_HEADER];
+
+   if ( cl->rid != 0 ) {
+        pack_frame(hdr, len, cl->rid, cl->rop, status);
+        l2d2_clientQueue(cl, hdr, sizeof(hdr));
+   }
+   l2d2_clientQueue(cl, data, len);
+}
+
+/*
+ * Queue a file for download, same wire format as SendFile(): an 11 byte
+ * size field followed by the content. A size of 0 tells the client the
+ * file could not be read. Framed requests get the content as payload,
+ * or a status of 1.
+ */
+static int l2d2_replyFile( _l2d2client *cl, const char *filename, FILE *mlog )
+{
+   char fsize[11], hdr[L2D2_FRAME_HEADER];
+   struct stat st;
+   FILE *waitf;
+   size_t num;
+
+   memset(fsize,'\0',sizeof(fsize));
+   /* framed clients refuse a reply longer than L2D2_REPLY_MAX */
+   if ( stat(filename,&st) != 0 || (cl->rid != 0 && st.st_size > L2D2_REPLY_MAX) ||
+        (waitf=fopen(filename,"r")) == NULL ) {
+        if ( mlog != NULL ) fprintf(mlog,"SendFile:mserver cannot read waitfile:%s\n",filename);
+        if ( cl->rid != 0 )
+             l2d2_reply(cl, 1);
+        else
+             l2d2_clientQueue(cl, fsize, sizeof(fsize));
+        return(1);
+   }
+
+   if ( cl->rid != 0 ) {
+        pack_frame(hdr, st.st_size, cl->rid, cl->rop, 0);
+        l2d2_clientQueue(cl, hdr, sizeof(hdr));
+   } else {
+        snprintf(fsize,sizeof(fsize),"%lld",(long long) st.st_size);
+        l2d2_clientQueue(cl, fsize, sizeof(fsize));
+   }
+
+   if ( cl->olen + st.st_size > cl->osize ) {
+        cl->osize = cl->olen + st.st_size;
+        cl->obuf = (char *) xrealloc(cl->obuf, cl->osize);
+   }
+   num = fread(cl->obuf + cl->olen, 1, st.st_size, waitf);
+   fclose(waitf);
+
+   /* keep the size announced to the client */
+   if ( num < (size_t) st.st_size ) memset(cl->obuf + cl->olen + num, '\0', st.st_size - num);
+   cl->olen += st.st_size;
+   return(0);
+}
+
+/*
+ * Send as much of the pending replies as the socket accepts.
+ * Called with the client lock held.
+ * Returns 0 when everything was sent, 1 when the socket is full
+ * and -1 when the connection is broken.
+ */
+static int l2d2_clientFlush( _l2d2client *cl )
+{
+   ssize_t num;
+
+   while ( cl->wpos < cl->wlen ) {
+        num = send(cl->fd, cl->wbuf + cl->wpos, cl->wlen - cl->wpos, 0);
+        if ( num < 0 ) {
+             if ( errno == EINTR ) continue;
+             if ( errno == EAGAIN || errno == EWOULDBLOCK ) return(1);
+             return(-1);
+        }
+        cl->wpos += num;
+   }
+   cl->wpos = cl->wlen = 0;
+
+   /* see 'S' request: let the client close its side first, once the
+      replies still in the log writer are sent too */
+   if ( cl->shut && cl->pending == 0 ) {
+        shutdown(cl->fd,SHUT_WR);
+        cl->shut = 0;
+   }
+   return(0);
+}
+
+/*
+ * Append replies to those waiting for the socket.
+ * Called with the client lock held.
+ */
+static void l2d2_clientPost( _l2d2client *cl, const char *data, size_t len )
+{
+   if ( cl->wlen + len > cl->wsize ) {
+        cl->wsize = cl->wlen + len > 2 * cl->wsize ? cl->wlen + len : 2 * cl->wsize;
+        cl->wbuf = (char *) xrealloc(cl->wbuf, cl->wsize);
+   }
+   memcpy(cl->wbuf + cl->wlen, data, len);
+   cl->wlen += len;
+}
+
+static void l2d2_workSubmit( _l2d2client *cl );
+
+/*
+ * Report a nodelog line the log writer could not write.
+ */
+static void l2d2_nodelogError( l2d2logline *ln )
+{
+   pthread_rwlock_rdlock(&LogLock);
+   if ( Servlet->mlog != NULL ) fprintf(Servlet->mlog,"NodeLogr: Could not write nodelog file:%s errno=%d logBuffer:%s",ln->path,ln->err,ln->text);
+   pthread_rwlock_unlock(&LogLock);
+}
+
+/*
+ * Log writer callback: the nodelog line of a client is on disk (or failed),
+ * reply and give the client back to the pool threads for its next requests.
+ */
+static void l2d2_nodelogDone( l2d2logline *ln, void *arg )
+{
+   _l2d2client *cl = (_l2d2client *) arg;
+
+   if ( ln->status != 0 ) l2d2_nodelogError(ln);
+   l2d2_reply(cl,ln->status);
+
+   pthread_mutex_lock(&cl->lock);
+   l2d2_workSubmit(cl);
+   pthread_mutex_unlock(&cl->lock);
+}
+
+/*
+ * Log writer callback for framed clients, which were not suspended: post
+ * the reply frame directly and wake up the event loop to send it. The
+ * last line of a request 'M' replies for all its lines.
+ */
+static void l2d2_nodelogFramed( l2d2logline *ln, void *arg )
+{
+   _l2d2client *cl = (_l2d2client *) arg;
+   char hdr[L2D2_FRAME_HEADER];
+   int fd;
+
+   if ( ln->status != 0 ) l2d2_nodelogError(ln);
+   if ( ln->target != 0 )
+        pack_frame(hdr, 0, ln->tag, 'M', ln->failed | (ln->status != 0 ? ln->target : 0));
+   else
+        pack_frame(hdr, 0, ln->tag, 'L', ln->status);
+
+   pthread_mutex_lock(&cl->lock);
+   l2d2_clientPost(cl, hdr, sizeof(hdr));
+   cl->pending--;
+   fd = cl->fd;
+   pthread_mutex_unlock(&cl->lock);
+
+   /* the client may be closed from now on, only use its descriptor */
+   while ( write(DonePipe[1], &fd, sizeof(fd)) < 0 && errno == EINTR );
+}
+
+/*
+ * Log writer callback for the lines of a request 'M' before its last,
+ * which gets their failures: arg is the last line, answered after them.
+ */
+static void l2d2_nodelogPart( l2d2logline *ln, void *arg )
+{
+   if ( ln->status != 0 ) {
+        l2d2_nodelogError(ln);
+        ((l2d2logline *) arg)->failed |= ln->target;
+   }
+}
+
+/*
+ * Serve one request of a client, replies are queued on the client.
+ * Runs in a pool thread. Returns TRUE when the request was handed to the
+ * log writer: the client then belongs to the writer until it replies.
+ */
+static int l2d2_ProcessRequest( _l2d2client *cl, char *buff, _l2d2worker *wrk )
+{
+  FILE *mlog = wrk->mlog;
+  char buf[1024], filename[1024];
+  char expName[256], expInode[64], hostname[128], node[256], signal[256], username[256];
+  char m5[40], Stime[25], proto[16];
   unsigned int pidSent;
-  int _ZONE_ = 1, STOP = -1, SelecTimeOut;
-  
-  char buf[1024],buff[1024];
-  char Astring[1024],inode[128], expName[256], expInode[64], hostname[128]; 
-  char Bigstr[2048];
-  char heartbeatFile[1024];
-  char node[256], signal[256], username[256];
-  char Stime[25],Etime[25], tlog[10];
-  char m5[40];
-  char filename[1024];
-
-  _l2d2client l2d2client[1024]; /* the select can take 1024 max  */
-
-  int  max_sd, new_sd;
-  int  desc_ready, end_server = FALSE;
-  int  rc, close_conn, got_lock;
-  int  mode,ceiling=0;
-  int  fd;           
-  int sent;            
-  struct stat stbuf; 
-  char *ts;
-  char trans;
-
-  key_t log_key;
- 
-  struct sigaction ssa;
-  struct timeval timeout;   /* Timeout for select */
-  struct flock nlock,ilock; /* for Logging we are using fnctl() */
+  int ret, mode, g_result;
+  struct stat stbuf;
   glob_t g_AliveFiles;
-  int g_result;
-  time_t sig_sent,now;
-  double delay;
+  time_t now;
+  unsigned long int epoch_diff;
+  double rate, burst, wait;
+  l2d2logline *ln, *lines[2];
+  int i, n;
+
+  switch (buff[0]) {
+          case 'A': /* test existence of file  */
+                   memset(filename,'\0',sizeof(filename));
+                   ret = sscanf(&buff[2],"%s %d",filename, &mode);
+                   ret = access (filename , mode);
+                   l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'B': /* take a submission token: "path rate burst", framed clients get the
+                       seconds to wait. The others are refused and use the bucket file */
+                   cl->trans++;
+                   if ( cl->rid == 0 || sscanf(&buff[2],"%1023s %lf %lf",filename, &rate, &burst) != 3 ) {
+                          l2d2_reply(cl,1);
+                          break;
+                   }
+                   pthread_mutex_lock(&RateMutex);
+                   wait = SeqRateLimit_take( filename, rate, burst, SeqRateLimit_now() );
+                   pthread_mutex_unlock(&RateMutex);
+                   snprintf(buf, sizeof(buf), "%.6f", wait);
+                   l2d2_replyData(cl, 0, buf, strlen(buf));
+                   break;
+          case 'C': /*  create a Lock file  */
+                   ret = CreateLock ( &buff[2] );
+                   l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'D': /* mkdir  */
+                   ret = r_mkdir ( &buff[2] , 1, mlog);
+                   l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'F': /* test existence of file  */
+                   ret = isFileExists ( &buff[2] );
+                   l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'G': /* glob  */
+                   ret = globPath (&buff[2], GLOB_NOSORT, 0, mlog );
+                   l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'I': /* accept session */
+                   pidSent=0;
+                   memset(expInode,'\0',sizeof(expInode));
+                   memset(expName,'\0',sizeof(expName));
+                   memset(node,'\0',sizeof(node));
+                   memset(signal,'\0',sizeof(signal));
+                   memset(hostname,'\0',sizeof(hostname));
+                   memset(username,'\0',sizeof(username));
+                   memset(m5,'\0',sizeof(m5));
+                   memset(proto,'\0',sizeof(proto));
+                   ret=sscanf(&buff[2],"%u %63s %255s %255s %255s %127s %255s %39s %15s",&pidSent,expInode,expName,node,signal,hostname,username,m5,proto);
+                   get_time(Stime,3);
+                   if ( ret < 8 ) {
+                           l2d2_reply(cl,1);
+                           if ( mlog != NULL ) fprintf (mlog,"Got wrong number of parameters at LOGIN, number=%d instead of 8 buff=>%s<\n",ret,buff);
+                           /* same comment as for the S case below */
+                           cl->oshut = 1;
+                           snprintf(cl->Open_str,sizeof(cl->Open_str),"Session Refused with Host:%s AT:%s Exp=%s Node=%s Signal=%s ... Wrong number of arguments ",hostname , Stime, expName, node, signal);
+                   } else if ( pidTken == pidSent && strcmp(m5,L2D2.m5sum) == 0 ) {
+                           if ( strcmp(proto,L2D2_PROTO_FRAMED) == 0 ) {
+                                   /* the client asked for the framed protocol, see do_Login */
+                                   l2d2_clientQueue(cl, "0F", 3);
+                                   cl->oframed = 1;
+                           } else {
+                                   l2d2_reply(cl,0);
+                           }
+                           snprintf(cl->Open_str,sizeof(cl->Open_str),"OpenConHost:%s At:%s Xp=%s Node=%s Signal=%s NumCon=%d ",hostname, Stime, expName, node ,signal, ClientTable.count);
+                   } else {
+                           l2d2_reply(cl,1);
+                           cl->oshut = 1;
+                           snprintf(cl->Open_str,sizeof(cl->Open_str),"Session Refused with Host:%s AT:%s Exp=%s Node=%s Signal=%s pid_svr=%d pid_sent=%d m5_client=%s ",hostname , Stime, expName, node, signal, pidTken, pidSent, m5);
+                   }
+                   /* gather info for this client */
+                   cl->trans=0;
+                   snprintf(cl->host,sizeof(cl->host),"%s",hostname);
+                   snprintf(cl->xp,sizeof(cl->xp),"%s",expName);
+                   snprintf(cl->xpinode,sizeof(cl->xpinode),"%s",expInode);
+                   snprintf(cl->node,sizeof(cl->node),"%s",node);
+                   snprintf(cl->signal,sizeof(cl->signal),"%s",signal);
+                   break;
+          case 'K': /* write Inter user dep file : Not used */
+                   break;
+          case 'L':/* Log the node under the proper experiment. The line goes to the log writer
+                      thread which appends the lines of all clients in batches, one fsync per
+                      file and batch. The client is answered once its batch is on disk */
+                   cl->trans++;
+                   if ( (ln = LogWriter_newLine( &buff[2] )) == NULL ) {
+                          if ( mlog != NULL ) fprintf(mlog,"NodeLogr: Error with the format of nodeLogerBuffer\n");
+                          l2d2_reply(cl,1);
+                          break;
+                   }
+                   ln->arg = cl;
+                   if ( cl->rid != 0 ) {
+                          /* framed clients go on with their next requests, the reply
+                             is sent whenever the batch is on disk */
+                          ln->done = l2d2_nodelogFramed;
+                          ln->tag = cl->rid;
+                          pthread_mutex_lock(&cl->lock);
+                          cl->pending++;
+                          pthread_mutex_unlock(&cl->lock);
+                          LogWriter_submit(ln);
+                          break;
+                   }
+                   ln->done = l2d2_nodelogDone;
+                   LogWriter_submit(ln);
+                   return(TRUE);
+          case 'M':/* Log a line once to each of the logs of a datestamp named by its targets
+                      (see L2D2_LOG_NODELOG), as many lines for the log writer. Framed
+                      clients only, the others send one request L per log */
+                   cl->trans++;
+                   if ( cl->rid == 0 || (n = LogWriter_newLines( &buff[2], lines )) == 0 ) {
+                          if ( mlog != NULL ) fprintf(mlog,"NodeLogr: Error with the format of nodeLogerBuffer\n");
+                          l2d2_reply(cl,1);
+                          break;
+                   }
+                   for ( i = 0; i < n - 1; i++ ) {
+                          lines[i]->done = l2d2_nodelogPart;
+                          lines[i]->arg = lines[n-1];
+                   }
+                   ln = lines[n-1];
+                   ln->done = l2d2_nodelogFramed;
+                   ln->arg = cl;
+                   ln->tag = cl->rid;
+                   pthread_mutex_lock(&cl->lock);
+                   cl->pending++;
+                   pthread_mutex_unlock(&cl->lock);
+                   for ( i = 0; i < n; i++ ) LogWriter_submit(lines[i]);
+                   break;
+          case 'N': /* grab a lock for End state */
+                   ret = lock( &buff[2] ,   L2D2 ,cl->xp, cl->node, mlog );
+                   l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'P': /* unlock End state */
+                   ret = unlock( &buff[2] , L2D2 ,cl->xp, cl->node, mlog );
+                   l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'R': /* Remove file on local xp */
+                   ret = removeFile( &buff[2] );
+                   l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'S': /* Client has sent a Stop. OK Close this connection
+                       Note: if we use close() here , the rcv() call will fail, we need to close
+                       the server write side and let the client close his side, the server will then
+                       report a closed socket */
+                   cl->oshut = 1;
+                   break;
+          case 'T': /* Touch a Lock file on local xp */
+                   ret = touch ( &buff[2] );
+                   l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'U': /* set the state of a node: remove its stale status files, create the
+                       new one. Framed clients get the names of the files removed */
+                   pthread_mutex_lock(&StateMutex);
+                   ret = setNodeState( &buff[2] , buf , sizeof(buf) );
+                   pthread_mutex_unlock(&StateMutex);
+                   if ( cl->rid != 0 )
+                          l2d2_replyData(cl, ret == 0 ? 0 : 1, buf, strlen(buf));
+                   else
+                          l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'W': /* write Node Wait file  under dependent-ON xp */
+                   pthread_mutex_lock(&WaitFileMutex);
+                   ret = writeNodeWaitedFile ( &buff[2] , mlog );
+                   pthread_mutex_unlock(&WaitFileMutex);
+                   l2d2_reply(cl,ret);
+                   cl->trans++;
+                   break;
+          case 'X': /* server shutdown */
+                   kill(L2D2.pid,SIGUSR1);
+                   cl->oshut = 1;
+                   break;
+          case 'Y': /* server is alive need to return more here? */
+                   time(&now);
+                   memset(buf,'\0',sizeof(buf));
+                   snprintf(buf,sizeof(buf),"%s/DM_*",L2D2.tmpdir);
+                   g_result = glob(buf, 0, NULL, &g_AliveFiles);
+                   if (  g_result == 0 && g_AliveFiles.gl_pathc == 1  ) {
+                            if ( stat(*(g_AliveFiles.gl_pathv), &stbuf) == 0) {
+                                   epoch_diff=abs(now - stbuf.st_mtime);
+                                   /* 120 sec for DM heartbeat */
+                                   if ( epoch_diff >=  180  ) {
+                                           snprintf(buf,sizeof(buf),"0 Problems with Dependency Manager: heartbeat ");
+                                           l2d2_replyData(cl,0,buf,strlen(buf));
+                                           globfree(&g_AliveFiles);
+                                           break;
+                                   }
+                            }
+                            globfree(&g_AliveFiles);
+                   } else if ( g_result == 0 && g_AliveFiles.gl_pathc > 1 ) {
+                          snprintf(buf,sizeof(buf),"0 Problems with Dependency Manager: Multiple instances");
+                          l2d2_replyData(cl,0,buf,strlen(buf));
+                          globfree(&g_AliveFiles);
+                          break;
+                   } else {
+                          /* issue a kill here before sending message */
+                          snprintf(buf,sizeof(buf),"0 Problems with Dependency Manager: process dead ");
+                          l2d2_replyData(cl,0,buf,strlen(buf));
+                          break;
+                   }
+
+                   snprintf(buf,sizeof(buf),"0 Server is Alive on host=%s version=%s, Dependency Manager ok, Eworker ok ",L2D2.host, L2D2.mversion);
+                   l2d2_replyData(cl,0,buf,strlen(buf));
+                   break;
+          case 'Z':/* download waited file to client */
+                   ret = l2d2_replyFile( cl, &buff[2] , mlog );
+                   /* if waited file not there really , client will abort
+                      connection will eventualy be closed */
+                   cl->trans++;
+                   break;
+          default :
+                   if ( mlog != NULL ) fprintf(mlog,"Unrecognized Token>%s< from Host=%s Exp=%s node=%s signal=%s \n",buff,cl->host,cl->xp,cl->node,cl->signal);
+                   l2d2_reply(cl,1);
+                   break;
+  }
+  return(FALSE);
+}
+
+/*
+ * Hand a client over to the pool threads. Called with the client lock held.
+ */
+static void l2d2_workSubmit( _l2d2client *cl )
+{
+   cl->busy = 1;
+   pthread_mutex_lock(&WorkMutex);
+   cl->qnext = NULL;
+   if ( WorkTail == NULL )
+        WorkHead = cl;
+   else
+        WorkTail->qnext = cl;
+   WorkTail = cl;
+   pthread_cond_signal(&WorkCond);
+   pthread_mutex_unlock(&WorkMutex);
+}
+
+/*
+ * Pool thread: serve the requests of the clients taken from the work
+ * queue. A client is held by one thread at a time so its requests are
+ * served and replied in order. Replies are built in obuf without the
+ * client lock and moved to wbuf once the batch is done, the event loop
+ * is then woken up through DonePipe to send them. A nodelog request
+ * suspends the client until the log writer submits it back, serving
+ * then resumes at jpos.
+ */
+static void *l2d2_poolThread( void *arg )
+{
+   _l2d2worker *wrk = (_l2d2worker *) arg;
+   _l2d2client *cl;
+   char *req, *tmp;
+   size_t tsize;
+   int fd, suspended;
+
+   for (;;) {
+        pthread_mutex_lock(&WorkMutex);
+        while ( WorkHead == NULL ) pthread_cond_wait(&WorkCond, &WorkMutex);
+        cl = WorkHead;
+        if ( (WorkHead = cl->qnext) == NULL ) WorkTail = NULL;
+        cl->qnext = NULL;
+        pthread_mutex_unlock(&WorkMutex);
+
+        suspended = FALSE;
+        pthread_mutex_lock(&cl->lock);
+        for (;;) {
+             /* hand over the replies served so far */
+             if ( cl->olen > 0 ) {
+                  l2d2_clientPost(cl, cl->obuf, cl->olen);
+                  cl->olen = 0;
+             }
+             if ( cl->oshut ) {
+                  cl->shut = 1;
+                  cl->oshut = 0;
+             }
+             if ( cl->oframed ) {
+                  cl->framed = 1;
+                  cl->oframed = 0;
+             }
+
+             /* take the pending requests */
+             if ( cl->jpos >= cl->jlen ) {
+                  if ( cl->qlen == 0 ) break;
+                  tmp = cl->jbuf; cl->jbuf = cl->qbuf; cl->qbuf = tmp;
+                  tsize = cl->jsize; cl->jsize = cl->qsize; cl->qsize = tsize;
+                  cl->jlen = cl->qlen;
+                  cl->jpos = 0;
+                  cl->qlen = 0;
+             }
+             pthread_mutex_unlock(&cl->lock);
+
+             pthread_rwlock_rdlock(&LogLock);
+             while ( ! suspended && cl->jpos < cl->jlen ) {
+                  req = cl->jbuf + cl->jpos;
+                  memcpy(&cl->rid, req, sizeof(cl->rid));
+                  req += sizeof(cl->rid);
+                  cl->rop = req[0];
+                  cl->jpos += sizeof(cl->rid) + strlen(req) + 1;
+                  suspended = l2d2_ProcessRequest(cl, req, wrk);
+             }
+             pthread_rwlock_unlock(&LogLock);
+
+             /* the log writer owns the client now, do not touch it */
+             if ( suspended ) break;
+             pthread_mutex_lock(&cl->lock);
+        }
+        if ( suspended ) continue;
+
+        cl->busy = 0;
+        fd = cl->fd;
+        pthread_mutex_unlock(&cl->lock);
+
+        /* the client may be closed from now on, only use its descriptor */
+        while ( write(DonePipe[1], &fd, sizeof(fd)) < 0 && errno == EINTR );
+   }
+   return(NULL);
+}
+
+/*
+ * Return the next client descriptor posted by the pool threads, -1 when none.
+ */
+static int l2d2_nextDone( void )
+{
+   int fd;
+
+   while ( read(DonePipe[0], &fd, sizeof(fd)) != sizeof(fd) ) {
+        if ( errno != EINTR ) return(-1);
+   }
+   return(fd);
+}
+
+/*
+ * A pool thread is done with the client on descriptor fd: send the replies,
+ * or close the client if the connection ended while it was being served.
+ * Returns the client when its connection is broken and must be dropped.
+ */
+static _l2d2client *l2d2_clientDone( int fd, _l2d2worker *wrk )
+{
+   _l2d2client *cl;
+   int closing, rc = 0;
+
+   if ( fd < 0 || fd >= ClientTable.size || (cl=ClientTable.conn[fd]) == NULL ) return(NULL);
+
+   pthread_mutex_lock(&cl->lock);
+   closing = cl->closing;
+   if ( ! closing ) rc = l2d2_clientFlush(cl);
+   else if ( cl->busy || cl->pending ) closing = FALSE;
+   pthread_mutex_unlock(&cl->lock);
+
+   if ( closing ) {
+        l2d2_clientClose(cl, wrk);
+        return(NULL);
+   }
+   return( rc < 0 ? cl : NULL );
+}
+
+/*
+ * Send what the socket now accepts of the replies of a client.
+ * Returns TRUE when the connection is broken.
+ */
+static int l2d2_clientWritable( _l2d2client *cl )
+{
+   int rc;
+
+   pthread_mutex_lock(&cl->lock);
+   rc = cl->closing ? 0 : l2d2_clientFlush(cl);
+   pthread_mutex_unlock(&cl->lock);
+   return( rc < 0 );
+}
+
+/*
+ * Queue one request for the pool threads: its framed id (0 for the 1024
+ * byte protocol) then the request as a NUL terminated string, starting
+ * with its opcode when given apart. Called with the client lock held.
+ */
+static void l2d2_clientRequest( _l2d2client *cl, unsigned int id, int op, const char *data, size_t len )
+{
+   size_t need = sizeof(id) + (op != 0 ? 2 : 0) + len + 1;
+   char *q;
+
+   if ( cl->qlen + need > cl->qsize ) {
+        cl->qsize = cl->qlen + need > 2 * cl->qsize ? cl->qlen + need : 2 * cl->qsize;
+        cl->qbuf = (char *) xrealloc(cl->qbuf, cl->qsize);
+   }
+   q = cl->qbuf + cl->qlen;
+   memcpy(q, &id, sizeof(id));
+   q += sizeof(id);
+   if ( op != 0 ) {
+        *q++ = (char) op;
+        *q++ = ' ';
+   }
+   memcpy(q, data, len);
+   q[len] = '\0';
+   cl->qlen += need;
+}
+
+/*
+ * Read everything available on a client socket and queue the complete
+ * requests for the pool threads. Requests are NUL terminated strings,
+ * clients pad them with NULs up to a fixed size (see send_socket), the
+ * padding is skipped. Once the socket is drained, an unterminated tail is
+ * taken as a request too since madmin sends its short commands without
+ * terminator. Clients which negotiated the framed protocol at login send
+ * frames instead (see L2D2_FRAME_HEADER).
+ * Returns TRUE when the connection must be closed.
+ */
+static int l2d2_clientReadable( _l2d2client *cl, _l2d2worker *wrk )
+{
+   char Stime[25];
+   char *p, *end, *eom;
+   ssize_t num;
+   size_t len;
+   unsigned int flen, id;
+   int op, status, bad = FALSE;
+   int drained = FALSE, close_conn = FALSE;
+
+   do {
+       /* keep room for one full request and a terminator */
+       if ( cl->rsize - cl->rlen < L2D2_REQUEST_SIZE + 1 ) {
+            if ( cl->rsize >= L2D2_CLIENT_RBUF_MAX ) {
+                 if ( wrk->mlog != NULL ) fprintf(wrk->mlog,"Request too long from Host:%s Exp=%s Node:%s, closing connection\n",cl->host,cl->xp,cl->node);
+                 return(TRUE);
+            }
+            cl->rsize = cl->rsize > 0 ? 2 * cl->rsize : 2 * L2D2_REQUEST_SIZE;
+            cl->rbuf = (char *) xrealloc(cl->rbuf, cl->rsize);
+       }
+
+       num = recv(cl->fd, cl->rbuf + cl->rlen, cl->rsize - cl->rlen - 1, 0);
+       if ( num < 0 ) {
+            if ( errno == EINTR ) continue;
+            if ( errno != EWOULDBLOCK && errno != EAGAIN ) {
+                 get_time(Stime,3);
+                 if ( wrk->mlog != NULL ) logZone(L2D2.dzone,L2D2.dzone,wrk->mlog,"recv() failed on descriptor:%d AT:%s errno=%d\n",cl->fd, Stime, errno);
+                 close_conn = TRUE;
+            }
+            drained = TRUE;
+       } else if ( num == 0 ) {
+            /* connection closed by the client */
+            close_conn = drained = TRUE;
+       } else {
+            cl->rlen += num;
+       }
+
+       /* queue complete requests */
+       p = cl->rbuf;
+       end = cl->rbuf + cl->rlen;
+       pthread_mutex_lock(&cl->lock);
+       if ( cl->framed ) {
+            while ( end - p >= L2D2_FRAME_HEADER ) {
+                 unpack_frame(p, &flen, &id, &op, &status);
+                 if ( flen > L2D2_FRAME_MAX || id == 0 || op <= ' ' || op > '~' ) {
+                      bad = TRUE;
+                      break;
+                 }
+                 if ( (size_t) (end - p) < L2D2_FRAME_HEADER + flen ) break;
+                 l2d2_clientRequest(cl, id, op, p + L2D2_FRAME_HEADER, flen);
+                 p += L2D2_FRAME_HEADER + flen;
+            }
+       } else {
+            while ( p < end ) {
+                 if ( *p == '\0' ) {
+                      p++;
+                      continue;
+                 }
+                 if ( (eom = memchr(p, '\0', end - p)) == NULL ) {
+                      if ( ! drained ) break;
+                      *end = '\0';
+                      eom = end;
+                 }
+                 len = eom - p;
+                 l2d2_clientRequest(cl, 0, 0, p, len);
+                 p = eom < end ? eom + 1 : end;
+            }
+       }
+       if ( cl->qlen > 0 && ! cl->busy ) l2d2_workSubmit(cl);
+       pthread_mutex_unlock(&cl->lock);
+
+       if ( bad ) {
+            if ( wrk->mlog != NULL ) fprintf(wrk->mlog,"Bad frame from Host:%s Exp=%s Node:%s, closing connection\n",cl->host,cl->xp,cl->node);
+            return(TRUE);
+       }
+
+       cl->rlen = end - p;
+       if ( cl->rlen > 0 && p != cl->rbuf ) memmove(cl->rbuf, p, cl->rlen);
+   } while ( ! drained );
+
+   return(close_conn);
+}
+
+/*
+ * Accept one pending connection on the listening socket.
+ * Returns the new client, NULL when there is nothing more to accept.
+ */
+static _l2d2client *l2d2_clientAccept( int listen_sd, _l2d2worker *wrk )
+{
+   int new_sd;
+
+   while ( (new_sd = accept(listen_sd, NULL, NULL)) < 0 ) {
+        if ( errno == EINTR || errno == ECONNABORTED ) continue;
+        if ( errno != EWOULDBLOCK && errno != EAGAIN ) {
+             if ( wrk->mlog != NULL ) fprintf(wrk->mlog,"accept() failed errno=%d\n",errno);
+             /* running out of descriptors is transient, anything else ends the worker */
+             if ( errno != EMFILE && errno != ENFILE ) wrk->end_server = TRUE;
+        }
+        return(NULL);
+   }
+
+   /* the accepted socket does not always inherit O_NONBLOCK from the listening socket */
+   if  ( ! (fcntl(new_sd, F_GETFL) & O_NONBLOCK)  ) {
+        if  (fcntl(new_sd, F_SETFL, fcntl(new_sd, F_GETFL) | O_NONBLOCK) < 0) {
+             if ( wrk->mlog != NULL ) fprintf(wrk->mlog,"Could not put the socket in non-blocking mode\n");
+        }
+   }
+
+   return( l2d2_clientOpen(new_sd) );
+}
+
+/*
+ * Called when the worker waited ETERNAL_WORKER_STIMEOUT seconds without
+ * activity: cascade the log file if the day changed.
+ */
+static void l2d2_workerIdle( _l2d2worker *wrk )
+{
+   char Stime[25], buf[1024];
+
+   get_time(Stime,1);
+   if ( strncmp(wrk->tlog,Stime,8) != 0 && wrk->mlog != NULL ) {
+        pthread_rwlock_wrlock(&LogLock);
+        fprintf(wrk->mlog,"Cascading log file at:%s\n", Stime);
+        snprintf(wrk->tlog,sizeof(wrk->tlog),"%.8s",Stime);
+        /* close old mlog file */
+        fclose(wrk->mlog);
+        snprintf(buf,sizeof(buf),"%s/meworker_%.8s_%d",L2D2.logdir,Stime,getpid());
+        if ( (wrk->mlog=fopen(buf,"w+")) == NULL ) {
+              fprintf(stderr,"Worker: Could not open mlog stream\n"); /* doesn't go anywhere */
+        } else {
+              setvbuf(wrk->mlog, NULL, _IONBF, 0);
+        }
+        pthread_rwlock_unlock(&LogLock);
+   }
+}
+
+/*
+ *  Worker Process : for locking & logging.
+ *  The main thread accepts the clients and multiplexes their sockets with
+ *  epoll or select according to L2D2.eventLoop, requests are served by a
+ *  fixed pool of L2D2.workerThreads threads.
+ */
+static void l2d2Servlet( int listen_sd )
+{
+  FILE *fp;
+  char buf[1024], Stime[25];
+  _l2d2worker wrk;
+  pthread_t tid;
+  pthread_attr_t attr;
+  sigset_t allsig, oldsig;
+  int i, nthreads = 0;
+
+  memset(&wrk,'\0',sizeof(wrk));
+  wrk.timeout=ETERNAL_WORKER_STIMEOUT;
 
   /* open log files */
   get_time(Stime,1);
-  snprintf(tlog,sizeof(tlog),"%.8s",Stime);
-  
+  snprintf(wrk.tlog,sizeof(wrk.tlog),"%.8s",Stime);
+
   memset(buf,'\0',sizeof(buf));
-  if ( tworker == ETERNAL ) 
-      snprintf(buf,sizeof(buf),"%s/meworker_%.8s_%d",L2D2.logdir,Stime,getpid());
-  else
-      snprintf(buf,sizeof(buf),"%s/mtworker_%.8s_%d",L2D2.logdir,Stime,getpid());
-  
+  snprintf(buf,sizeof(buf),"%s/meworker_%.8s_%d",L2D2.logdir,Stime,getpid());
 
-  /* if logging directory was removed -> NO logs  for the 3 servers */ 
-  if ( (mlog=fopen(buf,"w+")) != NULL ) {
-         setvbuf(mlog, NULL, _IONBF, 0); /* streams will be unbuffered */
+  /* if logging directory was removed -> NO logs  for the 3 servers */
+  if ( (wrk.mlog=fopen(buf,"w+")) != NULL ) {
+         setvbuf(wrk.mlog, NULL, _IONBF, 0); /* streams will be unbuffered */
   }
 
+  /* for heartbeat */
+  snprintf(wrk.heartbeatFile,sizeof(wrk.heartbeatFile),"%s/EW_%d",L2D2.tmpdir,getpid());
 
-  /* for heartbeat */ 
-  if ( tworker == ETERNAL ) {
-        snprintf(heartbeatFile,sizeof(heartbeatFile),"%s/EW_%d",L2D2.tmpdir,getpid());
-  } else { 
-	snprintf(heartbeatFile,sizeof(heartbeatFile),"%s/TRW_%d",L2D2.tmpdir,getpid());
-  }
-       
   /* create files */
-  if ( (fp=fopen(heartbeatFile,"w+")) != NULL ) {
+  if ( (fp=fopen(wrk.heartbeatFile,"w+")) != NULL ) {
           fclose(fp);
   }
- 
-  /*
-  === This could be used in future ====
-  register SIGALRM signal for session control with each client,though it will need sig suspend 
-  ssa.sa_handler = recv_handler;
-  ssa.sa_flags = 0;
-  sigemptyset(&ssa.sa_mask);
-  if ( sigaction(SIGALRM,&ssa,NULL) == -1 ) fprintf(mlog,"Error registring signal in SelectServlet \n");
-  */
 
-  FD_ZERO(&master_set);
-  max_sd = listen_sd;
-  FD_SET(listen_sd, &master_set);
+  Servlet = &wrk;
 
-  /* get reference time to manage sending of signals to add workers to main server */
-  time(&sig_sent);
+  if ( pipe(DonePipe) != 0 ) {
+        if ( wrk.mlog != NULL ) fprintf(wrk.mlog,"Worker: could not create pipe ... exiting\n");
+        exit(1);
+  }
+  fcntl(DonePipe[0], F_SETFL, fcntl(DonePipe[0], F_GETFL) | O_NONBLOCK);
+
+  /* signals are for the main thread, pool and log writer threads block them all */
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  sigfillset(&allsig);
+  pthread_sigmask(SIG_BLOCK, &allsig, &oldsig);
+  if ( LogWriter_start(L2D2.nodelogIndex) != 0 ) {
+        if ( wrk.mlog != NULL ) fprintf(wrk.mlog,"Worker: could not start the log writer ... exiting\n");
+        exit(1);
+  }
+  /* a configuration path that left it unset gets the default */
+  if ( L2D2.workerThreads <= 0 ) L2D2.workerThreads = 8;
+  for ( i = 0; i < L2D2.workerThreads; i++ ) {
+        if ( pthread_create(&tid, &attr, l2d2_poolThread, &wrk) != 0 ) {
+              if ( wrk.mlog != NULL ) fprintf(wrk.mlog,"Worker: could not create pool thread number %d\n",i);
+              break;
+        }
+        nthreads++;
+  }
+  pthread_sigmask(SIG_SETMASK, &oldsig, NULL);
+  pthread_attr_destroy(&attr);
 
-  /* fix timeout for each type of workers */
-  if ( tworker == ETERNAL ) {
-          SelecTimeOut=ETERNAL_WORKER_STIMEOUT;
-  } else {
-          SelecTimeOut=TRANSIENT_WORKER_STIMEOUT;
+  if ( nthreads == 0 ) {
+        if ( wrk.mlog != NULL ) fprintf(wrk.mlog,"Worker: no pool thread ... exiting\n");
+        exit(1);
   }
 
+#ifdef L2D2_HAVE_EPOLL
+  if ( L2D2.eventLoop == L2D2_LOOP_EPOLL ) {
+        if ( wrk.mlog != NULL ) fprintf(wrk.mlog,"Worker pid=%d using epoll event loop and %d threads\n",getpid(),nthreads);
+        l2d2EpollServlet(listen_sd, &wrk);
+        return;
+  }
+#endif
+  if ( wrk.mlog != NULL ) fprintf(wrk.mlog,"Worker pid=%d using select event loop and %d threads\n",getpid(),nthreads);
+  l2d2SelectServlet(listen_sd, &wrk);
+}
+
+/*
+ * Stop watching the socket of a finished client in the select() loop.
+ */
+static void l2d2_selectDrop( _l2d2client *cl, _l2d2worker *wrk, fd_set *master_set, int *max_sd )
+{
+   int fd = cl->fd;
+
+   l2d2_clientDrop(cl, wrk);
+   FD_CLR(fd, master_set);
+   if (fd == *max_sd) {
+      while (FD_ISSET(*max_sd, master_set) == FALSE) *max_sd -= 1;
+   }
+}
+
+/*
+ * select() event loop, limited to descriptors below FD_SETSIZE.
+ */
+static void l2d2SelectServlet( int listen_sd , _l2d2worker *wrk )
+{
+  fd_set master_set, read_set, write_set;
+  int i, fd, rc, max_sd, desc_ready, pending, close_conn;
+  struct timeval timeout;   /* Timeout for select */
+  _l2d2client *cl;
+
+  FD_ZERO(&master_set);
+  FD_SET(listen_sd, &master_set);
+  FD_SET(DonePipe[0], &master_set);
+  max_sd = listen_sd > DonePipe[0] ? listen_sd : DonePipe[0];
+
   /* Loop waiting for incoming connects or for incoming data on any of the connected sockets. */
   do
   {
-      /* Copy the master fd_set over to the working fd_set. */
-      memcpy(&working_set, &master_set, sizeof(master_set));
-  
-      /* set timeout for select SELECT_TIMEOUT minutes      */
-      timeout.tv_sec = SelecTimeOut ;
+      /* Copy the master fd_set over to the working fd_set, and watch
+         for writability the clients having replies pending */
+      memcpy(&read_set, &master_set, sizeof(master_set));
+      FD_ZERO(&write_set);
+      for (i=0; i <= max_sd && i < ClientTable.size; ++i) {
+          if ( (cl=ClientTable.conn[i]) == NULL || ! FD_ISSET(i, &master_set) ) continue;
+          pthread_mutex_lock(&cl->lock);
+          pending = cl->wlen > 0;
+          pthread_mutex_unlock(&cl->lock);
+          if ( pending ) FD_SET(i, &write_set);
+      }
+
+      timeout.tv_sec = wrk->timeout ;
       timeout.tv_usec = 0;
 
-      /* Call select() with timeout                         */
-      rc = select(max_sd + 1, &working_set, NULL, NULL, &timeout);
+      rc = select(max_sd + 1, &read_set, &write_set, NULL, &timeout);
 
-      /* Check to see if the select call failed.            */
       if (rc < 0) {
-	 if ( mlog != NULL ) fprintf(mlog,"select() failed: Worker end \n");
+         if ( errno == EINTR ) continue;
+	 if ( wrk->mlog != NULL ) fprintf(wrk->mlog,"select() failed: Worker end \n");
          break;
       }
 
-      /* Check to see if select call timed out ... yes -> do admin. things */ 
-      if (rc == 0) {
-          if ( tworker != ETERNAL ) {
-             ret=unlink(heartbeatFile);
-	     get_time(Stime,2);
-	     if ( mlog != NULL ) {
-	           fprintf(mlog,"Transient worker process exited pid=%lu at:%s\n", (unsigned long) getpid(), Stime );
-	           fclose(mlog);
-	     }
-	     exit(0); /* send SIGCHLD to controller */
-          } else {
-	     /* cascade log file if time to do so */
-	     get_time(Stime,1);
-	     if ( strncmp(tlog,Stime,8) != 0 && mlog != NULL ) {
-	            fprintf(mlog,"Cascading log file at:%s\n", Stime);
-	            snprintf(tlog,sizeof(tlog),"%.8s",Stime);
-	            /* close old mlog file */
-	            fclose(mlog);
-                    snprintf(buf,sizeof(buf),"%s/meworker_%.8s_%d",L2D2.logdir,Stime,getpid());
-	            if ( (mlog=fopen(buf,"w+")) == NULL ) {
-	                      fprintf(stderr,"Worker: Could not open mlog stream\n"); /* doesn't go anywhere */
-	            } else {
-	                setvbuf(mlog, NULL, _IONBF, 0);
-                    }
-	     }
-	  }
-      }
-      
+      /* Check to see if select call timed out ... yes -> do admin. things */
+      if (rc == 0) l2d2_workerIdle(wrk);
+
       /* heartbeat */
-      ret=utime(heartbeatFile,NULL); 
+      utime(wrk->heartbeatFile,NULL);
 
-      /* One or more descriptors are readable. Need to           
-         determine which ones they are.                         */
       desc_ready = rc;
       for (i=0; i <= max_sd  &&  desc_ready > 0; ++i)
       {
-         /* Check to see if this descriptor is ready            */
-         if (FD_ISSET(i, &working_set))
-         {
-            /* A descriptor was found that is readable - one     
-               less has to be looked for.  This is being done     
-               so that we can stop looking at the working set     
-               once we have found all of the descriptors that     
-               were ready. */
-            
-	    desc_ready -= 1;
-
-            /* Check to see if this is the listening socket */
-            if (i == listen_sd)
-            {
-               /* Accept all incoming connections that are        
-                  queued up on the listening socket before we     
-                  loop back and call select again. */
-               do
-               {
-                  /* Accept each incoming connection.  If       
-                     accept fails with EWOULDBLOCK, then we     
-                     have accepted all of them.  Any other      
-                     failure on accept will cause us to end the 
-                     server.  */
-                  new_sd = accept(listen_sd, NULL, NULL);
-                  if (new_sd < 0) {
-                     if (errno != EWOULDBLOCK) {
-	                    if ( mlog != NULL ) fprintf(mlog,"accept() failed \n");
-                            end_server = TRUE;
+         if ( ! FD_ISSET(i, &read_set) && ! FD_ISSET(i, &write_set) ) continue;
+         desc_ready -= FD_ISSET(i, &read_set) ? 1 : 0;
+         desc_ready -= FD_ISSET(i, &write_set) ? 1 : 0;
+
+         /* Accept all incoming connections that are queued up on the listening socket */
+         if (i == listen_sd) {
+               while ( (cl=l2d2_clientAccept(listen_sd, wrk)) != NULL ) {
+                     if ( cl->fd >= FD_SETSIZE ) {
+                           if ( wrk->mlog != NULL ) fprintf(wrk->mlog,"Descriptor %d above select() limit, connection refused\n",cl->fd);
+                           l2d2_clientClose(cl, wrk);
+                           continue;
                      }
-                     break;
-                  }
-
-                  /* Add the new incoming connection to the master read set. 
-		   * And Examine maximum simulatenous connected Clients 
-		   * Note, we do not reject accepts, but we rely on the main 
-		   * server to spawn a new worker to lower the load and also 
-		   * hoping that after 5 sec, the load is fairly distributed
-		   * btw the workers. */
-		  
-		  /* put the socket in non-blocking mode 
-		     I think there is no need for this , the socket will inherit the
-		     state from the listening socket */
-		  if  ( ! (fcntl(new_sd, F_GETFL) & O_NONBLOCK)  ) {
-		        if  (fcntl(new_sd, F_SETFL, fcntl(new_sd, F_GETFL) | O_NONBLOCK) < 0) {
-		            if ( mlog != NULL ) fprintf(mlog,"Could not put the socket in non-blocking mode\n");
-		        }
-		  }
-                  
-		  FD_SET(new_sd, &master_set);
-                  if (new_sd > max_sd) max_sd = new_sd; /* keep track of the max */
-		  
-		  ceiling++;
-		  if ( ceiling >= L2D2.maxClientPerProcess ) {
-			time(&now);
-			/* wait SPAWNING_DELAY_TIME secondes btw sending of signals to main server,this is for signal flood control 
-			   Note : Only Eternal worker is able to send signal for adding workers */
-			if ( (delay=difftime(now,sig_sent)) >= SPAWNING_DELAY_TIME ) {
-		               get_time(Stime,3);
-			       if ( tworker == ETERNAL ) {
-		                     if ( mlog != NULL ) fprintf(mlog,"Signal sent at:%s to main server to add a worker\n",Stime);
-		                     kill(L2D2.pid,SIGUSR2);
-                               }
-			       sig_sent=now;
-			}
-		  }
+                     FD_SET(cl->fd, &master_set);
+                     if (cl->fd > max_sd) max_sd = cl->fd; /* keep track of the max */
+               }
+               continue;
+         }
 
-                 /* Loop back up and accept another incoming connection */
-               } while (new_sd != -1);
-            }
+         /* replies from the pool threads */
+         if (i == DonePipe[0]) {
+               while ( (fd=l2d2_nextDone()) >= 0 ) {
+                     if ( (cl=l2d2_clientDone(fd, wrk)) != NULL ) l2d2_selectDrop(cl, wrk, &master_set, &max_sd);
+               }
+               continue;
+         }
 
-            /* This is not the listening socket, therefore an     
-               existing connection must be readable             */
-            else
-            {
-               close_conn = FALSE;
-               /* Receive all incoming data on this socket        
-                  before we loop back and call select again.    */
-               memset(buff,'\0',sizeof(buff));
-	       count=0;
-               do
-               {
-		/* Receive data on this connection until the    
-                   recv fails with EWOULDBLOCK.  If any other   
-                   failure occurs, we will close the connection. */
-		   
-                   rc = recv(i, buff, sizeof(buff), 0);
-                   if (rc < 0) {
-                      if (errno != EWOULDBLOCK) {
-                           get_time(Stime,3);
-                           if ( mlog != NULL ) logZone(L2D2.dzone,L2D2.dzone,mlog,"recv() failed with Host:%s AT:%s Exp=%s Node:%s Signal:%s\n",l2d2client[i].host, Stime, l2d2client[i].xp, l2d2client[i].node, l2d2client[i].signal);
-                           close_conn = TRUE;
-                      }
-                      break;
-                    }
-
-                    /* Check to see if the connection has been closed by the client  */
-                   if (rc == 0) {
-                        get_time(Stime,3);
-                        if ( mlog != NULL ) logZone(_ZONE_,L2D2.dzone,mlog,"%s Closed:%s TrNum=%u\n",l2d2client[i].Open_str,Stime,l2d2client[i].trans);
-                        close_conn = TRUE;
-                        break;
-                   }
-                   
-                   /* work on data (requests)  */
-                   buff[rc > 0 ? rc : 0] = '\0';
-		  
-                   switch (buff[0]) {
-	                       case 'A': /* test existence of file  */
-			                memset(filename,'\0',sizeof(filename));
-					ret = sscanf(&buff[2],"%s %d",filename, &mode);
-	                                ret = access (filename , mode);
-			                send_reply(i,ret);
-					l2d2client[i].trans++;
-			                break;
-	                       case 'C': /*  create a Lock file  */
-	                                ret = CreateLock ( &buff[2] );
-			                send_reply(i,ret);
-					l2d2client[i].trans++;
-			                break;
-	                       case 'D': /* mkdir  */
-	                                ret = r_mkdir ( &buff[2] , 1, mlog);
-			                send_reply(i,ret);
-					l2d2client[i].trans++;
-			                break;
-	                       case 'F': /* test existence of file  */
-	                                ret = isFileExists ( &buff[2] );
-			                send_reply(i,ret);
-					l2d2client[i].trans++;
-			                break;
-	                       case 'G': /* glob  */
-			                ret = globPath (&buff[2], GLOB_NOSORT, 0, mlog );
-			                send_reply(i,ret);
-					l2d2client[i].trans++;
-			                break;
-	                       case 'I': /* accept session */
-			                 pidSent=0;
-					 memset(expInode,'\0',sizeof(expInode));
-					 memset(expName,'\0',sizeof(expName));
-					 memset(node,'\0',sizeof(node));
-					 memset(hostname,'\0',sizeof(hostname));
-					 memset(username,'\0',sizeof(username));
-					 memset(m5,'\0',sizeof(m5));
-                                         ret=sscanf(&buff[2],"%d %s %s %s %s %s %s %s",&pidSent,expInode,expName,node,signal,hostname,username,m5);
-                                         get_time(Stime,3);
-                                         if ( ret != 8 ) {
-	                                         send_reply(i,1);
-                                                 if ( mlog != NULL ) fprintf (mlog,"Got wrong number of parameters at LOGIN, number=%d instead of 8 buff=>%s<\n",ret,buff);
-	                                         /* close(i);same comment as for the S case below */
-			                         ret=shutdown(i,SHUT_WR);
-					         ceiling--;
-                                                 snprintf(l2d2client[i].Open_str,sizeof(l2d2client[i].Open_str),"Session Refused with Host:%s AT:%s Exp=%s Node=%s Signal=%s ... Wrong number of arguments ",hostname , Stime, expName, node, signal);
-                                         } else if ( pidTken == pidSent && strcmp(m5,L2D2.m5sum) == 0 ) {
-	                                         send_reply(i,0);
-						 snprintf(l2d2client[i].Open_str,sizeof(l2d2client[i].Open_str),"OpenConHost:%s At:%s Xp=%s Node=%s Signal=%s NumCon=%d ",hostname, Stime, expName, node ,signal, ceiling);
-                                         } else {
-	                                         send_reply(i,1);
-	                                         /* close(i);same comment as for the S case below */
-			                         ret=shutdown(i,SHUT_WR);
-						 ceiling--;
-                                                 snprintf(l2d2client[i].Open_str,sizeof(l2d2client[i].Open_str),"Session Refused with Host:%s AT:%s Exp=%s Node=%s Signal=%s pid_svr=%d pid_sent=%d m5_client=%s ",hostname , Stime, expName, node, signal, pidTken, pidSent, m5);
-                                         }
-                                         /* gather info for this client */
-					 l2d2client[i].trans=0;
-			                 strcpy(l2d2client[i].host,hostname);
-			                 strcpy(l2d2client[i].xp,expName);
-			                 strcpy(l2d2client[i].node,node);
-			                 strcpy(l2d2client[i].signal,signal);
-		                         break;
-	                       case 'K': /* write Inter user dep file : Not used */
-			                break;
-	                       case 'L':/* Log the node under the proper experiment ie: grab a lock on a file  */ 
-                                        /* Generate a key based on xp's Inode & user id. Same for all process ,we are not using ftok
-		                           Note : For this release we discard using the datestamp in generating the key */
-
-                                        memset(buf,'\0',sizeof(buf));
-
-                                        /* regexp for checking existence of TRansient Workers . If there are any , we must use the
-					   locking mechanism. if none (only the Eternel worker write directly in nodelog file */ 
-	                                snprintf(buf,sizeof(buf),"%s/TRW_*",L2D2.tmpdir);
-					g_result = glob(buf, 0, NULL, &g_AliveFiles);
-
-                                        if ( tworker == TRANSIENT || ( g_result == 0 && g_AliveFiles.gl_pathc > 0 ) ) {
-
-					       globfree(&g_AliveFiles);
-                                               log_key = (getuid() & 0xff ) << 24 | ( atoi(expInode) & 0xffff) << 16;
-                                               memset(buf,'\0',sizeof(buf));
-	                                       snprintf(buf,sizeof(buf),"%s/NodeLogLock_0x%x",L2D2.tmpdir,log_key);
-					       /* Open a file descriptor to the file.  what if +1 open at the same time? */
-					       if ( (fd = open (buf, O_WRONLY|O_CREAT, S_IRWXU)) < 0 ) {
-                                                      if ( mlog != NULL ) fprintf(mlog,"ERROR Opening NodeLogLock file\n");
-			                              send_reply(i,1);
-					              break;
-					       }
-					       memset (&nlock, 0, sizeof(nlock));
-					       nlock.l_type = F_WRLCK;
-					       /* NOTE: F_SETLKW -> fnc suspend until lock be placed, 
-					                F_SETLK  -> fnc returns immedialtly if lock cannot be placed */
-                                               got_lock = FALSE;
-
-					       /* try for (MAX_LOCK_TRY - 1) * 0.25 sec ie= 2.5 sec */
-                                               for (  try = 0; try < MAX_LOCK_TRY; try++ ) {
-					           if (fcntl(fd, F_SETLK, &nlock) == -1) {
-					                usleep(250000);
-					           } else { 
-					                got_lock = TRUE;
-					                break;
-					           }
-					       }
-
-                                               if ( got_lock == FALSE ) {
-					              fcntl(fd, F_GETLK, &ilock);
-					              if ( mlog != NULL ) fprintf(mlog,"ERROR Cannot get lock, owned by pid:%d exp=%s node=%s\n", ilock.l_pid, expName, node);
-                                                      close(fd);
-			                              send_reply(i,1);
-					              break;
-					       }
-
-	                                       ret = NodeLogr( &buff[2] , getpid(), mlog );
-			                       send_reply(i,ret);
-                         
-                                               nlock.l_type = F_UNLCK;
-                                               if (fcntl(fd, F_SETLK, &nlock) == -1) {
-                                                      if ( mlog != NULL ) fprintf(mlog,"ERROR unlocking NodeLogLock file\n");
-					       }
-                                               close(fd);
-                                        } else {  
-					       /* one Serial worker ie Eternel worker */ 
-	                                       ret = NodeLogr( &buff[2] , getpid(), mlog );
-			                       send_reply(i,ret);
-					}
-			  
-					l2d2client[i].trans++;
-			                break;
-	                       case 'N': /* grab a lock for End state */
-		                        ret = lock( &buff[2] ,   L2D2 ,expName, node, mlog ); 
-			                send_reply(i,ret);
-					l2d2client[i].trans++;
-			                break;
-	                       case 'P': /* unlock End state */ 
-		                        ret = unlock( &buff[2] , L2D2 ,expName, node, mlog ); 
-			                send_reply(i,ret);
-					l2d2client[i].trans++;
-		                        break;
-	                       case 'R': /* Remove file on local xp */
-	                                ret = removeFile( &buff[2] );
-			                send_reply(i,ret);
-					l2d2client[i].trans++;
-			                break;
-	                       case 'S': /* Client has sent a Stop. OK Close this connection 
-			                Note: if we use close(i) here , the rcv() call will fail, we need to close
-					the server write side and let the client close his side, the server will then
-					report a closed socket */
-			                ret=shutdown(i,SHUT_WR);
-			                STOP = TRUE; /* var STOP not used for the moment */
-			                break;
-	                       case 'T': /* Touch a Lock file on local xp */
-	                                ret = touch ( &buff[2] );
-			                send_reply(i,ret);
-					l2d2client[i].trans++;
-			                break;
-	                       case 'W': /* write Node Wait file  under dependent-ON xp */
-			                ret = writeNodeWaitedFile ( &buff[2] , mlog );
-			                send_reply(i,ret);
-					l2d2client[i].trans++;
-			                break;
-	                       case 'X': /* server shutdown */
-		                        kill(L2D2.pid,SIGUSR1);
-			                ret=shutdown(i,SHUT_WR);
-			                STOP = TRUE;
-			                break;
-	                       case 'Y': /* server is alive need to return more here? */
-		                        get_time(Stime,1);
-                                        time(&now);
-                                        memset(buf,'\0',sizeof(buf));
-	                                snprintf(buf,sizeof(buf),"%s/DM_*",L2D2.tmpdir);
-					g_result = glob(buf, 0, NULL, &g_AliveFiles);
-                                        if (  g_result == 0 && g_AliveFiles.gl_pathc == 1  ) {
-				                 if ( stat(*(g_AliveFiles.gl_pathv), &stbuf) == 0) {
-					                epoch_diff=abs(now - stbuf.st_mtime); 
-							/* 120 sec for DM heartbeat */
-					                if ( epoch_diff >=  180  ) {
-	                                                        snprintf(buf,sizeof(buf),"0 Problems with Dependency Manager: heartbeat \0");
-					                        ret=write(i,buf,strlen(buf));
-			                                        break;
-					                }
-						 }
-                                        } else if (g_AliveFiles.gl_pathc > 1 ) {
-	                                       snprintf(buf,sizeof(buf),"0 Problems with Dependency Manager: Multiple instances\0");
-					       ret=write(i,buf,strlen(buf));
-			                       break;
-					} else {
-					       /* issue a kill here before sending message */
-	                                       snprintf(buf,sizeof(buf),"0 Problems with Dependency Manager: process dead \0");
-					       ret=write(i,buf,strlen(buf));
-			                       break;
-					}
-
-			                if ( tworker != ETERNAL ) {
-                                             time(&now);
-                                             memset(buf,'\0',sizeof(buf));
-	                                     snprintf(buf,sizeof(buf),"%s/DM_*",L2D2.tmpdir);
-					     g_result = glob(buf, 0, NULL, &g_AliveFiles);
-                                             if (  g_result == 0 && g_AliveFiles.gl_pathc == 1  ) {
-				                      if ( stat(*(g_AliveFiles.gl_pathv), &stbuf) == 0) {
-					                     epoch_diff=(int)(now - stbuf.st_mtime); 
-							     /* 60 sec for EW heartbeat if no coonections  */
-					                     if ( epoch_diff >= 100 ) {
-	                                                             snprintf(buf,sizeof(buf),"0 Problems with Eternal worker: heartbeat\0");
-					                             ret=write(i,buf,strlen(buf));
-			                                             break;
-					                     }
-						      }
-                                             } else if (g_AliveFiles.gl_pathc > 1 ) {
-	                                            snprintf(buf,sizeof(buf),"0 Problems with Eternal worker: Multiple instances\0");
-					            ret=write(i,buf,strlen(buf));
-			                            break;
-					     } else {
-					       /* issue a kill here before sending message */
-	                                       snprintf(buf,sizeof(buf),"0 Problems with Eternal worker: process dead \0");
-					       ret=write(i,buf,strlen(buf));
-			                       break;
-					     }
-					} 
-
-			                /* send_reply(i,0); */
-	                                snprintf(buf,sizeof(buf),"0 Server is Alive on host=%s version=%s, Dependency Manager ok, Eworker ok \0",L2D2.host, L2D2.mversion);
-					ret=write(i,buf,strlen(buf));
-			                break;
-	                       case 'Z':/* download waited file to client */
-		                        ret = SendFile( &buff[2] , i, mlog ); 
-					/* if waited file not there really , client will abort
-					   connection will eventualy be closed */
-					l2d2client[i].trans++;
-		              	        break;
-                               default :
-	                                if ( mlog != NULL ) fprintf(mlog,"Unrecognized Token>%s< from Host=%s Exp=%s node=%s signal=%s \n",buff,l2d2client[i].host,l2d2client[i].xp,l2d2client[i].node,l2d2client[i].signal);
-			                send_reply(i,1); 
-			                break;
-                       }
-		       count++;
-               } while (TRUE); 
-
-               /* If the close_conn flag was turned on, we need   
-                  to clean up this active connection.  This       
-                  clean up process includes removing the          
-                  descriptor from the master set and              
-                  determining the new maximum descriptor value    
-                  based on the bits that are still turned ON in   
-                  the master set.                               */
-
-               if (close_conn) {
-                     close(i);
-                     FD_CLR(i, &master_set);
-                     if (i == max_sd) {
-                        while (FD_ISSET(max_sd, &master_set) == FALSE) max_sd -= 1;
+         /* existing connection is readable and/or writable */
+         if ( (cl = ClientTable.conn[i]) == NULL ) continue;
+         close_conn = FALSE;
+         if ( FD_ISSET(i, &read_set) ) close_conn = l2d2_clientReadable(cl, wrk);
+         if ( ! close_conn && FD_ISSET(i, &write_set) ) close_conn = l2d2_clientWritable(cl);
+
+         if (close_conn) l2d2_selectDrop(cl, wrk, &master_set, &max_sd);
+      } /* End of loop through selectable descriptors */
+   } while (wrk->end_server == FALSE);
+}
+
+#ifdef L2D2_HAVE_EPOLL
+/*
+ * epoll() event loop. Client sockets are edge triggered: they are
+ * drained on each readable event and flushed on each writable event.
+ * The listening socket stays level triggered.
+ */
+static void l2d2EpollServlet( int listen_sd , _l2d2worker *wrk )
+{
+  struct epoll_event ev, events[L2D2_EPOLL_EVENTS];
+  int i, fd, rc, epfd, close_conn;
+  _l2d2client *cl;
+
+  if ( (epfd = epoll_create(L2D2_EPOLL_EVENTS)) < 0 ) {
+        if ( wrk->mlog != NULL ) fprintf(wrk->mlog,"epoll_create() failed, falling back to select()\n");
+        l2d2SelectServlet(listen_sd, wrk);
+        return;
+  }
+
+  memset(&ev,'\0',sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = listen_sd;
+  rc = epoll_ctl(epfd, EPOLL_CTL_ADD, listen_sd, &ev);
+  ev.data.fd = DonePipe[0];
+  if ( rc < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, DonePipe[0], &ev) < 0 ) {
+        if ( wrk->mlog != NULL ) fprintf(wrk->mlog,"epoll_ctl() failed, falling back to select()\n");
+        close(epfd);
+        l2d2SelectServlet(listen_sd, wrk);
+        return;
+  }
+
+  do
+  {
+      rc = epoll_wait(epfd, events, L2D2_EPOLL_EVENTS, wrk->timeout * 1000);
+
+      if (rc < 0) {
+         if ( errno == EINTR ) continue;
+	 if ( wrk->mlog != NULL ) fprintf(wrk->mlog,"epoll_wait() failed: Worker end \n");
+         break;
+      }
+
+      /* timed out ... yes -> do admin. things */
+      if (rc == 0) l2d2_workerIdle(wrk);
+
+      /* heartbeat */
+      utime(wrk->heartbeatFile,NULL);
+
+      for (i=0; i < rc; ++i)
+      {
+         if ( events[i].data.fd == listen_sd ) {
+               while ( (cl=l2d2_clientAccept(listen_sd, wrk)) != NULL ) {
+                     memset(&ev,'\0',sizeof(ev));
+                     ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                     ev.data.fd = cl->fd;
+                     if ( epoll_ctl(epfd, EPOLL_CTL_ADD, cl->fd, &ev) < 0 ) {
+                           if ( wrk->mlog != NULL ) fprintf(wrk->mlog,"epoll_ctl() failed on descriptor %d, connection refused\n",cl->fd);
+                           l2d2_clientClose(cl, wrk);
                      }
-		     /* dont think that this re-initializing is mandatory */
-		     l2d2client[i].trans=0;
-		     memset(l2d2client[i].host,'\0',sizeof(l2d2client[i].host));
-		     memset(l2d2client[i].xp,'\0',sizeof(l2d2client[i].xp));
-		     memset(l2d2client[i].node,'\0',sizeof(l2d2client[i].node));
-		     memset(l2d2client[i].signal,'\0',sizeof(l2d2client[i].signal));
-		     memset(l2d2client[i].Open_str,'\0',sizeof(l2d2client[i].Open_str));
-		     memset(l2d2client[i].Close_str,'\0',sizeof(l2d2client[i].Close_str));
-		     ceiling--;
                }
-            } /* End of existing connection is readable */
-         } /* End of if (FD_ISSET(i, &working_set)) */
-      } /* End of loop through selectable descriptors */
-   } while (end_server == FALSE);
+               continue;
+         }
 
-   /* Cleanup all of the sockets that are open                  */
-   for (i=0; i <= max_sd; ++i) {
-      if (FD_ISSET(i, &master_set)) close(i);
-   }
+         /* replies from the pool threads */
+         if ( events[i].data.fd == DonePipe[0] ) {
+               while ( (fd=l2d2_nextDone()) >= 0 ) {
+                     if ( (cl=l2d2_clientDone(fd, wrk)) != NULL ) {
+                           epoll_ctl(epfd, EPOLL_CTL_DEL, cl->fd, &ev);
+                           l2d2_clientDrop(cl, wrk);
+                     }
+               }
+               continue;
+         }
+
+         if ( events[i].data.fd >= ClientTable.size || (cl=ClientTable.conn[events[i].data.fd]) == NULL ) continue;
+
+         close_conn = FALSE;
+         if ( events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR) ) close_conn = l2d2_clientReadable(cl, wrk);
+         if ( ! close_conn && (events[i].events & EPOLLOUT) ) close_conn = l2d2_clientWritable(cl);
+
+         /* a client still held by a pool thread is closed once its job is done */
+         if (close_conn) {
+               epoll_ctl(epfd, EPOLL_CTL_DEL, cl->fd, &ev);
+               l2d2_clientDrop(cl, wrk);
+         }
+      }
+   } while (wrk->end_server == FALSE);
+
+   close(epfd);
 }
+#endif
 
 
 void maestro_l2d2_main_process_server (int fserver)
@@ -1068,7 +1798,8 @@ void maestro_l2d2_main_process_server (int fserver)
   /* Generate Eternal worker */
   if ( (pid_eworker = fork()) == 0 ) { 
       fclose(smlog);
-      l2d2SelectServlet( fserver , ETERNAL );
+      l2d2Servlet( fserver );
+      exit(0);
   } else if ( pid_eworker > 0 ) {      
       fprintf(smlog,"Main server: creating the first Worker pid=%d\n", pid_eworker);
   } else {                        
@@ -1097,27 +1828,6 @@ void maestro_l2d2_main_process_server (int fserver)
               }
 	}
 
-	if ( sig_admin_AddWorker == 1 ) {
-	      sig_admin_AddWorker=0;
-	      get_time(Time,3);
-	      fprintf(smlog,"Received signal USR2 at:%s from worker\n",Time);
-	      
-              if ( ProcessCount < L2D2.maxNumOfProcess && ProcessCount < MAX_PROCESS ) {
-                 if ( (ChildPids[ProcessCount] = fork()) == 0 ) { 
-		      fclose(smlog);
-                      l2d2SelectServlet( fserver , TRANSIENT );
-		      exit(0); /* never reached */
-                 } else if ( ChildPids[ProcessCount] > 0 ) {        
-	              fprintf(smlog,"One worker generated with pid=%u at:%s Actual ProcessCount=%d\n",ChildPids[ProcessCount],Time,ProcessCount);
-                      ProcessCount++;
-                 } else                      
-                      fprintf(smlog,"fork() Worker failed\n");
-              } else {
-	            fprintf(smlog,"cannot add more worker, already reached maximum:%d\n",ProcessCount);
-              }
-	}
-	
-
         /* sigchild :: a Child has exited ... dont know who is */
 	if ( sig_child == 1 ) {
 	     sig_child=0;
@@ -1127,9 +1837,6 @@ void maestro_l2d2_main_process_server (int fserver)
                    if ( ew_regenerated == 3 ) {
 	                 fprintf(smlog,"Eternal Worker has been Re-generated 2 times already .. exiting at :%s\n",Time);
 	                 close(fserver);
-                         for ( j=0; j < MAX_PROCESS ; j++ ) {
-	                       ChildPids[j] == 0 ? : kill (ChildPids[j],9);
-                         }
                          kill(L2D2.depProcPid,9);
 			 /* send email notice */
                          snprintf(message,sizeof(message),"maestro server (pid=%u) died (at:%s) after being re-started 2 times, Please check",L2D2.pid,Time);
@@ -1142,7 +1849,7 @@ void maestro_l2d2_main_process_server (int fserver)
 			 ret=unlink(filename);
                          if ( (pid_eworker = fork()) == 0 ) { 
 		                    fclose(smlog);
-                                    l2d2SelectServlet( fserver , ETERNAL );
+                                    l2d2Servlet( fserver );
 		                    exit(0); /* never reached */
                          } else if ( pid_eworker > 0 ) {      
                                     fprintf(smlog,"Main server: creating a Eworker pid=%d at:%s\n", pid_eworker, Time);
@@ -1161,9 +1868,6 @@ void maestro_l2d2_main_process_server (int fserver)
 	           if ( dm_regenerated == 2 ) {
 		        fprintf(smlog,"Dependency manager has been Re-generated once already .. exiting at:%s\n",Time);
 	                kill(pid_eworker,9);
-                        for ( j=0; j < MAX_PROCESS ; j++ ) {
-	                       ChildPids[j] == 0 ? : kill (ChildPids[j],9);
-                        }
                         snprintf(message,sizeof(message),"Dependency manager (pid=%u) died (at:%s) after being re-started, mserver exiting, Please check",L2D2.depProcPid,Time);
 			ret=sendmail(L2D2.emailTO,L2D2.emailTO,L2D2.emailCC,"maestro server (mserver) failure",&message[0],smlog);
 	                l2d2server_shutdown(pid_eworker,smlog);
@@ -1187,23 +1891,13 @@ void maestro_l2d2_main_process_server (int fserver)
                         }
                    }
              }
-
-	     /* Check Transient worker, update variables  */
-             for ( j=0; j < MAX_PROCESS; j++ ) {
-		 if ( ChildPids[j] != 0 && (ret=kill(ChildPids[j],0)) != 0 ) {
-	                     get_time(Time,2);
-                             ProcessCount = (ProcessCount < 0) ? 0 : ProcessCount-1;
-	                     fprintf(smlog,"Worker process pid:%u has terminated time=%s ProcessCount=%d\n", ChildPids[j], Time, ProcessCount);
-                             ChildPids[j]=0;
-		 }
-	     }
 	}
         
 	/* Heartbeat: 
 	   both of [E|T]Worker and DManager update a file on tmpdir, This section examine the
 	   modif time of the file to see if processes are still alive, this redundency is
 	   added in case we miss signals 
-	   Note : the Files TW_* (transient worker) are not examined */
+	   */
 
 	current_epoch = time(NULL);
 	/* Eternal worker       */
@@ -1242,9 +1936,6 @@ void maestro_l2d2_main_process_server (int fserver)
         if ( sig_admin_Terminate == 1 ) {
 	     close(fserver);
              sleep (2);
-             for ( j=0; j < MAX_PROCESS; j++ ) {
-	           ChildPids[j] == 0 ? : kill (ChildPids[j],9);
-             }
 	     kill(pid_eworker,9);
              kill(L2D2.depProcPid,9);
 	     l2d2server_shutdown(pid_eworker,smlog);
@@ -1257,9 +1948,6 @@ void maestro_l2d2_main_process_server (int fserver)
 	   if ( strcmp(m5sum,L2D2.m5sum) != 0 ) {
 	       get_time(Time,1);
 	       fprintf(smlog,"mserver::Error md5sum has changed File=%s new=%s old=%s ... at:%s killing server\n",L2D2.auth,m5sum,L2D2.m5sum,Time);
-               for ( j=0; j < MAX_PROCESS; j++ ) {
-	           ChildPids[j] == 0 ? : kill (ChildPids[j],9);
-               }
 	       kill(pid_eworker,9);
 	       l2d2server_remove(smlog);
 	   } else {
@@ -1270,7 +1958,6 @@ void maestro_l2d2_main_process_server (int fserver)
 
 	/* Wait on Un-caught childs  */
 	if ( (kpid=waitpid(-1,NULL,WNOHANG)) > 0 ) { 
-               ProcessCount = (ProcessCount < 0) ? 0 : ProcessCount-1;
 	       fprintf(smlog,"mserver::Waited on child with pid:%lu\n",(unsigned long ) kpid);
         }
 
@@ -1305,13 +1992,6 @@ void maestro_l2d2_main_process_server (int fserver)
 		 }
 	}
         
-	/* check to see if # of Transient worker alive file is consistent with ProcessCount variable 
-	   This glitch could happen sometime 
-	snprintf(filename,sizeof(filename),"%s/TRW_*",L2D2.tmpdir);
-	g_lres = glob(filename, GLOB_NOSORT , NULL, &g_LogFiles);
-        if (  g_lres == 0 && g_LogFiles.gl_pathc != ProcessCount ) {
-	}
-	*/
 
         
 
@@ -1339,6 +2019,7 @@ int main ( int argc , char * argv[] )
 
   char *home = NULL;
   char *ip=NULL;
+  struct rlimit rl;
 
   /* default values for L2D2.clean_times */
   L2D2.clean_times=L2D2_cleantimes;
@@ -1395,6 +2076,12 @@ int main ( int argc , char * argv[] )
   snprintf(buf,sizeof(buf),"%s/.suites/mconfig.xml",passwdEnt->pw_dir);
   ret = ParseXmlConfigFile(buf, &L2D2 );
 
+  /* a worker holds one descriptor per client, allow as many as the hard limit does */
+  if ( getrlimit(RLIMIT_NOFILE,&rl) == 0 && rl.rlim_cur < rl.rlim_max ) {
+      rl.rlim_cur = rl.rlim_max;
+      if ( setrlimit(RLIMIT_NOFILE,&rl) != 0 ) fprintf(stderr, "maestro_server(), could not raise the limit of open files\n");
+  }
+
   /* detach from current terminal */
   if ( fork() > 0 ) {
       usleep(250000);
@@ -1528,8 +2215,6 @@ static void l2d2server_shutdown(pid_t pid , FILE *fp)
     snprintf(buf,sizeof(buf),"%s/END_TASK_LOCK",L2D2.tmpdir);
     ret=unlink(buf);
 
-    /* TRW_* ??? */
-
     ret=rmdir(L2D2.tmpdir);
     ret == 0 ?  fprintf(fp,"tmp directory removed ... \n") : fprintf(fp,"tmp directory not removed ... \n") ;
 
@@ -21,7 +21,9 @@
 
 #ifndef L2D2SERVER_H
 #define L2D2SERVER_H
-
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
 
 /* structure that holds l2d2server 'global' data */
 typedef struct {
@@ -40,8 +42,6 @@ typedef struct {
    int      pollfreq;
    int      dependencyTimeOut;
    int      dzone;
-   int      maxNumOfProcess;
-   int      maxClientPerProcess;
    char     ip[32];
    char     host[128];
    char     logdir[256];
@@ -63,8 +63,15 @@ typedef struct {
    unsigned int port_min;
    unsigned int port_max;
    _clean_times clean_times;
+   int      eventLoop;
+   int      workerThreads;
+   int      nodelogIndex;   /* keep the binary index of the nodelogs written */
 } _l2d2server;
 
+/* event loop used by the workers to multiplex their clients */
+#define L2D2_LOOP_EPOLL  0
+#define L2D2_LOOP_SELECT 1
+
 struct _depParameters {
    char xpd_name[256];
    char xpd_node[256];
@@ -88,25 +95,61 @@ struct _depParameters {
    char xpd_key[33];
 } depParameters;
 
-typedef struct {
+typedef struct _l2d2client {
+      int  fd;
       char host[64];
       char xp[256];
+      char xpinode[64];
       char node[512];
       char signal[16];
       char Open_str[1024];
-      char Close_str[1024];
       unsigned int trans;
+      char *rbuf;     /* bytes received, event loop only */
+      size_t rlen;
+      size_t rsize;
+      char *jbuf;     /* requests being served, pool thread only */
+      size_t jsize;
+      size_t jlen;
+      size_t jpos;    /* next request to serve */
+      char *obuf;     /* replies being built, pool thread only */
+      size_t olen;
+      size_t osize;
+      int  oshut;
+      int  oframed;
+      unsigned int rid;   /* framed id of the request being served, 0 for the 1024 byte protocol */
+      int  rop;
+      pthread_mutex_t lock;   /* protects the fields below */
+      int  busy;      /* held by a pool thread or the log writer */
+      int  closing;   /* connection ended, close once not busy nor pending */
+      char *qbuf;     /* requests waiting for a pool thread */
+      size_t qlen;
+      size_t qsize;
+      char *wbuf;     /* replies not yet accepted by the socket */
+      size_t wpos;
+      size_t wlen;
+      size_t wsize;
+      int  shut;      /* shutdown write side once replies are flushed */
+      int  framed;    /* requests come as frames (see L2D2_FRAME_HEADER) */
+      int  pending;   /* framed nodelog lines still in the log writer */
+      struct _l2d2client *qnext;   /* work queue link */
 } _l2d2client;
 
-typedef enum _TypeOfWorker {
-      ETERNAL,
-      TRANSIENT
-} TypeOfWorker;
+/* connections of a worker, indexed by socket descriptor */
+typedef struct {
+      _l2d2client **conn;
+      int size;
+      int count;
+} _l2d2clientTable;
+
+/* per worker state shared by the event loops */
+typedef struct {
+      FILE *mlog;
+      char heartbeatFile[1024];
+      char tlog[10];
+      int  timeout;
+      int  end_server;
+} _l2d2worker;
 
-static void maestro_l2d2_main_process_server (int fserver);
-static void l2d2server_shutdown (pid_t pid , FILE *fp);
-static void l2d2server_remove (FILE *fp);
-static void l2d2SelectServlet( int sock , TypeOfWorker twrk );
 extern void logZone(int , int , FILE *fp , char * , ...);
 extern char *page_start_dep , *page_end_dep;
 extern char *page_start_blocked , *page_end_blocked;
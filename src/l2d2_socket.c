@@ -38,6 +38,8 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <sys/dir.h>
+#include <sys/select.h>
+#include <stdint.h>
 #include <sys/param.h>
 #include "l2d2_socket.h" 
 
@@ -471,8 +473,10 @@ int send_socket (int sock , char *buf , int size , unsigned int timeout)
 }
 /** 
  * Initiate a connection with maestro_server 
+ * When framed is not NULL, the framed protocol is asked for and *framed
+ * tells if the server accepted it; an older server ignores the request.
  */
-int do_Login( int sock , unsigned int pid , char *node, char *xpname , char *signl , char *username ,char **m5) {
+int do_Login( int sock , unsigned int pid , char *node, char *xpname , char *signl , char *username ,char **m5, int *framed) {
 
     char host[25];
     char bLogin[1024];
@@ -506,7 +510,8 @@ int do_Login( int sock , unsigned int pid , char *node, char *xpname , char *sig
                return (1);
     }
 
-    snprintf(bLogin,sizeof(bLogin),"I %u %ld %s %s %s %s %s %s", pid, (long) fileStat.st_ino, xpname, node , signl , host, username, *m5);
+    snprintf(bLogin,sizeof(bLogin),"I %u %ld %s %s %s %s %s %s%s%s", pid, (long) fileStat.st_ino, xpname, node , signl , host, username, *m5,
+             framed != NULL ? " " : "", framed != NULL ? L2D2_PROTO_FRAMED : "");
     if ( (bytes_sent=send_socket (sock , bLogin , sizeof(bLogin) , SOCK_TIMEOUT_CLIENT)) <= 0 ) { 
                 fprintf(stderr,"LOGIN FAILED (Timeout sending) with %s Maestro server from host=%s node=%s signal=%s\n",username, host, node, signl );
     	        return(1);
@@ -522,6 +527,12 @@ int do_Login( int sock , unsigned int pid , char *node, char *xpname , char *sig
     buffer[bytes_read > 0 ? bytes_read :0] = '\0';
 		
     if ( buffer[0] != '0'  ) fprintf(stderr,"LOGIN FAILED with %s Maestro server from host=%s node=%s signal=%s\n",username, host, node, signl ); 
+
+    /* "0F" : the server speaks the framed protocol from now on */
+    if ( framed != NULL ) {
+          *framed = ( buffer[0] == '0' && buffer[1] == 'F' );
+          set_framed(sock, *framed);
+    }
 					  
     return (buffer[0] == '0' ? 0 : 1);
 
@@ -549,3 +560,94 @@ int recv_full ( int sock , char * buff, int rsize )
 	return (received==rsize)  ? 0 : 1; 
 }
 
+/**
+ * send_full
+ * send all the buffer with timeout
+ *
+ */
+int send_full ( int sock , const char * buff, int size )
+{
+        int sent = 0, r;
+
+        while ( sent < size )
+        {
+           alarm(SOCK_TIMEOUT_CLIENT);
+           r = send( sock, buff + sent, size - sent, 0 );
+           alarm(0);
+           if ( r <= 0 ) {
+                   fprintf(stderr,"Client break in send_full\n");
+                   break;
+           }
+           sent += r;
+        }
+
+        return (sent==size)  ? 0 : 1; 
+}
+
+/* sockets using the framed protocol */
+static unsigned char FramedSockets[FD_SETSIZE];
+
+int is_framed ( int sock )
+{
+        return ( sock >= 0 && sock < FD_SETSIZE && FramedSockets[sock] );
+}
+
+void set_framed ( int sock, int on )
+{
+        if ( sock >= 0 && sock < FD_SETSIZE ) FramedSockets[sock] = on ? 1 : 0;
+}
+
+/**
+ * pack_frame / unpack_frame
+ * header of a frame of the framed protocol, see L2D2_FRAME_HEADER
+ */
+void pack_frame ( char *hdr, unsigned int len, unsigned int id, int op, int status )
+{
+        uint32_t l = htonl(len), i = htonl(id);
+        uint16_t o = htons((uint16_t) op), st = htons((uint16_t) status);
+
+        memcpy(hdr, &l, 4);
+        memcpy(hdr + 4, &i, 4);
+        memcpy(hdr + 8, &o, 2);
+        memcpy(hdr + 10, &st, 2);
+}
+
+void unpack_frame ( const char *hdr, unsigned int *len, unsigned int *id, int *op, int *status )
+{
+        uint32_t l, i;
+        uint16_t o, st;
+
+        memcpy(&l, hdr, 4);
+        memcpy(&i, hdr + 4, 4);
+        memcpy(&o, hdr + 8, 2);
+        memcpy(&st, hdr + 10, 2);
+        *len = ntohl(l);
+        *id = ntohl(i);
+        *op = ntohs(o);
+        *status = ntohs(st);
+}
+
+/**
+ * recv_frame
+ * receive one frame, the payload (if any) is malloc'ed and NUL terminated.
+ * a payload longer than L2D2_REPLY_MAX is refused before anything is allocated.
+ * returns 0 success, 1 failure
+ */
+int recv_frame ( int sock, unsigned int *id, int *op, int *status, char **payload, unsigned int *len )
+{
+        char hdr[L2D2_FRAME_HEADER];
+
+        *payload = NULL;
+        if ( recv_full(sock, hdr, sizeof(hdr)) != 0 ) return(1);
+        unpack_frame(hdr, len, id, op, status);
+
+        if ( *len > L2D2_REPLY_MAX ) return(1);
+        if ( (*payload = (char *) malloc((size_t) *len + 1)) == NULL ) return(1);
+        if ( *len > 0 && recv_full(sock, *payload, *len) != 0 ) {
+                free(*payload);
+                *payload = NULL;
+                return(1);
+        }
+        (*payload)[*len] = '\0';
+        return(0);
+}
@@ -44,6 +44,21 @@
 #define SOCK_BUF_SIZE 10
 #define SOCK_TIMEOUT_CLIENT 20
 
+/* framed protocol, asked for at login (see do_Login). Every request and
+   reply starts with a header: payload length (4), request id (4), opcode (2)
+   and status (2), in network byte order. Replies carry the id of their
+   request and may come back in any order */
+#define L2D2_FRAME_HEADER 12
+#define L2D2_FRAME_MAX    (8*1024)   /* max payload of a request */
+#define L2D2_REPLY_MAX    (64*1024*1024) /* max payload of a reply (file content) */
+#define L2D2_PROTO_FRAMED "F1"
+
+/* logs of a datestamp named by the targets of a framed log request 'M'
+   "targets user:$SEQ_EXP_HOME/logs/datestamp:line", the status of its reply
+   has the bits of the targets that could not be written (1: not served) */
+#define L2D2_LOG_NODELOG  2
+#define L2D2_LOG_TOPLOG   4
+
 /* prototype */
 int GetHostName (char *, size_t );
 char *get_Authorization( char * , char *, char **);
@@ -60,6 +75,12 @@ int send_socket (int , char * , int  , unsigned int );
 int read_socket (int , char * , int  , unsigned int ); 
 int recv_socket (int , char * , int  , unsigned int ); 
 int recv_full ( int sock , char * buff, int rsize );
+int send_full ( int sock , const char * buff, int size );
 void send_reply (int , int );  
-int do_Login( int  , unsigned int  , char *, char * , char * , char * ,char **);
+int do_Login( int  , unsigned int  , char *, char * , char * , char * ,char **, int *);
+void pack_frame ( char *hdr, unsigned int len, unsigned int id, int op, int status );
+void unpack_frame ( const char *hdr, unsigned int *len, unsigned int *id, int *op, int *status );
+int  recv_frame ( int sock, unsigned int *id, int *op, int *status, char **payload, unsigned int *len );
+int  is_framed ( int sock );
+void set_framed ( int sock, int on );
 #endif
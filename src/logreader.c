@@ -29,30 +29,283 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdint.h>
 #include "logreader.h"
 #include "SeqUtil.h"
 #include "SeqDatesUtil.h" 
+#include "SeqStatsStore.h"
+#include "SeqLogSpool.h"
+#include "SeqLogIndex.h"
 #define LR_SHOW_ALL 0
 #define LR_SHOW_STATUS 1
 #define LR_SHOW_STATS 2
 #define LR_SHOW_AVG 3
 #define LR_CALC_AVG 4
+#define LR_SHOW_LATEST 5
+#define LR_SHOW_HISTORY 6
 
 /* global */
-struct _ListListNodes MyListListNodes = { -1 , NULL , NULL };
-struct _NodeLoopList MyNodeLoopList = {"first",NULL,NULL};
+struct _ListListNodes MyListListNodes = { -1 , NULL , NULL, NULL };
+struct _NodeLoopList MyNodeLoopList = {"first",NULL,NULL,NULL};
 struct _StatsNode *rootStatsNode;
 
 /* read_type: see LR defines*/
 int read_type=LR_SHOW_ALL;
 struct stat pt;
 
+/* arena of the nodes and of their strings, blocks of LR_ARENA_BLOCK bytes */
+#define LR_ARENA_BLOCK (1024*1024)
+static char *arenaBlock = NULL;
+static size_t arenaUsed = 0, arenaSize = 0;
+
+/* node table by node path and loop extension, branch table by node path,
+ * both doubled when they have as many entries as buckets */
+static struct _ListNodes **nodeTable = NULL;
+static unsigned int nodeTableSize = 0, nodeCount = 0;
+static struct _NodeBranch **branchTable = NULL;
+static unsigned int branchTableSize = 0, branchCount = 0;
+
+/* length buckets by node length, and the last one of MyListListNodes */
+static struct _ListListNodes **lengthBuckets = NULL;
+static int lengthBucketsSize = 0;
+static struct _ListListNodes *lastLength = &MyListListNodes;
+
+/* incremental reading: the nodes read so far and how far the nodelog was
+ * read are kept in a checkpoint next to it (see logreader_setCheckpoint()),
+ * a later read restores them and reads only the lines appended since.  The
+ * nodelog is read again from the start when it is not the same file anymore
+ * (device, inode), when it is shorter than the checkpoint, when the bytes
+ * before the checkpoint offset changed or when it was rewritten to the same
+ * size (mtime).  The image is native endian and versioned, any other
+ * checkpoint is ignored. */
+#define LR_CKPT_MAGIC    "LRCKPT"
+#define LR_CKPT_VERSION  1
+#define LR_CKPT_TAIL     256    /* bytes before the offset that are checked */
+
+typedef struct _LrCkptHeader {
+   char     magic[8];
+   uint32_t version;
+   uint32_t order;           /* 0x01020304 written natively */
+   uint64_t dev;
+   uint64_t ino;
+   int64_t  offset;          /* end of the last line read */
+   int64_t  size;            /* size and mtime of the nodelog when read */
+   int64_t  mtime;
+   int64_t  mtime_nsec;
+   uint32_t tailHash;        /* of the LR_CKPT_TAIL bytes before offset */
+   uint32_t nnodes;
+} LrCkptHeader;
+
+/* followed by the strings Node, TNode, loop and waitmsg, each with its NUL */
+typedef struct _LrCkptNode {
+   uint32_t nodeLength;
+   uint32_t tnodeLength;
+   uint32_t loopLength;
+   uint32_t waitmsgLength;
+   char stime[18];
+   char btime[18];
+   char etime[18];
+   char itime[18];
+   char atime[18];
+   char wtime[18];
+   char dtime[18];
+   char LastAction;
+   char ignoreNode;
+} LrCkptNode;
+
+static char *checkpointPath = NULL;
+static char *historyNode = NULL;
+
+/* the nodelog and where its lines go, for the readers of SeqLogIndex */
+typedef struct {
+   int fd;
+   FILE *output;
+} LrLineOutput;
+
+static void *lr_alloc( size_t size ) {
+   char *ptr;
+   size = (size + 7) & ~(size_t) 7;
+   if ( arenaBlock == NULL || arenaUsed + size > arenaSize ) {
+      arenaSize = size > LR_ARENA_BLOCK ? size : LR_ARENA_BLOCK;
+      if ( (arenaBlock = malloc(arenaSize)) == NULL ) {
+         fprintf(stderr,"cannot malloc \n");
+         exit(1);
+      }
+      arenaUsed = 0;
+   }
+   ptr = arenaBlock + arenaUsed;
+   arenaUsed += size;
+   return ptr;
+}
+
+static char *lr_strdup( const char *str ) {
+   size_t len = strlen(str);
+   char *copy = lr_alloc(len + 1);
+   memcpy(copy, str, len + 1);
+   return copy;
+}
+
+static unsigned int lr_hashBytes( const char *ptr, size_t len ) {
+   unsigned int h = 2166136261u;
+   for ( ; len > 0; ptr++, len-- ) {
+      h ^= (unsigned char) *ptr;
+      h *= 16777619u;
+   }
+   return h;
+}
+
+static unsigned int lr_hash( const char *str ) {
+   unsigned int h = 2166136261u;
+   for ( ; *str != '\0'; str++ ) {
+      h ^= (unsigned char) *str;
+      h *= 16777619u;
+   }
+   return h;
+}
+
+static void lr_growNodeTable( void ) {
+   struct _ListNodes **table, *node, *next;
+   unsigned int size = nodeTableSize ? 2 * nodeTableSize : 1024, i, h;
+
+   if ( (table = calloc(size, sizeof(struct _ListNodes *))) == NULL ) {
+      fprintf(stderr,"cannot malloc \n");
+      exit(1);
+   }
+   for ( i = 0; i < nodeTableSize; i++ ) {
+      for ( node = nodeTable[i]; node != NULL; node = next ) {
+         next = node->hashNext;
+         h = lr_hash(node->PNode.Node) & (size - 1);
+         node->hashNext = table[h];
+         table[h] = node;
+      }
+   }
+   free(nodeTable);
+   nodeTable = table;
+   nodeTableSize = size;
+}
+
+static void lr_growBranchTable( void ) {
+   struct _NodeBranch **table, *branch, *next;
+   unsigned int size = branchTableSize ? 2 * branchTableSize : 1024, i, h;
+
+   if ( (table = calloc(size, sizeof(struct _NodeBranch *))) == NULL ) {
+      fprintf(stderr,"cannot malloc \n");
+      exit(1);
+   }
+   for ( i = 0; i < branchTableSize; i++ ) {
+      for ( branch = branchTable[i]; branch != NULL; branch = next ) {
+         next = branch->hashNext;
+         h = lr_hash(branch->TNode) & (size - 1);
+         branch->hashNext = table[h];
+         table[h] = branch;
+      }
+   }
+   free(branchTable);
+   branchTable = table;
+   branchTableSize = size;
+}
+
+static struct _ListNodes *lr_findNode( const char *composedNode ) {
+   struct _ListNodes *node;
+   if ( nodeTableSize == 0 ) return NULL;
+   for ( node = nodeTable[lr_hash(composedNode) & (nodeTableSize - 1)]; node != NULL; node = node->hashNext ) {
+      if ( strcmp(node->PNode.Node, composedNode) == 0 ) return node;
+   }
+   return NULL;
+}
+
+/* the branch of a node path, created if create is set */
+static struct _NodeBranch *lr_findBranch( const char *tnode, int create ) {
+   struct _NodeBranch *branch;
+   unsigned int h;
+
+   if ( branchTableSize != 0 ) {
+      for ( branch = branchTable[lr_hash(tnode) & (branchTableSize - 1)]; branch != NULL; branch = branch->hashNext ) {
+         if ( strcmp(branch->TNode, tnode) == 0 ) return branch;
+      }
+   }
+   if ( ! create ) return NULL;
+
+   if ( branchCount >= branchTableSize ) lr_growBranchTable();
+   branch = lr_alloc(sizeof(struct _NodeBranch));
+   branch->TNode = lr_strdup(tnode);
+   branch->members = NULL;
+   branch->loopList = NULL;
+   h = lr_hash(tnode) & (branchTableSize - 1);
+   branch->hashNext = branchTable[h];
+   branchTable[h] = branch;
+   branchCount++;
+   return branch;
+}
+
+/* the list of the nodes of a length, added at the end of MyListListNodes */
+static struct _ListListNodes *lr_lengthBucket( int len ) {
+   struct _ListListNodes *bucket;
+   int size;
+
+   if ( len >= lengthBucketsSize ) {
+      for ( size = lengthBucketsSize ? lengthBucketsSize : 256; size <= len; size *= 2 );
+      if ( (lengthBuckets = realloc(lengthBuckets, size * sizeof(struct _ListListNodes *))) == NULL ) {
+         fprintf(stderr,"cannot malloc \n");
+         exit(1);
+      }
+      memset(lengthBuckets + lengthBucketsSize, 0, (size - lengthBucketsSize) * sizeof(struct _ListListNodes *));
+      lengthBucketsSize = size;
+   }
+   if ( (bucket = lengthBuckets[len]) != NULL ) return bucket;
+
+   if ( MyListListNodes.Nodelength == -1 ) {
+      /* first time */
+      bucket = &MyListListNodes;
+   } else {
+      bucket = lr_alloc(sizeof(struct _ListListNodes));
+      bucket->next = NULL;
+      lastLength->next = bucket;
+      lastLength = bucket;
+   }
+   bucket->Nodelength = len;
+   bucket->Ptr_LNode = bucket->last = NULL;
+   lengthBuckets[len] = bucket;
+   return bucket;
+}
+
+/* a new node, at the end of the nodes of its length */
+static struct _ListNodes *lr_newNode( const char *composedNode, const char *node, const char *loop ) {
+   struct _ListNodes     *ptr_Ltrotte;
+   struct _ListListNodes *ptr_LLtrotte;
+   struct _NodeBranch    *branch;
+   unsigned int h;
+
+   ptr_LLtrotte = lr_lengthBucket(strlen(composedNode));
+   ptr_Ltrotte = lr_alloc(sizeof(struct _ListNodes));
+   memset(ptr_Ltrotte, 0, sizeof(struct _ListNodes));
+   ptr_Ltrotte->PNode.Node = lr_strdup(composedNode);
+   ptr_Ltrotte->PNode.TNode = lr_strdup(node);
+   ptr_Ltrotte->PNode.loop = lr_strdup(loop);
+   ptr_Ltrotte->PNode.waitmsg = "";
+   if ( ptr_LLtrotte->last == NULL ) {
+      ptr_LLtrotte->Ptr_LNode = ptr_Ltrotte;
+   } else {
+      ptr_LLtrotte->last->next = ptr_Ltrotte;
+   }
+   ptr_LLtrotte->last = ptr_Ltrotte;
+
+   if ( nodeCount >= nodeTableSize ) lr_growNodeTable();
+   h = lr_hash(composedNode) & (nodeTableSize - 1);
+   ptr_Ltrotte->hashNext = nodeTable[h];
+   nodeTable[h] = ptr_Ltrotte;
+   nodeCount++;
+
+   branch = lr_findBranch(node, 1);
+   ptr_Ltrotte->nextMember = branch->members;
+   branch->members = ptr_Ltrotte;
+   return ptr_Ltrotte;
+}
+
 void insert_node(char S, char *node, char *loop, char *stime, char *btime, char *etime , char *atime , char *itime, char *wtime, char *dtime, char * exectime, char * submitdelay, char * waitmsg ) {
 
-      char ComposedNode[512];
-      struct _ListNodes     *ptr_lhead,  *ptr_Ltrotte, *ptr_Lpreced;
-      struct _ListListNodes *ptr_LLtrotte, *ptr_LLpreced;
-      int found_len=0 , found_node=0, len=0; 
+      char ComposedNode[SEQ_MAXFIELD];
+      struct _ListNodes     *ptr_Ltrotte;
        
       /*if init state clean statuses of the branch*/
       if (S == 'i') {
@@ -63,239 +316,58 @@ void insert_node(char S, char *node, char *loop, char *stime, char *btime, char
 
       /* must easier to work like this */
       snprintf(ComposedNode,sizeof(ComposedNode),"%s%s",node,loop);
-      len =strlen(ComposedNode);
-      
-      if ( MyListListNodes.Nodelength == -1 ) {
-           /* first time */
-           MyListListNodes.Nodelength=len;
-	   if ( (ptr_lhead=(struct _ListNodes *) malloc(sizeof(struct _ListNodes))) != NULL ) {
-		strcpy(ptr_lhead->PNode.Node,ComposedNode);
-	        strcpy(ptr_lhead->PNode.TNode,node);
-		strcpy(ptr_lhead->PNode.loop,loop);
-		      
-		strcpy(ptr_lhead->PNode.atime,"");
-		strcpy(ptr_lhead->PNode.btime,"");
-		strcpy(ptr_lhead->PNode.etime,"");
-		strcpy(ptr_lhead->PNode.itime,"");
-		strcpy(ptr_lhead->PNode.stime,"");
-		strcpy(ptr_lhead->PNode.wtime,"");
-		strcpy(ptr_lhead->PNode.dtime,"");
-		      
-		switch ( S ) 
-		      {
-		        case 'a':
-	                         strcpy(ptr_lhead->PNode.atime,atime);
-				 break;
-		        case 'b':
-	                         strcpy(ptr_lhead->PNode.btime,btime);
-				 break;
-		        case 'e':
-	                         strcpy(ptr_lhead->PNode.etime,etime);
-				 break;
-		        case 'i':
-	                         strcpy(ptr_lhead->PNode.itime,itime);
-				 break;
-		        case 's':
-	                         strcpy(ptr_lhead->PNode.stime,stime);
-				 break;
-			case 'w':
-				strcpy(ptr_lhead->PNode.wtime,wtime);
-                  		strcpy(ptr_lhead->PNode.waitmsg,waitmsg); 
-				 break;
-			case 'd':
-			         strcpy(ptr_lhead->PNode.dtime,dtime);
-				 break;
-			case 'c':
-			         strcpy(ptr_lhead->PNode.dtime,dtime);
-				 break;
-		      }
-		      ptr_lhead->PNode.LastAction = S;
-		      ptr_lhead->PNode.ignoreNode = 0;
-		      ptr_lhead->next = NULL;
-		      MyListListNodes.Ptr_LNode = ptr_lhead;
-		      MyListListNodes.next = NULL;
-			 
-           } else {
-	       fprintf(stderr,"cannot malloc \n");
-	       exit(1);
-	   }
-           /* execTime submitDelay */
-      } else {
-       /* parcouriri la liste for (  ptr_trotte = ptrHEADLLN; ptr_trotte != NULL ; ptr_trotte = ptr_trotte->next)  {  ptr_preced = ptr_trotte; } */
-       /* go to end of list for ( ptr_LLtrotte = ptrHEADLLN; ptr_LLtrotte != NULL ; ptr_LLtrotte = ptr_LLtrotte->next)  { ptr_LLpreced = ptr_LLtrotte; } */
-       /* find node with the same length */
-       for ( ptr_LLtrotte = &MyListListNodes; ptr_LLtrotte != NULL ; ptr_LLtrotte = ptr_LLtrotte->next)
-       { 
-           if ( ptr_LLtrotte->Nodelength == len ) {
-	        found_len=1;
-                /* found same length, find  exact node if any  */
-                for ( ptr_Ltrotte = ptr_LLtrotte->Ptr_LNode; ptr_Ltrotte != NULL ; ptr_Ltrotte = ptr_Ltrotte->next) {
-                               if ( strcmp(ptr_Ltrotte->PNode.Node,ComposedNode) == 0 ) {
-                                    found_node=1;
-				    /* complete insertion of parameters */
-				    switch (S) 
-				    {
-		                       case 'a':
-	                                        strcpy(ptr_Ltrotte->PNode.atime,atime);
-				                break;
-		                       case 'b':
-	                                        strcpy(ptr_Ltrotte->PNode.btime,btime);
-				                break;
-		                       case 'e':
-	                                        strcpy(ptr_Ltrotte->PNode.etime,etime);
-				                break;
-		                       case 'i':
-	                                        strcpy(ptr_Ltrotte->PNode.itime,itime);
-				                break;
-		                       case 's':
-						/*resetting node values in submit state*/
-	                                        strcpy(ptr_Ltrotte->PNode.stime,stime);
-	                                        strcpy(ptr_Ltrotte->PNode.atime,"");
-	                                        strcpy(ptr_Ltrotte->PNode.btime,"");
-	                                        strcpy(ptr_Ltrotte->PNode.etime,"");
-	                                        strcpy(ptr_Ltrotte->PNode.itime,"");
-	                                        strcpy(ptr_Ltrotte->PNode.wtime,"");
-	                                        strcpy(ptr_Ltrotte->PNode.dtime,"");
-				                break;
-				       case 'w':
-						strcpy(ptr_Ltrotte->PNode.wtime,wtime);
-                  strcpy(ptr_Ltrotte->PNode.waitmsg,waitmsg); 
-   
-						break;
-				       case 'd':
-						strcpy(ptr_Ltrotte->PNode.dtime,dtime);
-						break;
-				       case 'c':
-						strcpy(ptr_Ltrotte->PNode.dtime,dtime);
-						break;
-				    }
-		                    ptr_Ltrotte->PNode.LastAction = S;
-				    ptr_Ltrotte->PNode.ignoreNode = 0;
-				    break;
-			       }
-			       ptr_Lpreced = ptr_Ltrotte;
-		}
-                if ( found_node == 0 && (ptr_Lpreced->next = (struct _ListNodes *) malloc(sizeof(struct _ListNodes ))) != NULL ) {
-                      
-	              strcpy(ptr_Lpreced->next->PNode.Node,ComposedNode);
-	              strcpy(ptr_Lpreced->next->PNode.TNode,node);
-	              strcpy(ptr_Lpreced->next->PNode.loop,loop);
-		      
-		      strcpy(ptr_Lpreced->next->PNode.atime,"");
-		      strcpy(ptr_Lpreced->next->PNode.btime,"");
-		      strcpy(ptr_Lpreced->next->PNode.etime,"");
-		      strcpy(ptr_Lpreced->next->PNode.itime,"");
-		      strcpy(ptr_Lpreced->next->PNode.stime,"");
-		      strcpy(ptr_Lpreced->next->PNode.wtime,"");
-		      strcpy(ptr_Lpreced->next->PNode.dtime,"");
-		      
-		      switch (S) 
-		      {
-		         case 'a':
-	                          strcpy(ptr_Lpreced->next->PNode.atime,atime);
-				  break;
-                         case 'b':
-	                          strcpy(ptr_Lpreced->next->PNode.btime,btime);
-				  break;
-                         case 'e':
-	                          strcpy(ptr_Lpreced->next->PNode.etime,etime);
-				  break;
-                         case 'i':
-	                          strcpy(ptr_Lpreced->next->PNode.itime,itime);
-				  break;
-                         case 's':
-	                          strcpy(ptr_Lpreced->next->PNode.stime,stime);
-				  break;
-			 case 'w':
-			          strcpy(ptr_Lpreced->next->PNode.wtime,wtime);
-                   strcpy(ptr_Lpreced->next->PNode.waitmsg,waitmsg); 
-			          break;
-			 case 'd':
-			          strcpy(ptr_Lpreced->next->PNode.dtime,dtime);
-			          break;
-			 case 'c':
-			          strcpy(ptr_Lpreced->next->PNode.dtime,dtime);
-			          break;
-		      }
-		      ptr_Lpreced->next->PNode.LastAction = S;
-		      ptr_Lpreced->next->PNode.ignoreNode = 0;
-		      ptr_Lpreced->next->next = NULL;
-                }
-	        break;	
-	   } 
-	   ptr_LLpreced = ptr_LLtrotte;
-       } 
-
-
-       if ( found_len == 0 && (ptr_LLpreced->next = (struct _ListListNodes *) malloc(sizeof(struct _ListListNodes ))) != NULL ) {
-	       ptr_LLpreced->next->Nodelength=len;
-	       ptr_LLpreced->next->next= NULL;
-	       
-	       if ( (ptr_Ltrotte = (struct _ListNodes *) malloc(sizeof(struct _ListNodes ))) != NULL ) {
-	               strcpy(ptr_Ltrotte->PNode.Node,ComposedNode);
-	               strcpy(ptr_Ltrotte->PNode.TNode,node);
-	               strcpy(ptr_Ltrotte->PNode.loop,loop);
-		       
-		       strcpy(ptr_Ltrotte->PNode.atime,"");
-		       strcpy(ptr_Ltrotte->PNode.btime,"");
-		       strcpy(ptr_Ltrotte->PNode.etime,"");
-		       strcpy(ptr_Ltrotte->PNode.itime,"");
-		       strcpy(ptr_Ltrotte->PNode.stime,"");
-		       strcpy(ptr_Ltrotte->PNode.wtime,"");
-		       strcpy(ptr_Ltrotte->PNode.dtime,"");
-		      
-		       switch (S) 
-		       {
-		         case 'a':
-	                          strcpy(ptr_Ltrotte->PNode.atime,atime);
-				  break;
-                         case 'b':
-	                          strcpy(ptr_Ltrotte->PNode.btime,btime);
-				  break;
-                         case 'e':
-	                          strcpy(ptr_Ltrotte->PNode.etime,etime);
-				  break;
-                         case 'i':
-	                          strcpy(ptr_Ltrotte->PNode.itime,itime);
-				  break;
-                         case 's':
-	                          strcpy(ptr_Ltrotte->PNode.stime,stime);
-				  break;
-			 case 'w':
-			          strcpy(ptr_Ltrotte->PNode.wtime,wtime);
-                   strcpy(ptr_Ltrotte->PNode.waitmsg,waitmsg); 
-
-			          break;
-			 case 'd':
-			          strcpy(ptr_Ltrotte->PNode.dtime,dtime);
-			          break;
-			 case 'c':
-			          strcpy(ptr_Ltrotte->PNode.dtime,dtime);
-			          break;
-		       }
-		       ptr_Ltrotte->PNode.LastAction = S;
-		       ptr_Ltrotte->PNode.ignoreNode = 0;
-	               ptr_Ltrotte->next=NULL;
-	               ptr_LLpreced->next->Ptr_LNode= ptr_Ltrotte;
-	       }
-	       
-             
-        }
-       
+
+      if ( (ptr_Ltrotte = lr_findNode(ComposedNode)) == NULL ) {
+           ptr_Ltrotte = lr_newNode(ComposedNode, node, loop);
+      }
+
+      /* complete insertion of parameters */
+      switch (S) 
+      {
+         case 'a':
+            strcpy(ptr_Ltrotte->PNode.atime,atime);
+            break;
+         case 'b':
+            strcpy(ptr_Ltrotte->PNode.btime,btime);
+            break;
+         case 'e':
+            strcpy(ptr_Ltrotte->PNode.etime,etime);
+            break;
+         case 's':
+            /*resetting node values in submit state*/
+            strcpy(ptr_Ltrotte->PNode.stime,stime);
+            strcpy(ptr_Ltrotte->PNode.atime,"");
+            strcpy(ptr_Ltrotte->PNode.btime,"");
+            strcpy(ptr_Ltrotte->PNode.etime,"");
+            strcpy(ptr_Ltrotte->PNode.itime,"");
+            strcpy(ptr_Ltrotte->PNode.wtime,"");
+            strcpy(ptr_Ltrotte->PNode.dtime,"");
+            break;
+         case 'w':
+            strcpy(ptr_Ltrotte->PNode.wtime,wtime);
+            ptr_Ltrotte->PNode.waitmsg = lr_strdup(waitmsg);
+            break;
+         case 'd':
+            strcpy(ptr_Ltrotte->PNode.dtime,dtime);
+            break;
+         case 'c':
+            strcpy(ptr_Ltrotte->PNode.dtime,dtime);
+            break;
       }
+      ptr_Ltrotte->PNode.LastAction = S;
+      ptr_Ltrotte->PNode.ignoreNode = 0;
 }
 
-void read_file (char *base)
+/* reads the lines from start up to end */
+static void lr_readLines (char *start, char *end)
 {
    char *ptr, *qq, *pp;
    char dstamp[18];
-   char node[128], signal[16],loop[32], waitmsg[256];
+   char node[SEQ_MAXFIELD], signal[16],loop[SEQ_MAXFIELD], waitmsg[SEQ_MAXFIELD];
    int size=0;
-   for ( ptr = base ; ptr < &base[pt.st_size]; ptr++) {
+   for ( ptr = start ; ptr < end; ptr++) {
       memset(dstamp,'\0',sizeof(dstamp));
-      memset(node,'\0',sizeof(node));
       memset(signal,'\0',sizeof(signal));
-      memset(loop,'\0',sizeof(loop));
 
       /* Time stamp */
       strncpy(dstamp,ptr+10,17);
@@ -303,17 +375,24 @@ void read_file (char *base)
       /* Node */
       qq = strchr(ptr+28,':');
       size=qq-(ptr+28);
+      if (size >= sizeof(node)) size = sizeof(node) - 1;
       strncpy(node,ptr+28, size);
+      node[size]='\0';
+      if (size < 9) node[9]='\0';   /* &node[9] below is "" without a node */
 
       /* signal */
       pp = strchr(qq+1,':');
       size=pp-(qq+9);
+      if (size >= sizeof(signal)) size = sizeof(signal) - 1;
       strncpy(signal,qq+9, size);
   
       /* loop */ 
       qq = strchr(pp+1,':');
       size=qq-(pp+1);
+      if (size >= sizeof(loop)) size = sizeof(loop) - 1;
       strncpy(loop,pp+1, size);
+      loop[size]='\0';
+      if (size < 8) loop[8]='\0';
       switch (signal[0]) {
          case 'a': /* [a]bort */
              insert_node('a', &node[9], &loop[8], "", "", "", dstamp, "", "", "", "", "",""); 
@@ -336,11 +415,12 @@ void read_file (char *base)
             break;
          case 'w': /* [w]ait */
             /* msg */ 
-            memset(waitmsg,'\0',sizeof(waitmsg));
             qq = strchr(qq+1,'=');  
             pp = strchr(ptr,'\n');
             size=pp-qq-1;
-            strncpy(waitmsg,qq+1, size);  
+            if (size >= sizeof(waitmsg)) size = sizeof(waitmsg) - 1;
+            strncpy(waitmsg,qq+1, size);
+            waitmsg[size]='\0';  
             insert_node('w', &node[9], &loop[8], "",  "", "", "", "", dstamp, "", "", "",waitmsg); 
             break;
          case 'd': /* [d]iscret */
@@ -359,19 +439,73 @@ void read_file (char *base)
 
 }
 
+void read_file (char *base)
+{
+   lr_readLines(base, base + pt.st_size);
+}
+
+/* adds the loop member lext of a node to the end of its loop list */
+static void lr_addLoopExt( struct _NodeLoopList *loopList, struct _Node_prm *prm, char *lext,
+                           const char *exectime, const char *submitdelay, const char *deltafromstart ) {
+   struct _LoopExt *ext = lr_alloc(sizeof(struct _LoopExt));
+
+   ext->Lext = lext;
+   strcpy(ext->lstime,prm->stime);
+   strcpy(ext->lbtime,prm->btime);
+   strcpy(ext->letime,prm->etime);
+   strcpy(ext->litime,prm->itime);
+   strcpy(ext->latime,prm->atime);
+   strcpy(ext->lwtime,prm->wtime);
+   strcpy(ext->ldtime,prm->dtime);
+   ext->waitmsg = prm->waitmsg;
+   strcpy(ext->exectime,exectime);
+   strcpy(ext->submitdelay,submitdelay);
+   strcpy(ext->deltafromstart,deltafromstart);
+   ext->LastAction = prm->LastAction;
+   ext->ignoreNode = prm->ignoreNode;
+   ext->next = NULL;
+   if ( loopList->last == NULL ) {
+      loopList->ptr_LoopExt = ext;
+   } else {
+      loopList->last->next = ext;
+   }
+   loopList->last = ext;
+}
+
+/* the stats of the members of a node, appended in place: the output of a
+ * loop of many members is long */
+static char *statsBuffer = NULL;
+static size_t statsLength = 0, statsSize = 0;
+
+static void lr_statsAppend( const char *str ) {
+   size_t len = strlen(str);
+   if ( statsLength + len + 1 > statsSize ) {
+      for ( statsSize = statsSize ? statsSize : 4096; statsLength + len + 1 > statsSize; statsSize *= 2 );
+      if ( (statsBuffer = realloc(statsBuffer, statsSize)) == NULL ) {
+         fprintf(stderr,"cannot malloc \n");
+         exit(1);
+      }
+   }
+   memcpy(statsBuffer + statsLength, str, len + 1);
+   statsLength += len;
+}
+
 void print_LListe ( struct _ListListNodes MyListListNodes, FILE *outputFile) 
 {
       struct _ListNodes      *ptr_Ltrotte;
-      struct _ListListNodes  *ptr_LLtrotte, *ptr_shortest_LLNode;
-      struct _NodeLoopList  *ptr_NLHtrotte, *ptr_NLHpreced;
-      struct _LoopExt       *ptr_LEXHead,   *ptr_LXHtrotte, *ptr_LXHpreced ;
+      struct _ListListNodes  *ptr_LLtrotte, *ptr_shortest_LLNode = &MyListListNodes;
+      struct _NodeLoopList  *ptr_NLHtrotte, *lastLoopList = &MyNodeLoopList;
+      struct _LoopExt       *ptr_LXHtrotte;
+      struct _NodeBranch    *branch;
       struct tm ti;
       time_t Sepoch,Bepoch,Eepoch,TopNodeSubmitTime;
       time_t ExeTime, SubDelay, RelativeEnd;
-      int n, found_loopNode, shortestLength=256, submit_time_found=0, begin_time_found=0, end_time_found=0 ;
+      int n, shortestLength=256, submit_time_found=0, begin_time_found=0, end_time_found=0 ;
       static char sbuffer[10],ebuffer[10], rbuffer[10];
-      char *stats_output = NULL, *tmp_output, *tmp_statstring =NULL;
-      char output_buffer[256];
+
+      /* mktime() finds out the daylight saving time, the result does not depend on what was on the stack */
+      memset(&ti, 0, sizeof(ti));
+      ti.tm_isdst = -1;
 
       /* Traverse the list to find the top node (shortest nodelength) to get its submit time to do the relative end time calculation */ 
       for ( ptr_LLtrotte = &MyListListNodes; ptr_LLtrotte != NULL ; ptr_LLtrotte = ptr_LLtrotte->next) {
@@ -392,7 +526,6 @@ void print_LListe ( struct _ListListNodes MyListListNodes, FILE *outputFile)
 	   /* printf all node having this length */
            for ( ptr_Ltrotte = ptr_LLtrotte->Ptr_LNode ; ptr_Ltrotte != NULL ; ptr_Ltrotte = ptr_Ltrotte->next)
 	         {
-	       found_loopNode = 0;
 
 	       /* timing */
 	       n=sscanf(ptr_Ltrotte->PNode.stime,"%4d%2d%2d.%2d:%2d:%2d", &ti.tm_year, &ti.tm_mon, &ti.tm_mday, &ti.tm_hour, &ti.tm_min, &ti.tm_sec);
@@ -445,103 +578,40 @@ void print_LListe ( struct _ListListNodes MyListListNodes, FILE *outputFile)
           } 
 	       /* end timing */
    
-	       /*if ( strcmp(ptr_Ltrotte->PNode.loop,"") != 0 ) {*/
-			/* fprintf(stdout,"node:%s is a loop=%s node \n",ptr_Ltrotte->PNode.Node,ptr_Ltrotte->PNode.loop); */
-			if ( strcmp(MyNodeLoopList.Node,"first") == 0 ) {
-				 strcpy(MyNodeLoopList.Node,ptr_Ltrotte->PNode.TNode);
-				 if ( (ptr_LEXHead=(struct _LoopExt *) malloc(sizeof(struct _LoopExt))) != NULL ) {
-					  MyNodeLoopList.ptr_LoopExt = ptr_LEXHead;
-					  if ( strcmp(ptr_Ltrotte->PNode.loop,"") != 0 ){
-					     strcpy(ptr_LEXHead->Lext,ptr_Ltrotte->PNode.loop);
-					  } else {
-					     strcpy(ptr_LEXHead->Lext,"null");
-					  }
-					  strcpy(ptr_LEXHead->lstime,ptr_Ltrotte->PNode.stime);
-					  strcpy(ptr_LEXHead->lbtime,ptr_Ltrotte->PNode.btime);
-					  strcpy(ptr_LEXHead->letime,ptr_Ltrotte->PNode.etime);
-					  strcpy(ptr_LEXHead->litime,ptr_Ltrotte->PNode.itime);
-					  strcpy(ptr_LEXHead->latime,ptr_Ltrotte->PNode.atime);
-					  strcpy(ptr_LEXHead->lwtime,ptr_Ltrotte->PNode.wtime);
-					  strcpy(ptr_LEXHead->waitmsg,ptr_Ltrotte->PNode.waitmsg);
-					  strcpy(ptr_LEXHead->exectime, ebuffer);
-					  strcpy(ptr_LEXHead->submitdelay, sbuffer);
-					  strcpy(ptr_LEXHead->deltafromstart, rbuffer);
-					  ptr_LEXHead->LastAction=ptr_Ltrotte->PNode.LastAction;
-					  ptr_LEXHead->ignoreNode=ptr_Ltrotte->PNode.ignoreNode;
-					  ptr_LEXHead->next = NULL;
-				 }
-			} else {
-			   for ( ptr_NLHtrotte = &MyNodeLoopList; ptr_NLHtrotte != NULL ; ptr_NLHtrotte = ptr_NLHtrotte->next) {
-				 if ( strcmp(ptr_NLHtrotte->Node,ptr_Ltrotte->PNode.TNode) == 0 ) {
-				    if(strcmp(ptr_Ltrotte->PNode.loop,"") != 0){
-				       for ( ptr_LXHtrotte = ptr_NLHtrotte->ptr_LoopExt ; ptr_LXHtrotte != NULL ; ptr_LXHtrotte = ptr_LXHtrotte->next) {
-					  if( strcmp(ptr_LXHtrotte->Lext, "null") == 0){
-					     strcpy(ptr_LXHtrotte->Lext, "all");
-					  }
-				       }
-				    }
-				    /* node found , go to end and add loop member*/
-				    for ( ptr_LXHtrotte = ptr_NLHtrotte->ptr_LoopExt ; ptr_LXHtrotte != NULL ; ptr_LXHtrotte = ptr_LXHtrotte->next) { ptr_LXHpreced = ptr_LXHtrotte; }
-				    if ( (ptr_LXHpreced->next = (struct _LoopExt *) malloc(sizeof(struct _LoopExt ))) != NULL ) {
-				       if ( strcmp(ptr_Ltrotte->PNode.loop,"") != 0 ){
-					  strcpy(ptr_LXHpreced->next->Lext,ptr_Ltrotte->PNode.loop);
-				       } else {
-					  strcpy(ptr_LXHpreced->next->Lext,"all");
-				       }
-				       strcpy(ptr_LXHpreced->next->lstime,ptr_Ltrotte->PNode.stime);
-				       strcpy(ptr_LXHpreced->next->lbtime,ptr_Ltrotte->PNode.btime);
-				       strcpy(ptr_LXHpreced->next->letime,ptr_Ltrotte->PNode.etime);
-				       strcpy(ptr_LXHpreced->next->litime,ptr_Ltrotte->PNode.itime);
-				       strcpy(ptr_LXHpreced->next->latime,ptr_Ltrotte->PNode.atime);
-				       strcpy(ptr_LXHpreced->next->lwtime,ptr_Ltrotte->PNode.wtime);
-				       strcpy(ptr_LXHpreced->next->ldtime,ptr_Ltrotte->PNode.dtime);
-				       strcpy(ptr_LXHpreced->next->waitmsg,ptr_Ltrotte->PNode.waitmsg);
-				       strcpy(ptr_LXHpreced->next->exectime,ebuffer);
-				       strcpy(ptr_LXHpreced->next->submitdelay,sbuffer);
-				       strcpy(ptr_LXHpreced->next->deltafromstart,rbuffer);
-				       ptr_LXHpreced->next->LastAction=ptr_Ltrotte->PNode.LastAction;
-				       ptr_LXHpreced->next->ignoreNode=ptr_Ltrotte->PNode.ignoreNode;
-				       ptr_LXHpreced->next->next = NULL;
-				    }
-				    found_loopNode = 1;
-				 }
-				 ptr_NLHpreced = ptr_NLHtrotte;
-			   }
-			   /* loop node not there create */
-			   if ( found_loopNode == 0 && (ptr_NLHpreced->next = (struct _NodeLoopList *) malloc(sizeof(struct _NodeLoopList ))) != NULL ) {
-				    strcpy(ptr_NLHpreced->next->Node,ptr_Ltrotte->PNode.TNode);
-				    ptr_NLHpreced->next->next = NULL;
-				    if ( (ptr_LEXHead = (struct _LoopExt *) malloc(sizeof(struct _LoopExt ))) != NULL ) {
-					     ptr_NLHpreced->next->ptr_LoopExt = ptr_LEXHead;
-					     if ( strcmp(ptr_Ltrotte->PNode.loop,"") != 0 ){
-						strcpy(ptr_LEXHead->Lext,ptr_Ltrotte->PNode.loop);
-					     } else {
-						strcpy(ptr_LEXHead->Lext,"null");
-					     }
-					     strcpy(ptr_LEXHead->lstime,ptr_Ltrotte->PNode.stime);
-					     strcpy(ptr_LEXHead->lbtime,ptr_Ltrotte->PNode.btime);
-					     strcpy(ptr_LEXHead->letime,ptr_Ltrotte->PNode.etime);
-					     strcpy(ptr_LEXHead->litime,ptr_Ltrotte->PNode.itime);
-					     strcpy(ptr_LEXHead->latime,ptr_Ltrotte->PNode.atime);
-					     strcpy(ptr_LEXHead->lwtime,ptr_Ltrotte->PNode.wtime);
-					     strcpy(ptr_LEXHead->ldtime,ptr_Ltrotte->PNode.dtime);
-					     strcpy(ptr_LEXHead->waitmsg,ptr_Ltrotte->PNode.waitmsg);
-					     strcpy(ptr_LEXHead->exectime,ebuffer);
-					     strcpy(ptr_LEXHead->submitdelay,sbuffer);
-					     strcpy(ptr_LEXHead->deltafromstart,rbuffer);
-					     ptr_LEXHead->LastAction=ptr_Ltrotte->PNode.LastAction;
-					     ptr_LEXHead->ignoreNode=ptr_Ltrotte->PNode.ignoreNode;
-					     ptr_LEXHead->next = NULL;
-				    }
-			   }
-			}
+	       /* the loop members of a node path go together, in the order of the nodes */
+	       if ( strcmp(MyNodeLoopList.Node,"first") == 0 ) {
+	          MyNodeLoopList.Node = ptr_Ltrotte->PNode.TNode;
+	          lr_findBranch(ptr_Ltrotte->PNode.TNode, 1)->loopList = &MyNodeLoopList;
+	          lastLoopList = &MyNodeLoopList;
+	          lr_addLoopExt(&MyNodeLoopList, &ptr_Ltrotte->PNode, strcmp(ptr_Ltrotte->PNode.loop,"") != 0 ? ptr_Ltrotte->PNode.loop : "null",
+	                        ebuffer, sbuffer, rbuffer);
+	       } else if ( (ptr_NLHtrotte = (branch = lr_findBranch(ptr_Ltrotte->PNode.TNode, 1))->loopList) != NULL ) {
+	          /* node found , go to end and add loop member*/
+	          if ( strcmp(ptr_Ltrotte->PNode.loop,"") != 0 && strcmp(ptr_NLHtrotte->ptr_LoopExt->Lext, "null") == 0 ) {
+	             ptr_NLHtrotte->ptr_LoopExt->Lext = "all";
+	          }
+	          lr_addLoopExt(ptr_NLHtrotte, &ptr_Ltrotte->PNode, strcmp(ptr_Ltrotte->PNode.loop,"") != 0 ? ptr_Ltrotte->PNode.loop : "all",
+	                        ebuffer, sbuffer, rbuffer);
+	       } else {
+	          /* loop node not there create */
+	          ptr_NLHtrotte = lr_alloc(sizeof(struct _NodeLoopList));
+	          ptr_NLHtrotte->Node = ptr_Ltrotte->PNode.TNode;
+	          ptr_NLHtrotte->ptr_LoopExt = ptr_NLHtrotte->last = NULL;
+	          ptr_NLHtrotte->next = NULL;
+	          lastLoopList->next = ptr_NLHtrotte;
+	          lastLoopList = ptr_NLHtrotte;
+	          branch->loopList = ptr_NLHtrotte;
+	          lr_addLoopExt(ptr_NLHtrotte, &ptr_Ltrotte->PNode, strcmp(ptr_Ltrotte->PNode.loop,"") != 0 ? ptr_Ltrotte->PNode.loop : "null",
+	                        ebuffer, sbuffer, rbuffer);
+	       }
 	    
 	   }
       }
 
       /* print loop task */
       for ( ptr_NLHtrotte = &MyNodeLoopList; ptr_NLHtrotte != NULL ; ptr_NLHtrotte = ptr_NLHtrotte->next) {
-	       stats_output = "\\stats {";
+	       statsLength = 0;
+	       lr_statsAppend("\\stats {");
 	       fprintf(stdout, "\\/%s", ptr_NLHtrotte->Node);
 
 	       if(read_type == LR_SHOW_ALL || read_type == LR_SHOW_STATUS ) {
@@ -553,38 +623,34 @@ void print_LListe ( struct _ListListNodes MyListListNodes, FILE *outputFile)
 			         ptr_LXHtrotte->Lext, ptr_LXHtrotte->exectime, ptr_LXHtrotte->submitdelay, ptr_LXHtrotte->lstime,
 			         ptr_LXHtrotte->lbtime,  ptr_LXHtrotte->letime, ptr_LXHtrotte->deltafromstart);
                */
-               sprintf(output_buffer, "%s {",ptr_LXHtrotte->Lext);  
-               tmp_statstring=strdup(output_buffer); 
-               if (  ptr_LXHtrotte->exectime && strlen( ptr_LXHtrotte->exectime ) > 0 ) { 
-                  tmp_statstring = sconcat (tmp_statstring," exectime ");  
-                  tmp_statstring = sconcat (tmp_statstring,ptr_LXHtrotte->exectime);  
+               lr_statsAppend(ptr_LXHtrotte->Lext);
+               lr_statsAppend(" {");
+               if ( strlen( ptr_LXHtrotte->exectime ) > 0 ) { 
+                  lr_statsAppend(" exectime ");
+                  lr_statsAppend(ptr_LXHtrotte->exectime);
                } 
-               if (  ptr_LXHtrotte->submitdelay && strlen( ptr_LXHtrotte->submitdelay ) > 0 ) { 
-                  tmp_statstring = sconcat (tmp_statstring," submitdelay ");  
-                  tmp_statstring = sconcat (tmp_statstring,ptr_LXHtrotte->submitdelay);  
+               if ( strlen( ptr_LXHtrotte->submitdelay ) > 0 ) { 
+                  lr_statsAppend(" submitdelay ");
+                  lr_statsAppend(ptr_LXHtrotte->submitdelay);
                } 
-               if (  ptr_LXHtrotte->lstime && strlen( ptr_LXHtrotte->lstime ) > 0 ) { 
-                  tmp_statstring = sconcat (tmp_statstring," submit ");  
-                  tmp_statstring = sconcat (tmp_statstring,ptr_LXHtrotte->lstime);  
+               if ( strlen( ptr_LXHtrotte->lstime ) > 0 ) { 
+                  lr_statsAppend(" submit ");
+                  lr_statsAppend(ptr_LXHtrotte->lstime);
                } 
-               if (  ptr_LXHtrotte->lbtime && strlen( ptr_LXHtrotte->lbtime ) > 0 ) { 
-                  tmp_statstring = sconcat (tmp_statstring," begin ");  
-                  tmp_statstring = sconcat (tmp_statstring,ptr_LXHtrotte->lbtime);  
+               if ( strlen( ptr_LXHtrotte->lbtime ) > 0 ) { 
+                  lr_statsAppend(" begin ");
+                  lr_statsAppend(ptr_LXHtrotte->lbtime);
                } 
-               if (  ptr_LXHtrotte->letime && strlen( ptr_LXHtrotte->letime ) > 0 ) { 
-                  tmp_statstring = sconcat (tmp_statstring," end ");  
-                  tmp_statstring = sconcat (tmp_statstring,ptr_LXHtrotte->letime);  
+               if ( strlen( ptr_LXHtrotte->letime ) > 0 ) { 
+                  lr_statsAppend(" end ");
+                  lr_statsAppend(ptr_LXHtrotte->letime);
                } 
-               if (  ptr_LXHtrotte->deltafromstart && strlen( ptr_LXHtrotte->deltafromstart ) > 0 ) { 
-                  tmp_statstring = sconcat (tmp_statstring," deltafromstart ");  
-                  tmp_statstring = sconcat (tmp_statstring,ptr_LXHtrotte->deltafromstart);  
+               if ( strlen( ptr_LXHtrotte->deltafromstart ) > 0 ) { 
+                  lr_statsAppend(" deltafromstart ");
+                  lr_statsAppend(ptr_LXHtrotte->deltafromstart);
                } 
+               lr_statsAppend(" } ");
 
-               tmp_statstring = sconcat (tmp_statstring," } ");  
-
-		         tmp_output=strdup(stats_output);
-		         stats_output=sconcat(tmp_output, tmp_statstring);
-                 free(tmp_statstring);
 		         if (read_type == LR_SHOW_ALL || read_type == LR_SHOW_STATUS ) {
 			         switch(ptr_LXHtrotte->LastAction){
 			            case 'a':
@@ -623,14 +689,12 @@ void print_LListe ( struct _ListListNodes MyListListNodes, FILE *outputFile)
 			             ptr_LXHtrotte->exectime, ptr_LXHtrotte->submitdelay, ptr_LXHtrotte->deltafromstart );
 		      }
 	       }
-	       sprintf(output_buffer, "}");
-	       tmp_output=strdup(stats_output);
-	       stats_output=sconcat(tmp_output, output_buffer);
+	       lr_statsAppend("}");
 	       if (read_type == LR_SHOW_ALL || read_type == LR_SHOW_STATUS) {
 	          fprintf(stdout, "}");
 	       }
 	       if ((read_type == LR_SHOW_ALL || read_type == LR_SHOW_STATS)) {
-		       fprintf(stdout, "%s", stats_output);  
+		       fputs(statsBuffer, stdout);
 	       }
 
       }
@@ -782,45 +846,82 @@ char *getNodeAverageLine(char *node, char *member){
    
 }
 
-/*used to generate averages from stats*/
+/*used to generate averages from stats: the stats of the window come from the
+ stats store (see SeqStatsStore.h), each time is averaged over its column*/
 void computeAverage(char *exp, char *datestamp, int stats_days, FILE * output_file){
-   char *stats_file_path = NULL;
-   char *full_path = NULL;
-   char char_datestamp[15];
-   char prev[15];
-   int i, count=0;
-   
-   FILE *f=NULL;
-   prev[14] = '\0';
-   char_datestamp[14] = '\0';
-   snprintf(char_datestamp, 15, "%s", datestamp);
+   SeqStatsWindow *window;
+   SeqStatsDay *day;
+   int *slots, *order, *counts, *fill, *samples[SEQ_STATS_NTIMES];
+   char *averages[SEQ_STATS_NTIMES];
+   unsigned int r;
+   int d, n, t, slot, nslots=0, truncate_amount;
    
    SeqUtil_TRACE(TL_FULL_TRACE,"logreader computing averages on exp: %s for datestamp: %s since last %d days\n", exp, datestamp, stats_days);
    
-   for (i=0; i < stats_days; i++){
-      stats_file_path = sconcat("/stats/", char_datestamp);
-      full_path = sconcat(exp, stats_file_path);
-      
-      SeqUtil_TRACE(TL_FULL_TRACE,"logreader collecting stats for datestamp %s in file %s\n", char_datestamp, full_path);
-      
-      f = fopen(full_path, "r");
-      if (f != NULL) {
-         if(getStats(f) != 0){
-            SeqUtil_TRACE(TL_ERROR,"logreader error while parsing the following stats file:\n");
-            SeqUtil_TRACE(TL_ERROR,"%s\n", full_path);
-         }
-         ++count;
-         fclose(f);
-      }
-      
-      strcpy(prev, char_datestamp);
-      snprintf(char_datestamp, 15, "%s", SeqDatesUtil_getPrintableDate(prev,-1,0,0,0));
+   if ( (window = SeqStatsStore_window(exp, datestamp, stats_days)) == NULL ) {
+      raiseError("logreader: cannot malloc in computeAverage\n");
    }
-   if (count == 0) {
+   if (window->ndays == 0) {
       fprintf(stderr,"Unable to calculate average; missing required statistics files under %s/stats\n", exp);
       exit(1); 
    }
-   processStats(exp, datestamp, output_file);
+
+   /* the nodes in the order first seen from the most recent day, with their number of days */
+   slots = malloc((window->nnodes + 1) * sizeof(int));
+   order = malloc((window->nnodes + 1) * sizeof(int));
+   counts = calloc(window->nnodes + 1, sizeof(int));
+   fill = malloc((window->nnodes + 1) * sizeof(int));
+   if ( slots == NULL || order == NULL || counts == NULL || fill == NULL ) {
+      raiseError("logreader: cannot malloc in computeAverage\n");
+   }
+   memset(slots, -1, (window->nnodes + 1) * sizeof(int));
+   for ( d = 0; d < window->ndays; d++ ) {
+      day = &window->days[d];
+      for ( r = 0; r < day->nrows; r++ ) {
+         if ( (slot = slots[day->node[r]]) < 0 ) {
+            slot = slots[day->node[r]] = nslots;
+            order[nslots++] = day->node[r];
+         }
+         if ( ++counts[slot] > 30 ) {
+            raiseError("ERROR: Maximum average count is 30. Please reduce the amount of days you wish to calculate the mean. \n"); 
+         }
+      }
+   }
+
+   /* up to 30 samples of a node per time, a column at a time */
+   for ( t = 0; t < SEQ_STATS_NTIMES; t++ ) {
+      if ( (samples[t] = malloc((nslots + 1) * 30 * sizeof(int))) == NULL ) {
+         raiseError("logreader: cannot malloc in computeAverage\n");
+      }
+      memset(fill, 0, (window->nnodes + 1) * sizeof(int));
+      for ( d = 0; d < window->ndays; d++ ) {
+         day = &window->days[d];
+         for ( r = 0; r < day->nrows; r++ ) {
+            slot = slots[day->node[r]];
+            samples[t][slot * 30 + fill[slot]++] = day->times[t][r];
+         }
+      }
+   }
+
+   for ( slot = 0; slot < nslots; slot++ ) {
+      /* truncating at least 1 extreme on each side per 10 elements, starting at 5 */
+      n = counts[slot];
+      truncate_amount = n < 4 ? 0 : (n + 9) / 10;
+      for ( t = 0; t < SEQ_STATS_NTIMES; t++ ) {
+         averages[t] = secondsToChar(SeqUtil_basicTruncatedMean(&samples[t][slot * 30], n, truncate_amount));
+      }
+      SeqUtil_printOrWrite(output_file, "SEQNODE=%s:MEMBER=%s:SUBMIT=%s:BEGIN=%s:END=%s:EXECTIME=%s:SUBMITDELAY=%s:DELTAFROMSTART=%s\n",
+             window->node[order[slot]], window->member[order[slot]], averages[SEQ_STATS_SUBMIT], averages[SEQ_STATS_BEGIN],
+             averages[SEQ_STATS_END], averages[SEQ_STATS_EXECTIME], averages[SEQ_STATS_SUBMITDELAY], averages[SEQ_STATS_DELTAFROMSTART]);
+      for ( t = 0; t < SEQ_STATS_NTIMES; t++ ) free(averages[t]);
+   }
+
+   for ( t = 0; t < SEQ_STATS_NTIMES; t++ ) free(samples[t]);
+   free(slots);
+   free(order);
+   free(counts);
+   free(fill);
+   SeqStatsStore_free(window);
 }
 
 /*translate stats file in linked list*/
@@ -1105,21 +1206,15 @@ char *sconcat(char *ptr1,char *ptr2){
 /*in case of init, when parsing log file*/
 void reset_branch (char *node, char *ext) {
    struct _ListNodes      *ptr_Ltrotte;
-   struct _ListListNodes  *ptr_LLtrotte;
-   struct _ListNodes      *tmp_prev_list;
+   struct _NodeBranch     *branch;
+   size_t extLength = strlen(ext);
    
-   
-   for ( ptr_LLtrotte = &MyListListNodes; ptr_LLtrotte != NULL ; ptr_LLtrotte = ptr_LLtrotte->next) {
-      ptr_Ltrotte = ptr_LLtrotte->Ptr_LNode;
-      while (ptr_Ltrotte != NULL){
-         tmp_prev_list=ptr_Ltrotte;
-         ptr_Ltrotte = ptr_Ltrotte->next;
-         
-         if (strcmp(node, tmp_prev_list->PNode.TNode) == 0 && strncmp(ext, tmp_prev_list->PNode.loop, strlen(ext)) == 0) {
-            /*delete_node(tmp_prev_list, ptr_LLtrotte);*/
-            tmp_prev_list->PNode.ignoreNode=1;
-            SeqUtil_TRACE(TL_FULL_TRACE,"logreader reset branch done on node: %s ext: %s \n",node,ext);
-         }
+   if ( (branch = lr_findBranch(node, 0)) == NULL ) return;
+   for ( ptr_Ltrotte = branch->members; ptr_Ltrotte != NULL ; ptr_Ltrotte = ptr_Ltrotte->nextMember ) {
+      if (strncmp(ext, ptr_Ltrotte->PNode.loop, extLength) == 0) {
+         /*delete_node(ptr_Ltrotte, ...);*/
+         ptr_Ltrotte->PNode.ignoreNode=1;
+         SeqUtil_TRACE(TL_FULL_TRACE,"logreader reset branch done on node: %s ext: %s \n",node,ext);
       }
    }
 }
@@ -1147,12 +1242,188 @@ void delete_node(struct _ListNodes *node, struct _ListListNodes *list) {
       }
    }
    
-   if (todelete != NULL) {
-      free(todelete);
-      todelete=NULL;
+   /* the nodes are freed with the arena */
+}
+
+
+/* restores the nodes of the checkpoint of the nodelog fd, returns the offset
+ * where the reading resumes, 0 to read the nodelog from the start */
+static off_t lr_restoreCheckpoint( const char *path, int fd, const struct stat *st ) {
+   LrCkptHeader hdr;
+   LrCkptNode rec;
+   struct _ListNodes *ptr_Ltrotte;
+   char tail[LR_CKPT_TAIL], *buf = NULL, *ptr, *end, *strings;
+   size_t tailLength, total;
+   struct stat cst;
+   ssize_t n;
+   off_t offset = 0, done;
+   uint32_t i;
+   int ckfd, pass;
+
+   if ( (ckfd = open(path, O_RDONLY)) < 0 ) {
+      SeqUtil_TRACE(TL_FULL_TRACE,"logreader: no checkpoint %s\n", path);
+      return 0;
+   }
+   if ( fstat(ckfd, &cst) != 0 || cst.st_size < sizeof(hdr) || (buf = malloc(cst.st_size)) == NULL ) goto end;
+   for ( done = 0; done < cst.st_size; done += n ) {
+      if ( (n = read(ckfd, buf + done, cst.st_size - done)) <= 0 ) goto end;
+   }
+   memcpy(&hdr, buf, sizeof(hdr));
+   if ( strncmp(hdr.magic, LR_CKPT_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != LR_CKPT_VERSION || hdr.order != 0x01020304 ) {
+      SeqUtil_TRACE(TL_MEDIUM,"logreader: checkpoint %s of another version ignored\n", path);
+      goto end;
+   }
+   if ( hdr.dev != (uint64_t) st->st_dev || hdr.ino != (uint64_t) st->st_ino || hdr.offset <= 0 || hdr.offset > st->st_size ) {
+      SeqUtil_TRACE(TL_FULL_TRACE,"logreader: nodelog replaced or truncated since checkpoint %s\n", path);
+      goto end;
+   }
+   if ( hdr.size == st->st_size && (hdr.mtime != st->st_mtim.tv_sec || hdr.mtime_nsec != st->st_mtim.tv_nsec) ) {
+      SeqUtil_TRACE(TL_FULL_TRACE,"logreader: nodelog rewritten since checkpoint %s\n", path);
+      goto end;
+   }
+   tailLength = hdr.offset < LR_CKPT_TAIL ? hdr.offset : LR_CKPT_TAIL;
+   if ( pread(fd, tail, tailLength, hdr.offset - tailLength) != tailLength || lr_hashBytes(tail, tailLength) != hdr.tailHash ) {
+      SeqUtil_TRACE(TL_FULL_TRACE,"logreader: nodelog changed before the offset of checkpoint %s\n", path);
+      goto end;
+   }
+
+   /* the records are checked before any node is created */
+   for ( pass = 0; pass < 2; pass++ ) {
+      ptr = buf + sizeof(hdr);
+      end = buf + cst.st_size;
+      for ( i = 0; i < hdr.nnodes; i++ ) {
+         if ( end - ptr < sizeof(rec) ) goto corrupt;
+         memcpy(&rec, ptr, sizeof(rec));
+         strings = ptr + sizeof(rec);
+         if ( rec.nodeLength >= SEQ_MAXFIELD || rec.tnodeLength >= SEQ_MAXFIELD || rec.loopLength >= SEQ_MAXFIELD || rec.waitmsgLength >= SEQ_MAXFIELD ) goto corrupt;
+         total = rec.nodeLength + rec.tnodeLength + rec.loopLength + rec.waitmsgLength + 4;
+         if ( end - strings < total ) goto corrupt;
+         if ( strings[rec.nodeLength] != '\0' || strings[rec.nodeLength + rec.tnodeLength + 1] != '\0' ||
+              strings[rec.nodeLength + rec.tnodeLength + rec.loopLength + 2] != '\0' || strings[total - 1] != '\0' ) goto corrupt;
+         if ( pass == 1 ) {
+            ptr_Ltrotte = lr_newNode(strings, strings + rec.nodeLength + 1, strings + rec.nodeLength + rec.tnodeLength + 2);
+            memcpy(ptr_Ltrotte->PNode.stime, rec.stime, sizeof(rec.stime));
+            memcpy(ptr_Ltrotte->PNode.btime, rec.btime, sizeof(rec.btime));
+            memcpy(ptr_Ltrotte->PNode.etime, rec.etime, sizeof(rec.etime));
+            memcpy(ptr_Ltrotte->PNode.itime, rec.itime, sizeof(rec.itime));
+            memcpy(ptr_Ltrotte->PNode.atime, rec.atime, sizeof(rec.atime));
+            memcpy(ptr_Ltrotte->PNode.wtime, rec.wtime, sizeof(rec.wtime));
+            memcpy(ptr_Ltrotte->PNode.dtime, rec.dtime, sizeof(rec.dtime));
+            ptr_Ltrotte->PNode.stime[17] = ptr_Ltrotte->PNode.btime[17] = ptr_Ltrotte->PNode.etime[17] = '\0';
+            ptr_Ltrotte->PNode.itime[17] = ptr_Ltrotte->PNode.atime[17] = ptr_Ltrotte->PNode.wtime[17] = '\0';
+            ptr_Ltrotte->PNode.dtime[17] = '\0';
+            if ( rec.waitmsgLength > 0 ) ptr_Ltrotte->PNode.waitmsg = lr_strdup(strings + total - rec.waitmsgLength - 1);
+            ptr_Ltrotte->PNode.LastAction = rec.LastAction;
+            ptr_Ltrotte->PNode.ignoreNode = rec.ignoreNode;
+         }
+         ptr = strings + total;
+      }
+      if ( ptr != end ) goto corrupt;
+   }
+   offset = hdr.offset;
+   SeqUtil_TRACE(TL_FULL_TRACE,"logreader: %u nodes restored from checkpoint %s, resuming at offset %ld\n", hdr.nnodes, path, (long) offset);
+   goto end;
+
+corrupt:
+   SeqUtil_TRACE(TL_MEDIUM,"logreader: corrupted checkpoint %s ignored\n", path);
+end:
+   free(buf);
+   close(ckfd);
+   return offset;
+}
+
+/* writes the nodes read up to offset of the nodelog mapped at base */
+static void lr_writeCheckpoint( const char *path, const struct stat *st, const char *base, off_t offset ) {
+   LrCkptHeader hdr;
+   LrCkptNode rec;
+   struct _ListListNodes *ptr_LLtrotte;
+   struct _ListNodes *ptr_Ltrotte;
+   char tmp[SEQ_MAXFIELD];
+   size_t tailLength;
+   FILE *fp;
+
+   memset(&hdr, 0, sizeof(hdr));
+   memcpy(hdr.magic, LR_CKPT_MAGIC, strlen(LR_CKPT_MAGIC));
+   hdr.version = LR_CKPT_VERSION;
+   hdr.order = 0x01020304;
+   hdr.dev = st->st_dev;
+   hdr.ino = st->st_ino;
+   hdr.offset = offset;
+   hdr.size = st->st_size;
+   hdr.mtime = st->st_mtim.tv_sec;
+   hdr.mtime_nsec = st->st_mtim.tv_nsec;
+   tailLength = offset < LR_CKPT_TAIL ? offset : LR_CKPT_TAIL;
+   hdr.tailHash = lr_hashBytes(base + offset - tailLength, tailLength);
+   hdr.nnodes = nodeCount;
+
+   /* written aside and renamed: another reader never gets a partial checkpoint */
+   snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+   if ( (fp = fopen(tmp, "w")) == NULL ) {
+      SeqUtil_TRACE(TL_MEDIUM,"logreader: cannot write checkpoint %s: %s\n", tmp, strerror(errno));
+      return;
+   }
+   fwrite(&hdr, sizeof(hdr), 1, fp);
+   /* in the order of the lists, restoring them in the same order */
+   for ( ptr_LLtrotte = &MyListListNodes; ptr_LLtrotte != NULL ; ptr_LLtrotte = ptr_LLtrotte->next) {
+      for ( ptr_Ltrotte = ptr_LLtrotte->Ptr_LNode ; ptr_Ltrotte != NULL ; ptr_Ltrotte = ptr_Ltrotte->next) {
+         memset(&rec, 0, sizeof(rec));
+         rec.nodeLength = strlen(ptr_Ltrotte->PNode.Node);
+         rec.tnodeLength = strlen(ptr_Ltrotte->PNode.TNode);
+         rec.loopLength = strlen(ptr_Ltrotte->PNode.loop);
+         rec.waitmsgLength = strlen(ptr_Ltrotte->PNode.waitmsg);
+         memcpy(rec.stime, ptr_Ltrotte->PNode.stime, sizeof(rec.stime));
+         memcpy(rec.btime, ptr_Ltrotte->PNode.btime, sizeof(rec.btime));
+         memcpy(rec.etime, ptr_Ltrotte->PNode.etime, sizeof(rec.etime));
+         memcpy(rec.itime, ptr_Ltrotte->PNode.itime, sizeof(rec.itime));
+         memcpy(rec.atime, ptr_Ltrotte->PNode.atime, sizeof(rec.atime));
+         memcpy(rec.wtime, ptr_Ltrotte->PNode.wtime, sizeof(rec.wtime));
+         memcpy(rec.dtime, ptr_Ltrotte->PNode.dtime, sizeof(rec.dtime));
+         rec.LastAction = ptr_Ltrotte->PNode.LastAction;
+         rec.ignoreNode = ptr_Ltrotte->PNode.ignoreNode;
+         fwrite(&rec, sizeof(rec), 1, fp);
+         fwrite(ptr_Ltrotte->PNode.Node, rec.nodeLength + 1, 1, fp);
+         fwrite(ptr_Ltrotte->PNode.TNode, rec.tnodeLength + 1, 1, fp);
+         fwrite(ptr_Ltrotte->PNode.loop, rec.loopLength + 1, 1, fp);
+         fwrite(ptr_Ltrotte->PNode.waitmsg, rec.waitmsgLength + 1, 1, fp);
+      }
+   }
+   if ( ferror(fp) | fclose(fp) ) {
+      SeqUtil_TRACE(TL_MEDIUM,"logreader: cannot write checkpoint %s\n", tmp);
+      unlink(tmp);
+   } else if ( rename(tmp, path) != 0 ) {
+      SeqUtil_TRACE(TL_MEDIUM,"logreader: cannot rename %s to %s: %s\n", tmp, path, strerror(errno));
+      unlink(tmp);
+   }
+}
+
+void logreader_setCheckpoint( const char *path ) {
+   free(checkpointPath);
+   checkpointPath = path != NULL ? strdup(path) : NULL;
+}
+
+void logreader_setNode( const char *node ) {
+   free(historyNode);
+   historyNode = NULL;
+   if ( node != NULL ) {
+      /* the nodes are logged with their leading slash */
+      historyNode = malloc(strlen(node) + 2);
+      sprintf(historyNode, "%s%s", node[0] == '/' ? "" : "/", node);
    }
 }
 
+/* output the line of the nodelog of rec as it is */
+static int lr_printLine( const SeqLogRecord *rec, void *arg ) {
+   LrLineOutput *lo = (LrLineOutput *) arg;
+   char *line;
+
+   if ( (line = malloc(rec->len + 1)) == NULL ) raiseError("logreader malloc: Out of memory!\n");
+   if ( pread(lo->fd, line, rec->len, rec->offset) == (ssize_t) rec->len ) {
+      line[rec->len] = '\0';
+      SeqUtil_printOrWrite(lo->output, "%s", line);
+   }
+   free(line);
+   return(0);
+}
 
 /* logreader API call
 *
@@ -1168,9 +1439,11 @@ void delete_node(struct _ListNodes *node, struct _ListListNodes *list) {
 void logreader(char * inputFilePath, char * outputFilePath, char * exp, char * datestamp, char * type, int statWindow, int clobberFile ) {
 
    FILE *output_file = NULL;
-   char * base; 
+   char * base, *end; 
    int fp=-1, ret; 
-   char input_file_path[512], optional_output_path[512], optional_output_dir[512];
+   off_t offset=0;
+   char input_file_path[512], optional_output_path[512], optional_output_dir[512], checkpoint_path[SEQ_MAXFIELD];
+   char top_log_path[512];
    
    if (exp == NULL || datestamp==NULL) {
       raiseError("logreader: exp and datestamp must be defined to use logreader\n");
@@ -1183,6 +1456,12 @@ void logreader(char * inputFilePath, char * outputFilePath, char * exp, char * d
       fp = open(inputFilePath, O_RDONLY, 0 );
    } else { 
       sprintf(input_file_path, "%s/logs/%s_nodelog" , exp,datestamp);  
+      sprintf(top_log_path, "%s/logs/%s_toplog" , exp,datestamp);  
+      SeqLogSpool_merge(top_log_path);
+   }
+   /* the lines logged while mserver was unreachable wait in the spool of the log */
+   if ( SeqLogSpool_merge(input_file_path) < 0 ) {
+      SeqUtil_TRACE(TL_MEDIUM,"logreader: cannot merge the spool of %s\n", input_file_path);
    }
    fp = open(input_file_path, O_RDONLY, 0 );
 
@@ -1210,6 +1489,16 @@ void logreader(char * inputFilePath, char * outputFilePath, char * exp, char * d
       } else if (strcmp(type, "compute_avg") == 0) {
 	      SeqUtil_TRACE(TL_FULL_TRACE,"logreader type: compute averages\n");
 	      read_type=LR_CALC_AVG;
+      } else if (strcmp(type, "latest") == 0) {
+	      SeqUtil_TRACE(TL_FULL_TRACE,"logreader type: latest line of the nodes\n");
+	      read_type=LR_SHOW_LATEST;
+      } else if (strcmp(type, "history") == 0) {
+	      SeqUtil_TRACE(TL_FULL_TRACE,"logreader type: lines of node %s\n", historyNode);
+	      read_type=LR_SHOW_HISTORY;
+         if (historyNode == NULL) {
+            fprintf ( stderr, "-t history needs the node (-N argument).\n");
+            exit(EXIT_FAILURE);
+         }
       } else {
          fprintf ( stderr, "Unsupported type (-t argument).\n");
          exit(EXIT_FAILURE);
@@ -1240,6 +1529,21 @@ void logreader(char * inputFilePath, char * outputFilePath, char * exp, char * d
       }
    }
 
+   if ((read_type == LR_SHOW_LATEST) || (read_type == LR_SHOW_HISTORY)) {
+      LrLineOutput lo;
+
+      /* from the index of the nodelog when mserver keeps one */
+      lo.fd = fp;
+      lo.output = output_file;
+      if ( fp < 0 ||
+           (read_type == LR_SHOW_LATEST ? SeqLogIndex_latest(input_file_path, lr_printLine, &lo)
+                                        : SeqLogIndex_history(input_file_path, historyNode, lr_printLine, &lo)) < 0 ) {
+         fprintf(stderr,"Cannot read input file %s\n",input_file_path );
+         exit(1);
+      }
+      close(fp);
+   }
+
    if ((read_type == LR_SHOW_ALL) || (read_type == LR_SHOW_STATUS) || (read_type == LR_SHOW_STATS))  {
       if ( fp < 0 ) {
          fprintf(stderr,"Cannot open input file %s\n",input_file_path );
@@ -1251,23 +1555,44 @@ void logreader(char * inputFilePath, char * outputFilePath, char * exp, char * d
          exit(1);
       }
 
-      if ( ( base = mmap(NULL, pt.st_size, PROT_READ, MAP_SHARED, fp, (off_t)0) ) == (char *) MAP_FAILED ) {
-         if (errno == EINVAL) {
-            fprintf (stdout,"\n");
-            close(fp);
-            if (output_file != NULL) fclose(output_file);
-            exit(EXIT_SUCCESS);
-         } else { 
-            fprintf(stderr,"Map failed \n");
-            close(fp);
-            if (output_file != NULL) fclose(output_file);
-            exit(EXIT_FAILURE);
+      if ( checkpointPath != NULL && pt.st_size > 0 ) {
+         if ( strlen(checkpointPath) > 0 ) {
+            snprintf(checkpoint_path, sizeof(checkpoint_path), "%s", checkpointPath);
+         } else {
+            snprintf(checkpoint_path, sizeof(checkpoint_path), "%s%s", input_file_path, LR_CHECKPOINT_SUFFIX);
          }
+         offset = lr_restoreCheckpoint(checkpoint_path, fp, &pt);
       }
-      read_file(base); 
+
+      if ( offset == 0 || offset < pt.st_size ) {
+         if ( ( base = mmap(NULL, pt.st_size, PROT_READ, MAP_SHARED, fp, (off_t)0) ) == (char *) MAP_FAILED ) {
+            if (errno == EINVAL) {
+               fprintf (stdout,"\n");
+               close(fp);
+               if (output_file != NULL) fclose(output_file);
+               exit(EXIT_SUCCESS);
+            } else { 
+               fprintf(stderr,"Map failed \n");
+               close(fp);
+               if (output_file != NULL) fclose(output_file);
+               exit(EXIT_FAILURE);
+            }
+         }
+         if ( checkpointPath != NULL ) {
+            /* a line being written is left to the next read */
+            for ( end = base + pt.st_size; end > base + offset && end[-1] != '\n'; end-- );
+            if ( end > base + offset ) {
+               lr_readLines(base + offset, end);
+               lr_writeCheckpoint(checkpoint_path, &pt, base, end - base);
+            }
+         } else {
+            read_file(base); 
+         }
    
-      /* unmap */
-      munmap(base, pt.st_size);  
+         /* unmap */
+         munmap(base, pt.st_size);  
+      }
+      close(fp);
       
       /*print node status and/or stats*/
       print_LListe ( MyListListNodes, output_file );
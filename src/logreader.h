@@ -22,10 +22,12 @@
 #ifndef LOGREADER_H
 #define LOGREADER_H
 
+/* The strings of the nodes are kept in an arena freed with the nodes, the
+ * timestamps (YYYYMMDD.HH:MM:SS) stay in the records. */
 typedef struct  _Node_prm {
-   char Node[256];
-   char TNode[256];
-   char loop[64];
+   char *Node;          /* node path and loop extension */
+   char *TNode;         /* node path */
+   char *loop;
    char stime[18];
    char btime[18];
    char etime[18];
@@ -34,23 +36,26 @@ typedef struct  _Node_prm {
    char wtime[18];
    char dtime[18];
    char LastAction;
-   char waitmsg[256];
+   char *waitmsg;
    int ignoreNode;
 } Node_prm;
 
 typedef struct _ListNodes {
    struct _Node_prm PNode;
-   struct _ListNodes *next;
+   struct _ListNodes *next;         /* next node of the same length, in the order read */
+   struct _ListNodes *hashNext;     /* next node of the same bucket of the node table */
+   struct _ListNodes *nextMember;   /* next loop member of the same node path */
 } ListNodes;
 
 typedef struct _ListListNodes {
    int Nodelength;
    struct _ListNodes *Ptr_LNode;
+   struct _ListNodes *last;
    struct _ListListNodes *next;
 } ListListNodes;
 
 typedef struct _LoopExt {
-   char Lext[32];
+   char *Lext;
    char lstime[18];
    char lbtime[18];
    char letime[18];
@@ -63,16 +68,25 @@ typedef struct _LoopExt {
    char deltafromstart[10];
    char LastAction;
    int ignoreNode;
-   char waitmsg[256];
+   char *waitmsg;
    struct _LoopExt *next;
 } LoopExt;
 
 typedef struct _NodeLoopList {
-   char Node[256];
+   char *Node;
    struct _LoopExt *ptr_LoopExt;
+   struct _LoopExt *last;
    struct _NodeLoopList *next;
 } NodeLoopList;
 
+/* the loop members of a node path, for the init of a branch and the output */
+typedef struct _NodeBranch {
+   char *TNode;
+   struct _ListNodes *members;
+   struct _NodeLoopList *loopList;
+   struct _NodeBranch *hashNext;
+} NodeBranch;
+
 typedef struct _PastTimes {
    char *begin;
    char *submit;
@@ -121,6 +135,18 @@ extern char * previousDay(char today[9]);
 extern char * sconcat(char *ptr1,char *ptr2);
 extern void delete_node(struct _ListNodes *node, struct _ListListNodes *list);
 
+/* incremental reading of the nodelog: the nodes read and the offset reached
+ * are kept in the checkpoint file path, the next read with the same path
+ * reads only the lines appended since.  An empty path is the nodelog path
+ * followed by LR_CHECKPOINT_SUFFIX, NULL reads the whole nodelog (default). */
+#define LR_CHECKPOINT_SUFFIX ".lrstate"
+extern void logreader_setCheckpoint( const char *path );
+
+/* the node of logreader -t history (the nodelog lines of node), answered
+ * with the index of the nodelog (SeqLogIndex.h) as is -t latest (the last
+ * line of every node and loop extension). */
+extern void logreader_setNode( const char *node );
+
 void logreader(char * inputFilePath, char * outputFilePath, char * exp, char * datestamp, char * type, int statWindow, int clobberFile); 
 
 #endif
@@ -29,6 +29,7 @@
 #include "SeqUtil.h"
 #include "getopt.h"
 #include "SeqDatesUtil.h"
+#include "SeqLogIndex.h"
 
 static void printUsage()
 {
@@ -36,7 +37,7 @@ static void printUsage()
 \n\
 USAGE:\n\
     \n\
-    logreader [-i inputfile] [-t type] [-o outputfile] | -t avg [-n days]) [-e exp] [-d datestamp] [-v] [-c]\n\
+    logreader [-i inputfile] [-t type] [-o outputfile] | -t avg [-n days] | -t history -N node) [-e exp] [-d datestamp] [-r | -k checkpoint] [-v] [-c]\n\
 \n\
 OPTIONS:\n\
 \n\
@@ -48,15 +49,31 @@ OPTIONS:\n\
 \n\
     -t, --type\n\
         Specify an output filter : log (statuses & stats, used for xflow), statuses, \n\
-        stats or avg (default is log)\n\
+        stats, avg, latest (the last line of every node and loop extension) or \n\
+        history (every line of the node given with -N) (default is log). latest \n\
+        and history output nodelog lines, read with the index mserver keeps with \n\
+        nodelogIndex=\"1\" (inputfile" SEQ_LOG_INDEX_EXT "), the whole log is read without it.\n\
 \n\
     -n, --days\n\
         Specify a number of days for averaging: Used with -t avg to define the number \n\
         of days for the averages since \"datestamp\" (default is 7). This is a 10% truncated \n\
         average to account for extremes.\n\
+\n\
+    -N, --node\n\
+        The node of -t history, ex: /main/task\n\
 \n\
     -c, --check\n\
         check if output file is present before trying to write. Will not write if file is present.\n\
+\n\
+    -r, --resume\n\
+        Incremental reading: the nodes read are kept with the offset reached in a\n\
+        checkpoint next to the input file (inputfile" LR_CHECKPOINT_SUFFIX "), the next\n\
+        logreader -r reads only the lines appended since. The whole file is read\n\
+        again when it was truncated or replaced. A line being written is left to\n\
+        the next read.\n\
+\n\
+    -k, --checkpoint\n\
+        Same as -r with the given checkpoint file\n\
 \n\
     \n\
     -d, --datestamp\n\
@@ -93,7 +110,7 @@ int main ( int argc, char * argv[] )
 {
    char *type=NULL, *inputFile=NULL, *outputFile=NULL, *exp=NULL, *datestamp=NULL, *tmpDate=NULL, *tmpExp=NULL; 
    int stats_days=7, clobberFile=1, i; 
-   char * short_opts = "i:t:n:o:d:e:vch";
+   char * short_opts = "i:t:n:o:d:e:k:N:rvch";
 
    extern char *optarg;
    extern int   optind;
@@ -106,6 +123,9 @@ int main ( int argc, char * argv[] )
       {"output-file"  , required_argument,   0,     'o'},
       {"days"        , required_argument,   0,     'n'},
       {"check"       , no_argument      ,   0,     'c'},
+      {"resume"      , no_argument      ,   0,     'r'},
+      {"checkpoint"  , required_argument,   0,     'k'},
+      {"node"        , required_argument,   0,     'N'},
       {"verbose"     , no_argument      ,   0,     'v'},
       {"help"        , no_argument      ,   0,     'h'},
       {NULL,0,0,0} /* End indicator */
@@ -148,6 +168,15 @@ int main ( int argc, char * argv[] )
       case 'c':
          clobberFile=0;
 	      break;
+      case 'r':
+         logreader_setCheckpoint("");
+	      break;
+      case 'k':
+         logreader_setCheckpoint(optarg);
+	      break;
+      case 'N':
+         logreader_setNode(optarg);
+	      break;
       case '?':
          printUsage();
          exit(1);
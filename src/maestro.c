@@ -33,6 +33,8 @@
 #include <sys/wait.h>
 #include <fcntl.h> 
 #include <sys/time.h>
+#include <errno.h>
+#include <spawn.h>
 
 #include "maestro.h"
 #include "nodelogger.h"
@@ -49,9 +51,11 @@
 #include "SeqUtilServer.h"
 #include "ocmjinfo.h"
 #include "logreader.h" 
+#include "SeqStateStore.h"
+#include "SeqLoopMap.h"
+#include "SeqStatusSnapshot.h"
+#include "SeqRateLimit.h"
 
-#define CONTAINER_FLOOD_LIMIT 10
-#define CONTAINER_FLOOD_TIMER 15
 #define LOCAL_DEPENDS_DIR "/sequencing/status/depends/"
 #define REMOTE_DEPENDS_DIR "/sequencing/status/remote_depends/"
 #define INTER_DEPENDS_DIR "/sequencing/status/inter_depends/"
@@ -74,6 +78,7 @@ static int go_initialize(char *_signal, char *_flow ,const SeqNodeDataPtr _nodeD
 static int go_begin(char *_signal, char *_flow ,const SeqNodeDataPtr nodeDataPtr);
 static int go_end(char *_signal, char *_flow ,const SeqNodeDataPtr _nodeDataPtr);
 static int go_submit(const char *signal, char *_flow ,const SeqNodeDataPtr nodeDataPtr, int ignoreAllDeps );
+static int submissions_wait( int keep );
 
 /* deal with containers states */
 static void processContainerBegin ( const SeqNodeDataPtr _nodeDataPtr, char *_flow );
@@ -92,7 +97,7 @@ static void setInitState(const SeqNodeDataPtr _nodeDataPtr);
 static int setEndState(const char *_signal, const SeqNodeDataPtr _nodeDataPtr);
 static void setAbortState(const SeqNodeDataPtr _nodeDataPtr, char * current_action);
 static void setWaitingState(const SeqNodeDataPtr _nodeDataPtr, const char* waited_one, const char* waited_status);
-static void clearAllOtherStates( SeqNodeDataPtr _nodeDataPtr, char *fullNodeName, char *originator, char *current_signal); 
+static void setNodeState( const SeqNodeDataPtr _nodeDataPtr, const char *fullNodeName, const char *originator, const char *state); 
 int   isNodeXState (const char* node, const char* loopargs, const char * datestamp, const char* exp, const char * state);  
 
 /* submission utilities */
@@ -118,6 +123,14 @@ int processDepStatus( const SeqNodeDataPtr _nodeDataPtr, SeqDepDataPtr dep, cons
 /* Declare pointer to function to be able to replace locking mechanism */
 /* see SeqUtil.h for other definitions */
 static int ServerConnectionStatus = 1;
+/* SEQ_LOOP_MAP of ~/.maestrorc: loop maps not used, used, or verified against the status files */
+static enum { LoopMapNo, LoopMapYes, LoopMapVerify } LoopMapMode = LoopMapYes;
+/* serverless mode reads the status directories itself, once per process (see SeqStatusSnapshot.h) */
+static int StatusSnapshotMode = 0;
+/* SEQ_DEPS_WORKERS of ~/.maestrorc: worker processes releasing the dependants of a node at the same time */
+static int DepWorkers = 4;
+/* SEQ_SUBMIT_INFLIGHT of ~/.maestrorc: submissions of this process running at the same time */
+static int SubmitInFlight = 4;
 static int QueDeqConnection = 0 ;
 int MLLServerConnectionFid=0; /* connection for the maestro Lock|Log  server */
 extern int OpenConnectionToMLLServer (const char *,const char *,const char*);
@@ -130,6 +143,7 @@ static int  (*_WriteInterUserDepFile) (const char *filename , const char * depBu
                                         const char *datestamp, const char *md5sum );
 static int (*_WriteFEFile) ( const char* _exp, const char* _node, const char* _datestamp, const char * _target_index, const char* _loopArgs,
                               const char* _filename) ;
+static double (*_takeSubmitToken) ( const char *bucket, double rate, double burst, const char* _seq_exp_home );
  
 int writeInterUserNodeWaitedFile ( const SeqNodeDataPtr _nodeDataPtr, const char* _dep_name, const char* _dep_index, char *depIndexPtr, const char *_dep_datestamp, 
                                    const char *_dep_status, const char* _dep_exp , const char* _dep_prot , const char* statusFile, const char * _flow);
@@ -173,12 +187,35 @@ static void CreateLockFile_nfs(int sock , char *filename, char *caller , const c
 
 }
  
+/*
+ * Takes a submission token from the bucket file, nfs version; returns the seconds to wait
+*/
+static double takeSubmitToken_nfs( const char *bucket, double rate, double burst, const char* _seq_exp_home )
+{
+   return SeqRateLimit_take( bucket, rate, burst, SeqRateLimit_now() );
+}
+
+/*
+ * Takes a submission token through mserver, from the bucket file if the server cannot
+*/
+static double takeSubmitToken_mserver( const char *bucket, double rate, double burst, const char* _seq_exp_home )
+{
+   double wait = 0.0;
+
+   if ( takeSubmitToken_svr( bucket, rate, burst, &wait, _seq_exp_home ) != 0 ) {
+      return takeSubmitToken_nfs( bucket, rate, burst, _seq_exp_home );
+   }
+   return wait;
+}
+ 
 static void useNFSlocking()
 {
   _isFileExists = isFileExists_nfs;
   _touch =  touch_nfs;
   _access = access_nfs;
   _removeFile = removeFile_nfs;
+  _removeFiles = removeFiles_nfs;
+  _setNodeState = setNodeState_nfs;
   _CreateLockFile = CreateLockFile_nfs;
   _SeqUtil_mkdir = SeqUtil_mkdir_nfs;
   _globPath = globPath_nfs;
@@ -187,18 +224,52 @@ static void useNFSlocking()
   _WriteInterUserDepFile =  WriteInterUserDepFile_nfs;
   _WriteFEFile = WriteForEachFile_nfs;
 /*  _WriteInterUserFEFile = WriteInterUserForEachFile_nfs ; */
+  _takeSubmitToken = takeSubmitToken_nfs;
   _fopen = fopen_nfs;
   _lock  = lock_nfs;
   _unlock  = unlock_nfs;
+  StatusSnapshotMode = 1;
   fprintf(stderr,"Serverless mode selected\n"); 
 }
  
+/*
+ * Wrapper for access and touch , status store version
+*/
+static void CreateLockFile_store(int sock , char *filename, char *caller , const char* _seq_exp_home)
+{
+   if ( access_store (filename, R_OK,_seq_exp_home) != 0 ) {
+          touch_store(filename,_seq_exp_home);
+          SeqUtil_TRACE(TL_FULL_TRACE, "%s created lockfile %s\n", caller, filename);
+   } else {
+          SeqUtil_TRACE(TL_FULL_TRACE, "%s not recreating existing lock file:%s\n",caller, filename );
+   }
+}
+
+/* Serverless mode with the node states kept in the status store of the datestamp, see SeqStateStore.h */
+static void useStateStore()
+{
+  _isFileExists = isFileExists_store;
+  _touch =  touch_store;
+  _access = access_store;
+  _removeFile = removeFile_store;
+  _removeFiles = removeFiles_store;
+  _setNodeState = setNodeState_store;
+  _CreateLockFile = CreateLockFile_store;
+  _globPath = globPath_store;
+  _globExtList = globExtList_store;
+  _takeSubmitToken = takeSubmitToken_nfs;
+  StatusSnapshotMode = 0;
+  fprintf(stderr,"Status store selected\n");
+}
+
 static void useSVRlocking()
 {
  _isFileExists = isFileExists_svr;
  _touch = touch_svr;
  _access = access_svr;
  _removeFile = removeFile_svr;
+ _removeFiles = removeFiles_svr;
+ _setNodeState = setNodeState_svr;
  _CreateLockFile = CreateLockFile_svr;
  _SeqUtil_mkdir = SeqUtil_mkdir_svr;
  _globPath = globPath_svr;
@@ -213,9 +284,26 @@ static void useSVRlocking()
  _fopen = fopen_svr;
  _lock  = lock_svr;
  _unlock  = unlock_svr;
+ _takeSubmitToken = takeSubmitToken_mserver;
+ StatusSnapshotMode = 0;
   fprintf(stderr,"mserver mode selected\n"); 
 }
 
+/* 
+ * _isFileExists for the status files of the completeness checks: from the snapshot of their
+ * directory in serverless mode
+*/
+static int isStatusFileExists( const char *filename, const char *caller, const char *_seq_exp_home )
+{
+   int ret;
+
+   if ( StatusSnapshotMode && (ret = SeqStatusSnapshot_exists( filename )) >= 0 ) {
+      SeqUtil_TRACE(TL_FULL_TRACE, "%s status snapshot %s:%d\n", caller, filename, ret);
+      return ret;
+   }
+   return _isFileExists( filename, caller, _seq_exp_home );
+}
+
 /**
  *  handler for timeout ie blocked connection
  *  and also for synchronizing writes to
@@ -428,19 +516,14 @@ Inputs:
 static void setAbortState(const SeqNodeDataPtr _nodeDataPtr, char * current_action) {
 
    char *extName = NULL;
-   char filename[SEQ_MAXFIELD];
+   char state[SEQ_MAXFIELD];
 
    extName = (char *) SeqNode_extension( _nodeDataPtr );    
 
-   /* clear any other state */
-   clearAllOtherStates( _nodeDataPtr, extName, "maestro.setAbortState()", current_action ); 
-
-   /* create the lock file only if not exists */
-   /* create the node status file */
-   memset(filename,'\0',sizeof filename);
-   sprintf(filename,"%s/%s/%s.abort.%s",_nodeDataPtr->workdir,_nodeDataPtr->datestamp, extName, current_action); 
-
-   _CreateLockFile(MLLServerConnectionFid , filename, "maestro.setAbortState() created lockfile", _nodeDataPtr->expHome);
+   /* clear any other state and create the node status file if not exists */
+   memset(state,'\0',sizeof state);
+   sprintf(state,"abort.%s",current_action); 
+   setNodeState( _nodeDataPtr, extName, "maestro.setAbortState()", state ); 
 
    free( extName );
 }
@@ -482,7 +565,7 @@ static int go_initialize(char *_signal, char *_flow ,const SeqNodeDataPtr _nodeD
    if (  strcmp (_signal,"initbranch" ) == 0 ) {
        memset( cmd, '\0' , sizeof cmd);
        SeqUtil_TRACE(TL_FULL_TRACE, "maestro.go_initialize() deleting end lockfiles starting at node=%s\n", _nodeDataPtr->name);
-       sprintf(cmd, "find %s/%s/%s/%s -name \"*%s.end\" -type f -print -delete -o -name \"*%s.begin\"  -type f -print -delete  -o -name \"*%s.abort.*\"  -type f -print -delete -o -name \"*%s.submit\" -type f -print -delete -o -name \"*%s.waiting*\" -type f -print -delete",_nodeDataPtr->workdir, _nodeDataPtr->datestamp ,_nodeDataPtr->container, _nodeDataPtr->nodeName, extName,extName,extName,extName,extName);
+       sprintf(cmd, "find %s/%s/%s/%s -name \"*%s.end\" -type f -print -delete -o -name \"*%s.begin\"  -type f -print -delete  -o -name \"*%s.abort.*\"  -type f -print -delete -o -name \"*%s.submit\" -type f -print -delete -o -name \"*%s.waiting*\" -type f -print -delete -o -name \"*%s.%s\" -type f -delete",_nodeDataPtr->workdir, _nodeDataPtr->datestamp ,_nodeDataPtr->container, _nodeDataPtr->nodeName, extName,extName,extName,extName,extName,extName,SEQ_LOOPMAP_SUFFIX);
        SeqUtil_TRACE(TL_FULL_TRACE,"cmd=%s\n",cmd); 
        fprintf(stderr,"Following status files are being deleted: \n");
        returnValue=system(cmd);
@@ -490,9 +573,10 @@ static int go_initialize(char *_signal, char *_flow ,const SeqNodeDataPtr _nodeD
     /* for npass tasks  */
        memset( cmd, '\0' , sizeof cmd);
        SeqUtil_TRACE(TL_FULL_TRACE, "maestro.go_initialize() deleting end lockfiles starting at node=%s\n", _nodeDataPtr->name);
-       sprintf(cmd, "find %s/%s/%s/%s -name \"*%s+*.end\"  -type f -print -delete -o -name \"*%s+*.begin\"  -type f -print -delete -o  -name \"*%s+*.abort.*\"  -type f -print -delete -o -name \"*%s+*.submit\"  -type f -print -delete -o -name \"*%s+*.waiting*\"  -type f -print -delete",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->container, _nodeDataPtr->nodeName, extName, extName, extName, extName, extName);
+       sprintf(cmd, "find %s/%s/%s/%s -name \"*%s+*.end\"  -type f -print -delete -o -name \"*%s+*.begin\"  -type f -print -delete -o  -name \"*%s+*.abort.*\"  -type f -print -delete -o -name \"*%s+*.submit\"  -type f -print -delete -o -name \"*%s+*.waiting*\"  -type f -print -delete -o -name \"*%s+*.%s\" -type f -delete",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->container, _nodeDataPtr->nodeName, extName, extName, extName, extName, extName, extName, SEQ_LOOPMAP_SUFFIX);
        SeqUtil_TRACE(TL_FULL_TRACE,"cmd=%s\n",cmd); 
        returnValue=system(cmd);
+       SeqStatusSnapshot_invalidate();
 
    } else if  ( strcmp (_signal,"initnode" ) == 0 ) {
        memset( cmd, '\0' , sizeof cmd);
@@ -516,6 +600,67 @@ static int go_initialize(char *_signal, char *_flow ,const SeqNodeDataPtr _nodeD
    return 0; 
 }
 
+/* the loop map of the loop instance of loopSpace, see SeqLoopMap.h */
+static void loopMapPath(const SeqNodeDataPtr _nodeDataPtr, const SeqLoopSpace *loopSpace, char *path, size_t size) {
+   snprintf(path, size, "%s/%s/%s%s%s.%s", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name,
+            strlen( loopSpace->base ) > 0 ? "." : "", loopSpace->base, SEQ_LOOPMAP_SUFFIX);
+}
+
+/* the loop map flags of the iteration of the loop with extension, from its status files */
+static int loopIterationState(const char *extension, void *arg) {
+   const SeqNodeDataPtr _nodeDataPtr = arg;
+   char filename[SEQ_MAXFIELD];
+   int flags = 0;
+
+   sprintf(filename,"%s/%s/%s.%s.end", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension);
+   if ( isStatusFileExists( filename, "loopIterationState()", _nodeDataPtr->expHome ) ) {
+      flags |= SEQ_LOOPMAP_DONE;
+   } else {
+      sprintf(filename,"%s/%s/%s.%s.abort.cont", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension);
+      if ( isStatusFileExists( filename, "loopIterationState()", _nodeDataPtr->expHome ) ) flags |= SEQ_LOOPMAP_DONE;
+   }
+   sprintf(filename,"%s/%s/%s.%s.abort.stop", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension);
+   if ( isStatusFileExists( filename, "loopIterationState()", _nodeDataPtr->expHome ) ) flags |= SEQ_LOOPMAP_ABORTED;
+   return flags;
+}
+
+/* 
+loopMapCounts
+
+ gets the number of done and aborted iterations of the loop instance of loopSpace from its loop map,
+ verified first against the status files with SEQ_LOOP_MAP=verify
+ returns 0 if succeeds, -1 if the status files have to be checked instead
+
+*/
+static int loopMapCounts(const SeqNodeDataPtr _nodeDataPtr, const SeqLoopSpace *loopSpace, unsigned long *done, unsigned long *aborted) {
+   char path[SEQ_MAXFIELD];
+
+   if ( LoopMapMode == LoopMapNo ) return -1;
+   loopMapPath( _nodeDataPtr, loopSpace, path, sizeof path );
+   if ( LoopMapMode == LoopMapVerify && SeqLoopMap_verify( path, loopSpace, loopIterationState, _nodeDataPtr, stderr ) > 0 ) {
+      fprintf(stderr,"maestro: loop map %s did not match the status files, rebuilt\n", path);
+   }
+   return SeqLoopMap_counts( path, loopSpace, loopIterationState, _nodeDataPtr, done, aborted );
+}
+
+/* clears the other states of the node, with extension after its own */
+static void setInitStateExtension(const SeqNodeDataPtr _nodeDataPtr, const char *extension) {
+   char *extName = NULL;
+
+   SeqUtil_stringAppend( &extName, _nodeDataPtr->name );
+   if( strlen( _nodeDataPtr->extension ) > 0 || strlen( extension ) > 0 ) {
+      SeqUtil_stringAppend( &extName, "." );
+      SeqUtil_stringAppend( &extName, _nodeDataPtr->extension );
+      SeqUtil_stringAppend( &extName, (char *) extension );
+   }
+   SeqUtil_TRACE(TL_FULL_TRACE,"maestro.go_initialize()() Looking for status files: %s\n", extName);
+
+   /* clear any other state */
+   setNodeState( _nodeDataPtr, extName, "maestro.setInitState()", "init"); 
+
+   free( extName );
+}
+
 /* 
 setInitState
 
@@ -528,49 +673,40 @@ Inputs:
 
 static void setInitState(const SeqNodeDataPtr _nodeDataPtr) {
 
-   char *extName = NULL;
    char *tmpString = NULL; 
-   LISTNODEPTR nodeList = NULL;
+   char extension[SEQ_MAXFIELD];
+   SeqLoopSpacePtr loopSpace = NULL;
+   SeqLoopIterator iterator;
 
    /* delete the lock files for the current loop, it is stored in it's container */
    if( _nodeDataPtr->type == Loop ) {
-      /* this will build the list for the loop iterations */
+      /* this will go through the loop iterations */
       if( ((char*) SeqLoops_getLoopAttribute( _nodeDataPtr->loop_args, _nodeDataPtr->nodeName )) == NULL ) {
          /* user has not selected an extension for the current loop, clear them all */
-         /* get the list of child leaf extensions for the node */
-         nodeList = (LISTNODEPTR) SeqLoops_childExtensions( _nodeDataPtr );
+         /* go through the child leaf extensions for the node */
+         loopSpace = SeqLoops_childSpace( _nodeDataPtr );
+         SeqLoops_iteratorInit( &iterator, loopSpace, 0 );
+         while( SeqLoops_iteratorNext( &iterator, extension, sizeof extension ) ) {
+            setInitStateExtension( _nodeDataPtr, extension );
+         }
+         loopMapPath( _nodeDataPtr, loopSpace, extension, sizeof extension );
+         if ( SeqLoopMap_remove( extension ) != 0 ) fprintf(stderr,"maestro.setInitState() cannot remove %s\n", extension);
+         SeqLoops_freeSpace( loopSpace );
       }
    }
    /* this line will take care of task, normal containers (including the loop node) */
-   SeqListNode_insertItem( &nodeList, "" );
+   setInitStateExtension( _nodeDataPtr, "" );
 
    if ( _nodeDataPtr->type == Switch ) {
       if( ((char*) SeqLoops_getLoopAttribute( _nodeDataPtr->loop_args, _nodeDataPtr->nodeName )) == NULL ) {
           SeqUtil_TRACE(TL_FULL_TRACE,"maestro.go_initialize() Adding to list switch argument extension: %s\n", SeqNameValues_getValue(_nodeDataPtr->switchAnswers,_nodeDataPtr->nodeName));
           SeqUtil_stringAppend( &tmpString, "+" );
           SeqUtil_stringAppend( &tmpString, SeqNameValues_getValue(_nodeDataPtr->switchAnswers,_nodeDataPtr->nodeName));
-          SeqListNode_insertItem( &nodeList, tmpString);
+          setInitStateExtension( _nodeDataPtr, tmpString );
        }
    }   
 
-   while( nodeList != NULL ) {
-      SeqUtil_stringAppend( &extName, _nodeDataPtr->name );
-      if( strlen( _nodeDataPtr->extension ) > 0 || strlen( nodeList->data ) > 0 ) {
-         SeqUtil_stringAppend( &extName, "." );
-         SeqUtil_stringAppend( &extName, _nodeDataPtr->extension );
-         SeqUtil_stringAppend( &extName, nodeList->data );
-      }
-      SeqUtil_TRACE(TL_FULL_TRACE,"maestro.go_initialize()() Looking for status files: %s\n", extName);
-
-      /* clear any other state */
-      clearAllOtherStates( _nodeDataPtr, extName, "maestro.setInitState()", ""); 
-
-      free( extName );
-      extName = NULL;
-      nodeList = nodeList->nextPtr;
-   }
    free (tmpString);
-   SeqListNode_deleteWholeList(&nodeList);
 }
 
 /* 
@@ -687,9 +823,6 @@ static void setBeginState(char *_signal, const SeqNodeDataPtr _nodeDataPtr) {
  
    extName = (char *)SeqNode_extension( _nodeDataPtr );
 
-   /* clear any other state */
-   clearAllOtherStates( _nodeDataPtr, extName, "maestro.setBeginState()", "begin"); 
-
    /* begin lock file */
    memset(filename,'\0',sizeof filename);
    sprintf(filename,"%s/%s/%s.begin",_nodeDataPtr->workdir,_nodeDataPtr->datestamp, extName); 
@@ -706,9 +839,9 @@ static void setBeginState(char *_signal, const SeqNodeDataPtr _nodeDataPtr) {
       nodebegin( _signal, _nodeDataPtr, _nodeDataPtr->datestamp );
    }
 
-   /* we will only create the lock file if it does not already exists */
+   /* clear any other state, we will only create the lock file if it does not already exists */
    SeqUtil_TRACE(TL_FULL_TRACE, "maestro.setBeginState() checking for lockfile %s\n", filename);
-   _CreateLockFile(MLLServerConnectionFid , filename , "setBeginState() ", _nodeDataPtr->expHome);
+   setNodeState( _nodeDataPtr, extName, "maestro.setBeginState()", "begin"); 
    free( extName );
 }
 
@@ -794,7 +927,7 @@ static void processContainerBegin ( const SeqNodeDataPtr _nodeDataPtr, char *_fl
           while(  siblingIteratorPtr != NULL && abortedSibling == 0 ) {
              memset( filename, '\0', sizeof filename );
              sprintf(filename,"%s/%s/%s/%s%s.abort.stop", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->container, siblingIteratorPtr->data, extWrite);
-             abortedSibling = _isFileExists( filename, "processContainerBegin()", _nodeDataPtr->expHome);
+             abortedSibling = isStatusFileExists( filename, "processContainerBegin()", _nodeDataPtr->expHome);
              if ( abortedSibling ) {
              /* check if it's a discretionary or catchup higher than job's value, bypass if yes */
                  memset( tmp, '\0', sizeof tmp );
@@ -934,9 +1067,6 @@ static int setEndState(const char* _signal, const SeqNodeDataPtr _nodeDataPtr) {
       nodeend( _signal, _nodeDataPtr, _nodeDataPtr->datestamp );
    }
 
-   /* clear any other state */
-   clearAllOtherStates( _nodeDataPtr, extName, "maestro.setEndState()", "end"); 
-
    /* Obtain a lock to protect end state */ 
    ret=_lock( filename , _nodeDataPtr->datestamp, _nodeDataPtr->expHome ); 
    /* ADD TIME GIVEN BY THE SERVER */ 
@@ -954,8 +1084,8 @@ static int setEndState(const char* _signal, const SeqNodeDataPtr _nodeDataPtr) {
              fprintf(stderr,"\nThis Task has Ended the CONTAINER :%s\n",filename);
     }
 
-   /* create the node end lock file name if not exists*/
-   _CreateLockFile( MLLServerConnectionFid , filename , "go_end() ", _nodeDataPtr->expHome);
+   /* clear any other state, create the node end lock file name if not exists*/
+   setNodeState( _nodeDataPtr, extName, "maestro.setEndState()", "end"); 
 
    if ( _nodeDataPtr->type == NpassTask && _nodeDataPtr->isLastArg ) {
       /*container arguments*/
@@ -974,6 +1104,7 @@ static int setEndState(const char* _signal, const SeqNodeDataPtr _nodeDataPtr) {
 
        /* create the ^last node end lock file name if not exists*/
       _CreateLockFile( MLLServerConnectionFid , filename1 , "go_end() ", _nodeDataPtr->expHome);
+      SeqStatusSnapshot_invalidate();
 
    }
 
@@ -990,67 +1121,40 @@ static int setEndState(const char* _signal, const SeqNodeDataPtr _nodeDataPtr) {
 }
 
 /* 
-clearAllOtherStates
+setNodeState
 
-Clears all the states files except current one.
+Puts the node in a new state: clears all the states files except the new one then
+creates it if not exists. Through mserver the whole transition is a single request.
 
 Inputs:
-  fullNodeName - pointer to the node's full name (i.e. /testsuite/assimilation/00/randomjob )
+  fullNodeName - pointer to the node's full name with its extension (i.e. /testsuite/assimilation/00/randomjob.+1 )
   originator - pointer to the name of the originating function that called this
+  state - begin, end, submit, waiting, abort.<action>, or init which only clears
 
 */
 
+static void setNodeState (const SeqNodeDataPtr _nodeDataPtr, const char * fullNodeName, const char * originator, const char* state ) {
 
-static void clearAllOtherStates (const SeqNodeDataPtr _nodeDataPtr, char * fullNodeName, char * originator, char* current_state ) {
-
-   int ret;
-   char filename[SEQ_MAXFIELD];
+   char request[SEQ_MAXFIELD], removed[SEQ_MAXFIELD];
+   const char *ext = NULL;
    char *extension = NULL, *tmpExt = NULL;
    SeqNameValuesPtr newArgs = NULL; 
+   SeqLoopSpacePtr loopSpace = NULL;
 
-   memset(filename,'\0',sizeof filename);
-   SeqUtil_TRACE(TL_FULL_TRACE, "maestro.clearAllOtherStates() originator=%s node=%s\n", originator, fullNodeName);
-
-   /* remove the node begin lock file */
-   sprintf(filename,"%s/%s/%s.begin",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, fullNodeName); 
-   if ( _access(filename, R_OK, _nodeDataPtr->expHome) == 0 && strcmp( current_state, "begin" ) != 0 ) {
-      SeqUtil_TRACE(TL_FULL_TRACE, "maestro.maestro.clearAllOtherStates() %s removed lockfile %s\n", originator, filename);
-      ret=_removeFile(filename, _nodeDataPtr->expHome);
-   }
-   memset(filename,'\0',sizeof filename);
-   sprintf(filename,"%s/%s/%s.end",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, fullNodeName); 
-   if ( _access(filename, R_OK, _nodeDataPtr->expHome) == 0 && strcmp( current_state, "end" ) != 0 ) {
-      SeqUtil_TRACE(TL_FULL_TRACE, "maestro.clearAllOtherStates() %s removed lockfile %s\n", originator, filename);
-      ret=_removeFile(filename, _nodeDataPtr->expHome);
-   }
-
-   memset(filename,'\0',sizeof filename);
-   sprintf(filename,"%s/%s/%s.abort.stop",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, fullNodeName); 
-   if ( _access(filename, R_OK, _nodeDataPtr->expHome) == 0 && strcmp( current_state, "stop" ) != 0 ) {
-      SeqUtil_TRACE(TL_FULL_TRACE, "maestro.clearAllOtherStates() %s removed lockfile %s\n", originator, filename);
-      ret=_removeFile(filename, _nodeDataPtr->expHome);
-   }
+   SeqUtil_TRACE(TL_FULL_TRACE, "maestro.setNodeState() originator=%s node=%s state=%s\n", originator, fullNodeName, state);
 
-   memset(filename,'\0',sizeof filename);
-   /* Notice that clearing submit will cause a concurrency vs NFS problem when we add dependency */
-   sprintf(filename,"%s/%s/%s.submit",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, fullNodeName); 
-   if ( _access(filename, R_OK, _nodeDataPtr->expHome) == 0 && strcmp( current_state, "submit" ) != 0 ) {
-      SeqUtil_TRACE(TL_FULL_TRACE, "maestro.clearAllOtherStates() %s removed lockfile %s\n", originator, filename);
-      ret=_removeFile(filename, _nodeDataPtr->expHome);
-   }
+   /* the extension is what follows the node name in its full name */
+   ext = fullNodeName + strlen( _nodeDataPtr->name );
+   if ( *ext == '.' ) ext++;
 
-   memset(filename,'\0',sizeof filename);
-   sprintf(filename,"%s/%s/%s.waiting",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, fullNodeName); 
-   if ( _access(filename, R_OK, _nodeDataPtr->expHome) == 0 && strcmp( current_state, "waiting" ) != 0 ) {
-      SeqUtil_TRACE(TL_FULL_TRACE, "maestro.clearAllOtherStates() %s removed lockfile %s\n", originator, filename);
-      ret=_removeFile(filename, _nodeDataPtr->expHome);
-   }
+   memset(request,'\0',sizeof request);
+   sprintf(request,"exp=%s datestamp=%s node=%s ext=%s state=%s", _nodeDataPtr->expHome, _nodeDataPtr->datestamp, _nodeDataPtr->name, ext, state); 
 
    /* NPASS(i) will delete NPASS.end in all states */
 
    if (_nodeDataPtr->type == NpassTask) {
        if((char*) SeqLoops_getLoopAttribute( _nodeDataPtr->loop_args, _nodeDataPtr->nodeName ) != NULL) {
-            SeqUtil_TRACE(TL_FULL_TRACE, "maestro.clearAllOtherStates() NPASS(i) deleting NPASS.end \n", originator, filename);
+            SeqUtil_TRACE(TL_FULL_TRACE, "maestro.setNodeState() %s NPASS(i) deleting NPASS.end \n", originator);
             newArgs = SeqNameValues_clone(_nodeDataPtr->loop_args);
             SeqNameValues_deleteItem(&newArgs, _nodeDataPtr->nodeName );
             tmpExt = (char *) SeqLoops_getExtFromLoopArgs(newArgs); 
@@ -1060,35 +1164,29 @@ static void clearAllOtherStates (const SeqNodeDataPtr _nodeDataPtr, char * fullN
             } else {
                 SeqUtil_stringAppend( &extension, "" );
             }
-
-            memset(filename,'\0',sizeof filename);
-            sprintf(filename,"%s/%s/%s%s.end",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension); 
-            if ( _access(filename, R_OK, _nodeDataPtr->expHome) == 0 && strcmp( current_state, "end" ) != 0 ) {
-                SeqUtil_TRACE(TL_FULL_TRACE, "maestro.clearAllOtherStates() %s removed lockfile %s\n", originator, filename);
-                ret=_removeFile(filename, _nodeDataPtr->expHome);
-            } 
+            sprintf(request + strlen(request)," npass=%s", extension); 
             SeqNameValues_deleteWholeList(&newArgs); 
             free( extension);
             free( tmpExt);
         }
    }
 
-   /* delete abort intermediate states only in init, abort or end */
-   if ( strcmp( current_state, "init" ) == 0 || strcmp( current_state, "end" ) == 0 ||
-        strcmp( current_state, "stop" ) == 0 ) {
-      memset(filename,'\0',sizeof filename);
-      sprintf(filename,"%s/%s/%s.abort.rerun",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, fullNodeName); 
-      if ( _access(filename, R_OK, _nodeDataPtr->expHome) == 0 && strcmp( current_state, "rerun" ) != 0 ) {
-         SeqUtil_TRACE(TL_FULL_TRACE, "maestro.clearAllOtherStates() %s removed lockfile %s\n", originator, filename);
-         ret=_removeFile(filename, _nodeDataPtr->expHome);
-      }
+   memset(removed,'\0',sizeof removed);
+   if ( _setNodeState(request, removed, sizeof removed, _nodeDataPtr->expHome) != 0 ) {
+      fprintf(stderr,"%s could not set state %s of node %s\n", originator, state, fullNodeName);
+   }
+   SeqStatusSnapshot_invalidate();
+   SeqUtil_TRACE(TL_FULL_TRACE, "maestro.setNodeState() %s removed lockfiles:%s\n", originator, removed);
 
-      memset(filename,'\0',sizeof filename);
-      sprintf(filename,"%s/%s/%s.abort.cont",_nodeDataPtr->workdir,  _nodeDataPtr->datestamp, fullNodeName); 
-      if ( _access(filename, R_OK, _nodeDataPtr->expHome) == 0 && strcmp( current_state, "cont" ) != 0 ) {
-         SeqUtil_TRACE(TL_FULL_TRACE, "maestro.clearAllOtherStates() %s removed lockfile %s\n", originator, filename);
-         ret=_removeFile(filename, _nodeDataPtr->expHome);
+   /* the iteration of a loop instance goes in the loop map in the same step, also with
+      SEQ_LOOP_MAP=no so that a map left there stays right */
+   if ( _nodeDataPtr->type == Loop && hasArgs(_nodeDataPtr) ) {
+      loopSpace = SeqLoops_childSpace( _nodeDataPtr );
+      loopMapPath( _nodeDataPtr, loopSpace, request, sizeof request );
+      if ( SeqLoopMap_set( request, loopSpace, ext, SeqLoopMap_stateFlags(state) ) != 0 ) {
+         fprintf(stderr,"%s could not update the loop map %s\n", originator, request);
       }
+      SeqLoops_freeSpace( loopSpace );
    }
 }
 
@@ -1106,26 +1204,36 @@ Inputs:
 static int isLoopComplete ( const SeqNodeDataPtr _nodeDataPtr ) {
    char endfile[SEQ_MAXFIELD];
    char continuefile[SEQ_MAXFIELD];
-   LISTNODEPTR extensions = NULL;
+   char extension[SEQ_MAXFIELD];
+   SeqLoopSpacePtr loopSpace = NULL;
+   SeqLoopIterator iterator;
+   unsigned long done = 0, aborted = 0;
    int undoneIteration = 0;
 
    memset( endfile, '\0', sizeof endfile );
    memset( continuefile, '\0', sizeof continuefile );
 
-   /* check if the loop is completed */
-   extensions = (LISTNODEPTR) SeqLoops_childExtensionsInReverse( _nodeDataPtr );
-   if( extensions != NULL ) {
-      while( extensions != NULL && undoneIteration == 0 ) {
-         sprintf(endfile,"%s/%s/%s.%s.end", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extensions->data);
-         sprintf(continuefile,"%s/%s/%s.%s.abort.cont", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extensions->data);
-         SeqUtil_TRACE(TL_FULL_TRACE, "maestro.isLoopComplete() loop done? checking for:%s or %s\n", endfile, continuefile);
-         undoneIteration = ! ( _isFileExists( endfile,      "isLoopComplete()" , _nodeDataPtr->expHome) || 
-                               _isFileExists( continuefile, "isLoopComplete()" , _nodeDataPtr->expHome) ) ;
-         extensions = extensions->nextPtr;
+   loopSpace = SeqLoops_childSpace( _nodeDataPtr );
+   if ( loopMapCounts( _nodeDataPtr, loopSpace, &done, &aborted ) == 0 ) {
+      undoneIteration = done != loopSpace->count;
+      SeqLoops_freeSpace( loopSpace );
+      SeqUtil_TRACE(TL_FULL_TRACE, "maestro.isLoopComplete() loop map done=%lu return value=%d\n", done, (! undoneIteration) );
+      return ! undoneIteration;
+   }
+
+   /* check if the loop is completed, last iteration first */
+   SeqLoops_iteratorInit( &iterator, loopSpace, 1 );
+   while( undoneIteration == 0 && SeqLoops_iteratorNext( &iterator, extension, sizeof extension ) ) {
+      if ( snprintf(endfile, sizeof endfile, "%s/%s/%s.%s.end", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension) >= (int) sizeof endfile ||
+           snprintf(continuefile, sizeof continuefile, "%s/%s/%s.%s.abort.cont", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension) >= (int) sizeof continuefile ) {
+         raiseError( "maestro.isLoopComplete() status file path too long for %s.%s\n", _nodeDataPtr->name, extension );
       }
+      SeqUtil_TRACE(TL_FULL_TRACE, "maestro.isLoopComplete() loop done? checking for:%s or %s\n", endfile, continuefile);
+      undoneIteration = ! ( isStatusFileExists( endfile,      "isLoopComplete()" , _nodeDataPtr->expHome) || 
+                            isStatusFileExists( continuefile, "isLoopComplete()" , _nodeDataPtr->expHome) ) ;
    }
 
-   SeqListNode_deleteWholeList(&extensions);
+   SeqLoops_freeSpace( loopSpace );
    SeqUtil_TRACE(TL_FULL_TRACE, "maestro.isLoopComplete() return value=%d\n", (! undoneIteration) );
    return ! undoneIteration;
 }
@@ -1143,21 +1251,30 @@ Inputs:
 
 static int isLoopAborted ( const SeqNodeDataPtr _nodeDataPtr ) {
    char abortedfile[SEQ_MAXFIELD];
-   LISTNODEPTR extensions = NULL;
+   char extension[SEQ_MAXFIELD];
+   SeqLoopSpacePtr loopSpace = NULL;
+   SeqLoopIterator iterator;
+   unsigned long done = 0, aborted = 0;
    int abortedIteration = 0;
 
+   loopSpace = SeqLoops_childSpace( _nodeDataPtr );
+   if ( loopMapCounts( _nodeDataPtr, loopSpace, &done, &aborted ) == 0 ) {
+      SeqLoops_freeSpace( loopSpace );
+      SeqUtil_TRACE(TL_FULL_TRACE, "maestro.isLoopAborted() loop map aborted=%lu return value=%d\n", aborted, aborted > 0 );
+      return aborted > 0;
+   }
+
    /* check if the loop is completed */
-   extensions = (LISTNODEPTR) SeqLoops_childExtensionsInReverse( _nodeDataPtr );
-   if( extensions != NULL ) {
-      while( extensions != NULL && abortedIteration == 0 ) {
-         memset( abortedfile, '\0', sizeof abortedfile );
-         sprintf(abortedfile,"%s/%s/%s.%s.abort.stop", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extensions->data);
-         SeqUtil_TRACE(TL_FULL_TRACE, "maestro.isLoopAborted() loop has aborted iteration? checking for:%s\n", abortedfile);
-         abortedIteration =  _isFileExists( abortedfile, "isLoopAborted()" , _nodeDataPtr->expHome) ;
-         extensions = extensions->nextPtr;
+   SeqLoops_iteratorInit( &iterator, loopSpace, 1 );
+   while( abortedIteration == 0 && SeqLoops_iteratorNext( &iterator, extension, sizeof extension ) ) {
+      memset( abortedfile, '\0', sizeof abortedfile );
+      if ( snprintf(abortedfile, sizeof abortedfile, "%s/%s/%s.%s.abort.stop", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension) >= (int) sizeof abortedfile ) {
+         raiseError( "maestro.isLoopAborted() status file path too long for %s.%s\n", _nodeDataPtr->name, extension );
       }
+      SeqUtil_TRACE(TL_FULL_TRACE, "maestro.isLoopAborted() loop has aborted iteration? checking for:%s\n", abortedfile);
+      abortedIteration =  isStatusFileExists( abortedfile, "isLoopAborted()" , _nodeDataPtr->expHome) ;
    }
-   SeqListNode_deleteWholeList(&extensions);
+   SeqLoops_freeSpace( loopSpace );
    SeqUtil_TRACE(TL_FULL_TRACE, "maestro.isLoopAborted() return value=%d\n", abortedIteration );
    return abortedIteration;
 }
@@ -1186,6 +1303,17 @@ static int isNpassComplete ( const SeqNodeDataPtr _nodeDataPtr ) {
    } 
    SeqUtil_stringAppend( &extension,"+"); 
  
+   /* serverless mode: the last end and the states of all the iterations from one read of the directory */
+   memset( statePattern, '\0', sizeof statePattern );
+   sprintf( statePattern,"%s/%s/%s.%s",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension);
+   if ( StatusSnapshotMode && (undoneIteration = SeqStatusSnapshot_count( statePattern, SEQ_SNAP_SUBMIT|SEQ_SNAP_BEGIN|SEQ_SNAP_ABORTSTOP )) >= 0 ) {
+      strcat( statePattern, "last.end" );
+      undoneIteration = undoneIteration > 0 || SeqStatusSnapshot_exists( statePattern ) == 0;
+      SeqUtil_TRACE(TL_FULL_TRACE,"maestro.isNpassComplete - status snapshot undone=%d\n", undoneIteration);
+      free(extension);
+      SeqNameValues_deleteWholeList( &containerLoopArgsList);
+      return ! undoneIteration;
+   }
 
    memset( statePattern, '\0', sizeof statePattern );
    sprintf( statePattern,"%s/%s/%s.%slast.end",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension);
@@ -1249,8 +1377,11 @@ static int isNpassAborted ( const SeqNodeDataPtr _nodeDataPtr ) {
 
    /* search for abort.stop states. */
    memset( statePattern, '\0', sizeof statePattern );
-   sprintf( statePattern,"%s/%s/%s.%s*.abort.stop",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension);
-   abortedIteration = _globPath(statePattern, GLOB_NOSORT,0,_nodeDataPtr->expHome);
+   sprintf( statePattern,"%s/%s/%s.%s",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->name, extension);
+   if ( ! StatusSnapshotMode || (abortedIteration = SeqStatusSnapshot_count( statePattern, SEQ_SNAP_ABORTSTOP )) < 0 ) {
+      strcat( statePattern, "*.abort.stop" );
+      abortedIteration = _globPath(statePattern, GLOB_NOSORT,0,_nodeDataPtr->expHome);
+   }
    if (abortedIteration) SeqUtil_TRACE(TL_FULL_TRACE,"maestro.isNpassAborted - found abort.stop\n");
 
    free(extension);
@@ -1544,8 +1675,8 @@ static void processContainerEnd ( const SeqNodeDataPtr _nodeDataPtr, char *_flow
              memset( continuefile, '\0', sizeof continuefile );
              sprintf(endfile,"%s/%s/%s/%s%s.end", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->container, siblingIteratorPtr->data, extWrite);
              sprintf(continuefile,"%s/%s/%s/%s%s.abort.cont", _nodeDataPtr->workdir, _nodeDataPtr->datestamp, _nodeDataPtr->container, siblingIteratorPtr->data, extWrite);
-             undoneChild = ! (_isFileExists( endfile,      "processContainerEnd()", _nodeDataPtr->expHome) || 
-                              _isFileExists( continuefile, "processContainerEnd()", _nodeDataPtr->expHome)    );
+             undoneChild = ! (isStatusFileExists( endfile,      "processContainerEnd()", _nodeDataPtr->expHome) || 
+                              isStatusFileExists( continuefile, "processContainerEnd()", _nodeDataPtr->expHome)    );
              if ( undoneChild ) {
              /* check if it's a discretionary or catchup higher than job's value, bypass if yes */
                  memset( tmp, '\0', sizeof tmp );
@@ -1585,6 +1716,272 @@ static void processContainerEnd ( const SeqNodeDataPtr _nodeDataPtr, char *_flow
    free( extWrite );
 }
 
+/********************************************************************************
+ * DOCUMENTATION: Inner workings.
+ * The submit tool and nodetracer are started with posix_spawnp() on the words
+ * of their command line (split on blanks, quotes removed, no other shell
+ * expansion), the output of the tool going to the submission file.  Up to
+ * SEQ_SUBMIT_INFLIGHT of them run while maestro goes on; the oldest is waited
+ * for when there are as many, and the top level maestro() call waits for all
+ * of them before it returns.  The end of a submission does what go_submit()
+ * did after system(): the tar of a work unit is made ready and nodetracer
+ * gets the output.  A failed submission is the return status of maestro(), as
+ * when it was waited for, and a message in the log of the node.
+ * With SEQ_SUBMIT_INFLIGHT=1 go_submit() waits for each submission and
+ * returns its status.
+********************************************************************************/
+
+/* a submission (or nodetracer call) running */
+typedef struct {
+   pid_t pid;
+   int   container;     /* the status of a container is its wait status, as system() returned */
+   int   tracer;        /* nodetracer of a submission */
+   char *node, *extension, *datestamp, *expHome, *loopArgs, *output;
+   char *tarFile, *movedTarFile, *readyFile;   /* work unit only */
+} Submission;
+
+static Submission *Submissions = NULL;
+static int SubmissionCount = 0, SubmissionSize = 0;
+
+/* the words of command in argv (at most size-1 of them, NULL terminated), command is modified */
+static void submission_argv( char *command, char **argv, int size )
+{
+   char *from = command, *to = command, quote;
+   int argc = 0;
+
+   while ( argc < size - 1 ) {
+      while ( *from == ' ' || *from == '\t' ) from++;
+      if ( *from == '\0' ) break;
+      argv[argc++] = to;
+      while ( *from != '\0' && *from != ' ' && *from != '\t' ) {
+         if ( *from == '"' || *from == '\'' ) {
+            for ( quote = *from++; *from != '\0' && *from != quote; ) *to++ = *from++;
+            if ( *from != '\0' ) from++;
+         } else {
+            *to++ = *from++;
+         }
+      }
+      if ( *from != '\0' ) from++;
+      *to++ = '\0';
+   }
+   argv[argc] = NULL;
+}
+
+/* starts command with its stdout and stderr in output (if not NULL), returns its pid, -1 if it cannot start */
+static pid_t submission_spawn( const char *command, const char *output )
+{
+   extern char **environ;
+   posix_spawn_file_actions_t actions;
+   char *words = NULL, *argv[256];
+   pid_t pid = -1;
+   int ret;
+
+   if ( (words = strdup(command)) == NULL ) raiseError("maestro malloc: Out of memory!\n");
+   submission_argv( words, argv, sizeof(argv) / sizeof(argv[0]) );
+   posix_spawn_file_actions_init( &actions );
+   if ( output != NULL ) {
+      posix_spawn_file_actions_addopen( &actions, STDOUT_FILENO, output, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+      posix_spawn_file_actions_adddup2( &actions, STDOUT_FILENO, STDERR_FILENO );
+   }
+   fflush(NULL);
+   if ( argv[0] == NULL || (ret = posix_spawnp( &pid, argv[0], &actions, NULL, argv, environ )) != 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "maestro cannot start %s: %s\n", argv[0] != NULL ? argv[0] : "(empty command)",
+                    argv[0] != NULL ? strerror(ret) : "");
+      pid = -1;
+   }
+   posix_spawn_file_actions_destroy( &actions );
+   free( words );
+   return pid;
+}
+
+static void submission_free( Submission *submission )
+{
+   free( submission->node );
+   free( submission->extension );
+   free( submission->datestamp );
+   free( submission->expHome );
+   free( submission->loopArgs );
+   free( submission->output );
+   free( submission->tarFile );
+   free( submission->movedTarFile );
+   free( submission->readyFile );
+}
+
+/* a copy of str, NULL if str is NULL */
+static char *submission_strdup( const char *str )
+{
+   char *copy = NULL;
+
+   if ( str != NULL && (copy = strdup(str)) == NULL ) raiseError("maestro malloc: Out of memory!\n");
+   return copy;
+}
+
+/* adds a running submission (its strings are kept) */
+static void submissions_add( Submission *submission )
+{
+   if ( SubmissionCount == SubmissionSize ) {
+      SubmissionSize = SubmissionSize ? 2 * SubmissionSize : 16;
+      if ( (Submissions = realloc( Submissions, SubmissionSize * sizeof(Submission) )) == NULL ) {
+         raiseError("maestro malloc: Out of memory!\n");
+      }
+   }
+   Submissions[SubmissionCount++] = *submission;
+}
+
+/* 
+submission_ended
+
+ What follows the end of a submission: the tar of a work unit is made ready and nodetracer is started on
+ its output.  waitStatus is the status given by waitpid().
+ returns the status of the submission (of nodetracer for a nodetracer call)
+
+*/
+static int submission_ended( Submission *submission, int waitStatus )
+{
+   Submission tracer;
+   char nodetracercmd[SEQ_MAXFIELD];
+   int status;
+
+   if ( submission->container ) {
+      status = waitStatus;
+   } else {
+      status = WIFEXITED(waitStatus) ? WEXITSTATUS(waitStatus) : 1;
+   }
+   if ( submission->tracer ) {
+      if ( status ) {
+         SeqUtil_TRACE(TL_CRITICAL,"Problem with nodetracer call, listing may not be available in the listings directory, possibly in $SEQ_EXP_HOME/sequencing/output.\n");
+      }
+      return status;
+   }
+
+   SeqUtil_TRACE(TL_FULL_TRACE,"maestro.go_submit() ord return status: %d \n",status);
+   if ( submission->readyFile != NULL ) {
+      rename(submission->movedTarFile,submission->tarFile);
+      SeqUtil_TRACE(TL_FULL_TRACE,"maestro.go_submit() moving temporary tar file %s to %s \n", submission->movedTarFile, submission->tarFile); 
+      _touch(submission->readyFile, submission->expHome);
+   }
+
+   if ( strlen( submission->loopArgs ) > 0 ) {
+      snprintf(nodetracercmd, sizeof(nodetracercmd), "%s/nodetracer -n %s -l %s -d %s -e %s -type submission -i %s -c", getenv("SEQ_UTILS_BIN"), submission->node, submission->loopArgs, submission->datestamp, submission->expHome, submission->output);
+   } else {
+      snprintf(nodetracercmd, sizeof(nodetracercmd), "%s/nodetracer -n %s -d %s -e %s -type submission -i %s -c", getenv("SEQ_UTILS_BIN"), submission->node, submission->datestamp, submission->expHome, submission->output);
+   }
+   memset( &tracer, 0, sizeof(tracer) );
+   tracer.tracer = 1;
+   tracer.node = submission_strdup( submission->node );
+   if ( (tracer.pid = submission_spawn( nodetracercmd, NULL )) < 0 ) {
+      submission_ended( &tracer, 127 << 8 );
+      submission_free( &tracer );
+   } else {
+      submissions_add( &tracer );
+   }
+
+   if ( status != 0 && SubmitInFlight > 1 ) {
+      snprintf(nodetracercmd, sizeof(nodetracercmd), "Submission failed with status %d, see %s", status, submission->output);
+      nodelogger( submission->node, "info", submission->extension, nodetracercmd, submission->datestamp, submission->expHome );
+   }
+   return status;
+}
+
+/* removes the submission at index, whose process is done, returns its status */
+static int submission_reap( int index, int waitStatus )
+{
+   Submission submission = Submissions[index];
+   int status;
+
+   memmove( &Submissions[index], &Submissions[index + 1], (SubmissionCount - index - 1) * sizeof(Submission) );
+   SubmissionCount--;
+   status = submission_ended( &submission, waitStatus );
+   if ( submission.tracer ) status = 0;
+   submission_free( &submission );
+   return status;
+}
+
+/* 
+submissions_wait
+
+ Waits until at most keep submissions run, the oldest first; the ones already done are removed first.
+ returns the status of the first submission that failed, 0 if none
+
+*/
+static int submissions_wait( int keep )
+{
+   int i, waitStatus, status, failed = 0;
+   pid_t pid;
+
+   for ( i = 0; i < SubmissionCount; ) {
+      if ( (pid = waitpid( Submissions[i].pid, &waitStatus, WNOHANG )) == Submissions[i].pid ) {
+         if ( (status = submission_reap( i, waitStatus )) != 0 && failed == 0 ) failed = status;
+      } else {
+         i++;
+      }
+   }
+   while ( SubmissionCount > keep ) {
+      while ( (pid = waitpid( Submissions[0].pid, &waitStatus, 0 )) < 0 && errno == EINTR );
+      if ( pid < 0 ) {
+         SeqUtil_TRACE(TL_ERROR, "maestro cannot wait for the submission of %s\n", Submissions[0].node);
+         waitStatus = 1 << 8;
+      }
+      if ( (status = submission_reap( 0, waitStatus )) != 0 && failed == 0 ) failed = status;
+   }
+   return failed;
+}
+
+/* the end of process pid, reaped by someone else; returns 1 if it was a submission */
+static int submissions_reaped( pid_t pid, int waitStatus )
+{
+   int i;
+
+   for ( i = 0; i < SubmissionCount; i++ ) {
+      if ( Submissions[i].pid == pid ) {
+         submission_reap( i, waitStatus );
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/* 
+submission_start
+
+ Starts the submit tool with command, its output going to output; the submission is added to the running
+ ones, the oldest being waited for if there are SEQ_SUBMIT_INFLIGHT of them.
+ returns 0, the status of the submission with SEQ_SUBMIT_INFLIGHT=1 or if it cannot start
+
+*/
+static int submission_start( const SeqNodeDataPtr _nodeDataPtr, const char *command, const char *output,
+                             const char *loopArgs, int container, const char *tarFile, const char *movedTarFile, const char *readyFile )
+{
+   Submission submission;
+   int status = 0;
+
+   memset( &submission, 0, sizeof(submission) );
+   submission.container = container;
+   submission.node = submission_strdup( _nodeDataPtr->name );
+   submission.extension = submission_strdup( _nodeDataPtr->extension );
+   submission.datestamp = submission_strdup( _nodeDataPtr->datestamp );
+   submission.expHome = submission_strdup( _nodeDataPtr->expHome );
+   submission.loopArgs = submission_strdup( loopArgs );
+   submission.output = submission_strdup( output );
+   if ( readyFile != NULL ) {
+      submission.tarFile = submission_strdup( tarFile );
+      submission.movedTarFile = submission_strdup( movedTarFile );
+      submission.readyFile = submission_strdup( readyFile );
+   }
+
+   submissions_wait( SubmitInFlight - 1 );
+   if ( (submission.pid = submission_spawn( command, output )) < 0 ) {
+      /* as the shell when it cannot run the command */
+      status = submission_ended( &submission, 127 << 8 );
+      submission_free( &submission );
+      return status;
+   }
+   SeqUtil_TRACE(TL_FULL_TRACE, "maestro.go_submit() submission of %s pid %d\n", _nodeDataPtr->name, (int) submission.pid);
+   submissions_add( &submission );
+   if ( SubmitInFlight <= 1 ) status = submissions_wait( 0 );
+   return status;
+}
+
 /*
 go_submit
 
@@ -1596,20 +1993,20 @@ Inputs:
   _nodeDataPtr - pointer to the node targetted by the execution
   ignoreAllDeps - integer representing True or False whether dependencies are ignored
 
-Returns the error status of the ord_soumet call.
+Returns the error status of the ord_soumet call, 0 if it still runs (see submission_start()).
 
 */
 
 static int go_submit(const char *_signal, char *_flow , const SeqNodeDataPtr _nodeDataPtr, int ignoreAllDeps ) {
    char tmpfile[SEQ_MAXFIELD], noendwrap[12],immediateMode[11], nodeFullPath[SEQ_MAXFIELD], workerEndFile[SEQ_MAXFIELD], workerAbortFile[SEQ_MAXFIELD], submissionDir[SEQ_MAXFIELD];
-   char listingDir[SEQ_MAXFIELD], defFile[SEQ_MAXFIELD], nodetracercmd[SEQ_MAXFIELD];
+   char listingDir[SEQ_MAXFIELD], defFile[SEQ_MAXFIELD];
    char cmd[SEQ_MAXFIELD];
    char pidbuf[100];
    char *cpu = NULL, *tmpdir=NULL;
    char *tmpCfgFile = NULL, *tmpTarPath=NULL, *tarFile=NULL, *movedTmpName=NULL, *movedTarFile=NULL, *readyFile=NULL, *prefix=NULL, *jobName=NULL, *workq=NULL;
    char *loopArgs = NULL, *extName = NULL, *fullExtName = NULL, *containerMethod = NULL;
    int catchup = CatchupNormal;
-   int error_status = 0, nodetracer_status=0, ret;
+   int error_status = 0, ret;
    SeqNodeDataPtr workerDataPtr = NULL;
    char mpi_flag[5];
 
@@ -1800,17 +2197,9 @@ static int go_submit(const char *_signal, char *_flow , const SeqNodeDataPtr _no
          }
 
          SeqUtil_TRACE(TL_FULL_TRACE,"Temporarily sending submission output to %s\n", submissionDir );
-         strcat(cmd, " > \""); strcat (cmd, submissionDir); strcat (cmd, "\" 2>&1");
-         fprintf(stderr,"Task type node submit command: %s\n", cmd );
-         error_status = system(cmd);
-         error_status = WEXITSTATUS(error_status);
-
-         SeqUtil_TRACE(TL_FULL_TRACE,"maestro.go_submit() ord return status: %d \n",error_status);
-         if (strcmp(_nodeDataPtr->workerPath, "") != 0) {
-	         rename(movedTarFile,tarFile);
-	         SeqUtil_TRACE(TL_FULL_TRACE,"maestro.go_submit() moving temporary tar file %s to %s \n", movedTarFile, tarFile); 
-	         _touch(readyFile, _nodeDataPtr->expHome);
-	      }
+         fprintf(stderr,"Task type node submit command: %s > \"%s\" 2>&1\n", cmd, submissionDir );
+         /* the tar of a work unit is made ready when the submission is done */
+         error_status = submission_start( _nodeDataPtr, cmd, submissionDir, loopArgs, 0, tarFile, movedTarFile, readyFile );
 
 	 /* 
 	    remove  *waiting.interUser* file if ignore dependency.
@@ -1864,21 +2253,10 @@ static int go_submit(const char *_signal, char *_flow , const SeqNodeDataPtr _no
 	         snprintf(cmd,sizeof(cmd),"%s %s -sys maestro_%s -jobfile %s -node %s -jn %s -d %s -q %s %s -c %s -shell %s -m %s -w %d -v -listing %s -wrapdir %s/sequencing -immediate %s -jobcfg %s -altcfgdir %s -args \"%s\" %s",submit_tool,workq , getenv("SEQ_MAESTRO_VERSION"), tmpfile,_nodeDataPtr->name, jobName, getenv("TRUE_HOST"), _nodeDataPtr->queue,mpi_flag,cpu,_nodeDataPtr->shell,_nodeDataPtr->memory,_nodeDataPtr->wallclock, listingDir, _nodeDataPtr->expHome, noendwrap, tmpCfgFile, getenv("SEQ_BIN"),  _nodeDataPtr->args,_nodeDataPtr->soumetArgs);
 
          }
-         strcat(cmd, " > \""); strcat (cmd, submissionDir); strcat (cmd, "\" 2>&1");
-         fprintf(stderr,"Container submit command: %s\n", cmd );
-         error_status=system(cmd);
-
-         SeqUtil_TRACE(TL_FULL_TRACE,"maestro.go_submit() ord return status: %d \n",error_status);
-      }
-      if ( strlen( loopArgs ) > 0 ) {
-         sprintf(nodetracercmd, "%s/nodetracer -n %s -l %s -d %s -e %s -type submission -i %s -c", getenv("SEQ_UTILS_BIN"), _nodeDataPtr->name, loopArgs, _nodeDataPtr->datestamp, _nodeDataPtr->expHome, submissionDir);
-      } else {
-         sprintf(nodetracercmd, "%s/nodetracer -n %s -d %s -e %s -type submission -i %s -c", getenv("SEQ_UTILS_BIN"), _nodeDataPtr->name, _nodeDataPtr->datestamp, _nodeDataPtr->expHome, submissionDir);
-      }
-      nodetracer_status = system(nodetracercmd);
-      if ( nodetracer_status ) {
-         SeqUtil_TRACE(TL_CRITICAL,"Problem with nodetracer call, listing may not be available in the listings directory, possibly in $SEQ_EXP_HOME/sequencing/output.\n");
+         fprintf(stderr,"Container submit command: %s > \"%s\" 2>&1\n", cmd, submissionDir );
+         error_status = submission_start( _nodeDataPtr, cmd, submissionDir, loopArgs, 1, NULL, NULL, NULL );
       }
+      /* nodetracer gets the output of the submission when it is done (submission_ended()) */
    }
 
    actionsEnd( (char*) _signal, _flow, _nodeDataPtr->name );
@@ -1916,21 +2294,58 @@ static void setSubmitState(const SeqNodeDataPtr _nodeDataPtr) {
    /* Notice that clearing submit will cause a concurrency vs NFS problem when we add dependency */
 
    char *extName = NULL ;
-   char filename[SEQ_MAXFIELD];
 
    extName =(char *) SeqNode_extension( _nodeDataPtr );      
 
-   /* clear any other state */
-   clearAllOtherStates( _nodeDataPtr, extName, "maestro.setSubmitState()", "submit" ); 
+   /* clear any other state and create the node submit lock file */
+   setNodeState( _nodeDataPtr, extName, "maestro.setSubmitState()", "submit" ); 
 
-   memset(filename,'\0',sizeof filename);
-   sprintf(filename,"%s/%s/%s.submit",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, extName); 
+   free( extName );
+}
 
-   /* create the node end lock file */
+/*
+submitRateLimit
 
-   _CreateLockFile(MLLServerConnectionFid , filename , "setSubmitState() ", _nodeDataPtr->expHome);
+Reads the submission rate limit of an experiment, SEQ_SUBMIT_RATE (submissions
+per second, 0 for none) and SEQ_SUBMIT_BURST of resources.def, see SeqRateLimit.h.
 
-   free( extName );
+Inputs:
+  _nodeDataPtr - pointer to the node submitting
+  bucket - set to the bucket file of the experiment, SEQ_MAXFIELD bytes
+  rate, burst - set to the limit
+*/
+static void submitRateLimit( const SeqNodeDataPtr _nodeDataPtr, char *bucket, double *rate, double *burst ) {
+   char defFile[SEQ_MAXFIELD];
+   char *value = NULL;
+
+   *rate = SEQ_RATE_DEFAULT;
+   *burst = SEQ_BURST_DEFAULT;
+   snprintf( defFile, sizeof(defFile), "%s/resources/resources.def", _nodeDataPtr->expHome );
+   if ( (value = SeqUtil_getdef( defFile, "SEQ_SUBMIT_RATE", _nodeDataPtr->expHome )) != NULL ) {
+      *rate = atof(value);
+      free(value);
+   }
+   if ( (value = SeqUtil_getdef( defFile, "SEQ_SUBMIT_BURST", _nodeDataPtr->expHome )) != NULL ) {
+      *burst = atof(value);
+      free(value);
+   }
+   snprintf( bucket, SEQ_MAXFIELD, "%s/sequencing/status/%s", _nodeDataPtr->expHome, SEQ_RATE_BUCKET );
+   SeqUtil_TRACE(TL_FULL_TRACE, "maestro.submitRateLimit() rate=%f burst=%f bucket=%s\n", *rate, *burst, bucket );
+}
+
+/*
+waitSubmitToken
+
+Waits for a token of the submission bucket of an experiment before a submission.
+*/
+static void waitSubmitToken( const SeqNodeDataPtr _nodeDataPtr, const char *bucket, double rate, double burst ) {
+   double wait;
+
+   if ( rate <= 0.0 ) return;
+   if ( (wait = _takeSubmitToken( bucket, rate, burst, _nodeDataPtr->expHome )) > 0.0 ) {
+      SeqUtil_TRACE(TL_MEDIUM, "maestro.waitSubmitToken() waiting %.3f seconds for a submission token\n", wait );
+      usleep( (useconds_t) (1000000 * wait) );
+   }
 }
 
 /*
@@ -1944,17 +2359,15 @@ Inputs:
 */
 static void submitNodeList (const SeqNodeDataPtr _nodeDataPtr) {
 	LISTNODEPTR listIteratorPtr = _nodeDataPtr->submits;
-	int counter = 0;
+	char bucket[SEQ_MAXFIELD];
+	double rate, burst;
 	SeqUtil_TRACE(TL_FULL_TRACE, "maestro.submitNodeList() called on %s \n", _nodeDataPtr->name );
+	if (listIteratorPtr != NULL) submitRateLimit( _nodeDataPtr, bucket, &rate, &burst );
 	while (listIteratorPtr != NULL) {
+		/*flood control, a token of the submission bucket of the experiment per submit*/ 
+		waitSubmitToken( _nodeDataPtr, bucket, rate, burst );
 		SeqUtil_TRACE(TL_FULL_TRACE, "maestro.submitNodeList() submits node %s\n", listIteratorPtr->data );
 		maestro ( listIteratorPtr->data, "submit", "continue" ,  _nodeDataPtr->loop_args, 0, NULL, _nodeDataPtr->datestamp , _nodeDataPtr->expHome);
-		/*flood control, wait CONTAINER_FLOOD_TIMER seconds between sets of submits*/ 
-		if (counter >= CONTAINER_FLOOD_LIMIT){
-			counter = 0; 
-			usleep(1000000 * CONTAINER_FLOOD_TIMER);
-		}
-		++counter;
 		listIteratorPtr =  listIteratorPtr->nextPtr;
 	}
 }
@@ -1973,18 +2386,17 @@ static void submitLoopSetNodeList ( const SeqNodeDataPtr _nodeDataPtr,
                                     SeqNameValuesPtr container_args_ptr, SeqNameValuesPtr loopset_index ) {
    SeqNameValuesPtr myLoopArgsPtr = loopset_index;
    SeqNameValuesPtr cmdLoopArg = NULL;
-   int counter=0;
+   char bucket[SEQ_MAXFIELD];
+   double rate, burst;
    SeqUtil_TRACE(TL_FULL_TRACE, "maestro.submitLoopSetNodeList() container_args_ptr=%s loopset_index=%s\n", SeqLoops_getLoopArgs(container_args_ptr), SeqLoops_getLoopArgs( loopset_index ) );
+   if ( myLoopArgsPtr != NULL ) submitRateLimit( _nodeDataPtr, bucket, &rate, &burst );
    while ( myLoopArgsPtr != NULL) {
       /* first get the parent container loop arguments */
       if( container_args_ptr != NULL ) {
          cmdLoopArg = SeqNameValues_clone( container_args_ptr );
       }
-      /*flood control, wait CONTAINER_FLOOD_TIMER seconds between sets of submits*/ 
-      if (counter >= CONTAINER_FLOOD_LIMIT){
-          counter = 0; 
-          usleep(1000000 * CONTAINER_FLOOD_TIMER);
-      }
+      /*flood control, a token of the submission bucket of the experiment per submit*/ 
+      waitSubmitToken( _nodeDataPtr, bucket, rate, burst );
 
       /* then add the current loop argument */
       SeqNameValues_insertItem( &cmdLoopArg, myLoopArgsPtr->name, myLoopArgsPtr->value );
@@ -1993,8 +2405,6 @@ static void submitLoopSetNodeList ( const SeqNodeDataPtr _nodeDataPtr,
       maestro ( _nodeDataPtr->name, "submit", "continue" , cmdLoopArg, 0, NULL, _nodeDataPtr->datestamp ,_nodeDataPtr->expHome);
       cmdLoopArg = NULL;
       myLoopArgsPtr = myLoopArgsPtr->nextPtr;
-      ++counter;
-      
    }
 }
 
@@ -2010,17 +2420,12 @@ Inputs:
 static void setWaitingState(const SeqNodeDataPtr _nodeDataPtr, const char* waited_one, const char* waited_status) {
 
    char *extName = NULL, *waitMsg = NULL;
-   char filename[SEQ_MAXFIELD];
 
 
 
 
    extName = (char *)SeqNode_extension( _nodeDataPtr );     
 
-   /* create the node waiting lock file name*/
-   memset(filename,'\0',sizeof filename);
-   sprintf(filename,"%s/%s/%s.waiting",_nodeDataPtr->workdir, _nodeDataPtr->datestamp, extName); 
-
    if (waitMsg = (char *) malloc ( strlen( waited_one ) + strlen( waited_status ) + 2)){ 
        sprintf( waitMsg, "%s %s", waited_status, waited_one );
    } else {
@@ -2028,10 +2433,8 @@ static void setWaitingState(const SeqNodeDataPtr _nodeDataPtr, const char* waite
    }
    nodewait( _nodeDataPtr, waitMsg, _nodeDataPtr->datestamp);  
 
-   /* clear any other state */
-   clearAllOtherStates( _nodeDataPtr, extName, "maestro.setWaitingState()", "waiting" ); 
-
-   _CreateLockFile(MLLServerConnectionFid , filename , "setWaitingState() ", _nodeDataPtr->expHome);
+   /* clear any other state and create the waiting lock file */
+   setNodeState( _nodeDataPtr, extName, "maestro.setWaitingState()", "waiting" ); 
 
    free( extName );
    free( waitMsg );
@@ -2057,31 +2460,181 @@ static void setWaitingState(const SeqNodeDataPtr _nodeDataPtr, const char* waite
  *                submitting, a nodelogger message is emitted and the dependency
  *                stays in the waited_end file
  *
+ * The dependants are released by up to SEQ_DEPS_WORKERS worker processes at the
+ * same time (see depWorker_start()), the output of each worker is copied to the
+ * log of this process when it is done.  With SEQ_DEPS_WORKERS=1 they are
+ * released one after the other by submitDependant().
+ *
  * NOTE: Since the execution of a maestro() call can encounter an exit statement
  * if there is something wrong with the dependency, we are using system calls so
  * that the submissions happen in a child process, and therefore exit calls will
  * terminate the child and not the current process. Defining the macro
  * SEQ_USE_SYSTEM_CALLS_FOR_DEPS controls whether submission is done with a
- * system call or with a function call.
+ * system call or with a function call.  A worker process calls maestro()
+ * itself, with the experiment this process has already loaded.
  ********************************************************************************/
 #define SEQ_USE_SYSTEM_CALLS_FOR_DEPS
+
+/* submits the dependant node, returns 0 if succeeds */
+static int submitDependant( const char *depExp, const char *depNode, const char *depDatestamp, const char *depArgs ) {
+   int submitCode = 0;
+#ifdef SEQ_USE_SYSTEM_CALLS_FOR_DEPS
+   char submitCmd[SEQ_MAXFIELD] = {'\0'};
+   char * submitDepArgs = NULL;
+
+   SeqUtil_TRACE(TL_FULL_TRACE,"submitDependencies(): Using system calls to submit %s\n",depNode);
+   if ( strlen( depArgs ) > 0 ) {
+      SeqUtil_stringAppend( &submitDepArgs, "-l " );
+   }
+   SeqUtil_stringAppend( &submitDepArgs, (char *) depArgs );
+   sprintf( submitCmd, "maestro -e %s -d %s -s submit -f continue -n %s %s",
+         depExp, depDatestamp, depNode, submitDepArgs ); 
+   SeqUtil_TRACE(TL_FULL_TRACE, "submitDependencies(): Running system command: %s\n", submitCmd);
+   submitCode = system ( submitCmd );
+   submitCode = WEXITSTATUS(submitCode); 
+   free(submitDepArgs);
+#else
+   SeqNameValuesPtr submitDepArgs = NULL;
+
+   SeqUtil_TRACE(TL_FULL_TRACE,"submitDependencies(): Using function call to submit dependency %s\n", depNode);
+   SeqUtil_TRACE(TL_FULL_TRACE, "submitDependencies calling maestro:\n\t\
+         maestro(%s, \"submit\", \"continue\", %s, 0, NULL, %s, %s );\n",
+         depNode, depArgs, depDatestamp, depExp );
+   SeqLoops_parseArgs(&submitDepArgs, depArgs);
+   submitCode = maestro( (char *) depNode, "submit", "continue", submitDepArgs, 0, NULL, (char *) depDatestamp, (char *) depExp);
+   SeqNameValues_deleteWholeList(&submitDepArgs);
+#endif
+   return submitCode;
+}
+
+/* puts back in the waited file the dependant that could not be submitted and tells the log of the node */
+static void dependantFailed( const SeqNodeDataPtr _nodeDataPtr, const char *waited_filename,
+                             const char *depExp, const char *depNode, const char *depDatestamp, const char *depArgs ) {
+   char statusFile[SEQ_MAXFIELD] = {'\0'}, nodelogger_msg[SEQ_MAXFIELD];
+   SeqNameValuesPtr depNVArgs = NULL;
+   char *depExtension = NULL;
+
+   SeqLoops_parseArgs( &depNVArgs, depArgs );
+   depExtension = SeqLoops_getExtFromLoopArgs( depNVArgs );
+   sprintf(statusFile,"%s/sequencing/status/%s/%s.%s.%s", depExp, depDatestamp,depNode, depExtension, "end" );
+   free(depExtension);
+   SeqNameValues_deleteWholeList( &depNVArgs );
+   /* Write the line back into the waited_file */
+   _WriteNWFile(depExp,depNode,depDatestamp,depArgs, waited_filename, statusFile);
+   SeqUtil_TRACE(TL_ERROR, "Error submitting node %s of experiment %s \n", depNode, depExp);
+   sprintf(nodelogger_msg, "An error occurred while submitting dependant node %s in experiment %s", depNode, depExp);
+   nodelogger(_nodeDataPtr->name, "info", _nodeDataPtr->extension, nodelogger_msg,
+         _nodeDataPtr->datestamp, _nodeDataPtr->expHome);
+}
+
+/* a dependant being released by a worker process of submitDependencies() */
+typedef struct {
+   pid_t pid;
+   FILE *output;             /* stdout and stderr of the worker */
+   int   submitCode;
+   char  depExp[256], depNode[256], depDatestamp[20], depArgs[SEQ_MAXFIELD];
+} DepWorker;
+
+/* 
+depWorker_start
+
+ Forks the worker process that releases the dependant of worker: it calls maestro() with the experiment
+ already loaded by this process, through its own connection to the server in server mode.
+ returns 1 if the worker is started, 0 if the dependant was released here instead (worker->submitCode set)
+
+*/
+static int depWorker_start( DepWorker *worker ) {
+   SeqNameValuesPtr submitDepArgs = NULL;
+   int submitCode;
+
+   fflush(NULL);
+   if ( (worker->output = tmpfile()) == NULL || (worker->pid = fork()) < 0 ) {
+      SeqUtil_TRACE(TL_ERROR, "maestro.submitDependencies() cannot start a worker, submitting %s here\n", worker->depNode);
+      if ( worker->output != NULL ) fclose( worker->output );
+      worker->output = NULL;
+      worker->submitCode = submitDependant( worker->depExp, worker->depNode, worker->depDatestamp, worker->depArgs );
+      return 0;
+   }
+   if ( worker->pid == 0 ) {
+      dup2( fileno(worker->output), STDOUT_FILENO );
+      dup2( fileno(worker->output), STDERR_FILENO );
+      /* the connection of the parent stays with it, maestro() opens another */
+      if ( ServerConnectionStatus == 0 ) close( MLLServerConnectionFid );
+      MLLServerConnectionFid = 0;
+      ServerConnectionStatus = 1;
+      QueDeqConnection = 0;
+      /* the submissions running are the parent's */
+      SubmissionCount = 0;
+      SeqStatusSnapshot_invalidate();
+
+      SeqLoops_parseArgs(&submitDepArgs, worker->depArgs);
+      submitCode = maestro( worker->depNode, "submit", "continue", submitDepArgs, 0, NULL, worker->depDatestamp, worker->depExp );
+      fflush(NULL);
+      _exit( submitCode == 0 ? 0 : 1 );
+   }
+   SeqUtil_TRACE(TL_FULL_TRACE, "maestro.submitDependencies() worker %d submitting %s\n", (int) worker->pid, worker->depNode);
+   return 1;
+}
+
+/* 
+depWorker_wait
+
+ Waits for one of the running workers, copies its output to stderr and sets its submitCode.
+ returns its index in workers
+
+*/
+static int depWorker_wait( DepWorker *workers, int running ) {
+   char buffer[4096];
+   size_t count;
+   pid_t pid;
+   int status = 0, i;
+
+   for (;;) {
+      if ( (pid = waitpid( -1, &status, 0 )) < 0 ) {
+         if ( errno == EINTR ) continue;
+         /* lost track of the workers */
+         SeqUtil_TRACE(TL_ERROR, "maestro.submitDependencies() cannot wait for the worker of %s\n", workers[running - 1].depNode);
+         i = running - 1;
+         status = -1;
+         break;
+      }
+      for ( i = 0; i < running && workers[i].pid != pid; i++ );
+      if ( i < running ) break;
+      submissions_reaped( pid, status );
+   }
+   workers[i].submitCode = ( status != -1 && WIFEXITED(status) ) ? WEXITSTATUS(status) : 1;
+
+   /* the output of the worker in one piece */
+   fprintf(stderr, "maestro.submitDependencies() release of %s %s (exp=%s datestamp=%s) status=%d:\n",
+           workers[i].depNode, workers[i].depArgs, workers[i].depExp, workers[i].depDatestamp, workers[i].submitCode);
+   rewind( workers[i].output );
+   while ( (count = fread( buffer, 1, sizeof buffer, workers[i].output )) > 0 ) {
+      fwrite( buffer, 1, count, stderr );
+   }
+   fclose( workers[i].output );
+   workers[i].output = NULL;
+   return i;
+}
+
 static void submitDependencies ( const SeqNodeDataPtr _nodeDataPtr, const char* _signal, const char* _flow ) {
    char line[512];
    char nodelogger_msg[SEQ_MAXFIELD];
    FILE* waitedFilePtr = NULL;
    SeqNameValuesPtr loopArgsPtr = NULL, depNVArgs = NULL;
    char depExp[256] = {'\0'}, depNode[256] = {'\0'}, depArgs[SEQ_MAXFIELD] = {'\0'}, depDatestamp[20] = {'\0'};
-   char waited_filename[SEQ_MAXFIELD] = {'\0'}, submitCmd[SEQ_MAXFIELD] = {'\0'}, statusFile[SEQ_MAXFIELD] = {'\0'};
+   char waited_filename[SEQ_MAXFIELD] = {'\0'};
    char *extName = NULL, * depExtension = NULL, *tmpValue=NULL, *tmpExt=NULL;
-   int submitCode = 0, count = 0, line_count=0, ret;
+   int submitCode = 0, count = 0, line_count=0, running = 0, released = 0, failed = 0, i;
    LISTNODEPTR submittedList = NULL, dependencyLines = NULL, current_dep_line = NULL;
+   DepWorker *workers = NULL;
 #ifdef SEQ_USE_SYSTEM_CALLS_FOR_DEPS
-   char * submitDepArgs = NULL;
-   SeqUtil_TRACE(TL_FULL_TRACE,"submitDependencies() in system call mode\n");
+   SeqUtil_TRACE(TL_FULL_TRACE,"submitDependencies() in system call mode, %d workers\n", DepWorkers);
 #else
-   SeqNameValuesPtr submitDepArgs = NULL;
-   SeqUtil_TRACE(TL_FULL_TRACE,"submitDependencies() in function call mode\n");
+   SeqUtil_TRACE(TL_FULL_TRACE,"submitDependencies() in function call mode, %d workers\n", DepWorkers);
 #endif
+   if ( DepWorkers > 1 && (workers = malloc( DepWorkers * sizeof(DepWorker) )) == NULL ) {
+      raiseError("maestro malloc: Out of memory!\n");
+   }
 
    SeqUtil_TRACE(TL_FULL_TRACE, "maestro.submitDependencies() executing for %s\n", _nodeDataPtr->nodeName );
 
@@ -2142,40 +2695,35 @@ static void submitDependencies ( const SeqNodeDataPtr _nodeDataPtr, const char*
                   if ( ! SeqListNode_isItemExists( submittedList, depNode ) ) {
                      SeqListNode_insertItem( &submittedList, depNode );
                      /* Attempt to submit dependant node */
-#ifdef SEQ_USE_SYSTEM_CALLS_FOR_DEPS
-                     SeqUtil_TRACE(TL_FULL_TRACE,"submitDependencies(): Using system calls to submit %s\n",depNode);
-                     if ( strlen( depArgs ) > 0 ) {
-                        SeqUtil_stringAppend( &submitDepArgs, "-l " );
+                     if ( DepWorkers > 1 ) {
+                        if ( running == DepWorkers ) {
+                           /* a place in the pool */
+                           i = depWorker_wait( workers, running );
+                           if ( workers[i].submitCode != 0 ) {
+                              failed++;
+                              dependantFailed( _nodeDataPtr, waited_filename, workers[i].depExp, workers[i].depNode,
+                                               workers[i].depDatestamp, workers[i].depArgs );
+                           }
+                           workers[i] = workers[--running];
+                        }
+                        strcpy( workers[running].depExp, depExp );
+                        strcpy( workers[running].depNode, depNode );
+                        strcpy( workers[running].depDatestamp, depDatestamp );
+                        strcpy( workers[running].depArgs, depArgs );
+                        released++;
+                        if ( depWorker_start( &workers[running] ) ) {
+                           running++;
+                           goto next;
+                        }
+                        submitCode = workers[running].submitCode;
+                     } else {
+                        released++;
+                        submitCode = submitDependant( depExp, depNode, depDatestamp, depArgs );
                      }
-                     SeqUtil_stringAppend( &submitDepArgs, depArgs );
-                     sprintf( submitCmd, "maestro -e %s -d %s -s submit -f continue -n %s %s",
-                           depExp, depDatestamp, depNode, submitDepArgs ); 
-                     SeqUtil_TRACE(TL_FULL_TRACE, "submitDependencies(): Running system command: %s\n", submitCmd);
-                     submitCode = system ( submitCmd );
-                     submitCode = WEXITSTATUS(submitCode); 
-                     free(submitDepArgs);
-                     submitDepArgs = NULL;
-#else
-                     SeqUtil_TRACE(TL_FULL_TRACE,"submitDependencies(): Using function call to submit dependency %s\n", depNode);
-                     SeqUtil_TRACE(TL_FULL_TRACE, "submitDependencies calling maestro:\n\t\
-                           maestro(%s, \"submit\", \"continue\", %s, 0, NULL, %s, %s );\n",
-                           depNode, depArgs, depDatestamp, depExp );
-                     SeqLoops_parseArgs(&submitDepArgs, depArgs);
-                     submitCode = maestro( depNode, "submit", "continue", submitDepArgs, 0, NULL, depDatestamp, depExp);
-                     SeqNameValues_deleteWholeList(&submitDepArgs);
-#endif
                      SeqUtil_TRACE(TL_FULL_TRACE, "maestro.submitDependencies() submitCode: %d\n", submitCode);
                      if( submitCode != 0 ) {
-                        depExtension = SeqLoops_getExtFromLoopArgs(depArgs);
-                        sprintf(statusFile,"%s/sequencing/status/%s/%s.%s.%s", depExp, depDatestamp,depNode, depExtension, "end" );
-                        free(depExtension);
-                        depExtension = NULL;
-                        /* Write the line back into the waited_file */
-                        _WriteNWFile(depExp,depNode,depDatestamp,depArgs, waited_filename, statusFile);
-                        SeqUtil_TRACE(TL_ERROR, "Error submitting node %s of experiment %s \n", depNode, depExp);
-                        sprintf(nodelogger_msg, "An error occurred while submitting dependant node %s in experiment %s", depNode, depExp);
-                        nodelogger(_nodeDataPtr->name, "info", _nodeDataPtr->extension, nodelogger_msg,
-                              _nodeDataPtr->datestamp, _nodeDataPtr->expHome);
+                        failed++;
+                        dependantFailed( _nodeDataPtr, waited_filename, depExp, depNode, depDatestamp, depArgs );
                      }
                   }
                next:
@@ -2184,6 +2732,17 @@ static void submitDependencies ( const SeqNodeDataPtr _nodeDataPtr, const char*
                   current_dep_line = current_dep_line->nextPtr;
                } /* end while loop */
 
+               /* the workers put back in this waited file the dependants they could not submit */
+               while ( running > 0 ) {
+                  i = depWorker_wait( workers, running );
+                  if ( workers[i].submitCode != 0 ) {
+                     failed++;
+                     dependantFailed( _nodeDataPtr, waited_filename, workers[i].depExp, workers[i].depNode,
+                                      workers[i].depDatestamp, workers[i].depArgs );
+                  }
+                  workers[i] = workers[--running];
+               }
+
                /* warn if file empty ... */
                if ( line_count == 0 ) raiseError( "waited_end file:%s (submitDependencies) EMPTY !!!! \n",waited_filename );
             } else {
@@ -2208,6 +2767,13 @@ static void submitDependencies ( const SeqNodeDataPtr _nodeDataPtr, const char*
          } /* if ((waitedFilePtr = _fopen(waited_filename, MLLServerConnectionFid)) != NULL ) */
       } /* if ( _access(waited_filename, R_OK, _nodeDataPtr->expHome) == 0 ) */
    } /* for( count=0; count < 2; count++ ) */
+   if ( released > 0 ) {
+      fprintf(stderr, "maestro.submitDependencies() %s%s %s: %d dependants released, %d failed\n",
+              _nodeDataPtr->name, _nodeDataPtr->extension, _signal, released, failed);
+      /* the dependants changed states */
+      SeqStatusSnapshot_invalidate();
+   }
+   free(workers);
    SeqListNode_deleteWholeList( &submittedList );
    free(extName);
    free(tmpExt);
@@ -2705,6 +3271,59 @@ int processDepStatus( const SeqNodeDataPtr _nodeDataPtr, SeqDepDataPtr dep, cons
    }
 }
 
+/********************************************************************************
+ * The facts of the target of a dependency that its evaluation needs: whether
+ * the node exists and, if it does, a node holding only its type, names,
+ * catchup, parent loops and data (loop definitions or switch value).  They
+ * are kept by the process for each (exp, node, datestamp), so the nodes
+ * depending many times on the same node walk the flow and resolve its
+ * resources once.
+********************************************************************************/
+typedef struct _DepNodeFacts {
+   char *exp, *node, *datestamp;
+   int exists;
+   SeqNodeDataPtr nodeData;    /* NULL if the node does not exist */
+   struct _DepNodeFacts *next;
+} DepNodeFacts;
+
+static DepNodeFacts *DepNodeFactsList = NULL;
+
+static DepNodeFacts *depNodeFacts( const char *node, const char *exp, const char *datestamp )
+{
+   DepNodeFacts *facts = NULL;
+   SeqNodeDataPtr nodeDataPtr = NULL;
+
+   for( facts = DepNodeFactsList; facts != NULL; facts = facts->next ) {
+      if( strcmp(facts->node, node) == 0 && strcmp(facts->exp, exp) == 0 &&
+          strcmp(facts->datestamp, datestamp != NULL ? datestamp : "") == 0 ) {
+         SeqUtil_TRACE(TL_FULL_TRACE, "depNodeFacts() known node:%s exp:%s\n", node, exp);
+         return facts;
+      }
+   }
+
+   if( (facts = calloc(1, sizeof(DepNodeFacts))) == NULL ||
+       (facts->node = strdup(node)) == NULL || (facts->exp = strdup(exp)) == NULL ||
+       (facts->datestamp = strdup(datestamp != NULL ? datestamp : "")) == NULL ) {
+      raiseError("maestro malloc: Out of memory!\n");
+   }
+   if( (facts->exists = doesNodeExist(node, exp, datestamp)) ) {
+      /* the flow and resources of the node, without its dependencies, submits and siblings */
+      nodeDataPtr = nodeinfo( node, NI_SHOW_TYPE, NULL, exp, NULL, (char *) datestamp, NULL );
+      facts->nodeData = SeqNode_createNode( nodeDataPtr->name );
+      facts->nodeData->type = nodeDataPtr->type;
+      facts->nodeData->catchup = nodeDataPtr->catchup;
+      facts->nodeData->loops = nodeDataPtr->loops;
+      facts->nodeData->data = nodeDataPtr->data;
+      nodeDataPtr->loops = NULL;
+      nodeDataPtr->data = NULL;
+      SeqNode_freeNode( nodeDataPtr );
+   }
+   SeqUtil_TRACE(TL_FULL_TRACE, "depNodeFacts() new node:%s exp:%s exists:%d\n", node, exp, facts->exists);
+   facts->next = DepNodeFactsList;
+   DepNodeFactsList = facts;
+   return facts;
+}
+
 /********************************************************************************
  * Maestro version of processDepStatus.  Checks if target node exists, checks
  * catchup, and checks all iterations targeted by the dependency.  When we find
@@ -2717,8 +3336,9 @@ int processDepStatus_MAESTRO( const SeqNodeDataPtr _nodeDataPtr, SeqDepDataPtr d
    SeqUtil_TRACE(TL_FULL_TRACE, "processDepStatus_MAESTRO() begin\n");
 
    int retval = SEQ_DEP_GO;
+   DepNodeFacts *facts = depNodeFacts(dep->node_name, dep->exp, dep->datestamp);
 
-   if  (! doesNodeExist(dep->node_name, dep->exp, dep->datestamp)) {
+   if  (! facts->exists) {
       char msg[1024];
       snprintf(msg,sizeof(msg), "Ignoring dependency on node:%s, exp:%s (out of scope)",
                                                    dep->node_name, dep->exp);
@@ -2728,20 +3348,17 @@ int processDepStatus_MAESTRO( const SeqNodeDataPtr _nodeDataPtr, SeqDepDataPtr d
       goto out;
    }
 
-   SeqNodeDataPtr depNodeDataPtr = nodeinfo( dep->node_name, NI_SHOW_ALL, NULL,
-                                          dep->exp, NULL, dep->datestamp,NULL );
+   SeqNodeDataPtr depNodeDataPtr = facts->nodeData;
    /* check catchup value of the node */
    if (depNodeDataPtr->catchup == CatchupDiscretionary) {
       SeqUtil_TRACE(TL_FULL_TRACE,"Node catchup is discretionnary\n");
       retval = SEQ_DEP_GO;
-      goto out_free;
+      goto out;
    }
 
    retval = checkTargetedIterations(_nodeDataPtr, depNodeDataPtr, dep, _flow);
 
    /* loop iterations until we find one that is not satisfied */
-out_free:
-   SeqNode_freeNode(depNodeDataPtr);
 out:
    SeqUtil_TRACE(TL_FULL_TRACE, "processDepStatus_MAESTRO() end, returning %d\n",
                                                                         retval);
@@ -2759,18 +3376,19 @@ int checkTargetedIterations(SeqNodeDataPtr _nodeDataPtr, SeqDepDataPtr depNodeDa
 {
    SeqUtil_TRACE(TL_FULL_TRACE, "checkTargetedIterations() begin\n");
    int retval = SEQ_DEP_GO;
-   char *lastCheckedIndex = NULL;
+   char lastCheckedIndex[SEQ_MAXFIELD];
    int undoneIteration = 0, writeStatus = 0;
-   LISTNODEPTR extensions = SeqLoops_getLoopContainerExtensionsInReverse(
-         depNodeDataPtr, dep->index );
-   LISTNODEPTR itr;
+   SeqLoopSpacePtr loopSpace = SeqLoops_containerSpace( depNodeDataPtr,
+                                                         dep->index );
+   SeqLoopIterator itr;
 
    /*
-    * Check iterations until an undone one is found or until they are all done.
+    * Check iterations, last one first, until an undone one is found or until
+    * they are all done.
     */
-   for(itr = extensions; itr != NULL; itr = itr->nextPtr){
-      lastCheckedIndex = itr->data;
-      if(checkDepIteration(_nodeDataPtr, dep, _flow, itr->data, &writeStatus)
+   SeqLoops_iteratorInit( &itr, loopSpace, 1 );
+   while( SeqLoops_iteratorNext( &itr, lastCheckedIndex, sizeof lastCheckedIndex ) ){
+      if(checkDepIteration(_nodeDataPtr, dep, _flow, lastCheckedIndex, &writeStatus)
                                                                == SEQ_DEP_WAIT ){
          /* Record the reason for exiting */
          undoneIteration = 1;
@@ -2791,7 +3409,7 @@ int checkTargetedIterations(SeqNodeDataPtr _nodeDataPtr, SeqDepDataPtr depNodeDa
       retval =  SEQ_DEP_WAIT;
    }
 out_free:
-   SeqListNode_deleteWholeList(&extensions);
+   SeqLoops_freeSpace( loopSpace );
    SeqUtil_TRACE(TL_FULL_TRACE, "checkTargetedIterations() end\n");
    return retval;
 }
@@ -3120,10 +3738,11 @@ Inputs:
 int maestro( char* _node, char* _signal, char* _flow, SeqNameValuesPtr _loops, int ignoreAllDeps, char* _extraArgs, char *_datestamp, char* _seq_exp_home ) {
    char buffer[SEQ_MAXFIELD] = {'\0'};
    char tmpdir[256];
-   char *seq_soumet = NULL, *tmp = NULL, *logMech=NULL, *defFile=NULL, *windowAverage = NULL, *runStats = NULL, *shortcut=NULL , *loopArgs=NULL ;
+   char *seq_soumet = NULL, *tmp = NULL, *logMech=NULL, *stateBackend=NULL, *stateSync=NULL, *loopMap=NULL, *depWorkers=NULL, *submitInFlight=NULL, *defFile=NULL, *windowAverage = NULL, *runStats = NULL, *shortcut=NULL , *loopArgs=NULL ;
    char *loopExtension = NULL, *nodeExtension = NULL, *extension = NULL, *tmpFullOrigin=NULL, *tmpLoopExt=NULL, *tmpJobID=NULL, *tmpNodeOrigin=NULL, *tmpHost=NULL, *fixedPath;
    SeqNodeDataPtr nodeDataPtr = NULL;
    int status = 1; /* starting with error condition */
+   int submitFailed = 0;
    int r;
    struct sigaction alrm, pipe;
    DIR *dirp = NULL;
@@ -3199,6 +3818,30 @@ int maestro( char* _node, char* _signal, char* _flow, SeqNameValuesPtr _loops, i
       raiseError("OutOfMemory exception in maestro()\n");
    }
    
+   /* SEQ_STATE_BACKEND=store keeps the node states of serverless mode in a status store */
+   stateBackend=SeqUtil_getdef( defFile, "SEQ_STATE_BACKEND", nodeDataPtr->expHome );
+   stateSync=SeqUtil_getdef( defFile, "SEQ_STATE_SYNC", nodeDataPtr->expHome );
+
+   /* SEQ_LOOP_MAP=no|yes|verify, the loop maps of isLoopComplete() and isLoopAborted() */
+   if ( (loopMap=SeqUtil_getdef( defFile, "SEQ_LOOP_MAP", nodeDataPtr->expHome )) != NULL ) {
+      if ( strcmp(loopMap,"no") == 0 ) LoopMapMode = LoopMapNo;
+      else if ( strcmp(loopMap,"verify") == 0 ) LoopMapMode = LoopMapVerify;
+      else LoopMapMode = LoopMapYes;
+      free(loopMap);
+   }
+
+   /* SEQ_DEPS_WORKERS=n, at most n dependants released at the same time, 1 for one after the other */
+   if ( (depWorkers=SeqUtil_getdef( defFile, "SEQ_DEPS_WORKERS", nodeDataPtr->expHome )) != NULL ) {
+      DepWorkers = atoi(depWorkers) > 0 ? atoi(depWorkers) : 1;
+      free(depWorkers);
+   }
+
+   /* SEQ_SUBMIT_INFLIGHT=n, at most n submissions running at the same time, 1 to wait for each */
+   if ( (submitInFlight=SeqUtil_getdef( defFile, "SEQ_SUBMIT_INFLIGHT", nodeDataPtr->expHome )) != NULL ) {
+      SubmitInFlight = atoi(submitInFlight) > 0 ? atoi(submitInFlight) : 1;
+      free(submitInFlight);
+   }
+
    if ( (logMech=SeqUtil_getdef( defFile, "SEQ_LOGGING_MECH", nodeDataPtr->expHome )) != NULL ) {
           free(defFile);defFile=NULL;
    } else {
@@ -3256,8 +3899,15 @@ int maestro( char* _node, char* _signal, char* _flow, SeqNameValuesPtr _loops, i
       }
    }
    
+   if ( ServerConnectionStatus == 1 && stateBackend != NULL && strcmp(stateBackend,"store") == 0 ) {
+       useStateStore();
+       SeqStateStore_sync( stateSync != NULL && strcmp(stateSync,"yes") == 0 );
+   }
+
    QueDeqConnection++;
    free(logMech); 
+   free(stateBackend);
+   free(stateSync);
 
    /* create working_dir directories */
    sprintf( tmpdir, "%s/%s/%s", nodeDataPtr->workdir, nodeDataPtr->datestamp, nodeDataPtr->container );
@@ -3331,6 +3981,12 @@ int maestro( char* _node, char* _signal, char* _flow, SeqNameValuesPtr _loops, i
       status=go_submit( _signal, _flow, nodeDataPtr, ignoreAllDeps );
    }
 
+   /* the submissions of this call are done before it returns, a failed one is its status */
+   if ( QueDeqConnection == 1 ) {
+      submitFailed = submissions_wait( 0 );
+      if ( status == 0 ) status = submitFailed;
+   }
+
    /* Release connection with server */
    QueDeqConnection--;
    if ( ServerConnectionStatus == 0 ) {
@@ -0,0 +1,219 @@
+/* mavgbench_main.c - Benchmark of the averages of the statistics of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "getopt.h"
+#include "SeqUtil.h"
+#include "SeqDatesUtil.h"
+#include "logreader.h"
+
+static void printUsage()
+{
+   char * usage = "\
+DESCRIPTION: mavgbench\n\
+\n\
+        Benchmark of the averages of the statistics of maestro (logreader -t\n\
+        compute_avg).  A fake experiment gets a stats file per day for the\n\
+        given nodes, some of them missing on some days, and the average over\n\
+        the window is computed by parsing the stats files into lists, as\n\
+        logreader did before, then from the stats store, once while it adds\n\
+        the stats files and once more with all of them already there.  The\n\
+        three outputs must be the same.\n\
+\n\
+USAGE\n\
+\n\
+    mavgbench [-n nodes] [-w days] [-d directory]\n\
+\n\
+OPTIONS\n\
+\n\
+    -n, --nodes\n\
+        Number of nodes and members in a stats file (default 10000)\n\
+\n\
+    -w, --window\n\
+        Number of days averaged (default 30, at most 30)\n\
+\n\
+    -d, --directory\n\
+        Directory where the fake experiment is created (default /tmp)\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+OUTPUT\n\
+\n\
+    Elapsed seconds of each way and whether the averages are the same.\n";
+puts(usage);
+}
+
+static double elapsedSince( struct timeval *t0 )
+{
+   struct timeval t1;
+   gettimeofday(&t1,NULL);
+   return (t1.tv_sec - t0->tv_sec) + (t1.tv_usec - t0->tv_usec) / 1.0e6;
+}
+
+static int sameFiles( const char *path1, const char *path2 )
+{
+   FILE *fp1, *fp2;
+   int c1, c2;
+
+   if ( (fp1 = fopen(path1,"r")) == NULL || (fp2 = fopen(path2,"r")) == NULL ) return 0;
+   do {
+      c1 = getc(fp1);
+      c2 = getc(fp2);
+   } while ( c1 == c2 && c1 != EOF );
+   fclose(fp1);
+   fclose(fp2);
+   return c1 == c2;
+}
+
+int main ( int argc, char * argv[] )
+{
+   char * short_opts = "n:w:d:h";
+
+   extern char *optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+
+      {"nodes"          , required_argument,   0,     'n'},
+      {"window"         , required_argument,   0,     'w'},
+      {"directory"      , required_argument,   0,     'd'},
+      {"help"           , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+
+   char *directory = "/tmp", exp[SEQ_MAXFIELD/2], path[SEQ_MAXFIELD], command[SEQ_MAXFIELD];
+   char datestamp[15], prev[15], member[32], legacy[SEQ_MAXFIELD], cold[SEQ_MAXFIELD], warm[SEQ_MAXFIELD];
+   int nodes = 10000, days = 30, i, d, s, same;
+   unsigned int seed = 1;
+   double legacyTime, coldTime, warmTime;
+   struct timeval t0;
+   struct stat st;
+   FILE *fp;
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index )) != -1) {
+      switch(c) {
+         case 'n':
+            nodes = atoi(optarg);
+            break;
+         case 'w':
+            days = atoi(optarg);
+            break;
+         case 'd':
+            directory = optarg;
+            break;
+         case 'h':
+            printUsage();
+            exit(0);
+         case '?':
+            exit(1);
+      }
+   }
+
+   if ( nodes <= 0 || days <= 0 || days > 30 ) {
+      printUsage();
+      exit(1);
+   }
+   if ( stat(directory,&st) != 0 || ! S_ISDIR(st.st_mode) ) {
+      fprintf(stderr,"mavgbench: %s is not a directory\n",directory);
+      exit(1);
+   }
+   snprintf(exp, sizeof(exp), "%s/mavgbench_%d", directory, getpid());
+   snprintf(path, sizeof(path), "%s/stats", exp);
+   if ( SeqUtil_mkdir_nfs(path, 1, NULL) != 0 ) {
+      fprintf(stderr,"mavgbench: cannot create %s\n",path);
+      exit(1);
+   }
+
+   /* a stats file per day, as logreader -t stats writes them; one node in
+    * 50 is missing on a day */
+   snprintf(datestamp, sizeof(datestamp), "20150130000000");
+   for ( d = 0; d < days; d++ ) {
+      snprintf(path, sizeof(path), "%s/stats/%s", exp, datestamp);
+      if ( (fp = fopen(path,"w")) == NULL ) {
+         fprintf(stderr,"mavgbench: cannot create %s\n",path);
+         exit(1);
+      }
+      for ( i = 0; i < nodes; i++ ) {
+         if ( rand_r(&seed) % 50 == 0 ) continue;
+         if ( i % 4 == 0 ) snprintf(member, sizeof(member), "null"); else snprintf(member, sizeof(member), "+%d", i % 4);
+         s = (i * 7 + rand_r(&seed) % 600) % 80000;
+         fprintf(fp, "SEQNODE=/bench/family_%d/task_%d:MEMBER=%s:SUBMIT=%.8d.%.2d:%.2d:%.2d:BEGIN=%.8d.%.2d:%.2d:%.2d:END=%.8d.%.2d:%.2d:%.2d:EXECTIME=%.2d:%.2d:%.2d:SUBMITDELAY=00:00:%.2d:DELTAFROMSTART=%.2d:%.2d:%.2d\n",
+                 i / 100, i / 4, member,
+                 20150130 - d, s / 3600, s / 60 % 60, s % 60,
+                 20150130 - d, (s + 30) / 3600, (s + 30) / 60 % 60, (s + 30) % 60,
+                 20150130 - d, (s + 630) / 3600, (s + 630) / 60 % 60, (s + 630) % 60,
+                 0, 10, 0, 30, (s + 630) / 3600, (s + 630) / 60 % 60, (s + 630) % 60);
+      }
+      fclose(fp);
+      strcpy(prev, datestamp);
+      snprintf(datestamp, sizeof(datestamp), "%s", SeqDatesUtil_getPrintableDate(prev,-1,0,0,0));
+   }
+   snprintf(legacy, sizeof(legacy), "%s/legacy_avg", exp);
+   snprintf(cold, sizeof(cold), "%s/cold_avg", exp);
+   snprintf(warm, sizeof(warm), "%s/warm_avg", exp);
+
+   fprintf(stdout,"nodes=%d window=%d directory=%s\n",nodes,days,directory);
+   fprintf(stdout,"%-28s %10s\n","average","seconds");
+
+   /* the lists of the stats files, as computeAverage() did */
+   gettimeofday(&t0,NULL);
+   rootStatsNode = NULL;
+   snprintf(datestamp, sizeof(datestamp), "20150130000000");
+   for ( d = 0; d < days; d++ ) {
+      snprintf(path, sizeof(path), "%s/stats/%s", exp, datestamp);
+      if ( (fp = fopen(path,"r")) != NULL ) {
+         getStats(fp);
+         fclose(fp);
+      }
+      strcpy(prev, datestamp);
+      snprintf(datestamp, sizeof(datestamp), "%s", SeqDatesUtil_getPrintableDate(prev,-1,0,0,0));
+   }
+   fp = fopen(legacy,"w");
+   processStats(exp, "20150130000000", fp);
+   fclose(fp);
+   legacyTime = elapsedSince(&t0);
+   fprintf(stdout,"%-28s %10.3f\n","stats files into lists", legacyTime);
+
+   gettimeofday(&t0,NULL);
+   fp = fopen(cold,"w");
+   computeAverage(exp, "20150130000000", days, fp);
+   fclose(fp);
+   coldTime = elapsedSince(&t0);
+   fprintf(stdout,"%-28s %10.3f\n","store, adding the files", coldTime);
+
+   gettimeofday(&t0,NULL);
+   fp = fopen(warm,"w");
+   computeAverage(exp, "20150130000000", days, fp);
+   fclose(fp);
+   warmTime = elapsedSince(&t0);
+   fprintf(stdout,"%-28s %10.3f\n","store", warmTime);
+
+   same = sameFiles(legacy, cold) && sameFiles(legacy, warm);
+   fprintf(stdout,"averages %s\n", same ? "identical" : "DIFFER");
+
+   snprintf(command, sizeof(command), "rm -rf %s", exp);
+   system(command);
+   return( same ? 0 : 1 );
+}
@@ -0,0 +1,153 @@
+/* mdefbench_main.c - Benchmark of the definition lookups of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "getopt.h"
+#include "SeqUtil.h"
+
+static void printUsage()
+{
+   char * usage = "\
+DESCRIPTION: mdefbench\n\
+\n\
+        Benchmark of the definition lookups of maestro. A fake experiment\n\
+        gets a resources.def file with the given number of definitions, and\n\
+        every round resolves with SeqUtil_keysub() one string per definition,\n\
+        each string referencing two of them, as XmlUtils_resolve() does for\n\
+        the attributes of the resource files of a node.\n\
+\n\
+USAGE\n\
+\n\
+    mdefbench [-n definitions] [-i rounds] [-d directory]\n\
+\n\
+OPTIONS\n\
+\n\
+    -n, --definitions\n\
+        Number of definitions in resources.def (default 500)\n\
+\n\
+    -i, --rounds\n\
+        Number of times every string is resolved (default 20)\n\
+\n\
+    -d, --directory\n\
+        Directory where the fake experiment is created (default /tmp)\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+OUTPUT\n\
+\n\
+    Substitutions, elapsed seconds and substitutions per second.\n";
+puts(usage);
+}
+
+int main ( int argc, char * argv[] )
+{
+   char * short_opts = "n:i:d:h";
+
+   extern char *optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+
+      {"definitions"    , required_argument,   0,     'n'},
+      {"rounds"         , required_argument,   0,     'i'},
+      {"directory"      , required_argument,   0,     'd'},
+      {"help"           , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+
+   char *directory = "/tmp", exp[SEQ_MAXFIELD/2], deffile[SEQ_MAXFIELD], command[SEQ_MAXFIELD];
+   char str[SEQ_MAXFIELD], expected[SEQ_MAXFIELD];
+   int definitions = 500, rounds = 20, r, i, errors = 0;
+   struct timeval t0, t1;
+   double elapsed;
+   struct stat st;
+   FILE *fp;
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index )) != -1) {
+      switch(c) {
+         case 'n':
+            definitions = atoi(optarg);
+            break;
+         case 'i':
+            rounds = atoi(optarg);
+            break;
+         case 'd':
+            directory = optarg;
+            break;
+         case 'h':
+            printUsage();
+            exit(0);
+         case '?':
+            exit(1);
+      }
+   }
+
+   if ( definitions <= 0 || rounds <= 0 ) {
+      printUsage();
+      exit(1);
+   }
+   if ( stat(directory,&st) != 0 || ! S_ISDIR(st.st_mode) ) {
+      fprintf(stderr,"mdefbench: %s is not a directory\n",directory);
+      exit(1);
+   }
+   if ( snprintf(exp, sizeof(exp), "%s/mdefbench_%d", directory, getpid()) >= sizeof(exp) ) {
+      fprintf(stderr,"mdefbench: %s is too long\n",directory);
+      exit(1);
+   }
+   snprintf(deffile, sizeof(deffile), "%s/resources/resources.def", exp);
+   snprintf(command, sizeof(command), "%s/resources", exp);
+   if ( SeqUtil_mkdir_nfs(command, 1, NULL) != 0 || (fp = fopen(deffile,"w")) == NULL ) {
+      fprintf(stderr,"mdefbench: cannot create %s\n",deffile);
+      exit(1);
+   }
+   /* the layout of the definitions varies as in real files */
+   fprintf(fp,"# definitions of mdefbench\n");
+   for ( i = 0; i < definitions; i++ ) {
+      if ( i % 10 == 0 ) fprintf(fp,"\n# group %d\n", i / 10);
+      fprintf(fp, i % 2 ? "BENCH_VAR_%d = /home/bench/value_%d\n" : "  BENCH_VAR_%d=/home/bench/value_%d\n", i, i);
+   }
+   fclose(fp);
+
+   fprintf(stdout,"definitions=%d rounds=%d directory=%s\n",definitions,rounds,directory);
+   fprintf(stdout,"%14s %10s %16s %8s\n","substitutions","seconds","substitutions/s","errors");
+
+   gettimeofday(&t0,NULL);
+   for ( r = 0; r < rounds; r++ ) {
+      for ( i = 0; i < definitions; i++ ) {
+         snprintf(str, sizeof(str), "${BENCH_VAR_%d}/bin:${BENCH_VAR_%d}", i, definitions - 1 - i);
+         snprintf(expected, sizeof(expected), "/home/bench/value_%d/bin:/home/bench/value_%d", i, definitions - 1 - i);
+         if ( strcmp(SeqUtil_keysub(str, deffile, NULL, exp), expected) != 0 ) errors++;
+      }
+   }
+   gettimeofday(&t1,NULL);
+
+   elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1.0e6;
+   fprintf(stdout,"%14d %10.3f %16.1f %8d\n", rounds * definitions * 2, elapsed, rounds * definitions * 2 / elapsed, errors);
+
+   SeqUtil_unmapfiles();
+   snprintf(command, sizeof(command), "rm -rf %s", exp);
+   system(command);
+   return( errors != 0 );
+}
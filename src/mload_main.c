@@ -0,0 +1,298 @@
+/* mload_main.c - Load test of the maestro server event loop.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pwd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "getopt.h"
+#include "l2d2_socket.h"
+#include "l2d2_commun.h"
+
+static void printUsage()
+{
+   char * usage = "\
+DESCRIPTION: mload\n\
+\n\
+        Load test of the maestro server (mserver) running for the current user.\n\
+        Opens logged in connections in steps up to a maximum and, at each step,\n\
+        measures the latency of requests sent on one active connection while the\n\
+        others stay idle. Run it once with the server configured with\n\
+        <pparams eventLoop=\"select\"/> and once with eventLoop=\"epoll\" in\n\
+        ~/.suites/mconfig.xml to compare both event loops.\n\
+\n\
+USAGE\n\
+\n\
+    mload [-c max-connections] [-s step] [-n requests] [-f file] [-b burst [-p]]\n\
+\n\
+OPTIONS\n\
+\n\
+    -c, --connections\n\
+        Maximum number of idle connections to open (default 4096)\n\
+\n\
+    -s, --step\n\
+        Number of connections added between two measures (default 512)\n\
+\n\
+    -n, --requests\n\
+        Number of requests timed at each step (default 1000)\n\
+\n\
+    -f, --file\n\
+        File whose existence is tested by the requests (default $HOME)\n\
+\n\
+    -b, --burst\n\
+        Number of requests sent back to back in each timed burst (default 1)\n\
+\n\
+    -p, --pipeline\n\
+        Log in with the framed protocol and send each burst in one flight,\n\
+        replies matched by request id. Without it, the requests of a burst\n\
+        each wait for their reply as with the 1024 byte protocol\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+OUTPUT\n\
+\n\
+    One line per step: number of open connections, number of connections\n\
+    the server refused or dropped, and the average, median, 99th percentile\n\
+    and maximum latency of a burst in microseconds.\n";
+puts(usage);
+}
+
+static void alarm_handler ( int notused ) { }
+
+static int compare_double( const void *a, const void *b )
+{
+   double da = *(const double *) a, db = *(const double *) b;
+   return (da > db) - (da < db);
+}
+
+/* open a connection and log in, returns the socket or -1 */
+static int mload_connect( char *ip, int port, unsigned int pid, char *xpname, char *user, char **m5, int *framed )
+{
+   int sock;
+
+   if ( (sock=connect_to_host_port_by_ip(ip,port)) < 0 ) return(-1);
+   if ( do_Login(sock, pid, "/mload", xpname, "load", user, m5, framed) != 0 ) {
+      close(sock);
+      return(-1);
+   }
+   return(sock);
+}
+
+/* send one fixed size request and wait for its 3 byte reply */
+static int mload_request( int sock, char *request )
+{
+   char buf[1024], reply[3];
+   int got = 0, num;
+
+   memset(buf,'\0',sizeof(buf));
+   snprintf(buf,sizeof(buf),"%s",request);
+   if ( send_socket(sock, buf, sizeof(buf), SOCK_TIMEOUT_CLIENT) != sizeof(buf) ) return(-1);
+   while ( got < sizeof(reply) ) {
+      if ( (num=recv_socket(sock, reply + got, sizeof(reply) - got, SOCK_TIMEOUT_CLIENT)) <= 0 ) return(-1);
+      got += num;
+   }
+   return( reply[0] == '0' ? 0 : 1 );
+}
+
+/* send a burst of requests in one flight of frames and wait for all the replies */
+static int mload_frames( int sock, char *request, int burst, char *frames )
+{
+   unsigned int id, len;
+   int i, op, status, plen = strlen(request) - 2;
+   char *payload;
+
+   for ( i = 0; i < burst; i++ ) {
+      pack_frame(frames + i * (L2D2_FRAME_HEADER + plen), plen, i + 1, request[0], 0);
+      memcpy(frames + i * (L2D2_FRAME_HEADER + plen) + L2D2_FRAME_HEADER, request + 2, plen);
+   }
+   if ( send_full(sock, frames, burst * (L2D2_FRAME_HEADER + plen)) != 0 ) return(-1);
+   for ( i = 0; i < burst; i++ ) {
+      if ( recv_frame(sock, &id, &op, &status, &payload, &len) != 0 ) return(-1);
+      free(payload);
+   }
+   return(0);
+}
+
+int main ( int argc, char * argv[] )
+{
+   char * short_opts = "c:s:n:f:b:ph";
+
+   extern char *optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+
+      {"connections"    , required_argument,   0,     'c'},
+      {"step"           , required_argument,   0,     's'},
+      {"requests"       , required_argument,   0,     'n'},
+      {"file"           , required_argument,   0,     'f'},
+      {"burst"          , required_argument,   0,     'b'},
+      {"pipeline"       , no_argument      ,   0,     'p'},
+      {"help"           , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+
+   int maxcon = 4096, step = 512, nreq = 1000, burst = 1, pipeline = 0, framed = 0;
+   int i, j, rc, level, opened = 0, failed = 0, active, port = 0;
+   unsigned int pid = 0;
+   char *file = NULL, *version, *auth, *m5 = NULL, *home;
+   char authorization_file[256], host[128], ip[32], request[1024], *frames;
+   int *socks;
+   double *lat, sum;
+   struct timeval t0, t1;
+   struct rlimit rl;
+   struct sigaction sa;
+   struct passwd *passwdEnt = getpwuid(getuid());
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index )) != -1) {
+      switch(c) {
+         case 'c':
+            maxcon = atoi(optarg);
+            break;
+         case 's':
+            step = atoi(optarg);
+            break;
+         case 'n':
+            nreq = atoi(optarg);
+            break;
+         case 'f':
+            file = optarg;
+            break;
+         case 'b':
+            burst = atoi(optarg);
+            break;
+         case 'p':
+            pipeline = 1;
+            break;
+         case 'h':
+            printUsage();
+            exit(0);
+         case '?':
+            exit(1);
+      }
+   }
+
+   if ( maxcon < 0 || step <= 0 || nreq <= 0 || burst <= 0 ) {
+      printUsage();
+      exit(1);
+   }
+
+   if ( (home=getenv("HOME")) == NULL ) home = passwdEnt->pw_dir;
+   if ( file == NULL ) file = home;
+
+   if ( (version=getenv("SEQ_MAESTRO_VERSION")) == NULL ) {
+      fprintf(stderr,"mload: Could not get maestro current version. Please do a proper ssmuse\n");
+      exit(1);
+   }
+
+   snprintf(authorization_file,sizeof(authorization_file),".maestro_server_%s",version);
+   if ( (auth=get_Authorization(authorization_file, passwdEnt->pw_name, &m5)) == NULL ) {
+      fprintf(stderr,"mload: no mserver running for user %s\n",passwdEnt->pw_name);
+      exit(1);
+   }
+   if ( sscanf(auth,"seqpid=%u seqhost=%127s seqip=%31s seqport=%d",&pid,host,ip,&port) != 4 ) {
+      fprintf(stderr,"mload: cannot parse %s\n",authorization_file);
+      exit(1);
+   }
+
+   /* timeouts of send_socket and recv_socket interrupt the call instead of killing us */
+   memset(&sa,'\0',sizeof(sa));
+   sa.sa_handler = alarm_handler;
+   sigemptyset(&sa.sa_mask);
+   sigaction(SIGALRM,&sa,NULL);
+   signal(SIGPIPE,SIG_IGN);
+
+   if ( getrlimit(RLIMIT_NOFILE,&rl) == 0 && rl.rlim_cur < rl.rlim_max ) {
+      rl.rlim_cur = rl.rlim_max;
+      setrlimit(RLIMIT_NOFILE,&rl);
+   }
+
+   socks = (int *) xmalloc((maxcon + 1) * sizeof(int));
+   lat = (double *) xmalloc(nreq * sizeof(double));
+   snprintf(request,sizeof(request),"F %s",file);
+   frames = (char *) xmalloc(burst * (L2D2_FRAME_HEADER + strlen(request)));
+
+   if ( (active=mload_connect(ip, port, pid, home, passwdEnt->pw_name, &m5, pipeline ? &framed : NULL)) < 0 ) {
+      fprintf(stderr,"mload: cannot log in mserver at %s:%d\n",ip,port);
+      exit(1);
+   }
+   if ( pipeline && ! framed ) {
+      fprintf(stderr,"mload: mserver does not support the framed protocol\n");
+      exit(1);
+   }
+
+   fprintf(stdout,"mserver pid=%u host=%s port=%d burst=%d %s\n",pid,host,port,burst,framed ? "framed" : "1024 bytes");
+   fprintf(stdout,"%12s %8s %10s %10s %10s %10s\n","connections","failed","avg(us)","p50(us)","p99(us)","max(us)");
+
+   for ( level = 0; level <= maxcon; level += step ) {
+      while ( opened + failed < level ) {
+         if ( (socks[opened]=mload_connect(ip, port, pid, home, passwdEnt->pw_name, &m5, NULL)) < 0 )
+            failed++;
+         else
+            opened++;
+      }
+
+      sum = 0.0;
+      for ( i = 0; i < nreq; i++ ) {
+         gettimeofday(&t0,NULL);
+         if ( framed ) {
+            rc = mload_frames(active, request, burst, frames);
+         } else {
+            for ( j = 0, rc = 0; j < burst && rc >= 0; j++ ) rc = mload_request(active, request);
+         }
+         if ( rc < 0 ) {
+            fprintf(stderr,"mload: request failed on active connection\n");
+            exit(1);
+         }
+         gettimeofday(&t1,NULL);
+         lat[i] = (t1.tv_sec - t0.tv_sec) * 1.0e6 + (t1.tv_usec - t0.tv_usec);
+         sum += lat[i];
+      }
+      qsort(lat, nreq, sizeof(double), compare_double);
+
+      fprintf(stdout,"%12d %8d %10.1f %10.1f %10.1f %10.1f\n", opened, failed, sum / nreq,
+              lat[nreq / 2], lat[(int)(nreq * 0.99)], lat[nreq - 1]);
+      fflush(stdout);
+   }
+
+   /* Stop all sessions, same as nodelogger */
+   for ( i = 0; i < opened; i++ ) {
+      send_socket(socks[i], "S \0", 3, SOCK_TIMEOUT_CLIENT);
+      close(socks[i]);
+   }
+   if ( framed ) {
+      pack_frame(frames, 0, 1, 'S', 0);
+      send_full(active, frames, L2D2_FRAME_HEADER);
+   } else {
+      send_socket(active, "S \0", 3, SOCK_TIMEOUT_CLIENT);
+   }
+   close(active);
+
+   free(frames);
+   free(socks);
+   free(lat);
+   free(auth);
+   free(m5);
+   return 0;
+}
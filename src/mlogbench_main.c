@@ -0,0 +1,282 @@
+/* mlogbench_main.c - Benchmark of the nodelog writers of the maestro server.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "getopt.h"
+#include "l2d2_Util.h"
+#include "l2d2_commun.h"
+#include "l2d2_logwriter.h"
+#include "SeqLogIndex.h"
+
+static void printUsage()
+{
+   char * usage = "\
+DESCRIPTION: mlogbench\n\
+\n\
+        Benchmark of the nodelog writers of the maestro server (mserver).\n\
+        Threads playing the part of clients append lines to nodelog files,\n\
+        each thread waiting for its line to be on disk before sending the next\n\
+        one, as a nodelogger does. The old writer opens, writes, fsyncs and\n\
+        closes the file for every line; the new one is the group commit log\n\
+        writer thread of mserver.\n\
+\n\
+USAGE\n\
+\n\
+    mlogbench [-t threads] [-n lines] [-f files] [-d directory] [-w old|new|both] [-x]\n\
+\n\
+OPTIONS\n\
+\n\
+    -t, --threads\n\
+        Number of writing threads (default 16)\n\
+\n\
+    -n, --lines\n\
+        Number of lines written by each thread (default 500)\n\
+\n\
+    -f, --files\n\
+        Number of nodelog files the threads write to (default 4)\n\
+\n\
+    -d, --directory\n\
+        Local directory where the nodelog files are created (default /tmp)\n\
+\n\
+    -w, --writer\n\
+        Writer to measure: old, new or both (default both)\n\
+\n\
+    -x, --index\n\
+        The new writer keeps the binary index of the nodelog files, as mserver\n\
+        does with nodelogIndex=\"1\"\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+OUTPUT\n\
+\n\
+    One line per writer: lines written, elapsed seconds and lines per second.\n";
+puts(usage);
+}
+
+typedef struct {
+   int id;
+   int done;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+} bench_thread;
+
+static int Lines = 500, Files = 4;
+static char *Directory = "/tmp";
+static char *User = "bench";
+
+/* the old writer serialized the lines of one file with a lock */
+static pthread_mutex_t *FileMutex;
+
+static void bench_request( char *buf, size_t size, int id, int i )
+{
+   snprintf(buf, size, "%s:%s/mlogbench_%d_nodelog:TIMESTAMP=20150101.00:00:00:SEQNODE=/bench/task_%d:MSGTYPE=end:SEQLOOP=:SEQMSG=line %d",
+            User, Directory, (id + i) % Files, id, i);
+}
+
+static void *bench_old( void *arg )
+{
+   bench_thread *th = (bench_thread *) arg;
+   char buf[1024];
+   int i;
+
+   for ( i = 0; i < Lines; i++ ) {
+      bench_request(buf, sizeof(buf), th->id, i);
+      pthread_mutex_lock(&FileMutex[(th->id + i) % Files]);
+      NodeLogr(buf, getpid(), stderr);
+      pthread_mutex_unlock(&FileMutex[(th->id + i) % Files]);
+   }
+   return(NULL);
+}
+
+static void bench_done( l2d2logline *ln, void *arg )
+{
+   bench_thread *th = (bench_thread *) arg;
+
+   if ( ln->status != 0 ) fprintf(stderr,"mlogbench: could not write %s errno=%d\n",ln->path,ln->err);
+   pthread_mutex_lock(&th->lock);
+   th->done = 1;
+   pthread_cond_signal(&th->cond);
+   pthread_mutex_unlock(&th->lock);
+}
+
+static void *bench_new( void *arg )
+{
+   bench_thread *th = (bench_thread *) arg;
+   l2d2logline *ln;
+   char buf[1024];
+   int i;
+
+   for ( i = 0; i < Lines; i++ ) {
+      bench_request(buf, sizeof(buf), th->id, i);
+      ln = LogWriter_newLine(buf);
+      ln->done = bench_done;
+      ln->arg = th;
+      th->done = 0;
+      LogWriter_submit(ln);
+      pthread_mutex_lock(&th->lock);
+      while ( ! th->done ) pthread_cond_wait(&th->cond, &th->lock);
+      pthread_mutex_unlock(&th->lock);
+   }
+   return(NULL);
+}
+
+/* run the threads and report, returns the lines per second */
+static double bench_run( const char *name, void *(*fn)(void *), int nthreads )
+{
+   bench_thread *th;
+   pthread_t *tid;
+   struct timeval t0, t1;
+   char path[1024];
+   double elapsed;
+   int i;
+
+   for ( i = 0; i < Files; i++ ) {
+      snprintf(path,sizeof(path),"%s/mlogbench_%d_nodelog%s",Directory,i,SEQ_LOG_INDEX_EXT);
+      unlink(path);
+      snprintf(path,sizeof(path),"%s/mlogbench_%d_nodelog",Directory,i);
+      unlink(path);
+   }
+
+   th = (bench_thread *) xmalloc(nthreads * sizeof(bench_thread));
+   tid = (pthread_t *) xmalloc(nthreads * sizeof(pthread_t));
+
+   gettimeofday(&t0,NULL);
+   for ( i = 0; i < nthreads; i++ ) {
+      th[i].id = i;
+      th[i].done = 0;
+      pthread_mutex_init(&th[i].lock, NULL);
+      pthread_cond_init(&th[i].cond, NULL);
+      if ( pthread_create(&tid[i], NULL, fn, &th[i]) != 0 ) {
+         fprintf(stderr,"mlogbench: cannot create thread %d\n",i);
+         exit(1);
+      }
+   }
+   for ( i = 0; i < nthreads; i++ ) pthread_join(tid[i], NULL);
+   gettimeofday(&t1,NULL);
+
+   elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1.0e6;
+   fprintf(stdout,"%8s %10d %10.3f %12.1f\n", name, nthreads * Lines, elapsed, nthreads * Lines / elapsed);
+   fflush(stdout);
+
+   for ( i = 0; i < nthreads; i++ ) {
+      pthread_mutex_destroy(&th[i].lock);
+      pthread_cond_destroy(&th[i].cond);
+   }
+   for ( i = 0; i < Files; i++ ) {
+      snprintf(path,sizeof(path),"%s/mlogbench_%d_nodelog%s",Directory,i,SEQ_LOG_INDEX_EXT);
+      unlink(path);
+      snprintf(path,sizeof(path),"%s/mlogbench_%d_nodelog",Directory,i);
+      unlink(path);
+   }
+   free(th);
+   free(tid);
+   return( nthreads * Lines / elapsed );
+}
+
+int main ( int argc, char * argv[] )
+{
+   char * short_opts = "t:n:f:d:w:xh";
+
+   extern char *optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+
+      {"threads"        , required_argument,   0,     't'},
+      {"lines"          , required_argument,   0,     'n'},
+      {"files"          , required_argument,   0,     'f'},
+      {"directory"      , required_argument,   0,     'd'},
+      {"writer"         , required_argument,   0,     'w'},
+      {"index"          , no_argument      ,   0,     'x'},
+      {"help"           , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+
+   int nthreads = 16, index = 0, i;
+   char *writer = "both";
+   double old_rate = 0.0, new_rate = 0.0;
+   struct stat st;
+   struct passwd *passwdEnt = getpwuid(getuid());
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index )) != -1) {
+      switch(c) {
+         case 't':
+            nthreads = atoi(optarg);
+            break;
+         case 'n':
+            Lines = atoi(optarg);
+            break;
+         case 'f':
+            Files = atoi(optarg);
+            break;
+         case 'd':
+            Directory = optarg;
+            break;
+         case 'w':
+            writer = optarg;
+            break;
+         case 'x':
+            index = 1;
+            break;
+         case 'h':
+            printUsage();
+            exit(0);
+         case '?':
+            exit(1);
+      }
+   }
+
+   if ( nthreads <= 0 || Lines <= 0 || Files <= 0 ||
+        (strcmp(writer,"old") != 0 && strcmp(writer,"new") != 0 && strcmp(writer,"both") != 0) ) {
+      printUsage();
+      exit(1);
+   }
+   if ( stat(Directory,&st) != 0 || ! S_ISDIR(st.st_mode) ) {
+      fprintf(stderr,"mlogbench: %s is not a directory\n",Directory);
+      exit(1);
+   }
+   if ( passwdEnt != NULL ) User = passwdEnt->pw_name;
+
+   FileMutex = (pthread_mutex_t *) xmalloc(Files * sizeof(pthread_mutex_t));
+   for ( i = 0; i < Files; i++ ) pthread_mutex_init(&FileMutex[i], NULL);
+
+   fprintf(stdout,"threads=%d lines/thread=%d files=%d directory=%s\n",nthreads,Lines,Files,Directory);
+   fprintf(stdout,"%8s %10s %10s %12s\n","writer","lines","seconds","lines/s");
+
+   if ( strcmp(writer,"new") != 0 ) old_rate = bench_run("old", bench_old, nthreads);
+   if ( strcmp(writer,"old") != 0 ) {
+      if ( LogWriter_start(index) != 0 ) {
+         fprintf(stderr,"mlogbench: cannot start the log writer\n");
+         exit(1);
+      }
+      new_rate = bench_run("new", bench_new, nthreads);
+   }
+   if ( old_rate > 0.0 && new_rate > 0.0 ) fprintf(stdout,"speedup %.1fx\n", new_rate / old_rate);
+
+   free(FileMutex);
+   return 0;
+}
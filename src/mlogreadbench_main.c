@@ -0,0 +1,238 @@
+/* mlogreadbench_main.c - Benchmark of the nodelog reader of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include "getopt.h"
+#include "SeqUtil.h"
+#include "logreader.h"
+
+static void printUsage()
+{
+   char * usage = "\
+DESCRIPTION: mlogreadbench\n\
+\n\
+        Benchmark of the nodelog reader of maestro (logreader -t log, as\n\
+        xflow runs it). A nodelog is generated for a fake suite of families\n\
+        of tasks and of loops with many members: submit, begin and end lines\n\
+        mostly, with some abort, wait, discret, catchup and info lines, and\n\
+        init lines resetting nodes or loop members.  With -a, the nodelog\n\
+        is read with a checkpoint (logreader -r), lines are appended to it\n\
+        and the time of the incremental read is given too.\n\
+\n\
+USAGE\n\
+\n\
+    mlogreadbench [-n lines] [-a lines] [-t tasks] [-l loops] [-m members] [-d directory] [-k]\n\
+\n\
+OPTIONS\n\
+\n\
+    -n, --lines\n\
+        Number of lines of the nodelog (default 1000000)\n\
+\n\
+    -a, --append\n\
+        Number of lines appended after a first read with a checkpoint (default 0)\n\
+\n\
+    -t, --tasks\n\
+        Number of tasks outside of loops (default 2000)\n\
+\n\
+    -l, --loops\n\
+        Number of tasks in loops (default 100)\n\
+\n\
+    -m, --members\n\
+        Number of members of each loop (default 500)\n\
+\n\
+    -d, --directory\n\
+        Directory where the fake experiment is created (default /tmp)\n\
+\n\
+    -k, --keep\n\
+        Keep the fake experiment and its nodelog\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+OUTPUT\n\
+\n\
+    Lines read, elapsed seconds and lines per second, of every read.\n";
+puts(usage);
+}
+
+static const char *Signals[] = { "submit", "begin", "end" };
+static const char *OtherSignals[] = { "abort", "wait", "discret", "catchup", "info", "init" };
+
+static unsigned int Seed = 1;
+
+/* count lines from line number first */
+static void writeLines( FILE *fp, int first, int count, int tasks, int loops, int members ) {
+   char node[SEQ_MAXFIELD], loop[64];
+   const char *signal;
+   int i, r;
+
+   for ( i = first; i < first + count; i++ ) {
+      r = rand_r(&Seed);
+      if ( r % 10 < 6 ) {
+         snprintf(node, sizeof(node), "bench/family_%d/task_%d", (r / 10) % tasks / 25, (r / 10) % tasks);
+         loop[0] = '\0';
+      } else {
+         snprintf(node, sizeof(node), "bench/loop_%d/task_%d", (r / 10) % loops / 5, (r / 10) % loops);
+         snprintf(loop, sizeof(loop), "+%d", (r / 1000) % members);
+      }
+      signal = ( r % 200 == 0 ) ? OtherSignals[(r / 200) % 6] : Signals[(r / 10) % 3];
+      fprintf(fp, "TIMESTAMP=20150101.%.2d:%.2d:%.2d:SEQNODE=/%s:MSGTYPE=%s:SEQLOOP=%s:SEQMSG=%s\n",
+              i / 3600 % 24, i / 60 % 60, i % 60, node, signal, loop,
+              strcmp(signal,"wait") == 0 ? "msg=waiting for /bench/family_0/task_0" : "host=bench job_ID=1");
+   }
+}
+
+/* seconds taken by logreader -t log, in a child: logreader keeps its nodes */
+static double timeRead( char *nodelog, char *exp, int resume ) {
+   struct timeval t0, t1;
+   int out, status;
+   pid_t pid;
+
+   gettimeofday(&t0,NULL);
+   if ( (pid = fork()) == 0 ) {
+      /* the statuses go to /dev/null */
+      if ( (out = open("/dev/null", O_WRONLY)) < 0 ) {
+         fprintf(stderr,"mlogreadbench: cannot open /dev/null\n");
+         exit(1);
+      }
+      dup2(out, 1);
+      close(out);
+      if ( resume ) logreader_setCheckpoint("");
+      logreader(nodelog, NULL, exp, "20150101000000", "log", 0, 1);
+      fflush(stdout);
+      _exit(0);
+   }
+   if ( pid < 0 || waitpid(pid, &status, 0) != pid || ! WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
+      fprintf(stderr,"mlogreadbench: logreader failed\n");
+      exit(1);
+   }
+   gettimeofday(&t1,NULL);
+   return (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1.0e6;
+}
+
+int main ( int argc, char * argv[] )
+{
+   char * short_opts = "n:a:t:l:m:d:kh";
+
+   extern char *optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+
+      {"lines"          , required_argument,   0,     'n'},
+      {"append"         , required_argument,   0,     'a'},
+      {"tasks"          , required_argument,   0,     't'},
+      {"loops"          , required_argument,   0,     'l'},
+      {"members"        , required_argument,   0,     'm'},
+      {"directory"      , required_argument,   0,     'd'},
+      {"keep"           , no_argument      ,   0,     'k'},
+      {"help"           , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+
+   char *directory = "/tmp", exp[SEQ_MAXFIELD/2], nodelog[SEQ_MAXFIELD], command[SEQ_MAXFIELD];
+   int lines = 1000000, append = 0, tasks = 2000, loops = 100, members = 500, keep = 0;
+   double elapsed;
+   struct stat st;
+   FILE *fp;
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index )) != -1) {
+      switch(c) {
+         case 'n':
+            lines = atoi(optarg);
+            break;
+         case 'a':
+            append = atoi(optarg);
+            break;
+         case 't':
+            tasks = atoi(optarg);
+            break;
+         case 'l':
+            loops = atoi(optarg);
+            break;
+         case 'm':
+            members = atoi(optarg);
+            break;
+         case 'd':
+            directory = optarg;
+            break;
+         case 'k':
+            keep = 1;
+            break;
+         case 'h':
+            printUsage();
+            exit(0);
+         case '?':
+            exit(1);
+      }
+   }
+
+   if ( lines <= 0 || append < 0 || tasks <= 0 || loops <= 0 || members <= 0 ) {
+      printUsage();
+      exit(1);
+   }
+   if ( stat(directory,&st) != 0 || ! S_ISDIR(st.st_mode) ) {
+      fprintf(stderr,"mlogreadbench: %s is not a directory\n",directory);
+      exit(1);
+   }
+   snprintf(exp, sizeof(exp), "%s/mlogreadbench_%d", directory, getpid());
+   snprintf(command, sizeof(command), "%s/logs", exp);
+   snprintf(nodelog, sizeof(nodelog), "%s/logs/20150101000000_nodelog", exp);
+   if ( SeqUtil_mkdir_nfs(command, 1, NULL) != 0 || (fp = fopen(nodelog,"w")) == NULL ) {
+      fprintf(stderr,"mlogreadbench: cannot create %s\n",nodelog);
+      exit(1);
+   }
+
+   writeLines(fp, 0, lines, tasks, loops, members);
+   fclose(fp);
+
+   fprintf(stdout,"lines=%d append=%d tasks=%d loops=%d members=%d directory=%s\n",lines,append,tasks,loops,members,directory);
+   fprintf(stdout,"%-12s %10s %10s %12s\n","read","lines","seconds","lines/s");
+
+   elapsed = timeRead(nodelog, exp, append > 0);
+   fprintf(stdout,"%-12s %10d %10.3f %12.1f\n", append > 0 ? "checkpoint" : "full", lines, elapsed, lines / elapsed);
+
+   if ( append > 0 ) {
+      if ( (fp = fopen(nodelog,"a")) == NULL ) {
+         fprintf(stderr,"mlogreadbench: cannot append to %s\n",nodelog);
+         exit(1);
+      }
+      writeLines(fp, lines, append, tasks, loops, members);
+      fclose(fp);
+      elapsed = timeRead(nodelog, exp, 1);
+      fprintf(stdout,"%-12s %10d %10.3f %12.1f\n", "incremental", append, elapsed, append / elapsed);
+      elapsed = timeRead(nodelog, exp, 0);
+      fprintf(stdout,"%-12s %10d %10.3f %12.1f\n", "full", lines + append, elapsed, (lines + append) / elapsed);
+   }
+
+   if ( keep ) {
+      fprintf(stdout,"nodelog kept in %s\n", nodelog);
+   } else {
+      snprintf(command, sizeof(command), "rm -rf %s", exp);
+      system(command);
+   }
+   return 0;
+}
@@ -0,0 +1,213 @@
+/* mnpassbench_main.c - Benchmark of the npass completeness check of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "getopt.h"
+#include "SeqUtil.h"
+#include "SeqStatusSnapshot.h"
+
+static void printUsage()
+{
+   char * usage = "\
+DESCRIPTION: mnpassbench\n\
+\n\
+        Benchmark of the completeness check of an npass task (isNpassComplete\n\
+        in maestro).  A fake experiment gets the status directory of a\n\
+        container with an npass task of many indexes, all ended, next to the\n\
+        status files of its sibling tasks.  Every index that ends checks\n\
+        whether the npass task is complete: with the four globs maestro did\n\
+        (last end, submit, begin, abort.stop), then with the status snapshot\n\
+        of the directory, read once per maestro process.  The check is done\n\
+        again with an index still running; both ways must agree.\n\
+\n\
+USAGE\n\
+\n\
+    mnpassbench [-n indexes] [-s siblings] [-d directory]\n\
+\n\
+OPTIONS\n\
+\n\
+    -n, --indexes\n\
+        Number of indexes of the npass task (default 2000)\n\
+\n\
+    -s, --siblings\n\
+        Number of sibling tasks in the container (default 100)\n\
+\n\
+    -d, --directory\n\
+        Directory where the fake experiment is created (default /tmp)\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+OUTPUT\n\
+\n\
+    Elapsed seconds of the checks of each way and whether they agree.\n";
+puts(usage);
+}
+
+static double elapsedSince( struct timeval *t0 )
+{
+   struct timeval t1;
+   gettimeofday(&t1,NULL);
+   return (t1.tv_sec - t0->tv_sec) + (t1.tv_usec - t0->tv_usec) / 1.0e6;
+}
+
+static void touchFile( const char *path )
+{
+   FILE *fp;
+
+   if ( (fp = fopen(path,"w")) == NULL ) {
+      fprintf(stderr,"mnpassbench: cannot create %s\n",path);
+      exit(1);
+   }
+   fclose(fp);
+}
+
+/* the check of isNpassComplete with globs */
+static int completeGlobs( const char *node )
+{
+   static const char *undone[] = { "submit", "begin", "abort.stop" };
+   char pattern[SEQ_MAXFIELD];
+   unsigned int i;
+
+   snprintf(pattern, sizeof(pattern), "%s.+last.end", node);
+   if ( ! globPath_nfs(pattern, GLOB_NOSORT, 0, NULL) ) return 0;
+   for ( i = 0; i < sizeof(undone) / sizeof(undone[0]); i++ ) {
+      snprintf(pattern, sizeof(pattern), "%s.+*.%s", node, undone[i]);
+      if ( globPath_nfs(pattern, GLOB_NOSORT, 0, NULL) ) return 0;
+   }
+   return 1;
+}
+
+/* the check of isNpassComplete with a new snapshot, as a new maestro process */
+static int completeSnapshot( const char *node )
+{
+   char prefix[SEQ_MAXFIELD];
+   int undone;
+
+   SeqStatusSnapshot_invalidate();
+   snprintf(prefix, sizeof(prefix), "%s.+", node);
+   undone = SeqStatusSnapshot_count(prefix, SEQ_SNAP_SUBMIT|SEQ_SNAP_BEGIN|SEQ_SNAP_ABORTSTOP);
+   strcat(prefix, "last.end");
+   return undone == 0 && SeqStatusSnapshot_exists(prefix) == 1;
+}
+
+int main ( int argc, char * argv[] )
+{
+   char * short_opts = "n:s:d:h";
+
+   extern char *optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+
+      {"indexes"        , required_argument,   0,     'n'},
+      {"siblings"       , required_argument,   0,     's'},
+      {"directory"      , required_argument,   0,     'd'},
+      {"help"           , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+
+   char *directory = "/tmp", exp[SEQ_MAXFIELD/2], dir[SEQ_MAXFIELD/2+64], node[SEQ_MAXFIELD/2+128], path[SEQ_MAXFIELD], command[SEQ_MAXFIELD];
+   int indexes = 2000, siblings = 100, i, same = 1, globResult = 0, snapshotResult = 0;
+   double globTime, snapshotTime;
+   struct timeval t0;
+   struct stat st;
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index )) != -1) {
+      switch(c) {
+         case 'n':
+            indexes = atoi(optarg);
+            break;
+         case 's':
+            siblings = atoi(optarg);
+            break;
+         case 'd':
+            directory = optarg;
+            break;
+         case 'h':
+            printUsage();
+            exit(0);
+         case '?':
+            exit(1);
+      }
+   }
+
+   if ( indexes <= 0 || siblings < 0 ) {
+      printUsage();
+      exit(1);
+   }
+   if ( stat(directory,&st) != 0 || ! S_ISDIR(st.st_mode) ) {
+      fprintf(stderr,"mnpassbench: %s is not a directory\n",directory);
+      exit(1);
+   }
+   if ( snprintf(exp, sizeof(exp), "%s/mnpassbench_%d", directory, getpid()) >= sizeof(exp) ) {
+      fprintf(stderr,"mnpassbench: %s is too long\n",directory);
+      exit(1);
+   }
+   snprintf(dir, sizeof(dir), "%s/sequencing/status/20150130000000/bench/family", exp);
+   if ( SeqUtil_mkdir_nfs(dir, 1, NULL) != 0 ) {
+      fprintf(stderr,"mnpassbench: cannot create %s\n",dir);
+      exit(1);
+   }
+
+   /* the npass task /bench/family/npass, all its indexes ended, and its siblings */
+   snprintf(node, sizeof(node), "%s/npass", dir);
+   for ( i = 1; i <= indexes; i++ ) {
+      snprintf(path, sizeof(path), "%s.+%d.end", node, i);
+      touchFile(path);
+   }
+   snprintf(path, sizeof(path), "%s.+last.end", node);
+   touchFile(path);
+   for ( i = 0; i < siblings; i++ ) {
+      snprintf(path, sizeof(path), "%s/task_%d.%s", dir, i, i % 2 ? "end" : "begin");
+      touchFile(path);
+   }
+
+   fprintf(stdout,"indexes=%d siblings=%d directory=%s\n",indexes,siblings,directory);
+   fprintf(stdout,"%-28s %10s\n","check","seconds");
+
+   /* every index that ends runs the check */
+   gettimeofday(&t0,NULL);
+   for ( i = 0; i < indexes; i++ ) globResult += completeGlobs(node);
+   globTime = elapsedSince(&t0);
+   fprintf(stdout,"%-28s %10.3f\n","globs", globTime);
+
+   gettimeofday(&t0,NULL);
+   for ( i = 0; i < indexes; i++ ) snapshotResult += completeSnapshot(node);
+   snapshotTime = elapsedSince(&t0);
+   fprintf(stdout,"%-28s %10.3f\n","status snapshot", snapshotTime);
+   same = globResult == indexes && snapshotResult == indexes;
+
+   /* an index running again: not complete any more */
+   snprintf(path, sizeof(path), "%s.+%d.begin", node, indexes / 2 + 1);
+   touchFile(path);
+   same = same && completeGlobs(node) == 0 && completeSnapshot(node) == 0;
+   fprintf(stdout,"checks %s\n", same ? "identical" : "DIFFER");
+
+   SeqStatusSnapshot_invalidate();
+   snprintf(command, sizeof(command), "rm -rf %s", exp);
+   system(command);
+   return( same ? 0 : 1 );
+}
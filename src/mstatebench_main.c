@@ -0,0 +1,193 @@
+/* mstatebench_main.c - Benchmark of the node status backends of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "getopt.h"
+#include "SeqUtil.h"
+#include "SeqStateStore.h"
+
+static void printUsage()
+{
+   char * usage = "\
+DESCRIPTION: mstatebench\n\
+\n\
+        Benchmark of the node status backends of maestro. Each round puts\n\
+        every node of a fake experiment through submit, begin and end, as\n\
+        maestro does, checks each new state and counts the ended nodes with\n\
+        a pattern. The files backend keeps one file per state (the default);\n\
+        the store backend keeps the states of the datestamp in one table\n\
+        (SEQ_STATE_BACKEND=store in ~/.maestrorc).\n\
+\n\
+USAGE\n\
+\n\
+    mstatebench [-n nodes] [-i rounds] [-d directory] [-w files|store|both] [-s]\n\
+\n\
+OPTIONS\n\
+\n\
+    -n, --nodes\n\
+        Number of nodes (default 200)\n\
+\n\
+    -i, --rounds\n\
+        Number of times every node goes through the states (default 5)\n\
+\n\
+    -d, --directory\n\
+        Directory where the fake experiment is created (default /tmp)\n\
+\n\
+    -w, --backend\n\
+        Backend to measure: files, store or both (default both)\n\
+\n\
+    -s, --sync\n\
+        Sync the journal of the store at each change (SEQ_STATE_SYNC=yes)\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+OUTPUT\n\
+\n\
+    One line per backend: state changes, elapsed seconds and state changes\n\
+    per second.\n";
+puts(usage);
+}
+
+static const char *States[] = { "submit", "begin", "end" };
+
+static int Nodes = 200, Rounds = 5;
+
+typedef struct {
+   int (*setNodeState) ( const char *request, char *removed, size_t size, const char * _seq_exp_home );
+   int (*isFileExists) ( const char* lockfile, const char *caller, const char * _seq_exp_home );
+   int (*globPath) ( const char *pattern, int flags, int (*errfunc) (const char *epath, int eerrno), const char * _seq_exp_home );
+} bench_backend;
+
+/* run the rounds on the experiment exp and report, returns the state changes per second */
+static double bench_run( const char *name, const bench_backend *be, const char *exp )
+{
+   char request[SEQ_MAXFIELD], path[SEQ_MAXFIELD], command[SEQ_MAXFIELD];
+   struct timeval t0, t1;
+   double elapsed;
+   int r, i, s, errors = 0;
+
+   snprintf(command, sizeof(command), "rm -rf %s", exp);
+   system(command);
+   snprintf(path, sizeof(path), "%s/sequencing/status/20150101000000/bench", exp);
+   if ( SeqUtil_mkdir_nfs(path, 1, NULL) != 0 ) {
+      fprintf(stderr,"mstatebench: cannot create %s\n",path);
+      exit(1);
+   }
+
+   gettimeofday(&t0,NULL);
+   for ( r = 0; r < Rounds; r++ ) {
+      for ( i = 0; i < Nodes; i++ ) {
+         for ( s = 0; s < sizeof(States) / sizeof(States[0]); s++ ) {
+            snprintf(request, sizeof(request), "exp=%s datestamp=20150101000000 node=/bench/task_%d ext= state=%s", exp, i, States[s]);
+            if ( be->setNodeState(request, NULL, 0, exp) != 0 ) errors++;
+            snprintf(path, sizeof(path), "%s/sequencing/status/20150101000000/bench/task_%d.%s", exp, i, States[s]);
+            if ( be->isFileExists(path, "mstatebench", exp) != 1 ) errors++;
+         }
+      }
+      snprintf(path, sizeof(path), "%s/sequencing/status/20150101000000/bench/task_*.end", exp);
+      if ( be->globPath(path, GLOB_NOSORT, 0, exp) != Nodes ) errors++;
+   }
+   gettimeofday(&t1,NULL);
+
+   elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1.0e6;
+   fprintf(stdout,"%8s %10d %10.3f %12.1f %8d\n", name, Rounds * Nodes * 3, elapsed, Rounds * Nodes * 3 / elapsed, errors);
+   fflush(stdout);
+
+   SeqStateStore_close();
+   snprintf(command, sizeof(command), "rm -rf %s", exp);
+   system(command);
+   return( Rounds * Nodes * 3 / elapsed );
+}
+
+int main ( int argc, char * argv[] )
+{
+   char * short_opts = "n:i:d:w:sh";
+
+   extern char *optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+
+      {"nodes"          , required_argument,   0,     'n'},
+      {"rounds"         , required_argument,   0,     'i'},
+      {"directory"      , required_argument,   0,     'd'},
+      {"backend"        , required_argument,   0,     'w'},
+      {"sync"           , no_argument      ,   0,     's'},
+      {"help"           , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+
+   static const bench_backend files = { setNodeState_nfs, isFileExists_nfs, globPath_nfs };
+   static const bench_backend store = { setNodeState_store, isFileExists_store, globPath_store };
+   char *directory = "/tmp", *backend = "both", exp[SEQ_MAXFIELD];
+   double files_rate = 0.0, store_rate = 0.0;
+   struct stat st;
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index )) != -1) {
+      switch(c) {
+         case 'n':
+            Nodes = atoi(optarg);
+            break;
+         case 'i':
+            Rounds = atoi(optarg);
+            break;
+         case 'd':
+            directory = optarg;
+            break;
+         case 'w':
+            backend = optarg;
+            break;
+         case 's':
+            SeqStateStore_sync(1);
+            break;
+         case 'h':
+            printUsage();
+            exit(0);
+         case '?':
+            exit(1);
+      }
+   }
+
+   if ( Nodes <= 0 || Rounds <= 0 ||
+        (strcmp(backend,"files") != 0 && strcmp(backend,"store") != 0 && strcmp(backend,"both") != 0) ) {
+      printUsage();
+      exit(1);
+   }
+   if ( stat(directory,&st) != 0 || ! S_ISDIR(st.st_mode) ) {
+      fprintf(stderr,"mstatebench: %s is not a directory\n",directory);
+      exit(1);
+   }
+   snprintf(exp, sizeof(exp), "%s/mstatebench_%d", directory, getpid());
+
+   fprintf(stdout,"nodes=%d rounds=%d directory=%s\n",Nodes,Rounds,directory);
+   fprintf(stdout,"%8s %10s %10s %12s %8s\n","backend","changes","seconds","changes/s","errors");
+
+   if ( strcmp(backend,"store") != 0 ) files_rate = bench_run("files", &files, exp);
+   if ( strcmp(backend,"files") != 0 ) store_rate = bench_run("store", &store, exp);
+   if ( files_rate > 0.0 && store_rate > 0.0 ) fprintf(stdout,"speedup %.1fx\n", store_rate / files_rate);
+
+   return 0;
+}
@@ -0,0 +1,289 @@
+/* msubmitbench_main.c - Benchmark of the submissions of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "getopt.h"
+#include "SeqUtil.h"
+#include "maestro.h"
+
+static void printUsage()
+{
+   char * usage = "\
+DESCRIPTION: msubmitbench\n\
+\n\
+        Benchmark of the submissions of maestro.  A fake experiment has a\n\
+        family submitting its tasks; each round begins the family, which\n\
+        submits every task through the fake submit tool testDir/fake_ord_soumet\n\
+        (SEQ_SOUMET), first waiting for each submission (SEQ_SUBMIT_INFLIGHT=1),\n\
+        then with several submissions running at the same time.  Every task\n\
+        must be submitted once per round both ways.\n\
+\n\
+USAGE\n\
+\n\
+    msubmitbench [-n tasks] [-r rounds] [-f inflight] [-t tool] [-d directory]\n\
+\n\
+OPTIONS\n\
+\n\
+    -n, --tasks\n\
+        Number of tasks of the family (default 10, the submissions past\n\
+        SEQ_SUBMIT_BURST, 10, wait for SEQ_SUBMIT_RATE)\n\
+\n\
+    -r, --rounds\n\
+        Number of times the family begins (default 3)\n\
+\n\
+    -f, --inflight\n\
+        Submissions running at the same time in the second way (default 8)\n\
+\n\
+    -t, --tool\n\
+        Fake submit tool (default testDir/fake_ord_soumet, its delay is\n\
+        FAKE_SOUMET_DELAY seconds)\n\
+\n\
+    -d, --directory\n\
+        Directory where the fake experiment is created (default /tmp)\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+OUTPUT\n\
+\n\
+    One line per way: submissions, elapsed seconds, submissions per second\n\
+    and the number of tasks not submitted.\n";
+puts(usage);
+}
+
+static const char *Datestamp = "20150101000000";
+
+static void writeFile( const char *path, const char *content )
+{
+   FILE *fp;
+
+   if ( (fp = fopen(path,"w")) == NULL ) {
+      fprintf(stderr,"msubmitbench: cannot create %s\n",path);
+      exit(1);
+   }
+   fputs(content,fp);
+   fclose(fp);
+}
+
+static void makeDir( const char *path )
+{
+   if ( SeqUtil_mkdir_nfs(path, 1, NULL) != 0 ) {
+      fprintf(stderr,"msubmitbench: cannot create %s\n",path);
+      exit(1);
+   }
+}
+
+/* the fake experiment exp, a family of tasks */
+static void makeExperiment( const char *exp, int tasks )
+{
+   char path[SEQ_MAXFIELD], line[SEQ_MAXFIELD];
+   FILE *fp;
+   int i;
+
+   snprintf(path, sizeof(path), "%s/modules/main", exp);
+   makeDir(path);
+   snprintf(path, sizeof(path), "%s/resources/main", exp);
+   makeDir(path);
+   snprintf(path, sizeof(path), "%s/logs", exp);
+   makeDir(path);
+   snprintf(path, sizeof(path), "%s/bin", exp);
+   makeDir(path);
+   snprintf(path, sizeof(path), "%s/EntryModule", exp);
+   symlink("modules/main", path);
+   snprintf(path, sizeof(path), "%s/ExpDate", exp);
+   snprintf(line, sizeof(line), "%s\n", Datestamp);
+   writeFile(path, line);
+   snprintf(path, sizeof(path), "%s/resources/resources.def", exp);
+   writeFile(path, "SEQ_DEFAULT_MACHINE=localhost\nFRONTEND=localhost\n");
+   snprintf(path, sizeof(path), "%s/resources/main/container.xml", exp);
+   writeFile(path, "<NODE_RESOURCES>\n <BATCH cpu=\"1\"/>\n</NODE_RESOURCES>\n");
+   /* nodetracer has no listing to move */
+   snprintf(path, sizeof(path), "%s/bin/nodetracer", exp);
+   writeFile(path, "#!/bin/sh\nexit 0\n");
+   chmod(path, 0755);
+
+   snprintf(path, sizeof(path), "%s/modules/main/flow.xml", exp);
+   if ( (fp = fopen(path,"w")) == NULL ) {
+      fprintf(stderr,"msubmitbench: cannot create %s\n",path);
+      exit(1);
+   }
+   fprintf(fp, "<MODULE name=\"main\">\n  <SUBMITS sub_name=\"family\"/>\n  <FAMILY name=\"family\">\n");
+   for ( i = 0; i < tasks; i++ ) fprintf(fp, "    <SUBMITS sub_name=\"task_%d\"/>\n", i);
+   for ( i = 0; i < tasks; i++ ) fprintf(fp, "    <TASK name=\"task_%d\"/>\n", i);
+   fprintf(fp, "  </FAMILY>\n</MODULE>\n");
+   fclose(fp);
+}
+
+/* the lines of file, 0 if none */
+static int countLines( const char *path )
+{
+   FILE *fp;
+   int c, lines = 0;
+
+   if ( (fp = fopen(path,"r")) == NULL ) return 0;
+   while ( (c = getc(fp)) != EOF ) if ( c == '\n' ) lines++;
+   fclose(fp);
+   return lines;
+}
+
+/* the rounds with inflight submissions at the same time, returns the number of tasks not submitted */
+static int benchRun( const char *name, const char *exp, int tasks, int rounds, int inflight )
+{
+   char path[SEQ_MAXFIELD], log[SEQ_MAXFIELD], command[2*SEQ_MAXFIELD], line[64];
+   struct timeval t0, t1;
+   double elapsed = 0.0;
+   int r, i, missing = 0, savedStderr, devnull;
+
+   snprintf(path, sizeof(path), "%s/.maestrorc", exp);
+   snprintf(line, sizeof(line), "SEQ_SUBMIT_INFLIGHT=%d\n", inflight);
+   writeFile(path, line);
+   snprintf(log, sizeof(log), "%s/fake_ord_soumet.log", exp);
+
+   for ( r = 0; r < rounds; r++ ) {
+      snprintf(command, sizeof(command), "rm -rf %s/sequencing %s", exp, log);
+      system(command);
+      snprintf(path, sizeof(path), "%s/sequencing/status/%s", exp, Datestamp);
+      makeDir(path);
+
+      /* the log of maestro is not the point */
+      fflush(stderr);
+      savedStderr = dup(STDERR_FILENO);
+      devnull = open("/dev/null", O_WRONLY);
+      dup2(devnull, STDERR_FILENO);
+      close(devnull);
+
+      gettimeofday(&t0,NULL);
+      maestro("/main/family", "begin", "continue", NULL, 0, NULL, (char *) Datestamp, (char *) exp);
+      gettimeofday(&t1,NULL);
+
+      fflush(stderr);
+      dup2(savedStderr, STDERR_FILENO);
+      close(savedStderr);
+      elapsed += (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1.0e6;
+
+      for ( i = 0; i < tasks; i++ ) {
+         snprintf(path, sizeof(path), "%s/sequencing/status/%s/main/family/task_%d.submit", exp, Datestamp, i);
+         if ( access(path, F_OK) != 0 ) missing++;
+      }
+      if ( countLines(log) != tasks ) missing += abs(countLines(log) - tasks);
+   }
+
+   fprintf(stdout,"%-14s %11d %10.3f %12.1f %8d\n", name, rounds * tasks, elapsed, rounds * tasks / elapsed, missing);
+   fflush(stdout);
+   return missing;
+}
+
+int main ( int argc, char * argv[] )
+{
+   char * short_opts = "n:r:f:t:d:h";
+
+   extern char *optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+
+      {"tasks"          , required_argument,   0,     'n'},
+      {"rounds"         , required_argument,   0,     'r'},
+      {"inflight"       , required_argument,   0,     'f'},
+      {"tool"           , required_argument,   0,     't'},
+      {"directory"      , required_argument,   0,     'd'},
+      {"help"           , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+
+   char *directory = "/tmp", *tool = "testDir/fake_ord_soumet", toolPath[PATH_MAX], exp[SEQ_MAXFIELD/2], path[SEQ_MAXFIELD], command[SEQ_MAXFIELD], name[32];
+   int tasks = 10, rounds = 3, inflight = 8, missing = 0;
+   struct stat st;
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index )) != -1) {
+      switch(c) {
+         case 'n':
+            tasks = atoi(optarg);
+            break;
+         case 'r':
+            rounds = atoi(optarg);
+            break;
+         case 'f':
+            inflight = atoi(optarg);
+            break;
+         case 't':
+            tool = optarg;
+            break;
+         case 'd':
+            directory = optarg;
+            break;
+         case 'h':
+            printUsage();
+            exit(0);
+         case '?':
+            exit(1);
+      }
+   }
+
+   if ( tasks <= 0 || rounds <= 0 || inflight <= 0 ) {
+      printUsage();
+      exit(1);
+   }
+   if ( stat(directory,&st) != 0 || ! S_ISDIR(st.st_mode) ) {
+      fprintf(stderr,"msubmitbench: %s is not a directory\n",directory);
+      exit(1);
+   }
+   if ( realpath(tool, toolPath) == NULL || access(toolPath, X_OK) != 0 ) {
+      fprintf(stderr,"msubmitbench: cannot run the submit tool %s\n",tool);
+      exit(1);
+   }
+
+   if ( snprintf(exp, sizeof(exp), "%s/msubmitbench_%d", directory, getpid()) >= sizeof(exp) ) {
+      fprintf(stderr,"msubmitbench: %s is too long\n",directory);
+      exit(1);
+   }
+   makeExperiment(exp, tasks);
+
+   /* the environment of a maestro job, ~/.maestrorc in the experiment */
+   setenv("HOME", exp, 1);
+   setenv("SEQ_SOUMET", toolPath, 1);
+   snprintf(path, sizeof(path), "%s/fake_ord_soumet.log", exp);
+   setenv("FAKE_SOUMET_LOG", path, 1);
+   snprintf(path, sizeof(path), "%s/bin", exp);
+   setenv("SEQ_UTILS_BIN", path, 1);
+   setenv("SEQ_MAESTRO_SHORTCUT", "maestro", 0);
+   setenv("SEQ_MAESTRO_VERSION", "bench", 0);
+   setenv("SEQ_BIN", path, 0);
+   setenv("TRUE_HOST", "localhost", 0);
+
+   fprintf(stdout,"tasks=%d rounds=%d delay=%ss directory=%s\n",tasks,rounds,
+           getenv("FAKE_SOUMET_DELAY") != NULL ? getenv("FAKE_SOUMET_DELAY") : "0.2",directory);
+   fprintf(stdout,"%-14s %11s %10s %12s %8s\n","inflight","submissions","seconds","per second","missing");
+
+   missing += benchRun("1", exp, tasks, rounds, 1);
+   snprintf(name, sizeof(name), "%d", inflight);
+   missing += benchRun(name, exp, tasks, rounds, inflight);
+   fprintf(stdout,"submissions %s\n", missing == 0 ? "identical" : "DIFFER");
+
+   snprintf(command, sizeof(command), "rm -rf %s", exp);
+   system(command);
+   return( missing == 0 ? 0 : 1 );
+}
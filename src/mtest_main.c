@@ -21,6 +21,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
 #include <libxml/tree.h>
@@ -33,6 +36,15 @@
 #include "getopt.h"
 #include "SeqNode.h"
 #include "XmlUtils.h"
+#include "SeqStateStore.h"
+#include "ExpSnapshot.h"
+#include "SeqLoopMap.h"
+#include "SeqStatusSnapshot.h"
+#include "SeqRateLimit.h"
+#include "TsvManifest.h"
+#include "tsvinfo.h"
+#include "SeqLogSpool.h"
+#include "SeqLogIndex.h"
 
 static char * testDir = NULL;
 int MLLServerConnectionFid=0;
@@ -517,6 +529,256 @@ int test_SeqLoops_getNodeLoopContainersExtensionsInReverse()
    return 0;
 }
 
+int test_SeqLoops_space()
+{
+   header("SeqLoops_space");
+   char extension[SEQ_MAXFIELD];
+   SeqNodeDataPtr ndp = SeqNode_createNode("/main/loop");
+   SeqLoopSpacePtr space = NULL;
+   SeqLoopIterator itr;
+   SeqLoopsPtr loopsPtr = NULL;
+   int count = 0;
+
+   ndp->type = Loop;
+   free(ndp->nodeName);
+   ndp->nodeName = strdup("loop");
+   ndp->extension = strdup("");
+   SeqNode_addSpecificData(ndp, "EXPRESSION", "1:5:2:1,5:9:2:1,20:22:1:1");
+
+   /* TEST : the iterations of the expression, the shared one given once */
+   space = SeqLoops_childSpace(ndp);
+   SeqLoops_iteratorInit(&itr, space, 1);
+   while( SeqLoops_iteratorNext(&itr, extension, sizeof extension) )
+      if( count++ == 0 && strcmp(extension, "+22") != 0 )
+         raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   if( space->count != 8 || count != 8 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : rank and membership without going through the iterations */
+   if( SeqLoops_spaceRank(space, "+7") != 3 || SeqLoops_spaceRank(space, "+21") != 6 ||
+       SeqLoops_spaceRank(space, "+4") != -1 || SeqLoops_spaceRank(space, "+7+1") != -1 ||
+       SeqLoops_spaceExtension(space, 4, extension, sizeof extension) != 2 || strcmp(extension, "+9") != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   SeqLoops_freeSpace(space);
+
+   /* TEST : a dependency index, its wildcards going over the loops */
+   loopsPtr = SeqNode_allocateLoopsEntry(ndp);
+   loopsPtr->type = SwitchType;
+   loopsPtr->loop_name = strdup("/main/sw");
+   SeqNameValues_insertItem(&loopsPtr->values, "VALUE", "00");
+   space = SeqLoops_containerSpace(ndp, "sw=*,outer=3,loop=*");
+   if( space->count != 8 || SeqLoops_spaceRank(space, "+00+3+20") != 5 ||
+       SeqLoops_spaceExtension(space, 7, extension, sizeof extension) != 8 ||
+       strcmp(extension, "+00+3+22") != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   SeqLoops_freeSpace(space);
+
+   SeqNode_freeNode(ndp);
+   return 0;
+}
+
+/* the status files of test_SeqLoopMap(), the flags of the iterations +1, +3, +5, +7 */
+static int loopMapScan(const char *extension, void *arg)
+{
+   const int *flags = arg;
+   return flags[(atoi(extension + 1) - 1) / 2];
+}
+
+int test_SeqLoopMap()
+{
+   header("SeqLoopMap");
+   char path[SEQ_MAXFIELD];
+   SeqNodeDataPtr ndp = SeqNode_createNode("/main/loop");
+   SeqLoopSpacePtr space = NULL;
+   unsigned long done = 0, aborted = 0;
+   int flags[4] = { SEQ_LOOPMAP_DONE, 0, SEQ_LOOPMAP_ABORTED, 0 };
+   FILE *fp = fopen("/dev/null", "w");
+
+   ndp->type = Loop;
+   free(ndp->nodeName);
+   ndp->nodeName = strdup("loop");
+   ndp->extension = strdup("");
+   SeqNode_addSpecificData(ndp, "START", "1");
+   SeqNode_addSpecificData(ndp, "END", "5");
+   SeqNode_addSpecificData(ndp, "STEP", "2");
+   space = SeqLoops_childSpace(ndp);
+   snprintf(path, sizeof path, "/tmp/mtest_loopmap_%d.%s", getpid(), SEQ_LOOPMAP_SUFFIX);
+
+   /* TEST : setting a missing map leaves it to the status files */
+   if( SeqLoopMap_set(path, space, "+3", SEQ_LOOPMAP_DONE) != 0 || access(path, F_OK) == 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : the map is built from the status files the first time */
+   if( SeqLoopMap_counts(path, space, loopMapScan, flags, &done, &aborted) != 0 || done != 1 || aborted != 1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : then kept by the state changes, without the status files */
+   flags[1] = SEQ_LOOPMAP_DONE;
+   flags[2] = SEQ_LOOPMAP_DONE;
+   if( SeqLoopMap_set(path, space, "+3", SeqLoopMap_stateFlags("end")) != 0 ||
+       SeqLoopMap_set(path, space, "+5", SeqLoopMap_stateFlags("abort.cont")) != 0 ||
+       SeqLoopMap_counts(path, space, NULL, NULL, &done, &aborted) != 0 || done != 3 || aborted != 0 ||
+       SeqLoopMap_verify(path, space, loopMapScan, flags, fp) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : the verification finds a map that differs from the status files and fixes it */
+   if( SeqLoopMap_set(path, space, "+1", SeqLoopMap_stateFlags("begin")) != 0 ||
+       SeqLoopMap_verify(path, space, loopMapScan, flags, fp) != 1 ||
+       SeqLoopMap_counts(path, space, NULL, NULL, &done, &aborted) != 0 || done != 3 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   SeqLoops_freeSpace(space);
+
+   /* TEST : another loop space makes the map stale, built again */
+   SeqNameValues_setValue(&ndp->data, "END", "7");
+   space = SeqLoops_childSpace(ndp);
+   if( SeqLoopMap_set(path, space, "+7", SEQ_LOOPMAP_DONE) != 0 ||
+       SeqLoopMap_counts(path, space, loopMapScan, flags, &done, &aborted) != 0 || space->count != 4 || done != 3 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   if( SeqLoopMap_remove(path) != 0 || access(path, F_OK) == 0 || SeqLoopMap_remove(path) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : a map that cannot be opened is an error, not a missing map */
+   if( mkdir(path, 0755) != 0 || SeqLoopMap_set(path, space, "+7", SEQ_LOOPMAP_DONE) == 0 || rmdir(path) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   fclose(fp);
+   SeqLoops_freeSpace(space);
+   SeqNode_freeNode(ndp);
+   return 0;
+}
+
+int test_SeqStatusSnapshot()
+{
+   header("SeqStatusSnapshot");
+   char dir[SEQ_MAXFIELD], path[SEQ_MAXFIELD], command[SEQ_MAXFIELD];
+   const char *files[] = { "npass.+1.end", "npass.+2.end", "npass.+2.begin", "npass.+last.end", "npass2.+1.submit",
+                           "task.end", "task.+1.waiting.interUser", "other.abort.stop" };
+   unsigned int i;
+   FILE *fp;
+
+   snprintf(dir, sizeof dir, "/tmp/mtest_snapshot_%d", getpid());
+   mkdir(dir, 0755);
+   for( i = 0; i < sizeof(files) / sizeof(files[0]); i++ ) {
+      snprintf(path, sizeof path, "%s/%s", dir, files[i]);
+      if( (fp = fopen(path, "w")) != NULL ) fclose(fp);
+   }
+
+   /* TEST : the status files of a node.ext, the other files go to the file system */
+   snprintf(path, sizeof path, "%s/npass.+2.begin", dir);
+   if( SeqStatusSnapshot_exists(path) != 1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   snprintf(path, sizeof path, "%s/npass.+1.begin", dir);
+   if( SeqStatusSnapshot_exists(path) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   snprintf(path, sizeof path, "%s/task.+1.waiting.interUser", dir);
+   if( SeqStatusSnapshot_exists(path) != -1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : the iterations of a node in some states, not those of another node with the same start */
+   snprintf(path, sizeof path, "%s/npass.+", dir);
+   if( SeqStatusSnapshot_count(path, SEQ_SNAP_END) != 3 ||
+       SeqStatusSnapshot_count(path, SEQ_SNAP_SUBMIT|SEQ_SNAP_BEGIN|SEQ_SNAP_ABORTSTOP) != 1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : a snapshot is kept until invalidated */
+   snprintf(path, sizeof path, "%s/npass.+2.begin", dir);
+   unlink(path);
+   if( SeqStatusSnapshot_exists(path) != 1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   SeqStatusSnapshot_invalidate();
+   if( SeqStatusSnapshot_exists(path) != 0 || SeqStatusSnapshot_state("abort.stop") != SEQ_SNAP_ABORTSTOP )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : a missing directory has no status files */
+   snprintf(path, sizeof path, "%s/missing/task.end", dir);
+   if( SeqStatusSnapshot_exists(path) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   SeqStatusSnapshot_invalidate();
+   snprintf(command, sizeof command, "rm -rf %s", dir);
+   system(command);
+   return 0;
+}
+
+/* whether no window of the sorted submission times has more than burst + rate * window submissions, slack aside */
+static int rateRespected( const double *times, int count, double rate, double burst, double slack )
+{
+   int i, j;
+
+   for( i = 0; i < count; i++ ) {
+      for( j = i; j < count; j++ ) {
+         if( j - i + 1 > burst + rate * (times[j] - times[i]) + slack + 1e-9 ) return 0;
+      }
+   }
+   return 1;
+}
+
+static int compareTimes( const void *a, const void *b )
+{
+   double d = *(const double *) a - *(const double *) b;
+   return (d > 0) - (d < 0);
+}
+
+int test_SeqRateLimit()
+{
+   header("SeqRateLimit");
+   SeqRateBucket bucket = { 10.0, 0.0 };
+   char dir[SEQ_MAXFIELD], path[SEQ_MAXFIELD], log[SEQ_MAXFIELD], line[64], command[SEQ_MAXFIELD];
+   double times[40], now, delay, start;
+   int i, n, fd, submitters = 3, each = 8;
+   pid_t pid;
+   FILE *fp;
+
+   /* TEST : simulation, 30 submissions at once then 10 after a pause, rate 2/s and burst 10 */
+   for( i = 0; i < 40; i++ ) {
+      now = i < 30 ? 0.0 : 100.0;
+      times[i] = now + SeqRateLimit_reserve(&bucket, 2.0, 10.0, now);
+   }
+   if( times[9] != 0.0 || times[10] != 0.5 || times[29] != 10.0 || times[30] != 100.0 || times[39] != 100.0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   if( ! rateRespected(times, 40, 2.0, 10.0, 0.0) )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : a rate of 0 is no limit */
+   if( SeqRateLimit_reserve(&bucket, 0.0, 10.0, 100.0) != 0.0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : fake submitters sharing a bucket file record the times of their submissions */
+   snprintf(dir, sizeof dir, "/tmp/mtest_ratelimit_%d", getpid());
+   mkdir(dir, 0755);
+   snprintf(path, sizeof path, "%s/%s", dir, SEQ_RATE_BUCKET);
+   snprintf(log, sizeof log, "%s/submissions", dir);
+   start = SeqRateLimit_now();
+   for( n = 0; n < submitters; n++ ) {
+      if( (pid = fork()) == 0 ) {
+         fd = open(log, O_WRONLY|O_CREAT|O_APPEND, 0644);
+         for( i = 0; i < each; i++ ) {
+            if( (delay = SeqRateLimit_take(path, 40.0, 4.0, SeqRateLimit_now())) > 0.0 ) usleep((useconds_t) (1000000 * delay));
+            snprintf(line, sizeof line, "%.6f\n", SeqRateLimit_now() - start);
+            write(fd, line, strlen(line));
+         }
+         close(fd);
+         _exit(0);
+      }
+      if( pid < 0 ) raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   }
+   while( wait(NULL) > 0 );
+   n = 0;
+   if( (fp = fopen(log, "r")) != NULL ) {
+      while( n < 40 && fscanf(fp, "%lf", &times[n]) == 1 ) n++;
+      fclose(fp);
+   }
+   qsort(times, n, sizeof(double), compareTimes);
+   /* a token every 25ms once the burst is spent, a submitter late by a tick at most */
+   if( n != submitters * each || ! rateRespected(times, n, 40.0, 4.0, 2.0) || times[n - 1] < (n - 4) / 40.0 - 0.01 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   snprintf(command, sizeof command, "rm -rf %s", dir);
+   system(command);
+   return 0;
+}
+
 const char* getVarName(const char *, const char*,const char *);
 int test_getVarName()
 {
@@ -535,6 +797,493 @@ int test_getVarName()
    return 0;
 }
 
+int test_SeqUtil_stateFiles()
+{
+   header("SeqUtil_stateFiles()");
+   char stale[SEQ_STATE_FILES][SEQ_MAXFIELD], newfile[SEQ_MAXFIELD];
+   int count = 0;
+
+   /* TEST : an end clears every other state and the abort intermediates but
+    * keeps the npass end */
+   if( SeqUtil_stateFiles("exp=/x datestamp=20160102030000 node=/a/t ext=+1 state=end npass=",
+                          stale, &count, newfile) != 0 || count != 6 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   if( strcmp(newfile,"/x/sequencing/status/20160102030000//a/t.+1.end") != 0 ||
+       strcmp(stale[0],"/x/sequencing/status/20160102030000//a/t.+1.begin") != 0 ||
+       strcmp(stale[5],"/x/sequencing/status/20160102030000//a/t.+1.abort.cont") != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : an init creates nothing, the npass end of an iteration goes away */
+   if( SeqUtil_stateFiles("exp=/x datestamp=20160102030000 node=/a/t ext= state=init npass=.+2",
+                          stale, &count, newfile) != 0 || count != 6 || newfile[0] != '\0' ||
+       strcmp(stale[5],"/x/sequencing/status/20160102030000//a/t.+2.end") != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : unknown states are refused */
+   if( SeqUtil_stateFiles("exp=/x datestamp=20160102030000 node=/a/t ext= state=abort./../t",
+                          stale, &count, newfile) == 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : status files longer than SEQ_MAXFIELD are refused, not truncated */
+   char request[2 * SEQ_MAXFIELD], exp[SEQ_MAXFIELD];
+   memset(exp, 'x', sizeof exp - 8);
+   exp[0] = '/';
+   exp[sizeof exp - 8] = '\0';
+   snprintf(request, sizeof request, "exp=%s datestamp=20160102030000 node=/a/t ext= state=end", exp);
+   if( SeqUtil_stateFiles(request, stale, &count, newfile) == 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   return 0;
+}
+
+int test_SeqStateStore()
+{
+   header("SeqStateStore");
+   char exp[SEQ_MAXFIELD], dir[SEQ_MAXFIELD], path[SEQ_MAXFIELD], request[SEQ_MAXFIELD], removed[SEQ_MAXFIELD];
+
+   snprintf(exp, sizeof exp, "/tmp/mtest_store_%d", getpid());
+   snprintf(dir, sizeof dir, "%s/sequencing/status/20160102030000", exp);
+   snprintf(path, sizeof path, "%s/a", dir);
+   SeqUtil_mkdir_nfs(path, 1, NULL);
+
+   /* TEST : the status file already there is imported when the store is created */
+   snprintf(path, sizeof path, "%s/a/t.+1.end", dir);
+   touch_nfs(path, NULL);
+   snprintf(request, sizeof request, "exp=%s datestamp=20160102030000 node=/a/t ext=+1 state=begin", exp);
+   if( setNodeState_store(request, removed, sizeof removed, NULL) != 0 || strcmp(removed, "t.+1.end") != 0 ||
+       isFileExists_store(path, "mtest", NULL) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : the states are found through the store, the pattern of globPath too */
+   snprintf(path, sizeof path, "%s//a/t.+1.begin", dir);
+   if( isFileExists_store(path, "mtest", NULL) != 1 || access_nfs(path, R_OK, NULL) == 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   snprintf(path, sizeof path, "%s/a/t.+*.begin", dir);
+   if( globPath_store(path, 0, 0, NULL) != 1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : the export writes the status files of the store */
+   snprintf(path, sizeof path, "%s/a/t.+1.begin", dir);
+   if( SeqStateStore_export(dir) != 2 || access_nfs(path, R_OK, NULL) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   SeqStateStore_close();
+   snprintf(request, sizeof request, "rm -rf %s", exp);
+   system(request);
+   return 0;
+}
+
+static void writeTestFile( const char *path, const char *content )
+{
+   FILE *fp = fopen(path, "w");
+   if( fp == NULL )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   fputs(content, fp);
+   fclose(fp);
+}
+
+int test_ExpSnapshot()
+{
+   header("ExpSnapshot");
+   char exp[SEQ_MAXFIELD], path[SEQ_MAXFIELD], snapshot[SEQ_MAXFIELD];
+   SeqNodeDataPtr ndp = NULL;
+
+   snprintf(exp, sizeof exp, "/tmp/mtest_snapshot_%d", getpid());
+   snprintf(path, sizeof path, "%s/modules/main", exp);
+   SeqUtil_mkdir_nfs(path, 1, NULL);
+   snprintf(path, sizeof path, "%s/resources/main", exp);
+   SeqUtil_mkdir_nfs(path, 1, NULL);
+   snprintf(path, sizeof path, "%s/sequencing", exp);
+   SeqUtil_mkdir_nfs(path, 1, NULL);
+   snprintf(path, sizeof path, "%s/EntryModule", exp);
+   symlink("modules/main", path);
+   snprintf(path, sizeof path, "%s/modules/main/flow.xml", exp);
+   writeTestFile(path, "<MODULE name=\"main\"><TASK name=\"a\"/>"
+                       "<TASK name=\"b\"><DEPENDS_ON dep_name=\"a\"/></TASK></MODULE>\n");
+   snprintf(path, sizeof path, "%s/resources/resources.def", exp);
+   writeTestFile(path, "SEQ_DEFAULT_MACHINE=mtest\n");
+   snprintf(path, sizeof path, "%s/resources/main/b.xml", exp);
+   writeTestFile(path, "<NODE_RESOURCES><BATCH cpu=\"3\" queue=\"q\"/></NODE_RESOURCES>\n");
+
+   ExpSnapshot_begin(exp);
+   ndp = nodeinfo("/main/b", NI_SHOW_ALL, NULL, exp, NULL, "20160102030000", NULL);
+   if( ExpSnapshot_addNode(ndp) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   SeqNode_freeNode(ndp);
+   snprintf(snapshot, sizeof snapshot, "%s/%s", exp, EXPSNAP_FILE);
+   if( ExpSnapshot_write(snapshot) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : the node comes from the snapshot with its resources and dependencies */
+   ndp = SeqNode_createNode("/main/b");
+   SeqNode_setSeqExpHome(ndp, exp);
+   if( ExpSnapshot_getNode(ndp, exp, NULL, NULL, NULL) != 0 || strcmp(ndp->cpu, "3") != 0 ||
+       strcmp(ndp->machine, "mtest") != 0 || ndp->dependencies == NULL ||
+       strcmp(ndp->dependencies->depData->node_name, "a") != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   SeqNode_freeNode(ndp);
+
+   /* TEST : a node missing from the snapshot goes to the xml files */
+   ndp = SeqNode_createNode("/main/a");
+   if( ExpSnapshot_getNode(ndp, exp, NULL, NULL, NULL) != 1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   SeqNode_freeNode(ndp);
+
+   /* TEST : once one of its files changed, the node is read from the xml files */
+   snprintf(path, sizeof path, "%s/resources/main/b.xml", exp);
+   writeTestFile(path, "<NODE_RESOURCES><BATCH cpu=\"4\" queue=\"qq\"/></NODE_RESOURCES>\n");
+   ndp = nodeinfo("/main/b", NI_SHOW_ALL, NULL, exp, NULL, "20160102030000", NULL);
+   if( strcmp(ndp->cpu, "4") != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   SeqNode_freeNode(ndp);
+
+   ExpSnapshot_close();
+   snprintf(path, sizeof path, "rm -rf %s", exp);
+   system(path);
+   return 0;
+}
+
+int test_XmlUtils_borrowdoc()
+{
+   header("XmlUtils_borrowdoc");
+   char path[SEQ_MAXFIELD];
+   xmlDocPtr doc1 = NULL, doc2 = NULL, doc3 = NULL;
+   int parsed1, parsed2, parsed3;
+
+   snprintf(path, sizeof path, "/tmp/mtest_borrowdoc_%d.xml", getpid());
+   writeTestFile(path, "<MODULE name=\"main\"/>\n");
+
+   /* TEST : the second borrower gets the document parsed for the first one */
+   doc1 = XmlUtils_borrowdoc(path, NULL, &parsed1);
+   doc2 = XmlUtils_borrowdoc(path, NULL, &parsed2);
+   if( doc1 == NULL || doc1 != doc2 || parsed1 != 1 || parsed2 != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : the document resolved with a definition file is another one */
+   doc3 = XmlUtils_borrowdoc(path, "/tmp/mtest.def", &parsed3);
+   if( doc3 == NULL || doc3 == doc1 || parsed3 != 1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   XmlUtils_releasedoc(doc3);
+   XmlUtils_releasedoc(doc2);
+
+   /* TEST : a changed file is parsed again, the old document stays with its borrower */
+   writeTestFile(path, "<MODULE name=\"other\"/>\n");
+   doc2 = XmlUtils_borrowdoc(path, NULL, &parsed2);
+   if( doc2 == NULL || doc2 == doc1 || parsed2 != 1 ||
+       strcmp((const char *) xmlDocGetRootElement(doc1)->name, "MODULE") != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   XmlUtils_releasedoc(doc1);
+   XmlUtils_releasedoc(doc2);
+
+   unlink(path);
+   return 0;
+}
+
+/* writes the tsv file of exp at path, with manifest if not NULL */
+static void writeTsv( const char *exp, const char *path, const char *manifest )
+{
+   FILE *fp = fopen(path, "w");
+   if( fp == NULL )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   write_db_file(exp, "20160102030000", fp, NULL, 1, manifest);
+   fclose(fp);
+   /* the definition files mapped by this process are not checked for changes */
+   SeqUtil_unmapfiles();
+}
+
+static int sameTestFiles( const char *a, const char *b )
+{
+   char command[SEQ_MAXFIELD];
+   snprintf(command, sizeof command, "cmp -s %s %s", a, b);
+   return system(command) == 0;
+}
+
+int test_TsvManifest()
+{
+   header("TsvManifest");
+   char exp[SEQ_MAXFIELD], path[SEQ_MAXFIELD], tsv[SEQ_MAXFIELD], full[SEQ_MAXFIELD], manifest[SEQ_MAXFIELD];
+   char *tsvRecord = NULL, *hrRecord = NULL;
+   size_t tsvLen, hrLen;
+   TsvInputs inputs;
+   TsvManifest *m = NULL;
+
+   memset(&inputs, '\0', sizeof inputs);
+   snprintf(exp, sizeof exp, "/tmp/mtest_manifest_%d", getpid());
+   snprintf(path, sizeof path, "%s/modules/main", exp);
+   SeqUtil_mkdir_nfs(path, 1, NULL);
+   snprintf(path, sizeof path, "%s/resources/main", exp);
+   SeqUtil_mkdir_nfs(path, 1, NULL);
+   snprintf(path, sizeof path, "%s/EntryModule", exp);
+   symlink("modules/main", path);
+   snprintf(path, sizeof path, "%s/modules/main/flow.xml", exp);
+   writeTestFile(path, "<MODULE name=\"main\"><SUBMITS sub_name=\"a\"/><SUBMITS sub_name=\"b\"/>"
+                       "<TASK name=\"a\"/><TASK name=\"b\"/></MODULE>\n");
+   snprintf(path, sizeof path, "%s/resources/resources.def", exp);
+   writeTestFile(path, "SEQ_DEFAULT_MACHINE=mtest\nQ_A=qa\nQ_B=qb\n");
+   snprintf(path, sizeof path, "%s/resources/main/a.xml", exp);
+   writeTestFile(path, "<NODE_RESOURCES><BATCH cpu=\"2\" queue=\"${Q_A}\"/></NODE_RESOURCES>\n");
+   snprintf(path, sizeof path, "%s/resources/main/b.xml", exp);
+   writeTestFile(path, "<NODE_RESOURCES><BATCH cpu=\"3\" queue=\"${Q_B}\"/></NODE_RESOURCES>\n");
+   snprintf(tsv, sizeof tsv, "%s/tsv.txt", exp);
+   snprintf(full, sizeof full, "%s/full.txt", exp);
+   snprintf(manifest, sizeof manifest, "%s%s", tsv, TSV_MANIFEST_EXT);
+
+   /* TEST : the output with a manifest is the output without one */
+   writeTsv(exp, tsv, manifest);
+   writeTsv(exp, full, NULL);
+   if( ! sameTestFiles(tsv, full) || access(manifest, R_OK) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : a key of resources.def changes only the node using it */
+   snprintf(path, sizeof path, "%s/resources/resources.def", exp);
+   writeTestFile(path, "SEQ_DEFAULT_MACHINE=mtest\nQ_A=qa\nQ_B=other\n");
+   m = TsvManifest_load(manifest, exp, "20160102030000");
+   if( TsvManifest_reuse(m, "/main/a", Task, &tsvRecord, &tsvLen, &hrRecord, &hrLen, &inputs) != 1 ||
+       strstr(tsvRecord, "{queue qa}") == NULL || inputs.nfiles != 1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   if( TsvManifest_reuse(m, "/main/b", Task, &tsvRecord, &tsvLen, &hrRecord, &hrLen, &inputs) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   /* TEST : nor is a node kept when its type changed */
+   if( TsvManifest_reuse(m, "/main/a", Family, &tsvRecord, &tsvLen, &hrRecord, &hrLen, &inputs) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   free(tsvRecord);
+   free(hrRecord);
+   TsvInputs_free(&inputs);
+   TsvManifest_free(m);
+
+   /* TEST : after a key and a resource file changed, the rebuild is a full build */
+   snprintf(path, sizeof path, "%s/resources/main/a.xml", exp);
+   writeTestFile(path, "<NODE_RESOURCES><BATCH cpu=\"12\" queue=\"${Q_A}\"/></NODE_RESOURCES>\n");
+   writeTsv(exp, tsv, manifest);
+   writeTsv(exp, full, NULL);
+   if( ! sameTestFiles(tsv, full) )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : a manifest that cannot be read has all the nodes resolved */
+   writeTestFile(manifest, "tsvinfo manifest 1\nexp /elsewhere\n");
+   writeTsv(exp, tsv, manifest);
+   if( ! sameTestFiles(tsv, full) )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   snprintf(path, sizeof path, "rm -rf %s", exp);
+   system(path);
+   return 0;
+}
+
+/* the line number seq of the fake writer w, long enough to show a cut line */
+static void spoolLine( char *buf, size_t size, int w, int seq ) {
+   snprintf(buf, size, "TIMESTAMP=20150101.00:00:00:SEQNODE=/spool/writer_%d:MSGTYPE=info:SEQMSG=%04d %0200d\n", w, seq, w);
+}
+
+int test_SeqLogSpool()
+{
+   header("SeqLogSpool");
+   char dir[SEQ_MAXFIELD], log[SEQ_MAXFIELD], path[SEQ_MAXFIELD], host[32], line[512], expected[512];
+   int writers = 6, each = 300, running, w, seq, i, fd, last[6], seen[6][300];
+   pid_t pid;
+   FILE *fp;
+
+   snprintf(dir, sizeof dir, "/tmp/mtest_spool_%d", getpid());
+   mkdir(dir, 0755);
+   snprintf(log, sizeof log, "%s/20150101000000_nodelog", dir);
+
+   /* TEST : no spool, nothing to merge */
+   if( SeqLogSpool_merge(log) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : writers of 3 hosts, two per host, append while the spool is merged */
+   for( w = 0; w < writers; w++ ) {
+      if( (pid = fork()) == 0 ) {
+         snprintf(host, sizeof host, "host%d", w % 3);
+         for( seq = 0; seq < each; seq++ ) {
+            spoolLine(line, sizeof line, w, seq);
+            if( SeqLogSpool_append(log, host, line) != 0 ) _exit(1);
+         }
+         _exit(0);
+      }
+      if( pid < 0 ) raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   }
+   for( running = writers; running > 0; ) {
+      if( SeqLogSpool_merge(log) < 0 )
+         raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+      while( running > 0 && waitpid(-1, &i, WNOHANG) > 0 ) {
+         if( ! WIFEXITED(i) || WEXITSTATUS(i) != 0 )
+            raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+         running--;
+      }
+      usleep(1000);
+   }
+   SeqLogSpool_merge(log);
+
+   /* every line once, whole, and in the order of its writer */
+   memset(seen, '\0', sizeof seen);
+   for( w = 0; w < writers; w++ ) last[w] = -1;
+   if( (fp = fopen(log, "r")) == NULL )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   while( fgets(line, sizeof line, fp) != NULL ) {
+      if( sscanf(line, "TIMESTAMP=20150101.00:00:00:SEQNODE=/spool/writer_%d:MSGTYPE=info:SEQMSG=%d", &w, &seq) != 2
+          || w < 0 || w >= writers || seq < 0 || seq >= each )
+         raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+      spoolLine(expected, sizeof expected, w, seq);
+      if( strcmp(line, expected) != 0 || seq <= last[w] || seen[w][seq]++ != 0 )
+         raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+      last[w] = seq;
+   }
+   fclose(fp);
+   for( w = 0; w < writers; w++ )
+      if( last[w] != each - 1 )
+         raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : merged lines are not merged again, a line being written waits for its end */
+   if( SeqLogSpool_merge(log) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   snprintf(path, sizeof path, "%s%s/host0", log, SEQ_LOG_SPOOL_EXT);
+   fd = open(path, O_WRONLY|O_APPEND);
+   write(fd, "1.000001 TIMESTAMP=partial", 26);
+   if( SeqLogSpool_merge(log) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   write(fd, "\n", 1);
+   close(fd);
+   if( SeqLogSpool_merge(log) != 1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   snprintf(path, sizeof path, "rm -rf %s", dir);
+   system(path);
+   return 0;
+}
+
+#define IDX_TEST_LINES 6000
+#define IDX_TEST_NODES 40
+
+/* what the readers of SeqLogIndex gave, in their order */
+typedef struct {
+   off_t offsets[IDX_TEST_LINES];
+   int n, states, stamp;
+} IndexSeen;
+
+static int indexSeen( const SeqLogRecord *rec, void *arg ) {
+   IndexSeen *seen = (IndexSeen *) arg;
+
+   seen->offsets[seen->n++] = rec->offset;
+   /* line 0 of the test log is an abortx of 2015-01-01 00:00:00 UTC */
+   if( rec->offset == 0 && rec->state == SEQ_LOG_ABORT && rec->time == 1420070400 && strcmp(rec->ext, "") == 0 ) seen->stamp++;
+   if( rec->state == SEQ_LOG_OTHER ) seen->states++;
+   return 0;
+}
+
+/* the offsets of the latest line of every node and extension, of the lines of node */
+static void indexExpected( const off_t *offsets, const int *keys, int lines, int node, IndexSeen *latest, IndexSeen *history ) {
+   int i, k, last[IDX_TEST_NODES * 3];
+
+   for( k = 0; k < IDX_TEST_NODES * 3; k++ ) last[k] = -1;
+   latest->n = history->n = 0;
+   for( i = 0; i < lines; i++ ) {
+      last[keys[i]] = i;
+      if( keys[i] / 3 == node ) history->offsets[history->n++] = offsets[i];
+   }
+   for( i = 0; i < lines; i++ )
+      if( last[keys[i]] == i ) latest->offsets[latest->n++] = offsets[i];
+}
+
+static int indexSame( const IndexSeen *a, const IndexSeen *b ) {
+   return a->n == b->n && memcmp(a->offsets, b->offsets, a->n * sizeof(off_t)) == 0;
+}
+
+/* the lines of the test log from first to lines, with their offset and key */
+static void indexLog( const char *log, off_t *offsets, int *keys, int first, int lines ) {
+   static const char *types[] = { "abortx", "submit", "begin", "end", "info", "initbranch", "wait", "mystery" };
+   char ext[16];
+   FILE *fp = fopen(log, "a");
+   int i, node;
+
+   for( i = first; i < lines; i++ ) {
+      node = (i * 7) % IDX_TEST_NODES;
+      keys[i] = node * 3 + (i / 5) % 3;
+      snprintf(ext, sizeof ext, "%d", keys[i] % 3);
+      offsets[i] = ftell(fp);
+      if( keys[i] % 3 == 0 )
+         fprintf(fp, "TIMESTAMP=20150101.%02d:%02d:%02d:SEQNODE=/main/n%d:MSGTYPE=%s:SEQMSG=line %d\n",
+                 i / 3600, (i / 60) % 60, i % 60, node, types[i % 8], i);
+      else
+         fprintf(fp, "TIMESTAMP=20150101.%02d:%02d:%02d:SEQNODE=/main/n%d:MSGTYPE=%s:SEQLOOP=+%s:SEQMSG=line %d\n",
+                 i / 3600, (i / 60) % 60, i % 60, node, types[i % 8], ext, i);
+   }
+   fclose(fp);
+}
+
+int test_SeqLogIndex()
+{
+   header("SeqLogIndex");
+   char dir[SEQ_MAXFIELD], log[SEQ_MAXFIELD], path[SEQ_MAXFIELD];
+   static off_t offsets[IDX_TEST_LINES];
+   static int keys[IDX_TEST_LINES];
+   static IndexSeen latest, history, expLatest, expHistory;
+   SeqLogIndex *idx;
+   FILE *fp;
+
+   snprintf(dir, sizeof dir, "/tmp/mtest_index_%d", getpid());
+   mkdir(dir, 0755);
+   snprintf(log, sizeof log, "%s/20150101000000_nodelog", dir);
+   indexLog(log, offsets, keys, 0, 3000);
+
+   /* TEST : without an index the nodelog is read as text */
+   indexExpected(offsets, keys, 3000, 1, &expLatest, &expHistory);
+   latest.n = history.n = latest.states = 0;
+   if( SeqLogIndex_latest(log, indexSeen, &latest) != expLatest.n || ! indexSame(&latest, &expLatest) ||
+       SeqLogIndex_history(log, "/main/n1", indexSeen, &history) != expHistory.n || ! indexSame(&history, &expHistory) )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : indexed in several segments, then lines beyond the index and a line being written */
+   if( (idx = SeqLogIndex_open(log)) == NULL || SeqLogIndex_update(idx) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   indexLog(log, offsets, keys, 3000, 3500);
+   fp = fopen(log, "a");
+   fprintf(fp, "not a nodelog line\nTIMESTAMP=20150101.23:00:00:SEQNODE=/main/n1:MSGTYPE=end");
+   fclose(fp);
+   indexExpected(offsets, keys, 3500, 1, &expLatest, &expHistory);
+   latest.n = history.n = latest.states = 0;
+   if( SeqLogIndex_latest(log, indexSeen, &latest) != expLatest.n || ! indexSame(&latest, &expLatest) ||
+       SeqLogIndex_history(log, "/main/n1", indexSeen, &history) != expHistory.n || ! indexSame(&history, &expHistory) )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   /* mystery is no state of maestro */
+   if( latest.states == 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   history.n = history.stamp = 0;
+   if( SeqLogIndex_history(log, "/main/n0", indexSeen, &history) <= 0 || history.stamp != 1 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : another writer goes on with the index, the end of the line being written is indexed */
+   fp = fopen(log, "a");
+   fprintf(fp, ":SEQMSG=done\n");
+   offsets[3500] = ftell(fp) - strlen("TIMESTAMP=20150101.23:00:00:SEQNODE=/main/n1:MSGTYPE=end:SEQMSG=done\n");
+   keys[3500] = 1 * 3;
+   fclose(fp);
+   SeqLogIndex_close(idx);
+   if( (idx = SeqLogIndex_open(log)) == NULL || SeqLogIndex_update(idx) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   indexExpected(offsets, keys, 3501, 1, &expLatest, &expHistory);
+   latest.n = history.n = 0;
+   if( SeqLogIndex_latest(log, indexSeen, &latest) != expLatest.n || ! indexSame(&latest, &expLatest) ||
+       SeqLogIndex_history(log, "/main/n1", indexSeen, &history) != expHistory.n || ! indexSame(&history, &expHistory) ||
+       SeqLogIndex_history(log, "/main/n99", indexSeen, &history) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+
+   /* TEST : a nodelog replaced by a shorter one has its index built again */
+   unlink(log);
+   indexLog(log, offsets, keys, 0, 1200);
+   if( SeqLogIndex_update(idx) != 0 )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   indexExpected(offsets, keys, 1200, 2, &expLatest, &expHistory);
+   latest.n = history.n = 0;
+   if( SeqLogIndex_latest(log, indexSeen, &latest) != expLatest.n || ! indexSame(&latest, &expLatest) ||
+       SeqLogIndex_history(log, "/main/n2", indexSeen, &history) != expHistory.n || ! indexSame(&history, &expHistory) )
+      raiseError("TEST_FAILED:%s()[%s:%d]\n",__func__,__FILE__,__LINE__);
+   SeqLogIndex_close(idx);
+
+   snprintf(path, sizeof path, "rm -rf %s", dir);
+   system(path);
+   return 0;
+}
+
 int runTests(const char * seq_exp_home, const char * node, const char * datestamp)
 {
    test_xml_fallback();
@@ -548,9 +1297,20 @@ int runTests(const char * seq_exp_home, const char * node, const char * datestam
    test_parseNodeDFS();
    test_Resource_parseWorkerPath();
    test_SeqLoops_getNodeLoopContainersExtensionsInReverse();
+   test_SeqLoops_space();
+   test_SeqLoopMap();
+   test_SeqStatusSnapshot();
+   test_SeqRateLimit();
 
 
    test_getVarName();
+   test_SeqUtil_stateFiles();
+   test_SeqStateStore();
+   test_ExpSnapshot();
+   test_XmlUtils_borrowdoc();
+   test_TsvManifest();
+   test_SeqLogSpool();
+   test_SeqLogIndex();
 
    SeqUtil_TRACE(TL_CRITICAL, "============== ALL TESTS HAVE PASSED =====================\n");
    return 0;
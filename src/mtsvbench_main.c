@@ -0,0 +1,321 @@
+/* mtsvbench_main.c - Benchmark of the tsvinfo database of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "getopt.h"
+#include "SeqUtil.h"
+#include "tsvinfo.h"
+
+int MLLServerConnectionFid=0;
+
+static void printUsage()
+{
+   char * usage = "\
+DESCRIPTION: mtsvbench\n\
+\n\
+        Benchmark of the database of tsvinfo.  A fake experiment gets families\n\
+        of tasks and a loop each, every node with its resource file using the\n\
+        definitions of resources.def and depending on its previous sibling.\n\
+        The tsv and human readable files are written with 1 thread resolving\n\
+        the resources of the nodes, then with each number of threads given;\n\
+        the files must be identical to those of 1 thread.  Then the files are\n\
+        written with a manifest (tsvinfo -i), again with nothing changed, and\n\
+        again after a task resource file and a key of resources.def used by\n\
+        the loops changed; the files must be identical to a full rebuild.\n\
+\n\
+USAGE\n\
+\n\
+    mtsvbench [-f families] [-n tasks] [-j threads,...] [-d directory]\n\
+\n\
+OPTIONS\n\
+\n\
+    -f, --families\n\
+        Number of families (default 50)\n\
+\n\
+    -n, --tasks\n\
+        Number of tasks per family (default 40)\n\
+\n\
+    -j, --threads\n\
+        Numbers of threads compared with 1, separated by commas (default 4,16)\n\
+\n\
+    -d, --directory\n\
+        Directory where the fake experiment is created (default /tmp)\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+OUTPUT\n\
+\n\
+    One line per number of threads and per incremental run: elapsed seconds,\n\
+    speedup over 1 thread and whether the files are identical.\n";
+puts(usage);
+}
+
+static const char *Datestamp = "20150101000000";
+
+static double elapsedSince( struct timeval *t0 )
+{
+   struct timeval t1;
+   gettimeofday(&t1,NULL);
+   return (t1.tv_sec - t0->tv_sec) + (t1.tv_usec - t0->tv_usec) / 1.0e6;
+}
+
+static FILE *createFile( const char *path )
+{
+   FILE *fp;
+
+   if ( (fp = fopen(path,"w")) == NULL ) {
+      fprintf(stderr,"mtsvbench: cannot create %s\n",path);
+      exit(1);
+   }
+   return fp;
+}
+
+static void makeDir( const char *path )
+{
+   if ( SeqUtil_mkdir_nfs(path, 1, NULL) != 0 ) {
+      fprintf(stderr,"mtsvbench: cannot create %s\n",path);
+      exit(1);
+   }
+}
+
+/* the fake experiment exp: families of tasks and a loop */
+static void makeExperiment( const char *exp, int families, int tasks )
+{
+   char path[SEQ_MAXFIELD];
+   FILE *fp, *flow;
+   int f, t;
+
+   snprintf(path, sizeof(path), "%s/modules/main", exp);
+   makeDir(path);
+   snprintf(path, sizeof(path), "%s/EntryModule", exp);
+   symlink("modules/main", path);
+   snprintf(path, sizeof(path), "%s/resources/resources.def", exp);
+   makeDir(path);
+   rmdir(path);
+   fp = createFile(path);
+   fprintf(fp, "SEQ_DEFAULT_MACHINE=localhost\nBENCH_QUEUE=development\nBENCH_MEMORY=800M\nBENCH_CPU=4x2\n");
+   fclose(fp);
+
+   snprintf(path, sizeof(path), "%s/modules/main/flow.xml", exp);
+   flow = createFile(path);
+   fprintf(flow, "<MODULE name=\"main\">\n");
+   for ( f = 0; f < families; f++ ) fprintf(flow, "  <SUBMITS sub_name=\"family_%d\"/>\n", f);
+   for ( f = 0; f < families; f++ ) {
+      fprintf(flow, "  <FAMILY name=\"family_%d\">\n    <SUBMITS sub_name=\"task_0\"/>\n    <SUBMITS sub_name=\"loop\"/>\n", f);
+      for ( t = 0; t < tasks; t++ ) fprintf(flow, "    <TASK name=\"task_%d\"/>\n", t);
+      fprintf(flow, "    <LOOP name=\"loop\">\n      <SUBMITS sub_name=\"inner\"/>\n      <TASK name=\"inner\"/>\n    </LOOP>\n  </FAMILY>\n");
+
+      snprintf(path, sizeof(path), "%s/resources/main/family_%d/loop", exp, f);
+      makeDir(path);
+      snprintf(path, sizeof(path), "%s/resources/main/family_%d/container.xml", exp, f);
+      fp = createFile(path);
+      fprintf(fp, "<NODE_RESOURCES>\n  <BATCH catchup=\"%d\"/>\n</NODE_RESOURCES>\n", f % 9);
+      fclose(fp);
+      snprintf(path, sizeof(path), "%s/resources/main/family_%d/loop/container.xml", exp, f);
+      fp = createFile(path);
+      fprintf(fp, "<NODE_RESOURCES>\n  <LOOP start=\"0\" end=\"%d\" step=\"1\" set=\"2\"/>\n</NODE_RESOURCES>\n", f + 1);
+      fclose(fp);
+      snprintf(path, sizeof(path), "%s/resources/main/family_%d/loop/inner.xml", exp, f);
+      fp = createFile(path);
+      fprintf(fp, "<NODE_RESOURCES>\n  <BATCH cpu=\"${BENCH_CPU}\" wallclock=\"3\"/>\n</NODE_RESOURCES>\n");
+      fclose(fp);
+
+      for ( t = 0; t < tasks; t++ ) {
+         snprintf(path, sizeof(path), "%s/resources/main/family_%d/task_%d.xml", exp, f, t);
+         fp = createFile(path);
+         fprintf(fp, "<NODE_RESOURCES>\n  <BATCH cpu=\"%d\" queue=\"${BENCH_QUEUE}\" memory=\"${BENCH_MEMORY}\" wallclock=\"%d\" mpi=\"%d\"/>\n",
+                 1 + t % 8, 5 + t, t % 2);
+         if ( t > 0 ) fprintf(fp, "  <DEPENDS_ON dep_name=\"task_%d\" status=\"end\" type=\"node\"/>\n", t - 1);
+         fprintf(fp, "  <ABORT_ACTION name=\"rerun\"/>\n</NODE_RESOURCES>\n");
+         fclose(fp);
+      }
+   }
+   fprintf(flow, "</MODULE>\n");
+   fclose(flow);
+}
+
+/* writes the database with threads threads in tsv and hr (with manifest if not NULL), returns the elapsed seconds */
+static double benchRun( const char *exp, int threads, const char *tsv, const char *hr, const char *manifest )
+{
+   struct timeval t0;
+   FILE *tsvFp = createFile(tsv), *hrFp = createFile(hr);
+   double elapsed;
+
+   gettimeofday(&t0,NULL);
+   write_db_file(exp, Datestamp, tsvFp, hrFp, threads, manifest);
+   fclose(tsvFp);
+   fclose(hrFp);
+   elapsed = elapsedSince(&t0);
+   return elapsed;
+}
+
+/* whether the files at a and b have the same bytes */
+static int sameFiles( const char *a, const char *b )
+{
+   FILE *fa = fopen(a,"r"), *fb = fopen(b,"r");
+   int ca = EOF, cb = EOF, same = ( fa != NULL && fb != NULL );
+
+   while ( same && (ca = getc(fa)) == (cb = getc(fb)) && ca != EOF );
+   same = same && ca == cb;
+   if ( fa != NULL ) fclose(fa);
+   if ( fb != NULL ) fclose(fb);
+   return same;
+}
+
+/* rewrites the file at path with the first occurrence of from replaced by to */
+static void editFile( const char *path, const char *from, const char *to )
+{
+   char content[SEQ_MAXFIELD], *at;
+   FILE *fp = fopen(path,"r");
+   size_t len = 0;
+
+   if ( fp != NULL ) {
+      len = fread(content, 1, sizeof(content) - 1, fp);
+      fclose(fp);
+   }
+   content[len] = '\0';
+   if ( (at = strstr(content, from)) == NULL ) {
+      fprintf(stderr,"mtsvbench: %s has no %s\n",path,from);
+      exit(1);
+   }
+   fp = createFile(path);
+   fprintf(fp, "%.*s%s%s", (int) (at - content), content, to, at + strlen(from));
+   fclose(fp);
+}
+
+/* the runs with a manifest, each compared with a full rebuild; returns whether the files were identical */
+static int benchIncremental( const char *exp, double elapsed1, const char *tsv1, const char *hr1 )
+{
+   char tsv[SEQ_MAXFIELD], hr[SEQ_MAXFIELD], manifest[SEQ_MAXFIELD], path[SEQ_MAXFIELD];
+   const char *names[] = { "manifest", "unchanged", "2 inputs" };
+   double elapsed;
+   int run, same, allSame = 1;
+
+   snprintf(tsv, sizeof(tsv), "%s/tsv.incremental", exp);
+   snprintf(hr, sizeof(hr), "%s/hr.incremental", exp);
+   snprintf(manifest, sizeof(manifest), "%s/tsv.incremental.manifest", exp);
+   for ( run = 0; run < 3; run++ ) {
+      if ( run == 2 ) {
+         snprintf(path, sizeof(path), "%s/resources/main/family_0/task_1.xml", exp);
+         editFile(path, "cpu=\"2\"", "cpu=\"12\"");
+         snprintf(path, sizeof(path), "%s/resources/resources.def", exp);
+         editFile(path, "BENCH_CPU=4x2", "BENCH_CPU=8x2");
+         /* the definition files mapped by this process are not checked for changes */
+         SeqUtil_unmapfiles();
+         elapsed1 = benchRun(exp, 1, tsv1, hr1, NULL);
+      }
+      elapsed = benchRun(exp, 1, tsv, hr, manifest);
+      same = sameFiles(tsv1, tsv) && sameFiles(hr1, hr);
+      allSame = allSame && same;
+      fprintf(stdout,"%-8s %10.3f %8.2f %10s\n", names[run], elapsed, elapsed1 / elapsed, same ? "identical" : "DIFFER");
+      fflush(stdout);
+   }
+   return allSame;
+}
+
+int main ( int argc, char * argv[] )
+{
+   char * short_opts = "f:n:j:d:h";
+
+   extern char *optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+
+      {"families"       , required_argument,   0,     'f'},
+      {"tasks"          , required_argument,   0,     'n'},
+      {"threads"        , required_argument,   0,     'j'},
+      {"directory"      , required_argument,   0,     'd'},
+      {"help"           , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+
+   char *directory = "/tmp", *threadList = "4,16", *list = NULL, *token = NULL, *saveptr = NULL;
+   char exp[SEQ_MAXFIELD/2], tsv1[SEQ_MAXFIELD], hr1[SEQ_MAXFIELD], tsv[SEQ_MAXFIELD], hr[SEQ_MAXFIELD], command[SEQ_MAXFIELD];
+   int families = 50, tasks = 40, threads, same, allSame = 1;
+   double elapsed1, elapsed;
+   struct stat st;
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index )) != -1) {
+      switch(c) {
+         case 'f':
+            families = atoi(optarg);
+            break;
+         case 'n':
+            tasks = atoi(optarg);
+            break;
+         case 'j':
+            threadList = optarg;
+            break;
+         case 'd':
+            directory = optarg;
+            break;
+         case 'h':
+            printUsage();
+            exit(0);
+         case '?':
+            exit(1);
+      }
+   }
+
+   if ( families <= 0 || tasks <= 0 ) {
+      printUsage();
+      exit(1);
+   }
+   if ( stat(directory,&st) != 0 || ! S_ISDIR(st.st_mode) ) {
+      fprintf(stderr,"mtsvbench: %s is not a directory\n",directory);
+      exit(1);
+   }
+   snprintf(exp, sizeof(exp), "%s/mtsvbench_%d", directory, getpid());
+   makeExperiment(exp, families, tasks);
+   snprintf(tsv1, sizeof(tsv1), "%s/tsv.1", exp);
+   snprintf(hr1, sizeof(hr1), "%s/hr.1", exp);
+
+   fprintf(stdout,"families=%d tasks=%d nodes=%d directory=%s\n",families,tasks,families * (tasks + 3) + 1,directory);
+   fprintf(stdout,"%-8s %10s %8s %10s\n","threads","seconds","speedup","files");
+
+   elapsed1 = benchRun(exp, 1, tsv1, hr1, NULL);
+   fprintf(stdout,"%-8d %10.3f %8.2f %10s\n", 1, elapsed1, 1.0, "reference");
+   fflush(stdout);
+
+   list = strdup(threadList);
+   for ( token = strtok_r(list, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr) ) {
+      if ( (threads = atoi(token)) <= 0 ) continue;
+      snprintf(tsv, sizeof(tsv), "%s/tsv.%d", exp, threads);
+      snprintf(hr, sizeof(hr), "%s/hr.%d", exp, threads);
+      elapsed = benchRun(exp, threads, tsv, hr, NULL);
+      same = sameFiles(tsv1, tsv) && sameFiles(hr1, hr);
+      allSame = allSame && same;
+      fprintf(stdout,"%-8d %10.3f %8.2f %10s\n", threads, elapsed, elapsed1 / elapsed, same ? "identical" : "DIFFER");
+      fflush(stdout);
+   }
+   free(list);
+
+   allSame = benchIncremental(exp, elapsed1, tsv1, hr1) && allSame;
+
+   snprintf(command, sizeof(command), "rm -rf %s", exp);
+   system(command);
+   return( allSame ? 0 : 1 );
+}
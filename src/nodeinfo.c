@@ -37,6 +37,7 @@
 #include "SeqLoopsUtil.h"
 #include "FlowVisitor.h"
 #include "ResourceVisitor.h"
+#include "ExpSnapshot.h"
 
 /* root node of xml resource file */
 const char* NODE_RES_XML_ROOT = "/NODE_RESOURCES";
@@ -124,14 +125,14 @@ void parseBatchResources (xmlXPathObjectPtr _result, SeqNodeDataPtr _nodeDataPtr
 
 /********************************************************************************
  * Takes a string of the form "...$((var_name))..." and returns the string
- * "var_name". Non-reentrant see file var_name_extract.c for testing of this
- * function.
+ * "var_name". Non-reentrant, the buffer is the thread's; see file
+ * var_name_extract.c for testing of this function.
 ********************************************************************************/
 const char* getVarName(const char *src, const char *startDelim,
                                         const char *endDelim)
 {
 
-   static char var_name[256];
+   static __thread char var_name[256];
 
    char *start = NULL;
    char *end = NULL;
@@ -616,6 +617,7 @@ void getRootNode( SeqNodeDataPtr _nodeDataPtr, const char *_seq_exp_home ) {
    xmlXPathContextPtr context = NULL;
    const xmlChar *nodeName = NULL;
    xmlNodePtr nodePtr;
+   int parsed;
 
    xmlFile = malloc( strlen( _seq_exp_home ) + strlen( "/EntryModule/flow.xml" ) + 1 );
 
@@ -623,7 +625,7 @@ void getRootNode( SeqNodeDataPtr _nodeDataPtr, const char *_seq_exp_home ) {
    sprintf( xmlFile, "%s/EntryModule/flow.xml", _seq_exp_home);
 
    /* parse the xml file */
-   if ((doc = XmlUtils_getdoc(xmlFile)) == NULL) {
+   if ((doc = XmlUtils_borrowdoc(xmlFile, NULL, &parsed)) == NULL) {
       raiseError("Unable to parse file, or file not found: %s\n", xmlFile);
    }
 
@@ -646,7 +648,7 @@ void getRootNode( SeqNodeDataPtr _nodeDataPtr, const char *_seq_exp_home ) {
    }
    xmlXPathFreeObject (result);
    xmlXPathFreeContext (context);
-   xmlFreeDoc(doc);
+   XmlUtils_releasedoc(doc);
    free( xmlFile );
 }
 
@@ -816,8 +818,11 @@ SeqNodeDataPtr nodeinfo ( const char* node, unsigned int filters,
    } else {
       /* add loop arg list to node */
       SeqNode_setLoopArgs( nodeDataPtr,_loops);
-      getFlowInfo ( nodeDataPtr, _exp_home, newNode,switch_args,filters);
-      getNodeResources(nodeDataPtr,_exp_home, newNode);
+      /* the compiled snapshot of the experiment spares the xml files when it is current */
+      if ( ExpSnapshot_getNode( nodeDataPtr, _exp_home, _loops, extraArgs, switch_args ) != 0 ) {
+         getFlowInfo ( nodeDataPtr, _exp_home, newNode,switch_args,filters);
+         getNodeResources(nodeDataPtr,_exp_home, newNode);
+      }
 
    }
 
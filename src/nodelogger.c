@@ -37,22 +37,23 @@
 #include "nodelogger.h"
 #include "l2d2_socket.h"
 #include "SeqUtil.h"
+#include "SeqLogSpool.h"
 #include <libgen.h>
 #include <strings.h>
 
 #define NODELOG_BUFSIZE 1024
 #define NODELOG_FILE_LENGTH 512
-#define TIMEOUT_NFS_SYNC 3
 
 
 /* global variables */
-static char nodelogger_buf[NODELOG_BUFSIZE];
-static char nodelogger_buf_top[NODELOG_BUFSIZE];
-static char nodelogger_buf_short[NODELOG_BUFSIZE];
-static char nodelogger_buf_notify[NODELOG_BUFSIZE];
-static char nodelogger_buf_notify_short[NODELOG_BUFSIZE];
+/* the request for mserver, "M targets user:$exp/logs/datestamp:" followed by
+   the line of the logs (nodelogger_line), formatted once by gen_message */
+static char nodelogger_buf[2*NODELOG_BUFSIZE + 64];
+static char *nodelogger_line = nodelogger_buf;
 extern int MLLServerConnectionFid;
 extern int OpenConnectionToMLLServer (const char *, const char *, const char *);
+extern void CloseConnectionWithMLLServer (int);
+extern int Send_L2D2_Request (int, const char *);
 
 static char NODELOG_JOB[NODELOG_BUFSIZE];
 static char NODELOG_MESSAGE[NODELOG_BUFSIZE];
@@ -60,14 +61,13 @@ static char NODELOG_LOOPEXT[NODELOG_BUFSIZE];
 static char NODELOG_DATE[NODELOG_BUFSIZE];
 
 static char username[32];
-static char LOG_PATH[1024];
-static char TMP_LOG_PATH[1024];
-static char TOP_LOG_PATH[1024];
-
-static int write_line(int sock, int top, const char* type);
-static void gen_message (const char *job, const char *type, const char* loop_ext, const char *message);
-static int sync_nodelog_over_nfs(const char *job, const char *type, const char* loop_ext, const char *message, const char *dtstmp, const char *logtype, const char * _seq_exp_home);
-static  void NotifyUser (int sock , int top , char mode , const char* _seq_exp_home);
+static char LOG_PREFIX[1024];
+static char LOG_PATH[sizeof(LOG_PREFIX) + 16];
+static char TOP_LOG_PATH[sizeof(LOG_PREFIX) + 16];
+
+static int write_line(int sock, int targets);
+static void gen_message (const char *job, const char *type, const char* loop_ext, const char *message, int targets);
+static int spool_nodelog(int targets);
 extern char* str2md5 (const char *str, int length);
 
 static void log_alarm_handler() { fprintf(stderr,"=== EXCEEDED TIME IN LOOP ITERATIONS ===\n"); };
@@ -81,12 +81,11 @@ _FromWhere FromWhere;
  
 void nodelogger(const char *job, const char* type, const char* loop_ext, const char *message, const char* datestamp, const char* _seq_exp_home)
 {
-   int sock=-1,ret, write_ret;
+   int sock=-1,ret, failed, targets;
    char *tmpfrommaestro = NULL;
    char tmp[10];
    struct passwd *p, *p2;
    struct sigaction sa;
-   char *logtocreate = NULL;
    int pathcounter=0;
    char *pathelement=NULL, *tmpbuf=NULL;
 
@@ -95,8 +94,8 @@ void nodelogger(const char *job, const char* type, const char* loop_ext, const c
     
    SeqUtil_TRACE(TL_FULL_TRACE, "nodelogger job:%s signal:%s message:%s loop_ext:%s datestamp:%s exp:%s\n", job, type, message, loop_ext, datestamp, _seq_exp_home);
 
+   memset(LOG_PREFIX,'\0',sizeof LOG_PREFIX);
    memset(LOG_PATH,'\0',sizeof LOG_PATH);
-   memset(TMP_LOG_PATH,'\0',sizeof TMP_LOG_PATH);
    memset(TOP_LOG_PATH,'\0',sizeof TOP_LOG_PATH);
    memset(username,'\0',sizeof username);
 
@@ -117,9 +116,9 @@ void nodelogger(const char *job, const char* type, const char* loop_ext, const c
       exit(1);
    }
 
-   snprintf(LOG_PATH,sizeof(LOG_PATH),"%s/logs/%s_nodelog",_seq_exp_home,datestamp);
-   snprintf(TMP_LOG_PATH,sizeof(TMP_LOG_PATH),"%s/sequencing/sync/%s",_seq_exp_home,datestamp);
-   snprintf(TOP_LOG_PATH,sizeof(TOP_LOG_PATH),"%s/logs/%s_toplog",_seq_exp_home,datestamp);
+   snprintf(LOG_PREFIX,sizeof(LOG_PREFIX),"%s/logs/%s",_seq_exp_home,datestamp);
+   snprintf(LOG_PATH,sizeof(LOG_PATH),"%s_nodelog",LOG_PREFIX);
+   snprintf(TOP_LOG_PATH,sizeof(TOP_LOG_PATH),"%s_toplog",LOG_PREFIX);
 
     /* setup an alarm so that if the logging is stuck
      * it will timeout after 60 seconds. This will prevent the
@@ -145,19 +144,20 @@ void nodelogger(const char *job, const char* type, const char* loop_ext, const c
        pathelement=strtok(NULL, "/");
     }
 
+    /* the root node and the abort, event and info messages also go to the toplog */
+    targets = L2D2_LOG_NODELOG;
+    if ((pathcounter <= 1) || (strcmp(type, "abort") == 0) || (strcmp(type, "event") == 0) || (strcmp(type, "info") == 0) ) {
+      targets |= L2D2_LOG_TOPLOG;
+    }
+
     /* if called inside maestro, a connection is already open  */
     tmpfrommaestro = getenv("FROM_MAESTRO");
     if ( tmpfrommaestro == NULL ) {
        SeqUtil_TRACE(TL_MEDIUM, "\n================= NODELOGGER: NOT_FROM_MAESTRO signal:%s================== \n",type);
        FromWhere = FROM_NODELOGGER;
        if ( (sock=OpenConnectionToMLLServer( job , "LOG",_seq_exp_home )) < 0 ) { 
-          gen_message(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE);
-          if ((pathcounter <= 1) || (strcmp(type, "abort") == 0) || (strcmp(type, "event") == 0) || (strcmp(type, "info") == 0) ) {
-            logtocreate = "both";
-          } else {
-            logtocreate = "nodelog";
-          }
-          ret=sync_nodelog_over_nfs(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE, datestamp, logtocreate,_seq_exp_home);
+          gen_message(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE, targets);
+          ret=spool_nodelog(targets);
           return;
        }
        /* install SIGALRM handler */
@@ -179,13 +179,8 @@ void nodelogger(const char *job, const char* type, const char* loop_ext, const c
            FromWhere = FROM_MAESTRO_NO_SVR;
 	   if ( (sock=OpenConnectionToMLLServer( job , "LOG" , _seq_exp_home )) < 0 ) { 
                SeqUtil_TRACE(TL_MEDIUM, "\n================= NODELOGGER: CANNOT ACQUIRE CONNECTION FROM MAESTRO PROCESS signal:%s================== \n",type);
-               gen_message(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE);
-               if ((pathcounter <= 1) || (strcmp(type, "abort") == 0) || (strcmp(type, "event") == 0) || (strcmp(type, "info") == 0) ) {
-                 logtocreate = "both";
-               } else {
-                 logtocreate = "nodelog";
-               }
-               ret=sync_nodelog_over_nfs(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE, datestamp, logtocreate, _seq_exp_home);
+               gen_message(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE, targets);
+               ret=spool_nodelog(targets);
                return;
             } else {
                SeqUtil_TRACE(TL_MEDIUM, "\n================= ACQUIRED A NEW CONNECTION FROM NODELOGGER PROCESS ================== \n");
@@ -194,26 +189,15 @@ void nodelogger(const char *job, const char* type, const char* loop_ext, const c
     }
  
     /* if we are here socket is Up then why the second test > -1 ??? */ 
-    gen_message(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE);
+    gen_message(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE, targets);
     if ( sock > -1 ) {
-      if ((write_ret=write_line(sock, 0, type )) == -1) {
-        logtocreate = "nodelog";
-        ret=sync_nodelog_over_nfs(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE, datestamp, logtocreate, _seq_exp_home); 
+      /* the logs the server could not write get the line through the spool */
+      if ((failed=write_line(sock, targets)) != 0) {
+        ret=spool_nodelog(failed);
+        return;
       }
-      if ((pathcounter <= 1) || (strcmp(type, "abort") == 0) || (strcmp(type, "event") == 0) || (strcmp(type, "info") == 0) ) {
-         if ((write_ret=write_line(sock, 1, type )) == -1) {
-           logtocreate = "toplog";
-           ret=sync_nodelog_over_nfs(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE, datestamp, logtocreate, _seq_exp_home); 
-         }
-      }
-      if (write_ret == -1) return;
     } else {
-      if ((pathcounter <= 1) || (strcmp(type, "abort") == 0) || (strcmp(type, "event") == 0) || (strcmp(type, "info") == 0) ) {
-        logtocreate = "both";
-      } else {
-        logtocreate = "nodelog";
-      }
-      ret=sync_nodelog_over_nfs(NODELOG_JOB, type, loop_ext, NODELOG_MESSAGE, datestamp, logtocreate, _seq_exp_home);
+      ret=spool_nodelog(targets);
       return;
     }
         /* @@@@@@@@@@@@@@@@@@@@@@@@@@@@@ CRITICAL  : CLOSE SOCKET ONLY WHEN NOT ACQUIRED FROM MAESTRO @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@ */
@@ -222,8 +206,7 @@ void nodelogger(const char *job, const char* type, const char* loop_ext, const c
 
        case FROM_NODELOGGER:
        case FROM_MAESTRO_NO_SVR:
-	   ret=write(sock,"S \0",3);
-           close(sock);
+           CloseConnectionWithMLLServer(sock);
            SeqUtil_TRACE(TL_MEDIUM, "\n================= ClOSING CONNECTION FROM NODELOGGER PROCESS ================== \n");
 	   break;
        default:
@@ -233,64 +216,54 @@ void nodelogger(const char *job, const char* type, const char* loop_ext, const c
 
 
 /**
- * write a buffer to socket with timeout
- * and receive an ack 0 || 1
+ * send the line to the server with timeout and receive the acks:
+ * one request for all the targets when the connection is framed, one
+ * request per log otherwise (or if the server does not serve it).
+ * Returns the targets that could not be logged.
  */
-static int write_line(int sock, int top, const char* type)
+static int write_line(int sock, int targets)
 {
+   char request[NODELOG_BUFSIZE + sizeof(LOG_PATH) + 64];
+   int status, failed = 0;
 
-   int bytes_read, bytes_sent;
-   int fileid;
-   char bf[512];
-
-
-   memset(bf, '\0', sizeof(bf));
-   
-   if (top == 0) {
-     if ( ((bytes_sent=send_socket(sock , nodelogger_buf , sizeof(nodelogger_buf) , SOCK_TIMEOUT_CLIENT)) <= 0)) {
-        fprintf(stderr,"%%%%%%%%%%%% NODELOGGER: socket closed at send  %%%%%%%%%%%%%%\n");
-        return(-1);
+   if ( is_framed(sock) ) {
+     if ( (status=Send_L2D2_Request(sock, nodelogger_buf)) < 0 ) {
+       fprintf(stderr,"%%%%%%%%%%%% NODELOGGER: socket closed at send or recv  %%%%%%%%%%%%%%\n");
+       return(targets);
      }
-   } else {
-     /* create tolog file */
-     if ((fileid = open(TOP_LOG_PATH,O_WRONLY|O_CREAT,0755)) < 1 ) {
-                        fprintf(stderr,"Nodelogger: could not create toplog:%s\n",TOP_LOG_PATH);
-			/* return something */
-     }
-
-     if ( ((bytes_sent=send_socket(sock , nodelogger_buf_top , sizeof(nodelogger_buf_top) , SOCK_TIMEOUT_CLIENT)) <= 0)) {
-       fprintf(stderr,"%%%%%%%%%%%% NODELOGGER: socket closed at send  %%%%%%%%%%%%%%\n");
-       return(-1);
+     if ( status != 1 ) {
+       if ( status != 0 ) fprintf(stderr,"Nodelogger::write_line: status=%d nodelogger_buf=%s\n",status,nodelogger_buf);
+       return(status & targets);
      }
    }
 
-   if ( (bytes_read=recv_socket (sock , bf , sizeof(bf) , SOCK_TIMEOUT_CLIENT)) <= 0 ) {
-     fprintf(stderr,"%%%%%%%%%%%% NODELOGGER: socket closed at recv   %%%%%%%%%%%%%%\n");
-     return(-1);
+   if ( targets & L2D2_LOG_NODELOG ) {
+     snprintf(request,sizeof(request),"L %-7s:%s:%s",username,LOG_PATH,nodelogger_line);
+     if ( (status=Send_L2D2_Request(sock, request)) != 0 ) {
+       fprintf(stderr,"Nodelogger::write_line: Error=%s status=%d request=%s\n",strerror(errno),status,request);
+       failed |= L2D2_LOG_NODELOG;
+     }
    }
-   if ( bf[0] != '0' ) {
-     bf[bytes_read > 0 ? bytes_read : 0] = '\0';  
-     fprintf(stderr,"Nodelogger::write_line: Error=%s bf=%s nodelogger_buf=%s\n",strerror(errno),bf,nodelogger_buf);
-     return(-1);
+   if ( targets & L2D2_LOG_TOPLOG ) {
+     snprintf(request,sizeof(request),"L %-7s:%s:%s",username,TOP_LOG_PATH,nodelogger_line);
+     if ( (status=Send_L2D2_Request(sock, request)) != 0 ) {
+       fprintf(stderr,"Nodelogger::write_line: Error=%s status=%d request=%s\n",strerror(errno),status,request);
+       failed |= L2D2_LOG_TOPLOG;
+     }
    }
-   /* Notify user if he is using nfs mode, this will be done at begin and end of root node 
-      Note : we notify user when using inter-dependencies
-   if ( top != 0 && (strcmp(type,"begin") == 0 || strcmp(type,"endx") == 0 ) ) NotifyUser ( sock , top ,'S', _seq_exp_home  );  */
-   
-
-   return(0);
+   return(failed);
 }
 
 /* gen_message: write a formatted log message */
 
-static void gen_message (const char *node,const char *type,const char* loop_ext, const char* message)
+static void gen_message (const char *node,const char *type,const char* loop_ext, const char* message, int targets)
 {
 
     time_t time();
     time_t timval;
 
-    char nodepath[100];
     int c_month, c_day, c_hour, c_min, c_sec, c_year;
+    int hlen, len, size;
 
 
     struct tm *tmptr;
@@ -307,293 +280,54 @@ static void gen_message (const char *node,const char *type,const char* loop_ext,
     c_min   = tmptr->tm_min;
     c_sec   = tmptr->tm_sec;
 
-    memset(nodepath, '\0', sizeof nodepath);
-
-    /* write the message into "nodelogger_buf", which will be sent to a socket if server up */
-    memset(nodelogger_buf, '\0', NODELOG_BUFSIZE );
-    memset(nodelogger_buf_short, '\0', NODELOG_BUFSIZE );
-    memset(nodelogger_buf_notify, '\0', NODELOG_BUFSIZE );
-    memset(nodelogger_buf_notify_short, '\0', NODELOG_BUFSIZE );
     SeqUtil_TRACE(TL_FULL_TRACE, "\nNODELOGGER node:%s type:%s message:%s\n", node, type, message );
 
+    /* the header of the request to the server, then the line itself right after it */
+    hlen = snprintf(nodelogger_buf,sizeof(nodelogger_buf),"M %d %s:%s:",targets,username,LOG_PREFIX);
+    nodelogger_line = nodelogger_buf + hlen;
+    size = NODELOG_BUFSIZE;
+
     if ( loop_ext != NULL ) {
-        snprintf(nodelogger_buf,sizeof(nodelogger_buf),"L %-7s:%s:TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=%s:SEQLOOP=%s:SEQMSG=%s\n",username,LOG_PATH,c_year,c_month,c_day,c_hour,c_min,c_sec,node,type,loop_ext,message);
-	snprintf(nodelogger_buf_top,sizeof(nodelogger_buf_top),"L %-7s:%s:TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=%s:SEQLOOP=%s:SEQMSG=%s\n",username,TOP_LOG_PATH,c_year,c_month,c_day,c_hour,c_min,c_sec,node,type,loop_ext,message);
-        snprintf(nodelogger_buf_short,sizeof(nodelogger_buf_short),"TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=%s:SEQLOOP=%s:SEQMSG=%s\n",c_year,c_month,c_day,c_hour,c_min,c_sec,node,type,loop_ext,message);
-	 snprintf(nodelogger_buf_notify,sizeof(nodelogger_buf_notify),"L %-7s:%s:TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=info:SEQLOOP=%s:SEQMSG=",username,LOG_PATH,c_year,c_month,c_day,c_hour,c_min,c_sec,node,loop_ext); 
-         snprintf(nodelogger_buf_notify_short,sizeof(nodelogger_buf_notify_short),"TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=info:SEQLOOP=%s:SEQMSG=",c_year,c_month,c_day,c_hour,c_min,c_sec,node,loop_ext); 
+        len = snprintf(nodelogger_line,size,"TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=%s:SEQLOOP=%s:SEQMSG=%s\n",c_year,c_month,c_day,c_hour,c_min,c_sec,node,type,loop_ext,message);
     } else {
-        snprintf(nodelogger_buf,sizeof(nodelogger_buf),"L %-7s:%s:TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=%s:SEQMSG=%s\n",username,LOG_PATH,c_year,c_month,c_day,c_hour,c_min,c_sec,node,type,message);
-	snprintf(nodelogger_buf_top,sizeof(nodelogger_buf_top),"L %-7s:%s:TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=%s:SEQMSG=%s\n",username,TOP_LOG_PATH,c_year,c_month,c_day,c_hour,c_min,c_sec,node,type,message);
-        snprintf(nodelogger_buf_short,sizeof(nodelogger_buf_short),"TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=%s:SEQMSG=%s\n",c_year,c_month,c_day,c_hour,c_min,c_sec,node,type,message);
-	snprintf(nodelogger_buf_notify,sizeof(nodelogger_buf_notify),"L %-7s:%s:TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=info:SEQMSG=",username,LOG_PATH,c_year,c_month,c_day,c_hour,c_min,c_sec,node); 
-        snprintf(nodelogger_buf_notify_short,sizeof(nodelogger_buf_notify_short),"TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=info:SEQMSG=",c_year,c_month,c_day,c_hour,c_min,c_sec,node); 
+        len = snprintf(nodelogger_line,size,"TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=%s:SEQMSG=%s\n",c_year,c_month,c_day,c_hour,c_min,c_sec,node,type,message);
     }
-    /* root node is NOT a loop node , no need to duplicate under loop_ext 
-    snprintf(nodelogger_buf_notify,sizeof(nodelogger_buf_notify),"L %-7s:%s:TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=info:SEQMSG=",username,LOG_PATH,c_year,c_month,c_day,c_hour,c_min,c_sec,node);
-    snprintf(nodelogger_buf_notify_short,sizeof(nodelogger_buf_notify_short),"TIMESTAMP=%.4d%.2d%.2d.%.2d:%.2d:%.2d:SEQNODE=%s:MSGTYPE=info:SEQMSG=",c_year,c_month,c_day,c_hour,c_min,c_sec,node);
-    */
-    
+    /* a line cut short still ends the line */
+    if ( len >= size ) nodelogger_line[size-2] = '\n';
 }
 
 
 
 /**
-  *  Synchronize clients logging to Experiment nodelog file
-  *  author : Rochdi Lahlou, cmoi 2013
-  *  Algo   : hypotheses : nfs 2+, garanties that link and rename are atomic
-  *           build on this to make clients writes to nodelog file based 
-  *           on a timed round robin methods. 
-  *
-  *
-  *
+  *  Log to the nodelog and/or the toplog (targets) without mserver: the line
+  *  goes to the spool segment of this host, merged into the log by logreader
+  *  or mserver, so that clients of several hosts never wait on each other
+  *  (see SeqLogSpool.h).
   */
-static int sync_nodelog_over_nfs (const char *node, const char * type, const char * loop_ext, const char * message, const char * datestamp, const char *logtype, const char * _seq_exp_home)
+static int spool_nodelog (int targets)
 {
-    FILE *fd;
-    struct stat fileStat;
-    int fileid,num,nb,my_turn,ret,status=0;
-    int success=0, loop=0;
-    unsigned int pid;
-    struct stat st;
-    static DIR *dp = NULL;
-    struct dirent *d;
-    time_t now;
-    char *truehost=NULL, *path_status=NULL, *mversion=NULL;
-    char resolved[MAXPATHLEN];
-    char host[128], lock[1024],flock[1024],lpath[1024];
-    char Stime[40],Etime[40],Atime[40];
-    char ffilename[1024],filename[256];
-    char host_pid[64],TokenHostPid[256],underline[2];
-    double Tokendate,date;
-    double diff_t;
-
-    SeqUtil_TRACE(TL_FULL_TRACE,"sync_nodelog_over_nfs(): Called\n");
-
-    if (logtype == "both") {
-       sync_nodelog_over_nfs(node,type,loop_ext,message,datestamp,"nodelog", _seq_exp_home);
-       sync_nodelog_over_nfs(node,type,loop_ext,message,datestamp,"toplog", _seq_exp_home);
-       return(0);
-    }
-    
-    /* get user parameters */
-    if (  (getpwnam(username)) == NULL ) {
-        fprintf(stderr, " Nodelogger::Cannot get user:%s passwd parameters\n",username);
-        return (1); 
-    }
-    /* get host , pid */
-    gethostname(host, sizeof(host));
-    pid = getpid();
-     
+    char *truehost=NULL;
+    char host[128];
+    int ret=0;
+
+    SeqUtil_TRACE(TL_FULL_TRACE,"spool_nodelog(): Called\n");
+
     /* env TRUE HOST should be defined */
     if ( (truehost=getenv("TRUE_HOST")) == NULL ) {
-       fprintf(stderr, "Nodelogger::Cannot get env. var TRUE_HOST\n");
+       memset(host,'\0',sizeof(host));
+       gethostname(host, sizeof(host) - 1);
        truehost=host;
     }
- 
-    /* env MAESTRO_VERSION */
-    if ( (mversion=getenv("SEQ_MAESTRO_VERSION")) == NULL ) {
-        fprintf(stderr, "Nodelogger::Cannot get env. var SEQ_MAESTRO_VERSION\n");
-    }
- 
-    /* env SEQ_EXP_HOME */
-    if ( _seq_exp_home == NULL ) {
-        fprintf(stderr,"Nodelogger::_seq_exp_home cannot be NULL...\n");
-        exit (1);
-    }
- 
-    /* construct a unique bucket name  */
-    memset(lock,'\0', sizeof(lock));
-    memset(flock,'\0', sizeof(flock));
-    memset(lpath,'\0', sizeof(lpath));
- 
-    /* I need an xp Inode */
-    if ( (path_status=realpath(_seq_exp_home,resolved)) == NULL ) {
-       fprintf(stderr,"Nodelogger::Probleme avec _seq_exp_home=%s\n",_seq_exp_home);
-       return (-1);
-    } 
- 						     
-    /* get inode */
-    if (stat(resolved,&fileStat) < 0) {
-       fprintf(stderr,"Nodelogger::Cannot stat on path=%s\n",resolved);
-       return (-1);
-    }
-     
-    /* create sync directory if not there */
-    snprintf(lpath,sizeof(lpath),"%s/v%s",TMP_LOG_PATH,mversion);
-    if ( access(lpath,R_OK) != 0 ) status=SeqUtil_mkdir_nfs(lpath , 1, NULL);
-     
-    snprintf(lock,sizeof(lock),"%s/v%s/node_logger_lock",TMP_LOG_PATH,mversion);
- 
-    get_time(Stime,3);
-    Tokendate = atof(Stime);
-    snprintf (flock,sizeof(flock),"%s/%s_%s_%u",lpath,Stime,host,pid);
-     
-    SeqUtil_TRACE(TL_FULL_TRACE, "\nToken date=%s host=%s pid=%u flock=%s\n",Stime,host,pid,flock);
-
-    sprintf (TokenHostPid,"%s_%u",host,pid);
-    
-    if ( (fd=fopen(flock,"w+")) == NULL ) {
-       fprintf(stderr,"Nodelogger::could not open filename:%s\n",flock);
-       /* decide what to do here */ 
-       return(-1);
-    } else {
-       fclose(fd);
-    }
 
-    time(&now);
-    alarm(TIMEOUT_NFS_SYNC);
-    get_time(Stime,3);
-    while ( loop < 500 ) {
-       if ( (dp=opendir(lpath)) == NULL ) {
-          fprintf(stderr,"Nodelogger::Cannot open dir:%s\n",lpath);
-          loop=loop+1;
-          usleep(100);
-          continue; 
-       }
-       while ( d=readdir(dp)) {
-          snprintf(ffilename,sizeof(ffilename),"%s/%s",lpath,d->d_name);
-          snprintf(filename,sizeof(filename),"%s",d->d_name);
- 
-          if ( stat(ffilename,&st) != 0 ) { continue; }
-	      if ( ( st.st_mode & S_IFMT ) == S_IFREG ) {
- 	       /* skip hidden files */
- 	          if ( filename[0] == '.' ) continue;
-              nb = sscanf(filename,"%lf%1[_]%s",&date,underline,host_pid);
-              if ( nb == 3 ) {
-                  if (  strcmp(TokenHostPid,host_pid) == 0 ) {
-                      my_turn = 1;
-                      continue;
-                  }
-                  if ( Tokendate > date ) {
-                     /* modif time should  be less than 2 sec */
-                     if ( (stat(ffilename,&st)) < 0 ) {
- 	                    continue;
- 	                 }
- 		             if ( (diff_t=difftime(now,st.st_mtime)) > 2 ) {
-						SeqUtil_TRACE(TL_FULL_TRACE, "Removed old token file %s \n",ffilename);
- 		                ret=unlink(ffilename); /* token file should be removed */
- 		             }
- 		             my_turn = 0;
- 		             break;
- 		          } else {
- 		             my_turn = 1;
- 	 	          }
-              }
-         }
-      } /* first while */
-      
-      if ( my_turn == 1 ) {
-          if ( (status=link(flock,lock)) == -1 ) {
-          /*  have to examine the life of the lock to see if it's belong to a living process */
-            if ( (lstat(lock,&st)) < 0 ) {
- 	        continue;
-            } else if ( (diff_t=difftime(now,st.st_mtime)) > 2 ) {
-               SeqUtil_TRACE(TL_FULL_TRACE, "Removed old lock file %s \n",lock);
- 			   ret=unlink(lock); /* lock file removed */
-            }
-         } else {
- 	         get_time(Atime,3);
-             if ( logtype == "toplog" ) {
-                 if ((fileid = open(TOP_LOG_PATH,O_WRONLY|O_CREAT,0755)) < 1 ) {
-                    fprintf(stderr,"Nodelogger::could not open toplog:%s\n",TOP_LOG_PATH);
-                 } else {
- 	                off_t s_seek=lseek(fileid, 0, SEEK_END);
-		            num = write(fileid, nodelogger_buf_short, strlen(nodelogger_buf_short));
-		            fsync(fileid);
-		            close(fileid);
- 	                ret=unlink(lock);
- 	                ret=unlink(flock);
-                    closedir(dp);
-		            success=1;
-		            break;
-                 }
-		     } else {
-                if ( (fileid = open(LOG_PATH,O_WRONLY|O_CREAT,0755)) < 1 ) {
-                    fprintf(stderr,"Nodelogger::could not open filename:%s\n",LOG_PATH);
-                } else {
- 	                off_t s_seek=lseek(fileid, 0, SEEK_END);
-		            num = write(fileid, nodelogger_buf_short, strlen(nodelogger_buf_short));
-		            fsync(fileid);
-		            close(fileid);
- 	                ret=unlink(lock);
- 	                ret=unlink(flock);
-                    closedir(dp);
- 	                success=1;
-		            break;
-                }
-            }
-        }
-      } else {
-         /* update own modif time to signal other that still active */
-         ret=utime(flock,NULL);
-      }
- 
-      loop++;
-      closedir(dp);
+    if ( (targets & L2D2_LOG_NODELOG) && SeqLogSpool_append(LOG_PATH, truehost, nodelogger_line) != 0 ) {
+       fprintf(stderr,"Nodelogger::could not spool nodelog line for host:%s\n",truehost);
+       ret=1;
     }
-    get_time(Etime,3);
-    if ( success == 1 ) { 
-       fprintf(stderr,"Nodelogger NFS_SYNC::Started at:%s Grabbed at:%s Ended at:%s tries=%d\n",Stime,Atime,Etime,loop);
-    } else  {
-       /* erase the lock  will lower load on the remaining clients */
-       ret=unlink(flock);
-       fprintf(stderr,"Nodelogger NFS_SYNC DID NOT GET the lock Started at:%s Ended at:%s tries=%d\n",Stime,Etime,loop);
+    if ( (targets & L2D2_LOG_TOPLOG) && SeqLogSpool_append(TOP_LOG_PATH, truehost, nodelogger_line) != 0 ) {
+       fprintf(stderr,"Nodelogger::could not spool toplog line for host:%s\n",truehost);
+       ret=1;
     }
-    /* Notify user if server not running  here we are at the level of root node so
-       Only one task (root Node) is running
-       Note : we notify user when using inter-dependencies
-    if ( (strcmp(logtype,"toplog") == 0)  && (strcmp(type,"begin") == 0 || strcmp(type,"endx") == 0 ) ) NotifyUser ( -1 , 1 ,'N', _seq_exp_home); */
-    
-    SeqUtil_TRACE(TL_FULL_TRACE,"sync_nodelog_over_nfs(): returning\n");
-    alarm(0);
-    return(0);
-}
-
-/** 
-* Notify User if he is using nfs mode, This notification will happen twice a run :
-* in the beginning and end of root Node
-*/
-static void NotifyUser (int sock , int top , char mode, const char * _seq_exp_home)
-{
-   char bf[512];
-   char *rcfile, *lmech ;
-   int bytes_sent, bytes_read, fileid, num;
-
-   if ( top != 0 ) {
-         if ( (rcfile=malloc( strlen (getenv("HOME")) + strlen("/.maestrorc") + 2 )) != NULL ) {
-	     sprintf(rcfile, "%s/.maestrorc", getenv("HOME"));
-        if ( (lmech=SeqUtil_getdef( rcfile, "SEQ_LOGGING_MECH", _seq_exp_home )) != NULL ) {
-		  switch ( mode ) {
-		        case 'S': /* mserver is up but logging mechanism is through NFS */
-			         strcat(nodelogger_buf_notify,"Please initialize SEQ_LOGGING_MECH=server in ~/.maestrorc file\n");
-	                         if ( strcmp(lmech,"nfs") == 0 ) {
-                                     if ( ((bytes_sent=send_socket(sock , nodelogger_buf_notify , sizeof(nodelogger_buf_notify) , SOCK_TIMEOUT_CLIENT)) <= 0)) {
-	                                     free(rcfile);free(lmech);
-                                             return;
-                                     }
-                                     if ( (bytes_read=recv_socket (sock , bf , sizeof(bf) , SOCK_TIMEOUT_CLIENT)) <= 0 ) {
-	                                     free(rcfile);free(lmech);
-                                             return;
-                                     }
-		                  }
-				  break;
-		        case 'N': /* mserver is down and logging mech. is through NFS */
-			         strcat(nodelogger_buf_notify_short,"Please start mserver and initialize SEQ_LOGGING_MECH=server in ~/.maestrorc file\n");
-	                         if ( strcmp(lmech,"nfs") == 0 ) {
-                                       if ( (fileid = open(LOG_PATH,O_WRONLY|O_CREAT,0755)) > 0 ) {
- 	                                        off_t s_seek=lseek(fileid, 0, SEEK_END);
-		                                num = write(fileid, nodelogger_buf_notify_short, strlen(nodelogger_buf_notify_short));
-		                                fsync(fileid);
-		                                close(fileid);
-                                       } 
-				 } 
-				 break;
-                  }
-		  free(lmech);
-	     }
-	     free(rcfile);
-	 }
-   }
 
+    SeqUtil_TRACE(TL_FULL_TRACE,"spool_nodelog(): returning\n");
+    return(ret);
 }
@@ -0,0 +1,131 @@
+/* statestore_main.c - Command-line API to the status store of the Maestro sequencer software package.
+ * Copyright (C) 2011-2015  Operations division of the Canadian Meteorological Centre
+ *                          Environment Canada
+ *
+ * Maestro is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation,
+ * version 2.1 of the License.
+ *
+ * Maestro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "SeqUtil.h"
+#include "SeqStateStore.h"
+#include "getopt.h"
+
+static void printUsage()
+{
+   char * usage = "DESCRIPTION: statestore: Lists the node states kept in the status store of a\n\
+    datestamp, or writes them back as status files for the tools that read them.\n\
+\n\
+USAGE:\n\
+\n\
+    statestore [-e experiment_home] -d datestamp [-l|-x] [-v]\n\
+\n\
+OPTIONS:\n\
+\n\
+    -e, --exp \n\
+        Experiment path.  If it is not supplied, the environment variable \n\
+        SEQ_EXP_HOME will be used.\n\
+\n\
+    -d, --datestamp \n\
+        14 character datestamp of the status directory.\n\
+\n\
+    -l, --list\n\
+        Print the states of the store, one \"node.ext state\" per line (default)\n\
+\n\
+    -x, --export\n\
+        Create the status files of the states set in the store and remove\n\
+        the status files of the states no longer set\n\
+\n\
+    -v, --verbose\n\
+        Turn on full tracing\n\
+\n\
+    -h, --help\n\
+        Show this help screen\n\
+\n\
+EXAMPLES:\n\
+\n\
+    statestore -d 20150101000000 -x\n";
+   puts(usage);
+}
+
+int main ( int argc, char * argv[] )
+{
+   const char*  short_opts = "e:d:lxvh";
+   extern char* optarg;
+   struct       option long_opts[] =
+   { /*  NAME        ,    has_arg       , flag  val(ID) */
+      {"exp"         , required_argument,   0,     'e'},
+      {"datestamp"   , required_argument,   0,     'd'},
+      {"list"        , no_argument      ,   0,     'l'},
+      {"export"      , no_argument      ,   0,     'x'},
+      {"verbose"     , no_argument      ,   0,     'v'},
+      {"help"        , no_argument      ,   0,     'h'},
+      {NULL,0,0,0} /* End indicator */
+   };
+   int opt_index, c = 0;
+   char *seq_exp_home = NULL, *datestamp = NULL, dir[SEQ_MAXFIELD];
+   int export = 0, ret;
+
+   while ((c = getopt_long(argc, argv, short_opts, long_opts, &opt_index)) != -1) {
+     switch(c) {
+        case 'e':
+           seq_exp_home = strdup( optarg );
+           break;
+        case 'd':
+           datestamp = strdup( optarg );
+           break;
+        case 'l':
+           export = 0;
+           break;
+        case 'x':
+           export = 1;
+           break;
+        case 'v':
+           SeqUtil_setTraceFlag( TRACE_LEVEL , TL_FULL_TRACE );
+           break;
+        case 'h':
+           printUsage();
+           exit(0);
+        case '?':
+           printUsage();
+           exit(1);
+     }
+   }
+
+   if ( seq_exp_home == NULL && (seq_exp_home = getenv("SEQ_EXP_HOME")) == NULL ) {
+      fprintf(stderr, "statestore: SEQ_EXP_HOME not set and no -e experiment_home given\n");
+      exit(1);
+   }
+   if ( datestamp == NULL ) {
+      printUsage();
+      exit(1);
+   }
+
+   snprintf(dir, sizeof dir, "%s/sequencing/status/%s", seq_exp_home, datestamp);
+   if ( export ) {
+      if ( (ret = SeqStateStore_export(dir)) >= 0 ) fprintf(stdout, "statestore: %d status files changed in %s\n", ret, dir);
+   } else {
+      ret = SeqStateStore_list(dir, stdout);
+   }
+   if ( ret < 0 ) {
+      fprintf(stderr, "statestore: no status store in %s\n", dir);
+      exit(1);
+   }
+   SeqStateStore_close();
+   return 0;
+}
@@ -92,9 +92,9 @@ Inputs:
 extern char* tictac_getDate( char* _expHome, char *format, char * datestamp ) {
 
    int i = 0;
-   char *dateFileName = NULL, *tmpstrtok = NULL, *tmpLatestFile=NULL;
+   char *dateFileName = NULL, *tmpstrtok = NULL, *tmpLatestFile=NULL, *saveptr = NULL;
    char statePattern[SEQ_MAXFIELD] = {'\0'};
-   char dateValue[PADDED_DATE_LENGTH] = {'\0'};
+   char dateValue[PADDED_DATE_LENGTH + 1] = {'\0'};
    char* returnDate = NULL, *envDate=NULL;
    size_t counter=0;
    glob_t glob_logs; 
@@ -130,7 +130,7 @@ extern char* tictac_getDate( char* _expHome, char *format, char * datestamp ) {
          }
          globfree(&glob_logs);
          dateFileName = (char*) SeqUtil_getPathLeaf( (const char*) (tmpLatestFile) );
-         sprintf(dateValue,"%s", (char*) strtok( dateFileName, "_" ));
+         sprintf(dateValue,"%.*s", PADDED_DATE_LENGTH, (char*) strtok_r( dateFileName, "_", &saveptr ));
       }
    }
 
@@ -144,7 +144,7 @@ extern char* tictac_getDate( char* _expHome, char *format, char * datestamp ) {
    SeqUtil_TRACE(TL_FULL_TRACE,"tictac_getDate() checking validity of dateValue ... \n");
    checkValidDatestamp(dateValue);
 
-   tmpstrtok = (char*) strtok( format, "%" );
+   tmpstrtok = format != NULL ? strtok_r( format, "%", &saveptr ) : NULL;
    while ( tmpstrtok != NULL ) {
       if (strcmp(tmpstrtok,"Y")==0)
          printf("%.*s", 4, &dateValue[0] );
@@ -158,7 +158,7 @@ extern char* tictac_getDate( char* _expHome, char *format, char * datestamp ) {
          printf("%.*s", 2, &dateValue[10] );
       if (strcmp(tmpstrtok,"S")==0)
          printf("%.*s", 2, &dateValue[12] );
-      tmpstrtok = (char*) strtok(NULL,"%");
+      tmpstrtok = strtok_r(NULL,"%",&saveptr);
    }
 
    if (returnDate = malloc( strlen(dateValue) + 1 )) {
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "SeqNode.h"
 #include "SeqUtil.h"
@@ -8,6 +9,8 @@
 #include "SeqNodeCensus.h"
 /* #include "nodeinfo.h" */
 #include "ResourceVisitor.h"
+#include "XmlUtils.h"
+#include "TsvManifest.h"
 
 static const char *indent = "    ";
 static const char *doubleIndent = "        ";
@@ -188,13 +191,139 @@ enum {
    TSV = 0,
    HUMAN = 1
 };
+
+/********************************************************************************
+ * The resources of the nodes of the census are resolved by a pool of threads.
+ * Each node has its slot, where the thread that took it leaves the records of
+ * the node; the slots are written in the order of the census as they are done,
+ * so the files are the same whatever the number of threads.  The caches of
+ * definition files and xml documents are per thread (see SeqUtil.c and
+ * XmlUtils.c), a thread frees its own when the census is done.
+ * With a manifest, the slots of the nodes whose inputs did not change get
+ * their records from it and are done from the start; the threads only take
+ * the other ones, recording their inputs for the new manifest.
+********************************************************************************/
+typedef struct {
+   PathArgNodePtr item;
+   char *tsv, *hr;         /* the records of the node */
+   size_t tsvLen, hrLen;
+   TsvInputs inputs;       /* with a manifest */
+   int done, resolved;
+} TsvSlot;
+
+typedef struct {
+   const char *seq_exp_home, *datestamp;
+   int tsv, human;         /* records wanted */
+   int record;             /* inputs wanted */
+   TsvSlot *slots;
+   int count, next;
+   int *todo, pending;     /* the slots to resolve */
+   pthread_mutex_t lock;
+   pthread_cond_t slotDone;
+} TsvPool;
+
+/* resolves the resources of the node of slot and writes its records in it */
+static void resolve_slot(TsvPool *pool, TsvSlot *slot)
+{
+   SeqNodeDataPtr ndp = NULL;
+   FILE *fp = NULL;
+
+   /* ndp = nodeinfo(itr->path, NI_RESOURCE_ONLY, NULL, seq_exp_home, NULL, datestamp,NULL ); */
+   ndp = SeqNode_createNode(slot->item->path);
+   /* ndp->datestamp = strdup(datestamp); */
+   SeqNode_setDatestamp(ndp,pool->datestamp);
+   SeqNode_setSeqExpHome(ndp,pool->seq_exp_home);
+   ndp->type = slot->item->type;
+   if( pool->record ) TsvManifest_record(&slot->inputs);
+   getNodeResources(ndp,pool->seq_exp_home,slot->item->path);
+   if( pool->record ) TsvManifest_record(NULL);
+   slot->resolved = 1;
+
+   if( pool->tsv ){
+      if( (fp = open_memstream(&slot->tsv, &slot->tsvLen)) == NULL )
+         raiseError("write_db_file(): Out of memory!\n");
+      node_to_keylist(ndp, fp, TSV);
+      fclose(fp);
+   }
+   if( pool->human ){
+      if( (fp = open_memstream(&slot->hr, &slot->hrLen)) == NULL )
+         raiseError("write_db_file(): Out of memory!\n");
+      node_to_keylist(ndp, fp, HUMAN);
+      fprintf(fp,"\n");
+      fclose(fp);
+   }
+   SeqNode_freeNode(ndp);
+}
+
+/* writes the records of slot */
+static void write_slot(TsvSlot *slot, FILE *tsv_output_fp, FILE *hr_output_fp)
+{
+   if( tsv_output_fp != NULL ){
+      fwrite(slot->tsv, 1, slot->tsvLen, tsv_output_fp);
+      /*
+       * It seems to work even if I don't put the check (i.e. having a space
+       * after the last element in the list), but TCL does do some funny
+       * things sometimes with extra spaces, so as a matter of consistency,
+       * let's avoid the extra space after the last element
+       */
+      if(slot->item->nextPtr != NULL){
+         fprintf(tsv_output_fp, " ");
+      }
+   }
+   if( hr_output_fp != NULL ){
+      fwrite(slot->hr, 1, slot->hrLen, hr_output_fp);
+   }
+}
+
+static void free_slot(TsvSlot *slot)
+{
+   TsvInputs_free(&slot->inputs);
+   free(slot->tsv);
+   free(slot->hr);
+   slot->tsv = slot->hr = NULL;
+}
+
+/* a thread of the pool: takes the next node until there is none */
+static void *resolve_worker(void *arg)
+{
+   TsvPool *pool = (TsvPool *) arg;
+   int i;
+
+   for(;;){
+      pthread_mutex_lock(&pool->lock);
+      i = pool->next < pool->pending ? pool->todo[pool->next++] : -1;
+      pthread_mutex_unlock(&pool->lock);
+      if( i < 0 ) break;
+
+      resolve_slot(pool, &pool->slots[i]);
+
+      pthread_mutex_lock(&pool->lock);
+      pool->slots[i].done = 1;
+      pthread_cond_broadcast(&pool->slotDone);
+      pthread_mutex_unlock(&pool->lock);
+   }
+
+   XmlUtils_flushDocCache();
+   SeqUtil_unmapfiles();
+   return NULL;
+}
+
 /********************************************************************************
  * Creates the tsv compatible and human readable files for storing info on nodes
- * of the experiment.
+ * of the experiment, the resources being resolved by threads threads.  With a
+ * manifest (NULL for none), only the nodes whose inputs changed since it was
+ * written are resolved, and it is written again for the next time.
 ********************************************************************************/
 int write_db_file(const char *seq_exp_home, const char *datestamp,
-                                       FILE *tsv_output_fp, FILE *hr_output_fp)
+                                       FILE *tsv_output_fp, FILE *hr_output_fp, int threads,
+                                       const char *manifest_file)
 {
+   TsvPool pool;
+   TsvManifest *manifest = NULL;
+   TsvSlot *slot = NULL;
+   pthread_t *tids = NULL;
+   int i, started = 0;
+
    /*
     * Get list of nodes in experiment
     */
@@ -207,47 +336,87 @@ int write_db_file(const char *seq_exp_home, const char *datestamp,
     */
    /* SeqListNode_reverseList(&nodeList); */
 
+   memset(&pool, 0, sizeof(pool));
+   pool.seq_exp_home = seq_exp_home;
+   pool.datestamp = datestamp;
    /*
-    * For each node in the list, write an entry in the file
+    * Note that fprintf(NULL,...) is OK, but testing it here avoids testing
+    * for every subsequent fprintf() that results from calling
+    * node_to_keylist().
     */
-   SeqNodeDataPtr ndp = NULL;
+   pool.tsv = ( tsv_output_fp != NULL );
+   pool.human = ( hr_output_fp != NULL );
+   if( manifest_file != NULL ){
+      /* the manifest keeps both records whatever the files asked for */
+      manifest = TsvManifest_load(manifest_file, seq_exp_home, datestamp);
+      pool.tsv = pool.human = pool.record = 1;
+   }
+   for_pap_list(counter,nodeList) pool.count++;
+   if( pool.count > 0 && ((pool.slots = calloc(pool.count, sizeof(TsvSlot))) == NULL ||
+                          (pool.todo = malloc(pool.count * sizeof(int))) == NULL) )
+      raiseError("write_db_file(): Out of memory!\n");
+   i = 0;
    for_pap_list(itr,nodeList){
+      slot = &pool.slots[i];
+      slot->item = itr;
+      if( manifest != NULL && TsvManifest_reuse(manifest, itr->path, itr->type, &slot->tsv, &slot->tsvLen,
+                                                &slot->hr, &slot->hrLen, &slot->inputs) ){
+         slot->done = 1;
+      } else {
+         pool.todo[pool.pending++] = i;
+      }
+      i++;
+   }
 
-      /* ndp = nodeinfo(itr->path, NI_RESOURCE_ONLY, NULL, seq_exp_home, NULL, datestamp,NULL ); */
-      ndp = SeqNode_createNode(itr->path);
-      /* ndp->datestamp = strdup(datestamp); */
-      SeqNode_setDatestamp(ndp,datestamp);
-      SeqNode_setSeqExpHome(ndp,seq_exp_home);
-      ndp->type = itr->type;
-      getNodeResources(ndp,seq_exp_home,itr->path);
-      /*
-       * Note that fprintf(NULL,...) is OK, but testing it here avoids testing
-       * for every subsequent fprintf() that results from calling
-       * node_to_keylist().
-       */
-      if( tsv_output_fp != NULL ){
-         node_to_keylist(ndp, tsv_output_fp, TSV);
-         /*
-          * It seems to work even if I don't put the check (i.e. having a space
-          * after the last element in the list), but TCL does do some funny
-          * things sometimes with extra spaces, so as a matter of consistency,
-          * let's avoid the extra space after the last element
-          */
-         if(itr->nextPtr != NULL){
-            fprintf(tsv_output_fp, " ");
+   if( threads > pool.pending ) threads = pool.pending;
+   if( threads > 1 ){
+      /* libxml2 is initialised by the main thread before the others use it */
+      xmlInitParser();
+      pthread_mutex_init(&pool.lock, NULL);
+      pthread_cond_init(&pool.slotDone, NULL);
+      if( (tids = malloc(threads * sizeof(pthread_t))) == NULL )
+         raiseError("write_db_file(): Out of memory!\n");
+      for( started = 0; started < threads; started++ ){
+         if( pthread_create(&tids[started], NULL, resolve_worker, &pool) != 0 ){
+            SeqUtil_TRACE(TL_ERROR, "write_db_file(): %d threads started out of %d\n", started, threads);
+            break;
          }
       }
+   }
+   SeqUtil_TRACE(TL_FULL_TRACE, "write_db_file(): %d nodes, %d to resolve, %d threads\n", pool.count, pool.pending, started);
+   if( manifest != NULL ) TsvManifest_begin(manifest);
 
-      if( hr_output_fp != NULL ){
-         node_to_keylist(ndp, hr_output_fp, HUMAN);
-         fprintf(hr_output_fp,"\n");
+   /*
+    * For each node in the list, write an entry in the file
+    */
+   for( i = 0; i < pool.count; i++ ){
+      slot = &pool.slots[i];
+      if( started == 0 ){
+         if( ! slot->done ) resolve_slot(&pool, slot);
+      } else {
+         pthread_mutex_lock(&pool.lock);
+         while( ! slot->done ) pthread_cond_wait(&pool.slotDone, &pool.lock);
+         pthread_mutex_unlock(&pool.lock);
       }
-
-      SeqNode_freeNode(ndp);
+      write_slot(slot, tsv_output_fp, hr_output_fp);
+      if( manifest != NULL )
+         TsvManifest_addNode(manifest, slot->item->path, slot->item->type, slot->tsv, slot->tsvLen,
+                             slot->hr, slot->hrLen, &slot->inputs, slot->resolved);
+      free_slot(slot);
    }
+   if( manifest != NULL ) TsvManifest_end(manifest);
 
+   for( i = 0; i < started; i++ ) pthread_join(tids[i], NULL);
+   if( tids != NULL ){
+      pthread_cond_destroy(&pool.slotDone);
+      pthread_mutex_destroy(&pool.lock);
+   }
 
 out_free:
+   free(tids);
+   free(pool.todo);
+   free(pool.slots);
+   TsvManifest_free(manifest);
    PathArgNode_deleteList(&nodeList);
    return 0;
 }
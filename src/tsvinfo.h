@@ -1,3 +1,4 @@
 
 int write_db_file(const char *seq_exp_home, const char *datestamp,
-                       FILE *tsv_output_fp, FILE *hr_output_fp);
+                       FILE *tsv_output_fp, FILE *hr_output_fp, int threads,
+                       const char *manifest_file);
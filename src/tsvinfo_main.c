@@ -25,6 +25,7 @@
 #include "SeqUtil.h"
 #include "SeqDatesUtil.h"
 #include "tsvinfo.h"
+#include "TsvManifest.h"
 
 
 int MLLServerConnectionFid=0;
@@ -42,7 +43,7 @@ DESCRIPTION: tsvinfo\n\
 \n\
 USAGE\n\
 \n\
-    tsvinfo -e SEQ_EXP_HOME -d datestamp [-t tsv-output-file -h human-readable-file]\n\
+    tsvinfo -e SEQ_EXP_HOME -d datestamp [-t tsv-output-file -h human-readable-file] [-j threads] [-i]\n\
 \n\
 OPTIONS\n\
 \n\
@@ -60,6 +61,17 @@ OPTIONS\n\
     -r, --readable-file \n\
         Specify the filename for the human readable output.  If no filename is\n\
         is specified, no output will be generated.\n\
+\n\
+    -j, --threads\n\
+        Number of threads resolving the resources of the nodes (default 4).\n\
+        The output is the same whatever the number of threads.\n\
+\n\
+    -i, --incremental\n\
+        Keep a manifest of the inputs of every node next to the output\n\
+        (tsv-output-file.manifest, or human-readable-file.manifest without a\n\
+        tsv file) and only resolve again the nodes whose xml files, or keys of\n\
+        the definition files, changed since the manifest was written.  The\n\
+        output is the same as without it.\n\
 \n\
     -v, --verbose\n\
         Turn on full tracing\n\
@@ -87,7 +99,13 @@ EXAMPLES:\n\
     tsvinfo -e /home/ops/afsi/phc/.suites/sample -t stdout -r stderr\n\
 \n\
         Send TSV ready output to STDOUT and send human readable output to \n\
-        STDERR.\n";
+        STDERR.\n\
+\n\
+    tsvinfo -e /home/ops/afsi/phc/.suites/sample -t /home/ops/afsi/phc/.suites/sample/resources/tsv_resources.txt -i\n\
+\n\
+        Updates the info file of the GUI after a change of a few resource\n\
+        files, /home/ops/afsi/phc/.suites/sample/resources/tsv_resources.txt.manifest\n\
+        telling which nodes changed.\n";
 puts(usage);
 }
 
@@ -109,7 +127,7 @@ FILE *open_filename( const char *filename)
 
 int main ( int argc, char * argv[] )
 {
-   char * short_opts = "d:e:t:r:vh";
+   char * short_opts = "d:e:t:r:j:ivh";
 
    extern char *optarg;
    extern char *optarg;
@@ -121,15 +139,20 @@ int main ( int argc, char * argv[] )
       {"datestamp"      , required_argument,   0,     'd'},
       {"tsv-file"       , required_argument,   0,     't'},
       {"readable-output", required_argument,   0,     'r'},
+      {"threads"        , required_argument,   0,     'j'},
+      {"incremental"    , no_argument      ,   0,     'i'},
       {"verbose"        , no_argument      ,   0,     'v'},
       {"help"           , no_argument      ,   0,     'h'},
       {NULL,0,0,0} /* End indicator */
    };
-   int opt_index, c = 0, i;
+   int opt_index, c = 0, i, threads = 4, incremental = 0;
 
    char *seq_exp_home = NULL,
         *datestamp = NULL,
-        *tmpDate=NULL;
+        *tmpDate=NULL,
+        *tsv_filename = NULL,
+        *human_filename = NULL,
+        *manifest_file = NULL;
 
    FILE *human_output_fp = NULL,
         *tsv_output_fp = NULL;
@@ -145,9 +168,17 @@ int main ( int argc, char * argv[] )
             break;
          case 'r':
             human_output_fp = open_filename( optarg );
+            human_filename = optarg;
             break;
          case 't':
             tsv_output_fp = open_filename( optarg );
+            tsv_filename = optarg;
+            break;
+         case 'j':
+            threads = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+         case 'i':
+            incremental = 1;
             break;
          case 'v':
             SeqUtil_setTraceFlag(TRACE_LEVEL,TL_FULL_TRACE);
@@ -186,7 +217,20 @@ int main ( int argc, char * argv[] )
       raiseError("Error: Datestamp must be set\n");
    }
 
-   write_db_file(seq_exp_home, datestamp, tsv_output_fp , human_output_fp);
+   if( incremental ){
+      /* the manifest goes next to the first output that is a file */
+      char *output = NULL;
+      if( tsv_output_fp != NULL && tsv_output_fp != stdout && tsv_output_fp != stderr )
+         output = tsv_filename;
+      else if( human_output_fp != NULL && human_output_fp != stdout && human_output_fp != stderr )
+         output = human_filename;
+      else
+         raiseError("Error : option -i (--incremental) needs an output file\n");
+      manifest_file = malloc( strlen(output) + strlen(TSV_MANIFEST_EXT) + 1 );
+      sprintf(manifest_file, "%s%s", output, TSV_MANIFEST_EXT);
+   }
+
+   write_db_file(seq_exp_home, datestamp, tsv_output_fp , human_output_fp, threads, manifest_file);
 
    if( human_output_fp != NULL )
       fclose(human_output_fp);
@@ -194,6 +238,7 @@ int main ( int argc, char * argv[] )
    if( tsv_output_fp != NULL )
       fclose(tsv_output_fp);
 
+   free(manifest_file);
    free(datestamp);
    free(seq_exp_home);
    return 0;